@@ -0,0 +1,464 @@
+// Microbenchmarks of the CPU hot paths, see microbench.h for the flags and the output.
+//   benchmark --benchmark_repetitions=10 --benchmark_out=results.json
+// Two result files are compared with the compare tool.
+// The benchmarks of this file only use the portable files of common, on other platforms build it with them:
+//   benchmark.cpp microbench.cpp clock_correlation.cpp command_recorder.cpp cpu_profiler.cpp frame_stalls.cpp
+//   job_system.cpp json.cpp platform.cpp render_graph.cpp resource_state_tracker.cpp rolling_stats.cpp upload_allocator.cpp
+// The ones of engine_benchmarks.cpp need the Windows SDK, DirectXMath and assimp, it is only part of the Windows build.
+#include "microbench.h"
+#include "clock_correlation.h"
+#include "command_recorder.h"
+#include "cpu_profiler.h"
+#include "job_system.h"
+#include "json.h"
+#include "render_graph.h"
+#include "resource_state_tracker.h"
+#include "rolling_stats.h"
+#include "upload_allocator.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+static void bm_rolling_stats_add(microbench_state &state)
+{
+    rolling_stats stats;
+    double value = 1.0;
+    for (auto _ : state)
+    {
+        stats.add(value);
+        value = value < 100.0 ? value * 1.37 : 0.5;
+    }
+    do_not_optimize(stats);
+    state.set_items_processed((int64_t)state.iterations());
+}
+MICROBENCH(bm_rolling_stats_add);
+
+static void bm_rolling_stats_summary(microbench_state &state)
+{
+    rolling_stats stats((uint32_t)state.range(0));
+    for (int64_t i = 0; i < state.range(0); i++)
+    {
+        stats.add(1.0 + (double)(i % 97) * 0.25);
+    }
+    for (auto _ : state)
+    {
+        rolling_summary summary = stats.summary();
+        do_not_optimize(summary);
+    }
+}
+MICROBENCH_ARGS(bm_rolling_stats_summary, {64}, {256}, {1024});
+
+static void bm_clock_correlation_gpu_to_cpu(microbench_state &state)
+{
+    clock_correlation correlation;
+    correlation.set_frequencies(25000000.0, 10000000.0);
+    for (uint64_t i = 0; i < clock_correlation::default_max_samples; i++)
+    {
+        correlation.add_sample(i * 12500000, i * 5000000 + (i % 3));
+    }
+    uint64_t gpu_ticks = 1000;
+    for (auto _ : state)
+    {
+        uint64_t cpu_ticks = correlation.gpu_to_cpu(gpu_ticks);
+        do_not_optimize(cpu_ticks);
+        gpu_ticks += 4096;
+    }
+}
+MICROBENCH(bm_clock_correlation_gpu_to_cpu);
+
+static void bm_profile_scope(microbench_state &state)
+{
+    // The records of a thread are dropped once its buffer is full, end the frame before that.
+    const uint64_t scopes_per_frame = profile_thread_buffer::capacity / 4;
+    uint64_t num_scopes = 0;
+    for (auto _ : state)
+    {
+        {
+            PROFILE_SCOPE("bm_profile_scope");
+        }
+        if (++num_scopes == scopes_per_frame)
+        {
+            state.pause_timing();
+            g_cpu_profiler.end_frame();
+            num_scopes = 0;
+            state.resume_timing();
+        }
+    }
+    g_cpu_profiler.end_frame();
+}
+MICROBENCH(bm_profile_scope);
+
+static void bm_job_system_parallel_for(microbench_state &state)
+{
+    job_system jobs;
+    jobs.start();
+    uint32_t count = (uint32_t)state.range(0);
+    std::vector<float> values(count, 1.0f);
+    auto scale = [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++)
+        {
+            values[i] = values[i] * 0.5f + 1.0f;
+        }
+    };
+    for (auto _ : state)
+    {
+        job_counter counter;
+        jobs.parallel_for(count, 256, scale, &counter);
+        jobs.wait(&counter);
+    }
+    do_not_optimize(values);
+    jobs.stop();
+    state.set_items_processed((int64_t)state.iterations() * count);
+}
+MICROBENCH_ARGS(bm_job_system_parallel_for, {1024}, {65536});
+
+// Scheduling cost against the number of threads, from 1 (everything inline on the caller) to oversubscription.
+// Each iteration runs 1024 small jobs from the main thread and waits for them, the workers steal from its queue.
+static void bm_job_system_threads(microbench_state &state)
+{
+    uint32_t num_threads = (uint32_t)state.range(0);
+    job_system jobs;
+    jobs.start(num_threads - 1);
+
+    const uint32_t num_jobs = 1024;
+    std::vector<uint64_t> values(num_jobs * 8, 1);
+    for (auto _ : state)
+    {
+        job_counter counter;
+        for (uint32_t i = 0; i < num_jobs; i++)
+        {
+            uint64_t *value = &values[i * 8]; // One cache line per job.
+            jobs.run([value]() { *value = *value * 6364136223846793005ull + 1442695040888963407ull; }, &counter);
+        }
+        jobs.wait(&counter);
+    }
+    do_not_optimize(values);
+    state.set_items_processed((int64_t)state.iterations() * num_jobs);
+    state.set_label(std::to_string(jobs.m_num_steals.load()) + " steals");
+    jobs.stop();
+}
+MICROBENCH_ARGS(bm_job_system_threads, {1}, {2}, {4}, {8}, {16}, {32}, {64});
+
+// Threads that run the same function together, started once so that the runs only time the function.
+// The calling thread is thread 0.
+class thread_gang
+{
+public:
+    explicit thread_gang(uint32_t num_threads)
+    {
+        for (uint32_t i = 1; i < num_threads; i++)
+        {
+            m_threads.emplace_back([this, i]() {
+                uint64_t generation = 0;
+                while (true)
+                {
+                    while (m_generation.load(std::memory_order_acquire) == generation)
+                    {
+                        std::this_thread::yield();
+                    }
+                    generation++;
+                    if (m_is_stopping.load(std::memory_order_relaxed))
+                    {
+                        return;
+                    }
+                    m_function(i);
+                    m_num_done.fetch_add(1, std::memory_order_release);
+                }
+            });
+        }
+    }
+
+    ~thread_gang()
+    {
+        m_is_stopping.store(true, std::memory_order_relaxed);
+        m_generation.fetch_add(1, std::memory_order_release);
+        for (std::thread &thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    template <typename F>
+    void run(F function)
+    {
+        m_function = function;
+        m_num_done.store(0, std::memory_order_relaxed);
+        m_generation.fetch_add(1, std::memory_order_release);
+        function(0);
+        while (m_num_done.load(std::memory_order_acquire) != m_threads.size())
+        {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    std::vector<std::thread> m_threads;
+    std::function<void(uint32_t)> m_function;
+    std::atomic<uint64_t> m_generation{0};
+    std::atomic<size_t> m_num_done{0};
+    std::atomic<bool> m_is_stopping{false};
+};
+
+// Constants of the geometry pass allocated and copied from several threads at the same time, as the recording jobs
+// do, with the per-thread blocks of upload_allocator or with one pointer bumped under a mutex.
+static const uint32_t upload_allocations_per_thread = 1024;
+static const size_t upload_constants_size = 128;
+static const size_t upload_alignment = 256;
+
+static void bm_upload_allocator_threads(microbench_state &state)
+{
+    uint32_t num_threads = (uint32_t)state.range(0);
+    size_t size_per_thread = upload_allocations_per_thread * upload_alignment + 2 * upload_allocator::block_size;
+    std::vector<uint8_t> memory(num_threads * size_per_thread);
+    upload_allocator allocator;
+    allocator.init(memory.data(), memory.size());
+    uint8_t constants[upload_constants_size] = {};
+
+    thread_gang gang(num_threads);
+    for (auto _ : state)
+    {
+        allocator.reset();
+        gang.run([&](uint32_t) {
+            for (uint32_t i = 0; i < upload_allocations_per_thread; i++)
+            {
+                uint8_t *dest = allocator.allocate(upload_constants_size, upload_alignment);
+                memcpy(dest, constants, upload_constants_size);
+            }
+        });
+    }
+    do_not_optimize(memory);
+    state.set_items_processed((int64_t)state.iterations() * num_threads * upload_allocations_per_thread);
+}
+MICROBENCH_ARGS(bm_upload_allocator_threads, {1}, {2}, {4}, {8}, {16});
+
+static void bm_upload_mutex_threads(microbench_state &state)
+{
+    uint32_t num_threads = (uint32_t)state.range(0);
+    std::vector<uint8_t> memory(num_threads * upload_allocations_per_thread * upload_alignment + upload_alignment);
+    std::mutex mutex;
+    size_t offset = 0;
+    uint8_t constants[upload_constants_size] = {};
+
+    thread_gang gang(num_threads);
+    for (auto _ : state)
+    {
+        offset = 0;
+        gang.run([&](uint32_t) {
+            for (uint32_t i = 0; i < upload_allocations_per_thread; i++)
+            {
+                uint8_t *dest = nullptr;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    offset = (offset + upload_alignment - 1) / upload_alignment * upload_alignment;
+                    dest = memory.data() + offset;
+                    offset += upload_constants_size;
+                }
+                memcpy(dest, constants, upload_constants_size);
+            }
+        });
+    }
+    do_not_optimize(memory);
+    state.set_items_processed((int64_t)state.iterations() * num_threads * upload_allocations_per_thread);
+}
+MICROBENCH_ARGS(bm_upload_mutex_threads, {1}, {2}, {4}, {8}, {16});
+
+// D3D12_RESOURCE_STATES values used by the passes of the frame.
+static const uint32_t state_render_target = 0x4;
+static const uint32_t state_unordered_access = 0x8;
+static const uint32_t state_pixel_shader_resource = 0x80;
+static const uint32_t state_copy_dest = 0x400;
+
+static const void *fake_resource(uint32_t index)
+{
+    return reinterpret_cast<const void *>((uintptr_t)(0x1000 + index * 64));
+}
+
+// A list that uses each resource in four passes, flushing the batched transitions before each pass.
+static void bm_state_tracker_batching(microbench_state &state)
+{
+    uint32_t num_resources = (uint32_t)state.range(0);
+    const uint32_t pass_states[] = {state_copy_dest, state_pixel_shader_resource, state_render_target, state_unordered_access};
+    resource_state_tracker tracker;
+    std::vector<tracked_barrier> barriers;
+    for (auto _ : state)
+    {
+        tracker.reset();
+        barriers.clear();
+        for (uint32_t pass_state : pass_states)
+        {
+            for (uint32_t i = 0; i < num_resources; i++)
+            {
+                tracker.require(fake_resource(i), pass_state);
+            }
+            tracker.flush(&barriers);
+        }
+        do_not_optimize(barriers);
+    }
+    state.set_items_processed((int64_t)state.iterations() * num_resources * 4);
+}
+MICROBENCH_ARGS(bm_state_tracker_batching, {64}, {1024});
+
+// Submission of a list whose resources all need a fixup barrier against the states of the previous list.
+static void bm_state_registry_resolve(microbench_state &state)
+{
+    uint32_t num_resources = (uint32_t)state.range(0);
+    resource_state_registry registry;
+    for (uint32_t i = 0; i < num_resources; i++)
+    {
+        registry.register_resource(fake_resource(i), state_copy_dest);
+    }
+
+    resource_state_tracker lists[2];
+    const uint32_t list_states[] = {state_pixel_shader_resource, state_copy_dest};
+    for (int list = 0; list < 2; list++)
+    {
+        for (uint32_t i = 0; i < num_resources; i++)
+        {
+            lists[list].require(fake_resource(i), list_states[list]);
+        }
+    }
+
+    std::vector<tracked_barrier> fixups;
+    uint64_t num_fixups = 0;
+    uint32_t list = 0;
+    for (auto _ : state)
+    {
+        fixups.clear();
+        registry.resolve(lists[list], &fixups);
+        num_fixups += fixups.size();
+        list ^= 1;
+    }
+    state.set_items_processed((int64_t)state.iterations() * num_resources);
+    state.set_label(std::to_string(num_fixups / (std::max)(state.iterations(), (uint64_t)1)) + " fixups per list");
+}
+MICROBENCH_ARGS(bm_state_registry_resolve, {64}, {1024});
+
+// Graph of passes that each write a target and read the targets of the two passes before, rebuilt and compiled
+// every frame like the one of particles_graphics. A side branch is culled.
+static void bm_render_graph_compile(microbench_state &state)
+{
+    uint32_t num_passes = (uint32_t)state.range(0);
+    render_graph graph;
+    uint64_t num_barriers = 0;
+    for (auto _ : state)
+    {
+        graph.reset();
+        std::vector<render_graph_handle> targets;
+        for (uint32_t i = 0; i < num_passes + 1; i++)
+        {
+            targets.push_back(graph.import_resource("target", fake_resource(i), state_pixel_shader_resource));
+        }
+        graph.set_output(targets[num_passes - 1]);
+
+        for (uint32_t i = 0; i < num_passes; i++)
+        {
+            render_graph_handle pass = graph.add_pass("pass", []() {});
+            graph.write(pass, targets[i], state_render_target);
+            for (uint32_t previous = (i < 2) ? 0 : i - 2; previous < i; previous++)
+            {
+                graph.read(pass, targets[previous], state_pixel_shader_resource);
+            }
+        }
+        render_graph_handle unused = graph.add_pass("unused", []() {});
+        graph.write(unused, targets[num_passes], state_unordered_access);
+
+        bool is_compiled = graph.compile();
+        do_not_optimize(is_compiled);
+        num_barriers += graph.m_num_barriers;
+    }
+    state.set_items_processed((int64_t)state.iterations() * num_passes);
+    state.set_label(std::to_string(num_barriers / (std::max)(state.iterations(), (uint64_t)1)) + " barriers");
+}
+MICROBENCH_ARGS(bm_render_graph_compile, {16}, {128});
+
+// Draws of the geometry pass on the null backend: object constants uploaded and bound, three textures staged in
+// the descriptor tables, an indexed draw.
+static const size_t draw_constants_size = 256;
+
+static void record_draws(command_recorder *recorder, uint32_t num_draws)
+{
+    uint8_t constants[draw_constants_size] = {};
+    recorder->begin(1);
+    recorder->begin_pass("Geometry pass");
+    recorder->set_root_signature(2, false);
+    recorder->set_viewport(1920.f, 1080.f);
+    recorder->set_primitive_topology(topology_triangle_list);
+    for (uint32_t i = 0; i < num_draws; i++)
+    {
+        constants[0] = (uint8_t)i;
+        recorder->set_root_constant_buffer(0, recorder->upload(constants, sizeof(constants), 256));
+        recorder->stage_descriptor(PS, SRV, 0, 0x10000 + i * 3);
+        recorder->stage_descriptor(PS, SRV, 1, 0x10001 + i * 3);
+        recorder->stage_descriptor(PS, SRV, 2, 0x10002 + i * 3);
+        recorder->set_descriptor_tables();
+        recorder->draw_indexed(3000, 1, i * 3000, 0, 0);
+    }
+    recorder->end_pass();
+    recorder->end();
+}
+
+static void bm_null_recorder_draws(microbench_state &state)
+{
+    uint32_t num_draws = (uint32_t)state.range(0);
+    null_device device;
+    null_command_recorder *recorder = static_cast<null_command_recorder *>(device.create_recorder(false));
+    for (auto _ : state)
+    {
+        device.begin_frame();
+        record_draws(recorder, num_draws);
+    }
+    state.set_items_processed((int64_t)state.iterations() * num_draws);
+    state.set_bytes_processed((int64_t)(state.iterations() * recorder->stream().size()));
+}
+MICROBENCH_ARGS(bm_null_recorder_draws, {256}, {4096});
+
+// The chunks of the geometry pass recorded by several threads at the same time, each on its own recorder, with the
+// upload memory of the device shared.
+static void bm_null_recorder_threads(microbench_state &state)
+{
+    uint32_t num_threads = (uint32_t)state.range(0);
+    const uint32_t draws_per_thread = 1024;
+    null_device device;
+    std::vector<command_recorder *> recorders;
+    for (uint32_t i = 0; i < num_threads; i++)
+    {
+        recorders.push_back(device.create_recorder(false));
+    }
+
+    thread_gang gang(num_threads);
+    for (auto _ : state)
+    {
+        device.begin_frame();
+        gang.run([&](uint32_t thread) { record_draws(recorders[thread], draws_per_thread); });
+    }
+    state.set_items_processed((int64_t)state.iterations() * num_threads * draws_per_thread);
+}
+MICROBENCH_ARGS(bm_null_recorder_threads, {1}, {2}, {4}, {8}, {16});
+
+static void bm_json_parse(microbench_state &state)
+{
+    std::string text = "{\"benchmarks\": [";
+    for (int64_t i = 0; i < state.range(0); i++)
+    {
+        text += i == 0 ? "" : ",";
+        text += "{\"name\": \"bm_" + std::to_string(i) + "\", \"real_time\": 12.5, \"cpu_time\": 12.25, \"time_unit\": \"ns\"}";
+    }
+    text += "]}";
+    for (auto _ : state)
+    {
+        json_value value;
+        json_parse(text, &value);
+        do_not_optimize(value);
+    }
+    state.set_bytes_processed((int64_t)(state.iterations() * text.size()));
+}
+MICROBENCH_ARGS(bm_json_parse, {16}, {256});
+
+int main(int argc, char **argv)
+{
+    return microbench_main(argc, argv);
+}
@@ -0,0 +1,269 @@
+// Microbenchmarks of the engine hot paths that need the Windows SDK, DirectXMath and assimp.
+// The allocators run on CPU memory instead of mapped upload buffers, the descriptor allocator needs a device.
+#include "microbench.h"
+#include "camera.h"
+#include "common.h"
+#include "gpu_interface.h"
+#include "math_helpers.h"
+#include "mesh.h"
+#include "transform.h"
+#include <vector>
+
+using namespace DirectX;
+
+static void bm_transform_update_world(microbench_state &state)
+{
+    transform t(XMFLOAT3(1.f, 2.f, 3.f), XMFLOAT3(0.1f, 0.2f, 0.3f), XMFLOAT3(2.f, 2.f, 2.f));
+    for (auto _ : state)
+    {
+        t.m_rotation.y += 0.001f;
+        t.update_world();
+        do_not_optimize(t.m_world);
+    }
+}
+MICROBENCH(bm_transform_update_world);
+
+static void bm_camera_update_view_proj(microbench_state &state)
+{
+    camera cam(16.f / 9.f, transform(XMFLOAT3(0.f, 5.f, -20.f)));
+    for (auto _ : state)
+    {
+        cam.m_transform.m_translation.x += 0.001f;
+        cam.update_view_proj();
+        do_not_optimize(cam.m_view_proj);
+    }
+}
+MICROBENCH(bm_camera_update_view_proj);
+
+static void bm_is_aabb_visible(microbench_state &state)
+{
+    // Frustum of a camera at the origin looking down +z, boxes on a grid around it: about half are visible.
+    camera cam(16.f / 9.f, transform(), 1.f, 1000.f);
+    XMVECTOR planes[6] = {
+        XMLoadFloat4(&cam.m_near_plane), XMLoadFloat4(&cam.m_far_plane),
+        XMLoadFloat4(&cam.m_left_plane), XMLoadFloat4(&cam.m_right_plane),
+        XMLoadFloat4(&cam.m_top_plane), XMLoadFloat4(&cam.m_bottom_plane)};
+
+    uint32_t count = (uint32_t)state.range(0);
+    std::vector<XMFLOAT3> centers(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        centers[i] = XMFLOAT3(random_float(-100.f, 100.f), random_float(-100.f, 100.f), random_float(-100.f, 100.f));
+    }
+    XMVECTOR extents = XMVectorSet(1.f, 1.f, 1.f, 0.f);
+
+    uint32_t num_visible = 0;
+    for (auto _ : state)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            num_visible += is_aabb_visible(planes, XMLoadFloat3(&centers[i]), extents) ? 1 : 0;
+        }
+    }
+    do_not_optimize(num_visible);
+    state.set_items_processed((int64_t)state.iterations() * count);
+}
+MICROBENCH_ARGS(bm_is_aabb_visible, {64}, {4096});
+
+static void bm_random_float(microbench_state &state)
+{
+    for (auto _ : state)
+    {
+        float value = random_float(0.f, 1.f);
+        do_not_optimize(value);
+    }
+}
+MICROBENCH(bm_random_float);
+
+static void bm_gaussian_random_float(microbench_state &state)
+{
+    for (auto _ : state)
+    {
+        float value = gaussian_random_float(0.f, 1.f);
+        do_not_optimize(value);
+    }
+}
+MICROBENCH(bm_gaussian_random_float);
+
+static void bm_align_up(microbench_state &state)
+{
+    size_t value = 1;
+    size_t alignment = (size_t)state.range(0);
+    for (auto _ : state)
+    {
+        do_not_optimize(value);
+        size_t aligned = align_up(value, alignment);
+        do_not_optimize(aligned);
+        value += 7;
+    }
+}
+MICROBENCH_ARGS(bm_align_up, {256}, {65536});
+
+static void bm_num_mipmap_levels(microbench_state &state)
+{
+    uint64_t size = 1;
+    for (auto _ : state)
+    {
+        do_not_optimize(size);
+        uint64_t levels = num_mipmap_levels(size, size / 2 + 1);
+        do_not_optimize(levels);
+        size = size < 16384 ? size * 2 + 1 : 1;
+    }
+}
+MICROBENCH(bm_num_mipmap_levels);
+
+// Grid of grid_size * grid_size vertices with every attribute, two triangles per cell.
+static aiMesh *create_grid_mesh(uint32_t grid_size)
+{
+    aiMesh *grid = new aiMesh();
+    grid->mName = "grid";
+    grid->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+    grid->mMaterialIndex = 0;
+    grid->mNumVertices = grid_size * grid_size;
+    grid->mVertices = new aiVector3D[grid->mNumVertices];
+    grid->mNormals = new aiVector3D[grid->mNumVertices];
+    grid->mTangents = new aiVector3D[grid->mNumVertices];
+    grid->mBitangents = new aiVector3D[grid->mNumVertices];
+    grid->mTextureCoords[0] = new aiVector3D[grid->mNumVertices];
+    grid->mNumUVComponents[0] = 2;
+    for (uint32_t y = 0; y < grid_size; y++)
+    {
+        for (uint32_t x = 0; x < grid_size; x++)
+        {
+            uint32_t i = y * grid_size + x;
+            grid->mVertices[i] = aiVector3D((float)x, 0.f, (float)y);
+            grid->mNormals[i] = aiVector3D(0.f, 1.f, 0.f);
+            grid->mTangents[i] = aiVector3D(1.f, 0.f, 0.f);
+            grid->mBitangents[i] = aiVector3D(0.f, 0.f, 1.f);
+            grid->mTextureCoords[0][i] = aiVector3D((float)x / grid_size, (float)y / grid_size, 0.f);
+        }
+    }
+
+    uint32_t cells = grid_size - 1;
+    grid->mNumFaces = cells * cells * 2;
+    grid->mFaces = new aiFace[grid->mNumFaces];
+    for (uint32_t y = 0; y < cells; y++)
+    {
+        for (uint32_t x = 0; x < cells; x++)
+        {
+            uint32_t corner = y * grid_size + x;
+            uint32_t corners[2][3] = {{corner, corner + grid_size, corner + 1},
+                                      {corner + 1, corner + grid_size, corner + grid_size + 1}};
+            for (uint32_t triangle = 0; triangle < 2; triangle++)
+            {
+                aiFace &face = grid->mFaces[(y * cells + x) * 2 + triangle];
+                face.mNumIndices = 3;
+                face.mIndices = new unsigned int[3];
+                for (uint32_t j = 0; j < 3; j++)
+                {
+                    face.mIndices[j] = corners[triangle][j];
+                }
+            }
+        }
+    }
+    return grid;
+}
+
+static void bm_process_mesh(microbench_state &state)
+{
+    // The indices are 16 bits, at most 256 * 256 vertices.
+    uint32_t grid_size = (uint32_t)state.range(0);
+    aiScene scene;
+    scene.mNumMeshes = 1;
+    scene.mMeshes = new aiMesh *[1];
+    scene.mMeshes[0] = create_grid_mesh(grid_size);
+    scene.mNumMaterials = 1;
+    scene.mMaterials = new aiMaterial *[1];
+    scene.mMaterials[0] = new aiMaterial();
+
+    mesh m;
+    for (auto _ : state)
+    {
+        mesh::asset_data asset = m.process_mesh(scene.mMeshes[0], &scene);
+        do_not_optimize(asset);
+    }
+    state.set_items_processed((int64_t)state.iterations() * grid_size * grid_size);
+}
+MICROBENCH_ARGS(bm_process_mesh, {16}, {256});
+
+static void bm_frame_resources_allocate(microbench_state &state)
+{
+    typedef gpu_interface::frame_resource::frame_resources_allocator allocator_type;
+    const size_t buffer_size = 64 * 1024 * 1024;
+    std::vector<UINT8> buffer(buffer_size);
+    allocator_type allocator;
+    allocator.init(buffer.data(), buffer_size);
+
+    size_t size = (size_t)state.range(0);
+    for (auto _ : state)
+    {
+        UINT8 *data = allocator.allocate(size, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+        do_not_optimize(data);
+        if (allocator.used() + 2 * allocator_type::block_size > buffer_size)
+        {
+            state.pause_timing();
+            allocator.reset();
+            state.resume_timing();
+        }
+    }
+    state.set_bytes_processed((int64_t)(state.iterations() * size));
+}
+MICROBENCH_ARGS(bm_frame_resources_allocate, {256}, {32768});
+
+static void bm_resource_uploader_allocate(microbench_state &state)
+{
+    const size_t buffer_size = 64 * 1024 * 1024;
+    std::vector<UINT8> buffer(buffer_size);
+    gpu_interface::resource_uploader uploader;
+    uploader.m_begin = buffer.data();
+    uploader.m_end = buffer.data() + buffer_size;
+    uploader.m_current = uploader.m_begin;
+
+    UINT64 size = (UINT64)state.range(0);
+    for (auto _ : state)
+    {
+        if (uploader.m_current + align_up(size, 256) > uploader.m_end)
+        {
+            state.pause_timing();
+            uploader.m_current = uploader.m_begin;
+            state.resume_timing();
+        }
+        UINT8 *data = uploader.allocate(size, 256);
+        do_not_optimize(data);
+    }
+    state.set_bytes_processed((int64_t)(state.iterations() * size));
+}
+MICROBENCH_ARGS(bm_resource_uploader_allocate, {256}, {32768});
+
+static void bm_descriptor_allocate(microbench_state &state)
+{
+    ComPtr<ID3D12Device> device;
+    if (FAILED(D3D12CreateDevice(nullptr, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&device))))
+    {
+        state.skip_with_error("No D3D12 device");
+        return;
+    }
+
+    gpu_interface::descriptor_allocator allocator;
+    allocator.max_descriptor_count = 4096;
+    allocator.descriptor_size = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    allocator.descriptor_count.store(0);
+    D3D12_DESCRIPTOR_HEAP_DESC heap_desc = {};
+    heap_desc.NumDescriptors = allocator.max_descriptor_count;
+    heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+    check_hr(device->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&allocator.m_staging_heap)));
+
+    for (auto _ : state)
+    {
+        if (allocator.descriptor_count.load(std::memory_order_relaxed) == allocator.max_descriptor_count)
+        {
+            state.pause_timing();
+            allocator.descriptor_count.store(0);
+            state.resume_timing();
+        }
+        size_t handle = allocator.allocate();
+        do_not_optimize(handle);
+    }
+}
+MICROBENCH(bm_descriptor_allocate);
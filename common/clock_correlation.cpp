@@ -0,0 +1,90 @@
+#include "clock_correlation.h"
+#include <algorithm>
+#include <math.h>
+
+// A measured rate further than this from the nominal one comes from a bad sample, e.g. a clock that was reset.
+static const double max_rate_error = 0.01;
+
+clock_correlation::clock_correlation(uint32_t max_samples)
+    : m_max_samples((std::max)(max_samples, 1u))
+{
+    m_samples.reserve(m_max_samples);
+}
+
+void clock_correlation::set_frequencies(double gpu_frequency, double cpu_frequency)
+{
+    m_nominal_rate = cpu_frequency / gpu_frequency;
+    clear();
+}
+
+void clock_correlation::clear()
+{
+    m_samples.clear();
+    m_next = 0;
+    m_last = {};
+    m_rate = m_nominal_rate;
+    m_offset = 0.0;
+    m_max_residual = 0.0;
+}
+
+void clock_correlation::add_sample(uint64_t gpu_ticks, uint64_t cpu_ticks)
+{
+    if (m_samples.size() < m_max_samples)
+    {
+        m_samples.push_back({gpu_ticks, cpu_ticks});
+    }
+    else
+    {
+        m_samples[m_next] = {gpu_ticks, cpu_ticks};
+        m_next = (m_next + 1) % m_max_samples;
+    }
+    m_last = {gpu_ticks, cpu_ticks};
+    fit();
+}
+
+void clock_correlation::fit()
+{
+    // Relative to the last sample, so that the values stay small enough for the precision of doubles.
+    size_t count = m_samples.size();
+    double mean_x = 0.0;
+    double mean_y = 0.0;
+    for (const clock_sample &sample : m_samples)
+    {
+        mean_x += (double)(int64_t)(sample.gpu_ticks - m_last.gpu_ticks);
+        mean_y += (double)(int64_t)(sample.cpu_ticks - m_last.cpu_ticks);
+    }
+    mean_x /= count;
+    mean_y /= count;
+
+    double sum_xx = 0.0;
+    double sum_xy = 0.0;
+    for (const clock_sample &sample : m_samples)
+    {
+        double x = (double)(int64_t)(sample.gpu_ticks - m_last.gpu_ticks) - mean_x;
+        double y = (double)(int64_t)(sample.cpu_ticks - m_last.cpu_ticks) - mean_y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+    }
+
+    m_rate = sum_xx > 0.0 ? sum_xy / sum_xx : m_nominal_rate;
+    if (fabs(m_rate / m_nominal_rate - 1.0) > max_rate_error)
+    {
+        m_rate = m_nominal_rate;
+    }
+    m_offset = mean_y - m_rate * mean_x;
+
+    m_max_residual = 0.0;
+    for (const clock_sample &sample : m_samples)
+    {
+        double x = (double)(int64_t)(sample.gpu_ticks - m_last.gpu_ticks);
+        double y = (double)(int64_t)(sample.cpu_ticks - m_last.cpu_ticks);
+        m_max_residual = (std::max)(m_max_residual, fabs(y - (m_offset + m_rate * x)));
+    }
+}
+
+uint64_t clock_correlation::gpu_to_cpu(uint64_t gpu_ticks) const
+{
+    double x = (double)(int64_t)(gpu_ticks - m_last.gpu_ticks);
+    int64_t y = (int64_t)llround(m_offset + m_rate * x);
+    return m_last.cpu_ticks + (uint64_t)y;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "common_api.h"
+#include <stdint.h>
+#include <vector>
+
+// Mapping of the timestamps of a GPU queue to the CPU clock.
+// The samples are pairs of GPU and CPU timestamps taken at the same time (ID3D12CommandQueue::GetClockCalibration()).
+// The two clocks drift apart, so instead of the nominal frequency ratio the mapping is a line fitted by least squares
+// through the last samples: cpu = last_cpu + offset + rate * (gpu - last_gpu). The rate is the measured CPU ticks per
+// GPU tick, the offset absorbs the jitter of the last sample. With a single sample the nominal ratio is used.
+// Timestamps are unsigned ticks, the differences are taken as signed so they can be on either side of a sample.
+// Device independent: the samples are plain ticks, the caller reads them from the queue.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+struct clock_sample
+{
+    uint64_t gpu_ticks;
+    uint64_t cpu_ticks;
+};
+
+class COMMON_API clock_correlation
+{
+public:
+    static const uint32_t default_max_samples = 16;
+
+    clock_correlation(uint32_t max_samples = default_max_samples);
+    ~clock_correlation() = default;
+
+    // Ticks per second of the two clocks, clears the samples.
+    void set_frequencies(double gpu_frequency, double cpu_frequency);
+
+    // Replaces the oldest sample once max_samples are kept, and fits the line again.
+    void add_sample(uint64_t gpu_ticks, uint64_t cpu_ticks);
+    void clear();
+    uint32_t num_samples() const { return (uint32_t)m_samples.size(); }
+    bool is_calibrated() const { return !m_samples.empty(); }
+
+    uint64_t gpu_to_cpu(uint64_t gpu_ticks) const;
+
+    // CPU ticks per GPU tick, measured and from the frequencies.
+    double rate() const { return m_rate; }
+    double nominal_rate() const { return m_nominal_rate; }
+
+    // Difference of the measured rate from the nominal one, in parts per million.
+    double drift_ppm() const { return (m_rate / m_nominal_rate - 1.0) * 1000000.0; }
+
+    // Largest distance of a sample to the line, in CPU ticks.
+    double max_residual() const { return m_max_residual; }
+
+private:
+    void fit();
+
+    std::vector<clock_sample> m_samples; // Ring buffer, m_next is the oldest once it is full.
+    uint32_t m_max_samples;
+    uint32_t m_next = 0;
+    clock_sample m_last = {};
+    double m_nominal_rate = 1.0;
+    double m_rate = 1.0;
+    double m_offset = 0.0;
+    double m_max_residual = 0.0;
+};
+
+#pragma warning(pop)
@@ -0,0 +1,627 @@
+#include "command_capture.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+
+static const char capture_magic[4] = {'C', 'M', 'D', 'S'};
+
+static double now_ns()
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Reads the arguments of the commands back, fails instead of reading past the end.
+struct stream_reader
+{
+    const uint8_t *m_current;
+    const uint8_t *m_end;
+    bool m_failed = false;
+
+    bool read_bytes(void *out, size_t size)
+    {
+        if (m_failed || (size_t)(m_end - m_current) < size)
+        {
+            m_failed = true;
+            return false;
+        }
+        memcpy(out, m_current, size);
+        m_current += size;
+        return true;
+    }
+
+    template <typename T>
+    T read()
+    {
+        T value = {};
+        read_bytes(&value, sizeof(T));
+        return value;
+    }
+};
+
+void command_capture::add_submission(uint8_t queue, command_recorder *const *recorders, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const null_command_recorder *recorder = static_cast<const null_command_recorder *>(recorders[i]);
+        captured_list list;
+        list.queue = queue;
+        list.submission = m_num_submissions;
+        list.is_compute = recorder->is_compute();
+        list.bytes.assign(recorder->stream().data(), recorder->stream().data() + recorder->stream().size());
+        m_lists.push_back(std::move(list));
+    }
+    m_num_submissions++;
+}
+
+uint64_t command_capture::size_bytes() const
+{
+    uint64_t size = 0;
+    for (const captured_list &list : m_lists)
+    {
+        size += list.bytes.size();
+    }
+    return size;
+}
+
+bool command_capture::save(const char *path, std::string *error) const
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        if (error)
+        {
+            *error = std::string("Could not open ") + path;
+        }
+        return false;
+    }
+
+    command_stream header;
+    header.write_bytes(capture_magic, sizeof(capture_magic));
+    header.write(command_stream_version);
+    header.write((uint32_t)m_lists.size());
+    header.write(m_num_submissions);
+    file.write((const char *)header.data(), header.size());
+    for (const captured_list &list : m_lists)
+    {
+        command_stream list_header;
+        list_header.write(list.queue);
+        list_header.write((uint8_t)list.is_compute);
+        list_header.write(list.submission);
+        list_header.write((uint64_t)list.bytes.size());
+        file.write((const char *)list_header.data(), list_header.size());
+        file.write((const char *)list.bytes.data(), list.bytes.size());
+    }
+
+    if (!file && error)
+    {
+        *error = std::string("Could not write ") + path;
+    }
+    return (bool)file;
+}
+
+bool command_capture::load(const char *path, std::string *error)
+{
+    clear();
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        if (error)
+        {
+            *error = std::string("Could not open ") + path;
+        }
+        return false;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    stream_reader reader = {bytes.data(), bytes.data() + bytes.size()};
+    char magic[sizeof(capture_magic)] = {};
+    reader.read_bytes(magic, sizeof(magic));
+    uint32_t version = reader.read<uint32_t>();
+    uint32_t num_lists = reader.read<uint32_t>();
+    m_num_submissions = reader.read<uint32_t>();
+    if (reader.m_failed || memcmp(magic, capture_magic, sizeof(magic)) != 0 || version != command_stream_version)
+    {
+        if (error)
+        {
+            *error = std::string(path) + " is not a capture of version " + std::to_string(command_stream_version);
+        }
+        clear();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < num_lists && !reader.m_failed; i++)
+    {
+        captured_list list;
+        list.queue = reader.read<uint8_t>();
+        list.is_compute = reader.read<uint8_t>() != 0;
+        list.submission = reader.read<uint32_t>();
+        uint64_t size = reader.read<uint64_t>();
+        if (reader.m_failed || size > (uint64_t)(reader.m_end - reader.m_current))
+        {
+            reader.m_failed = true;
+            break;
+        }
+        list.bytes.assign(reader.m_current, reader.m_current + size);
+        reader.m_current += size;
+        m_lists.push_back(std::move(list));
+    }
+
+    if (reader.m_failed)
+    {
+        if (error)
+        {
+            *error = std::string(path) + " is truncated";
+        }
+        clear();
+        return false;
+    }
+    return true;
+}
+
+capture_queue::capture_queue(recording_queue *queue, command_capture *capture, uint8_t queue_index)
+    : m_queue(queue), m_capture(capture), m_queue_index(queue_index)
+{
+}
+
+void capture_queue::execute(command_recorder *const *recorders, uint32_t count, const char *name)
+{
+    m_capture->add_submission(m_queue_index, recorders, count);
+    m_queue->execute(recorders, count, name);
+}
+
+bool replay_stream(const uint8_t *data, size_t size, command_recorder *recorder, replay_command_cost *costs, double clock_overhead_ns)
+{
+    stream_reader reader = {data, data + size};
+    std::string pass_name;
+    std::vector<uint8_t> upload_data;
+    descriptor_handle targets[8] = {};
+    std::vector<recorded_barrier> barriers;
+
+    while (reader.m_current < reader.m_end)
+    {
+        recorded_command_type type = (recorded_command_type)reader.read<uint8_t>();
+        if (type >= recorded_command_MAX)
+        {
+            return false;
+        }
+
+        // The arguments are read before the clock starts, only the call to the recorder is timed.
+        double start = 0.0;
+        auto begin_timing = [&]() {
+            if (!reader.m_failed && costs)
+            {
+                start = now_ns();
+            }
+            return !reader.m_failed;
+        };
+
+        switch (type)
+        {
+        case recorded_begin_pass:
+        {
+            uint16_t length = reader.read<uint16_t>();
+            pass_name.resize(length);
+            reader.read_bytes(&pass_name[0], length);
+            if (begin_timing())
+            {
+                recorder->begin_pass(pass_name.c_str());
+            }
+            break;
+        }
+        case recorded_end_pass:
+            if (begin_timing())
+            {
+                recorder->end_pass();
+            }
+            break;
+        case recorded_set_pipeline:
+        {
+            gpu_handle pipeline = reader.read<gpu_handle>();
+            if (begin_timing())
+            {
+                recorder->set_pipeline(pipeline);
+            }
+            break;
+        }
+        case recorded_set_root_signature:
+        {
+            gpu_handle root_signature = reader.read<gpu_handle>();
+            bool is_compute = reader.read<uint8_t>() != 0;
+            if (begin_timing())
+            {
+                recorder->set_root_signature(root_signature, is_compute);
+            }
+            break;
+        }
+        case recorded_set_root_constant_buffer:
+        case recorded_set_root_shader_resource:
+        case recorded_set_root_table:
+        {
+            uint32_t parameter = reader.read<uint8_t>();
+            gpu_address address = reader.read<gpu_address>();
+            if (begin_timing())
+            {
+                if (type == recorded_set_root_constant_buffer)
+                {
+                    recorder->set_root_constant_buffer(parameter, address);
+                }
+                else if (type == recorded_set_root_shader_resource)
+                {
+                    recorder->set_root_shader_resource(parameter, address);
+                }
+                else
+                {
+                    recorder->set_root_table(parameter, address);
+                }
+            }
+            break;
+        }
+        case recorded_stage_descriptor:
+        {
+            uint32_t stage = reader.read<uint8_t>();
+            uint32_t descriptor_type = reader.read<uint8_t>();
+            uint32_t slot = reader.read<uint8_t>();
+            descriptor_handle descriptor = reader.read<descriptor_handle>();
+            if (begin_timing())
+            {
+                recorder->stage_descriptor(stage, descriptor_type, slot, descriptor);
+            }
+            break;
+        }
+        case recorded_set_descriptor_tables:
+            if (begin_timing())
+            {
+                recorder->set_descriptor_tables();
+            }
+            break;
+        case recorded_invalidate_descriptor_tables:
+            if (begin_timing())
+            {
+                recorder->invalidate_descriptor_tables();
+            }
+            break;
+        case recorded_set_vertex_buffer:
+        {
+            gpu_address address = reader.read<gpu_address>();
+            uint32_t buffer_size = reader.read<uint32_t>();
+            uint32_t stride = reader.read<uint32_t>();
+            if (begin_timing())
+            {
+                recorder->set_vertex_buffer(address, buffer_size, stride);
+            }
+            break;
+        }
+        case recorded_set_index_buffer:
+        {
+            gpu_address address = reader.read<gpu_address>();
+            uint32_t buffer_size = reader.read<uint32_t>();
+            bool is_32_bits = reader.read<uint8_t>() != 0;
+            if (begin_timing())
+            {
+                recorder->set_index_buffer(address, buffer_size, is_32_bits);
+            }
+            break;
+        }
+        case recorded_set_primitive_topology:
+        {
+            primitive_topology topology = (primitive_topology)reader.read<uint8_t>();
+            if (begin_timing())
+            {
+                recorder->set_primitive_topology(topology);
+            }
+            break;
+        }
+        case recorded_set_viewport:
+        {
+            float width = reader.read<float>();
+            float height = reader.read<float>();
+            if (begin_timing())
+            {
+                recorder->set_viewport(width, height);
+            }
+            break;
+        }
+        case recorded_set_render_targets:
+        {
+            uint32_t num_targets = reader.read<uint8_t>();
+            if (num_targets > sizeof(targets) / sizeof(targets[0]))
+            {
+                return false;
+            }
+            reader.read_bytes(targets, num_targets * sizeof(descriptor_handle));
+            descriptor_handle depth = reader.read<descriptor_handle>();
+            if (begin_timing())
+            {
+                recorder->set_render_targets(num_targets, targets, depth);
+            }
+            break;
+        }
+        case recorded_clear_render_target:
+        {
+            descriptor_handle target = reader.read<descriptor_handle>();
+            float color[4] = {};
+            reader.read_bytes(color, sizeof(color));
+            if (begin_timing())
+            {
+                recorder->clear_render_target(target, color);
+            }
+            break;
+        }
+        case recorded_clear_depth:
+        {
+            descriptor_handle depth = reader.read<descriptor_handle>();
+            float value = reader.read<float>();
+            bool is_clearing_stencil = reader.read<uint8_t>() != 0;
+            if (begin_timing())
+            {
+                recorder->clear_depth(depth, value, is_clearing_stencil);
+            }
+            break;
+        }
+        case recorded_draw:
+        {
+            uint32_t args[4] = {};
+            reader.read_bytes(args, sizeof(args));
+            if (begin_timing())
+            {
+                recorder->draw(args[0], args[1], args[2], args[3]);
+            }
+            break;
+        }
+        case recorded_draw_indexed:
+        {
+            uint32_t index_count = reader.read<uint32_t>();
+            uint32_t instance_count = reader.read<uint32_t>();
+            uint32_t first_index = reader.read<uint32_t>();
+            int32_t base_vertex = reader.read<int32_t>();
+            uint32_t first_instance = reader.read<uint32_t>();
+            if (begin_timing())
+            {
+                recorder->draw_indexed(index_count, instance_count, first_index, base_vertex, first_instance);
+            }
+            break;
+        }
+        case recorded_dispatch:
+        {
+            uint32_t groups[3] = {};
+            reader.read_bytes(groups, sizeof(groups));
+            if (begin_timing())
+            {
+                recorder->dispatch(groups[0], groups[1], groups[2]);
+            }
+            break;
+        }
+        case recorded_execute_indirect:
+        {
+            gpu_handle signature = reader.read<gpu_handle>();
+            uint32_t max_commands = reader.read<uint32_t>();
+            gpu_handle arguments = reader.read<gpu_handle>();
+            uint64_t arguments_offset = reader.read<uint64_t>();
+            gpu_handle count_buffer = reader.read<gpu_handle>();
+            uint64_t count_offset = reader.read<uint64_t>();
+            if (begin_timing())
+            {
+                recorder->execute_indirect(signature, max_commands, arguments, arguments_offset, count_buffer, count_offset);
+            }
+            break;
+        }
+        case recorded_barriers:
+        {
+            uint32_t num_barriers = reader.read<uint32_t>();
+            if (reader.m_failed || num_barriers > (size_t)(reader.m_end - reader.m_current) / sizeof(recorded_barrier))
+            {
+                return false;
+            }
+            barriers.resize(num_barriers);
+            reader.read_bytes(barriers.data(), num_barriers * sizeof(recorded_barrier));
+            if (begin_timing())
+            {
+                recorder->barriers(barriers.data(), num_barriers);
+            }
+            break;
+        }
+        case recorded_copy_descriptors:
+        {
+            descriptor_handle dest = reader.read<descriptor_handle>();
+            descriptor_handle src = reader.read<descriptor_handle>();
+            uint32_t num_descriptors = reader.read<uint32_t>();
+            descriptor_heap_kind heap = (descriptor_heap_kind)reader.read<uint8_t>();
+            if (begin_timing())
+            {
+                recorder->copy_descriptors(dest, src, num_descriptors, heap);
+            }
+            break;
+        }
+        case recorded_copy_buffer:
+        {
+            gpu_handle dest = reader.read<gpu_handle>();
+            uint64_t dest_offset = reader.read<uint64_t>();
+            gpu_handle src = reader.read<gpu_handle>();
+            uint64_t src_offset = reader.read<uint64_t>();
+            uint64_t copy_size = reader.read<uint64_t>();
+            if (begin_timing())
+            {
+                recorder->copy_buffer(dest, dest_offset, src, src_offset, copy_size);
+            }
+            break;
+        }
+        case recorded_upload:
+        {
+            // The data is not captured, the same amount of bytes is copied.
+            uint64_t upload_size = reader.read<uint64_t>();
+            uint32_t alignment = reader.read<uint32_t>();
+            reader.read<gpu_address>();
+            if (upload_data.size() < upload_size)
+            {
+                upload_data.resize((size_t)upload_size);
+            }
+            if (begin_timing())
+            {
+                recorder->upload(upload_data.data(), upload_size, alignment);
+            }
+            break;
+        }
+        case recorded_native:
+            // The native commands are not captured, the replay only makes the call.
+            if (begin_timing())
+            {
+                recorder->record_native([](void *native_list) { (void)native_list; });
+            }
+            break;
+        default:
+            return false;
+        }
+
+        if (reader.m_failed)
+        {
+            return false;
+        }
+        if (costs)
+        {
+            costs[type].count++;
+            costs[type].total_ns += (std::max)(now_ns() - start - clock_overhead_ns, 0.0);
+        }
+    }
+    return true;
+}
+
+// Average cost of a pair of clock reads, taken out of each command timing.
+static double measure_clock_overhead()
+{
+    const int num_samples = 10000;
+    double total_ns = 0.0;
+    for (int i = 0; i < num_samples; i++)
+    {
+        double start = now_ns();
+        total_ns += now_ns() - start;
+    }
+    return total_ns / num_samples;
+}
+
+replay_stats replay_capture(const command_capture &capture, recording_device *device, recording_queue *const *queues,
+                            uint32_t num_queues, uint32_t num_frames)
+{
+    replay_stats stats;
+    const std::vector<captured_list> &lists = capture.lists();
+    stats.num_lists = (uint32_t)lists.size();
+    stats.stream_bytes = capture.size_bytes();
+    stats.clock_overhead_ns = measure_clock_overhead();
+
+    std::vector<command_recorder *> recorders;
+    for (const captured_list &list : lists)
+    {
+        if (list.queue >= num_queues)
+        {
+            stats.error = "The capture uses queue " + std::to_string(list.queue) + ", " + std::to_string(num_queues) + " given";
+            return stats;
+        }
+        recorders.push_back(device->create_recorder(list.is_compute));
+    }
+
+    // One frame at a time, like the capture: the upload memory is reused every frame.
+    auto replay_frame = [&](replay_command_cost *costs) {
+        device->begin_frame();
+        std::vector<uint64_t> signaled(num_queues, 0);
+        size_t first = 0;
+        while (first < lists.size())
+        {
+            size_t end = first;
+            while (end < lists.size() && lists[end].submission == lists[first].submission)
+            {
+                command_recorder *recorder = recorders[end];
+                recorder->begin();
+                if (!replay_stream(lists[end].bytes.data(), lists[end].bytes.size(), recorder, costs, stats.clock_overhead_ns))
+                {
+                    stats.error = "Invalid command in list " + std::to_string(end);
+                    return false;
+                }
+                recorder->end();
+                end++;
+            }
+            uint8_t queue = lists[first].queue;
+            queues[queue]->execute(&recorders[first], (uint32_t)(end - first));
+            signaled[queue] = queues[queue]->signal();
+            first = end;
+        }
+        for (uint32_t i = 0; i < num_queues; i++)
+        {
+            queues[i]->wait(signaled[i]);
+        }
+        return true;
+    };
+
+    double total_ms = 0.0;
+    for (uint32_t i = 0; i < num_frames; i++)
+    {
+        double start = now_ns();
+        if (!replay_frame(nullptr))
+        {
+            return stats;
+        }
+        double frame_ms = (now_ns() - start) / 1e6;
+        total_ms += frame_ms;
+        stats.best_frame_ms = (i == 0) ? frame_ms : (std::min)(stats.best_frame_ms, frame_ms);
+    }
+    for (uint32_t i = 0; i < num_frames; i++)
+    {
+        if (!replay_frame(stats.commands))
+        {
+            return stats;
+        }
+    }
+
+    stats.num_frames = num_frames;
+    stats.frame_ms = num_frames > 0 ? total_ms / num_frames : 0.0;
+    std::vector<recorded_pass_stats> passes;
+    for (command_recorder *recorder : recorders)
+    {
+        passes.insert(passes.end(), recorder->pass_stats().begin(), recorder->pass_stats().end());
+    }
+    stats.passes = merge_pass_stats(passes);
+    return stats;
+}
+
+std::string dump_replay_stats(const replay_stats &stats)
+{
+    std::stringstream stream;
+    stream.precision(3);
+    stream << std::fixed;
+    if (!stats.error.empty())
+    {
+        stream << "Replay failed: " << stats.error << "\n";
+        return stream.str();
+    }
+
+    stream << stats.num_frames << " frames of " << stats.num_lists << " lists, " << stats.stream_bytes << " bytes of commands, "
+           << stats.frame_ms << " ms average, " << stats.best_frame_ms << " ms best\n";
+
+    // Per frame, the timings of all the frames are summed.
+    std::vector<int> types;
+    double total_ns = 0.0;
+    for (int type = 0; type < recorded_command_MAX; type++)
+    {
+        if (stats.commands[type].count > 0)
+        {
+            types.push_back(type);
+            total_ns += stats.commands[type].total_ns;
+        }
+    }
+    std::sort(types.begin(), types.end(), [&](int a, int b) { return stats.commands[a].total_ns > stats.commands[b].total_ns; });
+
+    uint32_t num_frames = (std::max)(stats.num_frames, 1u);
+    stream << "Per frame, " << stats.clock_overhead_ns << " ns of clock overhead removed from each command:\n";
+    for (int type : types)
+    {
+        const replay_command_cost &cost = stats.commands[type];
+        stream << std::left << std::setw(30) << recorded_command_name((recorded_command_type)type) << std::right
+               << std::setw(8) << cost.count / num_frames << " x"
+               << std::setw(10) << cost.total_ns / cost.count << " ns"
+               << std::setw(10) << cost.total_ns / num_frames / 1000.0 << " us"
+               << std::setw(7) << (total_ns > 0.0 ? 100.0 * cost.total_ns / total_ns : 0.0) << " %\n";
+    }
+    stream << dump_pass_stats(stats.passes);
+    return stream.str();
+}
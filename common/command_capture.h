@@ -0,0 +1,99 @@
+#pragma once
+#include "common_api.h"
+#include "command_recorder.h"
+#include <string>
+#include <vector>
+
+// Capture and replay of the command streams of a frame.
+// A capture is the exact sequence of commands of each list the null backend recorded, in submission order, with the
+// queue and the submission of each list. Replaying it on a recorder calls the same commands with the same
+// arguments, without the scene and update logic, so that the recording cost can be timed alone and compared
+// between builds. The handles and addresses are replayed as they were recorded: replay on the null backend.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+struct captured_list
+{
+    uint8_t queue = 0;       // Index in the queues given to replay_capture().
+    uint32_t submission = 0; // Lists with the same submission are executed together.
+    bool is_compute = false;
+    std::vector<uint8_t> bytes; // command_stream encoding.
+};
+
+class COMMON_API command_capture
+{
+public:
+    command_capture() = default;
+    ~command_capture() = default;
+
+    void clear() { m_lists.clear(); m_num_submissions = 0; }
+
+    // Copies the streams of the lists of one submission, they must be null_command_recorder.
+    void add_submission(uint8_t queue, command_recorder *const *recorders, uint32_t count);
+
+    const std::vector<captured_list> &lists() const { return m_lists; }
+    uint32_t num_submissions() const { return m_num_submissions; }
+    uint64_t size_bytes() const;
+
+    // Binary file: a header with the stream version, then the lists.
+    bool save(const char *path, std::string *error = nullptr) const;
+    bool load(const char *path, std::string *error = nullptr);
+
+private:
+    std::vector<captured_list> m_lists;
+    uint32_t m_num_submissions = 0;
+};
+
+// Passes the submitted lists to another queue and adds them to a capture.
+class COMMON_API capture_queue : public recording_queue
+{
+public:
+    capture_queue(recording_queue *queue, command_capture *capture, uint8_t queue_index);
+    ~capture_queue() = default;
+
+    void execute(command_recorder *const *recorders, uint32_t count, const char *name = nullptr) override;
+    uint64_t signal() override { return m_queue->signal(); }
+    uint64_t completed_value() override { return m_queue->completed_value(); }
+    void wait(uint64_t value) override { m_queue->wait(value); }
+    void wait_on_gpu(recording_queue *queue, uint64_t value) override { m_queue->wait_on_gpu(queue, value); }
+
+private:
+    recording_queue *m_queue;
+    command_capture *m_capture;
+    uint8_t m_queue_index;
+};
+
+struct replay_command_cost
+{
+    uint64_t count = 0;
+    double total_ns = 0.0; // Without the cost of reading the clock.
+};
+
+struct replay_stats
+{
+    uint32_t num_frames = 0;
+    uint32_t num_lists = 0;
+    uint64_t stream_bytes = 0;
+    double frame_ms = 0.0;        // Average of the frames replayed without the per-command timings.
+    double best_frame_ms = 0.0;
+    double clock_overhead_ns = 0.0;
+    replay_command_cost commands[recorded_command_MAX];
+    std::vector<recorded_pass_stats> passes; // Of the last frame, merged by name.
+    std::string error;
+};
+
+// Decodes the stream and calls the recorder for each command, between begin() and end() of the recorder.
+// With costs, each command is timed and added to costs[type]. Returns false on an unknown or truncated command.
+COMMON_API bool replay_stream(const uint8_t *data, size_t size, command_recorder *recorder, replay_command_cost *costs = nullptr,
+                              double clock_overhead_ns = 0.0);
+
+// Replays the capture num_frames times on recorders of the device, executing the lists on queues[list.queue].
+// The frames are replayed twice: once as a whole for the frame time, once with each command timed.
+COMMON_API replay_stats replay_capture(const command_capture &capture, recording_device *device, recording_queue *const *queues,
+                                       uint32_t num_queues, uint32_t num_frames);
+
+// Frame time, then the count, total and average cost of each command type, most expensive first.
+COMMON_API std::string dump_replay_stats(const replay_stats &stats);
+
+#pragma warning(pop)
@@ -0,0 +1,107 @@
+#include "command_list_pool.h"
+#include "gpu_interface.h"
+#include <algorithm>
+#include <sstream>
+
+void command_list_pool::init(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, const char *name)
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_device = device;
+    m_type = type;
+    m_name = name;
+    m_object_name.assign(m_name.begin(), m_name.end());
+    m_pairs.clear();
+    m_pair_indices.clear();
+    m_free_list.clear();
+    m_stats = {};
+}
+
+ID3D12GraphicsCommandList *command_list_pool::acquire(ID3D12PipelineState *pso)
+{
+    command_pair *pair = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_free_list.recycle([](const void *fence) { return ((ID3D12Fence *)fence)->GetCompletedValue(); });
+
+        if (m_free_list.num_free() == 0)
+        {
+            size_t index = m_pairs.size();
+            m_pairs.emplace_back();
+            command_pair *new_pair = &m_pairs.back();
+            check_hr(m_device->CreateCommandAllocator(m_type, IID_PPV_ARGS(new_pair->cmd_alloc.GetAddressOf())));
+            check_hr(m_device->CreateCommandList(gpu_interface::DEFAULT_NODE, m_type, new_pair->cmd_alloc.Get(),
+                                                 nullptr, IID_PPV_ARGS(new_pair->cmd_list.GetAddressOf())));
+            check_hr(new_pair->cmd_list->Close());
+            set_name_indexed(new_pair->cmd_alloc, m_object_name.c_str(), (UINT)index);
+            set_name_indexed(new_pair->cmd_list, m_object_name.c_str(), (UINT)index);
+            new_pair->state = pair_free;
+            new_pair->num_uses = 0;
+            m_pair_indices[new_pair->cmd_list.Get()] = index;
+            m_free_list.add(index);
+            m_stats.num_pairs++;
+        }
+
+        // The most recently freed pair first, its allocator already grew to the size of a similar list.
+        size_t index = 0;
+        m_free_list.acquire(&index);
+        pair = &m_pairs[index];
+        pair->fence = nullptr;
+        pair->state = pair_open;
+        pair->num_uses++;
+
+        m_stats.num_open++;
+        m_stats.max_open = (std::max)(m_stats.max_open, m_stats.num_open);
+        m_stats.num_acquires++;
+    }
+
+    // The fence completed, nothing else uses the pair.
+    check_hr(pair->cmd_alloc->Reset());
+    check_hr(pair->cmd_list->Reset(pair->cmd_alloc.Get(), pso));
+    if (pso)
+    {
+        g_render_counters.add(counter_pipeline_changes);
+    }
+    return pair->cmd_list.Get();
+}
+
+void command_list_pool::submitted(ID3D12CommandList *const *cmd_lists, UINT count, ID3D12Fence *fence, UINT64 fence_value)
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    for (UINT i = 0; i < count; i++)
+    {
+        auto found = m_pair_indices.find(cmd_lists[i]);
+        if (found == m_pair_indices.end())
+        {
+            continue;
+        }
+
+        command_pair &pair = m_pairs[found->second];
+        ASSERT(pair.state == pair_open, "A pooled command list was submitted twice without being acquired again.");
+        pair.state = pair_in_flight;
+        pair.fence = fence;
+        m_free_list.submitted(found->second, fence, fence_value);
+
+        m_stats.num_open--;
+        m_stats.num_in_flight = (UINT)m_free_list.num_in_flight();
+        m_stats.max_in_flight = (std::max)(m_stats.max_in_flight, m_stats.num_in_flight);
+    }
+}
+
+command_list_pool_stats command_list_pool::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    command_list_pool_stats stats = m_stats;
+    stats.num_in_flight = (UINT)m_free_list.num_in_flight();
+    return stats;
+}
+
+std::string command_list_pool::dump() const
+{
+    command_list_pool_stats pool_stats = stats();
+    std::stringstream stream;
+    stream << m_name << ": " << pool_stats.num_pairs << " lists, "
+           << pool_stats.num_open << " open (max " << pool_stats.max_open << "), "
+           << pool_stats.num_in_flight << " in flight (max " << pool_stats.max_in_flight << "), "
+           << pool_stats.num_acquires << " acquires";
+    return stream.str();
+}
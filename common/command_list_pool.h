@@ -0,0 +1,76 @@
+#pragma once
+#include "common.h"
+#include "directx12_include.h"
+#include "fenced_free_list.h"
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Command allocators and lists of one list type, recycled with fences.
+// acquire() hands out an open list with its own allocator, from any thread. Once the list is executed, submitted()
+// tags it with the fence value its queue signals after it, and the pair is reused when the fence reaches that value.
+// The pool grows to the number of lists in flight, it doesn't depend on the frame index or on the number of threads.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+struct command_list_pool_stats
+{
+    UINT num_pairs;      // Allocator and list pairs created.
+    UINT num_open;       // Acquired and not submitted yet.
+    UINT num_in_flight;  // Submitted, waiting for their fence.
+    UINT max_open;       // High-water marks since init().
+    UINT max_in_flight;
+    UINT64 num_acquires;
+};
+
+class COMMON_API command_list_pool
+{
+public:
+    command_list_pool() = default;
+    ~command_list_pool() = default;
+
+    void init(ComPtr<ID3D12Device> device, D3D12_COMMAND_LIST_TYPE type, const char *name);
+
+    // Returns a reset list, recording starts with the given pipeline state.
+    ID3D12GraphicsCommandList *acquire(ID3D12PipelineState *pso = nullptr);
+
+    // The lists of the pool that are in cmd_lists can be reused once fence reaches fence_value.
+    // The other lists are ignored, so that a whole submission can be passed.
+    void submitted(ID3D12CommandList *const *cmd_lists, UINT count, ID3D12Fence *fence, UINT64 fence_value);
+
+    command_list_pool_stats stats() const;
+    std::string dump() const;
+
+private:
+    enum pair_state
+    {
+        pair_free,
+        pair_open,
+        pair_in_flight,
+    };
+
+    struct command_pair
+    {
+        ComPtr<ID3D12CommandAllocator> cmd_alloc;
+        ComPtr<ID3D12GraphicsCommandList> cmd_list;
+        ComPtr<ID3D12Fence> fence; // Kept alive while the pair is in flight.
+        pair_state state;
+        UINT64 num_uses;
+    };
+
+    ComPtr<ID3D12Device> m_device;
+    D3D12_COMMAND_LIST_TYPE m_type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+    std::string m_name;
+    std::wstring m_object_name;
+
+    mutable std::mutex m_mtx;
+    std::deque<command_pair> m_pairs; // A deque so that the pairs don't move when the pool grows.
+    std::unordered_map<ID3D12CommandList *, size_t> m_pair_indices;
+    fenced_free_list m_free_list;
+    command_list_pool_stats m_stats = {};
+};
+
+#pragma warning(pop)
@@ -0,0 +1,546 @@
+#include "command_recorder.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+
+static const char *command_names[recorded_command_MAX] = {
+    "begin pass",
+    "end pass",
+    "set pipeline",
+    "set root signature",
+    "set root constant buffer",
+    "set root shader resource",
+    "set root table",
+    "stage descriptor",
+    "set descriptor tables",
+    "invalidate descriptor tables",
+    "set vertex buffer",
+    "set index buffer",
+    "set primitive topology",
+    "set viewport",
+    "set render targets",
+    "clear render target",
+    "clear depth",
+    "draw",
+    "draw indexed",
+    "dispatch",
+    "execute indirect",
+    "barriers",
+    "copy descriptors",
+    "copy buffer",
+    "upload",
+    "native commands",
+};
+
+const char *recorded_command_name(recorded_command_type type)
+{
+    return type < recorded_command_MAX ? command_names[type] : "unknown";
+}
+
+std::vector<recorded_pass_stats> merge_pass_stats(const std::vector<recorded_pass_stats> &passes)
+{
+    std::vector<recorded_pass_stats> merged;
+    for (const recorded_pass_stats &pass : passes)
+    {
+        auto found = std::find_if(merged.begin(), merged.end(), [&](const recorded_pass_stats &m) { return m.name == pass.name; });
+        if (found == merged.end())
+        {
+            merged.push_back(pass);
+        }
+        else
+        {
+            found->add(pass);
+        }
+    }
+    return merged;
+}
+
+std::string dump_pass_stats(const std::vector<recorded_pass_stats> &passes)
+{
+    std::stringstream stream;
+    recorded_pass_stats total;
+    for (const recorded_pass_stats &pass : passes)
+    {
+        stream << std::left << std::setw(38) << (pass.name.empty() ? "(no pass)" : pass.name) << std::right
+               << std::setw(7) << pass.num_commands << " commands"
+               << std::setw(6) << pass.num_draws << " draws"
+               << std::setw(5) << pass.num_dispatches << " dispatches"
+               << std::setw(5) << pass.num_barriers << " barriers"
+               << std::setw(6) << pass.num_descriptor_copies << " descriptors"
+               << std::setw(9) << pass.upload_bytes << " bytes\n";
+        total.add(pass);
+    }
+    stream << "Total: " << total.num_commands << " commands, " << total.num_draws << " draws, "
+           << total.num_dispatches << " dispatches, " << total.num_barriers << " barriers, "
+           << total.num_descriptor_copies << " descriptors, " << total.upload_bytes << " bytes uploaded";
+    return stream.str();
+}
+
+void command_recorder::begin_pass(const char *name)
+{
+    recorded_pass_stats pass;
+    pass.name = name;
+    m_passes.push_back(pass);
+    m_is_in_pass = true;
+}
+
+void command_recorder::end_pass()
+{
+    m_is_in_pass = false;
+}
+
+void command_recorder::transition(uint32_t before, uint32_t after, std::initializer_list<gpu_handle> resources)
+{
+    const uint32_t max_barriers = 16;
+    recorded_barrier transitions[max_barriers];
+    uint32_t num_barriers = 0;
+    for (gpu_handle resource : resources)
+    {
+        transitions[num_barriers++] = {resource, 0, all_subresources, before, after, tracked_barrier_transition, 0};
+        if (num_barriers == max_barriers)
+        {
+            barriers(transitions, num_barriers);
+            num_barriers = 0;
+        }
+    }
+    if (num_barriers > 0)
+    {
+        barriers(transitions, num_barriers);
+    }
+}
+
+void command_recorder::reset_stats()
+{
+    m_passes.clear();
+    m_is_in_pass = false;
+}
+
+recorded_pass_stats *command_recorder::current_pass()
+{
+    // Commands outside of the passes go to an unnamed pass, a new one after each named pass.
+    if (m_passes.empty() || (!m_is_in_pass && !m_passes.back().name.empty()))
+    {
+        m_passes.push_back(recorded_pass_stats());
+    }
+    return &m_passes.back();
+}
+
+void command_recorder::count(recorded_command_type type, uint64_t amount)
+{
+    if (type == recorded_begin_pass || type == recorded_end_pass)
+    {
+        return;
+    }
+
+    recorded_pass_stats *pass = current_pass();
+    pass->num_commands++;
+    switch (type)
+    {
+    case recorded_draw:
+    case recorded_draw_indexed:
+    case recorded_execute_indirect:
+        pass->num_draws++;
+        break;
+    case recorded_dispatch:
+        pass->num_dispatches++;
+        break;
+    case recorded_barriers:
+        pass->num_barriers += (uint32_t)amount;
+        break;
+    case recorded_copy_descriptors:
+    case recorded_stage_descriptor:
+        pass->num_descriptor_copies += (uint32_t)amount;
+        break;
+    case recorded_upload:
+        pass->upload_bytes += amount;
+        break;
+    default:
+        break;
+    }
+}
+
+void command_stream::write_bytes(const void *data, size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+    size_t offset = m_bytes.size();
+    m_bytes.resize(offset + size);
+    memcpy(m_bytes.data() + offset, data, size);
+}
+
+void command_stream::write_string(const char *text)
+{
+    size_t length = (std::min)(strlen(text), (size_t)0xffff);
+    write((uint16_t)length);
+    write_bytes(text, length);
+}
+
+null_upload_arena::null_upload_arena(uint64_t capacity)
+    : m_memory((size_t)capacity)
+{
+}
+
+gpu_address null_upload_arena::allocate(const void *data, uint64_t size, uint64_t alignment)
+{
+    alignment = alignment == 0 ? 1 : alignment;
+    uint64_t offset = m_offset.load(std::memory_order_relaxed);
+    uint64_t aligned_offset = 0;
+    do
+    {
+        aligned_offset = (offset + alignment - 1) / alignment * alignment;
+    } while (!m_offset.compare_exchange_weak(offset, aligned_offset + size, std::memory_order_relaxed));
+
+    // Past the end the copy wraps around, the bytes are never read.
+    uint64_t capacity = m_memory.size();
+    if (data && capacity > 0)
+    {
+        uint64_t copy_offset = aligned_offset % capacity;
+        uint64_t copy_size = (std::min)(size, capacity - copy_offset);
+        memcpy(m_memory.data() + copy_offset, data, (size_t)copy_size);
+    }
+
+    uint64_t end = aligned_offset + size;
+    uint64_t high_water = m_high_water.load(std::memory_order_relaxed);
+    while (end > high_water && !m_high_water.compare_exchange_weak(high_water, end, std::memory_order_relaxed))
+    {
+    }
+    return base_address + aligned_offset;
+}
+
+null_command_recorder::null_command_recorder(null_upload_arena *uploads, bool is_compute)
+    : m_uploads(uploads), m_is_compute(is_compute)
+{
+}
+
+void null_command_recorder::begin(gpu_handle pipeline)
+{
+    m_stream.clear();
+    m_tracker.reset();
+    reset_stats();
+    m_is_recording = true;
+    if (pipeline != 0)
+    {
+        set_pipeline(pipeline);
+    }
+}
+
+void null_command_recorder::end()
+{
+    m_is_recording = false;
+}
+
+void null_command_recorder::begin_pass(const char *name)
+{
+    command_recorder::begin_pass(name);
+    m_stream.write_type(recorded_begin_pass);
+    m_stream.write_string(name);
+}
+
+void null_command_recorder::end_pass()
+{
+    command_recorder::end_pass();
+    m_stream.write_type(recorded_end_pass);
+}
+
+void null_command_recorder::set_pipeline(gpu_handle pipeline)
+{
+    count(recorded_set_pipeline);
+    m_stream.write_type(recorded_set_pipeline);
+    m_stream.write(pipeline);
+}
+
+void null_command_recorder::set_root_signature(gpu_handle root_signature, bool is_compute)
+{
+    count(recorded_set_root_signature);
+    m_stream.write_type(recorded_set_root_signature);
+    m_stream.write(root_signature);
+    m_stream.write((uint8_t)is_compute);
+}
+
+void null_command_recorder::set_root_constant_buffer(uint32_t parameter, gpu_address address)
+{
+    count(recorded_set_root_constant_buffer);
+    m_stream.write_type(recorded_set_root_constant_buffer);
+    m_stream.write((uint8_t)parameter);
+    m_stream.write(address);
+}
+
+void null_command_recorder::set_root_shader_resource(uint32_t parameter, gpu_address address)
+{
+    count(recorded_set_root_shader_resource);
+    m_stream.write_type(recorded_set_root_shader_resource);
+    m_stream.write((uint8_t)parameter);
+    m_stream.write(address);
+}
+
+void null_command_recorder::set_root_table(uint32_t parameter, gpu_address descriptor)
+{
+    count(recorded_set_root_table);
+    m_stream.write_type(recorded_set_root_table);
+    m_stream.write((uint8_t)parameter);
+    m_stream.write(descriptor);
+}
+
+void null_command_recorder::stage_descriptor(uint32_t stage, uint32_t type, uint32_t slot, descriptor_handle descriptor)
+{
+    count(recorded_stage_descriptor);
+    m_stream.write_type(recorded_stage_descriptor);
+    m_stream.write((uint8_t)stage);
+    m_stream.write((uint8_t)type);
+    m_stream.write((uint8_t)slot);
+    m_stream.write(descriptor);
+}
+
+void null_command_recorder::set_descriptor_tables()
+{
+    count(recorded_set_descriptor_tables);
+    m_stream.write_type(recorded_set_descriptor_tables);
+}
+
+void null_command_recorder::invalidate_descriptor_tables()
+{
+    count(recorded_invalidate_descriptor_tables);
+    m_stream.write_type(recorded_invalidate_descriptor_tables);
+}
+
+void null_command_recorder::set_vertex_buffer(gpu_address address, uint32_t size, uint32_t stride)
+{
+    count(recorded_set_vertex_buffer);
+    m_stream.write_type(recorded_set_vertex_buffer);
+    m_stream.write(address);
+    m_stream.write(size);
+    m_stream.write(stride);
+}
+
+void null_command_recorder::set_index_buffer(gpu_address address, uint32_t size, bool is_32_bits)
+{
+    count(recorded_set_index_buffer);
+    m_stream.write_type(recorded_set_index_buffer);
+    m_stream.write(address);
+    m_stream.write(size);
+    m_stream.write((uint8_t)is_32_bits);
+}
+
+void null_command_recorder::set_primitive_topology(primitive_topology topology)
+{
+    count(recorded_set_primitive_topology);
+    m_stream.write_type(recorded_set_primitive_topology);
+    m_stream.write((uint8_t)topology);
+}
+
+void null_command_recorder::set_viewport(float width, float height)
+{
+    count(recorded_set_viewport);
+    m_stream.write_type(recorded_set_viewport);
+    m_stream.write(width);
+    m_stream.write(height);
+}
+
+void null_command_recorder::set_render_targets(uint32_t num_targets, const descriptor_handle *targets, descriptor_handle depth)
+{
+    count(recorded_set_render_targets);
+    m_stream.write_type(recorded_set_render_targets);
+    m_stream.write((uint8_t)num_targets);
+    m_stream.write_bytes(targets, num_targets * sizeof(descriptor_handle));
+    m_stream.write(depth);
+}
+
+void null_command_recorder::clear_render_target(descriptor_handle target, const float color[4])
+{
+    count(recorded_clear_render_target);
+    m_stream.write_type(recorded_clear_render_target);
+    m_stream.write(target);
+    m_stream.write_bytes(color, 4 * sizeof(float));
+}
+
+void null_command_recorder::clear_depth(descriptor_handle depth, float value, bool is_clearing_stencil)
+{
+    count(recorded_clear_depth);
+    m_stream.write_type(recorded_clear_depth);
+    m_stream.write(depth);
+    m_stream.write(value);
+    m_stream.write((uint8_t)is_clearing_stencil);
+}
+
+void null_command_recorder::draw(uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance)
+{
+    count(recorded_draw);
+    m_stream.write_type(recorded_draw);
+    m_stream.write(vertex_count);
+    m_stream.write(instance_count);
+    m_stream.write(first_vertex);
+    m_stream.write(first_instance);
+}
+
+void null_command_recorder::draw_indexed(uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t base_vertex, uint32_t first_instance)
+{
+    count(recorded_draw_indexed);
+    m_stream.write_type(recorded_draw_indexed);
+    m_stream.write(index_count);
+    m_stream.write(instance_count);
+    m_stream.write(first_index);
+    m_stream.write(base_vertex);
+    m_stream.write(first_instance);
+}
+
+void null_command_recorder::dispatch(uint32_t x, uint32_t y, uint32_t z)
+{
+    count(recorded_dispatch);
+    m_stream.write_type(recorded_dispatch);
+    m_stream.write(x);
+    m_stream.write(y);
+    m_stream.write(z);
+}
+
+void null_command_recorder::execute_indirect(gpu_handle signature, uint32_t max_commands, gpu_handle arguments, uint64_t arguments_offset,
+                                             gpu_handle count_buffer, uint64_t count_offset)
+{
+    count(recorded_execute_indirect);
+    m_stream.write_type(recorded_execute_indirect);
+    m_stream.write(signature);
+    m_stream.write(max_commands);
+    m_stream.write(arguments);
+    m_stream.write(arguments_offset);
+    m_stream.write(count_buffer);
+    m_stream.write(count_offset);
+}
+
+void null_command_recorder::barriers(const recorded_barrier *barriers, uint32_t num_barriers)
+{
+    // Same order as the D3D12 backend: the pending barriers go first, then the transitions set the tracked states.
+    flush_barriers();
+    for (uint32_t i = 0; i < num_barriers; i++)
+    {
+        const recorded_barrier &barrier = barriers[i];
+        if (barrier.type == tracked_barrier_transition && (barrier.flags & tracked_barrier_begin_only) == 0)
+        {
+            m_tracker.assume((const void *)(uintptr_t)barrier.resource, barrier.before, barrier.after, barrier.subresource,
+                             barrier.subresource == all_subresources ? 1 : barrier.subresource + 1);
+        }
+    }
+
+    count(recorded_barriers, num_barriers);
+    m_stream.write_type(recorded_barriers);
+    m_stream.write(num_barriers);
+    m_stream.write_bytes(barriers, num_barriers * sizeof(recorded_barrier));
+}
+
+void null_command_recorder::require_state(gpu_handle resource, uint32_t state)
+{
+    m_tracker.require((const void *)(uintptr_t)resource, state);
+}
+
+void null_command_recorder::require_uav(gpu_handle resource)
+{
+    m_tracker.require_uav((const void *)(uintptr_t)resource);
+}
+
+void null_command_recorder::flush_barriers()
+{
+    if (!m_tracker.has_pending())
+    {
+        return;
+    }
+
+    m_pending_barriers.clear();
+    m_tracker.flush(&m_pending_barriers);
+    m_flushed_barriers.clear();
+    for (const tracked_barrier &barrier : m_pending_barriers)
+    {
+        m_flushed_barriers.push_back(to_recorded_barrier(barrier));
+    }
+    count(recorded_barriers, m_flushed_barriers.size());
+    m_stream.write_type(recorded_barriers);
+    m_stream.write((uint32_t)m_flushed_barriers.size());
+    m_stream.write_bytes(m_flushed_barriers.data(), m_flushed_barriers.size() * sizeof(recorded_barrier));
+}
+
+void null_command_recorder::copy_descriptors(descriptor_handle dest, descriptor_handle src, uint32_t num_descriptors, descriptor_heap_kind heap)
+{
+    count(recorded_copy_descriptors, num_descriptors);
+    m_stream.write_type(recorded_copy_descriptors);
+    m_stream.write(dest);
+    m_stream.write(src);
+    m_stream.write(num_descriptors);
+    m_stream.write((uint8_t)heap);
+}
+
+void null_command_recorder::copy_buffer(gpu_handle dest, uint64_t dest_offset, gpu_handle src, uint64_t src_offset, uint64_t size)
+{
+    count(recorded_copy_buffer);
+    m_stream.write_type(recorded_copy_buffer);
+    m_stream.write(dest);
+    m_stream.write(dest_offset);
+    m_stream.write(src);
+    m_stream.write(src_offset);
+    m_stream.write(size);
+}
+
+gpu_address null_command_recorder::upload(const void *data, uint64_t size, uint64_t alignment)
+{
+    // Only the size is recorded, the data goes to the arena like it would go to upload memory.
+    count(recorded_upload, size);
+    gpu_address address = m_uploads->allocate(data, size, alignment);
+    m_stream.write_type(recorded_upload);
+    m_stream.write(size);
+    m_stream.write((uint32_t)alignment);
+    m_stream.write(address);
+    return address;
+}
+
+void null_command_recorder::update_buffer(gpu_handle dest, uint64_t dest_offset, const void *data, uint64_t size)
+{
+    // The source of the copy is the upload arena, handle 0.
+    gpu_address address = upload(data, size, 16);
+    copy_buffer(dest, dest_offset, 0, address - null_upload_arena::base_address, size);
+}
+
+void null_command_recorder::record_native(const std::function<void(void *native_list)> &record)
+{
+    // There is no list to record on, the call is a no-op that only shows in the stream and the counts.
+    (void)record;
+    flush_barriers();
+    count(recorded_native);
+    m_stream.write_type(recorded_native);
+}
+
+null_device::~null_device()
+{
+    for (null_command_recorder *recorder : m_recorders)
+    {
+        delete recorder;
+    }
+}
+
+gpu_handle null_device::create_buffer(uint64_t size, const char *)
+{
+    // Buffers are placed one after the other, 64KB aligned like committed resources.
+    const uint64_t alignment = 64 * 1024;
+    m_buffer_addresses.push_back(m_next_address);
+    m_next_address += (size + alignment - 1) / alignment * alignment;
+    return (gpu_handle)m_buffer_addresses.size();
+}
+
+gpu_address null_device::buffer_address(gpu_handle buffer)
+{
+    return (buffer > 0 && buffer <= m_buffer_addresses.size()) ? m_buffer_addresses[(size_t)buffer - 1] : 0;
+}
+
+command_recorder *null_device::create_recorder(bool is_compute)
+{
+    m_recorders.push_back(new null_command_recorder(&m_uploads, is_compute));
+    return m_recorders.back();
+}
+
+void null_queue::execute(command_recorder *const *recorders, uint32_t count, const char *)
+{
+    m_num_submissions++;
+    m_num_lists += count;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        m_stream_bytes += static_cast<null_command_recorder *>(recorders[i])->stream().size();
+    }
+}
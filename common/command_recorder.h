@@ -0,0 +1,382 @@
+#pragma once
+#include "common_api.h"
+#include "cpu_profiler.h"
+#include "resource_state_tracker.h"
+#include "rootsig_layout.h"
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Command recording without a GPU.
+// command_recorder is the subset of a graphics command list the passes use, recording_device and recording_queue
+// the device and queue calls around it. The D3D12 backend forwards to the API (d3d12_recorder.h), the null backend
+// encodes the commands into a compact in-memory stream and hands out dummy GPU addresses, so that the CPU cost of
+// recording can be measured on any machine. Both count the draws, barriers, descriptor copies and uploaded bytes
+// of each pass.
+// Objects are opaque 64 bits handles, pointers for D3D12. Resource states are D3D12_RESOURCE_STATES values.
+// Descriptors are staged per shader stage and slot like with the descriptor table allocators of gpu_interface.
+
+typedef uint64_t gpu_handle;        // Resource, pipeline state, root signature or command signature.
+typedef uint64_t gpu_address;       // GPU virtual address, or GPU descriptor handle for the root tables.
+typedef uint64_t descriptor_handle; // CPU descriptor handle.
+
+enum recorded_command_type : uint8_t
+{
+    recorded_begin_pass,
+    recorded_end_pass,
+    recorded_set_pipeline,
+    recorded_set_root_signature,
+    recorded_set_root_constant_buffer,
+    recorded_set_root_shader_resource,
+    recorded_set_root_table,
+    recorded_stage_descriptor,
+    recorded_set_descriptor_tables,
+    recorded_invalidate_descriptor_tables,
+    recorded_set_vertex_buffer,
+    recorded_set_index_buffer,
+    recorded_set_primitive_topology,
+    recorded_set_viewport,
+    recorded_set_render_targets,
+    recorded_clear_render_target,
+    recorded_clear_depth,
+    recorded_draw,
+    recorded_draw_indexed,
+    recorded_dispatch,
+    recorded_execute_indirect,
+    recorded_barriers,
+    recorded_copy_descriptors,
+    recorded_copy_buffer,
+    recorded_upload,
+    recorded_native,
+    recorded_command_MAX
+};
+COMMON_API const char *recorded_command_name(recorded_command_type type);
+
+enum descriptor_heap_kind : uint32_t
+{
+    descriptor_heap_resources, // CBV, SRV and UAV.
+    descriptor_heap_samplers,
+};
+
+enum primitive_topology : uint32_t
+{
+    topology_triangle_list,
+    topology_line_list,
+    topology_point_list,
+};
+
+// A tracked_barrier with handles, without padding so that streams can store it as is.
+struct recorded_barrier
+{
+    gpu_handle resource;
+    gpu_handle resource_before; // Aliasing barriers only.
+    uint32_t subresource;
+    uint32_t before;
+    uint32_t after;
+    uint16_t type; // tracked_barrier_type.
+    uint16_t flags;
+};
+static_assert(sizeof(recorded_barrier) == 32, "recorded_barrier is stored in the command streams.");
+
+inline recorded_barrier to_recorded_barrier(const tracked_barrier &barrier)
+{
+    return {(gpu_handle)(uintptr_t)barrier.resource, (gpu_handle)(uintptr_t)barrier.resource_before, barrier.subresource,
+            barrier.before, barrier.after, (uint16_t)barrier.type, (uint16_t)barrier.flags};
+}
+
+inline tracked_barrier to_tracked_barrier(const recorded_barrier &barrier)
+{
+    return {(tracked_barrier_type)barrier.type, (const void *)(uintptr_t)barrier.resource, barrier.subresource,
+            barrier.before, barrier.after, barrier.flags, (const void *)(uintptr_t)barrier.resource_before};
+}
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+struct recorded_pass_stats
+{
+    std::string name;
+    uint32_t num_commands = 0;
+    uint32_t num_draws = 0; // Direct and indirect.
+    uint32_t num_dispatches = 0;
+    uint32_t num_barriers = 0;
+    uint32_t num_descriptor_copies = 0; // Descriptors, not calls.
+    uint64_t upload_bytes = 0;
+
+    void add(const recorded_pass_stats &other)
+    {
+        num_commands += other.num_commands;
+        num_draws += other.num_draws;
+        num_dispatches += other.num_dispatches;
+        num_barriers += other.num_barriers;
+        num_descriptor_copies += other.num_descriptor_copies;
+        upload_bytes += other.upload_bytes;
+    }
+};
+
+// Sums the passes with the same name, in the order they first appear.
+COMMON_API std::vector<recorded_pass_stats> merge_pass_stats(const std::vector<recorded_pass_stats> &passes);
+COMMON_API std::string dump_pass_stats(const std::vector<recorded_pass_stats> &passes);
+
+class COMMON_API command_recorder
+{
+public:
+    command_recorder() = default;
+    virtual ~command_recorder() = default;
+
+    // Starts and ends the recording of one command list.
+    virtual void begin(gpu_handle pipeline = 0) = 0;
+    virtual void end() = 0;
+
+    // Commands between begin_pass() and end_pass() are counted in the pass, the others in an unnamed one.
+    virtual void begin_pass(const char *name);
+    virtual void end_pass();
+
+    virtual void set_pipeline(gpu_handle pipeline) = 0;
+    virtual void set_root_signature(gpu_handle root_signature, bool is_compute) = 0;
+    virtual void set_root_constant_buffer(uint32_t parameter, gpu_address address) = 0;
+    virtual void set_root_shader_resource(uint32_t parameter, gpu_address address) = 0;
+    virtual void set_root_table(uint32_t parameter, gpu_address descriptor) = 0;
+
+    // Copies a descriptor to the staging tables of the stage, set_descriptor_tables() binds the tables that changed.
+    // stage and type are shader_stages and shader_descriptor_type values.
+    virtual void stage_descriptor(uint32_t stage, uint32_t type, uint32_t slot, descriptor_handle descriptor) = 0;
+    virtual void set_descriptor_tables() = 0;
+
+    // The next set_descriptor_tables() sets every table, e.g. on a list that starts without them.
+    virtual void invalidate_descriptor_tables() = 0;
+
+    // Reserves the tables of num_table_sets set_descriptor_tables() calls, for recorders with their own staging.
+    virtual void reserve_descriptor_tables(uint32_t num_table_sets) { (void)num_table_sets; }
+
+    virtual void set_vertex_buffer(gpu_address address, uint32_t size, uint32_t stride) = 0;
+    virtual void set_index_buffer(gpu_address address, uint32_t size, bool is_32_bits) = 0;
+    virtual void set_primitive_topology(primitive_topology topology) = 0;
+    virtual void set_viewport(float width, float height) = 0; // Sets the scissor rect too.
+    virtual void set_render_targets(uint32_t num_targets, const descriptor_handle *targets, descriptor_handle depth) = 0;
+    virtual void clear_render_target(descriptor_handle target, const float color[4]) = 0;
+    virtual void clear_depth(descriptor_handle depth, float value, bool is_clearing_stencil = false) = 0;
+    virtual void draw(uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance) = 0;
+    virtual void draw_indexed(uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t base_vertex, uint32_t first_instance) = 0;
+    virtual void dispatch(uint32_t x, uint32_t y, uint32_t z) = 0;
+    virtual void execute_indirect(gpu_handle signature, uint32_t max_commands, gpu_handle arguments, uint64_t arguments_offset,
+                                  gpu_handle count_buffer, uint64_t count_offset) = 0;
+
+    // Barriers computed by the caller. The transitions that are not begin only set the tracked state of the resource.
+    virtual void barriers(const recorded_barrier *barriers, uint32_t num_barriers) = 0;
+
+    // Transitions of whole resources from a known state.
+    void transition(uint32_t before, uint32_t after, std::initializer_list<gpu_handle> resources);
+
+    // Tracked barriers: the transitions to the required states are batched until flush_barriers().
+    virtual void require_state(gpu_handle resource, uint32_t state) = 0;
+    virtual void require_uav(gpu_handle resource) = 0;
+    virtual void flush_barriers() = 0;
+
+    virtual void copy_descriptors(descriptor_handle dest, descriptor_handle src, uint32_t num_descriptors, descriptor_heap_kind heap) = 0;
+    virtual void copy_buffer(gpu_handle dest, uint64_t dest_offset, gpu_handle src, uint64_t src_offset, uint64_t size) = 0;
+
+    // Copies the data to upload memory that stays valid until the submission completes, returns its GPU address.
+    virtual gpu_address upload(const void *data, uint64_t size, uint64_t alignment) = 0;
+
+    // Uploads the data and copies it to the buffer.
+    virtual void update_buffer(gpu_handle dest, uint64_t dest_offset, const void *data, uint64_t size) = 0;
+
+    // Records commands straight on the list of the backend, e.g. the draws of a UI library. The D3D12 backend calls
+    // record with its ID3D12GraphicsCommandList, the null backend has no list and only counts the call.
+    virtual void record_native(const std::function<void(void *native_list)> &record) = 0;
+
+    // GPU timer around the commands, counted as a pass. Only the D3D12 backend measures the GPU time.
+    virtual void timer_start(profile_event_id event) { begin_pass(profile_event_name(event)); }
+    virtual void timer_stop(profile_event_id event) { (void)event; end_pass(); }
+
+    // Passes recorded since begin().
+    const std::vector<recorded_pass_stats> &pass_stats() const { return m_passes; }
+
+protected:
+    void reset_stats();
+    recorded_pass_stats *current_pass();
+    void count(recorded_command_type type, uint64_t amount = 1);
+
+    std::vector<recorded_pass_stats> m_passes;
+    bool m_is_in_pass = false;
+};
+
+class COMMON_API recording_device
+{
+public:
+    recording_device() = default;
+    virtual ~recording_device() = default;
+
+    virtual gpu_handle create_buffer(uint64_t size, const char *name) = 0;
+    virtual gpu_address buffer_address(gpu_handle buffer) = 0;
+
+    // Recorders belong to the device, they can be used by one thread at a time.
+    virtual command_recorder *create_recorder(bool is_compute) = 0;
+
+    // Starts a new frame of upload memory, the previous frames must be complete.
+    virtual void begin_frame() = 0;
+};
+
+class COMMON_API recording_queue
+{
+public:
+    recording_queue() = default;
+    virtual ~recording_queue() = default;
+
+    // Submits the recorders that ended, in order. The name marks the submission in GPU captures.
+    virtual void execute(command_recorder *const *recorders, uint32_t count, const char *name = nullptr) = 0;
+
+    // Value signaled after the work submitted so far, and CPU side wait.
+    virtual uint64_t signal() = 0;
+    virtual uint64_t completed_value() = 0;
+    virtual void wait(uint64_t value) = 0;
+
+    // The work submitted after this call waits until the other queue signals the value, of the same backend.
+    virtual void wait_on_gpu(recording_queue *queue, uint64_t value) = 0;
+};
+
+// Compact encoding of the commands: one type byte followed by the arguments, without padding.
+// The arguments are written in the order of the command_recorder parameters, see null_command_recorder. Files of
+// captured streams (command_capture.h) store this version, change it with the encoding.
+static const uint32_t command_stream_version = 3;
+
+class COMMON_API command_stream
+{
+public:
+    void clear() { m_bytes.clear(); }
+    size_t size() const { return m_bytes.size(); }
+    const uint8_t *data() const { return m_bytes.data(); }
+
+    void write_type(recorded_command_type type) { m_bytes.push_back((uint8_t)type); }
+    void write_bytes(const void *data, size_t size);
+    void write_string(const char *text);
+    template <typename T>
+    void write(const T &value) { write_bytes(&value, sizeof(T)); }
+
+private:
+    std::vector<uint8_t> m_bytes;
+};
+
+// Upload memory of the null backend: real CPU memory so that the copies cost what they do on a GPU, with
+// addresses in a range no resource uses. Allocations are lock-free and the memory is reused every frame.
+class COMMON_API null_upload_arena
+{
+public:
+    static const gpu_address base_address = 0x7f0000000000ull;
+
+    explicit null_upload_arena(uint64_t capacity = 64ull * 1024 * 1024);
+    ~null_upload_arena() = default;
+
+    gpu_address allocate(const void *data, uint64_t size, uint64_t alignment);
+    void reset() { m_offset.store(0, std::memory_order_relaxed); }
+    uint64_t high_water() const { return m_high_water.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<uint8_t> m_memory;
+    std::atomic<uint64_t> m_offset{0};
+    std::atomic<uint64_t> m_high_water{0};
+};
+
+class COMMON_API null_command_recorder : public command_recorder
+{
+public:
+    null_command_recorder(null_upload_arena *uploads, bool is_compute);
+    ~null_command_recorder() = default;
+
+    void begin(gpu_handle pipeline = 0) override;
+    void end() override;
+    void begin_pass(const char *name) override;
+    void end_pass() override;
+
+    void set_pipeline(gpu_handle pipeline) override;
+    void set_root_signature(gpu_handle root_signature, bool is_compute) override;
+    void set_root_constant_buffer(uint32_t parameter, gpu_address address) override;
+    void set_root_shader_resource(uint32_t parameter, gpu_address address) override;
+    void set_root_table(uint32_t parameter, gpu_address descriptor) override;
+    void stage_descriptor(uint32_t stage, uint32_t type, uint32_t slot, descriptor_handle descriptor) override;
+    void set_descriptor_tables() override;
+    void invalidate_descriptor_tables() override;
+    void set_vertex_buffer(gpu_address address, uint32_t size, uint32_t stride) override;
+    void set_index_buffer(gpu_address address, uint32_t size, bool is_32_bits) override;
+    void set_primitive_topology(primitive_topology topology) override;
+    void set_viewport(float width, float height) override;
+    void set_render_targets(uint32_t num_targets, const descriptor_handle *targets, descriptor_handle depth) override;
+    void clear_render_target(descriptor_handle target, const float color[4]) override;
+    void clear_depth(descriptor_handle depth, float value, bool is_clearing_stencil = false) override;
+    void draw(uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance) override;
+    void draw_indexed(uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t base_vertex, uint32_t first_instance) override;
+    void dispatch(uint32_t x, uint32_t y, uint32_t z) override;
+    void execute_indirect(gpu_handle signature, uint32_t max_commands, gpu_handle arguments, uint64_t arguments_offset,
+                          gpu_handle count_buffer, uint64_t count_offset) override;
+    void barriers(const recorded_barrier *barriers, uint32_t num_barriers) override;
+    void require_state(gpu_handle resource, uint32_t state) override;
+    void require_uav(gpu_handle resource) override;
+    void flush_barriers() override;
+    void copy_descriptors(descriptor_handle dest, descriptor_handle src, uint32_t num_descriptors, descriptor_heap_kind heap) override;
+    void copy_buffer(gpu_handle dest, uint64_t dest_offset, gpu_handle src, uint64_t src_offset, uint64_t size) override;
+    gpu_address upload(const void *data, uint64_t size, uint64_t alignment) override;
+    void update_buffer(gpu_handle dest, uint64_t dest_offset, const void *data, uint64_t size) override;
+    void record_native(const std::function<void(void *native_list)> &record) override;
+
+    const command_stream &stream() const { return m_stream; }
+    bool is_compute() const { return m_is_compute; }
+    bool is_recording() const { return m_is_recording; }
+
+private:
+    null_upload_arena *m_uploads;
+    command_stream m_stream;
+    bool m_is_compute;
+    bool m_is_recording = false;
+    resource_state_tracker m_tracker;
+    std::vector<tracked_barrier> m_pending_barriers;
+    std::vector<recorded_barrier> m_flushed_barriers;
+};
+
+class COMMON_API null_device : public recording_device
+{
+public:
+    static const gpu_address base_address = 0x100000000ull;
+
+    null_device() = default;
+    ~null_device();
+
+    gpu_handle create_buffer(uint64_t size, const char *name) override;
+    gpu_address buffer_address(gpu_handle buffer) override;
+    command_recorder *create_recorder(bool is_compute) override;
+    void begin_frame() override { m_uploads.reset(); }
+
+    const null_upload_arena &uploads() const { return m_uploads; }
+
+private:
+    null_upload_arena m_uploads;
+    std::vector<gpu_address> m_buffer_addresses; // Handle - 1 is the index.
+    gpu_address m_next_address = base_address;
+    std::vector<null_command_recorder *> m_recorders;
+};
+
+// Executes instantly: every signaled value is complete. Keeps the totals of what was submitted.
+class COMMON_API null_queue : public recording_queue
+{
+public:
+    null_queue() = default;
+    ~null_queue() = default;
+
+    void execute(command_recorder *const *recorders, uint32_t count, const char *name = nullptr) override;
+    uint64_t signal() override { return ++m_value; }
+    uint64_t completed_value() override { return m_value; }
+    void wait(uint64_t) override {}
+    void wait_on_gpu(recording_queue *, uint64_t) override {}
+
+    uint64_t m_num_submissions = 0;
+    uint64_t m_num_lists = 0;
+    uint64_t m_stream_bytes = 0;
+
+private:
+    uint64_t m_value = 0;
+};
+
+#pragma warning(pop)
@@ -21,9 +21,7 @@ inline void check_hr(HRESULT hr)
 
 void wait_duration(DWORD duration)
 {
-    HANDLE event_handle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
-    WaitForSingleObject(event_handle, duration);
-    CloseHandle(event_handle);
+    sleep_ms(duration);
 }
 
 void failed_assert(const char *file, int line, std::string statement, std::string message)
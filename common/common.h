@@ -4,12 +4,7 @@
 #include "stdint.h"
 #include <string>
 #include "step_timer.h"
-
-#ifdef COMMON_EXPORTS
-#define COMMON_API __declspec(dllexport)
-#else
-#define COMMON_API __declspec(dllimport)
-#endif
+#include "common_api.h"
 
 #define Kilobytes(Value) ((Value)*1024LL)
 #define Megabytes(Value) (Kilobytes(Value) * 1024LL)
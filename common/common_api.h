@@ -0,0 +1,13 @@
+#pragma once
+
+// DLL export macro shared by every file of the common library.
+// Kept free of platform headers so that device independent code can include it.
+#if defined(_WIN32)
+#ifdef COMMON_EXPORTS
+#define COMMON_API __declspec(dllexport)
+#else
+#define COMMON_API __declspec(dllimport)
+#endif
+#else
+#define COMMON_API
+#endif
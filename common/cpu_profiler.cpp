@@ -0,0 +1,387 @@
+#include "cpu_profiler.h"
+#include <algorithm>
+#include <deque>
+#include <sstream>
+#include <string.h>
+#include <thread>
+
+cpu_profiler g_cpu_profiler;
+
+// Interned names, looked up by an open addressing table of FNV-1a hashes.
+static const uint32_t event_table_size = max_profile_events * 2;
+static std::mutex g_events_mtx;
+static std::deque<std::string> g_event_names;
+static const char *g_event_name_ptrs[max_profile_events] = {};
+static profile_event_id g_event_table[event_table_size];
+static bool g_is_event_table_cleared = false;
+
+static uint32_t hash_name(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (const char *c = name; *c; c++)
+    {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    return hash;
+}
+
+profile_event_id intern_profile_event(const char *name)
+{
+    std::lock_guard<std::mutex> lock(g_events_mtx);
+    if (!g_is_event_table_cleared)
+    {
+        std::fill(g_event_table, g_event_table + event_table_size, profile_event_invalid);
+        g_is_event_table_cleared = true;
+    }
+
+    uint32_t slot = hash_name(name) % event_table_size;
+    while (g_event_table[slot] != profile_event_invalid)
+    {
+        if (strcmp(g_event_name_ptrs[g_event_table[slot]], name) == 0)
+        {
+            return g_event_table[slot];
+        }
+        slot = (slot + 1) % event_table_size;
+    }
+
+    if (g_event_names.size() >= max_profile_events)
+    {
+        return profile_event_invalid;
+    }
+    profile_event_id event = (profile_event_id)g_event_names.size();
+    g_event_names.push_back(name);
+    g_event_name_ptrs[event] = g_event_names.back().c_str();
+    g_event_table[slot] = event;
+    return event;
+}
+
+const char *profile_event_name(profile_event_id event)
+{
+    // Set before the id is returned by intern_profile_event() and never changed.
+    return event < max_profile_events && g_event_name_ptrs[event] ? g_event_name_ptrs[event] : "unknown event";
+}
+
+// Buffer of the calling thread in the profiler it last used.
+static thread_local const cpu_profiler *t_profiler = nullptr;
+static thread_local profile_thread_buffer *t_buffer = nullptr;
+
+// Lets the buffer be reused once the thread exits.
+struct profile_thread_exit
+{
+    ~profile_thread_exit()
+    {
+        if (t_buffer)
+        {
+            t_buffer->m_is_alive.store(false, std::memory_order_release);
+        }
+    }
+};
+static thread_local profile_thread_exit t_thread_exit;
+
+cpu_profiler::~cpu_profiler()
+{
+    if (t_profiler == this)
+    {
+        t_profiler = nullptr;
+        t_buffer = nullptr;
+    }
+    for (profile_thread_buffer *buffer : m_threads)
+    {
+        delete buffer;
+    }
+}
+
+profile_thread_buffer *cpu_profiler::thread_buffer()
+{
+    if (t_profiler == this)
+    {
+        return t_buffer;
+    }
+    return register_thread();
+}
+
+profile_thread_buffer *cpu_profiler::register_thread()
+{
+    // Before the buffer is set, so that the exit of the thread sees it.
+    (void)&t_thread_exit;
+
+    std::lock_guard<std::mutex> lock(m_threads_mtx);
+    profile_thread_buffer *buffer = nullptr;
+    for (profile_thread_buffer *dead : m_threads)
+    {
+        bool is_drained = dead->m_read.load(std::memory_order_relaxed) == dead->m_write.load(std::memory_order_acquire);
+        if (!dead->m_is_alive.load(std::memory_order_acquire) && is_drained)
+        {
+            buffer = dead;
+            buffer->m_open_scopes.clear();
+            buffer->m_is_alive.store(true, std::memory_order_relaxed);
+            break;
+        }
+    }
+    if (!buffer)
+    {
+        buffer = new profile_thread_buffer();
+        buffer->m_index = (uint32_t)m_threads.size();
+        m_threads.push_back(buffer);
+    }
+    buffer->m_name = "thread #" + std::to_string(buffer->m_index);
+
+    t_profiler = this;
+    t_buffer = buffer;
+    return buffer;
+}
+
+profile_thread_buffer *cpu_profiler::begin(profile_event_id event)
+{
+    profile_thread_buffer *buffer = thread_buffer();
+    write_profile_record(buffer, event, 0);
+    return buffer;
+}
+
+void cpu_profiler::end(profile_event_id event)
+{
+    write_profile_record(thread_buffer(), event, 1);
+}
+
+void cpu_profiler::set_thread_name(const char *name)
+{
+    profile_thread_buffer *buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(m_threads_mtx);
+    buffer->m_name = name;
+}
+
+const char *cpu_profiler::thread_name()
+{
+    return thread_buffer()->m_name.c_str();
+}
+
+uint32_t cpu_profiler::thread_index()
+{
+    return thread_buffer()->m_index;
+}
+
+// Node of the path parent/event of the thread, nodes after first belong to the thread.
+static int32_t find_node(std::vector<profile_node> *nodes, size_t first, uint32_t thread, int32_t parent, uint32_t depth,
+                         profile_event_id event)
+{
+    for (size_t i = first; i < nodes->size(); i++)
+    {
+        const profile_node &node = (*nodes)[i];
+        if (node.parent == parent && node.event == event)
+        {
+            return (int32_t)i;
+        }
+    }
+
+    profile_node node;
+    node.event = event;
+    node.thread = thread;
+    node.parent = parent;
+    node.depth = depth;
+    nodes->push_back(node);
+    return (int32_t)nodes->size() - 1;
+}
+
+void cpu_profiler::collect_thread(profile_thread_buffer *buffer, profile_frame *frame)
+{
+    std::vector<profile_node> *nodes = &frame->nodes;
+    size_t first = nodes->size();
+    uint32_t thread = buffer->m_index;
+
+    // The scopes still open at the end of the last frame get their nodes again in this one.
+    int32_t parent = -1;
+    for (size_t i = 0; i < buffer->m_open_scopes.size(); i++)
+    {
+        buffer->m_open_scopes[i].node = find_node(nodes, first, thread, parent, (uint32_t)i, buffer->m_open_scopes[i].event);
+        parent = buffer->m_open_scopes[i].node;
+    }
+
+    uint32_t read = buffer->m_read.load(std::memory_order_relaxed);
+    uint32_t write = buffer->m_write.load(std::memory_order_acquire);
+    for (uint32_t i = read; i != write; i++)
+    {
+        const profile_record &record = buffer->m_records[i & (profile_thread_buffer::capacity - 1)];
+        std::vector<profile_thread_buffer::open_scope> &open_scopes = buffer->m_open_scopes;
+        if (!record.is_end)
+        {
+            int32_t parent_node = open_scopes.empty() ? -1 : open_scopes.back().node;
+            int32_t node = find_node(nodes, first, thread, parent_node, (uint32_t)open_scopes.size(), record.event);
+            open_scopes.push_back({record.event, record.tsc, node});
+            continue;
+        }
+
+        // The scopes above the matching begin lost their end to a full buffer, an end without a begin lost its
+        // begin.
+        auto it = std::find_if(open_scopes.rbegin(), open_scopes.rend(), [&](const profile_thread_buffer::open_scope &scope) {
+            return scope.event == record.event;
+        });
+        if (it == open_scopes.rend())
+        {
+            continue;
+        }
+        open_scopes.erase(std::next(it).base() + 1, open_scopes.end());
+
+        profile_thread_buffer::open_scope scope = open_scopes.back();
+        open_scopes.pop_back();
+        double duration_ms = tsc_to_ms(record.tsc - scope.start_tsc);
+        profile_node &node = (*nodes)[scope.node];
+        node.calls++;
+        node.total_ms += duration_ms;
+        node.self_ms += duration_ms;
+        if (node.parent >= 0)
+        {
+            (*nodes)[node.parent].self_ms -= duration_ms;
+        }
+
+        double start_ms = scope.start_tsc >= m_frame_start_tsc ? tsc_to_ms(scope.start_tsc - m_frame_start_tsc)
+                                                               : -tsc_to_ms(m_frame_start_tsc - scope.start_tsc);
+        frame->scopes.push_back({record.event, thread, (uint32_t)open_scopes.size(), start_ms, duration_ms});
+    }
+    buffer->m_read.store(write, std::memory_order_release);
+    frame->num_dropped += buffer->m_num_dropped.exchange(0, std::memory_order_relaxed);
+}
+
+// Appends the node and its children to ordered, depth first.
+static void order_nodes(const std::vector<profile_node> &nodes, const std::vector<std::vector<int32_t>> &children, int32_t index,
+                        int32_t parent, std::vector<profile_node> *ordered)
+{
+    profile_node node = nodes[index];
+    node.parent = parent;
+    ordered->push_back(node);
+    int32_t new_index = (int32_t)ordered->size() - 1;
+    for (int32_t child : children[index])
+    {
+        order_nodes(nodes, children, child, new_index, ordered);
+    }
+}
+
+const profile_frame &cpu_profiler::end_frame()
+{
+    uint64_t end_tsc = read_tsc();
+    m_frame.frame_number++;
+    m_frame.start_tsc = m_frame_start_tsc;
+    m_frame.frame_ms = m_frame_start_tsc ? tsc_to_ms(end_tsc - m_frame_start_tsc) : 0.0;
+    m_frame.num_dropped = 0;
+    m_frame.nodes.clear();
+    m_frame.scopes.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_threads_mtx);
+        m_frame.thread_names.resize(m_threads.size());
+        for (profile_thread_buffer *buffer : m_threads)
+        {
+            m_frame.thread_names[buffer->m_index] = buffer->m_name;
+            collect_thread(buffer, &m_frame);
+        }
+    }
+
+    // The nodes are created in order of their first begin, the children of a node can be apart.
+    std::vector<std::vector<int32_t>> children(m_frame.nodes.size());
+    std::vector<profile_node> ordered;
+    ordered.reserve(m_frame.nodes.size());
+    for (size_t i = 0; i < m_frame.nodes.size(); i++)
+    {
+        if (m_frame.nodes[i].parent >= 0)
+        {
+            children[m_frame.nodes[i].parent].push_back((int32_t)i);
+        }
+    }
+    for (size_t i = 0; i < m_frame.nodes.size(); i++)
+    {
+        if (m_frame.nodes[i].parent < 0)
+        {
+            order_nodes(m_frame.nodes, children, (int32_t)i, -1, &ordered);
+        }
+    }
+    m_frame.nodes.swap(ordered);
+
+    m_frame_start_tsc = end_tsc;
+    return m_frame;
+}
+
+std::string dump_profile_frame(const profile_frame &frame)
+{
+    std::stringstream stream;
+    stream.precision(3);
+    stream << std::fixed;
+    stream << "Frame " << frame.frame_number << ": " << frame.frame_ms << " ms, " << frame.scopes.size() << " scopes";
+    if (frame.num_dropped > 0)
+    {
+        stream << ", " << frame.num_dropped << " records dropped";
+    }
+    stream << "\n";
+
+    uint32_t thread = 0xffffffff;
+    for (const profile_node &node : frame.nodes)
+    {
+        if (node.thread != thread)
+        {
+            thread = node.thread;
+            stream << frame.thread_names[thread] << "\n";
+        }
+        stream << std::string(2 + node.depth * 2, ' ') << profile_event_name(node.event) << ": " << node.calls << " calls, "
+               << node.total_ms << " ms, self " << node.self_ms << " ms\n";
+    }
+    return stream.str();
+}
+
+std::string benchmark_profile_scope(uint32_t num_scopes)
+{
+    // The scopes are written in batches that fit the buffer, the profiler is drained between them.
+    const uint32_t batch_size = profile_thread_buffer::capacity / 4;
+    profile_event_id outer = intern_profile_event("benchmark outer scope");
+    profile_event_id inner = intern_profile_event("benchmark inner scope");
+
+    uint64_t scope_ticks = 0;
+    uint64_t loop_ticks = 0;
+    uint32_t num_measured = 0;
+    size_t num_nodes = 0;
+    std::thread thread([&]() {
+        cpu_profiler profiler;
+        profiler.set_thread_name("profiler benchmark");
+        volatile uint32_t sink = 0;
+        for (uint32_t done = 0; done < num_scopes; done += batch_size)
+        {
+            // Pairs of nested scopes, ended like profile_scope does.
+            uint64_t start = clock_ticks();
+            for (uint32_t i = 0; i < batch_size; i += 2)
+            {
+                profile_thread_buffer *outer_buffer = profiler.begin(outer);
+                profile_thread_buffer *inner_buffer = profiler.begin(inner);
+                sink = sink + i;
+                write_profile_record(inner_buffer, inner, 1);
+                write_profile_record(outer_buffer, outer, 1);
+            }
+            uint64_t middle = clock_ticks();
+            for (uint32_t i = 0; i < batch_size; i += 2)
+            {
+                sink = sink + i;
+            }
+            uint64_t end = clock_ticks();
+            scope_ticks += middle - start;
+            loop_ticks += end - middle;
+            num_measured += batch_size;
+            num_nodes = profiler.end_frame().nodes.size();
+        }
+    });
+    thread.join();
+
+    double scope_ns = ticks_to_ms(scope_ticks - (std::min)(scope_ticks, loop_ticks)) * 1000000.0 / num_measured;
+
+    // The TSC reads are most of the cost, and much slower in virtual machines that trap them.
+    const uint32_t num_reads = 100000;
+    uint64_t tsc_sum = 0;
+    uint64_t tsc_start = clock_ticks();
+    for (uint32_t i = 0; i < num_reads; i++)
+    {
+        tsc_sum += read_tsc();
+    }
+    double tsc_ns = ticks_to_ms(clock_ticks() - tsc_start) * 1000000.0 / num_reads;
+
+    std::stringstream stream;
+    stream.precision(1);
+    stream << std::fixed;
+    stream << num_measured << " scopes in nested pairs, " << scope_ns << " ns per scope (begin and end), " << num_nodes
+           << " nodes per frame\n";
+    stream << "of which " << 2.0 * tsc_ns << " ns reading the TSC twice" << (tsc_sum != 0 ? "\n" : "");
+    return stream.str();
+}
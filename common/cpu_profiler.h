@@ -0,0 +1,176 @@
+#pragma once
+#include "common_api.h"
+#include "platform.h"
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Hierarchical CPU profiler.
+// Events are interned once per call site: PROFILE_EVENT("name") turns the name into a small id the first time the
+// line runs, later runs only read a static. A scope writes a begin and an end record with the TSC into a ring
+// buffer of its thread, without locks or allocations. The scope keeps the buffer it found at its begin, its end
+// is an inline write. Once per frame, end_frame() drains the buffers, matches the
+// records of each thread into nested scopes and merges them by call path.
+// Scopes must be closed on the thread that opened them, in reverse order.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+typedef uint16_t profile_event_id;
+static const profile_event_id profile_event_invalid = 0xffff;
+static const uint32_t max_profile_events = 1024;
+
+// Returns the id of the name, the same for every call with an equal string.
+COMMON_API profile_event_id intern_profile_event(const char *name);
+COMMON_API const char *profile_event_name(profile_event_id event);
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// Id of a name, interned by the first run of the call site.
+#define PROFILE_EVENT(name) ([]() { static const profile_event_id event = intern_profile_event(name); return event; }())
+
+// Profiles the rest of the enclosing block.
+#define PROFILE_SCOPE(name) profile_scope PROFILE_CONCAT(profile_scope_, __LINE__)(PROFILE_EVENT(name))
+
+struct profile_record
+{
+    uint64_t tsc;
+    profile_event_id event;
+    uint16_t is_end;
+};
+
+// Records of one thread. The thread writes, end_frame() reads, the two only share the indices.
+struct profile_thread_buffer
+{
+    static const uint32_t capacity = 16384; // Power of two.
+
+    std::atomic<uint32_t> m_write{0};
+    std::atomic<uint32_t> m_read{0};
+    uint32_t m_write_limit = capacity; // m_read + capacity when the writer last read it, only used by the writer.
+    std::atomic<uint32_t> m_num_dropped{0}; // Records lost because the buffer was full.
+    std::atomic<bool> m_is_alive{true};
+    uint32_t m_index = 0;
+    std::string m_name;
+    profile_record m_records[capacity];
+
+    // Scopes of the thread that are still open, only used by end_frame().
+    struct open_scope
+    {
+        profile_event_id event;
+        uint64_t start_tsc;
+        int32_t node;
+    };
+    std::vector<open_scope> m_open_scopes;
+};
+
+// Called by the thread that owns the buffer.
+inline void write_profile_record(profile_thread_buffer *buffer, profile_event_id event, uint16_t is_end)
+{
+    // The read index is only loaded once the slots known to be free are used up, its acquire orders the reuse of
+    // the slots end_frame() read.
+    uint32_t write = buffer->m_write.load(std::memory_order_relaxed);
+    if (write == buffer->m_write_limit)
+    {
+        buffer->m_write_limit = buffer->m_read.load(std::memory_order_acquire) + profile_thread_buffer::capacity;
+        if (write == buffer->m_write_limit)
+        {
+            buffer->m_num_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    profile_record &record = buffer->m_records[write & (profile_thread_buffer::capacity - 1)];
+    record.tsc = read_tsc();
+    record.event = event;
+    record.is_end = is_end;
+    buffer->m_write.store(write + 1, std::memory_order_release);
+}
+
+// Scopes with the same call path on the same thread, over one frame.
+struct profile_node
+{
+    profile_event_id event = profile_event_invalid;
+    uint32_t thread = 0;
+    int32_t parent = -1;
+    uint32_t depth = 0;
+    uint32_t calls = 0;
+    double total_ms = 0.0;
+    double self_ms = 0.0; // Without the time of the children.
+};
+
+// One closed scope, in the order they were closed.
+struct profile_scope_record
+{
+    profile_event_id event;
+    uint32_t thread;
+    uint32_t depth;
+    double start_ms; // Since the start of the frame, negative for a scope opened during an earlier frame.
+    double duration_ms;
+};
+
+struct profile_frame
+{
+    uint64_t frame_number = 0;
+    uint64_t start_tsc = 0;
+    double frame_ms = 0.0;
+    uint32_t num_dropped = 0;
+    std::vector<std::string> thread_names; // By thread index.
+    std::vector<profile_node> nodes;       // Depth first, the children in order of appearance.
+    std::vector<profile_scope_record> scopes;
+};
+
+class COMMON_API cpu_profiler
+{
+public:
+    cpu_profiler() = default;
+    ~cpu_profiler();
+
+    // A thread records into the buffer it registered with the last profiler it used, g_cpu_profiler unless a
+    // benchmark runs its own. begin() returns that buffer, to end the scope with write_profile_record().
+    profile_thread_buffer *begin(profile_event_id event);
+    void end(profile_event_id event);
+
+    // Name of the calling thread in the reports, "thread #index" by default.
+    void set_thread_name(const char *name);
+    const char *thread_name();
+    uint32_t thread_index();
+
+    // Collects the scopes closed since the last call. Called once per frame, by one thread.
+    // A scope is counted in the frame during which it is closed.
+    const profile_frame &end_frame();
+    const profile_frame &last_frame() const { return m_frame; }
+
+private:
+    profile_thread_buffer *thread_buffer();
+    profile_thread_buffer *register_thread();
+    void collect_thread(profile_thread_buffer *buffer, profile_frame *frame);
+
+    std::mutex m_threads_mtx;
+    std::vector<profile_thread_buffer *> m_threads;
+    profile_frame m_frame;
+    uint64_t m_frame_start_tsc = 0;
+};
+
+extern COMMON_API cpu_profiler g_cpu_profiler;
+
+struct profile_scope
+{
+    profile_scope(profile_event_id event) : m_buffer(g_cpu_profiler.begin(event)), m_event(event) {}
+    ~profile_scope() { write_profile_record(m_buffer, m_event, 1); }
+    profile_scope(const profile_scope &) = delete;
+    profile_scope &operator=(const profile_scope &) = delete;
+
+    profile_thread_buffer *m_buffer;
+    profile_event_id m_event;
+};
+
+// Indented call tree of each thread with the calls, total and self time of each path.
+COMMON_API std::string dump_profile_frame(const profile_frame &frame);
+
+// Cost of a scope, measured on a thread of its own with num_scopes nested and sequential scopes.
+COMMON_API std::string benchmark_profile_scope(uint32_t num_scopes = 1000000);
+
+#pragma warning(pop)
@@ -0,0 +1,410 @@
+#include "d3d12_recorder.h"
+#include "d3dx12.h"
+#include <pix3.h>
+
+d3d12_command_recorder::d3d12_command_recorder(gpu_interface *gpu, command_list_pool *pool)
+    : m_gpu(gpu), m_pool(pool)
+{
+}
+
+void d3d12_command_recorder::begin(gpu_handle pipeline)
+{
+    reset_stats();
+    m_cmd_list = m_pool->acquire((ID3D12PipelineState *)pipeline);
+    m_gpu->set_staging_heaps(m_cmd_list);
+    m_is_compute = m_cmd_list->GetType() == D3D12_COMMAND_LIST_TYPE_COMPUTE;
+    if (!m_is_compute)
+    {
+        m_cmd_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    }
+}
+
+void d3d12_command_recorder::end()
+{
+    m_gpu->close_command_list(m_cmd_list);
+}
+
+void d3d12_command_recorder::set_pipeline(gpu_handle pipeline)
+{
+    count(recorded_set_pipeline);
+    g_render_counters.add(counter_pipeline_changes);
+    m_cmd_list->SetPipelineState((ID3D12PipelineState *)pipeline);
+}
+
+void d3d12_command_recorder::set_root_signature(gpu_handle root_signature, bool is_compute)
+{
+    count(recorded_set_root_signature);
+    g_render_counters.add(counter_root_signature_changes);
+    m_is_compute = is_compute;
+    if (is_compute)
+    {
+        m_cmd_list->SetComputeRootSignature((ID3D12RootSignature *)root_signature);
+    }
+    else
+    {
+        m_cmd_list->SetGraphicsRootSignature((ID3D12RootSignature *)root_signature);
+    }
+}
+
+void d3d12_command_recorder::set_root_constant_buffer(uint32_t parameter, gpu_address address)
+{
+    count(recorded_set_root_constant_buffer);
+    if (m_is_compute)
+    {
+        m_cmd_list->SetComputeRootConstantBufferView(parameter, address);
+    }
+    else
+    {
+        m_cmd_list->SetGraphicsRootConstantBufferView(parameter, address);
+    }
+}
+
+void d3d12_command_recorder::set_root_shader_resource(uint32_t parameter, gpu_address address)
+{
+    count(recorded_set_root_shader_resource);
+    if (m_is_compute)
+    {
+        m_cmd_list->SetComputeRootShaderResourceView(parameter, address);
+    }
+    else
+    {
+        m_cmd_list->SetGraphicsRootShaderResourceView(parameter, address);
+    }
+}
+
+void d3d12_command_recorder::set_root_table(uint32_t parameter, gpu_address descriptor)
+{
+    count(recorded_set_root_table);
+    g_render_counters.add(counter_descriptor_tables);
+    D3D12_GPU_DESCRIPTOR_HANDLE handle = {descriptor};
+    if (m_is_compute)
+    {
+        m_cmd_list->SetComputeRootDescriptorTable(parameter, handle);
+    }
+    else
+    {
+        m_cmd_list->SetGraphicsRootDescriptorTable(parameter, handle);
+    }
+}
+
+gpu_interface::frame_resource::descriptor_table_frame_allocator *d3d12_command_recorder::table_allocator(uint32_t type)
+{
+    if (m_context)
+    {
+        return type == sampler ? &m_context->sampler_table_allocator : &m_context->csu_table_allocator;
+    }
+    gpu_interface::frame_resource *frame = m_gpu->get_frame_resource();
+    return type == sampler ? &frame->sampler_table_allocator : &frame->csu_table_allocator;
+}
+
+void d3d12_command_recorder::stage_descriptor(uint32_t stage, uint32_t type, uint32_t slot, descriptor_handle descriptor)
+{
+    count(recorded_stage_descriptor);
+    D3D12_CPU_DESCRIPTOR_HANDLE handle = {(SIZE_T)descriptor};
+    table_allocator(type)->stage_to_cpu_heap(m_gpu->device, (shader_stages)stage, (shader_descriptor_type)type, slot, handle);
+}
+
+void d3d12_command_recorder::set_descriptor_tables()
+{
+    count(recorded_set_descriptor_tables);
+    if (m_context)
+    {
+        m_gpu->set_descriptor_tables(m_cmd_list, m_context);
+    }
+    else
+    {
+        m_gpu->set_descriptor_tables(m_cmd_list);
+    }
+}
+
+void d3d12_command_recorder::invalidate_descriptor_tables()
+{
+    count(recorded_invalidate_descriptor_tables);
+    if (!m_context)
+    {
+        m_gpu->invalidate_descriptor_tables();
+        return;
+    }
+
+    for (int stage = 0; stage < SHADERSTAGE_MAX; ++stage)
+    {
+        m_context->csu_table_allocator.m_is_stage_dirty[stage] = true;
+        m_context->sampler_table_allocator.m_is_stage_dirty[stage] = true;
+    }
+}
+
+void d3d12_command_recorder::reserve_descriptor_tables(uint32_t num_table_sets)
+{
+    if (m_context)
+    {
+        m_gpu->begin_recording_context(m_context, num_table_sets);
+    }
+}
+
+void d3d12_command_recorder::set_vertex_buffer(gpu_address address, uint32_t size, uint32_t stride)
+{
+    count(recorded_set_vertex_buffer);
+    D3D12_VERTEX_BUFFER_VIEW view = {address, size, stride};
+    m_cmd_list->IASetVertexBuffers(0, 1, &view);
+}
+
+void d3d12_command_recorder::set_index_buffer(gpu_address address, uint32_t size, bool is_32_bits)
+{
+    count(recorded_set_index_buffer);
+    D3D12_INDEX_BUFFER_VIEW view = {address, size, is_32_bits ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT};
+    m_cmd_list->IASetIndexBuffer(&view);
+}
+
+void d3d12_command_recorder::set_primitive_topology(primitive_topology topology)
+{
+    count(recorded_set_primitive_topology);
+    const D3D12_PRIMITIVE_TOPOLOGY topologies[] = {D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+                                                   D3D_PRIMITIVE_TOPOLOGY_LINELIST,
+                                                   D3D_PRIMITIVE_TOPOLOGY_POINTLIST};
+    m_cmd_list->IASetPrimitiveTopology(topologies[topology]);
+}
+
+void d3d12_command_recorder::set_viewport(float width, float height)
+{
+    count(recorded_set_viewport);
+    D3D12_VIEWPORT viewport = {0.f, 0.f, width, height, 0.f, 1.f};
+    D3D12_RECT scissor_rect = {0, 0, (LONG)width, (LONG)height};
+    m_cmd_list->RSSetViewports(1, &viewport);
+    m_cmd_list->RSSetScissorRects(1, &scissor_rect);
+}
+
+void d3d12_command_recorder::set_render_targets(uint32_t num_targets, const descriptor_handle *targets, descriptor_handle depth)
+{
+    count(recorded_set_render_targets);
+    D3D12_CPU_DESCRIPTOR_HANDLE rtvs[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
+    for (uint32_t i = 0; i < num_targets; i++)
+    {
+        rtvs[i].ptr = (SIZE_T)targets[i];
+    }
+    D3D12_CPU_DESCRIPTOR_HANDLE dsv = {(SIZE_T)depth};
+    m_cmd_list->OMSetRenderTargets(num_targets, rtvs, FALSE, depth != 0 ? &dsv : nullptr);
+}
+
+void d3d12_command_recorder::clear_render_target(descriptor_handle target, const float color[4])
+{
+    count(recorded_clear_render_target);
+    D3D12_CPU_DESCRIPTOR_HANDLE rtv = {(SIZE_T)target};
+    m_cmd_list->ClearRenderTargetView(rtv, color, 0, nullptr);
+}
+
+void d3d12_command_recorder::clear_depth(descriptor_handle depth, float value, bool is_clearing_stencil)
+{
+    count(recorded_clear_depth);
+    D3D12_CPU_DESCRIPTOR_HANDLE dsv = {(SIZE_T)depth};
+    D3D12_CLEAR_FLAGS flags = is_clearing_stencil ? D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL : D3D12_CLEAR_FLAG_DEPTH;
+    m_cmd_list->ClearDepthStencilView(dsv, flags, value, 0, 0, nullptr);
+}
+
+void d3d12_command_recorder::draw(uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance)
+{
+    count(recorded_draw);
+    g_render_counters.add(counter_draws);
+    m_cmd_list->DrawInstanced(vertex_count, instance_count, first_vertex, first_instance);
+}
+
+void d3d12_command_recorder::draw_indexed(uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t base_vertex, uint32_t first_instance)
+{
+    count(recorded_draw_indexed);
+    g_render_counters.add(counter_draws);
+    m_cmd_list->DrawIndexedInstanced(index_count, instance_count, first_index, base_vertex, first_instance);
+}
+
+void d3d12_command_recorder::dispatch(uint32_t x, uint32_t y, uint32_t z)
+{
+    count(recorded_dispatch);
+    g_render_counters.add(counter_dispatches);
+    m_cmd_list->Dispatch(x, y, z);
+}
+
+void d3d12_command_recorder::execute_indirect(gpu_handle signature, uint32_t max_commands, gpu_handle arguments, uint64_t arguments_offset,
+                                              gpu_handle count_buffer, uint64_t count_offset)
+{
+    count(recorded_execute_indirect);
+    g_render_counters.add(counter_execute_indirect);
+    m_cmd_list->ExecuteIndirect((ID3D12CommandSignature *)signature, max_commands,
+                                (ID3D12Resource *)arguments, arguments_offset,
+                                (ID3D12Resource *)count_buffer, count_offset);
+}
+
+void d3d12_command_recorder::barriers(const recorded_barrier *barriers, uint32_t num_barriers)
+{
+    // gpu_interface flushes the tracked barriers first and counts them in the render counters.
+    count(recorded_barriers, num_barriers);
+    m_barriers.clear();
+    for (uint32_t i = 0; i < num_barriers; i++)
+    {
+        m_barriers.push_back(to_tracked_barrier(barriers[i]));
+    }
+    m_gpu->record_barriers(m_cmd_list, m_barriers);
+}
+
+void d3d12_command_recorder::require_state(gpu_handle resource, uint32_t state)
+{
+    m_gpu->require_state(m_cmd_list, (ID3D12Resource *)resource, (D3D12_RESOURCE_STATES)state);
+}
+
+void d3d12_command_recorder::require_uav(gpu_handle resource)
+{
+    m_gpu->require_uav(m_cmd_list, (ID3D12Resource *)resource);
+}
+
+void d3d12_command_recorder::flush_barriers()
+{
+    m_gpu->flush_barriers(m_cmd_list);
+}
+
+void d3d12_command_recorder::copy_descriptors(descriptor_handle dest, descriptor_handle src, uint32_t num_descriptors, descriptor_heap_kind heap)
+{
+    count(recorded_copy_descriptors, num_descriptors);
+    g_render_counters.add(counter_descriptor_copies, num_descriptors);
+    D3D12_CPU_DESCRIPTOR_HANDLE dest_handle = {(SIZE_T)dest};
+    D3D12_CPU_DESCRIPTOR_HANDLE src_handle = {(SIZE_T)src};
+    D3D12_DESCRIPTOR_HEAP_TYPE heap_type = heap == descriptor_heap_samplers ? D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER
+                                                                            : D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    m_gpu->device->CopyDescriptorsSimple(num_descriptors, dest_handle, src_handle, heap_type);
+}
+
+void d3d12_command_recorder::copy_buffer(gpu_handle dest, uint64_t dest_offset, gpu_handle src, uint64_t src_offset, uint64_t size)
+{
+    count(recorded_copy_buffer);
+    m_cmd_list->CopyBufferRegion((ID3D12Resource *)dest, dest_offset, (ID3D12Resource *)src, src_offset, size);
+}
+
+gpu_address d3d12_command_recorder::upload(const void *data, uint64_t size, uint64_t alignment)
+{
+    count(recorded_upload, size);
+    gpu_interface::frame_resource *frame = m_gpu->get_frame_resource();
+    UINT8 *dest = frame->m_resources_buffer.allocate((size_t)size, (size_t)alignment);
+    memcpy(dest, data, (size_t)size);
+    size_t offset = dest - frame->m_resources_buffer.m_begin;
+    return frame->m_resources_buffer.m_upload_resource->GetGPUVirtualAddress() + offset;
+}
+
+void d3d12_command_recorder::update_buffer(gpu_handle dest, uint64_t dest_offset, const void *data, uint64_t size)
+{
+    gpu_interface::frame_resource *frame = m_gpu->get_frame_resource();
+    gpu_address address = upload(data, size, 16);
+    uint64_t offset = address - frame->m_resources_buffer.m_upload_resource->GetGPUVirtualAddress();
+    copy_buffer(dest, dest_offset, to_handle(frame->m_resources_buffer.m_upload_resource.Get()), offset, size);
+}
+
+void d3d12_command_recorder::record_native(const std::function<void(void *native_list)> &record)
+{
+    // The native commands don't go through the tracker, the barriers they may depend on are recorded first.
+    flush_barriers();
+    count(recorded_native);
+    record(m_cmd_list);
+}
+
+void d3d12_command_recorder::timer_start(profile_event_id event)
+{
+    command_recorder::timer_start(event);
+    m_gpu->timer_start(m_cmd_list, event);
+}
+
+void d3d12_command_recorder::timer_stop(profile_event_id event)
+{
+    m_gpu->timer_stop(m_cmd_list, event);
+    command_recorder::timer_stop(event);
+}
+
+d3d12_recording_device::d3d12_recording_device(gpu_interface *gpu, command_list_pool *direct_pool, command_list_pool *compute_pool)
+    : m_gpu(gpu), m_direct_pool(direct_pool), m_compute_pool(compute_pool)
+{
+}
+
+d3d12_recording_device::~d3d12_recording_device()
+{
+    for (d3d12_command_recorder *recorder : m_recorders)
+    {
+        delete recorder;
+    }
+}
+
+gpu_handle d3d12_recording_device::create_buffer(uint64_t size, const char *name)
+{
+    ComPtr<ID3D12Resource> buffer;
+    check_hr(m_gpu->device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+                                                    D3D12_HEAP_FLAG_NONE,
+                                                    &CD3DX12_RESOURCE_DESC::Buffer(size),
+                                                    D3D12_RESOURCE_STATE_COMMON,
+                                                    nullptr,
+                                                    IID_PPV_ARGS(buffer.GetAddressOf())));
+    set_name(buffer.Get(), name);
+    track_gpu_memory(m_gpu->device.Get(), buffer.Get(), gpu_memory_buffers, name);
+    m_buffers.push_back(buffer);
+    return to_handle(buffer.Get());
+}
+
+gpu_address d3d12_recording_device::buffer_address(gpu_handle buffer)
+{
+    return ((ID3D12Resource *)buffer)->GetGPUVirtualAddress();
+}
+
+command_recorder *d3d12_recording_device::create_recorder(bool is_compute)
+{
+    m_recorders.push_back(new d3d12_command_recorder(m_gpu, is_compute ? m_compute_pool : m_direct_pool));
+    return m_recorders.back();
+}
+
+d3d12_recording_queue::d3d12_recording_queue(gpu_interface *gpu, ComPtr<ID3D12CommandQueue> queue, command_list_pool *pool)
+    : m_gpu(gpu), m_queue(queue), m_pool(pool)
+{
+    check_hr(m_gpu->device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(m_fence.GetAddressOf())));
+    NAME_D3D12_OBJECT(m_fence);
+    m_fence_event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+}
+
+d3d12_recording_queue::~d3d12_recording_queue()
+{
+    CloseHandle(m_fence_event);
+}
+
+void d3d12_recording_queue::execute(command_recorder *const *recorders, uint32_t count, const char *name)
+{
+    m_lists.clear();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        m_lists.push_back(static_cast<d3d12_command_recorder *>(recorders[i])->cmd_list());
+    }
+    if (name)
+    {
+        PIXBeginEvent(m_queue.Get(), 0, "%s: %llu", name, m_value + 1);
+    }
+    m_gpu->execute_command_lists(m_queue, m_lists.data(), (UINT)m_lists.size());
+    if (name)
+    {
+        PIXEndEvent(m_queue.Get());
+    }
+    m_unsignaled_lists.insert(m_unsignaled_lists.end(), m_lists.begin(), m_lists.end());
+}
+
+uint64_t d3d12_recording_queue::signal()
+{
+    m_value++;
+    check_hr(m_queue->Signal(m_fence.Get(), m_value));
+    m_pool->submitted(m_unsignaled_lists.data(), (UINT)m_unsignaled_lists.size(), m_fence.Get(), m_value);
+    m_unsignaled_lists.clear();
+    return m_value;
+}
+
+void d3d12_recording_queue::wait_on_gpu(recording_queue *queue, uint64_t value)
+{
+    check_hr(m_queue->Wait(static_cast<d3d12_recording_queue *>(queue)->fence(), value));
+}
+
+void d3d12_recording_queue::wait(uint64_t value)
+{
+    if (m_fence->GetCompletedValue() >= value)
+    {
+        return;
+    }
+    check_hr(m_fence->SetEventOnCompletion(value, m_fence_event));
+    stall_scope stall(stall_gpu_flush);
+    WaitForSingleObject(m_fence_event, INFINITE);
+}
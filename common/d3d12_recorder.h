@@ -0,0 +1,118 @@
+#pragma once
+#include "command_recorder.h"
+#include "command_list_pool.h"
+#include "gpu_interface.h"
+
+// D3D12 backend of the recording interface.
+// Handles are the D3D12 object pointers, e.g. to_handle(m_PSOs[pso]). The lists come from a command_list_pool and
+// the uploads from the upload buffer of the current frame resource. Descriptors are staged on the table allocators
+// of the frame resource, or on a recording context so that several lists can be recorded at the same time.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+class COMMON_API d3d12_command_recorder : public command_recorder
+{
+public:
+    d3d12_command_recorder(gpu_interface *gpu, command_list_pool *pool);
+    ~d3d12_command_recorder() = default;
+
+    // begin() acquires a list from the pool with the staging heaps set, end() closes it.
+    void begin(gpu_handle pipeline = 0) override;
+    void end() override;
+
+    // Stages the descriptors of the next lists on the context instead of the frame resource, null to stop.
+    void set_recording_context(gpu_interface::recording_context *context) { m_context = context; }
+
+    void set_pipeline(gpu_handle pipeline) override;
+    void set_root_signature(gpu_handle root_signature, bool is_compute) override;
+    void set_root_constant_buffer(uint32_t parameter, gpu_address address) override;
+    void set_root_shader_resource(uint32_t parameter, gpu_address address) override;
+    void set_root_table(uint32_t parameter, gpu_address descriptor) override;
+    void stage_descriptor(uint32_t stage, uint32_t type, uint32_t slot, descriptor_handle descriptor) override;
+    void set_descriptor_tables() override;
+    void invalidate_descriptor_tables() override;
+    void reserve_descriptor_tables(uint32_t num_table_sets) override;
+    void set_vertex_buffer(gpu_address address, uint32_t size, uint32_t stride) override;
+    void set_index_buffer(gpu_address address, uint32_t size, bool is_32_bits) override;
+    void set_primitive_topology(primitive_topology topology) override;
+    void set_viewport(float width, float height) override;
+    void set_render_targets(uint32_t num_targets, const descriptor_handle *targets, descriptor_handle depth) override;
+    void clear_render_target(descriptor_handle target, const float color[4]) override;
+    void clear_depth(descriptor_handle depth, float value, bool is_clearing_stencil = false) override;
+    void draw(uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance) override;
+    void draw_indexed(uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t base_vertex, uint32_t first_instance) override;
+    void dispatch(uint32_t x, uint32_t y, uint32_t z) override;
+    void execute_indirect(gpu_handle signature, uint32_t max_commands, gpu_handle arguments, uint64_t arguments_offset,
+                          gpu_handle count_buffer, uint64_t count_offset) override;
+    void barriers(const recorded_barrier *barriers, uint32_t num_barriers) override;
+    void require_state(gpu_handle resource, uint32_t state) override;
+    void require_uav(gpu_handle resource) override;
+    void flush_barriers() override;
+    void copy_descriptors(descriptor_handle dest, descriptor_handle src, uint32_t num_descriptors, descriptor_heap_kind heap) override;
+    void copy_buffer(gpu_handle dest, uint64_t dest_offset, gpu_handle src, uint64_t src_offset, uint64_t size) override;
+    gpu_address upload(const void *data, uint64_t size, uint64_t alignment) override;
+    void update_buffer(gpu_handle dest, uint64_t dest_offset, const void *data, uint64_t size) override;
+    void record_native(const std::function<void(void *native_list)> &record) override;
+    void timer_start(profile_event_id event) override;
+    void timer_stop(profile_event_id event) override;
+
+    // The list being recorded, or the last one until the next begin().
+    ID3D12GraphicsCommandList *cmd_list() const { return m_cmd_list; }
+
+private:
+    gpu_interface::frame_resource::descriptor_table_frame_allocator *table_allocator(uint32_t type);
+
+    gpu_interface *m_gpu;
+    command_list_pool *m_pool;
+    ID3D12GraphicsCommandList *m_cmd_list = nullptr;
+    gpu_interface::recording_context *m_context = nullptr;
+    bool m_is_compute = false;
+    std::vector<tracked_barrier> m_barriers;
+};
+
+class COMMON_API d3d12_recording_device : public recording_device
+{
+public:
+    d3d12_recording_device(gpu_interface *gpu, command_list_pool *direct_pool, command_list_pool *compute_pool);
+    ~d3d12_recording_device();
+
+    gpu_handle create_buffer(uint64_t size, const char *name) override;
+    gpu_address buffer_address(gpu_handle buffer) override;
+    command_recorder *create_recorder(bool is_compute) override;
+    void begin_frame() override {} // gpu_interface resets the upload buffer of the frame resource.
+
+private:
+    gpu_interface *m_gpu;
+    command_list_pool *m_direct_pool;
+    command_list_pool *m_compute_pool;
+    std::vector<ComPtr<ID3D12Resource>> m_buffers;
+    std::vector<d3d12_command_recorder *> m_recorders;
+};
+
+class COMMON_API d3d12_recording_queue : public recording_queue
+{
+public:
+    d3d12_recording_queue(gpu_interface *gpu, ComPtr<ID3D12CommandQueue> queue, command_list_pool *pool);
+    ~d3d12_recording_queue();
+
+    void execute(command_recorder *const *recorders, uint32_t count, const char *name = nullptr) override;
+    uint64_t signal() override;
+    uint64_t completed_value() override { return m_fence->GetCompletedValue(); }
+    void wait(uint64_t value) override;
+    void wait_on_gpu(recording_queue *queue, uint64_t value) override;
+
+    ID3D12Fence *fence() const { return m_fence.Get(); }
+
+private:
+    gpu_interface *m_gpu;
+    ComPtr<ID3D12CommandQueue> m_queue;
+    command_list_pool *m_pool;
+    ComPtr<ID3D12Fence> m_fence;
+    HANDLE m_fence_event;
+    uint64_t m_value = 0;
+    std::vector<ID3D12CommandList *> m_lists;
+    std::vector<ID3D12CommandList *> m_unsignaled_lists; // Tagged with the next signaled value.
+};
+
+#pragma warning(pop)
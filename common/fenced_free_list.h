@@ -0,0 +1,84 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Free list of pooled objects that the GPU uses until a fence reaches a value, e.g. the command lists of
+// command_list_pool. The objects are indices in the pool of the caller and the fences opaque pointers, the caller
+// reads their completed value. An object submitted with a fence value is only handed out again once recycle() saw
+// the fence reach it.
+// Device independent, header only.
+
+class fenced_free_list
+{
+public:
+    void clear()
+    {
+        m_free.clear();
+        m_in_flight.clear();
+    }
+
+    // A new object of the pool, free.
+    void add(size_t index) { m_free.push_back(index); }
+
+    // The most recently freed object first, false when none is free.
+    bool acquire(size_t *index)
+    {
+        if (m_free.empty())
+        {
+            return false;
+        }
+        *index = m_free.back();
+        m_free.pop_back();
+        return true;
+    }
+
+    void submitted(size_t index, const void *fence, uint64_t fence_value)
+    {
+        m_in_flight.push_back({index, fence, fence_value});
+    }
+
+    // Frees the objects whose fence reached their value. Most objects in flight wait for the same few fences,
+    // completed_value(fence) is called once per run of objects with the same fence. The objects left in flight
+    // keep their order, so do the runs.
+    template <typename completed_function>
+    void recycle(completed_function completed_value)
+    {
+        const void *last_fence = nullptr;
+        uint64_t completed = 0;
+        size_t num_kept = 0;
+        for (size_t i = 0; i < m_in_flight.size(); i++)
+        {
+            const in_flight &object = m_in_flight[i];
+            if (i == 0 || object.fence != last_fence)
+            {
+                last_fence = object.fence;
+                completed = completed_value(last_fence);
+            }
+
+            if (object.fence_value <= completed)
+            {
+                m_free.push_back(object.index);
+            }
+            else
+            {
+                m_in_flight[num_kept++] = object;
+            }
+        }
+        m_in_flight.resize(num_kept);
+    }
+
+    size_t num_free() const { return m_free.size(); }
+    size_t num_in_flight() const { return m_in_flight.size(); }
+
+private:
+    struct in_flight
+    {
+        size_t index;
+        const void *fence;
+        uint64_t fence_value;
+    };
+
+    std::vector<size_t> m_free;
+    std::vector<in_flight> m_in_flight;
+};
@@ -0,0 +1,116 @@
+#include "frame_pacer.h"
+#include "frame_stalls.h"
+#include <algorithm>
+
+void frame_pacer::set_frames_in_flight(uint32_t frames_in_flight)
+{
+    uint32_t max_count = max_frames_in_flight;
+    m_frames_in_flight = (std::min)((std::max)(frames_in_flight, 1u), max_count);
+    m_frame_index = 0;
+    for (uint64_t &value : m_frame_values)
+    {
+        value = m_last_value;
+    }
+}
+
+uint64_t frame_pacer::end_frame()
+{
+    uint64_t value = ++m_last_value;
+    m_frame_values[m_frame_index] = value;
+    m_frame_index = (m_frame_index + 1) % m_frames_in_flight;
+    m_frame_number++;
+    return value;
+}
+
+void simulated_gpu::submit(double now_ms, double gpu_ms, uint64_t value)
+{
+    m_busy_until_ms = (std::max)(m_busy_until_ms, now_ms) + gpu_ms;
+    m_signals.push_back({value, m_busy_until_ms});
+}
+
+uint64_t simulated_gpu::completed_value(double now_ms) const
+{
+    uint64_t completed = 0;
+    for (const signal &s : m_signals)
+    {
+        if (s.time_ms > now_ms)
+        {
+            break;
+        }
+        completed = (std::max)(completed, s.value);
+    }
+    return completed;
+}
+
+double simulated_gpu::completion_time(uint64_t value, double now_ms) const
+{
+    // Values that were never submitted don't block, like a fence that is already past them.
+    for (const signal &s : m_signals)
+    {
+        if (s.value >= value)
+        {
+            return (std::max)(s.time_ms, now_ms);
+        }
+    }
+    return now_ms;
+}
+
+frame_pacing_result simulate_frame_pacing(const frame_pacing_config &config)
+{
+    frame_pacer pacer;
+    pacer.set_frames_in_flight(config.frames_in_flight);
+    simulated_gpu gpu;
+
+    frame_pacing_result result;
+    present_pacing pacing(config.num_frames);
+    uint32_t random = 12345;
+    uint32_t first_measured = pacer.frames_in_flight() + 8;
+    uint32_t num_measured = 0;
+    double now = 0.0;
+    for (uint32_t frame = 0; frame < config.num_frames; frame++)
+    {
+        double frame_start = now;
+        double wait_ms = 0.0;
+        if (config.is_low_latency)
+        {
+            double ready = gpu.completion_time(pacer.frame_wait_value(), now);
+            wait_ms += ready - now;
+            now = ready;
+        }
+
+        // The frame wait runs during the update, the CPU only blocks for what is left of it. In low latency mode
+        // it is already done.
+        double input_time = now;
+        now += config.update_ms;
+        double ready = gpu.completion_time(pacer.frame_wait_value(), now);
+        wait_ms += ready - now;
+        random = random * 1664525u + 1013904223u;
+        double jitter = ((double)(random >> 8) / (double)(1u << 24) * 2.0 - 1.0) * config.record_jitter_ms;
+        now = ready + (std::max)(config.record_ms + jitter, 0.0);
+
+        uint64_t value = pacer.end_frame();
+        gpu.submit(now, config.gpu_ms, value);
+
+        if (frame >= first_measured)
+        {
+            result.frame_ms += now - frame_start;
+            result.cpu_wait_ms += wait_ms;
+            result.input_to_present_ms += now - input_time;
+            result.input_to_gpu_done_ms += gpu.completion_time(value, now) - input_time;
+            pacing.add_present(now);
+            num_measured++;
+        }
+    }
+
+    if (num_measured > 0)
+    {
+        result.frame_ms /= num_measured;
+        result.cpu_wait_ms /= num_measured;
+        result.input_to_present_ms /= num_measured;
+        result.input_to_gpu_done_ms /= num_measured;
+    }
+    frame_pacing_summary summary = pacing.summary();
+    result.present_interval_p99_ms = summary.interval.p99;
+    result.present_jitter_ms = summary.jitter.mean;
+    return result;
+}
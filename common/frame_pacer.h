@@ -0,0 +1,99 @@
+#pragma once
+#include "common_api.h"
+#include <stdint.h>
+#include <vector>
+
+// Frame indices and fence values of the frames in flight.
+// Every frame signals a new fence value when the GPU is done with it. A frame resource is reused by the frame
+// frames_in_flight later, which waits for the value of its last user. Usually that wait runs after the input is
+// sampled, during the update. In low latency mode it runs before: the input is sampled after the wait instead of
+// before it, and gets to the screen sooner.
+// simulated_gpu and simulate_frame_pacing() run the same logic against a GPU clock, to see the effect of the
+// settings without a device.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+class COMMON_API frame_pacer
+{
+public:
+    static const uint32_t max_frames_in_flight = 4;
+
+    frame_pacer() = default;
+    ~frame_pacer() = default;
+
+    // Restarts at frame resource 0, the fence values up to last_signaled_value are considered in use.
+    // Clamped to [1, max_frames_in_flight].
+    void set_frames_in_flight(uint32_t frames_in_flight);
+    uint32_t frames_in_flight() const { return m_frames_in_flight; }
+
+    uint32_t frame_index() const { return m_frame_index; }
+    uint64_t frame_number() const { return m_frame_number; }
+    uint64_t last_signaled_value() const { return m_last_value; }
+
+    // Value the GPU must reach before the current frame can use its frame resource.
+    uint64_t frame_wait_value() const { return m_frame_values[m_frame_index]; }
+
+    // Ends the current frame: returns the value to signal after its work and moves to the next frame resource.
+    uint64_t end_frame();
+
+    // Returns a value to signal outside of the frames, to wait for all the work submitted so far.
+    uint64_t flush_value() { return ++m_last_value; }
+
+private:
+    uint32_t m_frames_in_flight = 3;
+    uint32_t m_frame_index = 0;
+    uint64_t m_frame_number = 0;
+    uint64_t m_last_value = 0;
+    uint64_t m_frame_values[max_frames_in_flight] = {};
+};
+
+// GPU that runs the submitted work in order, on a clock in milliseconds given by the caller.
+class COMMON_API simulated_gpu
+{
+public:
+    simulated_gpu() = default;
+    ~simulated_gpu() = default;
+
+    // gpu_ms of work submitted at now_ms, the value is signaled when it is done.
+    void submit(double now_ms, double gpu_ms, uint64_t value);
+    uint64_t completed_value(double now_ms) const;
+
+    // Time at which the value is reached, now_ms if it already is.
+    double completion_time(uint64_t value, double now_ms) const;
+
+private:
+    struct signal
+    {
+        uint64_t value;
+        double time_ms;
+    };
+    std::vector<signal> m_signals; // In submission order.
+    double m_busy_until_ms = 0.0;
+};
+
+struct frame_pacing_config
+{
+    uint32_t frames_in_flight = 3;
+    bool is_low_latency = false;
+    double update_ms = 2.0; // CPU work before the frame resource is needed, from the input sampling.
+    double record_ms = 4.0; // CPU work that needs the frame resource, up to the present.
+    double gpu_ms = 8.0;
+    double record_jitter_ms = 0.0; // The recording takes record_ms plus or minus up to this, pseudo-randomly.
+    uint32_t num_frames = 200;
+};
+
+// Averages over the frames after the first frames_in_flight + 8, once the queue is in its steady state.
+struct frame_pacing_result
+{
+    double frame_ms = 0.0;
+    double cpu_wait_ms = 0.0;
+    double input_to_present_ms = 0.0;
+    double input_to_gpu_done_ms = 0.0;
+    double present_interval_p99_ms = 0.0;
+    double present_jitter_ms = 0.0; // Mean difference between two consecutive present intervals.
+};
+
+COMMON_API frame_pacing_result simulate_frame_pacing(const frame_pacing_config &config);
+
+#pragma warning(pop)
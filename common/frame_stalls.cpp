@@ -0,0 +1,103 @@
+#include "frame_stalls.h"
+#include "platform.h"
+#include <math.h>
+
+stall_tracker g_stall_tracker;
+
+const char *stall_cause_name(stall_cause cause)
+{
+    switch (cause)
+    {
+    case stall_frame_fence:
+        return "Stall: frame fence";
+    case stall_present:
+        return "Stall: present";
+    case stall_gpu_flush:
+        return "Stall: GPU flush";
+    case stall_job_wait:
+        return "Stall: job wait";
+    case stall_worker_sleep:
+        return "Stall: worker sleep";
+    default:
+        return "Stall: unknown";
+    }
+}
+
+// Profiler events of the causes, interned on first use.
+static profile_event_id stall_event(stall_cause cause)
+{
+    static profile_event_id events[stall_cause_count] = {
+        intern_profile_event(stall_cause_name(stall_frame_fence)),
+        intern_profile_event(stall_cause_name(stall_present)),
+        intern_profile_event(stall_cause_name(stall_gpu_flush)),
+        intern_profile_event(stall_cause_name(stall_job_wait)),
+        intern_profile_event(stall_cause_name(stall_worker_sleep)),
+    };
+    return events[cause];
+}
+
+present_pacing::present_pacing(uint32_t window)
+    : m_intervals(window), m_jitter(window)
+{
+}
+
+void present_pacing::set_window(uint32_t window)
+{
+    m_intervals.set_window(window);
+    m_jitter.set_window(window);
+    m_last_present_ms = -1.0;
+    m_last_interval_ms = -1.0;
+}
+
+void present_pacing::add_present(double present_ms)
+{
+    if (m_last_present_ms >= 0.0)
+    {
+        double interval_ms = present_ms - m_last_present_ms;
+        m_intervals.add(interval_ms);
+        if (m_last_interval_ms >= 0.0)
+        {
+            m_jitter.add(fabs(interval_ms - m_last_interval_ms));
+        }
+        m_last_interval_ms = interval_ms;
+    }
+    m_last_present_ms = present_ms;
+}
+
+frame_pacing_summary present_pacing::summary() const
+{
+    return {m_intervals.summary(), m_jitter.summary()};
+}
+
+uint64_t stall_tracker::begin_stall(stall_cause cause)
+{
+    g_cpu_profiler.begin(stall_event(cause));
+    return clock_ticks();
+}
+
+void stall_tracker::end_stall(stall_cause cause, uint64_t start_ticks)
+{
+    uint64_t ticks = clock_ticks() - start_ticks;
+    g_cpu_profiler.end(stall_event(cause));
+
+    cause_counters &counters = m_current[cause];
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.ticks.fetch_add(ticks, std::memory_order_relaxed);
+    uint64_t max_ticks = counters.max_ticks.load(std::memory_order_relaxed);
+    while (ticks > max_ticks && !counters.max_ticks.compare_exchange_weak(max_ticks, ticks, std::memory_order_relaxed))
+    {
+    }
+}
+
+void stall_tracker::end_frame(uint64_t present_ticks)
+{
+    // A stall that ends during the exchanges goes to either frame.
+    for (uint32_t i = 0; i < stall_cause_count; i++)
+    {
+        cause_counters &counters = m_current[i];
+        m_last_frame[i].count = counters.count.exchange(0, std::memory_order_relaxed);
+        m_last_frame[i].total_ms = ticks_to_ms(counters.ticks.exchange(0, std::memory_order_relaxed));
+        m_last_frame[i].max_ms = ticks_to_ms(counters.max_ticks.exchange(0, std::memory_order_relaxed));
+    }
+    m_pacing.add_present(ticks_to_ms(present_ticks));
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "common_api.h"
+#include "cpu_profiler.h"
+#include "rolling_stats.h"
+#include <atomic>
+#include <stdint.h>
+
+// Blocking waits of the frames, by cause, and the pacing of the presents.
+// A wait that can block is wrapped in begin_stall()/end_stall() or a stall_scope: its duration is added to the
+// totals of the frame, and it is a scope of g_cpu_profiler named after its cause, so it also shows in the profile
+// and in the traces on the thread that waited.
+// The present-to-present intervals tell how regular the frames are: their jitter is the mean difference between
+// two consecutive intervals, an even 20 ms has none while alternating 10 and 30 ms has 20 ms.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+enum stall_cause
+{
+    stall_frame_fence,  // The frame resource is still used by the GPU.
+    stall_present,      // Present(), blocks when the swapchain has no free buffer.
+    stall_gpu_flush,    // Other fence waits: queue flushes and synchronous submissions.
+    stall_job_wait,     // A thread waiting for the jobs of other threads, without any job to run meanwhile.
+    stall_worker_sleep, // A job worker parked because there was no job.
+    stall_cause_count,
+};
+
+COMMON_API const char *stall_cause_name(stall_cause cause);
+
+struct stall_totals
+{
+    uint32_t count = 0;
+    double total_ms = 0.0;
+    double max_ms = 0.0;
+};
+
+struct frame_pacing_summary
+{
+    rolling_summary interval; // Present to present.
+    rolling_summary jitter;   // Difference between two consecutive intervals.
+};
+
+// Statistics of the present-to-present intervals over the last frames, on any clock in milliseconds.
+class COMMON_API present_pacing
+{
+public:
+    present_pacing(uint32_t window = rolling_stats::default_window);
+    ~present_pacing() = default;
+
+    void set_window(uint32_t window);
+    void add_present(double present_ms);
+    frame_pacing_summary summary() const;
+
+private:
+    rolling_stats m_intervals;
+    rolling_stats m_jitter;
+    double m_last_present_ms = -1.0;
+    double m_last_interval_ms = -1.0;
+};
+
+class COMMON_API stall_tracker
+{
+public:
+    stall_tracker() = default;
+    ~stall_tracker() = default;
+
+    // Any thread. begin_stall() returns the start to give to end_stall().
+    uint64_t begin_stall(stall_cause cause);
+    void end_stall(stall_cause cause, uint64_t start_ticks);
+
+    // Called by the thread that presents, after Present(): ends the totals of the frame.
+    void end_frame(uint64_t present_ticks);
+    const stall_totals &last_frame(stall_cause cause) const { return m_last_frame[cause]; }
+    frame_pacing_summary pacing() const { return m_pacing.summary(); }
+    present_pacing &pacing_stats() { return m_pacing; }
+
+private:
+    struct cause_counters
+    {
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint64_t> ticks{0};
+        std::atomic<uint64_t> max_ticks{0};
+    };
+    cause_counters m_current[stall_cause_count];
+    stall_totals m_last_frame[stall_cause_count];
+    present_pacing m_pacing;
+};
+
+extern COMMON_API stall_tracker g_stall_tracker;
+
+// Stall of g_stall_tracker for the lifetime of the object.
+class stall_scope
+{
+public:
+    stall_scope(stall_cause cause)
+        : m_cause(cause), m_start(g_stall_tracker.begin_stall(cause))
+    {
+    }
+    ~stall_scope() { g_stall_tracker.end_stall(m_cause, m_start); }
+
+private:
+    stall_cause m_cause;
+    uint64_t m_start;
+};
+
+#pragma warning(pop)
@@ -5,11 +5,30 @@
 #include <pix3.h>
 #include <DirectXTex.h>
 #include "stb_image.h"
+#include <d3d12shader.h>
+#include <algorithm>
+#include <sstream>
+#include <thread>
 
 #include "../particles/shader_data.h"
 
 using namespace DirectX;
 
+// The state tracker is device independent, make sure its constants match D3D12.
+static_assert(all_subresources == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, "Subresource constant mismatch.");
+static_assert(resource_state_unordered_access == D3D12_RESOURCE_STATE_UNORDERED_ACCESS, "UAV state mismatch.");
+static_assert(tracked_barrier_begin_only == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY &&
+                  tracked_barrier_end_only == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY,
+              "Split barrier flags mismatch.");
+static_assert(resource_state_read_mask == (D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER |
+                                           D3D12_RESOURCE_STATE_INDEX_BUFFER |
+                                           D3D12_RESOURCE_STATE_DEPTH_READ |
+                                           D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
+                                           D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE |
+                                           D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT |
+                                           D3D12_RESOURCE_STATE_COPY_SOURCE),
+              "Read state mask mismatch.");
+
 void gpu_interface::init_core(DXGI_FORMAT back_buffer_format)
 {
     UINT32 dxgi_factory_flags = 0;
@@ -182,6 +201,7 @@ void gpu_interface::init_core(DXGI_FORMAT back_buffer_format)
         D3D12_RESOURCE_STATE_GENERIC_READ,
         nullptr,
         IID_PPV_ARGS(&m_buffer_uploader.m_upload_resource)));
+    track_gpu_memory(device.Get(), m_buffer_uploader.m_upload_resource.Get(), gpu_memory_upload, "Buffer uploader");
 
     void *pdata = nullptr;
     CD3DX12_RANGE read_range(0, 0);
@@ -199,21 +219,32 @@ void gpu_interface::init_core(DXGI_FORMAT back_buffer_format)
         D3D12_RESOURCE_STATE_GENERIC_READ,
         nullptr,
         IID_PPV_ARGS(&m_texture_uploader)));
+    track_gpu_memory(device.Get(), m_texture_uploader.Get(), gpu_memory_upload, "Texture uploader");
 
     m_tex_uploader_data = nullptr;
     m_texture_uploader->Map(0, &read_range, &m_tex_uploader_data);
     NAME_D3D12_OBJECT(m_texture_uploader);
 
-    frame_index = swapchain->GetCurrentBackBufferIndex();
+    back_buffer_index = swapchain->GetCurrentBackBufferIndex();
+    frame_index = m_frame_pacer.frame_index();
 
     // GPU timer.
-    m_gpu_timer = gpu_timer(device, graphics_cmd_queue,
-                            &frame_index, NUM_BACK_BUFFERS);
+    m_gpu_timer = gpu_timer(device, graphics_cmd_queue, MAX_FRAMES_IN_FLIGHT, max_timers_per_frame);
+    for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        m_timer_slots[i].resize(max_timers_per_frame);
+    }
+
+    // The timers of both queues use the query heap of the graphics queue, so its frequency.
+    m_clock_correlations[timer_queue_graphics].set_frequencies(m_gpu_timer.frequency(), (double)clock_frequency());
+    m_clock_correlations[timer_queue_compute].set_frequencies(m_gpu_timer.frequency(), (double)clock_frequency());
+    calibrate_clocks();
 }
 
 void gpu_interface::init_frame_resources(UINT additional_descriptors_count)
 {
-    for (UINT32 i = 0; i < NUM_BACK_BUFFERS; ++i)
+    // The descriptors of every possible frame are created up front, the upload buffers only for the frames in flight.
+    for (UINT32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
         // Create the command list and command allocator for the current frame
         ComPtr<ID3D12CommandAllocator> cmd_alloc;
@@ -230,11 +261,13 @@ void gpu_interface::init_frame_resources(UINT additional_descriptors_count)
         gpu_interface::frame_resource *frame = &frames[i];
         frame->cmd_alloc = cmd_alloc;
         frame->cmd_list = cmd_list;
-        frame->fence_value = i;
 
         // Create resource allocator
-        frame->m_resources_buffer = frame_resource::frame_resources_allocator::frame_resources_allocator(device, 1024 * 1024 * 128);
-        NAME_D3D12_OBJECT_INDEXED(frame->m_resources_buffer.m_upload_resource, i);
+        if (i < frames_in_flight())
+        {
+            frame->m_resources_buffer.create(device, frame_upload_buffer_size);
+            NAME_D3D12_OBJECT_INDEXED(frame->m_resources_buffer.m_upload_resource, i);
+        }
 
         // Create descriptor table allocators
         frame->csu_table_allocator = frame_resource::descriptor_table_frame_allocator::descriptor_table_frame_allocator(device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
@@ -261,9 +294,9 @@ void gpu_interface::resize(int width, int height,
     // Clear back buffers
     for (UINT i = 0; i < num_render_targets; i++)
     {
-        if (frames[i].back_buffer != nullptr)
+        if (back_buffers[i] != nullptr)
         {
-            frames[i].back_buffer.Reset();
+            back_buffers[i].Reset();
         }
     }
 
@@ -286,12 +319,14 @@ void gpu_interface::resize(int width, int height,
         ComPtr<ID3D12Resource> back_buffer = nullptr;
         check_hr(swapchain->GetBuffer(i, IID_PPV_ARGS(&back_buffer)));
         device->CreateRenderTargetView(back_buffer.Get(), nullptr, render_targets[i].rtv_backbuffer);
-        frames[i].back_buffer = back_buffer;
-        NAME_D3D12_OBJECT_INDEXED(frames[i].back_buffer, i);
+        back_buffers[i] = back_buffer;
+        NAME_D3D12_OBJECT_INDEXED(back_buffers[i], i);
+        track_gpu_memory(device.Get(), back_buffers[i].Get(), gpu_memory_render_targets, "Back buffer");
     }
+    back_buffer_index = swapchain->GetCurrentBackBufferIndex();
 }
 
-gpu_interface::frame_resource::frame_resources_allocator::frame_resources_allocator(
+void gpu_interface::frame_resource::frame_resources_allocator::create(
     ComPtr<ID3D12Device> device,
     size_t size)
 {
@@ -302,23 +337,109 @@ gpu_interface::frame_resource::frame_resources_allocator::frame_resources_alloca
         &CD3DX12_RESOURCE_DESC::Buffer(size),
         D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
         IID_PPV_ARGS(&m_upload_resource)));
+    track_gpu_memory(device.Get(), m_upload_resource.Get(), gpu_memory_upload, "Frame upload buffer");
 
     void *pdata;
     CD3DX12_RANGE read_range(0, 0);
     m_upload_resource->Map(0, &read_range, &pdata);
-    m_current = m_begin = reinterpret_cast<UINT8 *>(pdata);
-    m_end = m_begin + size;
+    init(reinterpret_cast<UINT8 *>(pdata), size);
+}
+
+void gpu_interface::frame_resource::frame_resources_allocator::init(UINT8 *begin, size_t size)
+{
+    m_begin = begin;
+    m_end = begin + size;
+    m_allocator.init(begin, size);
 }
 
 UINT8 *gpu_interface::frame_resource::frame_resources_allocator::allocate(
     size_t size,
     size_t alignment)
 {
-    m_current = reinterpret_cast<UINT8 *>(align_up(reinterpret_cast<size_t>(m_current), alignment));
-    ASSERT(m_current + size <= m_end, "Buffer is not full");
-    UINT8 *ret = m_current;
-    m_current += size;
-    return ret;
+    g_render_counters.add(counter_upload_bytes, size);
+    UINT8 *data = m_allocator.allocate(size, alignment);
+    ASSERT(data != nullptr, "Upload buffer is full");
+    return data;
+}
+
+std::string gpu_interface::benchmark_upload_contention(size_t constants_size, UINT max_threads)
+{
+    const UINT allocations_per_thread = 4096;
+    const size_t alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+    const size_t block_size = frame_resource::frame_resources_allocator::block_size;
+    size_t size_per_thread = allocations_per_thread * align_up(constants_size, alignment) + 2 * block_size;
+
+    frame_resource::frame_resources_allocator allocator;
+    allocator.create(device, max_threads * size_per_thread);
+    std::vector<UINT8> constants(constants_size, 0);
+
+    // The previous scheme: a single pointer bumped under a mutex.
+    std::mutex locked_mtx;
+    UINT8 *locked_current = nullptr;
+
+    auto run = [&](UINT num_threads, bool is_locked) {
+        allocator.reset();
+        locked_current = allocator.m_begin;
+
+        std::atomic<UINT> num_ready{0};
+        std::atomic<bool> is_started{false};
+        std::vector<std::thread> threads;
+        for (UINT t = 0; t < num_threads; t++)
+        {
+            threads.emplace_back([&]() {
+                num_ready.fetch_add(1);
+                while (!is_started.load(std::memory_order_acquire))
+                {
+                    std::this_thread::yield();
+                }
+
+                for (UINT i = 0; i < allocations_per_thread; i++)
+                {
+                    UINT8 *dest = nullptr;
+                    if (is_locked)
+                    {
+                        std::lock_guard<std::mutex> lock(locked_mtx);
+                        dest = reinterpret_cast<UINT8 *>(align_up(reinterpret_cast<size_t>(locked_current), alignment));
+                        locked_current = dest + constants_size;
+                    }
+                    else
+                    {
+                        dest = allocator.allocate(constants_size, alignment);
+                    }
+                    memcpy(dest, constants.data(), constants_size);
+                }
+            });
+        }
+
+        // Time from the moment every thread is ready to go.
+        while (num_ready.load() < num_threads)
+        {
+            std::this_thread::yield();
+        }
+        double start_time = g_cpu_timer.get_timestamp();
+        is_started.store(true, std::memory_order_release);
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        return (g_cpu_timer.get_timestamp() - start_time) / g_cpu_timer.cpu_frequency * cpu_timer::milliseconds;
+    };
+
+    std::stringstream stream;
+    stream.precision(1);
+    stream << std::fixed;
+    stream << allocations_per_thread << " allocations of " << constants_size << " bytes per thread, ns per allocation\n";
+    stream << "threads    mutex    lock-free    speedup\n";
+    for (UINT num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+    {
+        double locked_ms = run(num_threads, true);
+        double lock_free_ms = run(num_threads, false);
+        double num_allocations = (double)num_threads * allocations_per_thread;
+        stream << num_threads << "    " << locked_ms * 1000000.0 / num_allocations
+               << "    " << lock_free_ms * 1000000.0 / num_allocations
+               << "    " << locked_ms / lock_free_ms << "x\n";
+    }
+    return stream.str();
 }
 
 gpu_interface::frame_resource::descriptor_table_frame_allocator::descriptor_table_frame_allocator(
@@ -338,13 +459,25 @@ gpu_interface::frame_resource::descriptor_table_frame_allocator::descriptor_tabl
     heap_desc.NumDescriptors = m_descriptor_count * SHADERSTAGE_MAX;
     check_hr(device->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&m_heap_cpu)));
 
-    heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-    heap_desc.NumDescriptors = (m_descriptor_count * SHADERSTAGE_MAX * max_rename_count) + additional_descriptors_count;
-    check_hr(device->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&m_heap_gpu)));
+    // Slices write to the shader visible heap of the frame's allocator.
+    if (max_rename_count > 0)
+    {
+        heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+        heap_desc.NumDescriptors = (m_descriptor_count * SHADERSTAGE_MAX * max_rename_count) + additional_descriptors_count;
+        check_hr(device->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&m_heap_gpu)));
+    }
 
     m_descriptor_type = descriptor_type;
     m_descriptor_size = device->GetDescriptorHandleIncrementSize(descriptor_type);
+    m_ring_offset = 0;
+    m_ring_end = m_descriptor_count * SHADERSTAGE_MAX * max_rename_count * m_descriptor_size; // The additional descriptors follow the ring.
     m_bound_descriptors.resize(SHADERSTAGE_MAX * descriptor_count);
+
+    // Copy whole tables until the staging usage is known.
+    for (int stage = 0; stage < SHADERSTAGE_MAX; ++stage)
+    {
+        m_stage_copy_count[stage] = m_descriptor_count;
+    }
 }
 
 void gpu_interface::frame_resource::descriptor_table_frame_allocator::reset_staging_heap(
@@ -388,6 +521,7 @@ void gpu_interface::frame_resource::descriptor_table_frame_allocator::reset_stag
                                               dst_staging, null_descriptors_sampler_csu[3],
                                               m_descriptor_type);
             }
+            g_render_counters.add(counter_descriptor_copies, GPU_RESOURCE_HEAP_CBV_COUNT + GPU_RESOURCE_HEAP_SRV_COUNT + GPU_RESOURCE_HEAP_UAV_COUNT);
         }
     }
 }
@@ -438,6 +572,7 @@ void gpu_interface::frame_resource::descriptor_table_frame_allocator::stage_to_c
     dst_staging.ptr += offset_to_descriptor * m_descriptor_size;
 
     device->CopyDescriptorsSimple(1, dst_staging, descriptor, m_descriptor_type);
+    g_render_counters.add(counter_descriptor_copies);
 }
 
 void gpu_interface::frame_resource::descriptor_table_frame_allocator::set_tables(
@@ -448,13 +583,16 @@ void gpu_interface::frame_resource::descriptor_table_frame_allocator::set_tables
     {
         if (m_is_stage_dirty[CS])
         {
+            ASSERT(m_ring_offset + m_stage_copy_count[CS] * m_descriptor_size <= m_ring_end, "Descriptor ring is full");
+
             D3D12_CPU_DESCRIPTOR_HANDLE dst = m_heap_gpu->GetCPUDescriptorHandleForHeapStart();
             dst.ptr += m_ring_offset;
 
             D3D12_CPU_DESCRIPTOR_HANDLE src = m_heap_cpu->GetCPUDescriptorHandleForHeapStart();
             src.ptr += (CS * m_descriptor_count) * m_descriptor_size;
 
-            device->CopyDescriptorsSimple(m_descriptor_count, dst, src, m_descriptor_type);
+            device->CopyDescriptorsSimple(m_stage_copy_count[CS], dst, src, m_descriptor_type);
+            g_render_counters.add(counter_descriptor_copies, m_stage_copy_count[CS]);
 
             D3D12_GPU_DESCRIPTOR_HANDLE table_base_descriptor = m_heap_gpu->GetGPUDescriptorHandleForHeapStart();
             table_base_descriptor.ptr += m_ring_offset;
@@ -467,8 +605,9 @@ void gpu_interface::frame_resource::descriptor_table_frame_allocator::set_tables
             {
                 cmd_list->SetComputeRootDescriptorTable(1, table_base_descriptor); // Sampler table.
             }
+            g_render_counters.add(counter_descriptor_tables);
             m_is_stage_dirty[CS] = false;
-            m_ring_offset += m_descriptor_count * m_descriptor_size;
+            m_ring_offset += m_stage_copy_count[CS] * m_descriptor_size;
         }
         return;
     }
@@ -479,13 +618,16 @@ void gpu_interface::frame_resource::descriptor_table_frame_allocator::set_tables
         {
             if (m_is_stage_dirty[stage])
             {
+                ASSERT(m_ring_offset + m_stage_copy_count[stage] * m_descriptor_size <= m_ring_end, "Descriptor ring is full");
+
                 D3D12_CPU_DESCRIPTOR_HANDLE dst = m_heap_gpu->GetCPUDescriptorHandleForHeapStart();
                 dst.ptr += m_ring_offset;
 
                 D3D12_CPU_DESCRIPTOR_HANDLE src = m_heap_cpu->GetCPUDescriptorHandleForHeapStart();
                 src.ptr += (stage * m_descriptor_count) * m_descriptor_size;
 
-                device->CopyDescriptorsSimple(m_descriptor_count, dst, src, m_descriptor_type);
+                device->CopyDescriptorsSimple(m_stage_copy_count[stage], dst, src, m_descriptor_type);
+                g_render_counters.add(counter_descriptor_copies, m_stage_copy_count[stage]);
 
                 D3D12_GPU_DESCRIPTOR_HANDLE table_base_descriptor = m_heap_gpu->GetGPUDescriptorHandleForHeapStart();
                 table_base_descriptor.ptr += m_ring_offset;
@@ -498,19 +640,51 @@ void gpu_interface::frame_resource::descriptor_table_frame_allocator::set_tables
                 {
                     cmd_list->SetGraphicsRootDescriptorTable(stage * 2 + 1, table_base_descriptor); // Sampler table.
                 }
+                g_render_counters.add(counter_descriptor_tables);
 
                 m_is_stage_dirty[stage] = false;
-                m_ring_offset += m_descriptor_count * m_descriptor_size;
+                m_ring_offset += m_stage_copy_count[stage] * m_descriptor_size;
             }
         }
     }
 }
 
+UINT gpu_interface::frame_resource::descriptor_table_frame_allocator::graphics_tables_size() const
+{
+    UINT size = 0;
+    for (int stage = VS; stage < SHADERSTAGE_MAX; ++stage)
+    {
+        if (stage != CS)
+        {
+            size += m_stage_copy_count[stage] * m_descriptor_size;
+        }
+    }
+    return size;
+}
+
+void gpu_interface::frame_resource::descriptor_table_frame_allocator::reserve_slice(
+    descriptor_table_frame_allocator *slice,
+    UINT num_table_sets)
+{
+    UINT slice_size = num_table_sets * graphics_tables_size();
+    ASSERT(m_ring_offset + slice_size <= m_ring_end, "Descriptor ring is full");
+
+    slice->m_heap_gpu = m_heap_gpu;
+    for (int stage = 0; stage < SHADERSTAGE_MAX; ++stage)
+    {
+        slice->m_stage_copy_count[stage] = m_stage_copy_count[stage];
+    }
+    slice->m_ring_offset = m_ring_offset;
+    slice->m_ring_end = m_ring_offset + slice_size;
+    m_ring_offset += slice_size;
+}
+
 bool gpu_interface::compile_shader(const wchar_t *file,
                                    const wchar_t *entry,
                                    shader_stages stage,
                                    ID3DBlob **blob,
-                                   D3D_SHADER_MACRO *defines)
+                                   D3D_SHADER_MACRO *defines,
+                                   shader_reflection *reflection)
 {
     WIN32_FIND_DATAW found_file;
     if (FindFirstFileW(file, &found_file) == INVALID_HANDLE_VALUE)
@@ -605,9 +779,171 @@ bool gpu_interface::compile_shader(const wchar_t *file,
     }
     check_hr(hr);
 
+    // The root signatures are sized from the bindings of the shaders compiled by this run.
+    shader_reflection shader_bindings = reflect_shader(*blob, stage, entry);
+    if (reflection)
+    {
+        *reflection = shader_bindings;
+    }
+    m_shader_reflections.push_back(shader_bindings);
+
     return true;
 }
 
+shader_reflection gpu_interface::reflect_shader(ID3DBlob *blob, shader_stages stage, const wchar_t *entry)
+{
+    shader_reflection reflection = {};
+    reflection.stage = stage;
+    std::wstring wentry(entry);
+    reflection.entry = std::string(wentry.begin(), wentry.end());
+
+    ComPtr<ID3D12ShaderReflection> shader_reflector;
+    check_hr(D3DReflect(blob->GetBufferPointer(), blob->GetBufferSize(), IID_PPV_ARGS(&shader_reflector)));
+
+    D3D12_SHADER_DESC shader_desc = {};
+    check_hr(shader_reflector->GetDesc(&shader_desc));
+
+    for (UINT i = 0; i < shader_desc.BoundResources; i++)
+    {
+        D3D12_SHADER_INPUT_BIND_DESC bind_desc = {};
+        check_hr(shader_reflector->GetResourceBindingDesc(i, &bind_desc));
+
+        shader_binding binding = {};
+        binding.name = bind_desc.Name;
+        binding.bind_point = bind_desc.BindPoint;
+        binding.space = bind_desc.Space;
+
+        // Unbounded arrays report a bind count of 0, they are never staged so count them as one.
+        binding.bind_count = bind_desc.BindCount == 0 ? 1 : bind_desc.BindCount;
+
+        switch (bind_desc.Type)
+        {
+        case D3D_SIT_CBUFFER:
+        {
+            binding.type = CBV;
+            D3D12_SHADER_BUFFER_DESC buffer_desc = {};
+            ID3D12ShaderReflectionConstantBuffer *cb = shader_reflector->GetConstantBufferByName(bind_desc.Name);
+            if (SUCCEEDED(cb->GetDesc(&buffer_desc)))
+            {
+                binding.size = buffer_desc.Size;
+            }
+            break;
+        }
+        case D3D_SIT_SAMPLER:
+            binding.type = sampler;
+            break;
+        case D3D_SIT_TBUFFER:
+        case D3D_SIT_TEXTURE:
+        case D3D_SIT_STRUCTURED:
+        case D3D_SIT_BYTEADDRESS:
+            binding.type = SRV;
+            break;
+        default:
+            binding.type = UAV;
+            break;
+        }
+        reflection.bindings.push_back(binding);
+    }
+    return reflection;
+}
+
+void gpu_interface::size_staging_tables(UINT graphics_space, UINT compute_space)
+{
+    // Graphics and compute stages stage their descriptors in different register spaces.
+    staging_usage compute_usage;
+    bool fits = compute_staging_usage(m_shader_reflections, graphics_space, staging_limits, &m_staging_usage);
+    fits &= compute_staging_usage(m_shader_reflections, compute_space, staging_limits, &compute_usage);
+    memcpy(m_staging_usage.count[CS], compute_usage.count[CS], sizeof(compute_usage.count[CS]));
+    ASSERT(fits, "A shader binds more staging descriptors than the staging tables hold.");
+
+    // Only copy the part of each staging table that shaders can read.
+    for (UINT32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        for (int stage = 0; stage < SHADERSTAGE_MAX; stage++)
+        {
+            const UINT32 *count = m_staging_usage.count[stage];
+            UINT csu_copy_count = count[CBV];
+            if (count[UAV] > 0)
+            {
+                csu_copy_count = GPU_RESOURCE_HEAP_CBV_COUNT + GPU_RESOURCE_HEAP_SRV_COUNT + count[UAV];
+            }
+            else if (count[SRV] > 0)
+            {
+                csu_copy_count = GPU_RESOURCE_HEAP_CBV_COUNT + count[SRV];
+            }
+
+            // Tables are always bound, keep at least one valid descriptor behind them.
+            frames[i].csu_table_allocator.m_stage_copy_count[stage] = (csu_copy_count > 0) ? csu_copy_count : 1;
+            frames[i].sampler_table_allocator.m_stage_copy_count[stage] = (count[sampler] > 0) ? count[sampler] : 1;
+        }
+    }
+
+    m_has_staging_usage = true;
+}
+
+rootsig_layout gpu_interface::build_graphics_staging_layout(const std::vector<shader_reflection> &shaders,
+                                                            const rootsig_layout_options &options,
+                                                            UINT space)
+{
+    rootsig_layout root_bindings = build_rootsig_layout(shaders, options);
+    return build_staging_rootsig_layout(shaders, root_bindings, space, staging_limits);
+}
+
+UINT gpu_interface::fill_staging_ranges(shader_stages stage, UINT space,
+                                        D3D12_DESCRIPTOR_RANGE1 *csu_ranges,
+                                        D3D12_DESCRIPTOR_RANGE1 *sampler_range)
+{
+    // Ranges keep their offset in the staging table so that stage_to_cpu_heap() is unaffected by the shrinking.
+    const UINT range_sizes[3] = {GPU_RESOURCE_HEAP_CBV_COUNT, GPU_RESOURCE_HEAP_SRV_COUNT, GPU_RESOURCE_HEAP_UAV_COUNT};
+    const D3D12_DESCRIPTOR_RANGE_TYPE range_types[3] = {D3D12_DESCRIPTOR_RANGE_TYPE_CBV,
+                                                        D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+                                                        D3D12_DESCRIPTOR_RANGE_TYPE_UAV};
+    UINT range_count = 0;
+    UINT table_offset = 0;
+    for (int type = CBV; type <= UAV; type++)
+    {
+        UINT num_descriptors = m_has_staging_usage ? m_staging_usage.count[stage][type] : range_sizes[type];
+        if (num_descriptors > 0)
+        {
+            D3D12_DESCRIPTOR_RANGE1 &range = csu_ranges[range_count++];
+            range.RangeType = range_types[type];
+            range.BaseShaderRegister = 0;
+            range.RegisterSpace = space;
+            range.NumDescriptors = num_descriptors;
+            range.OffsetInDescriptorsFromTableStart = table_offset;
+            range.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE;
+        }
+        table_offset += range_sizes[type];
+    }
+
+    // A table needs at least one range.
+    if (range_count == 0)
+    {
+        D3D12_DESCRIPTOR_RANGE1 &range = csu_ranges[range_count++];
+        range.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_CBV;
+        range.BaseShaderRegister = 0;
+        range.RegisterSpace = space;
+        range.NumDescriptors = 1;
+        range.OffsetInDescriptorsFromTableStart = 0;
+        range.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE;
+    }
+
+    *sampler_range = {};
+    sampler_range->RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER;
+    sampler_range->BaseShaderRegister = 0;
+    sampler_range->RegisterSpace = space;
+    sampler_range->NumDescriptors = GPU_SAMPLER_HEAP_COUNT;
+    if (m_has_staging_usage)
+    {
+        UINT num_samplers = m_staging_usage.count[stage][sampler];
+        sampler_range->NumDescriptors = (num_samplers > 0) ? num_samplers : 1;
+    }
+    sampler_range->OffsetInDescriptorsFromTableStart = 0;
+    sampler_range->Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE;
+
+    return range_count;
+}
+
 ComPtr<ID3D12RootSignature> gpu_interface::create_rootsig(std::vector<D3D12_ROOT_PARAMETER1> *params,
                                                           std::vector<CD3DX12_STATIC_SAMPLER_DESC> *samplers,
                                                           D3D12_ROOT_SIGNATURE_FLAGS flags)
@@ -651,6 +987,70 @@ ComPtr<ID3D12RootSignature> gpu_interface::create_rootsig(std::vector<D3D12_ROOT
     return rootsig;
 }
 
+ComPtr<ID3D12RootSignature> gpu_interface::create_rootsig(const rootsig_layout &layout,
+                                                          std::vector<CD3DX12_STATIC_SAMPLER_DESC> *samplers,
+                                                          D3D12_ROOT_SIGNATURE_FLAGS flags)
+{
+    const D3D12_SHADER_VISIBILITY visibilities[SHADERSTAGE_MAX + 1] = {D3D12_SHADER_VISIBILITY_VERTEX,
+                                                                       D3D12_SHADER_VISIBILITY_HULL,
+                                                                       D3D12_SHADER_VISIBILITY_DOMAIN,
+                                                                       D3D12_SHADER_VISIBILITY_GEOMETRY,
+                                                                       D3D12_SHADER_VISIBILITY_PIXEL,
+                                                                       D3D12_SHADER_VISIBILITY_ALL,  // CS
+                                                                       D3D12_SHADER_VISIBILITY_ALL}; // SHADERSTAGE_MAX
+    const D3D12_DESCRIPTOR_RANGE_TYPE range_types[DESCRIPTORTYPE_MAX] = {D3D12_DESCRIPTOR_RANGE_TYPE_CBV,
+                                                                         D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+                                                                         D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+                                                                         D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER};
+
+    // The ranges must outlive the serialization of the root signature.
+    std::vector<std::vector<D3D12_DESCRIPTOR_RANGE1>> ranges(layout.parameters.size());
+    std::vector<D3D12_ROOT_PARAMETER1> params(layout.parameters.size());
+
+    for (size_t i = 0; i < layout.parameters.size(); i++)
+    {
+        const rootsig_parameter &src = layout.parameters[i];
+        D3D12_ROOT_PARAMETER1 &param = params[i];
+        param.ShaderVisibility = visibilities[src.visibility];
+
+        switch (src.type)
+        {
+        case rootsig_table:
+            for (const rootsig_range &src_range : src.ranges)
+            {
+                D3D12_DESCRIPTOR_RANGE1 range = {};
+                range.RangeType = range_types[src_range.type];
+                range.BaseShaderRegister = src_range.base_register;
+                range.RegisterSpace = src_range.space;
+                range.NumDescriptors = src_range.count;
+                range.OffsetInDescriptorsFromTableStart = src_range.table_offset;
+                range.Flags = (src_range.type == sampler) ? D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE
+                                                          : D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE | D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE;
+                ranges[i].push_back(range);
+            }
+            param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+            param.DescriptorTable.NumDescriptorRanges = (UINT)ranges[i].size();
+            param.DescriptorTable.pDescriptorRanges = ranges[i].data();
+            break;
+        case rootsig_constants:
+            param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+            param.Constants.Num32BitValues = src.num_32bit_values;
+            param.Constants.ShaderRegister = src.shader_register;
+            param.Constants.RegisterSpace = src.space;
+            break;
+        default:
+            param.ParameterType = (src.type == rootsig_cbv) ? D3D12_ROOT_PARAMETER_TYPE_CBV
+                                  : (src.type == rootsig_srv) ? D3D12_ROOT_PARAMETER_TYPE_SRV
+                                                              : D3D12_ROOT_PARAMETER_TYPE_UAV;
+            param.Descriptor.ShaderRegister = src.shader_register;
+            param.Descriptor.RegisterSpace = src.space;
+            param.Descriptor.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE;
+            break;
+        }
+    }
+    return create_rootsig(&params, samplers, flags);
+}
+
 std::vector<D3D12_RESOURCE_BARRIER> gpu_interface::transition(
     D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after,
     const std::vector<ComPtr<ID3D12Resource>> &resources,
@@ -674,17 +1074,341 @@ std::vector<D3D12_RESOURCE_BARRIER> gpu_interface::transition(
 
     if (cmd_list)
     {
+        // Keep the tracked states in sync with the hand-coded transitions.
+        // The first half of a split barrier doesn't change the state yet.
+        if ((flags & D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY) == 0)
+        {
+            flush_barriers(cmd_list.Get());
+            command_list_states *states = get_command_list_states(cmd_list.Get());
+            for (auto &resource : resources)
+            {
+                UINT num_subresources = (subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES) ? 1 : resource_subresource_count(resource.Get());
+                states->tracker.assume(resource.Get(), before, after, subresource, num_subresources);
+            }
+        }
         cmd_list->ResourceBarrier((UINT)barriers.size(), barriers.data());
+        g_render_counters.add(counter_barriers, barriers.size());
     }
     return barriers;
 }
 
+UINT gpu_interface::resource_subresource_count(ID3D12Resource *resource)
+{
+    D3D12_RESOURCE_DESC desc = resource->GetDesc();
+    if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+    {
+        return 1;
+    }
+
+    UINT array_size = (desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D) ? 1 : desc.DepthOrArraySize;
+    return desc.MipLevels * array_size;
+}
+
+gpu_interface::command_list_states *gpu_interface::get_command_list_states(ID3D12CommandList *cmd_list)
+{
+    // Elements of an unordered_map keep their address and are never erased, the states can be used outside of the lock.
+    // A list is only recorded by one thread at a time, its states need no other synchronization.
+    {
+        std::shared_lock<std::shared_mutex> lock(m_command_list_states_mtx);
+        auto it = m_command_list_states.find(cmd_list);
+        if (it != m_command_list_states.end())
+        {
+            return &it->second;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_command_list_states_mtx);
+    return &m_command_list_states[cmd_list];
+}
+
+void gpu_interface::register_resource(ID3D12Resource *resource, D3D12_RESOURCE_STATES state)
+{
+    std::lock_guard<std::mutex> lock(m_state_mtx);
+    m_state_registry.register_resource(resource, state, resource_subresource_count(resource));
+}
+
+void gpu_interface::unregister_resource(ID3D12Resource *resource)
+{
+    std::lock_guard<std::mutex> lock(m_state_mtx);
+    m_state_registry.unregister_resource(resource);
+}
+
+// Private data of a tracked object, D3D12 releases it when the object is destroyed.
+class gpu_memory_release : public IUnknown
+{
+public:
+    gpu_memory_release(uint64_t id) : m_id(id) {}
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **object) override
+    {
+        if (riid == __uuidof(IUnknown))
+        {
+            *object = static_cast<IUnknown *>(this);
+            AddRef();
+            return S_OK;
+        }
+        *object = nullptr;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() override { return ++m_refs; }
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        ULONG refs = --m_refs;
+        if (refs == 0)
+        {
+            g_gpu_memory.remove(m_id);
+            delete this;
+        }
+        return refs;
+    }
+
+private:
+    uint64_t m_id;
+    std::atomic<ULONG> m_refs{1};
+};
+
+// {062CA930-E9A5-41F3-8D0D-93F8AE87D1C1}
+static const GUID gpu_memory_release_guid = {0x062ca930, 0xe9a5, 0x41f3, {0x8d, 0x0d, 0x93, 0xf8, 0xae, 0x87, 0xd1, 0xc1}};
+
+static void track_object(ID3D12Object *object, gpu_memory_category category, gpu_allocation_kind kind, const char *name,
+                         uint64_t size, ID3D12Heap *heap)
+{
+    // An object tracked twice keeps its first entry, replacing the private data would remove it.
+    uint64_t id = (uint64_t)(uintptr_t)object;
+    if (!g_gpu_memory.add(id, category, kind, name, size, (uint64_t)(uintptr_t)heap))
+    {
+        return;
+    }
+    gpu_memory_release *release = new gpu_memory_release(id);
+    check_hr(object->SetPrivateDataInterface(gpu_memory_release_guid, release));
+    release->Release();
+}
+
+void track_gpu_memory(ID3D12Device *device, ID3D12Resource *resource, gpu_memory_category category, const char *name,
+                      ID3D12Heap *heap)
+{
+    D3D12_RESOURCE_DESC desc = resource->GetDesc();
+    D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(gpu_interface::DEFAULT_NODE, 1, &desc);
+    track_object(resource, category, heap ? gpu_allocation_placed : gpu_allocation_committed, name, info.SizeInBytes, heap);
+}
+
+void track_gpu_memory(ID3D12Heap *heap, gpu_memory_category category, const char *name)
+{
+    track_object(heap, category, gpu_allocation_heap, name, heap->GetDesc().SizeInBytes, nullptr);
+}
+
+void track_gpu_memory(ID3D12QueryHeap *heap, UINT num_queries, const char *name)
+{
+    track_object(heap, gpu_memory_queries, gpu_allocation_heap, name, num_queries * sizeof(UINT64), nullptr);
+}
+
+void gpu_interface::require_state(ID3D12GraphicsCommandList *cmd_list,
+                                  ID3D12Resource *resource,
+                                  D3D12_RESOURCE_STATES state,
+                                  UINT subresource)
+{
+    command_list_states *states = get_command_list_states(cmd_list);
+    UINT num_subresources = (subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES) ? 1 : resource_subresource_count(resource);
+    states->tracker.require(resource, state, subresource, num_subresources);
+}
+
+void gpu_interface::require_uav(ID3D12GraphicsCommandList *cmd_list, ID3D12Resource *resource)
+{
+    get_command_list_states(cmd_list)->tracker.require_uav(resource);
+}
+
+static void to_d3d12_barriers(const std::vector<tracked_barrier> &tracked, std::vector<D3D12_RESOURCE_BARRIER> *out)
+{
+    out->clear();
+    for (const tracked_barrier &barrier : tracked)
+    {
+        D3D12_RESOURCE_BARRIER d3d12_barrier = {};
+        d3d12_barrier.Flags = (D3D12_RESOURCE_BARRIER_FLAGS)barrier.flags;
+        if (barrier.type == tracked_barrier_uav)
+        {
+            d3d12_barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+            d3d12_barrier.UAV.pResource = (ID3D12Resource *)barrier.resource;
+        }
+        else if (barrier.type == tracked_barrier_aliasing)
+        {
+            d3d12_barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+            d3d12_barrier.Aliasing.pResourceBefore = (ID3D12Resource *)barrier.resource_before;
+            d3d12_barrier.Aliasing.pResourceAfter = (ID3D12Resource *)barrier.resource;
+        }
+        else
+        {
+            d3d12_barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+            d3d12_barrier.Transition.pResource = (ID3D12Resource *)barrier.resource;
+            d3d12_barrier.Transition.Subresource = barrier.subresource;
+            d3d12_barrier.Transition.StateBefore = (D3D12_RESOURCE_STATES)barrier.before;
+            d3d12_barrier.Transition.StateAfter = (D3D12_RESOURCE_STATES)barrier.after;
+        }
+        out->push_back(d3d12_barrier);
+    }
+}
+
+void gpu_interface::flush_barriers(ID3D12GraphicsCommandList *cmd_list)
+{
+    command_list_states *states = get_command_list_states(cmd_list);
+    if (!states->tracker.has_pending())
+    {
+        return;
+    }
+
+    states->pending.clear();
+    states->tracker.flush(&states->pending);
+    to_d3d12_barriers(states->pending, &states->barriers);
+    cmd_list->ResourceBarrier((UINT)states->barriers.size(), states->barriers.data());
+    g_render_counters.add(counter_barriers, states->barriers.size());
+}
+
+// Records barriers computed outside of the tracker, e.g. by a render graph, in one call.
+void gpu_interface::record_barriers(ID3D12GraphicsCommandList *cmd_list, const std::vector<tracked_barrier> &barriers)
+{
+    flush_barriers(cmd_list);
+
+    command_list_states *states = get_command_list_states(cmd_list);
+    for (const tracked_barrier &barrier : barriers)
+    {
+        // The first half of a split barrier doesn't change the state yet.
+        if (barrier.type == tracked_barrier_transition && (barrier.flags & tracked_barrier_begin_only) == 0)
+        {
+            ID3D12Resource *resource = (ID3D12Resource *)barrier.resource;
+            UINT num_subresources = (barrier.subresource == all_subresources) ? 1 : resource_subresource_count(resource);
+            states->tracker.assume(resource, barrier.before, barrier.after, barrier.subresource, num_subresources);
+        }
+    }
+
+    to_d3d12_barriers(barriers, &states->barriers);
+    cmd_list->ResourceBarrier((UINT)states->barriers.size(), states->barriers.data());
+    g_render_counters.add(counter_barriers, states->barriers.size());
+}
+
+void gpu_interface::acquire_fixup_lists(UINT queue_index, UINT count, std::vector<fixup_list> *out)
+{
+    D3D12_COMMAND_LIST_TYPE list_type = (queue_index == 1) ? D3D12_COMMAND_LIST_TYPE_COMPUTE : D3D12_COMMAND_LIST_TYPE_DIRECT;
+    out->clear();
+    UINT first_index = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_fixup_mtx);
+        if (m_fixup_fences[queue_index] == nullptr)
+        {
+            check_hr(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(m_fixup_fences[queue_index].GetAddressOf())));
+        }
+
+        UINT64 completed_value = m_fixup_fences[queue_index]->GetCompletedValue();
+        std::vector<fixup_list> &free_lists = m_fixup_lists[queue_index];
+        for (size_t i = free_lists.size(); i-- > 0 && out->size() < count;)
+        {
+            if (free_lists[i].fence_value <= completed_value)
+            {
+                out->push_back(std::move(free_lists[i]));
+                free_lists.erase(free_lists.begin() + i);
+            }
+        }
+
+        first_index = m_fixup_list_count;
+        m_fixup_list_count += count - (UINT)out->size();
+    }
+
+    // The missing lists are created outside of the locks, closed so that every list in the pool is reset the same way.
+    for (UINT index = first_index; out->size() < count; index++)
+    {
+        fixup_list fixup = {};
+        check_hr(device->CreateCommandAllocator(list_type, IID_PPV_ARGS(fixup.cmd_alloc.GetAddressOf())));
+        check_hr(device->CreateCommandList(DEFAULT_NODE, list_type, fixup.cmd_alloc.Get(), nullptr, IID_PPV_ARGS(fixup.cmd_list.GetAddressOf())));
+        check_hr(fixup.cmd_list->Close());
+        NAME_D3D12_OBJECT_INDEXED(fixup.cmd_list, index);
+        out->push_back(std::move(fixup));
+    }
+}
+
+void gpu_interface::release_fixup_lists(UINT queue_index, std::vector<fixup_list> *lists)
+{
+    std::lock_guard<std::mutex> lock(m_fixup_mtx);
+    for (fixup_list &fixup : *lists)
+    {
+        m_fixup_lists[queue_index].push_back(std::move(fixup));
+    }
+    lists->clear();
+}
+
+void gpu_interface::execute_command_lists(ComPtr<ID3D12CommandQueue> queue, ID3D12CommandList *const *cmd_lists, UINT count)
+{
+    UINT queue_index = (queue->GetDesc().Type == D3D12_COMMAND_LIST_TYPE_COMPUTE) ? 1 : 0;
+
+    // Each list needs at most one fixup list, they are taken before the registry is locked.
+    // The ones that end up unused go back to the free lists untouched.
+    std::lock_guard<std::mutex> submit_lock(m_submit_mtx[queue_index]);
+    std::vector<fixup_list> &fixups = m_submit_fixups[queue_index];
+    acquire_fixup_lists(queue_index, count, &fixups);
+
+    {
+        // Lists are resolved in submission order, the lock keeps the registry in the same order as the queue.
+        std::lock_guard<std::mutex> lock(m_state_mtx);
+        std::vector<command_list_states *> &list_states = m_submit_states;
+        list_states.clear();
+        for (UINT i = 0; i < count; i++)
+        {
+            list_states.push_back(get_command_list_states(cmd_lists[i]));
+            ASSERT(!list_states[i]->tracker.has_pending(), "A command list was closed with pending barriers, call flush_barriers() first.");
+            ASSERT(list_states[i]->stopped_timers.empty(), "A command list was closed with unresolved timers, call close_command_list().");
+        }
+
+        m_submit_lists.clear();
+        bool has_fixups = false;
+        UINT64 next_fence_value = m_fixup_fence_values[queue_index] + 1;
+        UINT num_used_fixups = 0;
+
+        for (UINT i = 0; i < count; i++)
+        {
+            m_fixup_barriers.clear();
+            m_state_registry.resolve(list_states[i]->tracker, &m_fixup_barriers);
+            list_states[i]->tracker.reset();
+
+            if (!m_fixup_barriers.empty())
+            {
+                fixup_list *fixup = &fixups[num_used_fixups++];
+                check_hr(fixup->cmd_alloc->Reset());
+                check_hr(fixup->cmd_list->Reset(fixup->cmd_alloc.Get(), nullptr));
+                fixup->fence_value = next_fence_value; // Not reusable until this submission completes.
+                to_d3d12_barriers(m_fixup_barriers, &m_fixup_d3d12_barriers);
+                fixup->cmd_list->ResourceBarrier((UINT)m_fixup_d3d12_barriers.size(), m_fixup_d3d12_barriers.data());
+                g_render_counters.add(counter_barriers, m_fixup_d3d12_barriers.size());
+                check_hr(fixup->cmd_list->Close());
+                m_submit_lists.push_back(fixup->cmd_list.Get());
+                has_fixups = true;
+            }
+            m_submit_lists.push_back(cmd_lists[i]);
+        }
+
+        // Everything goes in a single submission, fixups included.
+        uint64_t submit_ticks = clock_ticks();
+        for (UINT i = 0; i < count; i++)
+        {
+            m_submissions[frame_index].push_back({cmd_lists[i], submit_ticks});
+        }
+        queue->ExecuteCommandLists((UINT)m_submit_lists.size(), m_submit_lists.data());
+        g_render_counters.add(counter_command_lists, m_submit_lists.size());
+
+        if (has_fixups)
+        {
+            m_fixup_fence_values[queue_index] = next_fence_value;
+            check_hr(queue->Signal(m_fixup_fences[queue_index].Get(), next_fence_value));
+        }
+    }
+
+    release_fixup_lists(queue_index, &fixups);
+}
+
 void gpu_interface::default_resource_from_uploader(ComPtr<ID3D12GraphicsCommandList> cmd_list,
                                                    ID3D12Resource **default_resource,
                                                    const void *data,
                                                    size_t byte_size,
                                                    size_t alignment,
-                                                   D3D12_RESOURCE_FLAGS flags)
+                                                   D3D12_RESOURCE_FLAGS flags,
+                                                   gpu_memory_category category,
+                                                   const char *name)
 {
     size_t aligned_byte_size = align_up(byte_size, alignment);
     check_hr(device->CreateCommittedResource(
@@ -695,6 +1419,7 @@ void gpu_interface::default_resource_from_uploader(ComPtr<ID3D12GraphicsCommandL
         nullptr,
         IID_PPV_ARGS(default_resource)));
     ID3D12Resource *p_default_resource = (*default_resource);
+    track_gpu_memory(device.Get(), p_default_resource, category, name);
 
     UINT8 *upload_dest = m_buffer_uploader.allocate(byte_size, aligned_byte_size);
     if (data != nullptr)
@@ -706,12 +1431,15 @@ void gpu_interface::default_resource_from_uploader(ComPtr<ID3D12GraphicsCommandL
     cmd_list->CopyBufferRegion(p_default_resource, 0,
                                m_buffer_uploader.m_upload_resource.Get(), offset,
                                byte_size);
+
+    register_resource(p_default_resource, D3D12_RESOURCE_STATE_COPY_DEST);
 }
 
 UINT8 *gpu_interface::resource_uploader::allocate(UINT64 data_size, UINT64 alignment)
 {
     data_size = align_up(data_size, alignment);
     ASSERT(m_current + data_size <= m_end, "Buffer is not full");
+    g_render_counters.add(counter_upload_bytes, data_size);
 
     UINT8 *ret = m_current;
     m_current += data_size;
@@ -759,6 +1487,7 @@ void gpu_interface::create_dsv(UINT64 width, UINT height)
         &clear_value,
         IID_PPV_ARGS(&depth_stencil_default_resource)));
     NAME_D3D12_OBJECT(depth_stencil_default_resource);
+    track_gpu_memory(device.Get(), depth_stencil_default_resource.Get(), gpu_memory_render_targets, "Depth stencil");
 
     // Depth stencil view
     D3D12_DEPTH_STENCIL_VIEW_DESC dsv_desv = {};
@@ -777,25 +1506,78 @@ void gpu_interface::set_descriptor_tables(ComPtr<ID3D12GraphicsCommandList> cmd_
     frame->sampler_table_allocator.set_tables(device, cmd_list);
 }
 
+void gpu_interface::invalidate_descriptor_tables()
+{
+    frame_resource *frame = get_frame_resource();
+    for (int stage = 0; stage < SHADERSTAGE_MAX; ++stage)
+    {
+        frame->csu_table_allocator.m_is_stage_dirty[stage] = true;
+        frame->sampler_table_allocator.m_is_stage_dirty[stage] = true;
+    }
+}
+
+void gpu_interface::set_descriptor_tables(ComPtr<ID3D12GraphicsCommandList> cmd_list, recording_context *context)
+{
+    context->csu_table_allocator.set_tables(device, cmd_list);
+    context->sampler_table_allocator.set_tables(device, cmd_list);
+}
+
+void gpu_interface::create_recording_context(recording_context *context)
+{
+    // Only the CPU staging heaps are created, the shader visible heaps are the ones of the frames.
+    context->csu_table_allocator = frame_resource::descriptor_table_frame_allocator::descriptor_table_frame_allocator(device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+                                                                                                                    staging_descriptors_per_stage, 0);
+    NAME_D3D12_OBJECT(context->csu_table_allocator.m_heap_cpu);
+    context->sampler_table_allocator = frame_resource::descriptor_table_frame_allocator::descriptor_table_frame_allocator(device, D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER,
+                                                                                                                        GPU_SAMPLER_HEAP_COUNT, 0);
+    NAME_D3D12_OBJECT(context->sampler_table_allocator.m_heap_cpu);
+}
+
+void gpu_interface::begin_recording_context(recording_context *context, UINT num_table_sets)
+{
+    D3D12_CPU_DESCRIPTOR_HANDLE null_descriptors[4] = {
+        m_null_sampler, m_null_cbv, m_null_srv, m_null_uav};
+
+    frame_resource *frame = get_frame_resource();
+    context->csu_table_allocator.reset_staging_heap(device, null_descriptors);
+    context->sampler_table_allocator.reset_staging_heap(device, null_descriptors);
+    frame->csu_table_allocator.reserve_slice(&context->csu_table_allocator, num_table_sets);
+    frame->sampler_table_allocator.reserve_slice(&context->sampler_table_allocator, num_table_sets);
+}
+
 void gpu_interface::flush_graphics_queue()
 {
-    // Mark commands up to this point.
-    previous_frame_index = get_frame_resource()->fence_value;
-    UINT64 fence_to_signal = previous_frame_index + 1;
-    graphics_cmd_queue->Signal(fence.Get(), fence_to_signal);
+    // Mark commands up to this point, without moving to the next frame.
+    UINT64 fence_to_signal = m_frame_pacer.flush_value();
+    check_hr(graphics_cmd_queue->Signal(fence.Get(), fence_to_signal));
     cpu_wait_for_fence(fence_to_signal);
-
-    // Don't move to the next frame. No call to Present() is made.
-    // Instead just increase the fence value of the current frame accordingly.
-    frames[swapchain->GetCurrentBackBufferIndex()].fence_value = fence_to_signal + 1;
 }
 
-gpu_interface::gbuffer gpu_interface::create_gbuffer(DXGI_FORMAT format, D3D12_RESOURCE_STATES initial_state)
+void gpu_interface::set_frames_in_flight(UINT frames_in_flight)
 {
-    gbuffer buffer = {};
-    buffer.format = format;
+    flush_graphics_queue();
+    m_frame_pacer.set_frames_in_flight(frames_in_flight);
+    for (UINT i = 0; i < m_frame_pacer.frames_in_flight(); i++)
+    {
+        if (frames[i].m_resources_buffer.m_upload_resource == nullptr)
+        {
+            frames[i].m_resources_buffer.create(device, frame_upload_buffer_size);
+            NAME_D3D12_OBJECT_INDEXED(frames[i].m_resources_buffer.m_upload_resource, i);
+        }
+    }
 
-    // Create gbuffer default texture resource.
+    // Every frame is complete, the timers that were not collected are dropped.
+    for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        m_num_timers[i].store(0, std::memory_order_relaxed);
+    }
+    frame_index = m_frame_pacer.frame_index();
+    minimum_fence = m_frame_pacer.frame_wait_value();
+    m_is_frame_ready = false;
+}
+
+D3D12_RESOURCE_DESC gpu_interface::gbuffer_desc(DXGI_FORMAT format)
+{
     D3D12_RESOURCE_DESC gbuffer0_tex_desc = {};
     gbuffer0_tex_desc.Width = g_hwnd_width;
     gbuffer0_tex_desc.Height = g_hwnd_height;
@@ -809,6 +1591,17 @@ gpu_interface::gbuffer gpu_interface::create_gbuffer(DXGI_FORMAT format, D3D12_R
     gbuffer0_tex_desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
     gbuffer0_tex_desc.Format = format;
     gbuffer0_tex_desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+    return gbuffer0_tex_desc;
+}
+
+gpu_interface::gbuffer gpu_interface::create_gbuffer(DXGI_FORMAT format, D3D12_RESOURCE_STATES initial_state,
+                                                     ComPtr<ID3D12Heap> heap, UINT64 heap_offset, const char *name)
+{
+    gbuffer buffer = {};
+    buffer.format = format;
+
+    // Create gbuffer default texture resource.
+    D3D12_RESOURCE_DESC gbuffer0_tex_desc = gbuffer_desc(format);
 
     D3D12_CLEAR_VALUE clear_value = {};
     clear_value.Format = format;
@@ -816,12 +1609,24 @@ gpu_interface::gbuffer gpu_interface::create_gbuffer(DXGI_FORMAT format, D3D12_R
     clear_value.Color[1] = 0.f;
     clear_value.Color[2] = 0.f;
     clear_value.Color[3] = 0.f;
-    check_hr(device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-                                             D3D12_HEAP_FLAG_NONE,
-                                             &gbuffer0_tex_desc,
-                                             initial_state,
-                                             &clear_value,
-                                             IID_PPV_ARGS(&buffer.rt_default_resource)));
+    if (heap)
+    {
+        check_hr(device->CreatePlacedResource(heap.Get(), heap_offset,
+                                              &gbuffer0_tex_desc,
+                                              initial_state,
+                                              &clear_value,
+                                              IID_PPV_ARGS(&buffer.rt_default_resource)));
+    }
+    else
+    {
+        check_hr(device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+                                                 D3D12_HEAP_FLAG_NONE,
+                                                 &gbuffer0_tex_desc,
+                                                 initial_state,
+                                                 &clear_value,
+                                                 IID_PPV_ARGS(&buffer.rt_default_resource)));
+    }
+    track_gpu_memory(device.Get(), buffer.rt_default_resource.Get(), gpu_memory_render_targets, name, heap.Get());
 
     // Create gbuffer RTV.
     buffer.rtv_handle.ptr = rtv_allocator.allocate();
@@ -850,19 +1655,10 @@ gpu_interface::gbuffer gpu_interface::create_gbuffer(DXGI_FORMAT format, D3D12_R
     return buffer;
 }
 
-gpu_interface::render_target gpu_interface::create_render_target(int index, DXGI_FORMAT format, D3D12_RESOURCE_STATES initial_state)
+D3D12_RESOURCE_DESC gpu_interface::render_target_desc(DXGI_FORMAT format)
 {
-    render_target rt = {};
-
-    // Assign formats.
-    frame_resource *frame = &frames[index];
-    check_hr(swapchain->GetBuffer(index, IID_PPV_ARGS(&frame->back_buffer)));
-    rt.ldr_format = frame->back_buffer->GetDesc().Format;
-    rt.hdr_format = format;
-
-    // Create the resource.
     D3D12_RESOURCE_DESC rt_resource_desc = {};
-    rt_resource_desc.Format = rt.hdr_format;
+    rt_resource_desc.Format = format;
     rt_resource_desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
     rt_resource_desc.Alignment = 0;
     rt_resource_desc.DepthOrArraySize = 1;
@@ -873,6 +1669,22 @@ gpu_interface::render_target gpu_interface::create_render_target(int index, DXGI
     rt_resource_desc.SampleDesc.Quality = 0;
     rt_resource_desc.MipLevels = 1;
     rt_resource_desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+    return rt_resource_desc;
+}
+
+gpu_interface::render_target gpu_interface::create_render_target(int index, DXGI_FORMAT format, D3D12_RESOURCE_STATES initial_state,
+                                                                 ComPtr<ID3D12Heap> heap, UINT64 heap_offset)
+{
+    render_target rt = {};
+
+    // Assign formats.
+    check_hr(swapchain->GetBuffer(index, IID_PPV_ARGS(&back_buffers[index])));
+    track_gpu_memory(device.Get(), back_buffers[index].Get(), gpu_memory_render_targets, "Back buffer");
+    rt.ldr_format = back_buffers[index]->GetDesc().Format;
+    rt.hdr_format = format;
+
+    // Create the resource.
+    D3D12_RESOURCE_DESC rt_resource_desc = render_target_desc(rt.hdr_format);
     D3D12_HEAP_PROPERTIES rt_heap_desc = {};
     rt_heap_desc.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
     rt_heap_desc.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
@@ -883,10 +1695,20 @@ gpu_interface::render_target gpu_interface::create_render_target(int index, DXGI
     clear_value.Color[2] = 0.f;
     clear_value.Color[3] = 1.f;
     clear_value.Format = rt.hdr_format;
-    check_hr(device->CreateCommittedResource(&rt_heap_desc, D3D12_HEAP_FLAG_NONE,
-                                             &rt_resource_desc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
-                                             &clear_value, IID_PPV_ARGS(rt.rt_default_resource.GetAddressOf())));
+    if (heap)
+    {
+        check_hr(device->CreatePlacedResource(heap.Get(), heap_offset,
+                                              &rt_resource_desc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+                                              &clear_value, IID_PPV_ARGS(rt.rt_default_resource.GetAddressOf())));
+    }
+    else
+    {
+        check_hr(device->CreateCommittedResource(&rt_heap_desc, D3D12_HEAP_FLAG_NONE,
+                                                 &rt_resource_desc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+                                                 &clear_value, IID_PPV_ARGS(rt.rt_default_resource.GetAddressOf())));
+    }
     NAME_D3D12_OBJECT_INDEXED(rt.rt_default_resource, index);
+    track_gpu_memory(device.Get(), rt.rt_default_resource.Get(), gpu_memory_render_targets, "HDR render target", heap.Get());
 
     // Create the RTVs.
     rt.rtv_hdr.ptr = rtv_allocator.allocate();
@@ -898,7 +1720,7 @@ gpu_interface::render_target gpu_interface::create_render_target(int index, DXGI
     device->CreateRenderTargetView(rt.rt_default_resource.Get(), &rtv_desc, rt.rtv_hdr);
 
     rt.rtv_backbuffer.ptr = rtv_allocator.allocate();
-    device->CreateRenderTargetView(frame->back_buffer.Get(), nullptr, rt.rtv_backbuffer);
+    device->CreateRenderTargetView(back_buffers[index].Get(), nullptr, rt.rtv_backbuffer);
 
     // Create the SRV.
     rt.srv_handle.ptr = csu_allocator.allocate();
@@ -923,104 +1745,337 @@ void gpu_interface::cpu_wait_for_fence(UINT64 fence_value)
         return; // We're already exactly at that fence value, or past that fence value
 
     fence->SetEventOnCompletion(fence_value, cpu_wait_event);
+    stall_scope stall(stall_gpu_flush);
     WaitForSingleObject(cpu_wait_event, INFINITE);
 }
 
-void gpu_interface::next_frame()
+double gpu_interface::next_frame()
 {
-    check_hr(swapchain->Present(0, 0));
+    present_frame();
+    return wait_for_frame();
+}
 
-    UINT64 current_frame_fence_value = get_frame_resource()->fence_value;
-    UINT64 next_frame_fence_value = current_frame_fence_value + 1;
+void gpu_interface::present_frame()
+{
+    {
+        stall_scope stall(stall_present);
+        check_hr(swapchain->Present(0, 0));
+    }
+    m_present_timestamp = g_cpu_timer.get_timestamp();
+    g_stall_tracker.end_frame(clock_ticks());
+    if (m_trace != nullptr)
+    {
+        m_trace->add_present(clock_ticks());
+    }
+    if (m_input_timestamp > 0.0)
+    {
+        m_input_to_present_ms = (m_present_timestamp - m_input_timestamp) / g_cpu_timer.cpu_frequency * cpu_timer::milliseconds;
+    }
 
+    UINT64 current_frame_fence_value = m_frame_pacer.end_frame();
     check_hr(graphics_cmd_queue->Signal(fence.Get(), current_frame_fence_value));
     PIXSetMarker(graphics_cmd_queue.Get(), 0, "graphics_cmd_queue signal(%d)", current_frame_fence_value);
 
-    // Update the frame_index. GetCurrentBackBufferIndex() gets incremented after swapchain->Present() calls.
-    previous_frame_index = frame_index;
-    frame_index = swapchain->GetCurrentBackBufferIndex();
+    // Move to the next frame resource. GetCurrentBackBufferIndex() gets incremented after swapchain->Present() calls.
+    frame_index = m_frame_pacer.frame_index();
+    back_buffer_index = swapchain->GetCurrentBackBufferIndex();
 
-    // The GPU must have reached at least up to the fence value of the frame we're about to render.
-    minimum_fence = frames[frame_index].fence_value;
-    completed_fence = fence->GetCompletedValue();
+    // The GPU must have reached at least up to the fence value of the last frame that used this frame resource.
+    minimum_fence = m_frame_pacer.frame_wait_value();
+    m_is_frame_ready = false;
+
+    {
+        // CPU and GPU frame-to-frame event.
+        PIXEndEvent(graphics_cmd_queue.Get());
+        PIXBeginEvent(graphics_cmd_queue.Get(), 0, "frame: %llu", m_frame_pacer.frame_number());
+    }
+}
+
+double gpu_interface::wait_for_frame()
+{
+    if (m_is_frame_ready)
+    {
+        return 0.0;
+    }
 
+    double wait_ms = 0.0;
+    completed_fence = fence->GetCompletedValue();
     if (completed_fence < minimum_fence)
     {
         PIXBeginEvent(0, "CPU Waiting for GPU to reach fence value: %d", minimum_fence);
         // Wait for the next frame resource to be ready.
+        double wait_start = g_cpu_timer.get_timestamp();
         fence->SetEventOnCompletion(minimum_fence, fence_event);
+        stall_scope stall(stall_frame_fence);
         WaitForSingleObject(fence_event, INFINITE);
+        wait_ms = (g_cpu_timer.get_timestamp() - wait_start) / g_cpu_timer.cpu_frequency * cpu_timer::milliseconds;
         PIXEndEvent();
     }
+    m_cpu_wait_ms = wait_ms;
 
-    frames[frame_index].fence_value = next_frame_fence_value;
-
-    {
-        // CPU and GPU frame-to-frame event.
-        PIXEndEvent(graphics_cmd_queue.Get());
-        PIXBeginEvent(graphics_cmd_queue.Get(), 0, "fence value: %d", next_frame_fence_value);
-    }
+    collect_timers();
+    m_is_frame_ready = true;
+    return wait_ms;
 }
 
-std::string gpu_interface::get_full_event_name(std::string event_name)
+// Timers started by the calling thread and not stopped yet, nested.
+struct open_timer
 {
-    wchar_t *p = NULL;
-    check_hr(GetThreadDescription(GetCurrentThread(), &p));
-    std::wstring wthread(p);
-    LocalFree(p);
-    std::string full_event_name = event_name + " (" + std::string(wthread.begin(), wthread.end()) + ")";
-    return full_event_name;
-}
+    const gpu_interface *gpu;
+    profile_event_id event;
+    UINT frame;
+    UINT slot;
+    uint64_t start_ticks;
+};
+static const UINT max_open_timers = 64;
+static thread_local open_timer t_open_timers[max_open_timers];
+static thread_local UINT t_num_open_timers = 0;
 
 void gpu_interface::timer_start(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                                std::string event_name)
+                                profile_event_id event)
 {
-    mtx.lock();
     // GPU.
-    timers[event_name].cmd_list[frame_index] = cmd_list.Get();
-    m_gpu_timer.start(event_name, cmd_list);
-
-    // CPU.
-    std::string full_event_name = get_full_event_name(event_name);
-    g_cpu_timer.start(full_event_name);
-
-    std::vector<std::string> &cpu_events = timers.at(event_name).cpu_event_names;
-    bool cpu_event_found = std::find(cpu_events.begin(), cpu_events.end(), full_event_name) != cpu_events.end();
-    if (!cpu_event_found)
+    UINT slot = m_num_timers[frame_index].fetch_add(1, std::memory_order_relaxed);
+    if (slot < max_timers_per_frame)
     {
-        cpu_events.push_back(full_event_name);
+        m_gpu_timer.start(frame_index, slot, cmd_list);
     }
 
+    // CPU.
+    ASSERT(t_num_open_timers < max_open_timers, "Too many nested timers on this thread.");
+    t_open_timers[t_num_open_timers++] = {this, event, frame_index, slot, clock_ticks()};
+    g_cpu_profiler.begin(event);
+    g_render_counters.begin_pass(event);
+
     // PIX.
-    PIXBeginEvent(cmd_list.Get(), 0, full_event_name.c_str());
-    mtx.unlock();
+    PIXBeginEvent(cmd_list.Get(), 0, "%s (%s)", profile_event_name(event), g_cpu_profiler.thread_name());
 }
 
 void gpu_interface::timer_stop(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                               std::string event_name)
+                               profile_event_id event)
 {
-    mtx.lock();
-    // GPU.
-    m_gpu_timer.stop(event_name, cmd_list);
-    m_gpu_timer.resolve(event_name, cmd_list);
+    // Timers of a thread are nested, the last one started with this event is the one to stop.
+    int index = (int)t_num_open_timers - 1;
+    while (index >= 0 && (t_open_timers[index].gpu != this || t_open_timers[index].event != event))
+    {
+        index--;
+    }
+    ASSERT(index >= 0, "timer_stop() was called without timer_start() on this thread.");
+    open_timer timer = t_open_timers[index];
+    for (UINT i = index; i + 1 < t_num_open_timers; i++)
+    {
+        t_open_timers[i] = t_open_timers[i + 1];
+    }
+    t_num_open_timers--;
+    g_cpu_profiler.end(event);
+    g_render_counters.end_pass(event);
 
-    // CPU.
-    std::string full_event_name = get_full_event_name(event_name);
-    g_cpu_timer.stop(full_event_name);
+    if (timer.slot < max_timers_per_frame)
+    {
+        // GPU.
+        m_gpu_timer.stop(timer.frame, timer.slot, cmd_list);
+        command_list_states *states = get_command_list_states(cmd_list.Get());
+        states->timer_frame = timer.frame;
+        states->stopped_timers.push_back(timer.slot);
+
+        // CPU.
+        timer_slot &slot = m_timer_slots[timer.frame][timer.slot];
+        slot.event = event;
+        slot.thread = g_cpu_profiler.thread_index();
+        slot.queue = cmd_list->GetType() == D3D12_COMMAND_LIST_TYPE_COMPUTE ? timer_queue_compute : timer_queue_graphics;
+        slot.list = cmd_list.Get();
+        slot.cpu_ms = ticks_to_ms(clock_ticks() - timer.start_ticks);
+        slot.is_stopped = true;
+    }
 
     // PIX.
     PIXEndEvent(cmd_list.Get());
-    mtx.unlock();
 }
 
-double gpu_interface::result_cpu(std::string event_name)
+void gpu_interface::close_command_list(ID3D12GraphicsCommandList *cmd_list)
+{
+    command_list_states *states = get_command_list_states(cmd_list);
+    flush_barriers(cmd_list);
+    if (!states->stopped_timers.empty())
+    {
+        resolve_timers(cmd_list, states);
+    }
+    check_hr(cmd_list->Close());
+}
+
+void gpu_interface::resolve_timers(ID3D12GraphicsCommandList *cmd_list, command_list_states *states)
+{
+    // A thread takes consecutive slots for the timers of its list, so there is usually a single run to resolve.
+    std::vector<UINT> &slots = states->stopped_timers;
+    std::sort(slots.begin(), slots.end());
+    UINT num_resolves = 0;
+    for (size_t begin = 0; begin < slots.size();)
+    {
+        size_t end = begin + 1;
+        while (end < slots.size() && slots[end] == slots[end - 1] + 1)
+        {
+            end++;
+        }
+        m_gpu_timer.resolve(states->timer_frame, slots[begin], (UINT)(end - begin), cmd_list);
+        num_resolves++;
+        begin = end;
+    }
+    m_num_timer_resolves[states->timer_frame].fetch_add(num_resolves, std::memory_order_relaxed);
+    slots.clear();
+}
+
+void gpu_interface::collect_timers()
+{
+    // The GPU is done with the frame that last used this frame index, nothing is recorded at this point.
+    UINT num_timers = (std::min)(m_num_timers[frame_index].load(std::memory_order_relaxed), max_timers_per_frame);
+    m_timer_results.clear();
+    uint64_t readback_start = clock_ticks();
+    m_gpu_timer.read_frame(frame_index, num_timers);
+    m_timer_readback.num_timers = 0;
+    m_timer_readback.num_resolves = m_num_timer_resolves[frame_index].exchange(0, std::memory_order_relaxed);
+    if (ticks_to_ms(clock_ticks() - m_last_calibration_ticks) >= calibration_interval_ms)
+    {
+        calibrate_clocks();
+    }
+
+    // Other threads can already submit the lists of the next frame.
+    std::lock_guard<std::mutex> lock(m_state_mtx);
+    for (UINT i = 0; i < num_timers; i++)
+    {
+        timer_slot &slot = m_timer_slots[frame_index][i];
+        if (!slot.is_stopped)
+        {
+            continue;
+        }
+
+        const profile_frame &profile = g_cpu_profiler.last_frame();
+        std::string thread_name = slot.thread < profile.thread_names.size() ? profile.thread_names[slot.thread]
+                                                                            : "thread #" + std::to_string(slot.thread);
+        timer_result result = {profile_event_name(slot.event), thread_name, slot.cpu_ms, m_gpu_timer.result(i), 0.0, false};
+        m_timer_readback.num_timers++;
+
+        // A list is submitted once per frame, the latency is signed because of the jitter of the calibration.
+        for (const list_submission &submission : m_submissions[frame_index])
+        {
+            if (submission.list == slot.list)
+            {
+                UINT64 begin = 0;
+                UINT64 end = 0;
+                m_gpu_timer.timestamps(i, &begin, &end);
+                int64_t latency_ticks = (int64_t)(gpu_to_cpu_ticks(slot.queue, begin) - submission.ticks);
+                result.queue_latency_ms = (double)latency_ticks * 1000.0 / (double)clock_frequency();
+                result.is_submitted = true;
+                break;
+            }
+        }
+        m_timer_results.push_back(result);
+        if (m_trace != nullptr)
+        {
+            add_trace_event(slot, i);
+        }
+        slot.is_stopped = false;
+    }
+    m_num_timers[frame_index].store(0, std::memory_order_relaxed);
+    m_submissions[frame_index].clear();
+    m_timer_readback.readback_ms = ticks_to_ms(clock_ticks() - readback_start);
+    if (m_trace != nullptr)
+    {
+        m_trace->end_gpu_frame();
+        if (!m_trace->is_capturing())
+        {
+            m_trace = nullptr;
+        }
+    }
+
+    std::sort(m_timer_results.begin(), m_timer_results.end(), [](const timer_result &a, const timer_result &b) {
+        if (a.event_name != b.event_name)
+        {
+            return a.event_name < b.event_name;
+        }
+        return a.thread_name < b.thread_name;
+    });
+
+    // The results of an event are next to each other, one sample per event.
+    for (size_t begin = 0; begin < m_timer_results.size();)
+    {
+        const std::string &event_name = m_timer_results[begin].event_name;
+        double cpu_ms = 0.0;
+        double gpu_ms = 0.0;
+        size_t end = begin;
+        for (; end < m_timer_results.size() && m_timer_results[end].event_name == event_name; end++)
+        {
+            cpu_ms += m_timer_results[end].cpu_ms;
+            gpu_ms += m_timer_results[end].gpu_ms;
+        }
+
+        auto it = std::lower_bound(m_timer_stats.begin(), m_timer_stats.end(), event_name, [](const timer_stats &stats, const std::string &name) {
+            return stats.event_name < name;
+        });
+        if (it == m_timer_stats.end() || it->event_name != event_name)
+        {
+            it = m_timer_stats.insert(it, {event_name, rolling_stats(m_timer_stats_window), rolling_stats(m_timer_stats_window)});
+        }
+        it->cpu.add(cpu_ms);
+        it->gpu.add(gpu_ms);
+        begin = end;
+    }
+}
+
+void gpu_interface::begin_trace(trace_capture *trace)
 {
-    return g_cpu_timer.result_ms(event_name);
+    m_trace = trace;
+    m_trace->set_gpu_track_name(timer_queue_graphics, "Graphics queue");
+    m_trace->set_gpu_track_name(timer_queue_compute, "Compute queue");
 }
 
-double gpu_interface::result_gpu(std::string event_name)
+void gpu_interface::calibrate_clocks()
 {
-    return m_gpu_timer.result(event_name, timers[event_name].cmd_list[frame_index]);
+    // GPU and CPU (QueryPerformanceCounter, as clock_ticks()) timestamps taken at the same time.
+    ComPtr<ID3D12CommandQueue> queues[timer_queue_count] = {graphics_cmd_queue, compute_cmd_queue};
+    for (UINT i = 0; i < timer_queue_count; i++)
+    {
+        UINT64 gpu_timestamp = 0;
+        UINT64 cpu_timestamp = 0;
+        check_hr(queues[i]->GetClockCalibration(&gpu_timestamp, &cpu_timestamp));
+        m_clock_correlations[i].add_sample(gpu_timestamp, cpu_timestamp);
+    }
+    m_last_calibration_ticks = clock_ticks();
+}
+
+uint64_t gpu_interface::gpu_to_cpu_ticks(timer_queue queue, UINT64 gpu_timestamp) const
+{
+    return m_clock_correlations[queue].gpu_to_cpu(gpu_timestamp);
+}
+
+void gpu_interface::add_trace_event(const timer_slot &slot, UINT slot_index)
+{
+    UINT64 begin = 0;
+    UINT64 end = 0;
+    m_gpu_timer.timestamps(slot_index, &begin, &end);
+
+    m_trace->add_gpu_event(slot.queue, slot.event, slot.thread, m_trace->clock_to_us(gpu_to_cpu_ticks(slot.queue, begin)),
+                           m_trace->clock_to_us(gpu_to_cpu_ticks(slot.queue, end)));
+}
+
+void gpu_interface::set_timer_stats_window(uint32_t frames)
+{
+    m_timer_stats_window = (std::max)(frames, 1u);
+    for (timer_stats &stats : m_timer_stats)
+    {
+        stats.cpu.set_window(m_timer_stats_window);
+        stats.gpu.set_window(m_timer_stats_window);
+    }
+}
+
+std::vector<gpu_interface::timer_stats_summary> gpu_interface::timer_stats_summaries() const
+{
+    std::vector<timer_stats_summary> summaries;
+    summaries.reserve(m_timer_stats.size());
+    for (const timer_stats &stats : m_timer_stats)
+    {
+        summaries.push_back({stats.event_name, stats.cpu.summary(), stats.gpu.summary()});
+    }
+    return summaries;
 }
 
 ComPtr<ID3D12RootSignature> gpu_interface::create_compute_staging_rootsig(std::vector<D3D12_ROOT_PARAMETER1> additional_parameters, UINT space)
@@ -1028,38 +2083,10 @@ ComPtr<ID3D12RootSignature> gpu_interface::create_compute_staging_rootsig(std::v
     std::vector<D3D12_ROOT_PARAMETER1> params;
 
     // Staging params.
-    // Static ranges that never change, the size of each range is assumed to be enough for any shader.
+    // The ranges cover the registers used by the compiled shaders, or the whole staging table before they are known.
     D3D12_DESCRIPTOR_RANGE1 sampler_range = {};
-    sampler_range.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER;
-    sampler_range.BaseShaderRegister = 0;
-    sampler_range.RegisterSpace = space;
-    sampler_range.NumDescriptors = GPU_SAMPLER_HEAP_COUNT;
-    sampler_range.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-    sampler_range.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE;
-
-    const UINT descriptor_range_count = 3;
-    D3D12_DESCRIPTOR_RANGE1 descriptor_ranges[descriptor_range_count];
-
-    descriptor_ranges[0].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_CBV;
-    descriptor_ranges[0].BaseShaderRegister = 0;
-    descriptor_ranges[0].RegisterSpace = space;
-    descriptor_ranges[0].NumDescriptors = GPU_RESOURCE_HEAP_CBV_COUNT;
-    descriptor_ranges[0].OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-    descriptor_ranges[0].Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE;
-
-    descriptor_ranges[1].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-    descriptor_ranges[1].BaseShaderRegister = 0;
-    descriptor_ranges[1].RegisterSpace = space;
-    descriptor_ranges[1].NumDescriptors = GPU_RESOURCE_HEAP_SRV_COUNT;
-    descriptor_ranges[1].OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-    descriptor_ranges[1].Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE;
-
-    descriptor_ranges[2].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
-    descriptor_ranges[2].BaseShaderRegister = 0;
-    descriptor_ranges[2].RegisterSpace = space;
-    descriptor_ranges[2].NumDescriptors = GPU_RESOURCE_HEAP_UAV_COUNT;
-    descriptor_ranges[2].OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-    descriptor_ranges[2].Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE;
+    D3D12_DESCRIPTOR_RANGE1 descriptor_ranges[3] = {};
+    UINT descriptor_range_count = fill_staging_ranges(CS, space, descriptor_ranges, &sampler_range);
 
     D3D12_ROOT_PARAMETER1 staging_param_csu = {};
     staging_param_csu.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
@@ -1081,93 +2108,37 @@ ComPtr<ID3D12RootSignature> gpu_interface::create_compute_staging_rootsig(std::v
 
 ComPtr<ID3D12RootSignature> gpu_interface::create_graphics_staging_rootsig(std::vector<D3D12_ROOT_PARAMETER1> additional_parameters, UINT space)
 {
-    D3D12_DESCRIPTOR_RANGE1 sampler_range = {};
-    sampler_range.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER;
-    sampler_range.BaseShaderRegister = 0;
-    sampler_range.RegisterSpace = space;
-    sampler_range.NumDescriptors = GPU_SAMPLER_HEAP_COUNT;
-    sampler_range.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-    sampler_range.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE;
-
-    const UINT descriptor_range_count = 3;
-    D3D12_DESCRIPTOR_RANGE1 descriptor_ranges[descriptor_range_count];
-
-    // Static ranges that never change, the size of each range is assumed to be enough for any shader.
-    descriptor_ranges[0].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_CBV;
-    descriptor_ranges[0].BaseShaderRegister = 0;
-    descriptor_ranges[0].RegisterSpace = space;
-    descriptor_ranges[0].NumDescriptors = GPU_RESOURCE_HEAP_CBV_COUNT;
-    descriptor_ranges[0].OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-    descriptor_ranges[0].Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE;
-
-    descriptor_ranges[1].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-    descriptor_ranges[1].BaseShaderRegister = 0;
-    descriptor_ranges[1].RegisterSpace = space;
-    descriptor_ranges[1].NumDescriptors = GPU_RESOURCE_HEAP_SRV_COUNT;
-    descriptor_ranges[1].OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-    descriptor_ranges[1].Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE;
-
-    descriptor_ranges[2].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
-    descriptor_ranges[2].BaseShaderRegister = 0;
-    descriptor_ranges[2].RegisterSpace = space;
-    descriptor_ranges[2].NumDescriptors = GPU_RESOURCE_HEAP_UAV_COUNT;
-    descriptor_ranges[2].OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-    descriptor_ranges[2].Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE;
-
-    UINT param_count = 2 * (SHADERSTAGE_MAX - 1); // 2: resource,sampler;   5: vs,hs,ds,gs,ps;
+    const UINT graphics_stage_count = SHADERSTAGE_MAX - 1; // vs,hs,ds,gs,ps;
+    const D3D12_SHADER_VISIBILITY visibilities[graphics_stage_count] = {D3D12_SHADER_VISIBILITY_VERTEX,
+                                                                        D3D12_SHADER_VISIBILITY_HULL,
+                                                                        D3D12_SHADER_VISIBILITY_DOMAIN,
+                                                                        D3D12_SHADER_VISIBILITY_GEOMETRY,
+                                                                        D3D12_SHADER_VISIBILITY_PIXEL};
+
+    // Each stage gets its own ranges, sized to the registers its shaders use.
+    D3D12_DESCRIPTOR_RANGE1 sampler_ranges[graphics_stage_count] = {};
+    D3D12_DESCRIPTOR_RANGE1 descriptor_ranges[graphics_stage_count][3] = {};
+
+    UINT param_count = 2 * graphics_stage_count; // 2: resource,sampler;   5: vs,hs,ds,gs,ps;
 
     std::vector<D3D12_ROOT_PARAMETER1> params;
     params.resize(param_count);
 
-    params[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    params[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
-    params[0].DescriptorTable.NumDescriptorRanges = descriptor_range_count;
-    params[0].DescriptorTable.pDescriptorRanges = descriptor_ranges;
-
-    params[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    params[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
-    params[1].DescriptorTable.NumDescriptorRanges = 1;
-    params[1].DescriptorTable.pDescriptorRanges = &sampler_range;
-
-    params[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    params[2].ShaderVisibility = D3D12_SHADER_VISIBILITY_HULL;
-    params[2].DescriptorTable.NumDescriptorRanges = descriptor_range_count;
-    params[2].DescriptorTable.pDescriptorRanges = descriptor_ranges;
-
-    params[3].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    params[3].ShaderVisibility = D3D12_SHADER_VISIBILITY_HULL;
-    params[3].DescriptorTable.NumDescriptorRanges = 1;
-    params[3].DescriptorTable.pDescriptorRanges = &sampler_range;
-
-    params[4].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    params[4].ShaderVisibility = D3D12_SHADER_VISIBILITY_DOMAIN;
-    params[4].DescriptorTable.NumDescriptorRanges = descriptor_range_count;
-    params[4].DescriptorTable.pDescriptorRanges = descriptor_ranges;
-
-    params[5].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    params[5].ShaderVisibility = D3D12_SHADER_VISIBILITY_DOMAIN;
-    params[5].DescriptorTable.NumDescriptorRanges = 1;
-    params[5].DescriptorTable.pDescriptorRanges = &sampler_range;
-
-    params[6].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    params[6].ShaderVisibility = D3D12_SHADER_VISIBILITY_GEOMETRY;
-    params[6].DescriptorTable.NumDescriptorRanges = descriptor_range_count;
-    params[6].DescriptorTable.pDescriptorRanges = descriptor_ranges;
-
-    params[7].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    params[7].ShaderVisibility = D3D12_SHADER_VISIBILITY_GEOMETRY;
-    params[7].DescriptorTable.NumDescriptorRanges = 1;
-    params[7].DescriptorTable.pDescriptorRanges = &sampler_range;
-
-    params[8].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    params[8].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
-    params[8].DescriptorTable.NumDescriptorRanges = descriptor_range_count;
-    params[8].DescriptorTable.pDescriptorRanges = descriptor_ranges;
-
-    params[9].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    params[9].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
-    params[9].DescriptorTable.NumDescriptorRanges = 1;
-    params[9].DescriptorTable.pDescriptorRanges = &sampler_range;
+    for (UINT stage = VS; stage < graphics_stage_count; stage++)
+    {
+        UINT descriptor_range_count = fill_staging_ranges((shader_stages)stage, space,
+                                                          descriptor_ranges[stage], &sampler_ranges[stage]);
+
+        params[stage * 2 + 0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+        params[stage * 2 + 0].ShaderVisibility = visibilities[stage];
+        params[stage * 2 + 0].DescriptorTable.NumDescriptorRanges = descriptor_range_count;
+        params[stage * 2 + 0].DescriptorTable.pDescriptorRanges = descriptor_ranges[stage];
+
+        params[stage * 2 + 1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+        params[stage * 2 + 1].ShaderVisibility = visibilities[stage];
+        params[stage * 2 + 1].DescriptorTable.NumDescriptorRanges = 1;
+        params[stage * 2 + 1].DescriptorTable.pDescriptorRanges = &sampler_ranges[stage];
+    }
 
     params.insert(params.end(), additional_parameters.begin(), additional_parameters.end());
 
@@ -1216,11 +2187,8 @@ void gpu_interface::create_descriptor_allocators()
     check_hr(device->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&sampler_allocator.m_staging_heap)));
 }
 
-D3D12_RESOURCE_ALLOCATION_INFO gpu_interface::upload_dds(const std::wstring &file,
-                                                         ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                                                         ID3D12Resource **texture_resource,
-                                                         bool generate_mips,
-                                                         ComPtr<ID3D12Heap> texture_heap, size_t heap_offset)
+// Converts the file to .dds the first time it is loaded and returns the name of the .dds file.
+static std::wstring convert_to_dds(const std::wstring &file, bool generate_mips)
 {
     std::wstring file_name_dds = remove_extension(file) + L".dds";
 
@@ -1291,16 +2259,11 @@ D3D12_RESOURCE_ALLOCATION_INFO gpu_interface::upload_dds(const std::wstring &fil
                                    file_name_dds.c_str()));
         }
     }
+    return file_name_dds;
+}
 
-    // Load dds subresource data.
-    ScratchImage dds_img;
-    TexMetadata dds_md;
-    check_hr(LoadFromDDSFile(file_name_dds.c_str(), DDS_FLAGS_NONE, &dds_md, dds_img));
-
-    const Image *dds_images = dds_img.GetImages();
-    std::vector<D3D12_SUBRESOURCE_DATA> subresources;
-    subresources.reserve(dds_md.mipLevels);
-
+static D3D12_RESOURCE_DESC dds_texture_desc(const TexMetadata &dds_md)
+{
     D3D12_RESOURCE_DESC tex_desc = {};
     tex_desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
     tex_desc.DepthOrArraySize = (UINT16)dds_md.arraySize;
@@ -1312,6 +2275,38 @@ D3D12_RESOURCE_ALLOCATION_INFO gpu_interface::upload_dds(const std::wstring &fil
     tex_desc.SampleDesc.Count = 1;
     tex_desc.SampleDesc.Quality = 0;
     tex_desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+    return tex_desc;
+}
+
+D3D12_RESOURCE_ALLOCATION_INFO gpu_interface::dds_allocation_info(const std::wstring &file, bool generate_mips)
+{
+    std::wstring file_name_dds = convert_to_dds(file, generate_mips);
+
+    // Only the header is read.
+    TexMetadata dds_md;
+    check_hr(GetMetadataFromDDSFile(file_name_dds.c_str(), DDS_FLAGS_NONE, dds_md));
+    D3D12_RESOURCE_DESC tex_desc = dds_texture_desc(dds_md);
+    return device->GetResourceAllocationInfo(0, 1, &tex_desc);
+}
+
+D3D12_RESOURCE_ALLOCATION_INFO gpu_interface::upload_dds(const std::wstring &file,
+                                                         ComPtr<ID3D12GraphicsCommandList> cmd_list,
+                                                         ID3D12Resource **texture_resource,
+                                                         bool generate_mips,
+                                                         ComPtr<ID3D12Heap> texture_heap, size_t heap_offset)
+{
+    std::wstring file_name_dds = convert_to_dds(file, generate_mips);
+
+    // Load dds subresource data.
+    ScratchImage dds_img;
+    TexMetadata dds_md;
+    check_hr(LoadFromDDSFile(file_name_dds.c_str(), DDS_FLAGS_NONE, &dds_md, dds_img));
+
+    const Image *dds_images = dds_img.GetImages();
+    std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+    subresources.reserve(dds_md.mipLevels);
+
+    D3D12_RESOURCE_DESC tex_desc = dds_texture_desc(dds_md);
     D3D12_RESOURCE_ALLOCATION_INFO alloc_info = device->GetResourceAllocationInfo(0, 1, &tex_desc);
     tex_desc.Alignment = alloc_info.Alignment;
 
@@ -1341,6 +2336,10 @@ D3D12_RESOURCE_ALLOCATION_INFO gpu_interface::upload_dds(const std::wstring &fil
                                                  D3D12_RESOURCE_STATE_COPY_DEST,
                                                  nullptr, IID_PPV_ARGS(texture_resource)));
     }
+    std::wstring file_name = file.substr(file.find_last_of(L"\\/") + 1);
+    std::string name(file_name.size(), '?');
+    std::transform(file_name.begin(), file_name.end(), name.begin(), [](wchar_t c) { return c < 128 ? (char)c : '?'; });
+    track_gpu_memory(device.Get(), *texture_resource, gpu_memory_textures, name.c_str(), texture_heap.Get());
 
     // CopyTextureRegion() from upload resource to default resource.
     UpdateSubresources(cmd_list.Get(),
@@ -1397,7 +2396,7 @@ void gpu_interface::reset_staging_descriptors()
     gpu_interface::frame_resource *frame_resource = get_frame_resource();
     frame_resource->csu_table_allocator.reset_staging_heap(device, null_descriptors);
     frame_resource->sampler_table_allocator.reset_staging_heap(device, null_descriptors);
-    frame_resource->m_resources_buffer.m_current = frame_resource->m_resources_buffer.m_begin;
+    frame_resource->m_resources_buffer.reset();
 }
 
 void gpu_interface::set_staging_heaps(ComPtr<ID3D12GraphicsCommandList> cmd_list)
@@ -3,31 +3,29 @@
 #include "common.h"
 #include <vector>
 #include <atomic>
+#include <unordered_map>
 #include "gpu_timer.h"
+#include "rootsig_layout.h"
+#include "resource_state_tracker.h"
+#include "frame_pacer.h"
+#include "cpu_profiler.h"
+#include "render_counters.h"
+#include "rolling_stats.h"
+#include "trace_capture.h"
+#include "clock_correlation.h"
+#include "frame_stalls.h"
+#include "gpu_memory.h"
+#include "upload_allocator.h"
+#include "command_recorder.h"
 #include <mutex>
-
-enum shader_stages
-{
-    VS,
-    HS,
-    DS,
-    GS,
-    PS,
-    CS,
-    SHADERSTAGE_MAX
-};
-
-enum shader_descriptor_type
-{
-    CBV,
-    SRV,
-    UAV,
-    sampler
-};
+#include <shared_mutex>
 
 #pragma warning(push)
 #pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
 
+// Handle of a D3D12 object for the command_recorder interface.
+inline gpu_handle to_handle(ID3D12Object *object) { return (gpu_handle)(uintptr_t)object; }
+
 struct COMMON_API gpu_interface
 {
     gpu_interface() = default;
@@ -35,6 +33,7 @@ struct COMMON_API gpu_interface
 
     static const UINT32 DEFAULT_NODE = 0;
     static const UINT32 NUM_BACK_BUFFERS = 3;
+    static const UINT32 MAX_FRAMES_IN_FLIGHT = frame_pacer::max_frames_in_flight; // Size of the per-frame arrays.
 
     // Formats
     static const DXGI_FORMAT DEPTH_STENCIL_FORMAT = DXGI_FORMAT_D24_UNORM_S8_UINT;
@@ -62,11 +61,20 @@ struct COMMON_API gpu_interface
                         const wchar_t *entry,
                         shader_stages stage,
                         ID3DBlob **blob,
-                        D3D_SHADER_MACRO *defines);
+                        D3D_SHADER_MACRO *defines,
+                        shader_reflection *reflection = nullptr);
     D3D12_GRAPHICS_PIPELINE_STATE_DESC create_default_pso_desc();
     ComPtr<ID3D12RootSignature> create_rootsig(std::vector<D3D12_ROOT_PARAMETER1> *params,
                                                std::vector<CD3DX12_STATIC_SAMPLER_DESC> *samplers,
                                                D3D12_ROOT_SIGNATURE_FLAGS flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+    ComPtr<ID3D12RootSignature> create_rootsig(const rootsig_layout &layout,
+                                               std::vector<CD3DX12_STATIC_SAMPLER_DESC> *samplers = nullptr,
+                                               D3D12_ROOT_SIGNATURE_FLAGS flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+
+    // Shader reflection.
+    // The bindings of every shader compiled since the start of the process.
+    std::vector<shader_reflection> m_shader_reflections;
+    shader_reflection reflect_shader(ID3DBlob *blob, shader_stages stage, const wchar_t *entry);
 
     std::vector<D3D12_RESOURCE_BARRIER> transition(
         D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after,
@@ -75,16 +83,83 @@ struct COMMON_API gpu_interface
         UINT subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
         D3D12_RESOURCE_BARRIER_FLAGS flags = D3D12_RESOURCE_BARRIER_FLAG_NONE);
 
+    // Resource state tracking.
+    // Instead of hand-coding transitions, passes declare the state a resource must be in with require_state().
+    // Pending barriers are batched per command list and recorded by flush_barriers() before the next draw or dispatch.
+    // Command lists must be submitted with execute_command_lists() so that the first use of a registered resource
+    // in a list gets patched against the state the previously submitted lists left it in.
+    struct command_list_states
+    {
+        resource_state_tracker tracker;
+        std::vector<tracked_barrier> pending;
+        std::vector<D3D12_RESOURCE_BARRIER> barriers;
+
+        // Timers stopped on the list, resolved by close_command_list().
+        UINT timer_frame = 0;
+        std::vector<UINT> stopped_timers;
+    };
+    std::mutex m_state_mtx; // Registry and submission order.
+    resource_state_registry m_state_registry;
+
+    // States of each command list, keyed by the list and kept for the lifetime of the interface.
+    // Lookups from the recording threads only take the shared lock, the exclusive lock is taken the first time a list is seen.
+    std::shared_mutex m_command_list_states_mtx;
+    std::unordered_map<ID3D12CommandList *, command_list_states> m_command_list_states;
+    command_list_states *get_command_list_states(ID3D12CommandList *cmd_list);
+    UINT resource_subresource_count(ID3D12Resource *resource);
+    void register_resource(ID3D12Resource *resource, D3D12_RESOURCE_STATES state);
+    void unregister_resource(ID3D12Resource *resource);
+    void require_state(ID3D12GraphicsCommandList *cmd_list,
+                       ID3D12Resource *resource,
+                       D3D12_RESOURCE_STATES state,
+                       UINT subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+    void require_uav(ID3D12GraphicsCommandList *cmd_list, ID3D12Resource *resource);
+    void flush_barriers(ID3D12GraphicsCommandList *cmd_list);
+    void record_barriers(ID3D12GraphicsCommandList *cmd_list, const std::vector<tracked_barrier> &barriers);
+    void execute_command_lists(ComPtr<ID3D12CommandQueue> queue, ID3D12CommandList *const *cmd_lists, UINT count);
+
+    // Flushes the pending barriers, resolves the timers stopped on the list and closes it.
+    void close_command_list(ID3D12GraphicsCommandList *cmd_list);
+
+    // Lists holding the barriers that bring resources to the state a submitted list expects.
+    struct fixup_list
+    {
+        ComPtr<ID3D12CommandAllocator> cmd_alloc;
+        ComPtr<ID3D12GraphicsCommandList> cmd_list;
+        UINT64 fence_value;
+    };
+    static const UINT32 num_fixup_queues = 2; // Direct and compute.
+    std::mutex m_fixup_mtx; // Free fixup lists and fixup fences, never held together with m_state_mtx.
+    std::vector<fixup_list> m_fixup_lists[num_fixup_queues];
+    UINT m_fixup_list_count = 0;
+    ComPtr<ID3D12Fence> m_fixup_fences[num_fixup_queues];
+    UINT64 m_fixup_fence_values[num_fixup_queues] = {}; // Written under m_state_mtx.
+    std::vector<tracked_barrier> m_fixup_barriers;
+    std::vector<D3D12_RESOURCE_BARRIER> m_fixup_d3d12_barriers;
+    std::vector<ID3D12CommandList *> m_submit_lists;
+    std::vector<command_list_states *> m_submit_states; // Scratch of execute_command_lists(), under m_state_mtx.
+    std::mutex m_submit_mtx[num_fixup_queues];           // Held by execute_command_lists() for m_submit_fixups.
+    std::vector<fixup_list> m_submit_fixups[num_fixup_queues];
+
+    // Takes count fixup lists the GPU is done with out of the free lists, the missing ones are created.
+    void acquire_fixup_lists(UINT queue_index, UINT count, std::vector<fixup_list> *out);
+    void release_fixup_lists(UINT queue_index, std::vector<fixup_list> *lists);
+
     void default_resource_from_uploader(ComPtr<ID3D12GraphicsCommandList> cmd_list,
                                         ID3D12Resource **default_resource,
                                         const void *data,
                                         size_t byte_size,
                                         size_t alignment,
-                                        D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE);
+                                        D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE,
+                                        gpu_memory_category category = gpu_memory_buffers,
+                                        const char *name = "Default buffer");
 
     void create_dsv(UINT64 width, UINT height);
     void set_descriptor_tables(ComPtr<ID3D12GraphicsCommandList> cmd_list);
 
+    // The next set_descriptor_tables() sets every table, e.g. on a new command list that starts without them.
+    void invalidate_descriptor_tables();
+
     template <typename T>
     struct constant_buffer
     {
@@ -100,6 +175,10 @@ struct COMMON_API gpu_interface
                                        data_size);
             return;
         }
+        void update(T *data, command_recorder *recorder)
+        {
+            recorder->update_buffer(to_handle(default_resource.Get()), 0, data, data_size);
+        }
         size_t data_size;
         size_t m_alignment;
         ComPtr<ID3D12Resource> default_resource;
@@ -131,6 +210,10 @@ struct COMMON_API gpu_interface
             // Update the *GPU* virtual address to the beginning of the new data.
             m_gpu_va = frame->m_resources_buffer.m_upload_resource->GetGPUVirtualAddress() + data_offset_size;
         }
+        void update(T *data, command_recorder *recorder)
+        {
+            m_gpu_va = recorder->upload(data, m_unaligned_size, m_alignment);
+        }
 
         gpu_interface *m_gpu;
         D3D12_GPU_VIRTUAL_ADDRESS m_gpu_va;
@@ -192,6 +275,17 @@ struct COMMON_API gpu_interface
                                        data_size);
             return;
         }
+
+        void update(T *data, size_t count, size_t index, command_recorder *recorder)
+        {
+            size_t data_size = count * m_datum_size;
+            recorder->update_buffer(to_handle(default_resource.Get()), index * data_size, data, data_size);
+        }
+
+        void update(T *data, command_recorder *recorder)
+        {
+            recorder->update_buffer(to_handle(default_resource.Get()), 0, data, m_num_elements * m_datum_size);
+        }
         size_t m_datum_size;
         size_t m_num_elements;
         size_t m_alignment;
@@ -211,7 +305,10 @@ struct COMMON_API gpu_interface
         D3D12_CPU_DESCRIPTOR_HANDLE rtv_handle;
         D3D12_CPU_DESCRIPTOR_HANDLE srv_handle;
     };
-    gpu_interface::gbuffer create_gbuffer(DXGI_FORMAT format, D3D12_RESOURCE_STATES initial_state = D3D12_RESOURCE_STATE_COMMON);
+    // The resource is placed in heap at heap_offset when a heap is given, committed otherwise.
+    gpu_interface::gbuffer create_gbuffer(DXGI_FORMAT format, D3D12_RESOURCE_STATES initial_state = D3D12_RESOURCE_STATE_COMMON,
+                                          ComPtr<ID3D12Heap> heap = nullptr, UINT64 heap_offset = 0, const char *name = "G-buffer");
+    D3D12_RESOURCE_DESC gbuffer_desc(DXGI_FORMAT format);
 
     struct render_target
     {
@@ -222,7 +319,9 @@ struct COMMON_API gpu_interface
         D3D12_CPU_DESCRIPTOR_HANDLE rtv_backbuffer;
         D3D12_CPU_DESCRIPTOR_HANDLE srv_handle;
     };
-    gpu_interface::render_target create_render_target(int index, DXGI_FORMAT format, D3D12_RESOURCE_STATES initial_state = D3D12_RESOURCE_STATE_COMMON);
+    gpu_interface::render_target create_render_target(int index, DXGI_FORMAT format, D3D12_RESOURCE_STATES initial_state = D3D12_RESOURCE_STATE_COMMON,
+                                                      ComPtr<ID3D12Heap> heap = nullptr, UINT64 heap_offset = 0);
+    D3D12_RESOURCE_DESC render_target_desc(DXGI_FORMAT format);
     void resize(int width, int height, render_target *render_targets, size_t num_render_targets);
 
     HANDLE cpu_wait_event;
@@ -230,23 +329,117 @@ struct COMMON_API gpu_interface
     size_t completed_fence;
     void cpu_wait_for_fence(UINT64 fence_value);
     void flush_graphics_queue();
-    void next_frame();
+
+    // Presents the frame, then waits until the GPU is done with the next frame resource.
+    // present_frame() and wait_for_frame() are the two halves, so that CPU work that doesn't touch the frame
+    // resources can run during the wait. Both return the milliseconds the CPU waited.
+    double next_frame();
+    void present_frame();
+    double wait_for_frame();
+    bool m_is_frame_ready = true;
+    double m_present_timestamp = 0.0; // g_cpu_timer timestamp taken after the last Present().
+
+    // Frames the CPU can record ahead of the GPU, 1 to MAX_FRAMES_IN_FLIGHT. Changing it flushes the graphics queue
+    // and creates the missing upload buffers, call it between present_frame() and the next frame.
+    // In low latency mode, call wait_for_frame() before sampling the input, see frame_pacer.h.
+    frame_pacer m_frame_pacer;
+    bool m_is_low_latency = false;
+    void set_frames_in_flight(UINT frames_in_flight);
+    UINT frames_in_flight() const { return m_frame_pacer.frames_in_flight(); }
+
+    // Measured on the last frame: CPU time blocked in wait_for_frame(), and time from the input timestamp given for
+    // the frame to its Present() call.
+    double m_cpu_wait_ms = 0.0;
+    double m_input_timestamp = 0.0;
+    double m_input_to_present_ms = 0.0;
+    void set_input_timestamp(double timestamp) { m_input_timestamp = timestamp; }
 
     // Timing.
-    std::mutex mtx;
+    // Timers can be used on any thread: each one takes a slot of the frame with an atomic increment, and is stopped
+    // by the thread that started it, on the same list or on one executed after it.
+    // The events come from PROFILE_EVENT(), the CPU side is also a scope of g_cpu_profiler.
+    static const UINT max_timers_per_frame = 256;
+    enum timer_queue : uint16_t
+    {
+        timer_queue_graphics,
+        timer_queue_compute,
+        timer_queue_count,
+    };
+    struct timer_slot
+    {
+        profile_event_id event;
+        uint32_t thread; // Index in g_cpu_profiler.
+        timer_queue queue; // From the type of the list.
+        ID3D12CommandList *list; // List of timer_stop(), to find its submission.
+        double cpu_ms;
+        bool is_stopped;
+    };
+    struct timer_result
+    {
+        std::string event_name;
+        std::string thread_name;
+        double cpu_ms;
+        double gpu_ms;
+        double queue_latency_ms; // From the submission of the list to the start of the timer on the GPU.
+        bool is_submitted; // False when the list was not submitted with execute_command_lists().
+    };
     gpu_timer m_gpu_timer;
-    std::string get_full_event_name(std::string event_name);
-    void timer_start(ComPtr<ID3D12GraphicsCommandList> cmd_list, std::string event_name);
-    void timer_stop(ComPtr<ID3D12GraphicsCommandList> cmd_list, std::string event_name);
-    double result_cpu(std::string event_name);
-    double result_gpu(std::string event_name);
+    std::vector<timer_slot> m_timer_slots[MAX_FRAMES_IN_FLIGHT];
+    std::atomic<UINT> m_num_timers[MAX_FRAMES_IN_FLIGHT] = {};
+    std::atomic<UINT> m_num_timer_resolves[MAX_FRAMES_IN_FLIGHT] = {};
+    std::vector<timer_result> m_timer_results; // Last frame whose GPU work is done, sorted by event name.
+    void timer_start(ComPtr<ID3D12GraphicsCommandList> cmd_list, profile_event_id event);
+    void timer_stop(ComPtr<ID3D12GraphicsCommandList> cmd_list, profile_event_id event);
+    void collect_timers();
+    void resolve_timers(ID3D12GraphicsCommandList *cmd_list, command_list_states *states);
+
+    // Cost of the timers of the last collected frame: a resolve per run of consecutive timers of a list, and one
+    // copy of the frame's timestamps out of the readback buffer.
+    struct timer_readback_stats
+    {
+        UINT num_timers;
+        UINT num_resolves;
+        double readback_ms;
+    };
+    timer_readback_stats m_timer_readback = {};
 
-    struct timer_entry
+    // Statistics of each event over the last frames, the timers of an event in a frame are summed.
+    // Updated by collect_timers(), sorted by event name.
+    struct timer_stats
+    {
+        std::string event_name;
+        rolling_stats cpu;
+        rolling_stats gpu;
+    };
+    struct timer_stats_summary
+    {
+        std::string event_name;
+        rolling_summary cpu;
+        rolling_summary gpu;
+    };
+    std::vector<timer_stats> m_timer_stats;
+    uint32_t m_timer_stats_window = rolling_stats::default_window;
+    void set_timer_stats_window(uint32_t frames);
+    std::vector<timer_stats_summary> timer_stats_summaries() const;
+
+    // GPU timestamps of each queue on the CPU clock (clock_ticks()), fitted on calibrations taken by collect_timers()
+    // every calibration_interval_ms. The CPU time of each submission is kept to measure the queue latency.
+    static constexpr double calibration_interval_ms = 500.0;
+    struct list_submission
     {
-        std::vector<std::string> cpu_event_names;
-        ID3D12GraphicsCommandList *cmd_list[NUM_BACK_BUFFERS];
+        ID3D12CommandList *list;
+        uint64_t ticks;
     };
-    std::unordered_map<std::string, timer_entry> timers;
+    clock_correlation m_clock_correlations[timer_queue_count];
+    uint64_t m_last_calibration_ticks = 0;
+    std::vector<list_submission> m_submissions[MAX_FRAMES_IN_FLIGHT]; // Written under m_state_mtx.
+    void calibrate_clocks();
+    uint64_t gpu_to_cpu_ticks(timer_queue queue, UINT64 gpu_timestamp) const;
+
+    // Adds the GPU timers collected from now on to the capture, until it is complete, one track per queue.
+    trace_capture *m_trace = nullptr;
+    void begin_trace(trace_capture *trace);
+    void add_trace_event(const timer_slot &slot, UINT slot_index);
 
     // Core device objects.
     ComPtr<IDXGIFactory6> m_dxgi_factory;
@@ -271,6 +464,9 @@ struct COMMON_API gpu_interface
                                               bool generate_mips = false,
                                               ComPtr<ID3D12Heap> texture_heap = nullptr, size_t heap_offset = 0);
 
+    // Size and alignment of the texture upload_dds() creates for the file, without loading the pixels.
+    D3D12_RESOURCE_ALLOCATION_INFO dds_allocation_info(const std::wstring &file, bool generate_mips = false);
+
     // Resource uploaders.
     struct COMMON_API resource_uploader
     {
@@ -311,32 +507,58 @@ struct COMMON_API gpu_interface
     ComPtr<ID3D12RootSignature> create_graphics_staging_rootsig(std::vector<D3D12_ROOT_PARAMETER1> additional_parameters = {}, UINT space = 0);
     ComPtr<ID3D12RootSignature> create_compute_staging_rootsig(std::vector<D3D12_ROOT_PARAMETER1> additional_parameters = {}, UINT space = 0);
 
+    // Staging tables shrunk to the registers used by the compiled shaders.
+    // size_staging_tables() is called once every shader is compiled, before the staging root signatures are created.
+    // Until then the tables keep their full size.
+    static constexpr UINT32 staging_limits[DESCRIPTORTYPE_MAX] = {GPU_RESOURCE_HEAP_CBV_COUNT,
+                                                                  GPU_RESOURCE_HEAP_SRV_COUNT,
+                                                                  GPU_RESOURCE_HEAP_UAV_COUNT,
+                                                                  GPU_SAMPLER_HEAP_COUNT};
+    bool m_has_staging_usage = false;
+    staging_usage m_staging_usage;
+    void size_staging_tables(UINT graphics_space, UINT compute_space);
+
+    // Layout of a graphics root signature for a PSO with hot per-draw constants, see build_staging_rootsig_layout().
+    // The constant buffers named in the options are bound as root CBVs, the other registers use the staging tables.
+    rootsig_layout build_graphics_staging_layout(const std::vector<shader_reflection> &shaders,
+                                                 const rootsig_layout_options &options,
+                                                 UINT space = 0);
+    UINT fill_staging_ranges(shader_stages stage, UINT space,
+                             D3D12_DESCRIPTOR_RANGE1 *csu_ranges,
+                             D3D12_DESCRIPTOR_RANGE1 *sampler_range);
+
     // Per-frame data
-    UINT32 frame_index;
-    UINT64 previous_frame_index;
+    // frame_index cycles over the frames in flight, back_buffer_index is the swap chain buffer the frame presents.
+    UINT32 frame_index = 0;
+    UINT32 back_buffer_index = 0;
+    ComPtr<ID3D12Resource> back_buffers[NUM_BACK_BUFFERS];
+    ID3D12Resource *get_back_buffer() { return back_buffers[back_buffer_index].Get(); }
     struct frame_resource
     {
         frame_resource() = default;
         ~frame_resource() = default;
 
-        UINT64 fence_value;
         ComPtr<ID3D12CommandAllocator> cmd_alloc;
         ComPtr<ID3D12GraphicsCommandList> cmd_list;
-        ComPtr<ID3D12Resource> back_buffer;
 
         // Per-frame resource allocator
+        // allocate() can be called from any thread without a lock, see upload_allocator. reset() is called when no
+        // thread allocates.
         struct COMMON_API frame_resources_allocator
         {
+            static const size_t block_size = upload_allocator::block_size;
+
             ~frame_resources_allocator() = default;
             frame_resources_allocator() = default;
-            frame_resources_allocator(
-                ComPtr<ID3D12Device> device,
-                size_t size);
+            void create(ComPtr<ID3D12Device> device, size_t size);
+            void init(UINT8 *begin, size_t size); // CPU memory only, for the benchmarks.
             UINT8 *allocate(size_t size, size_t alignment);
+            void reset() { m_allocator.reset(); }
+            size_t used() const { return m_allocator.used(); }
             ComPtr<ID3D12Resource> m_upload_resource;
-            UINT8 *m_begin;
-            UINT8 *m_current;
-            UINT8 *m_end;
+            UINT8 *m_begin = nullptr;
+            UINT8 *m_end = nullptr;
+            upload_allocator m_allocator;
         };
         frame_resources_allocator m_resources_buffer;
 
@@ -351,11 +573,13 @@ struct COMMON_API gpu_interface
                                              UINT max_rename_count,
                                              UINT additional_descriptors_count = 0);
             ComPtr<ID3D12DescriptorHeap> m_heap_cpu;
-            ComPtr<ID3D12DescriptorHeap> m_heap_gpu;
+            ComPtr<ID3D12DescriptorHeap> m_heap_gpu; // Not created when max_rename_count is 0, see reserve_slice().
             D3D12_DESCRIPTOR_HEAP_TYPE m_descriptor_type;
             UINT m_descriptor_size;
             UINT m_descriptor_count;
             UINT m_ring_offset;
+            UINT m_ring_end;
+            UINT m_stage_copy_count[SHADERSTAGE_MAX];
             bool m_is_stage_dirty[SHADERSTAGE_MAX];
             std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> m_bound_descriptors;
 
@@ -373,14 +597,47 @@ struct COMMON_API gpu_interface
 
             // Validate.
             void set_tables(ComPtr<ID3D12Device> device, ComPtr<ID3D12GraphicsCommandList> cmd_list);
+
+            // Size of the ring used by one set_tables() call on a graphics command list with every stage dirty.
+            UINT graphics_tables_size() const;
+
+            // Hands the space of num_table_sets graphics table sets to slice, which stages into its own CPU heap
+            // and writes its tables to this allocator's shader visible heap.
+            void reserve_slice(descriptor_table_frame_allocator *slice, UINT num_table_sets);
         };
         descriptor_table_frame_allocator csu_table_allocator;
         descriptor_table_frame_allocator sampler_table_allocator;
     };
-    frame_resource frames[NUM_BACK_BUFFERS];
+    frame_resource frames[MAX_FRAMES_IN_FLIGHT];
+    static const size_t frame_upload_buffer_size = 1024 * 1024 * 128;
     frame_resource *get_frame_resource() { return &frames[frame_index]; };
+
+    // Times threads that allocate and copy constants_size bytes from a frame_resources_allocator, against a
+    // pointer bumped under a mutex, with 1 to max_threads threads. Returns a text report.
+    std::string benchmark_upload_contention(size_t constants_size, UINT max_threads = 16);
+
+    // Staging of a command list recorded on another thread than the one that owns the frame.
+    // Descriptors go to slices of the current frame's heaps, so that contexts can be used at the same time without
+    // locks. Constants are allocated from the frame's upload buffer directly. begin_recording_context() reserves
+    // the slices, it's called by the thread that owns the frame before the context is handed to a job.
+    struct recording_context
+    {
+        frame_resource::descriptor_table_frame_allocator csu_table_allocator;
+        frame_resource::descriptor_table_frame_allocator sampler_table_allocator;
+    };
+    void create_recording_context(recording_context *context);
+    void begin_recording_context(recording_context *context, UINT num_table_sets);
+    void set_descriptor_tables(ComPtr<ID3D12GraphicsCommandList> cmd_list, recording_context *context);
 };
 
+// Memory accounting of the resources and heaps, in g_gpu_memory until D3D12 destroys them.
+// Resources are counted with the size GetResourceAllocationInfo() reports, a placed resource with the heap it is in.
+COMMON_API void track_gpu_memory(ID3D12Device *device, ID3D12Resource *resource, gpu_memory_category category,
+                                 const char *name, ID3D12Heap *heap = nullptr);
+COMMON_API void track_gpu_memory(ID3D12Heap *heap, gpu_memory_category category, const char *name);
+// A query heap doesn't report its size, it is estimated as 8 bytes per query.
+COMMON_API void track_gpu_memory(ID3D12QueryHeap *heap, UINT num_queries, const char *name);
+
 template <typename T>
 gpu_interface::scratch_buffer<T>
 gpu_interface::create_scratch_buffer(T *data, size_t num_elements, bool is_constant_buffer)
@@ -429,6 +686,7 @@ gpu_interface::create_upload_buffer(T *data, size_t num_elements, bool is_consta
                                              D3D12_RESOURCE_STATE_GENERIC_READ,
                                              nullptr,
                                              IID_PPV_ARGS(ub.m_upload_resource.GetAddressOf())));
+    track_gpu_memory(device.Get(), ub.m_upload_resource.Get(), gpu_memory_upload, "Upload buffer");
 
     check_hr(ub.m_upload_resource->Map(0, nullptr, (void **)&ub.m_mapped_data));
     return ub;
@@ -446,7 +704,7 @@ gpu_interface::create_constant_buffer(T *data, size_t num_elements, D3D12_RESOUR
     size_t aligned_size = align_up(data_size, cb.m_alignment);
 
     default_resource_from_uploader(get_frame_resource()->cmd_list, cb.default_resource.GetAddressOf(),
-                                   data, data_size, cb.m_alignment, flags);
+                                   data, data_size, cb.m_alignment, flags, gpu_memory_buffers, "Constant buffer");
 
     cb.cpu_handle.ptr = csu_allocator.allocate();
 
@@ -470,7 +728,7 @@ gpu_interface::create_structured_buffer(T *data, size_t num_elements, D3D12_RESO
     db.m_unaligned_size = num_elements * db.m_datum_size;
 
     default_resource_from_uploader(get_frame_resource()->cmd_list, db.default_resource.GetAddressOf(),
-                                   data, db.m_unaligned_size, db.m_alignment, flags);
+                                   data, db.m_unaligned_size, db.m_alignment, flags, gpu_memory_buffers, "Structured buffer");
 
     D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
     srv_desc.Format = DXGI_FORMAT_UNKNOWN;
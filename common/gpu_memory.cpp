@@ -0,0 +1,200 @@
+#include "gpu_memory.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+gpu_memory_tracker g_gpu_memory;
+
+const char *gpu_memory_category_name(gpu_memory_category category)
+{
+    switch (category)
+    {
+    case gpu_memory_textures:
+        return "Textures";
+    case gpu_memory_render_targets:
+        return "Render targets";
+    case gpu_memory_shadow_maps:
+        return "Shadow maps";
+    case gpu_memory_meshes:
+        return "Meshes";
+    case gpu_memory_buffers:
+        return "Buffers";
+    case gpu_memory_upload:
+        return "Upload";
+    case gpu_memory_readback:
+        return "Readback";
+    case gpu_memory_queries:
+        return "Queries";
+    case gpu_memory_transient:
+        return "Transient";
+    default:
+        return "unknown category";
+    }
+}
+
+void gpu_memory_tracker::add_usage(gpu_memory_usage *usage, const gpu_allocation &allocation)
+{
+    if (allocation.kind == gpu_allocation_placed)
+    {
+        usage->placed_bytes += allocation.size;
+    }
+    else
+    {
+        usage->bytes += allocation.size;
+        usage->peak_bytes = (std::max)(usage->peak_bytes, usage->bytes);
+    }
+    usage->count++;
+    usage->peak_count = (std::max)(usage->peak_count, usage->count);
+}
+
+void gpu_memory_tracker::remove_usage(gpu_memory_usage *usage, const gpu_allocation &allocation)
+{
+    if (allocation.kind == gpu_allocation_placed)
+    {
+        usage->placed_bytes -= allocation.size;
+    }
+    else
+    {
+        usage->bytes -= allocation.size;
+    }
+    usage->count--;
+}
+
+bool gpu_memory_tracker::add(uint64_t id, gpu_memory_category category, gpu_allocation_kind kind, const char *name,
+                             uint64_t size, uint64_t heap)
+{
+    if (category < 0 || category >= gpu_memory_category_count)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto inserted = m_allocations.emplace(id, gpu_allocation());
+    if (!inserted.second)
+    {
+        return false;
+    }
+
+    gpu_allocation &allocation = inserted.first->second;
+    allocation.id = id;
+    allocation.name = name ? name : "";
+    allocation.category = category;
+    allocation.kind = kind;
+    allocation.size = size;
+    allocation.heap = kind == gpu_allocation_placed ? heap : 0;
+    add_usage(&m_categories[category], allocation);
+    add_usage(&m_total, allocation);
+    return true;
+}
+
+bool gpu_memory_tracker::remove(uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto allocation = m_allocations.find(id);
+    if (allocation == m_allocations.end())
+    {
+        return false;
+    }
+
+    remove_usage(&m_categories[allocation->second.category], allocation->second);
+    remove_usage(&m_total, allocation->second);
+    m_allocations.erase(allocation);
+    return true;
+}
+
+gpu_memory_usage gpu_memory_tracker::usage(gpu_memory_category category) const
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return category >= 0 && category < gpu_memory_category_count ? m_categories[category] : gpu_memory_usage();
+}
+
+gpu_memory_usage gpu_memory_tracker::total() const
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_total;
+}
+
+std::vector<gpu_allocation> gpu_memory_tracker::allocations() const
+{
+    std::vector<gpu_allocation> allocations;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        allocations.reserve(m_allocations.size());
+        for (const auto &pair : m_allocations)
+        {
+            allocations.push_back(pair.second);
+        }
+    }
+
+    // By name for equal sizes, the order of the map changes with the addresses.
+    std::sort(allocations.begin(), allocations.end(), [](const gpu_allocation &a, const gpu_allocation &b) {
+        return a.size != b.size ? a.size > b.size : a.name < b.name;
+    });
+    return allocations;
+}
+
+void gpu_memory_tracker::reset_peaks()
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    for (gpu_memory_usage &usage : m_categories)
+    {
+        usage.peak_bytes = usage.bytes;
+        usage.peak_count = usage.count;
+    }
+    m_total.peak_bytes = m_total.bytes;
+    m_total.peak_count = m_total.count;
+}
+
+static double to_mb(uint64_t bytes)
+{
+    return (double)bytes / (1024.0 * 1024.0);
+}
+
+static void dump_usage(std::stringstream *stream, const char *name, const gpu_memory_usage &usage)
+{
+    *stream << std::left << std::setw(16) << name << std::right << std::setw(8) << usage.count << std::setw(12)
+            << to_mb(usage.bytes) << std::setw(12) << to_mb(usage.peak_bytes) << std::setw(12) << to_mb(usage.placed_bytes)
+            << "\n";
+}
+
+std::string gpu_memory_tracker::dump(size_t max_allocations) const
+{
+    gpu_memory_usage categories[gpu_memory_category_count];
+    gpu_memory_usage total;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        std::copy(m_categories, m_categories + gpu_memory_category_count, categories);
+        total = m_total;
+    }
+
+    std::stringstream stream;
+    stream.precision(2);
+    stream << std::fixed;
+    stream << std::left << std::setw(16) << "Category" << std::right << std::setw(8) << "Count" << std::setw(12) << "MB"
+           << std::setw(12) << "Peak MB" << std::setw(12) << "Placed MB"
+           << "\n";
+    for (int i = 0; i < gpu_memory_category_count; i++)
+    {
+        dump_usage(&stream, gpu_memory_category_name((gpu_memory_category)i), categories[i]);
+    }
+    dump_usage(&stream, "Total", total);
+
+    std::vector<gpu_allocation> largest = allocations();
+    if (largest.size() > max_allocations)
+    {
+        stream << "Largest " << max_allocations << " of " << largest.size() << " allocations:\n";
+        largest.resize(max_allocations);
+    }
+    else
+    {
+        stream << largest.size() << " allocations:\n";
+    }
+    for (const gpu_allocation &allocation : largest)
+    {
+        const char *kinds[] = {"committed", "heap", "placed"};
+        stream << std::setw(12) << to_mb(allocation.size) << " MB  " << std::left << std::setw(16)
+               << gpu_memory_category_name(allocation.category) << std::setw(10) << kinds[allocation.kind] << std::right
+               << allocation.name << "\n";
+    }
+    return stream.str();
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "common_api.h"
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Accounting of the GPU memory the renderer allocates, by category and name, next to the usage and budget the
+// adapter reports for the whole process.
+// The device code adds an allocation when it creates a resource or a heap, with the size D3D12 reserves for it, and
+// removes it when D3D12 destroys the object. An allocation is keyed by the address of its object.
+// Committed resources and heaps hold memory. A placed resource is listed with the heap it is in, its size only
+// counts in the placed bytes of its category: the heap already holds that memory, aliased resources share it.
+// Device independent: objects are opaque pointers, the sizes and the budget come from the device code.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+enum gpu_memory_category
+{
+    gpu_memory_textures,       // Material, sprite and environment textures.
+    gpu_memory_render_targets, // G-buffers, HDR, back buffer sized and depth targets.
+    gpu_memory_shadow_maps,
+    gpu_memory_meshes,         // Vertex and index buffers.
+    gpu_memory_buffers,        // Constant, structured and indirect argument buffers, e.g. the particles.
+    gpu_memory_upload,         // Upload rings and staging buffers.
+    gpu_memory_readback,
+    gpu_memory_queries,
+    gpu_memory_transient,      // Heaps aliased by the render graph.
+    gpu_memory_category_count
+};
+
+COMMON_API const char *gpu_memory_category_name(gpu_memory_category category);
+
+enum gpu_allocation_kind
+{
+    gpu_allocation_committed,
+    gpu_allocation_heap,
+    gpu_allocation_placed,
+};
+
+struct gpu_allocation
+{
+    uint64_t id = 0;
+    std::string name;
+    gpu_memory_category category = gpu_memory_buffers;
+    gpu_allocation_kind kind = gpu_allocation_committed;
+    uint64_t size = 0;
+    uint64_t heap = 0; // Id of the heap of a placed resource.
+};
+
+struct gpu_memory_usage
+{
+    uint64_t bytes = 0; // Of the committed resources and heaps.
+    uint64_t peak_bytes = 0;
+    uint64_t placed_bytes = 0;
+    uint32_t count = 0; // Allocations of any kind.
+    uint32_t peak_count = 0;
+};
+
+class COMMON_API gpu_memory_tracker
+{
+public:
+    gpu_memory_tracker() = default;
+    ~gpu_memory_tracker() = default;
+
+    // Returns false when the id is already tracked, the allocation is left unchanged.
+    bool add(uint64_t id, gpu_memory_category category, gpu_allocation_kind kind, const char *name, uint64_t size,
+             uint64_t heap = 0);
+    // Returns false when the id isn't tracked.
+    bool remove(uint64_t id);
+
+    gpu_memory_usage usage(gpu_memory_category category) const;
+    gpu_memory_usage total() const;
+
+    // Largest first.
+    std::vector<gpu_allocation> allocations() const;
+
+    // The peaks start again from the current usage.
+    void reset_peaks();
+
+    // Table of the categories with their totals and peaks, and the largest allocations.
+    std::string dump(size_t max_allocations = 16) const;
+
+private:
+    static void add_usage(gpu_memory_usage *usage, const gpu_allocation &allocation);
+    static void remove_usage(gpu_memory_usage *usage, const gpu_allocation &allocation);
+
+    mutable std::mutex m_mtx;
+    std::unordered_map<uint64_t, gpu_allocation> m_allocations;
+    gpu_memory_usage m_categories[gpu_memory_category_count];
+    gpu_memory_usage m_total;
+};
+
+extern COMMON_API gpu_memory_tracker g_gpu_memory;
+
+#pragma warning(pop)
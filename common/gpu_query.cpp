@@ -1,4 +1,5 @@
 #include "gpu_query.h"
+#include "gpu_interface.h"
 #include "d3dx12.h"
 
 #define NUM_SAMPLES 2
@@ -23,6 +24,7 @@ gpu_query::gpu_query(ComPtr<ID3D12Device> device, ComPtr<ID3D12GraphicsCommandLi
     check_hr(device->CreateQueryHeap(
         &query_heap_desc,
         IID_PPV_ARGS(&m_query_heap)));
+    track_gpu_memory(m_query_heap.Get(), m_timer_count, "GPU query queries");
 
     check_hr(device->CreateCommittedResource(
         &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
@@ -31,6 +33,7 @@ gpu_query::gpu_query(ComPtr<ID3D12Device> device, ComPtr<ID3D12GraphicsCommandLi
         D3D12_RESOURCE_STATE_COPY_DEST,
         NULL,
         IID_PPV_ARGS(m_query_rb_buffer.GetAddressOf())));
+    track_gpu_memory(device.Get(), m_query_rb_buffer.Get(), gpu_memory_readback, "GPU query readback");
 }
 
 void gpu_query::start(std::string query_name)
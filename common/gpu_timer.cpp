@@ -1,24 +1,21 @@
 #include "gpu_timer.h"
+#include "gpu_interface.h"
+#include <string.h>
+
+// Begin and end timestamps.
+static const UINT samples_per_event = 2;
 
 gpu_timer::gpu_timer(ComPtr<ID3D12Device> device,
                      ComPtr<ID3D12CommandQueue> cmd_queue,
-                     UINT *backbuffer_index,
                      UINT num_backbuffers,
-                     UINT max_events_per_list, UINT max_cmdlists_per_frame, UINT max_samples_per_event)
-    : m_samples_per_event(max_samples_per_event)
+                     UINT max_events_per_frame)
+    : m_max_events_per_frame(max_events_per_frame)
 {
     UINT64 tmp_gpu_frequency;
     cmd_queue->GetTimestampFrequency(&tmp_gpu_frequency);
     m_gpu_frequency = (double)tmp_gpu_frequency;
 
-    frames.resize(num_backbuffers);
-    m_backbuffer_index = backbuffer_index;
-
-    event_stride = max_samples_per_event;
-    list_stride = event_stride * max_events_per_list;
-    frame_stride = list_stride * max_cmdlists_per_frame;
-
-    max_num_entries = m_samples_per_event * num_backbuffers * max_events_per_list * max_cmdlists_per_frame;
+    UINT max_num_entries = samples_per_event * max_events_per_frame * num_backbuffers;
 
     D3D12_QUERY_HEAP_DESC query_heap_desc;
     query_heap_desc.Count = max_num_entries;
@@ -29,6 +26,7 @@ gpu_timer::gpu_timer(ComPtr<ID3D12Device> device,
         &query_heap_desc,
         IID_PPV_ARGS(&m_query_heap)));
     m_query_heap->SetName(L"m_query_heap");
+    track_gpu_memory(m_query_heap.Get(), max_num_entries, "GPU timer queries");
 
     check_hr(device->CreateCommittedResource(
         &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
@@ -38,130 +36,82 @@ gpu_timer::gpu_timer(ComPtr<ID3D12Device> device,
         NULL,
         IID_PPV_ARGS(m_query_rb_buffer.GetAddressOf())));
     m_query_rb_buffer->SetName(L"m_query_rb_buffer");
+    track_gpu_memory(device.Get(), m_query_rb_buffer.Get(), gpu_memory_readback, "GPU timer readback");
+
+    // Readback buffers can stay mapped, the GPU only writes to it between the fences of the frames.
+    check_hr(m_query_rb_buffer->Map(0, nullptr, (void **)&m_mapped_timestamps));
+    m_frame_timestamps.resize(samples_per_event * max_events_per_frame);
 }
 
-void gpu_timer::start(std::string event_name, ComPtr<ID3D12GraphicsCommandList> cmd_list)
+gpu_timer::~gpu_timer()
 {
-    UINT frame_id = *m_backbuffer_index;
-    frame &cur_frame = frames[frame_id];
-
-    bool is_list_found = cur_frame.lists.find(cmd_list.Get()) != cur_frame.lists.end();
-    if (!is_list_found)
+    if (m_mapped_timestamps != nullptr)
     {
-        // The command list was not found for this frame, add it.
-        cur_frame.lists[cmd_list.Get()].id = (UINT)cur_frame.lists.size();
-        cur_frame.list_to_events[cmd_list.Get()];
+        D3D12_RANGE written_range = {};
+        m_query_rb_buffer->Unmap(0, &written_range);
     }
+}
 
-    events_table &cur_list_events = cur_frame.list_to_events.at(cmd_list.Get());
-    bool is_event_found = cur_list_events.find(event_name) != cur_list_events.end();
-    if (!is_event_found)
+gpu_timer &gpu_timer::operator=(gpu_timer &&other) noexcept
+{
+    if (this != &other)
     {
-        // The event was not found for this command list, add it.
-        cur_list_events[event_name] = (UINT)cur_list_events.size();
+        if (m_mapped_timestamps != nullptr)
+        {
+            D3D12_RANGE written_range = {};
+            m_query_rb_buffer->Unmap(0, &written_range);
+        }
+        m_query_heap = std::move(other.m_query_heap);
+        m_query_rb_buffer = std::move(other.m_query_rb_buffer);
+        m_mapped_timestamps = other.m_mapped_timestamps;
+        m_frame_timestamps = std::move(other.m_frame_timestamps);
+        m_gpu_frequency = other.m_gpu_frequency;
+        m_max_events_per_frame = other.m_max_events_per_frame;
+        other.m_mapped_timestamps = nullptr;
     }
-
-    UINT list_id = cur_frame.lists.at(cmd_list.Get()).id;
-    UINT event_id = cur_frame.list_to_events.at(cmd_list.Get()).at(event_name);
-    UINT global_offset = calc_offset(frame_id, event_id, list_id);
-    cmd_list->EndQuery(m_query_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, global_offset);
-
-    cur_frame.lists.at(cmd_list.Get()).is_resolved = false;
+    return *this;
 }
 
-void gpu_timer::stop(std::string event_name, ComPtr<ID3D12GraphicsCommandList> cmd_list)
+void gpu_timer::start(UINT frame, UINT event, ComPtr<ID3D12GraphicsCommandList> cmd_list)
 {
-    UINT frame_id = *m_backbuffer_index;
-    frame &cur_frame = frames[frame_id];
-    UINT list_id = cur_frame.lists.at(cmd_list.Get()).id;
-    UINT event_id = cur_frame.list_to_events.at(cmd_list.Get()).at(event_name);
-    UINT global_offset = calc_offset(frame_id, event_id, list_id) + 1;
-    cmd_list->EndQuery(m_query_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, global_offset);
+    cmd_list->EndQuery(m_query_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, calc_offset(frame, event));
 }
 
-double gpu_timer::result(std::string event_name, ComPtr<ID3D12GraphicsCommandList> cmd_list)
+void gpu_timer::stop(UINT frame, UINT event, ComPtr<ID3D12GraphicsCommandList> cmd_list)
 {
-    UINT frame_id = *m_backbuffer_index;
-    frame &cur_frame = frames[frame_id];
-
-    bool is_list_found = cur_frame.lists.find(cmd_list.Get()) != cur_frame.lists.end();
-    if (!is_list_found)
-    {
-        // This list is not being tracked by the gpu timer. No calls to start() have been made yet.
-        return 0.0;
-    }
-
-    events_table &list_events = cur_frame.list_to_events.at(cmd_list.Get());
-    bool list_event_found = list_events.find(event_name) != list_events.end();
-    if (!list_event_found)
-    {
-        // The event was not found for this command list.
-        return 0.0;
-    }
-
-    UINT list_id = cur_frame.lists.at(cmd_list.Get()).id;
-    UINT event_id = cur_frame.list_to_events.at(cmd_list.Get()).at(event_name);
-
-    UINT global_offset = calc_offset(frame_id, event_id, list_id);
-    UINT buffer_start = global_offset;
-    UINT buffer_end = buffer_start + 1;
-
-    D3D12_RANGE rb_range;
-    rb_range.Begin = buffer_start * sizeof(UINT64);
-    rb_range.End = buffer_end * sizeof(UINT64);
-    m_query_rb_buffer->Map(0, &rb_range, (void **)&m_timestamp_buffer);
-
-    UINT64 timestamp_tick_delta = m_timestamp_buffer[buffer_end] - m_timestamp_buffer[buffer_start];
-    double frame_time = ((double)timestamp_tick_delta / m_gpu_frequency) * 1000.0; // convert from gpu ticks to milliseconds
-
-    rb_range = {};
-    m_query_rb_buffer->Unmap(0, &rb_range);
-    m_timestamp_buffer = NULL;
-    return frame_time;
+    cmd_list->EndQuery(m_query_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, calc_offset(frame, event) + 1);
 }
 
-void gpu_timer::resolve_frame()
+void gpu_timer::resolve(UINT frame, UINT first_event, UINT num_events, ID3D12GraphicsCommandList *cmd_list)
 {
-    frame &frame = frames[*m_backbuffer_index];
-    lists_table &lists = frame.lists;
-    entries_table &entries = frame.list_to_events;
-
-    for (auto &list : lists)
-    {
-        ID3D12GraphicsCommandList *cur_list = list.first;
-        list_info &cur_list_info = list.second;
-
-        if (!cur_list_info.is_resolved)
-        {
-            events_table &events = entries.at(cur_list);
-            for (auto &event : events)
-            {
-                const std::string &cur_list_event_name = event.first;
-                resolve(cur_list_event_name, cur_list);
-            }
-        }
-    }
+    UINT offset = calc_offset(frame, first_event);
+    cmd_list->ResolveQueryData(m_query_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, offset, num_events * samples_per_event,
+                               m_query_rb_buffer.Get(), offset * sizeof(UINT64));
 }
 
-void gpu_timer::resolve(std::string event_name, ComPtr<ID3D12GraphicsCommandList> cmd_list)
+void gpu_timer::read_frame(UINT frame, UINT num_events)
 {
-    UINT frame_id = *m_backbuffer_index;
-    frame &cur_frame = frames[frame_id];
-    UINT list_id = cur_frame.lists.at(cmd_list.Get()).id;
-    UINT event_id = cur_frame.list_to_events.at(cmd_list.Get()).at(event_name);
+    ASSERT(num_events <= m_max_events_per_frame, "Too many events for the timer.");
+    memcpy(m_frame_timestamps.data(), m_mapped_timestamps + calc_offset(frame, 0), num_events * samples_per_event * sizeof(UINT64));
+}
 
-    UINT buffer_start = calc_offset(frame_id, event_id, list_id);
-    UINT64 aligned_dest = buffer_start * sizeof(UINT64);
+double gpu_timer::result(UINT event) const
+{
+    UINT64 begin = 0;
+    UINT64 end = 0;
+    timestamps(event, &begin, &end);
 
-    cmd_list->ResolveQueryData(m_query_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, buffer_start, 2, m_query_rb_buffer.Get(), aligned_dest);
+    UINT64 timestamp_tick_delta = end - begin;
+    return ((double)timestamp_tick_delta / m_gpu_frequency) * 1000.0; // convert from gpu ticks to milliseconds
+}
 
-    cur_frame.lists.at(cmd_list.Get()).is_resolved = true;
+void gpu_timer::timestamps(UINT event, UINT64 *begin, UINT64 *end) const
+{
+    *begin = m_frame_timestamps[event * samples_per_event];
+    *end = m_frame_timestamps[event * samples_per_event + 1];
 }
 
-UINT gpu_timer::calc_offset(local_id frame_id, local_id event_id, local_id list_id)
+UINT gpu_timer::calc_offset(UINT frame, UINT event) const
 {
-    UINT offset_to_frame = frame_stride * frame_id;
-    UINT offset_to_event = event_stride * event_id;
-    UINT offset_to_list = list_stride * list_id;
-    return offset_to_frame + offset_to_event + offset_to_list;
+    return (frame * m_max_events_per_frame + event) * samples_per_event;
 }
@@ -1,61 +1,58 @@
 #pragma once
 #include "common.h"
 #include "directx12_include.h"
-#include <unordered_map>
 #include <vector>
-#include <string>
 
+// GPU timestamps of the events of each frame in flight.
+// An event is identified by its index in the frame, it uses two queries: one written by start() and one by stop().
+// Events are independent of each other, lists recorded on different threads can be timed without a lock as long
+// as they use different event indices. The queries are copied to the readback buffer by resolve(), once per list
+// for a range of events, and the results of a frame are read in one copy by read_frame() once its fence is reached.
+// The readback buffer stays mapped.
 #pragma warning(push)
 #pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
 class COMMON_API gpu_timer
 {
 public:
     gpu_timer() = default;
-    ~gpu_timer() = default;
+    ~gpu_timer();
     gpu_timer(ComPtr<ID3D12Device> device,
               ComPtr<ID3D12CommandQueue> cmd_queue,
-              UINT *backbuffer_index,
               UINT num_backbuffers,
-              UINT max_events_per_list = 100, UINT max_cmdlists_per_frame = 100, UINT max_samples_per_event = 2);
+              UINT max_events_per_frame);
+    gpu_timer(const gpu_timer &) = delete;
+    gpu_timer &operator=(const gpu_timer &) = delete;
+    gpu_timer(gpu_timer &&other) noexcept { *this = std::move(other); }
+    gpu_timer &operator=(gpu_timer &&other) noexcept;
 
-    void start(std::string event_name, ComPtr<ID3D12GraphicsCommandList> cmd_list);
-    void stop(std::string event_name, ComPtr<ID3D12GraphicsCommandList> cmd_list);
-    double result(std::string event_name, ComPtr<ID3D12GraphicsCommandList> cmd_list);
-    void resolve_frame();
-    void resolve(std::string event_name, ComPtr<ID3D12GraphicsCommandList> cmd_list);
+    void start(UINT frame, UINT event, ComPtr<ID3D12GraphicsCommandList> cmd_list);
+    void stop(UINT frame, UINT event, ComPtr<ID3D12GraphicsCommandList> cmd_list);
+
+    // Copies the timestamps of the events [first_event, first_event + num_events) to the readback buffer, on a list
+    // executed after the ones of their start() and stop().
+    void resolve(UINT frame, UINT first_event, UINT num_events, ID3D12GraphicsCommandList *cmd_list);
+
+    // Copies the timestamps of the first num_events events of the frame from the readback buffer, for result() and
+    // timestamps().
+    void read_frame(UINT frame, UINT num_events);
+
+    // Milliseconds between the two timestamps of an event of the last frame read.
+    double result(UINT event) const;
+
+    // The two timestamps, in GPU ticks of frequency().
+    void timestamps(UINT event, UINT64 *begin, UINT64 *end) const;
+    double frequency() const { return m_gpu_frequency; }
+
+    UINT max_events_per_frame() const { return m_max_events_per_frame; }
 
 private:
     ComPtr<ID3D12QueryHeap> m_query_heap;
     ComPtr<ID3D12Resource> m_query_rb_buffer;
+    const UINT64 *m_mapped_timestamps = nullptr;
+    std::vector<UINT64> m_frame_timestamps;
+    double m_gpu_frequency = 1.0;
+    UINT m_max_events_per_frame = 0;
 
-    UINT m_samples_per_event;
-    UINT max_num_entries;
-
-    UINT event_stride;
-    UINT frame_stride;
-    UINT list_stride;
-
-    UINT64 *m_timestamp_buffer;
-    double m_gpu_frequency;
-    UINT *m_backbuffer_index;
-
-    using local_id = UINT;
-    struct list_info
-    {
-        local_id id;
-        bool is_resolved;
-    };
-    using events_table = std::unordered_map<std::string, local_id>;
-    using lists_table = std::unordered_map<ID3D12GraphicsCommandList *, list_info>;
-    //using lists_table = std::unordered_map<ID3D12GraphicsCommandList *, local_id>;
-    using entries_table = std::unordered_map<ID3D12GraphicsCommandList *, events_table>;
-
-    struct frame
-    {
-        lists_table lists;
-        entries_table list_to_events;
-    };
-    std::vector<frame> frames;
-    UINT calc_offset(local_id frame_id, local_id event_id, local_id list_id);
+    UINT calc_offset(UINT frame, UINT event) const;
 };
 #pragma warning(pop)
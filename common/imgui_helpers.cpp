@@ -37,11 +37,41 @@ void imgui_new_frame()
     ImGui::NewFrame();
 }
 
-void imgui_render(ID3D12GraphicsCommandList *cmd_list)
+void imgui_render(ID3D12GraphicsCommandList *cmd_list, imgui_draw_snapshot *snapshot)
 {
     cmd_list->SetDescriptorHeaps(1, &imgui_srv_heap);
+    ImGui_ImplDX12_RenderDrawData(&snapshot->m_draw_data, cmd_list);
+}
+
+imgui_draw_snapshot::~imgui_draw_snapshot()
+{
+    clear();
+}
+
+void imgui_draw_snapshot::capture()
+{
+    clear();
     ImGui::Render();
-    ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), cmd_list);
+    ImDrawData *draw_data = ImGui::GetDrawData();
+    for (int i = 0; i < draw_data->CmdListsCount; i++)
+    {
+        m_draw_lists.push_back(draw_data->CmdLists[i]->CloneOutput());
+    }
+
+    m_draw_data = *draw_data;
+    m_draw_data.CmdLists = m_draw_lists.data();
+}
+
+void imgui_draw_snapshot::clear()
+{
+    for (ImDrawList *draw_list : m_draw_lists)
+    {
+        IM_DELETE(draw_list);
+    }
+    m_draw_lists.clear();
+
+    // An empty display size makes the renderer skip the snapshot.
+    m_draw_data.Clear();
 }
 
 void imgui_shutdown()
@@ -75,18 +105,72 @@ void imgui_gpu_memory(IDXGIAdapter4 *adapter)
     ImGui::Text("Local (video) memory");
     ImGui::Indent(10.f);
 
-    ImGui::Text("Current usage: %u", local_usage);
-    ImGui::Text("Budget: %u", local_budget);
+    ImGui::Text("Current usage: %llu", (unsigned long long)local_usage);
+    ImGui::Text("Budget: %llu", (unsigned long long)local_budget);
     ImGui::ProgressBar((float)local_usage / (float)local_budget, ImVec2(0.f, 0.f));
     ImGui::Unindent(10.f);
 
     ImGui::Text("Non-local (system) memory");
     ImGui::Indent(10.f);
-    ImGui::Text("Current usage: %u", nonlocal_usage);
-    ImGui::Text("Budget: %u", nonlocal_budget);
+    ImGui::Text("Current usage: %llu", (unsigned long long)nonlocal_usage);
+    ImGui::Text("Budget: %llu", (unsigned long long)nonlocal_budget);
     ImGui::ProgressBar((float)nonlocal_usage / (float)nonlocal_budget, ImVec2(0.f, 0.f));
     ImGui::Unindent(10.f);
     ImGui::Separator();
+
+    // What the renderer allocated, the rest of the usage is the driver, the swap chain and the other processes.
+    const double mb = 1024.0 * 1024.0;
+    if (ImGui::BeginTable("gpu memory", 5,
+                          ImGuiTableFlags_BordersInnerH |
+                              ImGuiTableFlags_BordersOuterH |
+                              ImGuiTableFlags_BordersOuterV |
+                              ImGuiTableFlags_BordersInnerV |
+                              ImGuiTableFlags_SizingStretchProp))
+    {
+        ImGui::TableSetupColumn("Category");
+        ImGui::TableSetupColumn("Count");
+        ImGui::TableSetupColumn("MB");
+        ImGui::TableSetupColumn("Peak MB");
+        ImGui::TableSetupColumn("Placed MB");
+        ImGui::TableHeadersRow();
+
+        auto usage_row = [mb](const char *name, const gpu_memory_usage &usage) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextUnformatted(name);
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%u", usage.count);
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%.2f", usage.bytes / mb);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%.2f", usage.peak_bytes / mb);
+            ImGui::TableSetColumnIndex(4);
+            ImGui::Text("%.2f", usage.placed_bytes / mb);
+        };
+        for (int i = 0; i < gpu_memory_category_count; i++)
+        {
+            gpu_memory_category category = (gpu_memory_category)i;
+            usage_row(gpu_memory_category_name(category), g_gpu_memory.usage(category));
+        }
+        usage_row("Total", g_gpu_memory.total());
+
+        ImGui::EndTable();
+    }
+    if (ImGui::Button("Reset peaks"))
+    {
+        g_gpu_memory.reset_peaks();
+    }
+
+    if (ImGui::TreeNode("Allocations"))
+    {
+        for (const gpu_allocation &allocation : g_gpu_memory.allocations())
+        {
+            ImGui::Text("%10.2f MB %s%s, %s", allocation.size / mb, allocation.name.c_str(),
+                        allocation.kind == gpu_allocation_placed ? " (placed)" : "",
+                        gpu_memory_category_name(allocation.category));
+        }
+        ImGui::TreePop();
+    }
 }
 
 void imgui_mouse_pos()
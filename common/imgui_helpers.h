@@ -7,11 +7,34 @@
 #include "imgui_impl_win32.h"
 #include "imgui_impl_dx12.h"
 
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+// Copy of the draw lists of a finished ImGui frame.
+// The lists owned by ImGui are only valid until the next imgui_new_frame(), the copy can be recorded while the UI
+// of the next frame is built.
+struct COMMON_API imgui_draw_snapshot
+{
+    imgui_draw_snapshot() = default;
+    ~imgui_draw_snapshot();
+    imgui_draw_snapshot(const imgui_draw_snapshot &) = delete;
+    imgui_draw_snapshot &operator=(const imgui_draw_snapshot &) = delete;
+
+    // Ends the ImGui frame and copies its draw data.
+    void capture();
+    void clear();
+
+    ImDrawData m_draw_data;
+    std::vector<ImDrawList *> m_draw_lists;
+};
+
+#pragma warning(pop)
+
 COMMON_API DirectX::XMFLOAT2 mouse_pos;
 COMMON_API DirectX::XMFLOAT2 ndc_mouse_pos;
 
 COMMON_API ImGuiContext *imgui_init(ComPtr<ID3D12Device> device, int num_back_buffers, DXGI_FORMAT back_buffer_format);
-COMMON_API void imgui_render(ID3D12GraphicsCommandList *cmd_list);
+COMMON_API void imgui_render(ID3D12GraphicsCommandList *cmd_list, imgui_draw_snapshot *snapshot);
 COMMON_API void imgui_shutdown();
 COMMON_API void imgui_mouse_pos();
 COMMON_API void imgui_gpu_memory(IDXGIAdapter4 *adapter);
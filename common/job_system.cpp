@@ -0,0 +1,486 @@
+#include "job_system.h"
+#include "cpu_profiler.h"
+#include "frame_stalls.h"
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static thread_local job_system *t_job_system = nullptr;
+static thread_local uint32_t t_thread_index = 0;
+
+// Idle workers spin this many times before going to sleep.
+static const int spin_count = 256;
+
+job_deque::job_deque()
+{
+    for (int64_t i = 0; i < capacity; i++)
+    {
+        m_jobs[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+bool job_deque::push(job *j)
+{
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_acquire);
+    if (b - t >= capacity)
+    {
+        return false;
+    }
+
+    // The release store publishes the job to the thieves that acquire m_bottom.
+    m_jobs[b & (capacity - 1)].store(j, std::memory_order_relaxed);
+    m_bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+job *job_deque::pop()
+{
+    int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        // Empty.
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    job *j = m_jobs[b & (capacity - 1)].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        // Last job, race against the thieves for it.
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            j = nullptr;
+        }
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return j;
+}
+
+job *job_deque::steal()
+{
+    int64_t t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b)
+    {
+        return nullptr;
+    }
+
+    job *j = m_jobs[t & (capacity - 1)].load(std::memory_order_relaxed);
+    if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+        // Another thread got it first.
+        return nullptr;
+    }
+    return j;
+}
+
+bool job_deque::is_empty() const
+{
+    return m_top.load(std::memory_order_acquire) >= m_bottom.load(std::memory_order_acquire);
+}
+
+job_pool::~job_pool()
+{
+    for (job *block : m_blocks)
+    {
+        delete[] block;
+    }
+}
+
+job *job_pool::allocate(uint32_t pool_index)
+{
+    if (!m_free)
+    {
+        m_free = m_released.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    if (!m_free)
+    {
+        job *block = new job[block_size];
+        for (uint32_t i = 0; i < block_size; i++)
+        {
+            block[i].counter = nullptr;
+            block[i].range = nullptr;
+            block[i].next = (i + 1 < block_size) ? &block[i + 1] : nullptr;
+            block[i].pool = pool_index;
+        }
+        m_blocks.push_back(block);
+        m_free = block;
+    }
+
+    job *j = m_free;
+    m_free = j->next;
+    return j;
+}
+
+void job_pool::release(job *j)
+{
+    // The owner only ever takes the whole stack, a pushed job can't be popped and pushed again under our feet.
+    job *head = m_released.load(std::memory_order_relaxed);
+    do
+    {
+        j->next = head;
+    } while (!m_released.compare_exchange_weak(head, j, std::memory_order_release, std::memory_order_relaxed));
+}
+
+job_system::~job_system()
+{
+    stop();
+}
+
+void job_system::start(uint32_t num_workers)
+{
+    if (m_is_running)
+    {
+        return;
+    }
+
+    if (num_workers == hardware_workers)
+    {
+        uint32_t hardware_threads = std::thread::hardware_concurrency();
+        num_workers = hardware_threads > 1 ? hardware_threads - 1 : 0;
+    }
+
+    m_queues.resize(num_workers + 1);
+    for (job_deque *&queue : m_queues)
+    {
+        queue = new job_deque();
+    }
+
+    m_pools.resize(num_workers + 2);
+    for (job_pool *&pool : m_pools)
+    {
+        pool = new job_pool();
+    }
+
+    t_job_system = this;
+    t_thread_index = 0;
+    m_num_jobs = 0;
+    m_num_steals = 0;
+    m_num_inline = 0;
+    m_is_running = true;
+
+    for (uint32_t i = 1; i <= num_workers; i++)
+    {
+        m_threads.emplace_back(&job_system::worker, this, i);
+#ifdef _WIN32
+        std::wstring thread_desc = L"job worker #" + std::to_wstring(i);
+        SetThreadDescription((HANDLE)m_threads.back().native_handle(), thread_desc.c_str());
+#endif
+    }
+}
+
+void job_system::stop()
+{
+    if (!m_is_running)
+    {
+        return;
+    }
+
+    m_is_running = false;
+    m_wake_counter.fetch_add(1, std::memory_order_seq_cst);
+    address_wake_all(&m_wake_counter);
+
+    for (std::thread &thread : m_threads)
+    {
+        thread.join();
+    }
+    m_threads.clear();
+
+    // Jobs that were never picked up are dropped.
+    for (job_deque *queue : m_queues)
+    {
+        while (job *j = queue->pop())
+        {
+            recycle(j);
+        }
+        delete queue;
+    }
+    m_queues.clear();
+
+    for (job *j : m_external_jobs)
+    {
+        recycle(j);
+    }
+    m_external_jobs.clear();
+    m_num_pending = 0;
+
+    for (job_pool *pool : m_pools)
+    {
+        delete pool;
+    }
+    m_pools.clear();
+
+    if (t_job_system == this)
+    {
+        t_job_system = nullptr;
+    }
+}
+
+uint32_t job_system::thread_index()
+{
+    return t_job_system ? t_thread_index : 0;
+}
+
+job *job_system::allocate_job()
+{
+    if (t_job_system == this)
+    {
+        return m_pools[t_thread_index]->allocate(t_thread_index);
+    }
+
+    uint32_t external_pool = (uint32_t)m_pools.size() - 1;
+    std::lock_guard<std::mutex> lock(m_external_mtx);
+    return m_pools[external_pool]->allocate(external_pool);
+}
+
+void job_system::run(std::function<void()> execute, job_counter *counter)
+{
+    if (!m_is_running)
+    {
+        // Not started, the caller runs the job.
+        m_num_inline++;
+        execute();
+        m_num_jobs.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    job *j = allocate_job();
+    j->execute = std::move(execute);
+    push(j, counter);
+}
+
+void job_system::parallel_for(uint32_t count, uint32_t batch_size, std::function<void(uint32_t, uint32_t)> execute, job_counter *counter)
+{
+    batch_size = batch_size == 0 ? 1 : batch_size;
+    uint32_t num_batches = (count + batch_size - 1) / batch_size;
+    if (num_batches == 0)
+    {
+        return;
+    }
+
+    if (!m_is_running)
+    {
+        for (uint32_t begin = 0; begin < count; begin += batch_size)
+        {
+            execute(begin, (count - begin > batch_size) ? begin + batch_size : count);
+        }
+        m_num_inline += num_batches;
+        m_num_jobs.fetch_add(num_batches, std::memory_order_relaxed);
+        return;
+    }
+
+    // One copy of the function for all the batches, a batch only holds its range.
+    job_range_function *range = new job_range_function();
+    range->execute = std::move(execute);
+    range->m_num_jobs.store(num_batches, std::memory_order_relaxed);
+    for (uint32_t begin = 0; begin < count; begin += batch_size)
+    {
+        job *j = allocate_job();
+        j->range = range;
+        j->begin = begin;
+        j->end = (count - begin > batch_size) ? begin + batch_size : count;
+        push(j, counter);
+    }
+}
+
+void job_system::push(job *j, job_counter *counter)
+{
+    j->counter = counter;
+    if (counter)
+    {
+        counter->m_value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (t_job_system == this)
+    {
+        if (!m_queues[t_thread_index]->push(j))
+        {
+            m_num_inline++;
+            execute(j);
+            return;
+        }
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(m_external_mtx);
+        m_external_jobs.push_back(j);
+    }
+
+    // Wake up a sleeping worker. The pending count is incremented before the sleepers are checked and the
+    // workers do the opposite, so that one of the two always sees the other.
+    m_num_pending.fetch_add(1, std::memory_order_seq_cst);
+    if (m_num_sleeping.load(std::memory_order_seq_cst) > 0)
+    {
+        m_wake_counter.fetch_add(1, std::memory_order_seq_cst);
+        address_wake_one(&m_wake_counter);
+    }
+}
+
+void job_system::wait(job_counter *counter)
+{
+    uint32_t index = (t_job_system == this) ? t_thread_index : 0;
+    bool can_help = (t_job_system == this) && m_is_running;
+
+    // Only the time without a job to run is a stall, one per stretch of waiting.
+    uint64_t stall_start = 0;
+    bool is_stalled = false;
+    while (!counter->is_done())
+    {
+        if (can_help && try_run_one(index))
+        {
+            if (is_stalled)
+            {
+                g_stall_tracker.end_stall(stall_job_wait, stall_start);
+                is_stalled = false;
+            }
+            continue;
+        }
+        if (!is_stalled)
+        {
+            stall_start = g_stall_tracker.begin_stall(stall_job_wait);
+            is_stalled = true;
+        }
+        std::this_thread::yield();
+    }
+    if (is_stalled)
+    {
+        g_stall_tracker.end_stall(stall_job_wait, stall_start);
+    }
+}
+
+bool job_system::run_one()
+{
+    if (t_job_system != this || !m_is_running)
+    {
+        return false;
+    }
+    return try_run_one(t_thread_index);
+}
+
+job *job_system::find_job(uint32_t index)
+{
+    // Own queue first, newest job first so that its data is still in the cache.
+    job *j = m_queues[index]->pop();
+    if (j)
+    {
+        return j;
+    }
+
+    // Steal the oldest job of another thread, starting with the next one to spread the thieves.
+    uint32_t num_queues = (uint32_t)m_queues.size();
+    for (uint32_t i = 1; i < num_queues; i++)
+    {
+        j = m_queues[(index + i) % num_queues]->steal();
+        if (j)
+        {
+            m_num_steals.fetch_add(1, std::memory_order_relaxed);
+            return j;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_external_mtx);
+    if (!m_external_jobs.empty())
+    {
+        j = m_external_jobs.back();
+        m_external_jobs.pop_back();
+    }
+    return j;
+}
+
+bool job_system::try_run_one(uint32_t index)
+{
+    job *j = find_job(index);
+    if (!j)
+    {
+        return false;
+    }
+
+    m_num_pending.fetch_sub(1, std::memory_order_relaxed);
+    execute(j);
+    return true;
+}
+
+void job_system::execute(job *j)
+{
+    if (j->range)
+    {
+        j->range->execute(j->begin, j->end);
+    }
+    else
+    {
+        j->execute();
+    }
+
+    // The captures are destroyed before the waiters are released.
+    job_counter *counter = j->counter;
+    recycle(j);
+    if (counter)
+    {
+        counter->m_value.fetch_sub(1, std::memory_order_release);
+    }
+    m_num_jobs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void job_system::recycle(job *j)
+{
+    j->execute = nullptr;
+    if (j->range && j->range->m_num_jobs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete j->range;
+    }
+    j->range = nullptr;
+    j->counter = nullptr;
+
+    // The external pool is only used under the lock, its jobs always go through the stack.
+    if (t_job_system == this && j->pool == t_thread_index)
+    {
+        m_pools[j->pool]->release_owned(j);
+    }
+    else
+    {
+        m_pools[j->pool]->release(j);
+    }
+}
+
+void job_system::worker(uint32_t index)
+{
+    t_job_system = this;
+    t_thread_index = index;
+    std::string thread_name = "job worker #" + std::to_string(index);
+    g_cpu_profiler.set_thread_name(thread_name.c_str());
+
+    int spins = 0;
+    while (m_is_running.load(std::memory_order_relaxed))
+    {
+        if (try_run_one(index))
+        {
+            spins = 0;
+            continue;
+        }
+
+        if (++spins < spin_count)
+        {
+            cpu_pause();
+            continue;
+        }
+
+        // The wait returns at once if a wakeup happened since the counter was read.
+        uint32_t wake_counter = m_wake_counter.load(std::memory_order_seq_cst);
+        m_num_sleeping.fetch_add(1, std::memory_order_seq_cst);
+        if (m_num_pending.load(std::memory_order_seq_cst) == 0 && m_is_running)
+        {
+            stall_scope stall(stall_worker_sleep);
+            address_wait(&m_wake_counter, wake_counter);
+        }
+        m_num_sleeping.fetch_sub(1, std::memory_order_seq_cst);
+        spins = 0;
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include "common_api.h"
+#include "platform.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// Work-stealing job system.
+// Each thread owns a Chase-Lev deque: it pushes and pops jobs at the bottom, idle threads steal from the top.
+// The thread that starts the job system is thread 0, it runs jobs while it waits on a counter.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+// Number of unfinished jobs of a group, waiting on it runs other jobs in the meantime.
+struct job_counter
+{
+    std::atomic<int32_t> m_value{0};
+    bool is_done() const { return m_value.load(std::memory_order_acquire) == 0; }
+};
+
+// Function of a parallel_for, shared by its batches and freed by the last one.
+struct job_range_function
+{
+    std::function<void(uint32_t, uint32_t)> execute;
+    std::atomic<uint32_t> m_num_jobs{0};
+};
+
+struct job
+{
+    std::function<void()> execute;
+    job_counter *counter;
+
+    // Batch of a parallel_for, used instead of execute when range is set.
+    job_range_function *range;
+    uint32_t begin;
+    uint32_t end;
+
+    job *next;     // Free list of the pool.
+    uint32_t pool; // Pool the job goes back to when it is done.
+};
+
+// Recycled jobs, one pool per thread so that run() doesn't allocate.
+// allocate() and release_owned() are only called by the owner of the pool, release() by the other threads: their
+// jobs are pushed on a lock-free stack that the owner takes back all at once when its free list is empty.
+class COMMON_API job_pool
+{
+public:
+    static const uint32_t block_size = 256;
+
+    job_pool() = default;
+    ~job_pool();
+
+    job *allocate(uint32_t pool_index);
+    void release(job *j);
+    void release_owned(job *j)
+    {
+        j->next = m_free;
+        m_free = j;
+    }
+
+private:
+    job *m_free = nullptr;
+    std::atomic<job *> m_released{nullptr};
+    std::vector<job *> m_blocks;
+};
+
+// Fixed capacity Chase-Lev deque of jobs, see "Correct and Efficient Work-Stealing for Weak Memory Models".
+// push() and pop() are only called by the owner thread, steal() by any thread.
+class COMMON_API job_deque
+{
+public:
+    static const int64_t capacity = 4096;
+
+    job_deque();
+    ~job_deque() = default;
+
+    // Returns false when the deque is full.
+    bool push(job *j);
+    job *pop();
+    job *steal();
+    bool is_empty() const;
+
+private:
+    alignas(64) std::atomic<int64_t> m_top{0};
+    alignas(64) std::atomic<int64_t> m_bottom{0};
+    std::atomic<job *> m_jobs[capacity];
+};
+
+class COMMON_API job_system
+{
+public:
+    job_system() = default;
+    ~job_system();
+
+    // The default starts one worker per hardware thread, minus the calling thread. With 0 workers the jobs
+    // run on the calling thread while it waits.
+    static const uint32_t hardware_workers = 0xffffffff;
+    void start(uint32_t num_workers = hardware_workers);
+    void stop();
+
+    // Adds the job to the queue of the calling thread, counter is incremented until the job is done.
+    void run(std::function<void()> execute, job_counter *counter = nullptr);
+
+    // Splits [0, count) in batches of batch_size and runs execute(begin, end) on each of them.
+    void parallel_for(uint32_t count, uint32_t batch_size, std::function<void(uint32_t, uint32_t)> execute, job_counter *counter);
+
+    // Runs jobs until the counter reaches zero.
+    void wait(job_counter *counter);
+
+    // Runs one queued job on the calling thread, returns false if there was none.
+    bool run_one();
+
+    // Workers and the thread that started the job system.
+    uint32_t num_threads() const { return (uint32_t)m_queues.size(); }
+
+    // Index of the calling thread, 0 for the main thread and for threads the job system doesn't know.
+    static uint32_t thread_index();
+
+    // Statistics since start().
+    std::atomic<uint64_t> m_num_jobs{0};
+    std::atomic<uint64_t> m_num_steals{0};
+    std::atomic<uint64_t> m_num_inline{0}; // Jobs run by run() because the queue was full.
+
+private:
+    void worker(uint32_t index);
+    bool try_run_one(uint32_t index);
+    job *find_job(uint32_t index);
+    job *allocate_job();
+    void push(job *j, job_counter *counter);
+    void execute(job *j);
+    void recycle(job *j);
+
+    std::vector<job_deque *> m_queues;
+    std::vector<std::thread> m_threads;
+
+    // One pool per thread, the last one is used under m_external_mtx by the threads that aren't part of the job system.
+    std::vector<job_pool *> m_pools;
+
+    // Jobs pushed by threads that aren't part of the job system.
+    std::mutex m_external_mtx;
+    std::vector<job *> m_external_jobs;
+
+    // Idle workers park on the wake counter until a job is pushed, every wakeup increments it.
+    std::atomic<uint32_t> m_wake_counter{0};
+    std::atomic<int32_t> m_num_pending{0};
+    std::atomic<int32_t> m_num_sleeping{0};
+    std::atomic<bool> m_is_running{false};
+};
+
+#pragma warning(pop)
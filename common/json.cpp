@@ -0,0 +1,396 @@
+#include "json.h"
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+struct json_reader
+{
+    const char *m_current;
+    const char *m_end;
+    std::string m_error;
+
+    void skip_whitespace()
+    {
+        while (m_current < m_end && (*m_current == ' ' || *m_current == '\t' || *m_current == '\n' || *m_current == '\r'))
+        {
+            m_current++;
+        }
+    }
+
+    bool fail(const char *message)
+    {
+        if (m_error.empty())
+        {
+            m_error = message;
+        }
+        return false;
+    }
+
+    bool match(const char *literal)
+    {
+        size_t length = strlen(literal);
+        if ((size_t)(m_end - m_current) < length || strncmp(m_current, literal, length) != 0)
+        {
+            return false;
+        }
+        m_current += length;
+        return true;
+    }
+
+    bool parse_string(std::string *out)
+    {
+        if (m_current >= m_end || *m_current != '"')
+        {
+            return fail("Expected a string.");
+        }
+        m_current++;
+
+        while (m_current < m_end && *m_current != '"')
+        {
+            char c = *m_current++;
+            if (c != '\\')
+            {
+                out->push_back(c);
+                continue;
+            }
+
+            if (m_current >= m_end)
+            {
+                return fail("Unterminated escape sequence.");
+            }
+
+            char escaped = *m_current++;
+            switch (escaped)
+            {
+            case '"':
+                out->push_back('"');
+                break;
+            case '\\':
+                out->push_back('\\');
+                break;
+            case '/':
+                out->push_back('/');
+                break;
+            case 'b':
+                out->push_back('\b');
+                break;
+            case 'f':
+                out->push_back('\f');
+                break;
+            case 'n':
+                out->push_back('\n');
+                break;
+            case 'r':
+                out->push_back('\r');
+                break;
+            case 't':
+                out->push_back('\t');
+                break;
+            case 'u':
+            {
+                if (m_end - m_current < 4)
+                {
+                    return fail("Truncated unicode escape.");
+                }
+                char hex[5] = {m_current[0], m_current[1], m_current[2], m_current[3], 0};
+                unsigned code_point = (unsigned)strtoul(hex, nullptr, 16);
+                m_current += 4;
+
+                // Encode as UTF-8, surrogate pairs are not combined.
+                if (code_point < 0x80)
+                {
+                    out->push_back((char)code_point);
+                }
+                else if (code_point < 0x800)
+                {
+                    out->push_back((char)(0xC0 | (code_point >> 6)));
+                    out->push_back((char)(0x80 | (code_point & 0x3F)));
+                }
+                else
+                {
+                    out->push_back((char)(0xE0 | (code_point >> 12)));
+                    out->push_back((char)(0x80 | ((code_point >> 6) & 0x3F)));
+                    out->push_back((char)(0x80 | (code_point & 0x3F)));
+                }
+                break;
+            }
+            default:
+                return fail("Invalid escape sequence.");
+            }
+        }
+
+        if (m_current >= m_end)
+        {
+            return fail("Unterminated string.");
+        }
+        m_current++;
+        return true;
+    }
+
+    bool parse_value(json_value *out, int depth)
+    {
+        if (depth > 128)
+        {
+            return fail("Document is nested too deeply.");
+        }
+
+        skip_whitespace();
+        if (m_current >= m_end)
+        {
+            return fail("Unexpected end of document.");
+        }
+
+        char c = *m_current;
+        if (c == '{')
+        {
+            m_current++;
+            out->type = json_object;
+            skip_whitespace();
+            if (m_current < m_end && *m_current == '}')
+            {
+                m_current++;
+                return true;
+            }
+
+            while (true)
+            {
+                skip_whitespace();
+                std::pair<std::string, json_value> member;
+                if (!parse_string(&member.first))
+                {
+                    return false;
+                }
+
+                skip_whitespace();
+                if (m_current >= m_end || *m_current != ':')
+                {
+                    return fail("Expected ':' after an object key.");
+                }
+                m_current++;
+
+                if (!parse_value(&member.second, depth + 1))
+                {
+                    return false;
+                }
+                out->object.push_back(std::move(member));
+
+                skip_whitespace();
+                if (m_current < m_end && *m_current == ',')
+                {
+                    m_current++;
+                    continue;
+                }
+                if (m_current < m_end && *m_current == '}')
+                {
+                    m_current++;
+                    return true;
+                }
+                return fail("Expected ',' or '}' in object.");
+            }
+        }
+
+        if (c == '[')
+        {
+            m_current++;
+            out->type = json_array;
+            skip_whitespace();
+            if (m_current < m_end && *m_current == ']')
+            {
+                m_current++;
+                return true;
+            }
+
+            while (true)
+            {
+                out->array.emplace_back();
+                if (!parse_value(&out->array.back(), depth + 1))
+                {
+                    return false;
+                }
+
+                skip_whitespace();
+                if (m_current < m_end && *m_current == ',')
+                {
+                    m_current++;
+                    continue;
+                }
+                if (m_current < m_end && *m_current == ']')
+                {
+                    m_current++;
+                    return true;
+                }
+                return fail("Expected ',' or ']' in array.");
+            }
+        }
+
+        if (c == '"')
+        {
+            out->type = json_string;
+            return parse_string(&out->string);
+        }
+
+        if (match("true"))
+        {
+            out->type = json_bool;
+            out->boolean = true;
+            return true;
+        }
+
+        if (match("false"))
+        {
+            out->type = json_bool;
+            out->boolean = false;
+            return true;
+        }
+
+        if (match("null"))
+        {
+            out->type = json_null;
+            return true;
+        }
+
+        // strtod() needs a null terminated buffer, numbers are short so copy them out.
+        char number[64] = {};
+        size_t length = 0;
+        while (m_current + length < m_end && length < sizeof(number) - 1 &&
+               strchr("+-0123456789.eE", m_current[length]) != nullptr)
+        {
+            number[length] = m_current[length];
+            length++;
+        }
+
+        if (length == 0)
+        {
+            return fail("Unexpected character.");
+        }
+
+        char *number_end = nullptr;
+        out->type = json_number;
+        out->number = strtod(number, &number_end);
+        if (number_end != number + length)
+        {
+            return fail("Invalid number.");
+        }
+        m_current += length;
+        return true;
+    }
+};
+
+const json_value *json_value::find(const char *key) const
+{
+    if (type != json_object)
+    {
+        return nullptr;
+    }
+
+    for (const auto &member : object)
+    {
+        if (member.first == key)
+        {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+double json_value::get_number(const char *key, double fallback) const
+{
+    const json_value *value = find(key);
+    return (value && value->type == json_number) ? value->number : fallback;
+}
+
+std::string json_value::get_string(const char *key, const std::string &fallback) const
+{
+    const json_value *value = find(key);
+    return (value && value->type == json_string) ? value->string : fallback;
+}
+
+bool json_value::get_bool(const char *key, bool fallback) const
+{
+    const json_value *value = find(key);
+    return (value && value->type == json_bool) ? value->boolean : fallback;
+}
+
+bool json_parse(const std::string &text, json_value *out, std::string *error)
+{
+    json_reader reader = {};
+    reader.m_current = text.data();
+    reader.m_end = text.data() + text.size();
+
+    *out = json_value();
+    bool success = reader.parse_value(out, 0);
+    if (success)
+    {
+        reader.skip_whitespace();
+        if (reader.m_current != reader.m_end)
+        {
+            success = reader.fail("Trailing characters after the document.");
+        }
+    }
+
+    if (!success && error)
+    {
+        size_t offset = reader.m_current - text.data();
+        *error = reader.m_error + " (offset " + std::to_string(offset) + ")";
+    }
+    return success;
+}
+
+bool json_parse_file(const char *path, json_value *out, std::string *error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        if (error)
+        {
+            *error = std::string("Could not open ") + path;
+        }
+        return false;
+    }
+
+    std::stringstream stream;
+    stream << file.rdbuf();
+    return json_parse(stream.str(), out, error);
+}
+
+std::string json_escape(const std::string &text)
+{
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '"':
+            escaped += "\\\"";
+            break;
+        case '\\':
+            escaped += "\\\\";
+            break;
+        case '\n':
+            escaped += "\\n";
+            break;
+        case '\r':
+            escaped += "\\r";
+            break;
+        case '\t':
+            escaped += "\\t";
+            break;
+        default:
+            if ((unsigned char)c < 0x20)
+            {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", (unsigned)c);
+                escaped += code;
+            }
+            else
+            {
+                escaped.push_back(c);
+            }
+            break;
+        }
+    }
+    return escaped;
+}
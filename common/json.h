@@ -0,0 +1,47 @@
+#pragma once
+#include "common_api.h"
+#include <string>
+#include <vector>
+#include <utility>
+
+// Minimal JSON reader used by offline tools and saved shader data.
+// Device independent, no platform headers.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+enum json_type
+{
+    json_null,
+    json_bool,
+    json_number,
+    json_string,
+    json_array,
+    json_object
+};
+
+struct COMMON_API json_value
+{
+    json_type type = json_null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<json_value> array;
+    std::vector<std::pair<std::string, json_value>> object;
+
+    // Returns nullptr if this is not an object or the key is missing.
+    const json_value *find(const char *key) const;
+
+    // Typed lookups with a fallback when the key is missing or has the wrong type.
+    double get_number(const char *key, double fallback = 0.0) const;
+    std::string get_string(const char *key, const std::string &fallback = "") const;
+    bool get_bool(const char *key, bool fallback = false) const;
+};
+
+COMMON_API bool json_parse(const std::string &text, json_value *out, std::string *error = nullptr);
+COMMON_API bool json_parse_file(const char *path, json_value *out, std::string *error = nullptr);
+
+// Escapes a string so that it can be written between quotes in a JSON document.
+COMMON_API std::string json_escape(const std::string &text);
+
+#pragma warning(pop)
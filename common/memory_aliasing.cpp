@@ -0,0 +1,189 @@
+#include "memory_aliasing.h"
+#include <algorithm>
+#include <sstream>
+
+static uint64_t align_offset(uint64_t value, uint64_t alignment)
+{
+    if (alignment <= 1)
+    {
+        return value;
+    }
+    return ((value + alignment - 1) / alignment) * alignment;
+}
+
+static bool lifetimes_overlap(const aliasing_request &a, const aliasing_request &b)
+{
+    return a.first_pass <= b.last_pass && b.first_pass <= a.last_pass;
+}
+
+aliasing_plan plan_memory_aliasing(const std::vector<aliasing_request> &requests)
+{
+    aliasing_plan plan;
+    plan.placements.resize(requests.size());
+    plan.is_aliased.assign(requests.size(), false);
+
+    // Largest first, ties are broken by lifetime then by order so that the plan is stable.
+    std::vector<uint32_t> order(requests.size());
+    for (uint32_t i = 0; i < (uint32_t)requests.size(); i++)
+    {
+        order[i] = i;
+        plan.unaliased_size += align_offset(requests[i].size, requests[i].alignment);
+    }
+
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (requests[a].size != requests[b].size)
+        {
+            return requests[a].size > requests[b].size;
+        }
+        if (requests[a].first_pass != requests[b].first_pass)
+        {
+            return requests[a].first_pass < requests[b].first_pass;
+        }
+        return a < b;
+    });
+
+    struct range
+    {
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    std::vector<uint32_t> placed;
+    std::vector<range> busy;
+    for (uint32_t index : order)
+    {
+        const aliasing_request &request = requests[index];
+
+        // One heap per category.
+        uint32_t heap = (uint32_t)plan.heaps.size();
+        for (uint32_t i = 0; i < (uint32_t)plan.heaps.size(); i++)
+        {
+            if (plan.heaps[i].category == request.category)
+            {
+                heap = i;
+                break;
+            }
+        }
+
+        if (heap == plan.heaps.size())
+        {
+            aliasing_heap new_heap = {request.category, 0, 1};
+            plan.heaps.push_back(new_heap);
+        }
+
+        // Memory used by the resources of the heap that are alive at the same time.
+        busy.clear();
+        for (uint32_t other : placed)
+        {
+            if (plan.placements[other].heap == heap && lifetimes_overlap(request, requests[other]))
+            {
+                range r = {plan.placements[other].offset, plan.placements[other].offset + requests[other].size};
+                busy.push_back(r);
+            }
+        }
+
+        std::sort(busy.begin(), busy.end(), [](const range &a, const range &b) { return a.begin < b.begin; });
+
+        // First fit in the gaps between the busy ranges.
+        uint64_t offset = 0;
+        for (const range &r : busy)
+        {
+            if (align_offset(offset, request.alignment) + request.size <= r.begin)
+            {
+                break;
+            }
+            offset = std::max(offset, r.end);
+        }
+        offset = align_offset(offset, request.alignment);
+
+        aliasing_placement placement = {heap, offset};
+        plan.placements[index] = placement;
+        plan.heaps[heap].size = std::max(plan.heaps[heap].size, offset + request.size);
+        plan.heaps[heap].alignment = std::max(plan.heaps[heap].alignment, request.alignment);
+        placed.push_back(index);
+    }
+
+    for (const aliasing_heap &heap : plan.heaps)
+    {
+        plan.aliased_size += align_offset(heap.size, heap.alignment);
+    }
+
+    // A resource needs an aliasing barrier before its first pass if its memory was used by an earlier resource.
+    for (uint32_t i = 0; i < (uint32_t)requests.size(); i++)
+    {
+        const aliasing_placement &a = plan.placements[i];
+        uint32_t before = aliasing_any_resource;
+        uint32_t num_before = 0;
+        for (uint32_t j = 0; j < (uint32_t)requests.size(); j++)
+        {
+            const aliasing_placement &b = plan.placements[j];
+            bool shares_memory = i != j && a.heap == b.heap &&
+                                 a.offset < b.offset + requests[j].size &&
+                                 b.offset < a.offset + requests[i].size;
+            if (!shares_memory)
+            {
+                continue;
+            }
+
+            plan.is_aliased[i] = true;
+            if (requests[j].last_pass < requests[i].first_pass)
+            {
+                before = j;
+                num_before++;
+            }
+        }
+
+        if (num_before > 0)
+        {
+            aliasing_barrier barrier = {requests[i].first_pass, num_before == 1 ? before : aliasing_any_resource, i};
+            plan.barriers.push_back(barrier);
+        }
+    }
+
+    std::stable_sort(plan.barriers.begin(), plan.barriers.end(),
+                     [](const aliasing_barrier &a, const aliasing_barrier &b) { return a.pass < b.pass; });
+    return plan;
+}
+
+static std::string format_size(uint64_t size)
+{
+    std::stringstream stream;
+    stream.precision(2);
+    stream << std::fixed << (double)size / (1024.0 * 1024.0) << " MiB";
+    return stream.str();
+}
+
+std::string aliasing_report(const std::vector<aliasing_request> &requests, const aliasing_plan &plan)
+{
+    std::stringstream stream;
+    for (uint32_t heap = 0; heap < (uint32_t)plan.heaps.size(); heap++)
+    {
+        stream << "Heap " << heap << " (category " << plan.heaps[heap].category << "): "
+               << format_size(plan.heaps[heap].size) << "\n";
+        for (uint32_t i = 0; i < (uint32_t)requests.size(); i++)
+        {
+            if (plan.placements[i].heap != heap)
+            {
+                continue;
+            }
+
+            const aliasing_request &request = requests[i];
+            stream << "    " << request.name << ": offset " << plan.placements[i].offset
+                   << ", " << format_size(request.size)
+                   << ", passes " << request.first_pass << "-" << request.last_pass
+                   << (plan.is_aliased[i] ? ", aliased" : "") << "\n";
+        }
+    }
+
+    for (const aliasing_barrier &barrier : plan.barriers)
+    {
+        stream << "Aliasing barrier before pass " << barrier.pass << ": "
+               << (barrier.before == aliasing_any_resource ? "any" : requests[barrier.before].name)
+               << " -> " << requests[barrier.after].name << "\n";
+    }
+
+    uint64_t saved = plan.unaliased_size > plan.aliased_size ? plan.unaliased_size - plan.aliased_size : 0;
+    stream << "Transient memory: " << format_size(plan.aliased_size) << " instead of "
+           << format_size(plan.unaliased_size) << ", " << format_size(saved) << " of VRAM saved\n";
+    return stream.str();
+}
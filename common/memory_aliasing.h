@@ -0,0 +1,67 @@
+#pragma once
+#include "common_api.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Transient memory aliasing planner.
+// Resources whose lifetimes don't overlap can share the same bytes of a heap. The planner packs them into one heap
+// per category and lists the aliasing barriers needed when a resource takes over memory used by another one.
+// This file is device independent: sizes and alignments come from GetResourceAllocationInfo() and lifetimes are
+// pass indices on a timeline chosen by the caller.
+
+static const uint32_t aliasing_any_resource = 0xffffffff;
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+struct aliasing_request
+{
+    std::string name;
+    uint64_t size;
+    uint64_t alignment;
+    uint32_t first_pass; // First and last pass that use the resource, both inclusive.
+    uint32_t last_pass;
+    uint32_t category; // Resources of different categories never share a heap, e.g. render targets on resource heap tier 1.
+};
+
+struct aliasing_placement
+{
+    uint32_t heap;
+    uint64_t offset;
+};
+
+struct aliasing_heap
+{
+    uint32_t category;
+    uint64_t size;
+    uint64_t alignment;
+};
+
+// The memory of "after" was used by "before" until an earlier pass.
+// before is aliasing_any_resource when several resources used that memory.
+struct aliasing_barrier
+{
+    uint32_t pass;
+    uint32_t before;
+    uint32_t after;
+};
+
+struct aliasing_plan
+{
+    std::vector<aliasing_placement> placements; // One per request, in the same order.
+    std::vector<aliasing_heap> heaps;
+    std::vector<aliasing_barrier> barriers; // Sorted by pass.
+    std::vector<bool> is_aliased;           // True if the request shares memory with another one.
+    uint64_t unaliased_size = 0;            // Total size if every resource had its own allocation.
+    uint64_t aliased_size = 0;              // Total size of the heaps.
+};
+
+// Largest resources are placed first, each one at the lowest offset that doesn't overlap the memory of a resource
+// that is alive at the same time.
+COMMON_API aliasing_plan plan_memory_aliasing(const std::vector<aliasing_request> &requests);
+
+// Human readable placements and the VRAM saved by the plan.
+COMMON_API std::string aliasing_report(const std::vector<aliasing_request> &requests, const aliasing_plan &plan);
+
+#pragma warning(pop)
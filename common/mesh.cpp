@@ -131,10 +131,10 @@ void mesh::from_generator(gpu_interface *gpu,
 
     gpu->default_resource_from_uploader(cmd_list, m_vertices_gpu.GetAddressOf(),
                                         mesh_data->Vertices.data(), vb_byte_size, vertex_stride,
-                                        D3D12_RESOURCE_FLAG_NONE);
+                                        D3D12_RESOURCE_FLAG_NONE, gpu_memory_meshes, "Mesh vertices");
     gpu->default_resource_from_uploader(cmd_list, m_indices_gpu.GetAddressOf(),
                                         mesh_data->GetIndices16().data(), ib_byte_size, index_stride,
-                                        D3D12_RESOURCE_FLAG_NONE);
+                                        D3D12_RESOURCE_FLAG_NONE, gpu_memory_meshes, "Mesh indices");
 
     mesh::submesh submesh = {};
     submesh.index_count = (UINT)mesh_data->Indices32.size();
@@ -170,6 +170,7 @@ void mesh::from_asset(gpu_interface *gpu,
     heap_desc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
     heap_desc.SizeInBytes = all_textures * max_tex_size;
     check_hr(gpu->device->CreateHeap(&heap_desc, IID_PPV_ARGS(&m_texture_heap)));
+    track_gpu_memory(m_texture_heap.Get(), gpu_memory_textures, "Mesh texture heap");
 
     // Import the asset data.
     Assimp::Importer importer;
@@ -250,12 +251,14 @@ void mesh::from_asset(gpu_interface *gpu,
     size_t vertex_stride = sizeof(mesh::vertex);
     size_t vb_byte_size = vertex_stride * total_mesh_vertices.size();
     gpu->default_resource_from_uploader(gpu->get_frame_resource()->cmd_list, m_vertices_gpu.GetAddressOf(),
-                                        total_mesh_vertices.data(), vb_byte_size, vertex_stride);
+                                        total_mesh_vertices.data(), vb_byte_size, vertex_stride,
+                                        D3D12_RESOURCE_FLAG_NONE, gpu_memory_meshes, "Mesh vertices");
 
     size_t index_stride = sizeof(UINT16);
     size_t ib_byte_size = index_stride * total_mesh_indices.size();
     gpu->default_resource_from_uploader(gpu->get_frame_resource()->cmd_list, m_indices_gpu.GetAddressOf(),
-                                        total_mesh_indices.data(), ib_byte_size, index_stride);
+                                        total_mesh_indices.data(), ib_byte_size, index_stride,
+                                        D3D12_RESOURCE_FLAG_NONE, gpu_memory_meshes, "Mesh indices");
 
     m_vbv.BufferLocation = m_vertices_gpu->GetGPUVirtualAddress();
     m_vbv.SizeInBytes = (UINT)vb_byte_size;
@@ -82,10 +82,12 @@ struct mesh
     };
     std::vector<asset_data> found_asset_data;
 
+    // Vertices, indices and texture paths of an imported mesh. Exported for the benchmarks.
+    COMMON_API asset_data process_mesh(aiMesh *mesh, const aiScene *scene);
+
 private:
     void process_node(aiNode *node,
                       const aiScene *scene,
                       const std::vector<std::string> &mesh_ignore_list);
-    asset_data process_mesh(aiMesh *mesh, const aiScene *scene);
     inline std::string load_material_textures(aiTextureType type, const aiMaterial *material);
 };
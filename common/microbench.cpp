@@ -0,0 +1,512 @@
+#include "microbench.h"
+#include "json.h"
+#include "platform.h"
+#include <algorithm>
+#include <math.h>
+#include <regex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <time.h>
+
+struct microbench_entry
+{
+    std::string name;
+    microbench_function function;
+    std::vector<std::vector<int64_t>> args;
+};
+
+// Filled by the static initializers of the benchmark files, before main().
+static std::vector<microbench_entry> &microbench_registry()
+{
+    static std::vector<microbench_entry> registry;
+    return registry;
+}
+
+static const uint64_t max_microbench_iterations = 1000000000;
+
+microbench_state::microbench_state(uint64_t max_iterations, const std::vector<int64_t> &args)
+    : m_max_iterations(max_iterations), m_args(args)
+{
+}
+
+microbench_state::iterator microbench_state::begin()
+{
+    if (is_error())
+    {
+        return {this, 0};
+    }
+    resume_timing();
+    return {this, m_max_iterations};
+}
+
+void microbench_state::pause_timing()
+{
+    if (m_is_running)
+    {
+        m_real_ms += ticks_to_ms(clock_ticks() - m_start_ticks);
+        m_cpu_ms += thread_cpu_ms() - m_start_cpu_ms;
+        m_is_running = false;
+    }
+}
+
+void microbench_state::resume_timing()
+{
+    if (!m_is_running)
+    {
+        m_is_running = true;
+        m_start_cpu_ms = thread_cpu_ms();
+        m_start_ticks = clock_ticks();
+    }
+}
+
+void microbench_state::skip_with_error(const char *message)
+{
+    pause_timing();
+    m_error = message;
+}
+
+void microbench_state::finish()
+{
+    pause_timing();
+}
+
+static const void *volatile g_microbench_sink = nullptr;
+
+void microbench_escape(const void *pointer)
+{
+    g_microbench_sink = pointer;
+}
+
+int register_microbench(const char *name, microbench_function function, std::vector<std::vector<int64_t>> args)
+{
+    std::vector<microbench_entry> &registry = microbench_registry();
+    registry.push_back({name, function, std::move(args)});
+    return (int)registry.size() - 1;
+}
+
+struct microbench_run
+{
+    std::string name;
+    const microbench_entry *entry;
+    std::vector<int64_t> args;
+};
+
+static std::vector<microbench_run> matching_runs(const std::string &filter)
+{
+    std::regex pattern(filter.empty() ? std::string(".") : filter);
+    std::vector<microbench_run> runs;
+    for (const microbench_entry &entry : microbench_registry())
+    {
+        std::vector<std::vector<int64_t>> args = entry.args;
+        if (args.empty())
+        {
+            args.push_back({});
+        }
+        for (const std::vector<int64_t> &run_args : args)
+        {
+            std::string name = entry.name;
+            for (int64_t arg : run_args)
+            {
+                name += "/" + std::to_string(arg);
+            }
+            if (std::regex_search(name, pattern))
+            {
+                runs.push_back({name, &entry, run_args});
+            }
+        }
+    }
+    return runs;
+}
+
+std::vector<std::string> list_microbenches(const std::string &filter)
+{
+    std::vector<std::string> names;
+    for (const microbench_run &run : matching_runs(filter))
+    {
+        names.push_back(run.name);
+    }
+    return names;
+}
+
+static microbench_result run_once(const microbench_run &run, uint64_t iterations)
+{
+    microbench_state state(iterations, run.args);
+    run.entry->function(state);
+
+    microbench_result result;
+    result.name = run.name;
+    result.run_name = run.name;
+    result.iterations = iterations;
+    result.real_ns = state.real_ms() * 1000000.0 / (double)iterations;
+    result.cpu_ns = state.cpu_ms() * 1000000.0 / (double)iterations;
+    double seconds = state.real_ms() / 1000.0;
+    if (seconds > 0.0)
+    {
+        result.items_per_second = (double)state.items() / seconds;
+        result.bytes_per_second = (double)state.bytes() / seconds;
+    }
+    result.label = state.label();
+    result.error = state.error();
+    return result;
+}
+
+static microbench_result aggregate_of(const std::vector<microbench_result> &repetitions, const char *aggregate)
+{
+    microbench_result result = repetitions[0];
+    result.name = result.run_name + "_" + aggregate;
+    result.aggregate = aggregate;
+    result.repetition_index = 0;
+
+    auto reduce = [&](double microbench_result::*field) {
+        size_t count = repetitions.size();
+        std::vector<double> values;
+        for (const microbench_result &repetition : repetitions)
+        {
+            values.push_back(repetition.*field);
+        }
+        double mean = 0.0;
+        for (double value : values)
+        {
+            mean += value;
+        }
+        mean /= (double)count;
+        if (strcmp(aggregate, "mean") == 0)
+        {
+            return mean;
+        }
+        if (strcmp(aggregate, "median") == 0)
+        {
+            std::sort(values.begin(), values.end());
+            return count % 2 == 1 ? values[count / 2] : 0.5 * (values[count / 2 - 1] + values[count / 2]);
+        }
+        double sum_squares = 0.0;
+        for (double value : values)
+        {
+            sum_squares += (value - mean) * (value - mean);
+        }
+        return count > 1 ? sqrt(sum_squares / (double)(count - 1)) : 0.0;
+    };
+    result.real_ns = reduce(&microbench_result::real_ns);
+    result.cpu_ns = reduce(&microbench_result::cpu_ns);
+    result.items_per_second = reduce(&microbench_result::items_per_second);
+    result.bytes_per_second = reduce(&microbench_result::bytes_per_second);
+    return result;
+}
+
+std::vector<microbench_result> run_microbenches(const microbench_options &options, bool print_progress)
+{
+    std::vector<microbench_result> results;
+    double min_time_ms = (std::max)(options.min_time_s, 0.0) * 1000.0;
+    uint32_t num_repetitions = (std::max)(options.repetitions, 1u);
+
+    for (const microbench_run &run : matching_runs(options.filter))
+    {
+        if (print_progress)
+        {
+            fprintf(stderr, "%s\n", run.name.c_str());
+        }
+
+        // Grow the iterations until a run lasts min_time, that run is the first repetition.
+        uint64_t iterations = 1;
+        microbench_result first = run_once(run, iterations);
+        double run_ms = first.real_ns * (double)iterations / 1000000.0;
+        while (first.error.empty() && run_ms < min_time_ms && iterations < max_microbench_iterations)
+        {
+            double multiplier = run_ms > 0.0 ? 1.4 * min_time_ms / run_ms : 10.0;
+            multiplier = (std::min)(multiplier, 10.0);
+            iterations = (std::min)((uint64_t)((double)iterations * multiplier) + 1, max_microbench_iterations);
+            first = run_once(run, iterations);
+            run_ms = first.real_ns * (double)iterations / 1000000.0;
+        }
+
+        std::vector<microbench_result> repetitions = {first};
+        for (uint32_t i = 1; i < num_repetitions && first.error.empty(); i++)
+        {
+            repetitions.push_back(run_once(run, iterations));
+            repetitions.back().repetition_index = i;
+        }
+        for (microbench_result &repetition : repetitions)
+        {
+            repetition.repetitions = num_repetitions;
+        }
+
+        if (!options.is_aggregates_only || num_repetitions == 1 || !first.error.empty())
+        {
+            results.insert(results.end(), repetitions.begin(), repetitions.end());
+        }
+        if (num_repetitions > 1 && first.error.empty())
+        {
+            results.push_back(aggregate_of(repetitions, "mean"));
+            results.push_back(aggregate_of(repetitions, "median"));
+            results.push_back(aggregate_of(repetitions, "stddev"));
+        }
+    }
+    return results;
+}
+
+static std::string format_time(double ns)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.*f ns", ns < 10.0 ? 3 : ns < 100.0 ? 2 : ns < 1000.0 ? 1 : 0, ns);
+    return text;
+}
+
+static std::string format_rate(double value, const char *unit)
+{
+    const char *prefixes[] = {"", "k", "M", "G", "T"};
+    int prefix = 0;
+    while (value >= 1000.0 && prefix < 4)
+    {
+        value /= 1000.0;
+        prefix++;
+    }
+    char text[64];
+    snprintf(text, sizeof(text), "%.4g%s%s/s", value, prefixes[prefix], unit);
+    return text;
+}
+
+std::string microbench_to_table(const std::vector<microbench_result> &results)
+{
+    size_t name_width = 10;
+    for (const microbench_result &result : results)
+    {
+        name_width = (std::max)(name_width, result.name.size());
+    }
+
+    std::string table;
+    char line[512];
+    snprintf(line, sizeof(line), "%-*s %15s %15s %12s\n", (int)name_width, "Benchmark", "Time", "CPU", "Iterations");
+    table += line;
+    table += std::string(name_width + 45, '-') + "\n";
+    for (const microbench_result &result : results)
+    {
+        if (!result.error.empty())
+        {
+            snprintf(line, sizeof(line), "%-*s ERROR: %s\n", (int)name_width, result.name.c_str(), result.error.c_str());
+            table += line;
+            continue;
+        }
+        std::string iterations = result.aggregate.empty() ? std::to_string(result.iterations) : "";
+        snprintf(line, sizeof(line), "%-*s %15s %15s %12s", (int)name_width, result.name.c_str(),
+                 format_time(result.real_ns).c_str(), format_time(result.cpu_ns).c_str(), iterations.c_str());
+        table += line;
+        if (result.items_per_second > 0.0)
+        {
+            table += " items_per_second=" + format_rate(result.items_per_second, "");
+        }
+        if (result.bytes_per_second > 0.0)
+        {
+            table += " bytes_per_second=" + format_rate(result.bytes_per_second, "B");
+        }
+        if (!result.label.empty())
+        {
+            table += " " + result.label;
+        }
+        table += "\n";
+    }
+    return table;
+}
+
+static std::string json_number_text(double value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.17g", isfinite(value) ? value : 0.0);
+    return text;
+}
+
+std::string microbench_to_json(const std::vector<microbench_result> &results, const char *executable)
+{
+    char date[64] = "";
+    time_t now = time(nullptr);
+    tm *local = localtime(&now);
+    if (local != nullptr)
+    {
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", local);
+    }
+
+    std::string json = "{\n  \"context\": {\n";
+    json += "    \"date\": \"" + std::string(date) + "\",\n";
+    json += "    \"executable\": \"" + json_escape(executable) + "\",\n";
+    json += "    \"num_cpus\": " + std::to_string(std::thread::hardware_concurrency()) + ",\n";
+    json += "    \"mhz_per_cpu\": " + std::to_string((int64_t)(calibrated_tsc().frequency / 1000000.0)) + ",\n";
+#ifdef NDEBUG
+    json += "    \"library_build_type\": \"release\"\n";
+#else
+    json += "    \"library_build_type\": \"debug\"\n";
+#endif
+    json += "  },\n  \"benchmarks\": [";
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const microbench_result &result = results[i];
+        json += i == 0 ? "\n" : ",\n";
+        json += "    {\n";
+        json += "      \"name\": \"" + json_escape(result.name) + "\",\n";
+        json += "      \"run_name\": \"" + json_escape(result.run_name) + "\",\n";
+        if (result.aggregate.empty())
+        {
+            json += "      \"run_type\": \"iteration\",\n";
+        }
+        else
+        {
+            json += "      \"run_type\": \"aggregate\",\n";
+            json += "      \"aggregate_name\": \"" + result.aggregate + "\",\n";
+        }
+        json += "      \"repetitions\": " + std::to_string(result.repetitions) + ",\n";
+        json += "      \"repetition_index\": " + std::to_string(result.repetition_index) + ",\n";
+        json += "      \"threads\": 1,\n";
+        if (!result.error.empty())
+        {
+            json += "      \"error_occurred\": true,\n";
+            json += "      \"error_message\": \"" + json_escape(result.error) + "\",\n";
+        }
+        json += "      \"iterations\": " + std::to_string(result.iterations) + ",\n";
+        json += "      \"real_time\": " + json_number_text(result.real_ns) + ",\n";
+        json += "      \"cpu_time\": " + json_number_text(result.cpu_ns) + ",\n";
+        json += "      \"time_unit\": \"ns\"";
+        if (result.items_per_second > 0.0)
+        {
+            json += ",\n      \"items_per_second\": " + json_number_text(result.items_per_second);
+        }
+        if (result.bytes_per_second > 0.0)
+        {
+            json += ",\n      \"bytes_per_second\": " + json_number_text(result.bytes_per_second);
+        }
+        if (!result.label.empty())
+        {
+            json += ",\n      \"label\": \"" + json_escape(result.label) + "\"";
+        }
+        json += "\n    }";
+    }
+    json += "\n  ]\n}\n";
+    return json;
+}
+
+static bool parse_flag(const char *arg, const char *flag, std::string *value)
+{
+    size_t length = strlen(flag);
+    if (strncmp(arg, flag, length) != 0)
+    {
+        return false;
+    }
+    if (arg[length] == '\0')
+    {
+        // A boolean flag without a value.
+        *value = "true";
+        return true;
+    }
+    if (arg[length] != '=')
+    {
+        return false;
+    }
+    *value = arg + length + 1;
+    return true;
+}
+
+static bool is_true(const std::string &value)
+{
+    return value == "true" || value == "1" || value == "yes";
+}
+
+static int print_microbench_usage(const char *executable)
+{
+    fprintf(stderr,
+            "usage: %s [--benchmark_filter=<regex>] [--benchmark_min_time=<seconds>]\n"
+            "          [--benchmark_repetitions=<n>] [--benchmark_report_aggregates_only=<true|false>]\n"
+            "          [--benchmark_format=<console|json>] [--benchmark_out=<file>]\n"
+            "          [--benchmark_out_format=<console|json>] [--benchmark_list_tests=<true|false>]\n",
+            executable);
+    return 1;
+}
+
+int microbench_main(int argc, char **argv)
+{
+    microbench_options options;
+    std::string format = "console";
+    std::string out_path;
+    std::string out_format = "json";
+    bool is_listing = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string value;
+        if (parse_flag(argv[i], "--benchmark_filter", &value))
+        {
+            options.filter = value;
+        }
+        else if (parse_flag(argv[i], "--benchmark_min_time", &value))
+        {
+            // Google Benchmark accepts a trailing s.
+            options.min_time_s = atof(value.c_str());
+        }
+        else if (parse_flag(argv[i], "--benchmark_repetitions", &value))
+        {
+            options.repetitions = (uint32_t)(std::max)(atoi(value.c_str()), 1);
+        }
+        else if (parse_flag(argv[i], "--benchmark_report_aggregates_only", &value))
+        {
+            options.is_aggregates_only = is_true(value);
+        }
+        else if (parse_flag(argv[i], "--benchmark_format", &value))
+        {
+            format = value;
+        }
+        else if (parse_flag(argv[i], "--benchmark_out_format", &value))
+        {
+            out_format = value;
+        }
+        else if (parse_flag(argv[i], "--benchmark_out", &value))
+        {
+            out_path = value;
+        }
+        else if (parse_flag(argv[i], "--benchmark_list_tests", &value))
+        {
+            is_listing = is_true(value);
+        }
+        else
+        {
+            return print_microbench_usage(argv[0]);
+        }
+    }
+    if ((format != "console" && format != "json") || (out_format != "console" && out_format != "json"))
+    {
+        return print_microbench_usage(argv[0]);
+    }
+
+    try
+    {
+        if (is_listing)
+        {
+            for (const std::string &name : list_microbenches(options.filter))
+            {
+                printf("%s\n", name.c_str());
+            }
+            return 0;
+        }
+
+        std::vector<microbench_result> results = run_microbenches(options, format == "console");
+        std::string text = format == "json" ? microbench_to_json(results, argv[0]) : microbench_to_table(results);
+        fputs(text.c_str(), stdout);
+
+        if (!out_path.empty())
+        {
+            FILE *file = fopen(out_path.c_str(), "wb");
+            if (file == nullptr)
+            {
+                fprintf(stderr, "Cannot write %s\n", out_path.c_str());
+                return 1;
+            }
+            std::string out = out_format == "json" ? microbench_to_json(results, argv[0]) : microbench_to_table(results);
+            fwrite(out.data(), 1, out.size(), file);
+            fclose(file);
+        }
+    }
+    catch (const std::regex_error &error)
+    {
+        fprintf(stderr, "Invalid --benchmark_filter: %s\n", error.what());
+        return 1;
+    }
+    return 0;
+}
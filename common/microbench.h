@@ -0,0 +1,154 @@
+#pragma once
+#include "common_api.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Small benchmark harness in the style of Google Benchmark, for the CPU hot paths.
+// A benchmark is a function that loops over its state, for (auto _ : state) { ... }, and is registered with
+// MICROBENCH() or MICROBENCH_ARGS(). The runner calls it with a growing number of iterations until a run lasts
+// min_time, then reports the time per iteration, in wall time and in CPU time of the thread. Each repetition is
+// a run of that many iterations, the mean, median and standard deviation are added when there are several.
+// The results are printed as a table or written as JSON with the layout of Google Benchmark
+// (--benchmark_format=json), so the tools that read one read the other.
+// The work of the loop has to stay observable, pass its results to do_not_optimize() or the compiler removes it.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+class COMMON_API microbench_state
+{
+public:
+    microbench_state(uint64_t max_iterations, const std::vector<int64_t> &args);
+    ~microbench_state() = default;
+
+    // Iterations of the range-for loop, the timer runs between begin() and the end of the loop.
+    struct [[maybe_unused]] iteration
+    {
+    };
+    struct iterator
+    {
+        microbench_state *state;
+        uint64_t remaining;
+
+        bool operator!=(const iterator &) const
+        {
+            if (remaining != 0)
+            {
+                return true;
+            }
+            state->finish();
+            return false;
+        }
+        iterator &operator++()
+        {
+            --remaining;
+            return *this;
+        }
+        iteration operator*() const { return {}; }
+    };
+    iterator begin();
+    iterator end() { return {this, 0}; }
+
+    // Arguments of the run, see MICROBENCH_ARGS().
+    int64_t range(size_t index = 0) const { return index < m_args.size() ? m_args[index] : 0; }
+    uint64_t iterations() const { return m_max_iterations; }
+
+    // Excludes the setup done inside the loop from the times.
+    void pause_timing();
+    void resume_timing();
+
+    // Over the whole run, reported per second.
+    void set_items_processed(int64_t items) { m_items = items; }
+    void set_bytes_processed(int64_t bytes) { m_bytes = bytes; }
+    void set_label(const std::string &label) { m_label = label; }
+
+    // Ends the benchmark with an error, the loop runs no iteration when it is called before it.
+    void skip_with_error(const char *message);
+
+    bool is_error() const { return !m_error.empty(); }
+    double real_ms() const { return m_real_ms; }
+    double cpu_ms() const { return m_cpu_ms; }
+    int64_t items() const { return m_items; }
+    int64_t bytes() const { return m_bytes; }
+    const std::string &label() const { return m_label; }
+    const std::string &error() const { return m_error; }
+
+private:
+    void finish();
+
+    uint64_t m_max_iterations;
+    std::vector<int64_t> m_args;
+    bool m_is_running = false;
+    uint64_t m_start_ticks = 0;
+    double m_start_cpu_ms = 0.0;
+    double m_real_ms = 0.0;
+    double m_cpu_ms = 0.0;
+    int64_t m_items = 0;
+    int64_t m_bytes = 0;
+    std::string m_label;
+    std::string m_error;
+};
+
+// Keeps a value alive and makes the compiler assume that memory is read and written.
+COMMON_API void microbench_escape(const void *pointer);
+
+template <typename T>
+inline void do_not_optimize(const T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "m"(value) : "memory");
+#else
+    // A call into the DLL, the compiler cannot see through it.
+    microbench_escape(&value);
+#endif
+}
+
+typedef void (*microbench_function)(microbench_state &state);
+
+// One run per set of arguments, named name/arg0/arg1... Returns the index of the benchmark.
+COMMON_API int register_microbench(const char *name, microbench_function function,
+                                   std::vector<std::vector<int64_t>> args = {});
+
+#define MICROBENCH(function) static int microbench_##function = register_microbench(#function, function)
+#define MICROBENCH_ARGS(function, ...) \
+    static int microbench_##function = register_microbench(#function, function, {__VA_ARGS__})
+
+struct microbench_result
+{
+    std::string name;      // With the aggregate suffix, e.g. bm_align_up_mean.
+    std::string run_name;  // Without it.
+    std::string aggregate; // Empty for a repetition, "mean", "median" or "stddev".
+    uint32_t repetitions = 1;
+    uint32_t repetition_index = 0;
+    uint64_t iterations = 0;
+    double real_ns = 0.0; // Per iteration.
+    double cpu_ns = 0.0;
+    double items_per_second = 0.0;
+    double bytes_per_second = 0.0;
+    std::string label;
+    std::string error;
+};
+
+struct microbench_options
+{
+    std::string filter;          // ECMAScript regex searched in the run names, all of them when empty.
+    double min_time_s = 0.5;     // Of a repetition.
+    uint32_t repetitions = 1;
+    bool is_aggregates_only = false;
+};
+
+COMMON_API std::vector<std::string> list_microbenches(const std::string &filter = "");
+COMMON_API std::vector<microbench_result> run_microbenches(const microbench_options &options,
+                                                           bool print_progress = false);
+
+COMMON_API std::string microbench_to_table(const std::vector<microbench_result> &results);
+COMMON_API std::string microbench_to_json(const std::vector<microbench_result> &results, const char *executable = "");
+
+// Command line of a benchmark executable, with the flags of Google Benchmark:
+//   --benchmark_filter=<regex> --benchmark_min_time=<seconds> --benchmark_repetitions=<n>
+//   --benchmark_report_aggregates_only=<true|false> --benchmark_format=<console|json>
+//   --benchmark_out=<file> --benchmark_out_format=<console|json> --benchmark_list_tests=<true|false>
+COMMON_API int microbench_main(int argc, char **argv);
+
+#pragma warning(pop)
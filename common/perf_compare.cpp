@@ -0,0 +1,503 @@
+#include "perf_compare.h"
+#include "json.h"
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <regex>
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+
+// Series of a run by name, in the order they are first seen.
+struct series_builder
+{
+    std::vector<perf_series> *series;
+    std::unordered_map<std::string, size_t> indices;
+
+    perf_series *get(const std::string &name, const char *unit)
+    {
+        auto found = indices.find(name);
+        if (found != indices.end())
+        {
+            return &(*series)[found->second];
+        }
+        indices[name] = series->size();
+        series->push_back({name, unit, {}});
+        return &series->back();
+    }
+};
+
+static double ns_per_unit(const std::string &unit)
+{
+    if (unit == "us")
+    {
+        return 1000.0;
+    }
+    if (unit == "ms")
+    {
+        return 1000000.0;
+    }
+    if (unit == "s")
+    {
+        return 1000000000.0;
+    }
+    return 1.0;
+}
+
+static void load_benchmarks(const json_value &benchmarks, bool is_cpu_time, std::vector<perf_series> *series)
+{
+    const char *time_key = is_cpu_time ? "cpu_time" : "real_time";
+    series_builder builder = {series, {}};
+    std::vector<std::pair<std::string, double>> means;
+    for (const json_value &benchmark : benchmarks.array)
+    {
+        if (benchmark.type != json_object || benchmark.get_bool("error_occurred") || benchmark.find(time_key) == nullptr)
+        {
+            continue;
+        }
+        std::string name = benchmark.get_string("run_name", benchmark.get_string("name"));
+        double value = benchmark.get_number(time_key) * ns_per_unit(benchmark.get_string("time_unit", "ns"));
+        std::string run_type = benchmark.get_string("run_type", "iteration");
+        if (run_type == "iteration")
+        {
+            builder.get(name, "ns")->samples.push_back(value);
+        }
+        else if (run_type == "aggregate" && benchmark.get_string("aggregate_name") == "mean")
+        {
+            means.push_back({name, value});
+        }
+    }
+    for (const std::pair<std::string, double> &mean : means)
+    {
+        if (builder.indices.find(mean.first) == builder.indices.end())
+        {
+            builder.get(mean.first, "ns")->samples.push_back(mean.second);
+        }
+    }
+}
+
+static void add_intervals(std::vector<double> times_us, perf_series *series)
+{
+    std::sort(times_us.begin(), times_us.end());
+    for (size_t i = 1; i < times_us.size(); i++)
+    {
+        series->samples.push_back((times_us[i] - times_us[i - 1]) / 1000.0);
+    }
+}
+
+static void load_trace(const json_value &events, std::vector<perf_series> *series)
+{
+    series_builder builder = {series, {}};
+    std::vector<double> frame_starts_us;
+    std::vector<double> presents_us;
+    for (const json_value &event : events.array)
+    {
+        if (event.type != json_object)
+        {
+            continue;
+        }
+        std::string phase = event.get_string("ph");
+        std::string name = event.get_string("name");
+        if (phase == "X")
+        {
+            // Process 2 is the GPU, see trace_capture::to_chrome_json().
+            bool is_gpu = event.get_string("cat") == "gpu" || event.get_number("pid") == 2.0;
+            builder.get((is_gpu ? "GPU " : "CPU ") + name, "ms")->samples.push_back(event.get_number("dur") / 1000.0);
+        }
+        else if (phase == "i" || phase == "I")
+        {
+            if (name == "Present")
+            {
+                presents_us.push_back(event.get_number("ts"));
+            }
+            else if (name.compare(0, 6, "Frame ") == 0)
+            {
+                frame_starts_us.push_back(event.get_number("ts"));
+            }
+        }
+    }
+    if (frame_starts_us.size() > 1)
+    {
+        add_intervals(frame_starts_us, builder.get("Frame interval", "ms"));
+    }
+    if (presents_us.size() > 1)
+    {
+        add_intervals(presents_us, builder.get("Present interval", "ms"));
+    }
+}
+
+bool load_perf_series(const char *path, std::vector<perf_series> *series, bool is_cpu_time, std::string *error)
+{
+    json_value root;
+    if (!json_parse_file(path, &root, error))
+    {
+        return false;
+    }
+
+    series->clear();
+    const json_value *benchmarks = root.find("benchmarks");
+    const json_value *events = root.type == json_array ? &root : root.find("traceEvents");
+    if (benchmarks != nullptr && benchmarks->type == json_array)
+    {
+        load_benchmarks(*benchmarks, is_cpu_time, series);
+    }
+    else if (events != nullptr && events->type == json_array)
+    {
+        load_trace(*events, series);
+    }
+    else
+    {
+        if (error)
+        {
+            *error = std::string(path) + " is neither a benchmark file nor a trace";
+        }
+        return false;
+    }
+    return true;
+}
+
+const char *compare_verdict_name(compare_verdict verdict)
+{
+    switch (verdict)
+    {
+    case compare_same:
+        return "same";
+    case compare_faster:
+        return "faster";
+    case compare_slower:
+        return "slower";
+    default:
+        return "unknown";
+    }
+}
+
+double median_of(std::vector<double> values)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+    size_t middle = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + middle, values.end());
+    double upper = values[middle];
+    if (values.size() % 2 == 1)
+    {
+        return upper;
+    }
+    double lower = *std::max_element(values.begin(), values.begin() + middle);
+    return 0.5 * (lower + upper);
+}
+
+// Samples up to this size without ties use the exact distribution of U.
+static const size_t max_exact_u_size = 20;
+
+// Probability of each value of U for samples of sizes n1 and n2 under the null hypothesis.
+// The number of orderings with U = u follows count(i, j, u) = count(i - 1, j, u - j) + count(i, j - 1, u).
+static std::vector<double> exact_u_distribution(size_t n1, size_t n2)
+{
+    size_t max_u = n1 * n2;
+    std::vector<std::vector<std::vector<double>>> counts(n1 + 1, std::vector<std::vector<double>>(n2 + 1));
+    for (size_t i = 0; i <= n1; i++)
+    {
+        for (size_t j = 0; j <= n2; j++)
+        {
+            std::vector<double> &count = counts[i][j];
+            count.assign(i * j + 1, 0.0);
+            if (i == 0 || j == 0)
+            {
+                count[0] = 1.0;
+                continue;
+            }
+            for (size_t u = 0; u <= i * j; u++)
+            {
+                if (u >= j && u - j < counts[i - 1][j].size())
+                {
+                    count[u] += counts[i - 1][j][u - j];
+                }
+                if (u < counts[i][j - 1].size())
+                {
+                    count[u] += counts[i][j - 1][u];
+                }
+            }
+        }
+    }
+
+    std::vector<double> distribution = counts[n1][n2];
+    double total = 0.0;
+    for (double count : distribution)
+    {
+        total += count;
+    }
+    for (size_t u = 0; u <= max_u; u++)
+    {
+        distribution[u] /= total;
+    }
+    return distribution;
+}
+
+double mann_whitney_p(const std::vector<double> &a, const std::vector<double> &b)
+{
+    size_t n1 = a.size();
+    size_t n2 = b.size();
+    if (n1 == 0 || n2 == 0)
+    {
+        return 1.0;
+    }
+
+    // Ranks of the pooled samples, ties get the mean of their ranks.
+    std::vector<std::pair<double, bool>> pooled;
+    pooled.reserve(n1 + n2);
+    for (double value : a)
+    {
+        pooled.push_back({value, true});
+    }
+    for (double value : b)
+    {
+        pooled.push_back({value, false});
+    }
+    std::sort(pooled.begin(), pooled.end(), [](const std::pair<double, bool> &x, const std::pair<double, bool> &y) { return x.first < y.first; });
+
+    double rank_sum = 0.0;
+    double tie_term = 0.0;
+    size_t n = pooled.size();
+    for (size_t first = 0; first < n;)
+    {
+        size_t last = first;
+        while (last + 1 < n && pooled[last + 1].first == pooled[first].first)
+        {
+            last++;
+        }
+        double rank = 0.5 * (double)(first + last) + 1.0;
+        for (size_t i = first; i <= last; i++)
+        {
+            rank_sum += pooled[i].second ? rank : 0.0;
+        }
+        double tied = (double)(last - first + 1);
+        tie_term += tied * tied * tied - tied;
+        first = last + 1;
+    }
+    double u = rank_sum - (double)(n1 * (n1 + 1)) / 2.0;
+
+    if (tie_term == 0.0 && n1 <= max_exact_u_size && n2 <= max_exact_u_size)
+    {
+        std::vector<double> distribution = exact_u_distribution(n1, n2);
+        size_t observed = (size_t)llround(u);
+        double lower = 0.0;
+        double upper = 0.0;
+        for (size_t i = 0; i < distribution.size(); i++)
+        {
+            lower += i <= observed ? distribution[i] : 0.0;
+            upper += i >= observed ? distribution[i] : 0.0;
+        }
+        return (std::min)(1.0, 2.0 * (std::min)(lower, upper));
+    }
+
+    // Normal approximation with the tie and continuity corrections.
+    double mean = (double)(n1 * n2) / 2.0;
+    double variance = (double)(n1 * n2) / 12.0 * ((double)(n + 1) - tie_term / (double)(n * (n - 1)));
+    if (variance <= 0.0)
+    {
+        return 1.0;
+    }
+    double z = (std::max)(fabs(u - mean) - 0.5, 0.0) / sqrt(variance);
+    return erfc(z / sqrt(2.0));
+}
+
+series_comparison compare_samples(const std::vector<double> &baseline, const std::vector<double> &candidate,
+                                  const compare_options &options)
+{
+    series_comparison comparison;
+    comparison.baseline_count = (uint32_t)baseline.size();
+    comparison.candidate_count = (uint32_t)candidate.size();
+    comparison.baseline_median = median_of(baseline);
+    comparison.candidate_median = median_of(candidate);
+    if (baseline.empty() || candidate.empty() || comparison.baseline_median <= 0.0)
+    {
+        return comparison;
+    }
+    comparison.delta = comparison.candidate_median / comparison.baseline_median - 1.0;
+    comparison.delta_low = comparison.delta;
+    comparison.delta_high = comparison.delta;
+    if (baseline.size() < 2 || candidate.size() < 2)
+    {
+        return comparison;
+    }
+
+    // Percentile bootstrap of the ratio of the medians.
+    std::mt19937_64 rng(options.seed);
+    std::uniform_int_distribution<size_t> pick_baseline(0, baseline.size() - 1);
+    std::uniform_int_distribution<size_t> pick_candidate(0, candidate.size() - 1);
+    std::vector<double> resampled_baseline(baseline.size());
+    std::vector<double> resampled_candidate(candidate.size());
+    std::vector<double> deltas;
+    deltas.reserve(options.num_resamples);
+    for (uint32_t i = 0; i < options.num_resamples; i++)
+    {
+        for (double &value : resampled_baseline)
+        {
+            value = baseline[pick_baseline(rng)];
+        }
+        for (double &value : resampled_candidate)
+        {
+            value = candidate[pick_candidate(rng)];
+        }
+        double baseline_median = median_of(resampled_baseline);
+        if (baseline_median > 0.0)
+        {
+            deltas.push_back(median_of(resampled_candidate) / baseline_median - 1.0);
+        }
+    }
+    if (!deltas.empty())
+    {
+        std::sort(deltas.begin(), deltas.end());
+        double tail = (1.0 - options.confidence) / 2.0;
+        size_t last = deltas.size() - 1;
+        comparison.delta_low = deltas[(size_t)floor(tail * (double)last)];
+        comparison.delta_high = deltas[(size_t)ceil((1.0 - tail) * (double)last)];
+    }
+
+    comparison.p_value = mann_whitney_p(baseline, candidate);
+    bool is_significant = comparison.p_value < options.alpha;
+    if (is_significant && comparison.delta >= options.threshold)
+    {
+        comparison.verdict = compare_slower;
+    }
+    else if (is_significant && comparison.delta <= -options.threshold)
+    {
+        comparison.verdict = compare_faster;
+    }
+    else if (comparison.delta_low > -options.threshold && comparison.delta_high < options.threshold)
+    {
+        comparison.verdict = compare_same;
+    }
+    return comparison;
+}
+
+run_comparison compare_runs(const std::vector<perf_series> &baseline, const std::vector<perf_series> &candidate,
+                            const compare_options &options, const std::string &filter)
+{
+    std::regex pattern(filter.empty() ? std::string(".") : filter);
+    std::unordered_map<std::string, const perf_series *> candidates;
+    for (const perf_series &series : candidate)
+    {
+        candidates[series.name] = &series;
+    }
+
+    run_comparison comparison;
+    double log_ratio_sum = 0.0;
+    uint32_t num_ratios = 0;
+    std::unordered_map<std::string, bool> is_in_baseline;
+    for (const perf_series &series : baseline)
+    {
+        is_in_baseline[series.name] = true;
+        if (!std::regex_search(series.name, pattern))
+        {
+            continue;
+        }
+        auto found = candidates.find(series.name);
+        if (found == candidates.end())
+        {
+            comparison.only_in_baseline.push_back(series.name);
+            continue;
+        }
+
+        series_comparison result = compare_samples(series.samples, found->second->samples, options);
+        result.name = series.name;
+        result.unit = series.unit;
+        comparison.series.push_back(result);
+        switch (result.verdict)
+        {
+        case compare_slower:
+            comparison.num_slower++;
+            break;
+        case compare_faster:
+            comparison.num_faster++;
+            break;
+        case compare_same:
+            comparison.num_same++;
+            break;
+        default:
+            comparison.num_unknown++;
+            break;
+        }
+        if (result.baseline_median > 0.0 && result.candidate_median > 0.0)
+        {
+            log_ratio_sum += log(result.candidate_median / result.baseline_median);
+            num_ratios++;
+        }
+    }
+    for (const perf_series &series : candidate)
+    {
+        if (is_in_baseline.find(series.name) == is_in_baseline.end() && std::regex_search(series.name, pattern))
+        {
+            comparison.only_in_candidate.push_back(series.name);
+        }
+    }
+    comparison.geomean_ratio = num_ratios > 0 ? exp(log_ratio_sum / (double)num_ratios) : 1.0;
+    return comparison;
+}
+
+static std::string format_value(double value, const std::string &unit)
+{
+    char text[48];
+    snprintf(text, sizeof(text), "%.*f %s", value < 10.0 ? 3 : value < 100.0 ? 2 : value < 1000.0 ? 1 : 0, value, unit.c_str());
+    return text;
+}
+
+static std::string format_percent(double ratio)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%+.1f%%", ratio * 100.0);
+    return text;
+}
+
+std::string comparison_report(const run_comparison &comparison, const compare_options &options)
+{
+    size_t name_width = 9;
+    for (const series_comparison &series : comparison.series)
+    {
+        name_width = (std::max)(name_width, series.name.size());
+    }
+
+    std::string report;
+    char line[1024];
+    char interval_title[32];
+    snprintf(interval_title, sizeof(interval_title), "%.0f%% interval", options.confidence * 100.0);
+    snprintf(line, sizeof(line), "%-*s %15s %15s %9s %19s %8s %9s  %s\n", (int)name_width, "Series", "Baseline", "Candidate",
+             "Delta", interval_title, "p", "Samples", "Verdict");
+    report += line;
+    report += std::string(name_width + 100, '-') + "\n";
+
+    bool has_single_samples = false;
+    for (const series_comparison &series : comparison.series)
+    {
+        std::string interval = "[" + format_percent(series.delta_low) + ", " + format_percent(series.delta_high) + "]";
+        std::string samples = std::to_string(series.baseline_count) + "/" + std::to_string(series.candidate_count);
+        snprintf(line, sizeof(line), "%-*s %15s %15s %9s %19s %8.4f %9s  %s\n", (int)name_width, series.name.c_str(),
+                 format_value(series.baseline_median, series.unit).c_str(), format_value(series.candidate_median, series.unit).c_str(),
+                 format_percent(series.delta).c_str(), interval.c_str(), series.p_value, samples.c_str(),
+                 compare_verdict_name(series.verdict));
+        report += line;
+        has_single_samples |= series.baseline_count < 2 || series.candidate_count < 2;
+    }
+
+    snprintf(line, sizeof(line),
+             "\n%zu compared: %u slower, %u faster, %u same, %u unknown. Geometric mean of the ratios %.4f.\n"
+             "Threshold %.1f%%, alpha %.3f, %u resamples.\n",
+             comparison.series.size(), comparison.num_slower, comparison.num_faster, comparison.num_same, comparison.num_unknown,
+             comparison.geomean_ratio, options.threshold * 100.0, options.alpha, options.num_resamples);
+    report += line;
+    if (has_single_samples)
+    {
+        report += "A series with a single sample cannot be judged, run the benchmarks with --benchmark_repetitions=10.\n";
+    }
+    for (const std::string &name : comparison.only_in_baseline)
+    {
+        report += "Only in the baseline: " + name + "\n";
+    }
+    for (const std::string &name : comparison.only_in_candidate)
+    {
+        report += "Only in the candidate: " + name + "\n";
+    }
+    return report;
+}
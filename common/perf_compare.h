@@ -0,0 +1,96 @@
+#pragma once
+#include "common_api.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Comparison of two performance runs, a baseline and a candidate, series by series.
+// A run is read from a benchmark JSON file (microbench.h or Google Benchmark, one sample per repetition) or from a
+// Chrome trace of the renderer (trace_capture.h, one sample per scope, GPU timer or frame). Lower is better.
+// The delta is the ratio of the medians minus one, its confidence interval comes from a percentile bootstrap that
+// resamples both sides, the p-value from a two-sided Mann-Whitney U test, exact for small samples without ties and
+// with the normal approximation otherwise. Neither assumes normal samples, and a few outliers barely move them.
+// Verdicts:
+//   slower / faster   the difference is significant (p < alpha) and at least the threshold.
+//   same              the confidence interval is within the threshold on both sides.
+//   unknown           neither: too few samples or too much noise to tell, e.g. a single repetition.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+struct perf_series
+{
+    std::string name;
+    std::string unit; // Of the samples, "ns" for the benchmarks and "ms" for the traces.
+    std::vector<double> samples;
+};
+
+// Benchmark files: real_time or cpu_time of each repetition, in ns. The aggregates are only used when a
+// benchmark has no repetition, e.g. --benchmark_report_aggregates_only, then the mean is its single sample.
+// Traces: "CPU <scope>" and "GPU <timer>" durations, "Frame interval" between the frame starts and
+// "Present interval" between the presents, in ms.
+COMMON_API bool load_perf_series(const char *path, std::vector<perf_series> *series, bool is_cpu_time = false,
+                                 std::string *error = nullptr);
+
+enum compare_verdict
+{
+    compare_same,
+    compare_faster,
+    compare_slower,
+    compare_unknown,
+};
+
+COMMON_API const char *compare_verdict_name(compare_verdict verdict);
+
+struct compare_options
+{
+    double threshold = 0.05;   // Relative difference of the medians that matters.
+    double alpha = 0.05;       // Significance level of the U test.
+    double confidence = 0.95;  // Of the bootstrap interval.
+    uint32_t num_resamples = 2000;
+    uint64_t seed = 1; // The bootstrap is reproducible for a given seed.
+};
+
+struct series_comparison
+{
+    std::string name;
+    std::string unit;
+    uint32_t baseline_count = 0;
+    uint32_t candidate_count = 0;
+    double baseline_median = 0.0;
+    double candidate_median = 0.0;
+    double delta = 0.0; // candidate / baseline - 1, of the medians.
+    double delta_low = 0.0;
+    double delta_high = 0.0;
+    double p_value = 1.0;
+    compare_verdict verdict = compare_unknown;
+};
+
+COMMON_API double median_of(std::vector<double> values);
+
+// Two-sided p-value of the hypothesis that the two samples come from the same distribution.
+COMMON_API double mann_whitney_p(const std::vector<double> &a, const std::vector<double> &b);
+
+COMMON_API series_comparison compare_samples(const std::vector<double> &baseline, const std::vector<double> &candidate,
+                                             const compare_options &options);
+
+struct run_comparison
+{
+    std::vector<series_comparison> series; // In the order of the baseline.
+    std::vector<std::string> only_in_baseline;
+    std::vector<std::string> only_in_candidate;
+    uint32_t num_slower = 0;
+    uint32_t num_faster = 0;
+    uint32_t num_same = 0;
+    uint32_t num_unknown = 0;
+    double geomean_ratio = 1.0; // Of the median ratios of the series compared.
+};
+
+// filter is an ECMAScript regex searched in the series names, all of them when empty.
+COMMON_API run_comparison compare_runs(const std::vector<perf_series> &baseline, const std::vector<perf_series> &candidate,
+                                       const compare_options &options, const std::string &filter = "");
+
+// Table of the series with their verdicts, and a summary line.
+COMMON_API std::string comparison_report(const run_comparison &comparison, const compare_options &options);
+
+#pragma warning(pop)
@@ -0,0 +1,416 @@
+#include "platform.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <intrin.h>
+#pragma comment(lib, "Synchronization.lib")
+#else
+#include <time.h>
+#ifdef PLATFORM_X86
+#include <cpuid.h>
+#endif
+#ifdef __linux__
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "The address waits use the atomic as a plain 32-bit value");
+
+uint64_t clock_ticks()
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)counter.QuadPart;
+#else
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ull + (uint64_t)time.tv_nsec;
+#endif
+}
+
+uint64_t clock_frequency()
+{
+#ifdef _WIN32
+    // Fixed at boot.
+    static const uint64_t frequency = []() {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        return (uint64_t)value.QuadPart;
+    }();
+    return frequency;
+#else
+    return 1000000000ull;
+#endif
+}
+
+double ticks_to_ms(uint64_t ticks)
+{
+    return (double)ticks * 1000.0 / (double)clock_frequency();
+}
+
+void cpu_pause()
+{
+#ifdef PLATFORM_X86
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+static bool is_tsc_invariant()
+{
+#ifdef PLATFORM_X86
+    // CPUID.80000007H:EDX[8].
+    unsigned int regs[4] = {};
+#ifdef _WIN32
+    int max_leaf[4];
+    __cpuid(max_leaf, 0x80000000);
+    if ((unsigned int)max_leaf[0] < 0x80000007)
+    {
+        return false;
+    }
+    __cpuid((int *)regs, 0x80000007);
+#else
+    if (!__get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3]))
+    {
+        return false;
+    }
+#endif
+    return (regs[3] & (1u << 8)) != 0;
+#else
+    // read_tsc() is the monotonic clock.
+    return true;
+#endif
+}
+
+static tsc_calibration calibrate_tsc()
+{
+    tsc_calibration calibration;
+    calibration.is_invariant = is_tsc_invariant();
+#ifdef PLATFORM_X86
+    // Spin rather than sleep, so that both counters are read back to back at each end.
+    uint64_t clock_start = clock_ticks();
+    uint64_t tsc_start = read_tsc();
+    uint64_t clock_end = clock_start + clock_frequency() / 50;
+    uint64_t clock_now = clock_start;
+    while (clock_now < clock_end)
+    {
+        clock_now = clock_ticks();
+    }
+    uint64_t tsc_end = read_tsc();
+
+    double seconds = (double)(clock_now - clock_start) / (double)clock_frequency();
+    calibration.frequency = (double)(tsc_end - tsc_start) / seconds;
+    calibration.calibration_ms = seconds * 1000.0;
+#else
+    calibration.frequency = (double)clock_frequency();
+#endif
+    return calibration;
+}
+
+const tsc_calibration &calibrated_tsc()
+{
+    static const tsc_calibration calibration = calibrate_tsc();
+    return calibration;
+}
+
+double tsc_to_ms(uint64_t cycles)
+{
+    return (double)cycles * 1000.0 / calibrated_tsc().frequency;
+}
+
+void sleep_ms(uint32_t duration_ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+}
+
+double thread_cpu_ms()
+{
+#ifdef _WIN32
+    // 100 ns units.
+    FILETIME creation, exit, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+    uint64_t kernel_time = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    uint64_t user_time = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (double)(kernel_time + user_time) / 10000.0;
+#else
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+#endif
+}
+
+#if !defined(_WIN32) && !defined(__linux__)
+// Waiters of the addresses that hash to the same bucket share its condition variable.
+struct address_bucket
+{
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+static address_bucket g_address_buckets[64];
+
+static address_bucket *bucket_of(std::atomic<uint32_t> *address)
+{
+    return &g_address_buckets[((uintptr_t)address >> 4) % 64];
+}
+#endif
+
+bool address_wait(std::atomic<uint32_t> *address, uint32_t expected, uint32_t timeout_ms)
+{
+#if defined(_WIN32)
+    BOOL is_woken = WaitOnAddress(address, &expected, sizeof(uint32_t), timeout_ms);
+    return is_woken || GetLastError() != ERROR_TIMEOUT;
+#elif defined(__linux__)
+    timespec timeout = {(time_t)(timeout_ms / 1000), (long)(timeout_ms % 1000) * 1000000};
+    long res = syscall(SYS_futex, (uint32_t *)address, FUTEX_WAIT_PRIVATE, expected,
+                       timeout_ms == infinite_wait ? nullptr : &timeout, nullptr, 0);
+    return res == 0 || errno != ETIMEDOUT;
+#else
+    address_bucket *bucket = bucket_of(address);
+    std::unique_lock<std::mutex> lock(bucket->mtx);
+    if (address->load(std::memory_order_seq_cst) != expected)
+    {
+        return true;
+    }
+    if (timeout_ms == infinite_wait)
+    {
+        bucket->cv.wait(lock);
+        return true;
+    }
+    return bucket->cv.wait_for(lock, std::chrono::milliseconds(timeout_ms)) == std::cv_status::no_timeout;
+#endif
+}
+
+void address_wake_one(std::atomic<uint32_t> *address)
+{
+#if defined(_WIN32)
+    WakeByAddressSingle(address);
+#elif defined(__linux__)
+    syscall(SYS_futex, (uint32_t *)address, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+    // The bucket is shared, one wakeup could go to the waiter of another address.
+    address_wake_all(address);
+#endif
+}
+
+void address_wake_all(std::atomic<uint32_t> *address)
+{
+#if defined(_WIN32)
+    WakeByAddressAll(address);
+#elif defined(__linux__)
+    syscall(SYS_futex, (uint32_t *)address, FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+    address_bucket *bucket = bucket_of(address);
+    std::lock_guard<std::mutex> lock(bucket->mtx);
+    bucket->cv.notify_all();
+#endif
+}
+
+bool lightweight_event::try_acquire()
+{
+    uint32_t expected = 1;
+    return m_is_signaled.load(std::memory_order_relaxed) == 1 &&
+           m_is_signaled.compare_exchange_strong(expected, 0, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+void lightweight_event::signal()
+{
+    // The flag is set before the parked waiters are checked and the waiters do the opposite, so that one of the
+    // two always sees the other.
+    m_is_signaled.store(1, std::memory_order_seq_cst);
+    if (m_num_parked.load(std::memory_order_seq_cst) > 0)
+    {
+        address_wake_one(&m_is_signaled);
+    }
+}
+
+void lightweight_event::wait()
+{
+    wait_for(infinite_wait);
+}
+
+bool lightweight_event::wait_for(uint32_t timeout_ms)
+{
+    for (uint32_t i = 0; i < m_spin_count; i++)
+    {
+        if (try_acquire())
+        {
+            return true;
+        }
+        cpu_pause();
+    }
+
+    uint64_t start = clock_ticks();
+    bool is_acquired = false;
+    m_num_parked.fetch_add(1, std::memory_order_seq_cst);
+    while (!(is_acquired = try_acquire()))
+    {
+        uint32_t remaining_ms = infinite_wait;
+        if (timeout_ms != infinite_wait)
+        {
+            double elapsed_ms = ticks_to_ms(clock_ticks() - start);
+            if (elapsed_ms >= timeout_ms)
+            {
+                break;
+            }
+            remaining_ms = (uint32_t)(timeout_ms - elapsed_ms) + 1;
+        }
+        address_wait(&m_is_signaled, 0, remaining_ms);
+    }
+    m_num_parked.fetch_sub(1, std::memory_order_relaxed);
+    return is_acquired;
+}
+
+// Primitives measured by benchmark_wakeup_latency().
+template <uint32_t spin_count>
+struct spinning_event : lightweight_event
+{
+    spinning_event() : lightweight_event(spin_count) {}
+};
+
+struct condition_variable_event
+{
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool is_signaled = false;
+
+    void signal()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            is_signaled = true;
+        }
+        cv.notify_one();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this]() { return is_signaled; });
+        is_signaled = false;
+    }
+};
+
+#ifdef _WIN32
+struct kernel_event
+{
+    HANDLE handle = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    ~kernel_event() { CloseHandle(handle); }
+    void signal() { SetEvent(handle); }
+    void wait() { WaitForSingleObject(handle, INFINITE); }
+};
+#endif
+
+struct wakeup_latency
+{
+    double median_us = 0.0;
+    double p99_us = 0.0;
+    double max_us = 0.0;
+};
+
+// Ping-pong between two threads, the latency is the time from the signal to the return of the wait.
+// With idle_us, the signaling thread waits that long before each signal, so that the waiter has parked.
+template <typename event_type>
+static wakeup_latency measure_wakeups(uint32_t num_wakeups, uint32_t idle_us)
+{
+    event_type ping;
+    event_type pong;
+    std::atomic<uint64_t> signal_time{0};
+    std::vector<double> latencies_us(num_wakeups);
+
+    std::thread waiter([&]() {
+        for (uint32_t i = 0; i < num_wakeups; i++)
+        {
+            ping.wait();
+            uint64_t woken_time = clock_ticks();
+            latencies_us[i] = ticks_to_ms(woken_time - signal_time.load(std::memory_order_acquire)) * 1000.0;
+            pong.signal();
+        }
+    });
+
+    uint64_t idle_ticks = clock_frequency() * idle_us / 1000000;
+    for (uint32_t i = 0; i < num_wakeups; i++)
+    {
+        uint64_t idle_end = clock_ticks() + idle_ticks;
+        while (clock_ticks() < idle_end)
+        {
+            cpu_pause();
+        }
+        signal_time.store(clock_ticks(), std::memory_order_release);
+        ping.signal();
+        pong.wait();
+    }
+    waiter.join();
+
+    std::sort(latencies_us.begin(), latencies_us.end());
+    wakeup_latency result;
+    result.median_us = latencies_us[num_wakeups / 2];
+    result.p99_us = latencies_us[(size_t)(num_wakeups * 0.99)];
+    result.max_us = latencies_us.back();
+    return result;
+}
+
+// Keeps the results of the timed calls.
+static volatile uint64_t g_clock_sink = 0;
+
+template <typename function>
+static double ns_per_call(function call)
+{
+    const uint32_t num_calls = 100000;
+    uint64_t sum = 0;
+    uint64_t start = clock_ticks();
+    for (uint32_t i = 0; i < num_calls; i++)
+    {
+        sum += call();
+    }
+    double ns = ticks_to_ms(clock_ticks() - start) * 1000000.0 / num_calls;
+    g_clock_sink = sum;
+    return ns;
+}
+
+std::string benchmark_wakeup_latency(uint32_t num_wakeups)
+{
+    num_wakeups = (std::max)(num_wakeups, 100u);
+    uint32_t num_parked_wakeups = (std::max)(num_wakeups / 10, 100u);
+    const uint32_t idle_us = 1000;
+
+    std::stringstream stream;
+    stream.precision(1);
+    stream << std::fixed;
+
+    const tsc_calibration &tsc = calibrated_tsc();
+    stream << "TSC " << tsc.frequency / 1000000.0 << " MHz" << (tsc.is_invariant ? ", invariant" : ", not invariant")
+           << ", calibrated over " << tsc.calibration_ms << " ms\n";
+    stream << "clock_ticks() " << ns_per_call(clock_ticks) << " ns, read_tsc() " << ns_per_call(read_tsc) << " ns\n";
+
+    // With a single hardware thread the spinning waiter delays the thread that signals it.
+    stream << std::thread::hardware_concurrency() << " hardware threads\n\n";
+
+    stream << num_wakeups << " ping-pong wakeups, then " << num_parked_wakeups << " after " << idle_us << " us idle, us\n";
+    stream << "primitive    median    p99    max    parked median    parked p99    parked max\n";
+    auto run = [&](const char *name, wakeup_latency (*measure)(uint32_t, uint32_t)) {
+        wakeup_latency hot = measure(num_wakeups, 0);
+        wakeup_latency parked = measure(num_parked_wakeups, idle_us);
+        stream << name << "    " << hot.median_us << "    " << hot.p99_us << "    " << hot.max_us
+               << "    " << parked.median_us << "    " << parked.p99_us << "    " << parked.max_us << "\n";
+    };
+    run("spin then park", measure_wakeups<spinning_event<lightweight_event::default_spin_count>>);
+    run("park", measure_wakeups<spinning_event<0>>);
+    run("condition variable", measure_wakeups<condition_variable_event>);
+#ifdef _WIN32
+    run("kernel event", measure_wakeups<kernel_event>);
+#endif
+    return stream.str();
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "common_api.h"
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Thin layer over the OS for the CPU subsystems: a monotonic clock, the time stamp counter, sleeps and waits on
+// an address.
+// Windows uses QueryPerformanceCounter and WaitOnAddress, Linux clock_gettime and futex. On other platforms the
+// address waits fall back to condition variables hashed by address.
+// Nothing here includes Windows.h, the files that only use this layer build on every platform.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+// Monotonic clock, clock_frequency() ticks per second.
+COMMON_API uint64_t clock_ticks();
+COMMON_API uint64_t clock_frequency();
+COMMON_API double ticks_to_ms(uint64_t ticks);
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PLATFORM_X86 1
+#endif
+
+// Time stamp counter of the CPU, the clock ticks where there is none.
+// Inline, the profiler reads it twice per scope.
+inline uint64_t read_tsc()
+{
+#ifdef PLATFORM_X86
+    return __rdtsc();
+#else
+    return clock_ticks();
+#endif
+}
+
+// Hint to the CPU that the thread is spinning.
+COMMON_API void cpu_pause();
+
+// TSC ticks per second, measured against the monotonic clock on the first call.
+// The TSC is only a clock when it is invariant: constant rate and synchronized between the cores.
+struct tsc_calibration
+{
+    double frequency = 0.0;
+    bool is_invariant = false;
+    double calibration_ms = 0.0; // Duration of the measurement.
+};
+COMMON_API const tsc_calibration &calibrated_tsc();
+COMMON_API double tsc_to_ms(uint64_t cycles);
+
+COMMON_API void sleep_ms(uint32_t duration_ms);
+
+// CPU time used by the calling thread, in milliseconds.
+COMMON_API double thread_cpu_ms();
+
+// Blocks while *address == expected, until a wake on the address or the timeout. Can return spuriously.
+// Returns false on timeout.
+static const uint32_t infinite_wait = 0xFFFFFFFF;
+COMMON_API bool address_wait(std::atomic<uint32_t> *address, uint32_t expected, uint32_t timeout_ms = infinite_wait);
+COMMON_API void address_wake_one(std::atomic<uint32_t> *address);
+COMMON_API void address_wake_all(std::atomic<uint32_t> *address);
+
+// Auto-reset event on an address wait, without a kernel object.
+// The waiter spins for spin_count iterations before it parks, signal() only calls the OS when a thread is parked.
+class COMMON_API lightweight_event
+{
+public:
+    static const uint32_t default_spin_count = 256;
+
+    lightweight_event(uint32_t spin_count = default_spin_count) : m_spin_count(spin_count) {}
+    ~lightweight_event() = default;
+
+    // Releases one waiter, or the next thread that waits.
+    void signal();
+    void wait();
+
+    // Returns false on timeout.
+    bool wait_for(uint32_t timeout_ms);
+
+private:
+    bool try_acquire();
+
+    std::atomic<uint32_t> m_is_signaled{0};
+    std::atomic<uint32_t> m_num_parked{0};
+    uint32_t m_spin_count;
+};
+
+// Latency from a signal to the wakeup of the waiting thread, for each primitive, when the waiter is spinning and
+// when it is parked.
+COMMON_API std::string benchmark_wakeup_latency(uint32_t num_wakeups = 2000);
+
+#pragma warning(pop)
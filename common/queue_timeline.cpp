@@ -0,0 +1,260 @@
+#include "queue_timeline.h"
+#include <algorithm>
+#include <sstream>
+
+static const char *queue_names[gpu_queue_MAX] = {"graphics", "compute", "copy"};
+
+queue_timeline::queue_timeline()
+{
+    for (uint32_t i = 0; i < gpu_queue_MAX; i++)
+    {
+        m_known[i].assign(gpu_queue_MAX, 0);
+    }
+}
+
+void queue_timeline::reset(uint32_t queue, uint64_t last_value)
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_last_value[queue] = last_value;
+    m_history[queue].clear();
+}
+
+const queue_timeline::known_values *queue_timeline::find_known(uint32_t queue, uint64_t value) const
+{
+    const std::deque<signal_history> &history = m_history[queue];
+    if (history.empty() || value < history.front().value || value > history.back().value)
+    {
+        return nullptr;
+    }
+    return &history[(size_t)(value - history.front().value)].known;
+}
+
+queue_submission queue_timeline::schedule(uint32_t queue, const char *name, const queue_sync_point *waits, size_t num_waits)
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+
+    queue_submission submission;
+    submission.name = name;
+    submission.queue = queue;
+    submission.num_dropped_waits = 0;
+
+    // What each wait implies: the value itself, and everything its submission had waited for.
+    std::vector<known_values> implied(num_waits);
+    for (size_t i = 0; i < num_waits; i++)
+    {
+        const queue_sync_point &wait = waits[i];
+        const known_values *known = find_known(wait.queue, wait.value);
+        implied[i] = known ? *known : known_values(gpu_queue_MAX, 0);
+        implied[i][wait.queue] = (std::max)(implied[i][wait.queue], wait.value);
+    }
+
+    known_values &known = m_known[queue];
+    for (size_t i = 0; i < num_waits; i++)
+    {
+        const queue_sync_point &wait = waits[i];
+        bool is_implied = wait.queue == queue || wait.value <= known[wait.queue];
+        for (size_t j = 0; j < num_waits && !is_implied; j++)
+        {
+            // Of two waits that imply each other, the first one is kept.
+            bool is_same = implied[i][waits[j].queue] >= waits[j].value;
+            is_implied = j != i && implied[j][wait.queue] >= wait.value && (!is_same || j < i);
+        }
+
+        if (is_implied)
+        {
+            submission.num_dropped_waits++;
+        }
+        else
+        {
+            submission.waits.push_back(wait);
+        }
+    }
+
+    for (size_t i = 0; i < num_waits; i++)
+    {
+        for (uint32_t q = 0; q < gpu_queue_MAX; q++)
+        {
+            known[q] = (std::max)(known[q], implied[i][q]);
+        }
+    }
+
+    submission.signal_value = ++m_last_value[queue];
+
+    signal_history history = {submission.signal_value, known};
+    history.known[queue] = submission.signal_value;
+    std::deque<signal_history> &queue_history = m_history[queue];
+    if (!queue_history.empty() && queue_history.back().value + 1 != submission.signal_value)
+    {
+        queue_history.clear();
+    }
+    queue_history.push_back(history);
+    if (queue_history.size() > max_history)
+    {
+        queue_history.pop_front();
+    }
+
+    m_log.push_back(submission);
+    return submission;
+}
+
+queue_sync_point queue_timeline::last(uint32_t queue) const
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    queue_sync_point point = {queue, m_last_value[queue]};
+    return point;
+}
+
+void queue_timeline::clear_log()
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_log.clear();
+}
+
+std::vector<queue_submission> queue_timeline::log() const
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_log;
+}
+
+std::string queue_timeline::dump() const
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    std::stringstream stream;
+    for (const queue_submission &submission : m_log)
+    {
+        stream << queue_names[submission.queue] << " " << submission.signal_value << ": " << submission.name;
+        if (!submission.waits.empty())
+        {
+            stream << ", waits for";
+            for (const queue_sync_point &wait : submission.waits)
+            {
+                stream << " " << queue_names[wait.queue] << " " << wait.value;
+            }
+        }
+        if (submission.num_dropped_waits > 0)
+        {
+            stream << " (" << submission.num_dropped_waits << " implied)";
+        }
+        stream << "\n";
+    }
+    return stream.str();
+}
+
+bool simulate_queues(const std::vector<queue_submission> &log, const std::vector<double> &durations_ms,
+                     simulated_schedule *schedule, std::string *error)
+{
+    schedule->submissions.assign(log.size(), simulated_submission{0, 0.0, 0.0});
+    schedule->total_ms = 0.0;
+    schedule->overlap_ms = 0.0;
+
+    // Submissions of each queue in order, and the value each queue had reached before the log.
+    std::vector<size_t> queue_submissions[gpu_queue_MAX];
+    uint64_t base_value[gpu_queue_MAX] = {};
+    bool has_base[gpu_queue_MAX] = {};
+    for (size_t i = 0; i < log.size(); i++)
+    {
+        uint32_t queue = log[i].queue;
+        queue_submissions[queue].push_back(i);
+        if (!has_base[queue])
+        {
+            base_value[queue] = log[i].signal_value - 1;
+            has_base[queue] = true;
+        }
+    }
+
+    // Time at which each value of the log is signaled, negative until then.
+    std::vector<double> signal_ms(log.size(), -1.0);
+    auto reached_ms = [&](const queue_sync_point &wait) -> double {
+        if (!has_base[wait.queue] || wait.value <= base_value[wait.queue])
+        {
+            return 0.0;
+        }
+        size_t index = (size_t)(wait.value - base_value[wait.queue] - 1);
+        if (index >= queue_submissions[wait.queue].size())
+        {
+            return -1.0;
+        }
+        return signal_ms[queue_submissions[wait.queue][index]];
+    };
+
+    size_t next[gpu_queue_MAX] = {};
+    double queue_free_ms[gpu_queue_MAX] = {};
+    size_t num_done = 0;
+    bool has_progress = true;
+    while (has_progress)
+    {
+        has_progress = false;
+        for (uint32_t queue = 0; queue < gpu_queue_MAX; queue++)
+        {
+            while (next[queue] < queue_submissions[queue].size())
+            {
+                size_t index = queue_submissions[queue][next[queue]];
+                double start_ms = queue_free_ms[queue];
+                bool is_ready = true;
+                for (const queue_sync_point &wait : log[index].waits)
+                {
+                    double wait_ms = reached_ms(wait);
+                    is_ready = is_ready && wait_ms >= 0.0;
+                    start_ms = (std::max)(start_ms, wait_ms);
+                }
+                if (!is_ready)
+                {
+                    break;
+                }
+
+                double duration_ms = index < durations_ms.size() ? durations_ms[index] : 0.0;
+                simulated_submission result = {queue, start_ms, start_ms + duration_ms};
+                schedule->submissions[index] = result;
+                signal_ms[index] = result.end_ms;
+                queue_free_ms[queue] = result.end_ms;
+                schedule->total_ms = (std::max)(schedule->total_ms, result.end_ms);
+                next[queue]++;
+                num_done++;
+                has_progress = true;
+            }
+        }
+    }
+
+    if (num_done != log.size())
+    {
+        if (error)
+        {
+            std::stringstream stream;
+            stream << "Submissions that never start:";
+            for (uint32_t queue = 0; queue < gpu_queue_MAX; queue++)
+            {
+                for (size_t i = next[queue]; i < queue_submissions[queue].size(); i++)
+                {
+                    stream << " \"" << log[queue_submissions[queue][i]].name << "\"";
+                }
+            }
+            *error = stream.str();
+        }
+        return false;
+    }
+
+    // Sweep over the start and end times, counting the busy queues.
+    std::vector<std::pair<double, int>> events;
+    for (const simulated_submission &submission : schedule->submissions)
+    {
+        if (submission.end_ms > submission.start_ms)
+        {
+            events.push_back({submission.start_ms, 1});
+            events.push_back({submission.end_ms, -1});
+        }
+    }
+    std::sort(events.begin(), events.end());
+
+    int num_busy = 0;
+    double last_ms = 0.0;
+    for (const std::pair<double, int> &event : events)
+    {
+        if (num_busy >= 2)
+        {
+            schedule->overlap_ms += event.first - last_ms;
+        }
+        num_busy += event.second;
+        last_ms = event.first;
+    }
+    return true;
+}
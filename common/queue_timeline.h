@@ -0,0 +1,103 @@
+#pragma once
+#include "common_api.h"
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Fence timelines of the GPU queues.
+// Each queue owns a fence, every submission signals the next value of its queue and waits for values of the
+// other queues. schedule() assigns the values and drops the waits that are already implied, either by an earlier
+// wait of the same queue or through the waits of the submission that is waited for.
+// Only the values are computed here, the caller issues the Wait/ExecuteCommandLists/Signal calls. The schedule can
+// be checked without a GPU with simulate_queues(), which runs the submissions like the queues would.
+
+enum gpu_queue
+{
+    gpu_queue_graphics,
+    gpu_queue_compute,
+    gpu_queue_copy,
+    gpu_queue_MAX
+};
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+struct queue_sync_point
+{
+    uint32_t queue;
+    uint64_t value; // 0 is always reached.
+};
+
+struct queue_submission
+{
+    std::string name;
+    uint32_t queue;
+    uint64_t signal_value;
+    std::vector<queue_sync_point> waits; // Only the waits that must be issued.
+    uint32_t num_dropped_waits;
+};
+
+class COMMON_API queue_timeline
+{
+public:
+    queue_timeline();
+    ~queue_timeline() = default;
+
+    // Starts the timeline of a queue after the value its fence already reached.
+    void reset(uint32_t queue, uint64_t last_value);
+
+    // Assigns the value signaled by a submission of the queue, after the given sync points.
+    // Can be called from several threads.
+    queue_submission schedule(uint32_t queue, const char *name, const queue_sync_point *waits = nullptr, size_t num_waits = 0);
+
+    // Value signaled by the last submission of the queue.
+    queue_sync_point last(uint32_t queue) const;
+
+    // Submissions since the last clear_log().
+    void clear_log();
+    std::vector<queue_submission> log() const;
+    std::string dump() const;
+
+private:
+    // Values of every queue known to be reached when a submission starts, or when it signals.
+    typedef std::vector<uint64_t> known_values;
+    struct signal_history
+    {
+        uint64_t value;
+        known_values known;
+    };
+    static const size_t max_history = 64;
+
+    const known_values *find_known(uint32_t queue, uint64_t value) const;
+
+    mutable std::mutex m_mtx;
+    uint64_t m_last_value[gpu_queue_MAX] = {};
+    known_values m_known[gpu_queue_MAX];
+    std::deque<signal_history> m_history[gpu_queue_MAX];
+    std::vector<queue_submission> m_log;
+};
+
+// Result of simulate_queues(), in milliseconds since the start of the first submission.
+struct simulated_submission
+{
+    uint32_t queue;
+    double start_ms;
+    double end_ms;
+};
+
+struct simulated_schedule
+{
+    std::vector<simulated_submission> submissions; // In the order of the log.
+    double total_ms = 0.0;
+    double overlap_ms = 0.0; // Time during which at least two queues are busy.
+};
+
+// Runs the submissions like the GPU would: each queue executes its submissions in order, a submission starts when
+// its queue is idle and the values it waits for are signaled. Values signaled before the log are reached at 0.
+// Returns false if some submissions can never start, their names are written to error.
+COMMON_API bool simulate_queues(const std::vector<queue_submission> &log, const std::vector<double> &durations_ms,
+                                simulated_schedule *schedule, std::string *error = nullptr);
+
+#pragma warning(pop)
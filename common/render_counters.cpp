@@ -0,0 +1,259 @@
+#include "render_counters.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+
+render_counters g_render_counters;
+
+const char *render_counter_name(render_counter counter)
+{
+    switch (counter)
+    {
+    case counter_draws:
+        return "Draws";
+    case counter_dispatches:
+        return "Dispatches";
+    case counter_execute_indirect:
+        return "ExecuteIndirect";
+    case counter_barriers:
+        return "Barriers";
+    case counter_descriptor_copies:
+        return "Descriptor copies";
+    case counter_descriptor_tables:
+        return "Descriptor tables";
+    case counter_upload_bytes:
+        return "Upload bytes";
+    case counter_pipeline_changes:
+        return "Pipeline changes";
+    case counter_root_signature_changes:
+        return "Root signature changes";
+    case counter_command_lists:
+        return "Command lists";
+    default:
+        return "unknown counter";
+    }
+}
+
+render_counter_values render_counter_frame::outside_passes() const
+{
+    render_counter_values outside = totals;
+    for (const pass_counter_values &pass : passes)
+    {
+        for (int i = 0; i < render_counter_count; i++)
+        {
+            outside.values[i] -= pass.counters.values[i];
+        }
+    }
+    return outside;
+}
+
+render_counter_thread_buffer::render_counter_thread_buffer()
+{
+    for (uint32_t row = 0; row < max_passes; row++)
+    {
+        m_passes[row] = profile_event_invalid;
+        for (int i = 0; i < render_counter_count; i++)
+        {
+            m_values[row][i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Buffer of the calling thread in the counters it last used.
+static thread_local const render_counters *t_counters = nullptr;
+static thread_local render_counter_thread_buffer *t_buffer = nullptr;
+
+// Lets the buffer be reused once the thread exits.
+struct render_counter_thread_exit
+{
+    ~render_counter_thread_exit()
+    {
+        if (t_buffer)
+        {
+            t_buffer->m_is_alive.store(false, std::memory_order_release);
+        }
+    }
+};
+static thread_local render_counter_thread_exit t_thread_exit;
+
+render_counters::~render_counters()
+{
+    if (t_counters == this)
+    {
+        t_counters = nullptr;
+        t_buffer = nullptr;
+    }
+    for (render_counter_thread_buffer *buffer : m_threads)
+    {
+        delete buffer;
+    }
+}
+
+render_counter_thread_buffer *render_counters::thread_buffer()
+{
+    if (t_counters == this)
+    {
+        return t_buffer;
+    }
+    return register_thread();
+}
+
+render_counter_thread_buffer *render_counters::register_thread()
+{
+    // Before the buffer is set, so that the exit of the thread sees it.
+    (void)&t_thread_exit;
+
+    // The counts of a dead thread stay in its buffer, they are collected with the ones of the thread that takes it.
+    std::lock_guard<std::mutex> lock(m_threads_mtx);
+    render_counter_thread_buffer *buffer = nullptr;
+    for (render_counter_thread_buffer *dead : m_threads)
+    {
+        if (!dead->m_is_alive.load(std::memory_order_acquire))
+        {
+            buffer = dead;
+            buffer->m_num_open_passes = 0;
+            buffer->m_is_alive.store(true, std::memory_order_relaxed);
+            break;
+        }
+    }
+    if (!buffer)
+    {
+        buffer = new render_counter_thread_buffer();
+        m_threads.push_back(buffer);
+    }
+
+    t_counters = this;
+    t_buffer = buffer;
+    return buffer;
+}
+
+void render_counters::begin_pass(profile_event_id event)
+{
+    render_counter_thread_buffer *buffer = thread_buffer();
+    if (buffer->m_num_open_passes == render_counter_thread_buffer::max_open_passes)
+    {
+        return;
+    }
+
+    // Passes keep their row, a thread records in a few of them.
+    uint32_t num_passes = buffer->m_num_passes.load(std::memory_order_relaxed);
+    uint32_t row = 1;
+    while (row < num_passes && buffer->m_passes[row] != event)
+    {
+        row++;
+    }
+    if (row == num_passes)
+    {
+        if (num_passes < render_counter_thread_buffer::max_passes)
+        {
+            buffer->m_passes[row] = event;
+            buffer->m_num_passes.store(num_passes + 1, std::memory_order_release);
+        }
+        else
+        {
+            row = buffer->m_num_open_passes > 0 ? buffer->m_open_passes[buffer->m_num_open_passes - 1].row : 0;
+        }
+    }
+    buffer->m_open_passes[buffer->m_num_open_passes++] = {event, row};
+}
+
+void render_counters::end_pass(profile_event_id event)
+{
+    // The last pass opened with this event, none when begin_pass() had no room for it.
+    render_counter_thread_buffer *buffer = thread_buffer();
+    int index = (int)buffer->m_num_open_passes - 1;
+    while (index >= 0 && buffer->m_open_passes[index].event != event)
+    {
+        index--;
+    }
+    if (index < 0)
+    {
+        return;
+    }
+    for (uint32_t i = index; i + 1 < buffer->m_num_open_passes; i++)
+    {
+        buffer->m_open_passes[i] = buffer->m_open_passes[i + 1];
+    }
+    buffer->m_num_open_passes--;
+}
+
+const render_counter_frame &render_counters::end_frame()
+{
+    // The passes keep the memory of the previous frames.
+    m_frame.frame_number = m_frame_number++;
+    m_frame.totals = render_counter_values();
+    m_frame.passes.clear();
+
+    std::lock_guard<std::mutex> lock(m_threads_mtx);
+    for (render_counter_thread_buffer *buffer : m_threads)
+    {
+        uint32_t num_passes = buffer->m_num_passes.load(std::memory_order_acquire);
+        for (uint32_t row = 0; row < num_passes; row++)
+        {
+            uint64_t delta[render_counter_count];
+            bool is_empty = true;
+            for (int i = 0; i < render_counter_count; i++)
+            {
+                uint64_t value = buffer->m_values[row][i].load(std::memory_order_relaxed);
+                delta[i] = value - buffer->m_collected[row][i];
+                buffer->m_collected[row][i] = value;
+                m_frame.totals.values[i] += delta[i];
+                is_empty = is_empty && delta[i] == 0;
+            }
+            if (row == 0 || is_empty)
+            {
+                continue;
+            }
+
+            profile_event_id event = buffer->m_passes[row];
+            auto pass = std::find_if(m_frame.passes.begin(), m_frame.passes.end(),
+                                     [event](const pass_counter_values &p) { return p.pass == event; });
+            if (pass == m_frame.passes.end())
+            {
+                m_frame.passes.push_back(pass_counter_values());
+                pass = m_frame.passes.end() - 1;
+                pass->pass = event;
+            }
+            for (int i = 0; i < render_counter_count; i++)
+            {
+                pass->counters.values[i] += delta[i];
+            }
+        }
+    }
+
+    std::sort(m_frame.passes.begin(), m_frame.passes.end(), [](const pass_counter_values &a, const pass_counter_values &b) {
+        return strcmp(profile_event_name(a.pass), profile_event_name(b.pass)) < 0;
+    });
+    return m_frame;
+}
+
+static void dump_row(std::stringstream *stream, const char *name, const render_counter_values &counters)
+{
+    *stream << std::left << std::setw(40) << name << std::right;
+    for (int i = 0; i < render_counter_count; i++)
+    {
+        *stream << (i == 0 ? "" : "  ") << std::setw(strlen(render_counter_name((render_counter)i))) << counters.values[i];
+    }
+    *stream << "\n";
+}
+
+std::string dump_render_counters(const render_counter_frame &frame)
+{
+    std::stringstream stream;
+    stream << "Frame " << frame.frame_number << "\n";
+    stream << std::left << std::setw(40) << "Pass";
+    for (int i = 0; i < render_counter_count; i++)
+    {
+        stream << (i == 0 ? "" : "  ") << render_counter_name((render_counter)i);
+    }
+    stream << "\n";
+
+    for (const pass_counter_values &pass : frame.passes)
+    {
+        dump_row(&stream, profile_event_name(pass.pass), pass.counters);
+    }
+    dump_row(&stream, "Outside of the passes", frame.outside_passes());
+    dump_row(&stream, "Total", frame.totals);
+    return stream.str();
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include "common_api.h"
+#include "cpu_profiler.h"
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Counts of the rendering work recorded each frame: draws, dispatches, barriers, descriptor work, uploads, state
+// changes and submissions, in total and by pass.
+// The code that records a command adds to the counters of its thread, in the pass the thread is in: a pass is a
+// profile event, opened and closed on the thread, usually by the GPU timers. Only the thread writes its counters,
+// without locks or read-modify-writes. Once per frame, end_frame() adds up what each thread counted since the last
+// call, the work of a frame is whatever was recorded between two calls.
+// Work outside of every pass only counts in the totals.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+enum render_counter
+{
+    counter_draws,
+    counter_dispatches,
+    counter_execute_indirect,
+    counter_barriers,
+    counter_descriptor_copies,
+    counter_descriptor_tables, // Root descriptor tables set.
+    counter_upload_bytes,
+    counter_pipeline_changes,
+    counter_root_signature_changes,
+    counter_command_lists, // Submitted to a queue.
+    render_counter_count
+};
+
+COMMON_API const char *render_counter_name(render_counter counter);
+
+struct render_counter_values
+{
+    uint64_t values[render_counter_count] = {};
+
+    uint64_t operator[](render_counter counter) const { return values[counter]; }
+};
+
+struct pass_counter_values
+{
+    profile_event_id pass = profile_event_invalid;
+    render_counter_values counters;
+};
+
+struct render_counter_frame
+{
+    uint64_t frame_number = 0;
+    render_counter_values totals;
+    std::vector<pass_counter_values> passes; // By name.
+
+    // Totals minus the passes.
+    render_counter_values outside_passes() const;
+};
+
+// Counters of one thread, a row per pass it recorded in.
+struct render_counter_thread_buffer
+{
+    static const uint32_t max_passes = 64;
+    static const uint32_t max_open_passes = 16;
+
+    render_counter_thread_buffer();
+
+    std::atomic<bool> m_is_alive{true};
+    std::atomic<uint32_t> m_num_passes{1}; // Row 0 counts the work outside of the passes.
+    profile_event_id m_passes[max_passes];  // Written before m_num_passes.
+    std::atomic<uint64_t> m_values[max_passes][render_counter_count];
+
+    // Only used by the thread.
+    struct open_pass
+    {
+        profile_event_id event;
+        uint32_t row;
+    };
+    open_pass m_open_passes[max_open_passes];
+    uint32_t m_num_open_passes = 0;
+
+    // Only used by end_frame(), the values it already counted.
+    uint64_t m_collected[max_passes][render_counter_count] = {};
+};
+
+class COMMON_API render_counters
+{
+public:
+    render_counters() = default;
+    ~render_counters();
+
+    void add(render_counter counter, uint64_t value = 1)
+    {
+        render_counter_thread_buffer *buffer = thread_buffer();
+        uint32_t row = buffer->m_num_open_passes > 0 ? buffer->m_open_passes[buffer->m_num_open_passes - 1].row : 0;
+        std::atomic<uint64_t> &count = buffer->m_values[row][counter];
+        count.store(count.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    // Passes are nested on a thread, the innermost one counts the work. A pass with no row left counts in its parent.
+    void begin_pass(profile_event_id event);
+    void end_pass(profile_event_id event);
+
+    // Adds up the counts since the last call. Called once per frame, by one thread.
+    const render_counter_frame &end_frame();
+    const render_counter_frame &last_frame() const { return m_frame; }
+
+private:
+    render_counter_thread_buffer *thread_buffer();
+    render_counter_thread_buffer *register_thread();
+
+    std::mutex m_threads_mtx;
+    std::vector<render_counter_thread_buffer *> m_threads;
+    render_counter_frame m_frame;
+    uint64_t m_frame_number = 0;
+};
+
+extern COMMON_API render_counters g_render_counters;
+
+// Counts the work of the rest of the enclosing block in a pass, for the threads that record part of a pass
+// without its timer.
+struct render_counter_pass
+{
+    render_counter_pass(profile_event_id event) : m_event(event) { g_render_counters.begin_pass(event); }
+    ~render_counter_pass() { g_render_counters.end_pass(m_event); }
+    render_counter_pass(const render_counter_pass &) = delete;
+    render_counter_pass &operator=(const render_counter_pass &) = delete;
+
+    profile_event_id m_event;
+};
+
+// Table of the counters of each pass, with the work outside of the passes and the totals.
+COMMON_API std::string dump_render_counters(const render_counter_frame &frame);
+
+#pragma warning(pop)
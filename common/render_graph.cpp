@@ -0,0 +1,462 @@
+#include "render_graph.h"
+#include <sstream>
+
+std::string resource_state_name(uint32_t state)
+{
+    if (state == 0)
+    {
+        return "COMMON";
+    }
+
+    if (state == resource_state_unknown)
+    {
+        return "UNKNOWN";
+    }
+
+    static const struct
+    {
+        uint32_t flag;
+        const char *name;
+    } state_names[] = {
+        {0x1, "VERTEX_AND_CONSTANT_BUFFER"},
+        {0x2, "INDEX_BUFFER"},
+        {0x4, "RENDER_TARGET"},
+        {0x8, "UNORDERED_ACCESS"},
+        {0x10, "DEPTH_WRITE"},
+        {0x20, "DEPTH_READ"},
+        {0x40, "NON_PIXEL_SHADER_RESOURCE"},
+        {0x80, "PIXEL_SHADER_RESOURCE"},
+        {0x100, "STREAM_OUT"},
+        {0x200, "INDIRECT_ARGUMENT"},
+        {0x400, "COPY_DEST"},
+        {0x800, "COPY_SOURCE"},
+        {0x1000, "RESOLVE_DEST"},
+        {0x2000, "RESOLVE_SOURCE"},
+    };
+
+    std::string name;
+    for (const auto &entry : state_names)
+    {
+        if ((state & entry.flag) != 0)
+        {
+            name += name.empty() ? "" : "|";
+            name += entry.name;
+        }
+    }
+    return name;
+}
+
+void render_graph::reset()
+{
+    for (size_t i = 0; i < m_num_active_passes; i++)
+    {
+        render_graph_pass &pass = m_passes[i];
+        pass.execute = nullptr;
+        pass.accesses.clear();
+        pass.barriers_before.clear();
+        pass.barriers_after.clear();
+    }
+    m_num_active_passes = 0;
+    m_num_active_resources = 0;
+    m_initial_barriers.clear();
+    m_num_culled = 0;
+    m_num_barriers = 0;
+    m_num_split_barriers = 0;
+}
+
+render_graph_handle render_graph::import_resource(const char *name, const void *resource, uint32_t initial_state, uint32_t final_state)
+{
+    if (m_num_active_resources == m_resources.size())
+    {
+        m_resources.emplace_back();
+    }
+
+    render_graph_resource &r = m_resources[m_num_active_resources];
+    r.name = name;
+    r.resource = resource;
+    r.initial_state = initial_state;
+    r.final_state = (final_state == resource_state_unknown) ? initial_state : final_state;
+    r.is_output = false;
+    r.is_aliased = false;
+    r.aliased_before = nullptr;
+    return (render_graph_handle)m_num_active_resources++;
+}
+
+void render_graph::set_output(render_graph_handle resource)
+{
+    m_resources[resource].is_output = true;
+}
+
+void render_graph::set_aliased(render_graph_handle resource, const void *previous)
+{
+    m_resources[resource].is_aliased = true;
+    m_resources[resource].aliased_before = previous;
+}
+
+render_graph_handle render_graph::add_pass(const char *name, std::function<void()> execute, bool has_side_effects)
+{
+    if (m_num_active_passes == m_passes.size())
+    {
+        m_passes.emplace_back();
+    }
+
+    render_graph_pass &pass = m_passes[m_num_active_passes];
+    pass.name = name;
+    pass.execute = std::move(execute);
+    pass.has_side_effects = has_side_effects;
+    pass.is_culled = false;
+    pass.ends_command_list = false;
+    return (render_graph_handle)m_num_active_passes++;
+}
+
+void render_graph::read(render_graph_handle pass, render_graph_handle resource, uint32_t state)
+{
+    render_graph_access access = {resource, state, false};
+    m_passes[pass].accesses.push_back(access);
+}
+
+void render_graph::write(render_graph_handle pass, render_graph_handle resource, uint32_t state)
+{
+    render_graph_access access = {resource, state, true};
+    m_passes[pass].accesses.push_back(access);
+}
+
+void render_graph::end_command_list(render_graph_handle pass)
+{
+    m_passes[pass].ends_command_list = true;
+}
+
+// Command list of the barriers after a pass, -1 being the barriers before the first pass.
+uint32_t render_graph::command_list_after(int pass) const
+{
+    if (pass < 0)
+    {
+        return 0;
+    }
+    return m_passes[pass].command_list + (m_passes[pass].ends_command_list ? 1 : 0);
+}
+
+void render_graph::add_barrier(tracked_barrier barrier, int last_pass, int previous_pass, uint32_t command_list,
+                               std::vector<tracked_barrier> *target)
+{
+    m_num_barriers++;
+
+    // Nothing runs between the last use and this one, a split barrier would gain nothing.
+    // The two halves of a split barrier also have to be in the same command list.
+    if (last_pass == previous_pass || command_list_after(last_pass) != command_list)
+    {
+        target->push_back(barrier);
+        return;
+    }
+
+    // Start the transition right after the last use so the GPU can overlap it with the passes in between.
+    tracked_barrier begin = barrier;
+    begin.flags = tracked_barrier_begin_only;
+    if (last_pass < 0)
+    {
+        m_initial_barriers.push_back(begin);
+    }
+    else
+    {
+        m_passes[last_pass].barriers_after.push_back(begin);
+    }
+
+    tracked_barrier end = barrier;
+    end.flags = tracked_barrier_end_only;
+    target->push_back(end);
+    m_num_split_barriers++;
+}
+
+bool render_graph::compile(std::string *error)
+{
+    m_initial_barriers.clear();
+    m_num_culled = 0;
+    m_num_barriers = 0;
+    m_num_split_barriers = 0;
+
+    // Cull the passes that don't contribute to an output, walking back from the last pass.
+    // Writes don't end the need for a resource: passes may blend or load on top of the previous content.
+    m_is_needed.assign(m_num_active_resources, 0);
+    for (size_t i = 0; i < m_num_active_resources; i++)
+    {
+        m_is_needed[i] = m_resources[i].is_output ? 1 : 0;
+    }
+
+    for (size_t i = m_num_active_passes; i-- > 0;)
+    {
+        render_graph_pass &pass = m_passes[i];
+        pass.barriers_before.clear();
+        pass.barriers_after.clear();
+
+        bool is_alive = pass.has_side_effects;
+        for (const render_graph_access &access : pass.accesses)
+        {
+            is_alive |= access.is_write && m_is_needed[access.resource];
+        }
+
+        pass.is_culled = !is_alive;
+        if (!is_alive)
+        {
+            m_num_culled++;
+            continue;
+        }
+
+        for (const render_graph_access &access : pass.accesses)
+        {
+            m_is_needed[access.resource] = 1;
+        }
+    }
+
+    // Command list of each pass, culled or not.
+    uint32_t command_list = 0;
+    for (size_t i = 0; i < m_num_active_passes; i++)
+    {
+        m_passes[i].command_list = command_list;
+        command_list += m_passes[i].ends_command_list ? 1 : 0;
+    }
+
+    // Walk the remaining passes in order and transition each resource to the state the next pass needs.
+    m_tracking.resize(m_num_active_resources);
+    for (size_t i = 0; i < m_num_active_resources; i++)
+    {
+        resource_tracking tracking = {m_resources[i].initial_state, -1, false};
+        m_tracking[i] = tracking;
+    }
+
+    int previous_pass = -1;
+    for (size_t i = 0; i < m_num_active_passes; i++)
+    {
+        render_graph_pass &pass = m_passes[i];
+        if (pass.is_culled)
+        {
+            continue;
+        }
+
+        // Merge the accesses of the pass, a resource can only be in one state at a time.
+        m_pass_usages.clear();
+        for (const render_graph_access &access : pass.accesses)
+        {
+            bool is_merged = false;
+            for (pass_usage &usage : m_pass_usages)
+            {
+                if (usage.resource != access.resource)
+                {
+                    continue;
+                }
+
+                bool both_read = !usage.is_write && !access.is_write &&
+                                 (usage.state & ~resource_state_read_mask) == 0 &&
+                                 (access.state & ~resource_state_read_mask) == 0;
+                if (both_read)
+                {
+                    usage.state |= access.state;
+                }
+                else if (usage.state == access.state)
+                {
+                    usage.is_write |= access.is_write;
+                }
+                else
+                {
+                    if (error)
+                    {
+                        *error = "Pass " + pass.name + " uses " + m_resources[access.resource].name + " as both " +
+                                 resource_state_name(usage.state) + " and " + resource_state_name(access.state) + ".";
+                    }
+                    return false;
+                }
+                is_merged = true;
+                break;
+            }
+
+            if (!is_merged)
+            {
+                pass_usage usage = {access.resource, access.state, access.is_write};
+                m_pass_usages.push_back(usage);
+            }
+        }
+
+        for (const pass_usage &usage : m_pass_usages)
+        {
+            resource_tracking &tracking = m_tracking[usage.resource];
+            const void *resource = m_resources[usage.resource].resource;
+
+            bool is_compatible = (tracking.state == usage.state) ||
+                                 (!usage.is_write && is_state_compatible(tracking.state, usage.state));
+            if (is_compatible)
+            {
+                // Unordered accesses still need to be ordered when one of them writes.
+                if (usage.state == resource_state_unordered_access && tracking.last_pass >= 0 &&
+                    (usage.is_write || tracking.last_was_write))
+                {
+                    tracked_barrier uav = {tracked_barrier_uav, resource, all_subresources,
+                                           resource_state_unordered_access, resource_state_unordered_access, 0, nullptr};
+                    pass.barriers_before.push_back(uav);
+                    m_num_barriers++;
+                }
+                tracking.last_pass = (int)i;
+                tracking.last_was_write = usage.is_write;
+                continue;
+            }
+
+            // Reads are combined, the resource stays readable by the passes that already used it.
+            uint32_t after = usage.state;
+            bool current_is_read = tracking.state != 0 && (tracking.state & ~resource_state_read_mask) == 0;
+            bool required_is_read = !usage.is_write && usage.state != 0 && (usage.state & ~resource_state_read_mask) == 0;
+            if (current_is_read && required_is_read)
+            {
+                after = tracking.state | usage.state;
+            }
+
+            tracked_barrier transition = {tracked_barrier_transition, resource, all_subresources, tracking.state, after, 0, nullptr};
+            add_barrier(transition, tracking.last_pass, previous_pass, pass.command_list, &pass.barriers_before);
+            tracking.state = after;
+            tracking.last_pass = (int)i;
+            tracking.last_was_write = usage.is_write;
+        }
+        previous_pass = (int)i;
+    }
+
+    // Aliasing barriers go before everything else, including the begin halves of split barriers.
+    for (size_t i = m_num_active_resources; i-- > 0;)
+    {
+        const render_graph_resource &r = m_resources[i];
+        if (r.is_aliased && m_tracking[i].last_pass >= 0)
+        {
+            tracked_barrier aliasing = {tracked_barrier_aliasing, r.resource, all_subresources, 0, 0, 0, r.aliased_before};
+            m_initial_barriers.insert(m_initial_barriers.begin(), aliasing);
+            m_num_barriers++;
+        }
+    }
+
+    // Leave every resource in its final state after the last pass.
+    if (previous_pass >= 0)
+    {
+        render_graph_pass &last = m_passes[previous_pass];
+        for (size_t i = 0; i < m_num_active_resources; i++)
+        {
+            resource_tracking &tracking = m_tracking[i];
+            uint32_t final_state = m_resources[i].final_state;
+            if (tracking.state == final_state)
+            {
+                continue;
+            }
+
+            tracked_barrier transition = {tracked_barrier_transition, m_resources[i].resource, all_subresources,
+                                          tracking.state, final_state, 0, nullptr};
+
+            add_barrier(transition, tracking.last_pass, previous_pass, command_list_after(previous_pass), &last.barriers_after);
+            tracking.state = final_state;
+        }
+    }
+    return true;
+}
+
+void render_graph::execute(const std::function<void(const std::vector<tracked_barrier> &, uint32_t)> &emit) const
+{
+    if (!m_initial_barriers.empty())
+    {
+        emit(m_initial_barriers, 0);
+    }
+
+    for (size_t i = 0; i < m_num_active_passes; i++)
+    {
+        const render_graph_pass &pass = m_passes[i];
+        if (pass.is_culled)
+        {
+            continue;
+        }
+
+        if (!pass.barriers_before.empty())
+        {
+            emit(pass.barriers_before, pass.command_list);
+        }
+
+        if (pass.execute)
+        {
+            pass.execute();
+        }
+
+        if (!pass.barriers_after.empty())
+        {
+            emit(pass.barriers_after, command_list_after((int)i));
+        }
+    }
+}
+
+const char *render_graph::resource_name(const void *resource) const
+{
+    for (size_t i = 0; i < m_num_active_resources; i++)
+    {
+        if (m_resources[i].resource == resource)
+        {
+            return m_resources[i].name.c_str();
+        }
+    }
+    return "?";
+}
+
+std::string render_graph::dump() const
+{
+    std::stringstream stream;
+    stream << "Render graph: " << (m_num_active_passes - m_num_culled) << " passes, "
+           << m_num_culled << " culled, "
+           << m_num_barriers << " barriers (" << m_num_split_barriers << " split)\n";
+
+    auto dump_barriers = [&](const std::vector<tracked_barrier> &barriers) {
+        for (const tracked_barrier &barrier : barriers)
+        {
+            const char *kind = "barrier";
+            if (barrier.type == tracked_barrier_uav)
+            {
+                stream << "    uav      " << resource_name(barrier.resource) << "\n";
+                continue;
+            }
+
+            if (barrier.type == tracked_barrier_aliasing)
+            {
+                stream << "    alias    " << (barrier.resource_before ? resource_name(barrier.resource_before) : "any")
+                       << " -> " << resource_name(barrier.resource) << "\n";
+                continue;
+            }
+
+            if (barrier.flags == tracked_barrier_begin_only)
+            {
+                kind = "begin  ";
+            }
+            else if (barrier.flags == tracked_barrier_end_only)
+            {
+                kind = "end    ";
+            }
+            stream << "    " << kind << "  " << resource_name(barrier.resource) << ": "
+                   << resource_state_name(barrier.before) << " -> " << resource_state_name(barrier.after) << "\n";
+        }
+    };
+
+    if (!m_initial_barriers.empty())
+    {
+        stream << "[start]\n";
+        dump_barriers(m_initial_barriers);
+    }
+
+    int index = 0;
+    for (size_t i = 0; i < m_num_active_passes; i++)
+    {
+        const render_graph_pass &pass = m_passes[i];
+        if (pass.is_culled)
+        {
+            stream << "[culled] " << pass.name << "\n";
+            continue;
+        }
+
+        stream << "[" << index++ << "] " << pass.name << (pass.has_side_effects ? " (side effects)" : "")
+               << (pass.ends_command_list ? " (ends command list)" : "") << "\n";
+        dump_barriers(pass.barriers_before);
+        for (const render_graph_access &access : pass.accesses)
+        {
+            stream << "    " << (access.is_write ? "write  " : "read   ") << "  "
+                   << m_resources[access.resource].name << " as " << resource_state_name(access.state) << "\n";
+        }
+        dump_barriers(pass.barriers_after);
+    }
+    return stream.str();
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include "common_api.h"
+#include "resource_state_tracker.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+// Render graph.
+// Passes declare the resources they read and write, compile() culls the passes whose outputs are never used
+// and computes the barriers between the remaining passes. Transitions that have at least one unrelated pass
+// between the last use of a resource and the next one are split into begin/end barriers.
+// The passes can be spread over several command lists, split barriers never cross from one list to the next.
+// This file is device independent: barriers use the tracked_barrier format and are recorded by the caller.
+
+typedef uint32_t render_graph_handle;
+static const render_graph_handle render_graph_invalid = 0xffffffff;
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+struct render_graph_access
+{
+    render_graph_handle resource;
+    uint32_t state;
+    bool is_write;
+};
+
+struct render_graph_pass
+{
+    std::string name;
+    std::function<void()> execute;
+    std::vector<render_graph_access> accesses;
+    bool has_side_effects = false; // Never culled, e.g. UI rendering into the back buffer.
+    bool is_culled = false;
+    bool ends_command_list = false; // The barriers after the pass and the next passes go to the next command list.
+    uint32_t command_list = 0;      // Command list of the barriers before the pass and of the pass itself.
+    std::vector<tracked_barrier> barriers_before;
+    std::vector<tracked_barrier> barriers_after;
+};
+
+struct render_graph_resource
+{
+    std::string name;
+    const void *resource;
+    uint32_t initial_state;
+    uint32_t final_state; // State the resource is left in at the end of the graph.
+    bool is_output;
+    bool is_aliased;
+    const void *aliased_before;
+};
+
+class COMMON_API render_graph
+{
+public:
+    render_graph() = default;
+    ~render_graph() = default;
+
+    // Removes every pass and resource, the allocations are kept for the next frame.
+    void reset();
+
+    // final_state defaults to initial_state so that the next frame starts from the same state.
+    render_graph_handle import_resource(const char *name, const void *resource, uint32_t initial_state,
+                                        uint32_t final_state = resource_state_unknown);
+
+    // The content of output resources is used after the graph, e.g. the back buffer.
+    void set_output(render_graph_handle resource);
+
+    // The resource is placed in memory that another resource used before the graph, e.g. the render target of the
+    // previous frame. An aliasing barrier is issued before the first pass, previous is nullptr when it isn't known.
+    // The first pass that uses the resource must initialize it with a clear, a discard or a copy.
+    void set_aliased(render_graph_handle resource, const void *previous = nullptr);
+
+    render_graph_handle add_pass(const char *name, std::function<void()> execute, bool has_side_effects = false);
+    void read(render_graph_handle pass, render_graph_handle resource, uint32_t state);
+    void write(render_graph_handle pass, render_graph_handle resource, uint32_t state);
+
+    // The passes after this one are recorded on the next command list, e.g. when the pass records its work on
+    // lists that are submitted between the two. The break stays where it is if the pass is culled.
+    void end_command_list(render_graph_handle pass);
+
+    // Returns false if a pass uses a resource in two states that can't be combined.
+    bool compile(std::string *error = nullptr);
+
+    // Runs the passes in order, emit() records the barriers that surround them on the given command list,
+    // 0 being the list of the first pass.
+    void execute(const std::function<void(const std::vector<tracked_barrier> &, uint32_t)> &emit) const;
+
+    // Human readable schedule: passes, culled passes and barriers.
+    std::string dump() const;
+
+    size_t num_passes() const { return m_num_active_passes; }
+    const render_graph_pass &pass(size_t index) const { return m_passes[index]; }
+    size_t num_resources() const { return m_num_active_resources; }
+    const render_graph_resource &resource(size_t index) const { return m_resources[index]; }
+
+    // Statistics of the last compile.
+    uint32_t m_num_culled = 0;
+    uint32_t m_num_barriers = 0;
+    uint32_t m_num_split_barriers = 0;
+
+private:
+    struct resource_tracking
+    {
+        uint32_t state;
+        int last_pass;
+        bool last_was_write;
+    };
+
+    struct pass_usage
+    {
+        render_graph_handle resource;
+        uint32_t state;
+        bool is_write;
+    };
+
+    const char *resource_name(const void *resource) const;
+    uint32_t command_list_after(int pass) const;
+    void add_barrier(tracked_barrier barrier, int last_pass, int previous_pass, uint32_t command_list,
+                     std::vector<tracked_barrier> *target);
+
+    std::vector<render_graph_pass> m_passes;
+    std::vector<render_graph_resource> m_resources;
+    size_t m_num_active_passes = 0;
+    size_t m_num_active_resources = 0;
+    std::vector<tracked_barrier> m_initial_barriers; // Aliasing barriers and begin halves of split barriers issued before the first pass.
+    std::vector<uint8_t> m_is_needed;
+    std::vector<resource_tracking> m_tracking;
+    std::vector<pass_usage> m_pass_usages;
+};
+
+// Writes a readable name for a state made of D3D12_RESOURCE_STATES flags.
+COMMON_API std::string resource_state_name(uint32_t state);
+
+#pragma warning(pop)
@@ -0,0 +1,329 @@
+#include "resource_state_tracker.h"
+#include <assert.h>
+
+bool is_state_compatible(uint32_t current, uint32_t required)
+{
+    if (current == required)
+    {
+        return true;
+    }
+
+    // COMMON is zero and can't be combined with anything else.
+    if (current == 0 || required == 0)
+    {
+        return false;
+    }
+
+    // A combined read state satisfies any subset of its reads.
+    bool is_read = (required & ~resource_state_read_mask) == 0;
+    return is_read && (current & required) == required;
+}
+
+// A pending transition to the state it starts from, left by a merge until the flush.
+static bool is_removed_barrier(const tracked_barrier &barrier)
+{
+    return barrier.type == tracked_barrier_transition && barrier.before == barrier.after;
+}
+
+void resource_state_tracker::reset()
+{
+    m_resources.clear();
+    m_pending.clear();
+    m_num_removed_pending = 0;
+    m_pending_generation++;
+    m_initial.clear();
+    m_requested_count = 0;
+    m_removed_count = 0;
+    m_flushed_count = 0;
+}
+
+resource_state_tracker::entry &resource_state_tracker::get_entry(const void *resource, uint32_t num_subresources)
+{
+    entry &e = m_resources[resource];
+    if (e.subresource_states.size() < num_subresources)
+    {
+        e.subresource_states.resize(num_subresources, e.state);
+    }
+    return e;
+}
+
+void resource_state_tracker::add_transition(const void *resource, entry *e, uint32_t subresource, uint32_t before, uint32_t after)
+{
+    // A pending transition of the same subresource is merged: A->B followed by B->C becomes A->C.
+    // The entry knows the last pending barrier of the resource, the list is only searched back from it when that
+    // barrier was removed by an earlier merge.
+    size_t last = (e->pending_generation == m_pending_generation) ? e->last_pending + 1 : 0;
+    for (size_t i = last; i-- > 0;)
+    {
+        tracked_barrier &pending = m_pending[i];
+        if (pending.resource != resource || is_removed_barrier(pending))
+        {
+            continue;
+        }
+
+        if (pending.type == tracked_barrier_uav || pending.subresource != subresource)
+        {
+            // The order with the UAV barrier or the other subresources must be kept.
+            break;
+        }
+
+        pending.after = after;
+        m_removed_count++;
+        if (pending.before == pending.after)
+        {
+            // A->B->A, both transitions are removed.
+            m_num_removed_pending++;
+            m_removed_count++;
+        }
+        return;
+    }
+
+    tracked_barrier barrier = {tracked_barrier_transition, resource, subresource, before, after, 0, nullptr};
+    e->last_pending = (uint32_t)m_pending.size();
+    e->pending_generation = m_pending_generation;
+    m_pending.push_back(barrier);
+}
+
+void resource_state_tracker::require_one(const void *resource, entry *e, uint32_t *current, uint32_t state, uint32_t subresource)
+{
+    if (*current == resource_state_unknown)
+    {
+        tracked_barrier initial = {tracked_barrier_transition, resource, subresource, resource_state_unknown, state, 0, nullptr};
+        m_initial.push_back(initial);
+        *current = state;
+        return;
+    }
+
+    if (is_state_compatible(*current, state))
+    {
+        m_removed_count++;
+        return;
+    }
+
+    // Reads are combined so that switching between read states only costs one barrier.
+    uint32_t after = state;
+    bool current_is_read = (*current & ~resource_state_read_mask) == 0 && *current != 0;
+    bool required_is_read = (state & ~resource_state_read_mask) == 0 && state != 0;
+    if (current_is_read && required_is_read)
+    {
+        after = *current | state;
+    }
+
+    add_transition(resource, e, subresource, *current, after);
+    *current = after;
+}
+
+void resource_state_tracker::require(const void *resource, uint32_t state, uint32_t subresource, uint32_t num_subresources)
+{
+    m_requested_count++;
+    entry &e = get_entry(resource, subresource == all_subresources ? 0 : num_subresources);
+
+    if (subresource != all_subresources)
+    {
+        if (e.is_uniform)
+        {
+            e.is_uniform = false;
+            e.subresource_states.assign(num_subresources, e.state);
+        }
+        assert(subresource < e.subresource_states.size());
+        require_one(resource, &e, &e.subresource_states[subresource], state, subresource);
+        return;
+    }
+
+    if (e.is_uniform)
+    {
+        require_one(resource, &e, &e.state, state, all_subresources);
+        return;
+    }
+
+    // The subresources were used individually, each one is brought to the new state.
+    for (uint32_t i = 0; i < (uint32_t)e.subresource_states.size(); i++)
+    {
+        require_one(resource, &e, &e.subresource_states[i], state, i);
+    }
+
+    bool is_uniform = true;
+    for (uint32_t sub_state : e.subresource_states)
+    {
+        is_uniform &= sub_state == e.subresource_states[0];
+    }
+
+    if (is_uniform && !e.subresource_states.empty())
+    {
+        e.is_uniform = true;
+        e.state = e.subresource_states[0];
+    }
+}
+
+void resource_state_tracker::require_uav(const void *resource)
+{
+    m_requested_count++;
+    for (const tracked_barrier &pending : m_pending)
+    {
+        if (pending.type == tracked_barrier_uav && pending.resource == resource)
+        {
+            m_removed_count++;
+            return;
+        }
+    }
+
+    // The transitions of the resource after this barrier are not merged across it.
+    auto it = m_resources.find(resource);
+    if (it != m_resources.end())
+    {
+        it->second.last_pending = (uint32_t)m_pending.size();
+        it->second.pending_generation = m_pending_generation;
+    }
+
+    tracked_barrier barrier = {tracked_barrier_uav, resource, all_subresources, resource_state_unordered_access, resource_state_unordered_access, 0, nullptr};
+    m_pending.push_back(barrier);
+}
+
+void resource_state_tracker::assume(const void *resource, uint32_t before, uint32_t after, uint32_t subresource, uint32_t num_subresources)
+{
+    entry &e = get_entry(resource, subresource == all_subresources ? 0 : num_subresources);
+
+    uint32_t *current = &e.state;
+    if (subresource != all_subresources)
+    {
+        if (e.is_uniform)
+        {
+            e.is_uniform = false;
+            e.subresource_states.assign(num_subresources, e.state);
+        }
+        assert(subresource < e.subresource_states.size());
+        current = &e.subresource_states[subresource];
+    }
+    else if (!e.is_uniform)
+    {
+        e.is_uniform = true;
+        e.subresource_states.clear();
+    }
+
+    // The caller knows the "before" state, so no initial requirement is recorded for it.
+    (void)before;
+    *current = after;
+}
+
+void resource_state_tracker::flush(std::vector<tracked_barrier> *out)
+{
+    for (const tracked_barrier &pending : m_pending)
+    {
+        if (!is_removed_barrier(pending))
+        {
+            out->push_back(pending);
+        }
+    }
+    m_flushed_count += (uint32_t)m_pending.size() - m_num_removed_pending;
+    m_pending.clear();
+    m_num_removed_pending = 0;
+    m_pending_generation++;
+}
+
+void resource_state_registry::register_resource(const void *resource, uint32_t state, uint32_t num_subresources)
+{
+    entry &e = m_resources[resource];
+    e.subresource_states.assign(num_subresources == 0 ? 1 : num_subresources, state);
+}
+
+void resource_state_registry::unregister_resource(const void *resource)
+{
+    m_resources.erase(resource);
+}
+
+bool resource_state_registry::is_registered(const void *resource) const
+{
+    return m_resources.find(resource) != m_resources.end();
+}
+
+uint32_t resource_state_registry::num_subresources(const void *resource) const
+{
+    auto it = m_resources.find(resource);
+    return it == m_resources.end() ? 1 : (uint32_t)it->second.subresource_states.size();
+}
+
+uint32_t resource_state_registry::state(const void *resource, uint32_t subresource) const
+{
+    auto it = m_resources.find(resource);
+    if (it == m_resources.end() || subresource >= it->second.subresource_states.size())
+    {
+        return resource_state_unknown;
+    }
+    return it->second.subresource_states[subresource];
+}
+
+void resource_state_registry::resolve(const resource_state_tracker &list, std::vector<tracked_barrier> *fixups)
+{
+    for (const tracked_barrier &initial : list.initial_requirements())
+    {
+        auto it = m_resources.find(initial.resource);
+        if (it == m_resources.end())
+        {
+            continue;
+        }
+
+        std::vector<uint32_t> &states = it->second.subresource_states;
+        if (initial.subresource != all_subresources)
+        {
+            // The list and the registry must agree on the number of subresources of the resource.
+            assert(initial.subresource < states.size());
+            if (initial.subresource < states.size() && states[initial.subresource] != initial.after)
+            {
+                tracked_barrier fixup = {tracked_barrier_transition, initial.resource, initial.subresource, states[initial.subresource], initial.after, 0, nullptr};
+                fixups->push_back(fixup);
+                states[initial.subresource] = initial.after;
+            }
+            continue;
+        }
+
+        bool is_uniform = true;
+        for (uint32_t sub_state : states)
+        {
+            is_uniform &= sub_state == states[0];
+        }
+
+        // The list expects the exact state it recorded its barriers against, not just a compatible one.
+        if (is_uniform)
+        {
+            if (states[0] != initial.after)
+            {
+                tracked_barrier fixup = {tracked_barrier_transition, initial.resource, all_subresources, states[0], initial.after, 0, nullptr};
+                fixups->push_back(fixup);
+            }
+        }
+        else
+        {
+            for (uint32_t i = 0; i < (uint32_t)states.size(); i++)
+            {
+                if (states[i] != initial.after)
+                {
+                    tracked_barrier fixup = {tracked_barrier_transition, initial.resource, i, states[i], initial.after, 0, nullptr};
+                    fixups->push_back(fixup);
+                }
+            }
+        }
+        states.assign(states.size(), initial.after);
+    }
+
+    list.for_each_final_state([this](const void *resource, uint32_t subresource, uint32_t state) {
+        auto it = m_resources.find(resource);
+        if (it == m_resources.end() || state == resource_state_unknown)
+        {
+            return;
+        }
+
+        std::vector<uint32_t> &states = it->second.subresource_states;
+        if (subresource == all_subresources)
+        {
+            states.assign(states.size(), state);
+        }
+        else
+        {
+            assert(subresource < states.size());
+            if (subresource < states.size())
+            {
+                states[subresource] = state;
+            }
+        }
+    });
+}
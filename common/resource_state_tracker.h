@@ -0,0 +1,157 @@
+#pragma once
+#include "common_api.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Resource state tracking and barrier batching.
+// Device independent: resources are opaque pointers and states use the values of D3D12_RESOURCE_STATES.
+
+static const uint32_t all_subresources = 0xffffffff;  // D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES
+static const uint32_t resource_state_unknown = 0xffffffff;
+
+// Read-only states, any combination of them can be used at the same time without a barrier.
+// VERTEX_AND_CONSTANT_BUFFER | INDEX_BUFFER | DEPTH_READ | NON_PIXEL_SHADER_RESOURCE | PIXEL_SHADER_RESOURCE | INDIRECT_ARGUMENT | COPY_SOURCE
+static const uint32_t resource_state_read_mask = 0x1 | 0x2 | 0x20 | 0x40 | 0x80 | 0x200 | 0x800;
+static const uint32_t resource_state_unordered_access = 0x8;
+
+enum tracked_barrier_type
+{
+    tracked_barrier_transition,
+    tracked_barrier_uav,
+    tracked_barrier_aliasing // resource takes over the memory of resource_before, nullptr for any placed resource.
+};
+
+// Split barrier flags, same values as D3D12_RESOURCE_BARRIER_FLAGS.
+static const uint32_t tracked_barrier_begin_only = 0x1;
+static const uint32_t tracked_barrier_end_only = 0x2;
+
+struct tracked_barrier
+{
+    tracked_barrier_type type;
+    const void *resource;
+    uint32_t subresource;
+    uint32_t before;
+    uint32_t after;
+    uint32_t flags;
+    const void *resource_before; // Aliasing barriers only.
+};
+
+// Returns true if a resource in the current state can be used as required without a barrier.
+COMMON_API bool is_state_compatible(uint32_t current, uint32_t required);
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+// Per command list tracker.
+// Callers declare the state each resource must be in, the tracker batches the transitions until the next flush.
+// The first use of a resource in a list has no known "before" state, it is recorded as an initial requirement
+// and resolved against the queue's state when the list is submitted.
+class COMMON_API resource_state_tracker
+{
+public:
+    resource_state_tracker() = default;
+    ~resource_state_tracker() = default;
+
+    void reset();
+
+    // Declares the state the resource must be in for the next GPU command.
+    void require(const void *resource, uint32_t state, uint32_t subresource = all_subresources, uint32_t num_subresources = 1);
+
+    // Orders unordered access writes to a resource with the next GPU command.
+    void require_uav(const void *resource);
+
+    // Records a barrier that was issued outside of the tracker.
+    // Hand-coded barriers state their "before" explicitly and are trusted, only the resulting state is tracked.
+    void assume(const void *resource, uint32_t before, uint32_t after, uint32_t subresource = all_subresources, uint32_t num_subresources = 1);
+
+    bool has_pending() const { return m_pending.size() > m_num_removed_pending; }
+
+    // Appends the pending barriers to out and clears them.
+    void flush(std::vector<tracked_barrier> *out);
+
+    // State the list expects each resource to be in when it starts executing, before is always unknown.
+    const std::vector<tracked_barrier> &initial_requirements() const { return m_initial; }
+
+    // Calls fn(resource, subresource, state) for the state each resource is left in at the end of the list.
+    template <typename F>
+    void for_each_final_state(F fn) const
+    {
+        for (const auto &pair : m_resources)
+        {
+            const entry &e = pair.second;
+            if (e.is_uniform)
+            {
+                fn(pair.first, all_subresources, e.state);
+                continue;
+            }
+
+            for (uint32_t i = 0; i < (uint32_t)e.subresource_states.size(); i++)
+            {
+                if (e.subresource_states[i] != resource_state_unknown)
+                {
+                    fn(pair.first, i, e.subresource_states[i]);
+                }
+            }
+        }
+    }
+
+    // Statistics since the last reset.
+    uint32_t m_requested_count = 0;
+    uint32_t m_removed_count = 0;
+    uint32_t m_flushed_count = 0;
+
+private:
+    struct entry
+    {
+        bool is_uniform = true;
+        uint32_t state = resource_state_unknown;
+        std::vector<uint32_t> subresource_states;
+        uint32_t last_pending = 0;       // Index of the last pending barrier of the resource,
+        uint32_t pending_generation = 0; // when this is m_pending_generation.
+    };
+
+    entry &get_entry(const void *resource, uint32_t num_subresources);
+    void require_one(const void *resource, entry *e, uint32_t *current, uint32_t state, uint32_t subresource);
+    void add_transition(const void *resource, entry *e, uint32_t subresource, uint32_t before, uint32_t after);
+
+    std::unordered_map<const void *, entry> m_resources;
+    std::vector<tracked_barrier> m_pending; // Merged A->B->A transitions stay as removed entries until the flush.
+    uint32_t m_num_removed_pending = 0;
+    uint32_t m_pending_generation = 1; // Changes when m_pending is cleared.
+    std::vector<tracked_barrier> m_initial;
+};
+
+// Resource states as of the last resolved command list, shared by every queue of the device.
+// D3D12 resource states are not per queue: a resource used on the compute queue and then on the direct queue has one
+// state, which the second queue's list is patched against. This is only correct when the lists are resolved in the
+// order the GPU executes them, i.e. work on the other queue that uses the same resources is ordered with fences and
+// submitted after the lists it waits on.
+// Resources that were never registered are not tracked and never get fixup barriers.
+class COMMON_API resource_state_registry
+{
+public:
+    resource_state_registry() = default;
+    ~resource_state_registry() = default;
+
+    void register_resource(const void *resource, uint32_t state, uint32_t num_subresources = 1);
+    void unregister_resource(const void *resource);
+    bool is_registered(const void *resource) const;
+    uint32_t num_subresources(const void *resource) const;
+    uint32_t state(const void *resource, uint32_t subresource = 0) const;
+
+    // Appends the barriers needed before the list can execute to fixups, then commits the list's final states.
+    // Lists must be resolved in the order they are submitted, on every queue.
+    // Subresource indices must be below the number of subresources the resource was registered with.
+    void resolve(const resource_state_tracker &list, std::vector<tracked_barrier> *fixups);
+
+private:
+    struct entry
+    {
+        std::vector<uint32_t> subresource_states;
+    };
+    std::unordered_map<const void *, entry> m_resources;
+};
+
+#pragma warning(pop)
@@ -0,0 +1,137 @@
+#include "rolling_stats.h"
+#include <algorithm>
+#include <math.h>
+
+rolling_stats::rolling_stats(uint32_t window)
+{
+    set_window(window);
+}
+
+void rolling_stats::set_window(uint32_t window)
+{
+    m_samples.assign((std::max)(window, 1u), 0.0);
+    m_buckets.assign(num_buckets, 0);
+    clear();
+}
+
+void rolling_stats::clear()
+{
+    std::fill(m_buckets.begin(), m_buckets.end(), 0);
+    m_next = 0;
+    m_count = 0;
+    m_sum = 0.0;
+    m_sum_squares = 0.0;
+}
+
+uint32_t rolling_stats::bucket_of(double value)
+{
+    if (!(value > min_value))
+    {
+        return 0;
+    }
+    double bucket = floor(log2(value / min_value) * buckets_per_octave) + 1.0;
+    return (uint32_t)(std::min)(bucket, (double)(num_buckets - 1));
+}
+
+double rolling_stats::bucket_lower_bound(uint32_t bucket)
+{
+    return bucket == 0 ? 0.0 : min_value * exp2((double)(bucket - 1) / buckets_per_octave);
+}
+
+void rolling_stats::add(double value)
+{
+    uint32_t window = (uint32_t)m_samples.size();
+    if (m_count == window)
+    {
+        double removed = m_samples[m_next];
+        m_buckets[bucket_of(removed)]--;
+        m_sum -= removed;
+        m_sum_squares -= removed * removed;
+    }
+    else
+    {
+        m_count++;
+    }
+
+    m_samples[m_next] = value;
+    m_buckets[bucket_of(value)]++;
+    m_sum += value;
+    m_sum_squares += value * value;
+    m_next = (m_next + 1) % window;
+
+    // The sums drift as samples are added and removed, they are recomputed each time the window is filled again.
+    if (m_next == 0)
+    {
+        m_sum = 0.0;
+        m_sum_squares = 0.0;
+        for (uint32_t i = 0; i < m_count; i++)
+        {
+            m_sum += m_samples[i];
+            m_sum_squares += m_samples[i] * m_samples[i];
+        }
+    }
+}
+
+void rolling_stats::min_max(double *min, double *max) const
+{
+    // The first count samples are the window, in any order.
+    *min = *max = m_samples[0];
+    for (uint32_t i = 1; i < m_count; i++)
+    {
+        *min = (std::min)(*min, m_samples[i]);
+        *max = (std::max)(*max, m_samples[i]);
+    }
+}
+
+double rolling_stats::percentile(double p) const
+{
+    if (m_count == 0)
+    {
+        return 0.0;
+    }
+
+    // Rank of the sample in [1, count], interpolated inside its bucket on a logarithmic scale.
+    double rank = (std::max)((std::min)(p, 1.0) * m_count, 1.0);
+    double below = 0.0;
+    for (uint32_t bucket = 0; bucket < num_buckets; bucket++)
+    {
+        uint32_t count = m_buckets[bucket];
+        if (count == 0 || below + count < rank)
+        {
+            below += count;
+            continue;
+        }
+
+        double fraction = (rank - below) / count;
+        double lower = bucket_lower_bound(bucket);
+        double upper = bucket_lower_bound(bucket + 1);
+        double value = bucket == 0 ? upper * fraction : lower * pow(upper / lower, fraction);
+
+        // The exact extremes are known, the interpolation can't go past them.
+        double min = 0.0;
+        double max = 0.0;
+        min_max(&min, &max);
+        return (std::min)((std::max)(value, min), max);
+    }
+    return 0.0;
+}
+
+rolling_summary rolling_stats::summary() const
+{
+    rolling_summary summary;
+    summary.count = m_count;
+    if (m_count == 0)
+    {
+        return summary;
+    }
+
+    uint32_t window = (uint32_t)m_samples.size();
+    summary.last = m_samples[(m_next + window - 1) % window];
+    min_max(&summary.min, &summary.max);
+    summary.mean = m_sum / m_count;
+    summary.stddev = sqrt((std::max)(m_sum_squares / m_count - summary.mean * summary.mean, 0.0));
+    summary.p50 = percentile(0.50);
+    summary.p95 = percentile(0.95);
+    summary.p99 = percentile(0.99);
+    return summary;
+}
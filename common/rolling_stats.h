@@ -0,0 +1,65 @@
+#pragma once
+#include "common_api.h"
+#include <stdint.h>
+#include <vector>
+
+// Statistics of the last samples of a value, e.g. the duration of a timer over the last frames.
+// The window keeps the samples to remove them when they get out of it. The percentiles come from a histogram of
+// the window with logarithmic buckets, buckets_per_octave per doubling, so their relative error stays under
+// 2^(1/buckets_per_octave) - 1 (4.4%) whatever the value. The memory is fixed once the window is set.
+// The samples are expected to be positive, the ones under min_value share the first bucket.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+struct rolling_summary
+{
+    uint32_t count = 0;
+    double last = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    double mean = 0.0;
+    double stddev = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+};
+
+class COMMON_API rolling_stats
+{
+public:
+    static const uint32_t default_window = 256;
+    static constexpr double min_value = 0.0001; // 100 ns in milliseconds.
+    static const uint32_t buckets_per_octave = 16;
+    static const uint32_t num_octaves = 28; // Up to min_value * 2^28, 7.4 hours in milliseconds.
+    static const uint32_t num_buckets = buckets_per_octave * num_octaves + 1;
+
+    rolling_stats(uint32_t window = default_window);
+    ~rolling_stats() = default;
+
+    // Clears the samples.
+    void set_window(uint32_t window);
+    uint32_t window() const { return (uint32_t)m_samples.size(); }
+
+    void add(double value);
+    void clear();
+    uint32_t count() const { return m_count; }
+
+    // p in [0, 1], the value under which that fraction of the samples of the window are.
+    double percentile(double p) const;
+    rolling_summary summary() const;
+
+private:
+    static uint32_t bucket_of(double value);
+    static double bucket_lower_bound(uint32_t bucket);
+    void min_max(double *min, double *max) const;
+
+    std::vector<double> m_samples; // Ring buffer of the window.
+    uint32_t m_next = 0;
+    uint32_t m_count = 0;
+    std::vector<uint32_t> m_buckets;
+    double m_sum = 0.0;
+    double m_sum_squares = 0.0;
+};
+
+#pragma warning(pop)
@@ -0,0 +1,430 @@
+#include "rootsig_layout.h"
+#include <algorithm>
+#include <cstring>
+
+static const char *stage_names[SHADERSTAGE_MAX] = {"vs", "hs", "ds", "gs", "ps", "cs"};
+static const char *descriptor_type_names[DESCRIPTORTYPE_MAX] = {"cbv", "srv", "uav", "sampler"};
+
+const char *shader_stage_name(shader_stages stage)
+{
+    return stage < SHADERSTAGE_MAX ? stage_names[stage] : "all";
+}
+
+const char *descriptor_type_name(shader_descriptor_type type)
+{
+    return type < DESCRIPTORTYPE_MAX ? descriptor_type_names[type] : "unknown";
+}
+
+int rootsig_layout::find_parameter(shader_descriptor_type type, uint32_t shader_register, uint32_t space,
+                                   shader_stages stage, uint32_t *table_offset) const
+{
+    for (size_t i = 0; i < parameters.size(); i++)
+    {
+        const rootsig_parameter &param = parameters[i];
+        if (stage != SHADERSTAGE_MAX && param.visibility != SHADERSTAGE_MAX && param.visibility != stage)
+        {
+            continue;
+        }
+
+        if (param.type == rootsig_table)
+        {
+            for (const rootsig_range &range : param.ranges)
+            {
+                if (range.type == type && range.space == space &&
+                    shader_register >= range.base_register &&
+                    shader_register < range.base_register + range.count)
+                {
+                    if (table_offset)
+                    {
+                        *table_offset = range.table_offset + (shader_register - range.base_register);
+                    }
+                    return (int)i;
+                }
+            }
+            continue;
+        }
+
+        bool is_cbv = (param.type == rootsig_cbv || param.type == rootsig_constants) && type == CBV;
+        bool is_srv = param.type == rootsig_srv && type == SRV;
+        bool is_uav = param.type == rootsig_uav && type == UAV;
+        if ((is_cbv || is_srv || is_uav) && param.shader_register == shader_register && param.space == space)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// A binding merged across every stage of the PSO that references it.
+struct merged_binding
+{
+    shader_binding binding;
+    uint32_t stage_mask;
+};
+
+static shader_stages visibility_from_mask(uint32_t stage_mask)
+{
+    for (int stage = 0; stage < SHADERSTAGE_MAX; stage++)
+    {
+        if (stage_mask == (1u << stage))
+        {
+            return (shader_stages)stage;
+        }
+    }
+    return SHADERSTAGE_MAX;
+}
+
+static bool binding_order(const merged_binding &a, const merged_binding &b)
+{
+    if (a.binding.type != b.binding.type)
+    {
+        return a.binding.type < b.binding.type;
+    }
+    if (a.binding.space != b.binding.space)
+    {
+        return a.binding.space < b.binding.space;
+    }
+    return a.binding.bind_point < b.binding.bind_point;
+}
+
+// Packs bindings into the ranges of one descriptor table, merging contiguous registers.
+static rootsig_parameter build_table(std::vector<merged_binding> bindings, shader_stages visibility, uint32_t *descriptor_count)
+{
+    std::sort(bindings.begin(), bindings.end(), binding_order);
+
+    rootsig_parameter table = {};
+    table.type = rootsig_table;
+    table.visibility = visibility;
+
+    uint32_t offset = 0;
+    for (const merged_binding &mb : bindings)
+    {
+        const shader_binding &b = mb.binding;
+        if (!table.ranges.empty())
+        {
+            rootsig_range &last = table.ranges.back();
+            uint32_t last_end = last.base_register + last.count;
+            if (last.type == b.type && last.space == b.space && b.bind_point <= last_end)
+            {
+                // Contiguous or overlapping registers extend the previous range.
+                uint32_t end = std::max(last_end, b.bind_point + b.bind_count);
+                offset += end - last_end;
+                last.count = end - last.base_register;
+                continue;
+            }
+        }
+
+        rootsig_range range = {};
+        range.type = b.type;
+        range.base_register = b.bind_point;
+        range.space = b.space;
+        range.count = b.bind_count;
+        range.table_offset = offset;
+        table.ranges.push_back(range);
+        offset += b.bind_count;
+    }
+
+    *descriptor_count += offset;
+    return table;
+}
+
+rootsig_layout build_rootsig_layout(const std::vector<shader_reflection> &stages, const rootsig_layout_options &options)
+{
+    // Merge the bindings of every stage, a resource read by several stages is bound once.
+    // Stages that use the same register for different resources keep their own binding, e.g. the object
+    // constants of the vertex and of the pixel shader.
+    std::vector<merged_binding> merged;
+    for (const shader_reflection &reflection : stages)
+    {
+        for (const shader_binding &binding : reflection.bindings)
+        {
+            bool found = false;
+            for (merged_binding &mb : merged)
+            {
+                if (mb.binding.type == binding.type &&
+                    mb.binding.space == binding.space &&
+                    mb.binding.bind_point == binding.bind_point &&
+                    mb.binding.name == binding.name)
+                {
+                    mb.stage_mask |= 1u << reflection.stage;
+                    mb.binding.bind_count = std::max(mb.binding.bind_count, binding.bind_count);
+                    mb.binding.size = std::max(mb.binding.size, binding.size);
+                    found = true;
+                    break;
+                }
+            }
+
+            if (!found)
+            {
+                merged_binding mb = {binding, 1u << reflection.stage};
+                merged.push_back(mb);
+            }
+        }
+    }
+
+    // Decide which constant buffers can live directly in the root signature.
+    std::vector<rootsig_parameter> root_params;
+    std::vector<merged_binding> table_bindings;
+    for (const merged_binding &mb : merged)
+    {
+        const shader_binding &b = mb.binding;
+        if (b.type == CBV && b.bind_count == 1)
+        {
+            uint32_t dwords = (b.size + 3) / 4;
+            bool is_hot = std::find(options.hot_constant_buffers.begin(),
+                                    options.hot_constant_buffers.end(),
+                                    b.name) != options.hot_constant_buffers.end();
+
+            rootsig_parameter param = {};
+            param.visibility = visibility_from_mask(mb.stage_mask);
+            param.shader_register = b.bind_point;
+            param.space = b.space;
+            param.name = b.name;
+
+            if (b.size > 0 && dwords <= options.max_root_constant_dwords)
+            {
+                param.type = rootsig_constants;
+                param.num_32bit_values = dwords;
+                root_params.push_back(param);
+                continue;
+            }
+
+            if (is_hot)
+            {
+                param.type = rootsig_cbv;
+                root_params.push_back(param);
+                continue;
+            }
+        }
+        table_bindings.push_back(mb);
+    }
+
+    // Group the remaining bindings into one resource table and one sampler table per visibility.
+    rootsig_layout layout;
+    std::vector<rootsig_parameter> tables;
+    for (int visibility = 0; visibility <= SHADERSTAGE_MAX; visibility++)
+    {
+        std::vector<merged_binding> resources;
+        std::vector<merged_binding> samplers;
+        for (const merged_binding &mb : table_bindings)
+        {
+            if (visibility_from_mask(mb.stage_mask) != visibility)
+            {
+                continue;
+            }
+
+            if (mb.binding.type == sampler)
+            {
+                samplers.push_back(mb);
+            }
+            else
+            {
+                resources.push_back(mb);
+            }
+        }
+
+        if (!resources.empty())
+        {
+            tables.push_back(build_table(resources, (shader_stages)visibility, &layout.table_descriptor_count));
+        }
+        if (!samplers.empty())
+        {
+            tables.push_back(build_table(samplers, (shader_stages)visibility, &layout.sampler_descriptor_count));
+        }
+    }
+
+    // Tables always fit, root constants and root CBVs are kept while the budget allows it.
+    // Demoted constant buffers are appended to a table visible to every stage.
+    layout.cost_dwords = (uint32_t)tables.size();
+    std::vector<merged_binding> demoted;
+    for (const rootsig_parameter &param : root_params)
+    {
+        uint32_t cost = (param.type == rootsig_constants) ? param.num_32bit_values : 2;
+        if (layout.cost_dwords + cost <= options.max_cost_dwords)
+        {
+            layout.cost_dwords += cost;
+            layout.parameters.push_back(param);
+        }
+        else
+        {
+            merged_binding mb = {};
+            mb.binding.name = param.name;
+            mb.binding.type = CBV;
+            mb.binding.bind_point = param.shader_register;
+            mb.binding.bind_count = 1;
+            mb.binding.space = param.space;
+            mb.stage_mask = (1u << SHADERSTAGE_MAX) - 1;
+            demoted.push_back(mb);
+        }
+    }
+
+    if (!demoted.empty())
+    {
+        tables.push_back(build_table(demoted, SHADERSTAGE_MAX, &layout.table_descriptor_count));
+        layout.cost_dwords += 1;
+    }
+
+    layout.parameters.insert(layout.parameters.end(), tables.begin(), tables.end());
+    return layout;
+}
+
+bool compute_staging_usage(const std::vector<shader_reflection> &shaders,
+                           uint32_t space,
+                           const uint32_t limits[DESCRIPTORTYPE_MAX],
+                           staging_usage *out)
+{
+    memset(out, 0, sizeof(staging_usage));
+
+    bool fits = true;
+    for (const shader_reflection &shader : shaders)
+    {
+        for (const shader_binding &binding : shader.bindings)
+        {
+            if (binding.space != space)
+            {
+                continue;
+            }
+
+            uint32_t end = binding.bind_point + binding.bind_count;
+            if (end > limits[binding.type])
+            {
+                end = limits[binding.type];
+                fits = false;
+            }
+
+            uint32_t &count = out->count[shader.stage][binding.type];
+            count = std::max(count, end);
+        }
+    }
+    return fits;
+}
+
+// Appends one range per run of consecutive used registers, at the offset of the register in the staging table.
+static void append_register_ranges(const std::vector<bool> &used, shader_descriptor_type type, uint32_t space,
+                                   uint32_t table_offset, std::vector<rootsig_range> *ranges)
+{
+    uint32_t num_registers = (uint32_t)used.size();
+    for (uint32_t reg = 0; reg < num_registers; reg++)
+    {
+        if (!used[reg])
+        {
+            continue;
+        }
+
+        rootsig_range range = {};
+        range.type = type;
+        range.base_register = reg;
+        range.space = space;
+        range.table_offset = table_offset + reg;
+        while (reg < num_registers && used[reg])
+        {
+            range.count++;
+            reg++;
+        }
+        ranges->push_back(range);
+    }
+}
+
+rootsig_layout build_staging_rootsig_layout(const std::vector<shader_reflection> &shaders,
+                                            const rootsig_layout &root_bindings,
+                                            uint32_t space,
+                                            const uint32_t limits[DESCRIPTORTYPE_MAX])
+{
+    // Only the root constants and root descriptors are kept, the tables are replaced by the staging ones.
+    rootsig_layout root;
+    for (const rootsig_parameter &param : root_bindings.parameters)
+    {
+        if (param.type != rootsig_table)
+        {
+            root.parameters.push_back(param);
+        }
+    }
+
+    const uint32_t table_offsets[DESCRIPTORTYPE_MAX] = {0, limits[CBV], limits[CBV] + limits[SRV], 0};
+
+    rootsig_layout layout;
+    for (int stage = VS; stage < CS; stage++)
+    {
+        std::vector<bool> used[DESCRIPTORTYPE_MAX];
+        for (int type = 0; type < DESCRIPTORTYPE_MAX; type++)
+        {
+            used[type].resize(limits[type], false);
+        }
+
+        for (const shader_reflection &shader : shaders)
+        {
+            if (shader.stage != stage)
+            {
+                continue;
+            }
+
+            for (const shader_binding &binding : shader.bindings)
+            {
+                if (binding.space != space)
+                {
+                    continue;
+                }
+
+                uint32_t end = std::min(binding.bind_point + binding.bind_count, limits[binding.type]);
+                for (uint32_t reg = binding.bind_point; reg < end; reg++)
+                {
+                    if (root.find_parameter(binding.type, reg, space, (shader_stages)stage) < 0)
+                    {
+                        used[binding.type][reg] = true;
+                    }
+                }
+            }
+        }
+
+        rootsig_parameter resources = {};
+        resources.type = rootsig_table;
+        resources.visibility = (shader_stages)stage;
+        for (int type = CBV; type <= UAV; type++)
+        {
+            append_register_ranges(used[type], (shader_descriptor_type)type, space, table_offsets[type], &resources.ranges);
+        }
+
+        // A table needs at least one range, it points at the first constant buffer register that is not in the root.
+        if (resources.ranges.empty())
+        {
+            uint32_t reg = 0;
+            while (root.find_parameter(CBV, reg, space, (shader_stages)stage) >= 0)
+            {
+                reg++;
+            }
+
+            rootsig_range range = {CBV, reg, space, 1, reg};
+            resources.ranges.push_back(range);
+        }
+
+        rootsig_parameter samplers = {};
+        samplers.type = rootsig_table;
+        samplers.visibility = (shader_stages)stage;
+        append_register_ranges(used[sampler], sampler, space, table_offsets[sampler], &samplers.ranges);
+        if (samplers.ranges.empty())
+        {
+            rootsig_range range = {sampler, 0, space, 1, 0};
+            samplers.ranges.push_back(range);
+        }
+
+        for (const rootsig_range &range : resources.ranges)
+        {
+            layout.table_descriptor_count += range.count;
+        }
+        for (const rootsig_range &range : samplers.ranges)
+        {
+            layout.sampler_descriptor_count += range.count;
+        }
+
+        layout.parameters.push_back(resources);
+        layout.parameters.push_back(samplers);
+        layout.cost_dwords += 2;
+    }
+
+    for (const rootsig_parameter &param : root.parameters)
+    {
+        layout.cost_dwords += (param.type == rootsig_constants) ? param.num_32bit_values : 2;
+        layout.parameters.push_back(param);
+    }
+    return layout;
+}
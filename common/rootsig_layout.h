@@ -0,0 +1,137 @@
+#pragma once
+#include "common_api.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Root signature layout generation from shader reflection data.
+// The reflection comes from the shaders compiled by the running process, nothing is read from disk.
+// This file is device independent: the layouts it produces are converted to
+// D3D12 root parameters by gpu_interface::create_rootsig.
+
+enum shader_stages
+{
+    VS,
+    HS,
+    DS,
+    GS,
+    PS,
+    CS,
+    SHADERSTAGE_MAX
+};
+
+enum shader_descriptor_type
+{
+    CBV,
+    SRV,
+    UAV,
+    sampler,
+    DESCRIPTORTYPE_MAX
+};
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+// A resource bound by a shader, as reported by D3DReflect.
+struct shader_binding
+{
+    std::string name;
+    shader_descriptor_type type;
+    uint32_t bind_point;
+    uint32_t bind_count;
+    uint32_t space;
+    uint32_t size; // Size in bytes of constant buffers, zero for other types.
+};
+
+struct shader_reflection
+{
+    shader_stages stage;
+    std::string entry;
+    std::vector<shader_binding> bindings;
+};
+
+COMMON_API const char *shader_stage_name(shader_stages stage);
+COMMON_API const char *descriptor_type_name(shader_descriptor_type type);
+
+enum rootsig_parameter_type
+{
+    rootsig_table,
+    rootsig_cbv,
+    rootsig_srv,
+    rootsig_uav,
+    rootsig_constants
+};
+
+struct rootsig_range
+{
+    shader_descriptor_type type;
+    uint32_t base_register;
+    uint32_t space;
+    uint32_t count;
+    uint32_t table_offset;
+};
+
+struct rootsig_parameter
+{
+    rootsig_parameter_type type;
+    shader_stages visibility; // SHADERSTAGE_MAX when visible to every stage.
+    uint32_t shader_register;
+    uint32_t space;
+    uint32_t num_32bit_values;
+    std::vector<rootsig_range> ranges; // Only used by descriptor tables.
+    std::string name;
+};
+
+struct rootsig_layout_options
+{
+    // Constant buffers up to this size are stored directly in the root signature.
+    uint32_t max_root_constant_dwords = 4;
+
+    // Constant buffers with these names are bound as root CBVs.
+    std::vector<std::string> hot_constant_buffers;
+
+    // Root signatures are limited to 64 DWORDs, anything over budget falls back to tables.
+    uint32_t max_cost_dwords = 64;
+};
+
+struct COMMON_API rootsig_layout
+{
+    std::vector<rootsig_parameter> parameters;
+    uint32_t cost_dwords = 0;
+    uint32_t table_descriptor_count = 0;
+    uint32_t sampler_descriptor_count = 0;
+
+    // Finds the root parameter a register is bound to.
+    // For descriptor tables, table_offset receives the offset of the descriptor from the table start.
+    int find_parameter(shader_descriptor_type type, uint32_t shader_register, uint32_t space,
+                       shader_stages stage = SHADERSTAGE_MAX, uint32_t *table_offset = nullptr) const;
+};
+
+// Builds the smallest root signature that covers every binding of a PSO's shader stages.
+COMMON_API rootsig_layout build_rootsig_layout(const std::vector<shader_reflection> &stages,
+                                               const rootsig_layout_options &options = rootsig_layout_options());
+
+// Number of descriptors of each type actually read through the staging descriptor tables.
+// Each count is one past the highest register used in the staging register space.
+struct staging_usage
+{
+    uint32_t count[SHADERSTAGE_MAX][DESCRIPTORTYPE_MAX];
+};
+
+// Returns false if any binding falls outside of the staging limits.
+COMMON_API bool compute_staging_usage(const std::vector<shader_reflection> &shaders,
+                                      uint32_t space,
+                                      const uint32_t limits[DESCRIPTORTYPE_MAX],
+                                      staging_usage *out);
+
+// Root signature of a graphics PSO that binds its hot constants in the root and the rest through the staging tables.
+// Parameters stage * 2 and stage * 2 + 1 are the resource and sampler staging tables of the graphics stages, where
+// set_tables() binds them, and the root constants and root descriptors of root_bindings follow them.
+// The ranges only cover the registers the shaders use in the staging space, at their offset in the staging table,
+// the registers bound in the root are left out.
+COMMON_API rootsig_layout build_staging_rootsig_layout(const std::vector<shader_reflection> &shaders,
+                                                       const rootsig_layout &root_bindings,
+                                                       uint32_t space,
+                                                       const uint32_t limits[DESCRIPTORTYPE_MAX]);
+
+#pragma warning(pop)
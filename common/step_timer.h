@@ -1,5 +1,8 @@
 #pragma once
-#include <unordered_map>
+#include "platform.h"
+
+// Frame timer. Time is in ticks of the monotonic clock, cycles are read from the TSC.
+// Parts of the frame are timed with the scopes of cpu_profiler.h.
 
 struct cpu_timer
 {
@@ -10,12 +13,12 @@ struct cpu_timer
         union
         {
             double start_time;
-            UINT64 start_cycle;
+            uint64_t start_cycle;
         };
         union
         {
             double end_time;
-            UINT64 end_cycle;
+            uint64_t end_cycle;
         };
     };
 
@@ -26,33 +29,28 @@ struct cpu_timer
     };
 
     double cpu_frequency = 0.0;
-    UINT frame_count = 0;
-    UINT64 total_frame_count = 0;
-    UINT fps = 0;
+    uint32_t frame_count = 0;
+    uint64_t total_frame_count = 0;
+    uint32_t fps = 0;
     double total_time = 0.0;
     double frame_time_ms = 0.0;
     double base_time = 0.0;
-    UINT64 cycles_per_frame = 0;
+    uint64_t cycles_per_frame = 0;
 
     sample frame;
-    std::unordered_map<std::string, sample> timers = {};
 
     cpu_timer()
     {
-        LARGE_INTEGER tmp_cpu_frequency;
-        QueryPerformanceFrequency(&tmp_cpu_frequency);
-        cpu_frequency = (double)tmp_cpu_frequency.QuadPart;
+        cpu_frequency = (double)clock_frequency();
 
         base_time = get_timestamp();
         frame.cpu_time.start_time = base_time;
-        frame.clock_cycles.start_cycle = __rdtsc();
+        frame.clock_cycles.start_cycle = read_tsc();
     }
 
     double get_timestamp()
     {
-        LARGE_INTEGER current_time = {};
-        QueryPerformanceCounter(&current_time);
-        return (double)current_time.QuadPart;
+        return (double)clock_ticks();
     }
 
     double get_current_time()
@@ -60,40 +58,10 @@ struct cpu_timer
         return (get_timestamp() - base_time) / cpu_frequency;
     }
 
-    void start(std::string name)
-    {
-        measurement cpu_time = {};
-        cpu_time.start_time = get_timestamp();
-        timers[name].cpu_time = cpu_time;
-
-        measurement clock_cycles = {};
-        clock_cycles.start_cycle = __rdtsc();
-        timers[name].clock_cycles = clock_cycles;
-    }
-
-    void stop(std::string name)
-    {
-        timers[name].cpu_time.end_time = get_timestamp();
-        timers[name].clock_cycles.end_cycle = __rdtsc();
-    }
-
-    double result_ms(std::string name)
-    {
-        measurement cpu_time = timers[name].cpu_time;
-        double delta = cpu_time.end_time - cpu_time.start_time;
-        return (delta / cpu_frequency) * milliseconds;
-    }
-
-    UINT64 result_cycles(std::string name)
-    {
-        measurement cpu_cycles = timers[name].clock_cycles;
-        return cpu_cycles.end_cycle - cpu_cycles.start_cycle;
-    }
-
     double tick()
     {
         // Cycles.
-        frame.clock_cycles.end_cycle = __rdtsc();
+        frame.clock_cycles.end_cycle = read_tsc();
         cycles_per_frame = frame.clock_cycles.end_cycle - frame.clock_cycles.start_cycle;
         frame.clock_cycles.start_cycle = frame.clock_cycles.end_cycle;
 
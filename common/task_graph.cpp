@@ -0,0 +1,385 @@
+#include "task_graph.h"
+#include "json.h"
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void task_graph::reset()
+{
+    for (size_t i = 0; i < m_num_active_tasks; i++)
+    {
+        task_graph_task &task = m_tasks[i];
+        task.execute = nullptr;
+        task.reads.clear();
+        task.writes.clear();
+        task.explicit_dependencies.clear();
+        task.dependencies.clear();
+        task.successors.clear();
+    }
+    m_num_active_tasks = 0;
+    m_data.clear();
+    m_num_dependencies = 0;
+}
+
+task_graph_handle task_graph::add_data(const char *name)
+{
+    m_data.push_back(name);
+    return (task_graph_handle)(m_data.size() - 1);
+}
+
+task_graph_handle task_graph::add_task(const char *name, std::function<void()> execute, bool on_main_thread)
+{
+    if (m_num_active_tasks == m_tasks.size())
+    {
+        m_tasks.resize(m_tasks.size() + 1);
+    }
+
+    // The tasks are usually added in the same order every frame, the slot then already has the event.
+    task_graph_task &task = m_tasks[m_num_active_tasks];
+    if (task.event == profile_event_invalid || task.name != name)
+    {
+        task.name = name;
+        task.event = intern_profile_event(name);
+    }
+    task.execute = std::move(execute);
+    task.on_main_thread = on_main_thread;
+    task.start_ms = 0.0;
+    task.end_ms = 0.0;
+    task.thread = 0;
+    return (task_graph_handle)m_num_active_tasks++;
+}
+
+void task_graph::read(task_graph_handle task, task_graph_handle data)
+{
+    m_tasks[task].reads.push_back(data);
+}
+
+void task_graph::write(task_graph_handle task, task_graph_handle data)
+{
+    m_tasks[task].writes.push_back(data);
+}
+
+void task_graph::depends_on(task_graph_handle task, task_graph_handle dependency)
+{
+    m_tasks[task].explicit_dependencies.push_back(dependency);
+}
+
+void task_graph::add_dependency(task_graph_handle task, task_graph_handle dependency, task_graph_handle data)
+{
+    if (task == dependency)
+    {
+        return;
+    }
+
+    // One dependency per pair of tasks, named after the first data that caused it.
+    for (const task_graph_dependency &existing : m_tasks[task].dependencies)
+    {
+        if (existing.task == dependency)
+        {
+            return;
+        }
+    }
+
+    task_graph_dependency d = {dependency, data};
+    m_tasks[task].dependencies.push_back(d);
+    m_tasks[dependency].successors.push_back(task);
+    m_num_dependencies++;
+}
+
+bool task_graph::compile(std::string *error)
+{
+    m_num_dependencies = 0;
+    for (size_t i = 0; i < m_num_active_tasks; i++)
+    {
+        m_tasks[i].dependencies.clear();
+        m_tasks[i].successors.clear();
+    }
+
+    // Last writer and readers since the last write of each data, in declaration order.
+    std::vector<task_graph_handle> last_writer(m_data.size(), task_graph_invalid);
+    std::vector<std::vector<task_graph_handle>> readers(m_data.size());
+    for (task_graph_handle i = 0; i < (task_graph_handle)m_num_active_tasks; i++)
+    {
+        task_graph_task &task = m_tasks[i];
+        for (task_graph_handle dependency : task.explicit_dependencies)
+        {
+            add_dependency(i, dependency, task_graph_invalid);
+        }
+
+        for (task_graph_handle data : task.reads)
+        {
+            if (last_writer[data] != task_graph_invalid)
+            {
+                add_dependency(i, last_writer[data], data);
+            }
+        }
+
+        for (task_graph_handle data : task.writes)
+        {
+            if (last_writer[data] != task_graph_invalid)
+            {
+                add_dependency(i, last_writer[data], data);
+            }
+            for (task_graph_handle reader : readers[data])
+            {
+                add_dependency(i, reader, data);
+            }
+        }
+
+        // Update the data after every access of the task was handled, a task can read and write the same data.
+        for (task_graph_handle data : task.reads)
+        {
+            readers[data].push_back(i);
+        }
+        for (task_graph_handle data : task.writes)
+        {
+            last_writer[data] = i;
+            readers[data].clear();
+        }
+    }
+
+    // Only the explicit dependencies can point forward, look for a cycle by removing the tasks that are ready.
+    std::vector<uint32_t> remaining(m_num_active_tasks);
+    std::vector<task_graph_handle> ready;
+    for (task_graph_handle i = 0; i < (task_graph_handle)m_num_active_tasks; i++)
+    {
+        remaining[i] = (uint32_t)m_tasks[i].dependencies.size();
+        if (remaining[i] == 0)
+        {
+            ready.push_back(i);
+        }
+    }
+
+    size_t num_done = 0;
+    while (!ready.empty())
+    {
+        task_graph_handle i = ready.back();
+        ready.pop_back();
+        num_done++;
+        for (task_graph_handle successor : m_tasks[i].successors)
+        {
+            if (--remaining[successor] == 0)
+            {
+                ready.push_back(successor);
+            }
+        }
+    }
+
+    if (num_done != m_num_active_tasks)
+    {
+        if (error)
+        {
+            std::stringstream stream;
+            stream << "Task graph has a cycle between:";
+            for (size_t i = 0; i < m_num_active_tasks; i++)
+            {
+                if (remaining[i] > 0)
+                {
+                    stream << " \"" << m_tasks[i].name << "\"";
+                }
+            }
+            *error = stream.str();
+        }
+        return false;
+    }
+    return true;
+}
+
+double task_graph::elapsed_ms() const
+{
+    return (double)(now_ns() - m_run_start) / 1000000.0;
+}
+
+void task_graph::run(job_system *jobs)
+{
+    if (m_remaining_capacity < m_num_active_tasks)
+    {
+        m_remaining.reset(new std::atomic<int32_t>[m_num_active_tasks]);
+        m_remaining_capacity = m_num_active_tasks;
+    }
+
+    m_run_start = now_ns();
+    m_main_thread_ready.clear();
+    m_pending_tasks.m_value.store((int32_t)m_num_active_tasks, std::memory_order_relaxed);
+    for (size_t i = 0; i < m_num_active_tasks; i++)
+    {
+        m_remaining[i].store((int32_t)m_tasks[i].dependencies.size(), std::memory_order_relaxed);
+    }
+
+    for (task_graph_handle i = 0; i < (task_graph_handle)m_num_active_tasks; i++)
+    {
+        if (m_tasks[i].dependencies.empty())
+        {
+            schedule(jobs, i);
+        }
+    }
+
+    // Run the main thread tasks as they become ready, and other jobs in the meantime.
+    while (!m_pending_tasks.is_done())
+    {
+        task_graph_handle task = task_graph_invalid;
+        {
+            std::lock_guard<std::mutex> lock(m_main_thread_mtx);
+            if (!m_main_thread_ready.empty())
+            {
+                task = m_main_thread_ready.back();
+                m_main_thread_ready.pop_back();
+            }
+        }
+
+        if (task != task_graph_invalid)
+        {
+            execute_task(jobs, task);
+        }
+        else if (!jobs->run_one())
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // The last jobs may still be returning.
+    jobs->wait(&m_jobs);
+
+    m_run_ms = elapsed_ms();
+    m_busy_ms = 0.0;
+    for (size_t i = 0; i < m_num_active_tasks; i++)
+    {
+        m_busy_ms += m_tasks[i].end_ms - m_tasks[i].start_ms;
+    }
+}
+
+void task_graph::schedule(job_system *jobs, task_graph_handle task)
+{
+    if (m_tasks[task].on_main_thread)
+    {
+        std::lock_guard<std::mutex> lock(m_main_thread_mtx);
+        m_main_thread_ready.push_back(task);
+        return;
+    }
+
+    jobs->run([this, jobs, task]() { execute_task(jobs, task); }, &m_jobs);
+}
+
+void task_graph::execute_task(job_system *jobs, task_graph_handle index)
+{
+    task_graph_task &task = m_tasks[index];
+    task.thread = job_system::thread_index();
+    task.start_ms = elapsed_ms();
+    g_cpu_profiler.begin(task.event);
+    task.execute();
+    g_cpu_profiler.end(task.event);
+    task.end_ms = elapsed_ms();
+
+    for (task_graph_handle successor : task.successors)
+    {
+        if (m_remaining[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            schedule(jobs, successor);
+        }
+    }
+    m_pending_tasks.m_value.fetch_sub(1, std::memory_order_release);
+}
+
+std::string task_graph::to_dot() const
+{
+    std::stringstream stream;
+    stream.precision(3);
+    stream << std::fixed;
+    stream << "digraph task_graph {\n";
+    stream << "    label=\"" << m_run_ms << " ms, " << m_busy_ms << " ms of tasks\";\n";
+    stream << "    node [shape=box];\n";
+    for (size_t i = 0; i < m_num_active_tasks; i++)
+    {
+        const task_graph_task &task = m_tasks[i];
+        stream << "    t" << i << " [label=\"" << json_escape(task.name) << "\\n"
+               << (task.end_ms - task.start_ms) << " ms at " << task.start_ms << " ms\\nthread " << task.thread << "\""
+               << (task.on_main_thread ? ", style=bold" : "") << "];\n";
+    }
+
+    for (size_t i = 0; i < m_num_active_tasks; i++)
+    {
+        for (const task_graph_dependency &dependency : m_tasks[i].dependencies)
+        {
+            stream << "    t" << dependency.task << " -> t" << i;
+            if (dependency.data != task_graph_invalid)
+            {
+                stream << " [label=\"" << json_escape(m_data[dependency.data]) << "\"]";
+            }
+            else
+            {
+                stream << " [style=dashed]";
+            }
+            stream << ";\n";
+        }
+    }
+    stream << "}\n";
+    return stream.str();
+}
+
+std::string task_graph::to_json() const
+{
+    std::stringstream stream;
+    stream.precision(6);
+    stream << std::fixed;
+    stream << "{\n    \"run_ms\": " << m_run_ms << ",\n    \"busy_ms\": " << m_busy_ms << ",\n    \"tasks\": [";
+    for (size_t i = 0; i < m_num_active_tasks; i++)
+    {
+        const task_graph_task &task = m_tasks[i];
+        stream << (i == 0 ? "\n" : ",\n");
+        stream << "        {\"name\": \"" << json_escape(task.name) << "\""
+               << ", \"thread\": " << task.thread
+               << ", \"main_thread\": " << (task.on_main_thread ? "true" : "false")
+               << ", \"start_ms\": " << task.start_ms
+               << ", \"end_ms\": " << task.end_ms
+               << ", \"dependencies\": [";
+        for (size_t j = 0; j < task.dependencies.size(); j++)
+        {
+            const task_graph_dependency &dependency = task.dependencies[j];
+            stream << (j == 0 ? "" : ", ") << "{\"task\": " << dependency.task << ", \"data\": ";
+            if (dependency.data != task_graph_invalid)
+            {
+                stream << "\"" << json_escape(m_data[dependency.data]) << "\"}";
+            }
+            else
+            {
+                stream << "null}";
+            }
+        }
+        stream << "]}";
+    }
+    stream << "\n    ]\n}\n";
+    return stream.str();
+}
+
+std::string task_graph::dump() const
+{
+    std::stringstream stream;
+    stream.precision(3);
+    stream << std::fixed;
+    stream << "Task graph: " << m_num_active_tasks << " tasks, " << m_num_dependencies << " dependencies, "
+           << m_run_ms << " ms (" << m_busy_ms << " ms of tasks)\n";
+    for (size_t i = 0; i < m_num_active_tasks; i++)
+    {
+        const task_graph_task &task = m_tasks[i];
+        stream << "    " << task.name << ": " << task.start_ms << " - " << task.end_ms << " ms, thread " << task.thread;
+        if (!task.dependencies.empty())
+        {
+            stream << ", after";
+            for (const task_graph_dependency &dependency : task.dependencies)
+            {
+                stream << " " << m_tasks[dependency.task].name;
+                if (dependency.data != task_graph_invalid)
+                {
+                    stream << " (" << m_data[dependency.data] << ")";
+                }
+            }
+        }
+        stream << "\n";
+    }
+    return stream.str();
+}
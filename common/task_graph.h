@@ -0,0 +1,110 @@
+#pragma once
+#include "common_api.h"
+#include "cpu_profiler.h"
+#include "job_system.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// CPU task graph.
+// Tasks declare the data they read and write, compile() turns the declaration order into dependencies:
+// a task runs after the last task that wrote what it reads, and after the tasks that used what it writes.
+// run() schedules the tasks on the job system as soon as their dependencies are done, so independent work
+// overlaps. Tasks that must stay on the thread that calls run(), e.g. the ones using the window, are flagged.
+// The timings of the last run can be exported as a DOT graph or as JSON. Each task is also a scope of
+// g_cpu_profiler, named after the task.
+
+typedef uint32_t task_graph_handle;
+static const task_graph_handle task_graph_invalid = 0xffffffff;
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+struct task_graph_dependency
+{
+    task_graph_handle task;
+    task_graph_handle data; // task_graph_invalid for the dependencies added with depends_on().
+};
+
+struct task_graph_task
+{
+    std::string name;
+    profile_event_id event = profile_event_invalid;
+    std::function<void()> execute;
+    bool on_main_thread = false;
+    std::vector<task_graph_handle> reads;
+    std::vector<task_graph_handle> writes;
+    std::vector<task_graph_handle> explicit_dependencies;
+    std::vector<task_graph_dependency> dependencies;
+    std::vector<task_graph_handle> successors;
+
+    // Last run, in milliseconds since the start of run().
+    double start_ms = 0.0;
+    double end_ms = 0.0;
+    uint32_t thread = 0;
+};
+
+class COMMON_API task_graph
+{
+public:
+    task_graph() = default;
+    ~task_graph() = default;
+
+    // Removes every task and data, the allocations are kept for the next frame.
+    void reset();
+
+    task_graph_handle add_data(const char *name);
+    task_graph_handle add_task(const char *name, std::function<void()> execute, bool on_main_thread = false);
+    void read(task_graph_handle task, task_graph_handle data);
+    void write(task_graph_handle task, task_graph_handle data);
+
+    // Dependency that isn't expressed by data, the dependency may be declared after the task.
+    void depends_on(task_graph_handle task, task_graph_handle dependency);
+
+    // Returns false if the explicit dependencies form a cycle.
+    bool compile(std::string *error = nullptr);
+
+    // Runs the tasks and returns when they are all done, the calling thread runs jobs in the meantime.
+    // Must be called by the thread that started the job system.
+    void run(job_system *jobs);
+
+    // Tasks, data and dependencies with the timings of the last run.
+    std::string to_dot() const;
+    std::string to_json() const;
+    std::string dump() const;
+
+    size_t num_tasks() const { return m_num_active_tasks; }
+    const task_graph_task &task(size_t index) const { return m_tasks[index]; }
+    size_t num_data() const { return m_data.size(); }
+    const std::string &data_name(size_t index) const { return m_data[index]; }
+
+    // Statistics of the last compile and run.
+    uint32_t m_num_dependencies = 0;
+    double m_run_ms = 0.0;
+    double m_busy_ms = 0.0; // Sum of the task durations, more than m_run_ms when tasks overlap.
+
+private:
+    void schedule(job_system *jobs, task_graph_handle task);
+    void execute_task(job_system *jobs, task_graph_handle task);
+    void add_dependency(task_graph_handle task, task_graph_handle dependency, task_graph_handle data);
+    double elapsed_ms() const;
+
+    std::vector<task_graph_task> m_tasks;
+    size_t m_num_active_tasks = 0;
+    std::vector<std::string> m_data;
+
+    // Unfinished dependencies of each task during run().
+    std::unique_ptr<std::atomic<int32_t>[]> m_remaining;
+    size_t m_remaining_capacity = 0;
+    job_counter m_pending_tasks;
+    job_counter m_jobs;
+    int64_t m_run_start = 0;
+
+    // Main thread tasks whose dependencies are done, run() picks them up.
+    std::mutex m_main_thread_mtx;
+    std::vector<task_graph_handle> m_main_thread_ready;
+};
+
+#pragma warning(pop)
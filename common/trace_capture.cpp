@@ -0,0 +1,543 @@
+#include "trace_capture.h"
+#include "json.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+void trace_capture::begin(uint32_t num_frames, uint32_t gpu_latency_frames, uint32_t max_cpu_events, uint32_t max_gpu_events,
+                          uint32_t max_counters)
+{
+    // Allocated once here, the frames only copy into the reserved memory.
+    m_cpu_events.clear();
+    m_cpu_events.reserve(max_cpu_events);
+    m_gpu_events.clear();
+    m_gpu_events.reserve(max_gpu_events);
+    m_counters.clear();
+    m_counters.reserve(max_counters);
+    m_frame_starts_us.clear();
+    m_frame_starts_us.reserve(num_frames);
+    m_presents_us.clear();
+    m_presents_us.reserve(num_frames + gpu_latency_frames + 1);
+
+    m_num_frames = (std::max)(num_frames, 1u);
+    m_gpu_latency_frames = gpu_latency_frames;
+    m_cpu_frames = 0;
+    m_gpu_frames_after_cpu = 0;
+    m_counter_frames = 0;
+    m_num_dropped = 0;
+    m_start_ticks = clock_ticks();
+    m_start_tsc = read_tsc();
+    m_is_capturing = true;
+}
+
+void trace_capture::set_gpu_track_name(uint16_t queue, const char *name)
+{
+    if (queue >= m_gpu_track_names.size())
+    {
+        m_gpu_track_names.resize(queue + 1);
+    }
+    m_gpu_track_names[queue] = name;
+}
+
+double trace_capture::clock_to_us(uint64_t ticks) const
+{
+    int64_t delta = (int64_t)(ticks - m_start_ticks);
+    return (double)delta * 1000000.0 / (double)clock_frequency();
+}
+
+void trace_capture::add_cpu_frame(const profile_frame &frame)
+{
+    // The frame that was running when the capture began is skipped, the first one starts after begin().
+    if (!m_is_capturing || m_cpu_frames == m_num_frames || frame.start_tsc < m_start_tsc)
+    {
+        return;
+    }
+
+    double frame_start_us = tsc_to_ms(frame.start_tsc - m_start_tsc) * 1000.0;
+    m_frame_starts_us.push_back(frame_start_us);
+    for (const profile_scope_record &scope : frame.scopes)
+    {
+        if (m_cpu_events.size() == m_cpu_events.capacity())
+        {
+            m_num_dropped++;
+            continue;
+        }
+        m_cpu_events.push_back({frame_start_us + scope.start_ms * 1000.0, scope.duration_ms * 1000.0, scope.event,
+                                (uint16_t)scope.thread, scope.thread});
+    }
+    if (frame.thread_names.size() > m_thread_names.size())
+    {
+        m_thread_names = frame.thread_names;
+    }
+    m_cpu_frames++;
+}
+
+void trace_capture::add_render_counters(const render_counter_frame &frame)
+{
+    // Only for a frame add_cpu_frame() kept.
+    if (!m_is_capturing || m_counter_frames == m_cpu_frames)
+    {
+        return;
+    }
+
+    double frame_start_us = m_frame_starts_us.back();
+    for (const pass_counter_values &pass : frame.passes)
+    {
+        if (m_counters.size() == m_counters.capacity())
+        {
+            m_num_dropped++;
+            continue;
+        }
+        m_counters.push_back({frame_start_us, pass.pass, pass.counters});
+    }
+    if (m_counters.size() == m_counters.capacity())
+    {
+        m_num_dropped++;
+    }
+    else
+    {
+        m_counters.push_back({frame_start_us, profile_event_invalid, frame.outside_passes()});
+    }
+    m_counter_frames++;
+}
+
+void trace_capture::add_gpu_event(uint16_t queue, profile_event_id event, uint32_t thread, double start_us, double end_us)
+{
+    // Work of the frames before the capture.
+    if (!m_is_capturing || end_us < 0.0)
+    {
+        return;
+    }
+    if (m_gpu_events.size() == m_gpu_events.capacity())
+    {
+        m_num_dropped++;
+        return;
+    }
+    m_gpu_events.push_back({start_us, end_us - start_us, event, queue, thread});
+}
+
+void trace_capture::add_present(uint64_t ticks)
+{
+    if (!m_is_capturing || m_presents_us.size() == m_presents_us.capacity())
+    {
+        return;
+    }
+    m_presents_us.push_back(clock_to_us(ticks));
+}
+
+void trace_capture::end_gpu_frame()
+{
+    if (m_is_capturing && m_cpu_frames == m_num_frames && ++m_gpu_frames_after_cpu > m_gpu_latency_frames)
+    {
+        m_is_capturing = false;
+    }
+}
+
+static const std::string &name_or_index(const std::vector<std::string> &names, size_t index, const char *prefix, std::string *storage)
+{
+    if (index < names.size() && !names[index].empty())
+    {
+        return names[index];
+    }
+    *storage = prefix + std::to_string(index);
+    return *storage;
+}
+
+static const char *counter_pass_name(profile_event_id pass)
+{
+    return pass == profile_event_invalid ? "Outside of the passes" : profile_event_name(pass);
+}
+
+// Passes of the captured counters, in order of appearance.
+static std::vector<profile_event_id> counter_passes(const std::vector<trace_counters> &counters)
+{
+    std::vector<profile_event_id> passes;
+    for (const trace_counters &c : counters)
+    {
+        if (std::find(passes.begin(), passes.end(), c.pass) == passes.end())
+        {
+            passes.push_back(c.pass);
+        }
+    }
+    return passes;
+}
+
+// Counters of the frame that starts at index begin, by pass of passes, null for the passes the frame didn't record
+// in. Returns the index of the next frame.
+static size_t frame_counters(const std::vector<trace_counters> &counters, const std::vector<profile_event_id> &passes, size_t begin,
+                             std::vector<const render_counter_values *> *rows)
+{
+    rows->assign(passes.size(), nullptr);
+    size_t end = begin;
+    while (end < counters.size() && counters[end].time_us == counters[begin].time_us)
+    {
+        size_t pass = std::find(passes.begin(), passes.end(), counters[end].pass) - passes.begin();
+        (*rows)[pass] = &counters[end].counters;
+        end++;
+    }
+    return end;
+}
+
+std::string trace_capture::to_chrome_json() const
+{
+    // Process 1 is the CPU with a thread per profiler thread, process 2 the GPU with a thread per queue.
+    std::stringstream stream;
+    stream.precision(3);
+    stream << std::fixed;
+    stream << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    stream << "{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": 1, \"args\": {\"name\": \"CPU\"}},\n";
+    stream << "{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": 2, \"args\": {\"name\": \"GPU\"}}";
+
+    std::string storage;
+    uint16_t num_threads = 0;
+    uint16_t num_queues = 0;
+    for (const trace_event &e : m_cpu_events)
+    {
+        num_threads = (std::max)(num_threads, (uint16_t)(e.track + 1));
+    }
+    for (const trace_event &e : m_gpu_events)
+    {
+        num_queues = (std::max)(num_queues, (uint16_t)(e.track + 1));
+    }
+    for (uint16_t i = 0; i < num_threads; i++)
+    {
+        stream << ",\n{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": " << i << ", \"args\": {\"name\": \""
+               << json_escape(name_or_index(m_thread_names, i, "thread #", &storage)) << "\"}}";
+    }
+    for (uint16_t i = 0; i < num_queues; i++)
+    {
+        stream << ",\n{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 2, \"tid\": " << i << ", \"args\": {\"name\": \""
+               << json_escape(name_or_index(m_gpu_track_names, i, "queue #", &storage)) << "\"}}";
+    }
+
+    for (size_t i = 0; i < m_frame_starts_us.size(); i++)
+    {
+        stream << ",\n{\"ph\": \"i\", \"s\": \"g\", \"name\": \"Frame " << i << "\", \"pid\": 1, \"tid\": 0, \"ts\": "
+               << m_frame_starts_us[i] << "}";
+    }
+    for (size_t i = 0; i < m_presents_us.size(); i++)
+    {
+        double interval_ms = i > 0 ? (m_presents_us[i] - m_presents_us[i - 1]) / 1000.0 : 0.0;
+        stream << ",\n{\"ph\": \"i\", \"s\": \"p\", \"name\": \"Present\", \"pid\": 1, \"tid\": 0, \"ts\": " << m_presents_us[i]
+               << ", \"args\": {\"interval ms\": " << interval_ms << "}}";
+    }
+    for (const trace_event &e : m_cpu_events)
+    {
+        stream << ",\n{\"ph\": \"X\", \"cat\": \"cpu\", \"name\": \"" << json_escape(profile_event_name(e.event)) << "\", \"pid\": 1, \"tid\": "
+               << e.track << ", \"ts\": " << e.start_us << ", \"dur\": " << e.duration_us << "}";
+    }
+    for (const trace_event &e : m_gpu_events)
+    {
+        stream << ",\n{\"ph\": \"X\", \"cat\": \"gpu\", \"name\": \"" << json_escape(profile_event_name(e.event)) << "\", \"pid\": 2, \"tid\": "
+               << e.track << ", \"ts\": " << e.start_us << ", \"dur\": " << e.duration_us << ", \"args\": {\"recorded by\": \""
+               << json_escape(name_or_index(m_thread_names, e.thread, "thread #", &storage)) << "\"}}";
+    }
+
+    // A counter event per counter and frame, with a series per pass. Every event has every series, the passes a
+    // frame didn't record in are 0.
+    std::vector<profile_event_id> passes = counter_passes(m_counters);
+    std::vector<const render_counter_values *> rows;
+    for (size_t begin = 0; begin < m_counters.size();)
+    {
+        size_t end = frame_counters(m_counters, passes, begin, &rows);
+        for (int counter = 0; counter < render_counter_count; counter++)
+        {
+            stream << ",\n{\"ph\": \"C\", \"name\": \"" << render_counter_name((render_counter)counter)
+                   << "\", \"pid\": 1, \"ts\": " << m_counters[begin].time_us << ", \"args\": {";
+            for (size_t pass = 0; pass < passes.size(); pass++)
+            {
+                stream << (pass == 0 ? "\"" : ", \"") << json_escape(counter_pass_name(passes[pass])) << "\": "
+                       << (rows[pass] ? rows[pass]->values[counter] : 0);
+            }
+            stream << "}}";
+        }
+        begin = end;
+    }
+    stream << "\n]}\n";
+    return stream.str();
+}
+
+// Protobuf encoding of the few messages of perfetto_trace.proto that are used.
+class proto_writer
+{
+public:
+    void varint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            m_bytes.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        m_bytes.push_back((uint8_t)value);
+    }
+    void uint_field(uint32_t field, uint64_t value)
+    {
+        varint((uint64_t)field << 3);
+        varint(value);
+    }
+    void bytes_field(uint32_t field, const void *data, size_t size)
+    {
+        varint(((uint64_t)field << 3) | 2);
+        varint(size);
+        m_bytes.insert(m_bytes.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+    }
+    void string_field(uint32_t field, const std::string &text) { bytes_field(field, text.data(), text.size()); }
+    void message_field(uint32_t field, const proto_writer &message) { bytes_field(field, message.m_bytes.data(), message.m_bytes.size()); }
+
+    std::vector<uint8_t> m_bytes;
+};
+
+// Field numbers of perfetto_trace.proto.
+enum perfetto_field
+{
+    trace_packet = 1,
+    packet_timestamp = 8,
+    packet_sequence_id = 10,
+    packet_track_event = 11,
+    packet_track_descriptor = 60,
+    track_uuid = 1,
+    track_name = 2,
+    track_process = 3,
+    track_thread = 4,
+    track_parent_uuid = 5,
+    track_counter = 8,
+    process_pid = 1,
+    process_name = 6,
+    thread_pid = 1,
+    thread_tid = 2,
+    thread_name = 5,
+    event_type = 9,
+    event_track_uuid = 11,
+    event_categories = 22,
+    event_name = 23,
+    event_counter_value = 30,
+};
+
+enum perfetto_event_type
+{
+    perfetto_slice_begin = 1,
+    perfetto_slice_end = 2,
+    perfetto_instant = 3,
+    perfetto_counter = 4,
+};
+
+static const uint32_t perfetto_sequence = 1;
+static const uint64_t cpu_process_uuid = 1;
+static const uint64_t gpu_process_uuid = 2;
+static const uint64_t cpu_thread_uuid = 100;
+static const uint64_t gpu_queue_uuid = 1000;
+static const uint64_t counter_uuid = 10000; // + counter * max_profile_events + pass.
+
+static void write_packet(proto_writer *trace, uint64_t timestamp_ns, uint32_t packet_field, const proto_writer &message)
+{
+    proto_writer packet;
+    if (packet_field == packet_track_event)
+    {
+        packet.uint_field(packet_timestamp, timestamp_ns);
+    }
+    packet.uint_field(packet_sequence_id, perfetto_sequence);
+    packet.message_field(packet_field, message);
+    trace->message_field(trace_packet, packet);
+}
+
+static void write_slice(proto_writer *trace, uint64_t track, uint64_t timestamp_ns, perfetto_event_type type, const char *name,
+                        const char *category)
+{
+    proto_writer event;
+    event.uint_field(event_type, type);
+    event.uint_field(event_track_uuid, track);
+    if (type != perfetto_slice_end)
+    {
+        event.string_field(event_categories, category);
+        event.string_field(event_name, name);
+    }
+    write_packet(trace, timestamp_ns, packet_track_event, event);
+}
+
+// Writes the events of a track as begin and end slices, which must nest: an event that ends after the one it
+// starts in is cut at the end of it.
+static void write_track_events(proto_writer *trace, uint64_t track, std::vector<const trace_event *> events, const char *category)
+{
+    std::sort(events.begin(), events.end(), [](const trace_event *a, const trace_event *b) {
+        return a->start_us != b->start_us ? a->start_us < b->start_us : a->duration_us > b->duration_us;
+    });
+
+    // Start times are shifted by a second so that the GPU work of the frame before the capture stays positive.
+    auto to_ns = [](double us) { return (uint64_t)((us + 1000000.0) * 1000.0); };
+    std::vector<double> open_ends;
+    for (const trace_event *e : events)
+    {
+        while (!open_ends.empty() && open_ends.back() <= e->start_us)
+        {
+            write_slice(trace, track, to_ns(open_ends.back()), perfetto_slice_end, nullptr, category);
+            open_ends.pop_back();
+        }
+        double end_us = e->start_us + e->duration_us;
+        if (!open_ends.empty())
+        {
+            end_us = (std::min)(end_us, open_ends.back());
+        }
+        write_slice(trace, track, to_ns(e->start_us), perfetto_slice_begin, profile_event_name(e->event), category);
+        open_ends.push_back(end_us);
+    }
+    while (!open_ends.empty())
+    {
+        write_slice(trace, track, to_ns(open_ends.back()), perfetto_slice_end, nullptr, category);
+        open_ends.pop_back();
+    }
+}
+
+std::vector<uint8_t> trace_capture::to_perfetto() const
+{
+    proto_writer trace;
+    std::string storage;
+
+    // Track descriptors: a process per processor, a thread track per CPU thread and a child track per GPU queue.
+    const char *process_names[] = {"CPU", "GPU"};
+    for (uint64_t pid = cpu_process_uuid; pid <= gpu_process_uuid; pid++)
+    {
+        proto_writer process;
+        process.uint_field(process_pid, pid);
+        process.string_field(process_name, process_names[pid - 1]);
+        proto_writer track;
+        track.uint_field(track_uuid, pid);
+        track.message_field(track_process, process);
+        write_packet(&trace, 0, packet_track_descriptor, track);
+    }
+
+    std::vector<std::vector<const trace_event *>> threads;
+    std::vector<std::vector<const trace_event *>> queues;
+    for (const trace_event &e : m_cpu_events)
+    {
+        threads.resize((std::max)(threads.size(), (size_t)e.track + 1));
+        threads[e.track].push_back(&e);
+    }
+    for (const trace_event &e : m_gpu_events)
+    {
+        queues.resize((std::max)(queues.size(), (size_t)e.track + 1));
+        queues[e.track].push_back(&e);
+    }
+
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        proto_writer thread;
+        thread.uint_field(thread_pid, cpu_process_uuid);
+        thread.uint_field(thread_tid, i + 1);
+        thread.string_field(thread_name, name_or_index(m_thread_names, i, "thread #", &storage));
+        proto_writer track;
+        track.uint_field(track_uuid, cpu_thread_uuid + i);
+        track.message_field(track_thread, thread);
+        write_packet(&trace, 0, packet_track_descriptor, track);
+    }
+    for (size_t i = 0; i < queues.size(); i++)
+    {
+        proto_writer track;
+        track.uint_field(track_uuid, gpu_queue_uuid + i);
+        track.string_field(track_name, name_or_index(m_gpu_track_names, i, "queue #", &storage));
+        track.uint_field(track_parent_uuid, gpu_process_uuid);
+        write_packet(&trace, 0, packet_track_descriptor, track);
+    }
+
+    for (size_t i = 0; i < m_frame_starts_us.size(); i++)
+    {
+        std::string name = "Frame " + std::to_string(i);
+        write_slice(&trace, cpu_process_uuid, (uint64_t)((m_frame_starts_us[i] + 1000000.0) * 1000.0), perfetto_instant,
+                    name.c_str(), "frame");
+    }
+    for (double present_us : m_presents_us)
+    {
+        write_slice(&trace, cpu_process_uuid, (uint64_t)((present_us + 1000000.0) * 1000.0), perfetto_instant, "Present", "frame");
+    }
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        write_track_events(&trace, cpu_thread_uuid + i, threads[i], "cpu");
+    }
+    for (size_t i = 0; i < queues.size(); i++)
+    {
+        write_track_events(&trace, gpu_queue_uuid + i, queues[i], "gpu");
+    }
+
+    // A counter track per counter and pass, in the CPU process.
+    std::vector<profile_event_id> passes = counter_passes(m_counters);
+    for (int counter = 0; counter < render_counter_count; counter++)
+    {
+        for (size_t pass = 0; pass < passes.size(); pass++)
+        {
+            proto_writer track;
+            track.uint_field(track_uuid, counter_uuid + counter * max_profile_events + pass);
+            track.string_field(track_name, std::string(render_counter_name((render_counter)counter)) + ": " +
+                                                counter_pass_name(passes[pass]));
+            track.uint_field(track_parent_uuid, cpu_process_uuid);
+            track.message_field(track_counter, proto_writer());
+            write_packet(&trace, 0, packet_track_descriptor, track);
+        }
+    }
+    std::vector<const render_counter_values *> rows;
+    for (size_t begin = 0; begin < m_counters.size();)
+    {
+        size_t end = frame_counters(m_counters, passes, begin, &rows);
+        for (int counter = 0; counter < render_counter_count; counter++)
+        {
+            for (size_t pass = 0; pass < passes.size(); pass++)
+            {
+                proto_writer event;
+                event.uint_field(event_type, perfetto_counter);
+                event.uint_field(event_track_uuid, counter_uuid + counter * max_profile_events + pass);
+                event.uint_field(event_counter_value, rows[pass] ? rows[pass]->values[counter] : 0);
+                write_packet(&trace, (uint64_t)((m_counters[begin].time_us + 1000000.0) * 1000.0), packet_track_event, event);
+            }
+        }
+        begin = end;
+    }
+    return trace.m_bytes;
+}
+
+bool trace_capture::save(const char *path, trace_format format, std::string *error) const
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        if (error)
+        {
+            *error = std::string("Could not open ") + path;
+        }
+        return false;
+    }
+
+    if (format == trace_format_chrome_json)
+    {
+        std::string json = to_chrome_json();
+        file.write(json.data(), json.size());
+    }
+    else
+    {
+        std::vector<uint8_t> bytes = to_perfetto();
+        file.write((const char *)bytes.data(), bytes.size());
+    }
+
+    if (!file)
+    {
+        if (error)
+        {
+            *error = std::string("Could not write ") + path;
+        }
+        return false;
+    }
+    return true;
+}
+
+std::string trace_capture::dump() const
+{
+    std::stringstream stream;
+    stream << m_frame_starts_us.size() << " frames, " << m_presents_us.size() << " presents, " << m_cpu_events.size() << " CPU events, " << m_gpu_events.size()
+           << " GPU events, " << m_counters.size() << " pass counters";
+    if (m_num_dropped > 0)
+    {
+        stream << ", " << m_num_dropped << " dropped";
+    }
+    if (m_is_capturing)
+    {
+        stream << ", capturing";
+    }
+    return stream.str();
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "common_api.h"
+#include "cpu_profiler.h"
+#include "render_counters.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Capture of the CPU scopes and GPU timers of a few frames, written as a Chrome trace (JSON, opens in
+// chrome://tracing and in the Perfetto UI) or as a Perfetto protobuf trace.
+// The CPU scopes come from the profiler frames, one track per thread. The GPU timers are added by the caller, one
+// track per queue, with their timestamps already converted to the CPU clock. The event arrays are allocated by
+// begin(), the capture only copies into them: events past their capacity are dropped and counted.
+// The render counters of each frame are written as counter tracks, one per counter with a series per pass.
+// Times are in microseconds since begin().
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+struct trace_event
+{
+    double start_us;
+    double duration_us;
+    profile_event_id event;
+    uint16_t track; // Thread index for the CPU events, queue for the GPU ones.
+    uint32_t thread; // Thread that recorded a GPU event.
+};
+
+// Counters of a pass over a frame, or of the work outside of the passes when pass is invalid.
+struct trace_counters
+{
+    double time_us; // Start of the frame.
+    profile_event_id pass;
+    render_counter_values counters;
+};
+
+enum trace_format
+{
+    trace_format_chrome_json,
+    trace_format_perfetto,
+};
+
+class COMMON_API trace_capture
+{
+public:
+    trace_capture() = default;
+    ~trace_capture() = default;
+
+    // Captures the CPU scopes of the next num_frames profiler frames, and the GPU timers collected until
+    // gpu_latency_frames frames later, when the GPU is done with the last captured frame.
+    void begin(uint32_t num_frames, uint32_t gpu_latency_frames, uint32_t max_cpu_events = 262144, uint32_t max_gpu_events = 16384,
+               uint32_t max_counters = 4096);
+    bool is_capturing() const { return m_is_capturing; }
+    bool is_complete() const { return !m_is_capturing && m_num_frames > 0; }
+
+    // Names of the GPU tracks, by queue.
+    void set_gpu_track_name(uint16_t queue, const char *name);
+
+    // Called once per frame with the last profiler frame.
+    void add_cpu_frame(const profile_frame &frame);
+
+    // Called after add_cpu_frame() with the counters of the same frame.
+    void add_render_counters(const render_counter_frame &frame);
+
+    // Called once per frame by the code that collects the GPU timers, after its add_gpu_event() calls.
+    void add_gpu_event(uint16_t queue, profile_event_id event, uint32_t thread, double start_us, double end_us);
+    void end_gpu_frame();
+
+    // Present of a frame, at a clock_ticks() value. Written as an instant event with the interval to the previous one.
+    void add_present(uint64_t ticks);
+
+    // Microseconds since begin() of a monotonic clock value, see clock_ticks().
+    double clock_to_us(uint64_t ticks) const;
+
+    uint32_t num_dropped() const { return m_num_dropped; }
+    const std::vector<trace_event> &cpu_events() const { return m_cpu_events; }
+    const std::vector<trace_event> &gpu_events() const { return m_gpu_events; }
+    const std::vector<trace_counters> &counters() const { return m_counters; }
+
+    std::string to_chrome_json() const;
+    std::vector<uint8_t> to_perfetto() const;
+    bool save(const char *path, trace_format format, std::string *error = nullptr) const;
+
+    // Number of frames and events captured.
+    std::string dump() const;
+
+private:
+    bool m_is_capturing = false;
+    uint32_t m_num_frames = 0;
+    uint32_t m_gpu_latency_frames = 0;
+    uint32_t m_cpu_frames = 0;
+    uint32_t m_gpu_frames_after_cpu = 0;
+    uint32_t m_num_dropped = 0;
+    uint64_t m_start_tsc = 0;
+    uint64_t m_start_ticks = 0;
+    std::vector<trace_event> m_cpu_events;
+    std::vector<trace_event> m_gpu_events;
+    std::vector<trace_counters> m_counters;
+    uint32_t m_counter_frames = 0;
+    std::vector<double> m_frame_starts_us;
+    std::vector<double> m_presents_us;
+    std::vector<std::string> m_thread_names;
+    std::vector<std::string> m_gpu_track_names;
+};
+
+#pragma warning(pop)
@@ -0,0 +1,100 @@
+#include "upload_allocator.h"
+#include "frame_pacer.h"
+
+// Block of the memory that a thread allocates from.
+struct upload_block
+{
+    const void *owner;
+    uint64_t generation;
+    uint8_t *current;
+    uint8_t *end;
+};
+
+// A thread allocates from the allocator of each frame in flight, plus headroom for the allocators that are not
+// per frame, e.g. the null device and the benchmarks. With more, the least recently created block is replaced: the
+// allocations stay valid, the rest of the replaced block is wasted and the next allocation takes a new block.
+static const int upload_block_headroom = 2;
+static const int max_upload_blocks_per_thread = (int)frame_pacer::max_frames_in_flight + upload_block_headroom;
+static_assert(max_upload_blocks_per_thread <= 8, "allocate() looks for the block of the allocator with a linear scan.");
+static thread_local upload_block t_upload_blocks[max_upload_blocks_per_thread] = {};
+static thread_local int t_next_upload_block = 0;
+
+// Unique across allocators, so that a block never matches an allocator created at the address of an old one.
+static std::atomic<uint64_t> g_upload_generation{0};
+
+static uint8_t *align_pointer(uint8_t *pointer, size_t alignment)
+{
+    return reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(pointer) + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+void upload_allocator::init(uint8_t *begin, size_t size)
+{
+    m_begin = begin;
+    m_end = begin + size;
+    reset();
+}
+
+void upload_allocator::reset()
+{
+    m_offset.store(0, std::memory_order_relaxed);
+    m_generation.store(g_upload_generation.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+uint8_t *upload_allocator::allocate(size_t size, size_t alignment)
+{
+    uint64_t generation = m_generation.load(std::memory_order_relaxed);
+    upload_block *block = nullptr;
+    for (int i = 0; i < max_upload_blocks_per_thread; i++)
+    {
+        if (t_upload_blocks[i].owner == this)
+        {
+            block = &t_upload_blocks[i];
+            break;
+        }
+    }
+
+    if (block == nullptr)
+    {
+        block = &t_upload_blocks[t_next_upload_block];
+        t_next_upload_block = (t_next_upload_block + 1) % max_upload_blocks_per_thread;
+        block->owner = this;
+        block->generation = 0;
+    }
+
+    // Bump inside the block of this thread.
+    if (block->generation == generation)
+    {
+        uint8_t *aligned = align_pointer(block->current, alignment);
+        if (aligned + size <= block->end)
+        {
+            block->current = aligned + size;
+            return aligned;
+        }
+    }
+
+    // Large allocations are taken from the memory directly, the others start a new block.
+    size_t capacity = (size_t)(m_end - m_begin);
+    size_t reserved = size + alignment;
+    if (reserved > block_size / 4)
+    {
+        size_t offset = m_offset.fetch_add(reserved, std::memory_order_relaxed);
+        if (offset + reserved > capacity)
+        {
+            return nullptr;
+        }
+        return align_pointer(m_begin + offset, alignment);
+    }
+
+    size_t offset = m_offset.fetch_add(block_size, std::memory_order_relaxed);
+    if (offset + block_size > capacity)
+    {
+        return nullptr;
+    }
+    block->generation = generation;
+    block->current = m_begin + offset;
+    block->end = block->current + block_size;
+
+    uint8_t *aligned = align_pointer(block->current, alignment);
+    block->current = aligned + size;
+    return aligned;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "common_api.h"
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bump allocator of a frame's upload memory that any thread can allocate from without a lock.
+// Each thread bumps a pointer inside its own block, blocks are taken from the memory with an atomic add, so threads
+// only touch the shared offset once per block. reset() is called when no thread allocates, it invalidates the
+// blocks of every thread.
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // Safe to ignore because the users of this DLL will always be compiled together with the DLL
+
+class COMMON_API upload_allocator
+{
+public:
+    static const size_t block_size = 64 * 1024;
+
+    upload_allocator() = default;
+    ~upload_allocator() = default;
+
+    // The memory must outlive the allocator, e.g. a mapped upload buffer.
+    void init(uint8_t *begin, size_t size);
+
+    // Null when the memory is full.
+    uint8_t *allocate(size_t size, size_t alignment);
+    void reset();
+
+    size_t used() const { return m_offset.load(std::memory_order_relaxed); }
+    uint8_t *begin() const { return m_begin; }
+    uint8_t *end() const { return m_end; }
+
+private:
+    uint8_t *m_begin = nullptr;
+    uint8_t *m_end = nullptr;
+    std::atomic<size_t> m_offset{0};
+    std::atomic<uint64_t> m_generation{0}; // Blocks of an older generation belong to a previous frame.
+};
+
+#pragma warning(pop)
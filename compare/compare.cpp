@@ -0,0 +1,105 @@
+// Compares a baseline and a candidate run, see perf_compare.h for the statistics and the verdicts.
+//   compare [options] <baseline> <candidate>
+// The runs are benchmark JSON files (benchmark --benchmark_repetitions=10 --benchmark_out=<file>) or traces saved by
+// the "Trace capture" panel of the particles sample in the Chrome format. Exits with 2 when a series is slower.
+// Only the portable files of common are used, on other platforms build it with them:
+//   compare.cpp perf_compare.cpp json.cpp
+#include "perf_compare.h"
+#include <regex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int print_usage()
+{
+    printf("usage: compare [options] <baseline> <candidate>\n"
+           "  --threshold=<percent>     Difference of the medians that matters, 5 by default.\n"
+           "  --alpha=<p>               Significance level of the Mann-Whitney U test, 0.05 by default.\n"
+           "  --confidence=<level>      Of the bootstrap interval of the delta, 0.95 by default.\n"
+           "  --resamples=<n>           Bootstrap resamples, 2000 by default.\n"
+           "  --seed=<n>                Of the bootstrap.\n"
+           "  --filter=<regex>          Series to compare.\n"
+           "  --cpu-time                Compares the CPU time of the benchmarks instead of the real time.\n");
+    return 1;
+}
+
+static const char *flag_value(const char *arg, const char *flag)
+{
+    size_t length = strlen(flag);
+    return strncmp(arg, flag, length) == 0 && arg[length] == '=' ? arg + length + 1 : nullptr;
+}
+
+int main(int argc, char **argv)
+{
+    compare_options options;
+    std::string filter;
+    bool is_cpu_time = false;
+    std::vector<const char *> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *value = nullptr;
+        if ((value = flag_value(argv[i], "--threshold")) != nullptr)
+        {
+            options.threshold = atof(value) / 100.0;
+        }
+        else if ((value = flag_value(argv[i], "--alpha")) != nullptr)
+        {
+            options.alpha = atof(value);
+        }
+        else if ((value = flag_value(argv[i], "--confidence")) != nullptr)
+        {
+            options.confidence = atof(value);
+        }
+        else if ((value = flag_value(argv[i], "--resamples")) != nullptr)
+        {
+            options.num_resamples = (uint32_t)strtoul(value, nullptr, 10);
+        }
+        else if ((value = flag_value(argv[i], "--seed")) != nullptr)
+        {
+            options.seed = strtoull(value, nullptr, 10);
+        }
+        else if ((value = flag_value(argv[i], "--filter")) != nullptr)
+        {
+            filter = value;
+        }
+        else if (strcmp(argv[i], "--cpu-time") == 0)
+        {
+            is_cpu_time = true;
+        }
+        else if (argv[i][0] == '-')
+        {
+            return print_usage();
+        }
+        else
+        {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.size() != 2 || options.threshold < 0.0 || options.alpha <= 0.0 || options.confidence <= 0.0 ||
+        options.confidence >= 1.0)
+    {
+        return print_usage();
+    }
+
+    std::string error;
+    std::vector<perf_series> baseline;
+    std::vector<perf_series> candidate;
+    if (!load_perf_series(paths[0], &baseline, is_cpu_time, &error) || !load_perf_series(paths[1], &candidate, is_cpu_time, &error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    run_comparison comparison;
+    try
+    {
+        comparison = compare_runs(baseline, candidate, options, filter);
+    }
+    catch (const std::regex_error &e)
+    {
+        fprintf(stderr, "Invalid --filter: %s\n", e.what());
+        return 1;
+    }
+    printf("%s", comparison_report(comparison, options).c_str());
+    return comparison.num_slower > 0 ? 2 : 0;
+}
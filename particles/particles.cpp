@@ -19,14 +19,7 @@ int *new_int_base = nullptr;
 
 extern "C" __declspec(dllexport) bool update_and_render()
 {
-    // Update camera
-    graphics->update_current_camera();
-
-    // Update UI
-    imgui_new_frame();
-    ui_context::draw(graphics);
-
-    // Render the scene
+    // Update the camera and the UI, and render the scene, as tasks of the frame.
     graphics->render();
 
     if (test)
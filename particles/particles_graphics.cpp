@@ -1,12 +1,30 @@
 #include "..\common\gpu_interface.h"
 #include "particles_graphics.h"
 #include "imgui_helpers.h"
+#include "ui_context.h"
 #include "math_helpers.h"
 #include "GeometryGenerator.h"
 #include <pix3.h>
+#include <sstream>
+#include <iomanip>
 
 using namespace DirectX;
 
+static const wchar_t *equirect_texture_file = L"..\\particles\\textures\\dikholo.hdr";
+
+// Index buffer of a mesh, from the view created with it.
+static void set_index_buffer(command_recorder *recorder, const D3D12_INDEX_BUFFER_VIEW &view)
+{
+    recorder->set_index_buffer(view.BufferLocation, view.SizeInBytes, view.Format == DXGI_FORMAT_R32_UINT);
+}
+
+static void set_mesh_buffers(command_recorder *recorder, const mesh *current_mesh)
+{
+    const D3D12_VERTEX_BUFFER_VIEW &vbv = current_mesh->m_vbv;
+    recorder->set_vertex_buffer(vbv.BufferLocation, vbv.SizeInBytes, vbv.StrideInBytes);
+    set_index_buffer(recorder, current_mesh->m_ibv);
+}
+
 particles_graphics::~particles_graphics()
 {
     for (size_t i = 0; i < PSOs_MAX; i++)
@@ -18,8 +36,9 @@ particles_graphics::~particles_graphics()
 void particles_graphics::initialize()
 {
     check_hr(SetThreadDescription(GetCurrentThread(), L"main thread"));
-    create_shadowmap_thread_contexts();
-    create_compute_thread_contexts();
+    g_cpu_profiler.set_thread_name("main thread");
+    m_jobs.start();
+    create_shadowmap_job_contexts();
 
     // Settings default values.
     show_debug_camera = false;
@@ -43,20 +62,26 @@ void particles_graphics::initialize()
                                draw_commands_buffer_descriptors);
 
     // Init ImGui.
-    m_ctx = imgui_init(m_gpu.device, m_gpu.NUM_BACK_BUFFERS, back_buffer_format);
+    m_ctx = imgui_init(m_gpu.device, m_gpu.MAX_FRAMES_IN_FLIGHT, back_buffer_format);
     ImGui::SetCurrentContext(m_ctx);
 
     // Create root signatures.
+    // The shaders are compiled first, the staging tables are shrunk to the registers their reflection reports.
+    compile_shaders();
+    m_gpu.size_staging_tables(0, 20);
     m_graphics_rootsig = create_graphics_rootsig();
     NAME_D3D12_OBJECT(m_graphics_rootsig);
     m_compute_rootsig = create_compute_rootsig();
     NAME_D3D12_OBJECT(m_compute_rootsig);
+    m_geometry_rootsig = create_geometry_rootsig();
+    NAME_D3D12_OBJECT(m_geometry_rootsig);
 
     // Initialize cameras.
     m_cameras[main_camera] = camera(g_aspect_ratio, transform({0.f, 0.f, -10.f}));
     m_cameras[debug_camera] = camera(g_aspect_ratio, transform({0.f, 0.f, -10.f}), 1.f, 300.f);
     update_current_camera();
 
+    plan_transient_memory();
     create_render_targets();
     create_depth_target();
     create_PSOs();
@@ -65,41 +90,24 @@ void particles_graphics::initialize()
     create_spotlight_shadowmaps();
     create_pointlight_shadowmaps();
 
-    // Create command objects per frame, per thread context.
-    for (UINT32 i = 0; i < gpu_interface::NUM_BACK_BUFFERS; i++)
+    // Command lists are created when a pass first needs more than the pool has.
+    m_direct_list_pool.init(m_gpu.device, D3D12_COMMAND_LIST_TYPE_DIRECT, "direct lists");
+    m_compute_list_pool.init(m_gpu.device, D3D12_COMMAND_LIST_TYPE_COMPUTE, "compute lists");
+
+    // The frames are recorded through the recording interface, on lists taken from the pools.
+    m_d3d12_device.reset(new d3d12_recording_device(&m_gpu, &m_direct_list_pool, &m_compute_list_pool));
+    m_d3d12_queues[gpu_queue_graphics].reset(new d3d12_recording_queue(&m_gpu, m_gpu.graphics_cmd_queue, &m_direct_list_pool));
+    m_d3d12_queues[gpu_queue_compute].reset(new d3d12_recording_queue(&m_gpu, m_gpu.compute_cmd_queue, &m_compute_list_pool));
+    m_recording.device = m_d3d12_device.get();
+    m_recording.queues[gpu_queue_graphics] = m_d3d12_queues[gpu_queue_graphics].get();
+    m_recording.queues[gpu_queue_compute] = m_d3d12_queues[gpu_queue_compute].get();
+    create_recorders(&m_recording);
+
+    // Staging of the geometry jobs.
+    for (int i = 0; i < max_geometry_chunks; i++)
     {
-        // Staging command lists.
-        check_hr(m_gpu.device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&staging_cmdallocs[i])));
-        check_hr(m_gpu.device->CreateCommandList(gpu_interface::DEFAULT_NODE, D3D12_COMMAND_LIST_TYPE_DIRECT,
-                                                 staging_cmdallocs[i].Get(),
-                                                 nullptr, IID_PPV_ARGS(&staging_cmdlists[i])));
-        check_hr(staging_cmdlists[i]->Close());
-        NAME_D3D12_OBJECT_INDEXED(staging_cmdlists[i], i);
-        NAME_D3D12_OBJECT_INDEXED(staging_cmdallocs[i], i);
-
-        // Shadow pass command lists.
-        for (int j = 0; j < G_NUM_SHADOW_THREADS; j++)
-        {
-            check_hr(m_gpu.device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&shadow_cmdallocs[i][j])));
-            check_hr(m_gpu.device->CreateCommandList(gpu_interface::DEFAULT_NODE, D3D12_COMMAND_LIST_TYPE_DIRECT,
-                                                     shadow_cmdallocs[i][j].Get(),
-                                                     nullptr, IID_PPV_ARGS(&shadow_cmdlists[i][j])));
-            check_hr(shadow_cmdlists[i][j]->Close());
-            NAME_D3D12_OBJECT_INDEXED(shadow_cmdlists[i][j], j);
-            NAME_D3D12_OBJECT_INDEXED(shadow_cmdallocs[i][j], j);
-        }
-
-        // Compute pass command lists.
-        for (int j = 0; j < G_NUM_COMPUTE_THREADS; j++)
-        {
-            check_hr(m_gpu.device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&compute_cmdallocs[i][j])));
-            check_hr(m_gpu.device->CreateCommandList(gpu_interface::DEFAULT_NODE, D3D12_COMMAND_LIST_TYPE_COMPUTE,
-                                                     compute_cmdallocs[i][j].Get(),
-                                                     nullptr, IID_PPV_ARGS(&compute_cmdlists[i][j])));
-            check_hr(compute_cmdlists[i][j]->Close());
-            NAME_D3D12_OBJECT_INDEXED(compute_cmdlists[i][j], j);
-            NAME_D3D12_OBJECT_INDEXED(compute_cmdallocs[i][j], j);
-        }
+        m_gpu.create_recording_context(&m_geometry_contexts[i]);
+        static_cast<d3d12_command_recorder *>(m_recording.geometry[i])->set_recording_context(&m_geometry_contexts[i]);
     }
 
     // Graphics work preamble.
@@ -125,7 +133,6 @@ void particles_graphics::initialize()
                      {m_object_cb_vs.default_resource,
                       m_pass_cb.default_resource,
                       m_render_object_cb_ps.default_resource,
-                      m_volume_light_cb_ps.default_resource,
                       m_shadowcasters_transforms},
                      cmd_list,
                      D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
@@ -155,7 +162,6 @@ void particles_graphics::initialize()
                      {m_object_cb_vs.default_resource,
                       m_pass_cb.default_resource,
                       m_render_object_cb_ps.default_resource,
-                      m_volume_light_cb_ps.default_resource,
                       m_shadowcasters_transforms},
                      cmd_list,
                      D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
@@ -164,17 +170,15 @@ void particles_graphics::initialize()
     // Execute initialization.
     check_hr(cmd_list->Close());
     ID3D12CommandList *cmd_lists[] = {cmd_list.Get()};
-    m_gpu.graphics_cmd_queue->ExecuteCommandLists(_countof(cmd_lists), cmd_lists);
+    m_gpu.execute_command_lists(m_gpu.graphics_cmd_queue, cmd_lists, _countof(cmd_lists));
     m_gpu.flush_graphics_queue();
 
     // Compute work preamble.
-    ComPtr<ID3D12GraphicsCommandList> compute_cmdlist = compute_cmdlists[0][0];
-    ComPtr<ID3D12CommandAllocator> compute_cmdalloc = compute_cmdallocs[0][0];
-    check_hr(compute_cmdalloc->Reset());
-    check_hr(compute_cmdlist->Reset(compute_cmdalloc.Get(), nullptr));
+    ComPtr<ID3D12GraphicsCommandList> compute_cmdlist = m_compute_list_pool.acquire();
     m_gpu.reset_staging_descriptors();
     m_gpu.set_staging_heaps(compute_cmdlist);
     compute_cmdlist->SetComputeRootSignature(m_compute_rootsig.Get());
+    g_render_counters.add(counter_root_signature_changes);
 
     // Create textures required for image-based lighting.
     create_ibl_textures(compute_cmdlist);
@@ -187,13 +191,18 @@ void particles_graphics::initialize()
 
     // Execute compute.
     check_hr(compute_cmdlist->Close());
-    m_gpu.compute_cmd_queue->ExecuteCommandLists(1, (ID3D12CommandList *const *)compute_cmdlist.GetAddressOf());
+    m_gpu.execute_command_lists(m_gpu.compute_cmd_queue, (ID3D12CommandList *const *)compute_cmdlist.GetAddressOf(), 1);
     check_hr(m_gpu.compute_cmd_queue->Signal(compute_fence.Get(), cfence_val));
+    m_compute_list_pool.submitted((ID3D12CommandList *const *)compute_cmdlist.GetAddressOf(), 1, compute_fence.Get(), cfence_val);
 
     // Flush compute.
     WaitForSingleObject(compute_flush_event, INFINITE);
     CloseHandle(compute_flush_event);
 
+    // The equirectangular environment map was only needed to generate the IBL textures,
+    // its memory now belongs to the gbuffers and render targets.
+    m_equirect_tex.default_resource.Reset();
+
     // Transition IBL textures to pixel shader resources.
     // This transition must be done on the graphics queue.
     ComPtr<ID3D12GraphicsCommandList> post_compute_cmdlist = m_gpu.get_frame_resource()->cmd_list;
@@ -239,12 +248,16 @@ void particles_graphics::initialize()
                       m_specular_brdf_lut.default_resource},
                      post_compute_cmdlist);
     post_compute_cmdlist->ResourceBarrier((UINT)mipchain_to_read_state.size(), mipchain_to_read_state.data());
+    g_render_counters.add(counter_barriers, mipchain_to_read_state.size());
 
     // Execute transitions.
     check_hr(post_compute_cmdlist->Close());
     ID3D12CommandList *post_compute_cmdlists[] = {post_compute_cmdlist.Get()};
-    m_gpu.graphics_cmd_queue->ExecuteCommandLists(_countof(post_compute_cmdlists), post_compute_cmdlists);
+    m_gpu.execute_command_lists(m_gpu.graphics_cmd_queue, post_compute_cmdlists, _countof(post_compute_cmdlists));
     m_gpu.flush_graphics_queue();
+
+    // The first frame records the initial state.
+    capture_frame_state(&m_frame_states[m_recorded_state]);
 }
 
 void particles_graphics::resize(int width, int height)
@@ -259,196 +272,831 @@ void particles_graphics::resize(int width, int height)
     for (size_t i = 0; i < _countof(m_cameras); i++)
     {
         m_cameras[i].calc_projection();
+        m_frame_states[0].cameras[i].calc_projection();
+        m_frame_states[1].cameras[i].calc_projection();
     }
 }
 
 void particles_graphics::render()
 {
-    m_deltatime = (float)g_cpu_timer.tick();
-    gpu_interface::frame_resource *frame_resource = m_gpu.get_frame_resource();
-    PIXBeginEvent(0, "CPU render(%d)", frame_resource->fence_value); // cpu render.
+    // The update writes the other state when it overlaps the recording, it starts from the last updated one.
+    int update_index = m_overlap_update ? 1 - m_recorded_state : m_recorded_state;
+    frame_state *update_state = &m_frame_states[update_index];
+    if (update_index != m_recorded_state)
+    {
+        *update_state = m_frame_states[m_recorded_state];
+    }
 
-    m_gpu.reset_staging_descriptors();
+    // In low latency mode the input is sampled once the frame resource is available, the frame wait task is then
+    // already done. The UI runs with the frame wait task, it only writes the requested mode.
+    m_gpu.m_is_low_latency = m_is_low_latency;
+    if (m_gpu.m_is_low_latency)
+    {
+        m_gpu.wait_for_frame();
+    }
+    update_state->deltatime = (float)g_cpu_timer.tick();
+    update_state->input_timestamp = g_cpu_timer.get_timestamp();
 
-    // Compute pass.
-    for (int i = 0; i < G_NUM_COMPUTE_THREADS; i++)
+    PIXBeginEvent(0, "CPU render(%llu)", m_gpu.m_frame_pacer.frame_number()); // cpu render.
+
+    // The UI shows the timers of the last collected frame, the frame wait collects the next ones.
+    if ((uint32_t)m_timer_stats_window != m_gpu.m_timer_stats_window)
     {
-        // Reset compute command objects.
-        check_hr(compute_cmdallocs[m_gpu.frame_index][i]->Reset());
-        check_hr(compute_cmdlists[m_gpu.frame_index][i]->Reset(compute_cmdallocs[m_gpu.frame_index][i].Get(),
-                                                               m_PSOs[particle_sim_PSO]));
-        // Tell each compute worker thread to begin the simulation pass.
-        SetEvent(begin_compute_events[i]);
+        m_gpu.set_timer_stats_window((uint32_t)m_timer_stats_window);
     }
+    m_timer_results = m_gpu.m_timer_results;
+    m_timer_readback = m_gpu.m_timer_readback;
+    for (int i = 0; i < stall_cause_count; i++)
+    {
+        m_stalls[i] = g_stall_tracker.last_frame((stall_cause)i);
+    }
+    m_pacing = g_stall_tracker.pacing();
+    m_cpu_wait_ms = m_gpu.m_cpu_wait_ms;
+    m_input_to_present_ms = m_gpu.m_input_to_present_ms;
+    m_timer_stats = m_gpu.timer_stats_summaries();
+    m_render_counters = g_render_counters.last_frame();
 
-    // Execute the compute work.
-    // Wait for the previous frame's compute workers to be done.
-    WaitForMultipleObjects(G_NUM_COMPUTE_THREADS, end_compute_events, true, INFINITE);
+    // Run the CPU work of the frame, this thread runs the UI and helps with the other tasks.
+    {
+        PROFILE_SCOPE("Build frame tasks");
+        build_frame_tasks(update_index);
+        std::string tasks_error;
+        bool is_compiled = m_frame_tasks.compile(&tasks_error);
+        ASSERT(is_compiled, tasks_error.c_str());
+    }
+    m_recording.timeline.clear_log();
+    m_frame_tasks.run(&m_jobs);
+
+    m_frame_tasks_report = m_frame_tasks.dump();
+    m_frame_tasks_dot = m_frame_tasks.to_dot();
+    m_frame_tasks_json = m_frame_tasks.to_json();
+    m_render_graph_report = m_render_graph.dump();
+    m_queue_report = m_recording.timeline.dump();
+    m_list_pools_report = m_direct_list_pool.dump() + "\n" + m_compute_list_pool.dump();
+
+    std::stringstream geometry_report;
+    geometry_report.precision(3);
+    geometry_report << std::fixed;
+    geometry_report << m_jobs.num_threads() << " job threads, " << m_num_recorded_geometry_chunks << " chunks, "
+                    << m_geometry_draws.size() << " draws\n";
+    double total_ms = 0.0;
+    double longest_ms = 0.0;
+    for (int i = 0; i < m_num_recorded_geometry_chunks; i++)
+    {
+        UINT num_draws = m_geometry_chunk_begin[i + 1] - m_geometry_chunk_begin[i];
+        geometry_report << "Chunk " << i << ": " << num_draws << " draws, " << m_geometry_chunk_ms[i] << " ms\n";
+        total_ms += m_geometry_chunk_ms[i];
+        longest_ms = (std::max)(longest_ms, m_geometry_chunk_ms[i]);
+    }
+    geometry_report << "Total: " << total_ms << " ms, longest chunk: " << longest_ms << " ms";
+    m_geometry_report = geometry_report.str();
 
-    ComPtr<ID3D12GraphicsCommandList> compute_cmdlist = compute_cmdlists[m_gpu.frame_index][0]; // 0: We only use one compute thread for now.
-    check_hr(compute_cmdlist->Close());
-    size_t frame_fence_value = frame_resource->fence_value;
-    PIXBeginEvent(m_gpu.compute_cmd_queue.Get(), 0, "compute_cmd_queue executing: %d", frame_fence_value);
-    m_gpu.compute_cmd_queue->ExecuteCommandLists(1, (ID3D12CommandList *const *)compute_cmdlist.GetAddressOf());
-    m_gpu.compute_cmd_queue->Signal(compute_fence.Get(), frame_fence_value);
-    // Wait for the graphics work to finish this frame before executing compute again.
-    // TODO: This is missing a lot of opportunity for doing compute work asynchronously.
-    m_gpu.compute_cmd_queue->Wait(m_gpu.fence.Get(), frame_fence_value);
-    PIXEndEvent(m_gpu.compute_cmd_queue.Get());
-    // Wait for the compute queue to finish.
-    m_gpu.graphics_cmd_queue->Wait(compute_fence.Get(), frame_fence_value);
+    if (m_run_headless_benchmark)
+    {
+        PROFILE_SCOPE("Headless benchmark");
+        run_headless_benchmark();
+        m_run_headless_benchmark = false;
+        m_capture_headless_frame = false;
+    }
+    run_requested_benchmarks();
 
-    // Graphics work preamble.
-    ComPtr<ID3D12CommandAllocator> cmd_alloc = frame_resource->cmd_alloc;
-    ComPtr<ID3D12GraphicsCommandList> cmd_list = frame_resource->cmd_list;
-    check_hr(cmd_alloc->Reset());
-    check_hr(cmd_list->Reset(cmd_alloc.Get(), nullptr));
+    PIXEndEvent(); // cpu render.
+
+    // Present, the wait for the next frame resource is the first task of the next frame.
+    // The presented frame was recorded from the state updated by this call or by the previous one.
+    const frame_state *recorded_state = &m_frame_states[m_recorded_state];
+    m_gpu.set_input_timestamp(recorded_state->input_timestamp);
+    {
+        PROFILE_SCOPE("Present");
+        m_gpu.present_frame();
+    }
+
+    frame_latency_stats *stats = &m_latency_stats[m_recorded_state != update_index ? 1 : 0];
+    stats->num_frames++;
+    stats->total_frame_ms += g_cpu_timer.frame_time_ms;
+    stats->total_work_ms += m_frame_tasks.m_run_ms;
+    stats->total_wait_ms += m_gpu.m_cpu_wait_ms;
+    stats->total_latency_ms += m_gpu.m_input_to_present_ms;
+
+    m_recorded_state = update_index;
+
+    // Requested from the UI, applied between two frames.
+    if (m_frames_in_flight != (int)m_gpu.frames_in_flight())
+    {
+        m_gpu.set_frames_in_flight(m_frames_in_flight);
+        m_frames_in_flight = (int)m_gpu.frames_in_flight();
+    }
+
+    // The frame tasks are done, every scope of the frame is closed.
+    // The lists of the frame are submitted, its counters are complete.
+    const profile_frame &profile = g_cpu_profiler.end_frame();
+    const render_counter_frame &counters = g_render_counters.end_frame();
+    m_cpu_profile_report = dump_profile_frame(profile);
+    update_trace(profile, counters);
+}
+
+void particles_graphics::update_trace(const profile_frame &frame, const render_counter_frame &counters)
+{
+    if (m_is_tracing)
+    {
+        m_trace.add_cpu_frame(frame);
+        m_trace.add_render_counters(counters);
+        if (m_trace.is_complete())
+        {
+            const char *path = m_trace_format == trace_format_perfetto ? "frame_trace.perfetto-trace" : "frame_trace.json";
+            std::string error;
+            if (m_trace.save(path, (trace_format)m_trace_format, &error))
+            {
+                m_trace_report = "Saved to " + std::string(path) + "\n" + m_trace.dump();
+            }
+            else
+            {
+                m_trace_report = error;
+            }
+            m_is_tracing = false;
+        }
+    }
+
+    // The capture starts with the next frame, the GPU timers come frames_in_flight frames after the CPU scopes.
+    if (m_start_trace && !m_is_tracing)
+    {
+        m_trace.begin((uint32_t)m_trace_frames, m_gpu.frames_in_flight());
+        m_gpu.begin_trace(&m_trace);
+        m_is_tracing = true;
+        m_trace_report = "Capturing...";
+    }
+    m_start_trace = false;
+}
+
+void particles_graphics::run_requested_benchmarks()
+{
+    if (m_run_upload_benchmark)
+    {
+        PROFILE_SCOPE("Upload contention benchmark");
+        m_upload_benchmark_report = m_gpu.benchmark_upload_contention(sizeof(object_data_vs));
+        m_run_upload_benchmark = false;
+    }
+    if (m_run_wakeup_benchmark)
+    {
+        PROFILE_SCOPE("Wakeup benchmark");
+        m_wakeup_benchmark_report = benchmark_wakeup_latency();
+        m_run_wakeup_benchmark = false;
+    }
+    if (m_run_profile_benchmark)
+    {
+        m_profile_benchmark_report = benchmark_profile_scope();
+        m_run_profile_benchmark = false;
+    }
+}
 
-    cmd_list->SetGraphicsRootSignature(m_graphics_rootsig.Get());
-    m_gpu.set_staging_heaps(cmd_list);
-
-    // Point shadows pass.
-    point_shadows_pass(cmd_list, frame_resource);
-
-    // Staging pass.
-    ComPtr<ID3D12CommandAllocator> staging_cmdalloc = staging_cmdallocs[m_gpu.frame_index];
-    ComPtr<ID3D12GraphicsCommandList> staging_cmdlist = staging_cmdlists[m_gpu.frame_index];
-    check_hr(staging_cmdalloc->Reset());
-    check_hr(staging_cmdlist->Reset(staging_cmdalloc.Get(), nullptr));
-    m_gpu.transition(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
-                     D3D12_RESOURCE_STATE_DEPTH_WRITE,
-                     {m_spotlight_shadowmaps.default_resource},
-                     staging_cmdlist);
-    m_gpu.transition(D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
-                     D3D12_RESOURCE_STATE_COPY_DEST,
-                     {m_pass_cb.default_resource},
-                     staging_cmdlist);
-    camera *current_cam = &m_cameras[selected_cam];
-    staging_pass(staging_cmdlist, current_cam);
-    check_hr(staging_cmdlist->Close());
-    ID3D12CommandList *staging_cmdlists[] = {staging_cmdlist.Get()};
-    m_gpu.graphics_cmd_queue->ExecuteCommandLists(_countof(staging_cmdlists), staging_cmdlists);
-
-    // Tell each shadow map worker thread to begin the shadow pass.
+void particles_graphics::run_headless_benchmark()
+{
+    // The recording tasks of the frame on the null backend: the same passes and scene, without a GPU to wait for.
+    null_device device;
+    null_queue graphics_queue;
+    null_queue compute_queue;
+    frame_recording recording;
+    recording.device = &device;
+    recording.queues[gpu_queue_graphics] = &graphics_queue;
+    recording.queues[gpu_queue_compute] = &compute_queue;
+    create_recorders(&recording);
+
+    const uint32_t num_frames = 100;
+    double total_ms = 0.0;
+    double best_ms = 0.0;
+    for (uint32_t i = 0; i < num_frames; i++)
+    {
+        double frame_ms = run_headless_frame(&recording);
+        total_ms += frame_ms;
+        best_ms = (i == 0) ? frame_ms : (std::min)(best_ms, frame_ms);
+    }
+
+    // Counts of the last frame, in submission order.
+    std::vector<command_recorder *> recorders(recording.compute, recording.compute + G_NUM_COMPUTE_THREADS);
+    recorders.push_back(recording.staging);
+    recorders.insert(recorders.end(), recording.shadows, recording.shadows + G_NUM_SHADOW_THREADS);
+    recorders.push_back(recording.main);
+    recorders.insert(recorders.end(), recording.geometry, recording.geometry + m_num_recorded_geometry_chunks);
+    recorders.push_back(recording.post_geometry);
+
+    std::vector<recorded_pass_stats> passes;
+    size_t stream_bytes = 0;
+    for (command_recorder *recorder : recorders)
+    {
+        passes.insert(passes.end(), recorder->pass_stats().begin(), recorder->pass_stats().end());
+        stream_bytes += static_cast<null_command_recorder *>(recorder)->stream().size();
+    }
+
+    std::stringstream report;
+    report.precision(3);
+    report << std::fixed;
+    report << num_frames << " frames on " << m_jobs.num_threads() << " threads, "
+           << total_ms / num_frames << " ms average, " << best_ms << " ms best\n";
+    report << recorders.size() << " lists, " << stream_bytes << " bytes of commands\n";
+    report << dump_pass_stats(merge_pass_stats(passes));
+
+    // The geometry recording time against the number of jobs recording it, on the same threads.
+    // The sum is the CPU time of the chunks, the longest chunk bounds the time of the recording.
+    report << "\nGeometry jobs, draws per job, sum of the chunks, longest chunk, frame (ms averages):\n";
+    int num_requested_chunks = m_num_geometry_chunks;
+    const uint32_t num_sweep_frames = 20;
+    for (int num_chunks = 1; num_chunks <= max_geometry_chunks; num_chunks++)
+    {
+        m_num_geometry_chunks = num_chunks;
+        double chunks_ms = 0.0;
+        double longest_ms = 0.0;
+        double frames_ms = 0.0;
+        for (uint32_t i = 0; i < num_sweep_frames; i++)
+        {
+            frames_ms += run_headless_frame(&recording);
+            double frame_longest_ms = 0.0;
+            for (int chunk = 0; chunk < m_num_recorded_geometry_chunks; chunk++)
+            {
+                chunks_ms += m_geometry_chunk_ms[chunk];
+                frame_longest_ms = (std::max)(frame_longest_ms, m_geometry_chunk_ms[chunk]);
+            }
+            longest_ms += frame_longest_ms;
+        }
+        report << std::setw(2) << m_num_recorded_geometry_chunks << std::setw(8) << m_geometry_draws.size() / m_num_recorded_geometry_chunks
+               << std::setw(10) << chunks_ms / num_sweep_frames << std::setw(10) << longest_ms / num_sweep_frames
+               << std::setw(10) << frames_ms / num_sweep_frames << "\n";
+    }
+    m_num_geometry_chunks = num_requested_chunks;
+    m_headless_report = report.str();
+
+    if (m_capture_headless_frame)
+    {
+        // One more frame, through queues that copy the command streams they execute.
+        command_capture capture;
+        capture_queue capture_graphics_queue(&graphics_queue, &capture, gpu_queue_graphics);
+        capture_queue capture_compute_queue(&compute_queue, &capture, gpu_queue_compute);
+        recording.queues[gpu_queue_graphics] = &capture_graphics_queue;
+        recording.queues[gpu_queue_compute] = &capture_compute_queue;
+        run_headless_frame(&recording);
+        recording.queues[gpu_queue_graphics] = &graphics_queue;
+        recording.queues[gpu_queue_compute] = &compute_queue;
+
+        std::string error;
+        if (!capture.save(m_capture_path.c_str(), &error))
+        {
+            m_headless_report += "\n\n" + error;
+            return;
+        }
+
+        // The replay runs on its own device, like the replay tool does with the file.
+        null_device replay_device;
+        recording_queue *queues[] = {&graphics_queue, &compute_queue};
+        replay_stats stats = replay_capture(capture, &replay_device, queues, 2, 100);
+        m_headless_report += "\n\nCaptured to " + m_capture_path + ", replay:\n" + dump_replay_stats(stats);
+    }
+}
+
+double particles_graphics::run_headless_frame(frame_recording *recording)
+{
+    double start_time = g_cpu_timer.get_timestamp();
+
+    // The frame resources are the upload memory of the null device, the state is the one of the last frame.
+    task_graph &tasks = m_headless_tasks;
+    tasks.reset();
+    task_graph_handle frame_resources = tasks.add_data("frame resources");
+    task_graph_handle camera_data = tasks.add_data("camera");
+    task_graph_handle settings = tasks.add_data("settings");
+    task_graph_handle attractors_data = tasks.add_data("attractors");
+    task_graph_handle task = tasks.add_task("Frame begin", [=]() { recording->device->begin_frame(); });
+    tasks.write(task, frame_resources);
+    add_recording_tasks(&tasks, recording, frame_resources, camera_data, settings, attractors_data);
+
+    std::string tasks_error;
+    bool is_compiled = tasks.compile(&tasks_error);
+    ASSERT(is_compiled, tasks_error.c_str());
+    tasks.run(&m_jobs);
+
+    return (g_cpu_timer.get_timestamp() - start_time) / g_cpu_timer.cpu_frequency * cpu_timer::milliseconds;
+}
+
+void particles_graphics::capture_frame_state(frame_state *state)
+{
+    for (int i = 0; i < cameras_MAX; i++)
+    {
+        state->cameras[i] = m_cameras[i];
+    }
+    state->selected_cam = selected_cam;
+    state->show_debug_camera = show_debug_camera;
+
+    state->clip_delta = clip_delta;
+    state->exposure = exposure;
+    state->specular_shading = specular_shading;
+    state->do_tonemapping = do_tonemapping;
+    state->use_pcf_point_shadows = use_pcf_point_shadows;
+    state->use_pcf_max_quality = use_pcf_max_quality;
+    state->is_drawing_bounds = is_drawing_bounds;
+    state->draw_billboards = draw_billboards;
+    state->brdf_id = brdf_id;
+    state->m_indirect_diffuse_brdf = m_indirect_diffuse_brdf;
+    state->m_indirect_specular_brdf = m_indirect_specular_brdf;
+    state->m_direct_diffuse_brdf = m_direct_diffuse_brdf;
+    state->m_direct_specular_brdf = m_direct_specular_brdf;
+    state->num_geometry_chunks = m_num_geometry_chunks;
+
+    for (int i = 0; i < num_particle_systems; i++)
+    {
+        state->particle_systems_infos[i] = particle_systems_infos[i];
+        state->attractors[i] = attractors[i];
+        state->volume_lights[i].m_transform = volume_lights[i].m_transform;
+        state->volume_lights[i].m_color = volume_lights[i].m_color;
+        state->volume_lights[i].m_radius = volume_lights[i].m_radius;
+        state->volume_lights[i].m_blend_mode = volume_lights[i].m_blend_mode;
+    }
+    for (int i = 0; i < num_spotlights; i++)
+    {
+        state->spotlights[i] = spotlights[i];
+    }
+
+    state->render_objects.clear();
+    for (auto &ro_pair : m_render_objects)
+    {
+        frame_state::render_object_state ro = {&ro_pair.first, ro_pair.second.m_transform, ro_pair.second.m_roughness_metalness};
+        state->render_objects.push_back(ro);
+    }
+
+    state->deltatime = 0.f;
+    state->input_timestamp = g_cpu_timer.get_timestamp();
+}
+
+void particles_graphics::publish_frame_state(const frame_state *state)
+{
+    for (int i = 0; i < cameras_MAX; i++)
+    {
+        m_cameras[i] = state->cameras[i];
+    }
+    selected_cam = state->selected_cam;
+    show_debug_camera = state->show_debug_camera;
+
+    clip_delta = state->clip_delta;
+    exposure = state->exposure;
+    specular_shading = state->specular_shading;
+    do_tonemapping = state->do_tonemapping;
+    use_pcf_point_shadows = state->use_pcf_point_shadows;
+    use_pcf_max_quality = state->use_pcf_max_quality;
+    is_drawing_bounds = state->is_drawing_bounds;
+    draw_billboards = state->draw_billboards;
+    brdf_id = state->brdf_id;
+    m_indirect_diffuse_brdf = state->m_indirect_diffuse_brdf;
+    m_indirect_specular_brdf = state->m_indirect_specular_brdf;
+    m_direct_diffuse_brdf = state->m_direct_diffuse_brdf;
+    m_direct_specular_brdf = state->m_direct_specular_brdf;
+    m_num_geometry_chunks = state->num_geometry_chunks;
+
+    for (int i = 0; i < num_particle_systems; i++)
+    {
+        particle_systems_infos[i] = state->particle_systems_infos[i];
+        attractors[i] = state->attractors[i];
+        volume_lights[i].m_transform = state->volume_lights[i].m_transform;
+        volume_lights[i].m_color = state->volume_lights[i].m_color;
+        volume_lights[i].m_radius = state->volume_lights[i].m_radius;
+        volume_lights[i].m_blend_mode = state->volume_lights[i].m_blend_mode;
+    }
+    for (int i = 0; i < num_spotlights; i++)
+    {
+        spotlights[i] = state->spotlights[i];
+    }
+
+    // The map isn't modified after initialization, so its iteration order doesn't change.
+    size_t ro_index = 0;
+    for (auto &ro_pair : m_render_objects)
+    {
+        const frame_state::render_object_state &ro = state->render_objects[ro_index++];
+        ro_pair.second.m_transform = ro.m_transform;
+        ro_pair.second.m_roughness_metalness = ro.m_roughness_metalness;
+    }
+
+    m_deltatime = state->deltatime;
+}
+
+void particles_graphics::build_frame_tasks(int update_index)
+{
+    task_graph &tasks = m_frame_tasks;
+    tasks.reset();
+    frame_state *update_state = &m_frame_states[update_index];
+    frame_state *recorded_state = &m_frame_states[m_recorded_state];
+    imgui_draw_snapshot *update_ui = &m_ui_draws[update_index];
+    bool is_overlapped = update_index != m_recorded_state;
+
+    // Data written by the update, in the state of the next frame when it overlaps the recording.
+    task_graph_handle state_camera = tasks.add_data("state camera");
+    task_graph_handle state_settings = tasks.add_data("state settings");
+    task_graph_handle state_attractors = tasks.add_data("state attractors");
+
+    // Data shared by the recording tasks. The settings are everything the UI can edit.
+    task_graph_handle frame_resources = tasks.add_data("frame resources");
+    task_graph_handle camera_data = tasks.add_data("camera");
+    task_graph_handle settings = tasks.add_data("settings");
+    task_graph_handle attractors_data = tasks.add_data("attractors");
+
+    // Camera update.
+    // It uses the camera selected by the previous frame, the UI runs after it.
+    task_graph_handle task = tasks.add_task("Camera update", [=]() { update_current_camera(update_state); });
+    tasks.read(task, state_settings);
+    tasks.write(task, state_camera);
+
+    // UI.
+    // ImGui reads the window and keyboard state of the thread that owns the window.
+    // Its draw lists are copied, the frame that records them may run with the UI of the next one.
+    task = tasks.add_task("UI", [=]() {
+        imgui_new_frame();
+        ui_context::draw(this, update_state);
+        update_ui->capture();
+    }, true);
+    tasks.write(task, state_settings);
+
+    // Attractor update.
+    task = tasks.add_task("Attractor update", [=]() { update_attractors(update_state); });
+    tasks.read(task, state_settings);
+    tasks.write(task, state_attractors);
+
+    // Wait until the GPU is done with the frame resource, the update doesn't need it.
+    // The simulation commands written by the previous frame are the input of this one.
+    task = tasks.add_task("Frame wait", [=]() {
+        m_gpu.wait_for_frame();
+        m_gpu.reset_staging_descriptors();
+        particle_simcmds_default.Swap(particle_simcmds_swap_default);
+    });
+    tasks.write(task, frame_resources);
+
+    // Copy the recorded state to the members that the passes read.
+    task = tasks.add_task("Publish state", [=]() { publish_frame_state(recorded_state); });
+    if (!is_overlapped)
+    {
+        tasks.read(task, state_camera);
+        tasks.read(task, state_settings);
+        tasks.read(task, state_attractors);
+    }
+    tasks.write(task, camera_data);
+    tasks.write(task, settings);
+    tasks.write(task, attractors_data);
+
+    add_recording_tasks(&tasks, &m_recording, frame_resources, camera_data, settings, attractors_data);
+}
+
+void particles_graphics::create_recorders(frame_recording *recording)
+{
+    for (int i = 0; i < G_NUM_COMPUTE_THREADS; i++)
+    {
+        recording->compute[i] = recording->device->create_recorder(true);
+    }
+    recording->staging = recording->device->create_recorder(false);
     for (int i = 0; i < G_NUM_SHADOW_THREADS; i++)
     {
-        // Reset shadow map command objects.
-        check_hr(shadow_cmdallocs[m_gpu.frame_index][i]->Reset());
-        check_hr(shadow_cmdlists[m_gpu.frame_index][i]->Reset(shadow_cmdallocs[m_gpu.frame_index][i].Get(),
-                                                              m_PSOs[shadow_pass_PSO]));
-        SetEvent(begin_shadowpass_events[i]);
+        recording->shadows[i] = recording->device->create_recorder(false);
+    }
+    recording->main = recording->device->create_recorder(false);
+    recording->post_geometry = recording->device->create_recorder(false);
+    for (int i = 0; i < max_geometry_chunks; i++)
+    {
+        recording->geometry[i] = recording->device->create_recorder(false);
     }
+}
+
+void particles_graphics::add_recording_tasks(task_graph *tasks, frame_recording *recording,
+                                             task_graph_handle frame_resources, task_graph_handle camera_data,
+                                             task_graph_handle settings, task_graph_handle attractors_data)
+{
+    // Lists and queues of the frame.
+    task_graph_handle compute_list = tasks->add_data("compute list");
+    task_graph_handle staging_list = tasks->add_data("staging list");
+    task_graph_handle geometry_chunks = tasks->add_data("geometry chunks");
+    task_graph_handle geometry_lists = tasks->add_data("geometry lists");
+    task_graph_handle shadow_lists = tasks->add_data("shadow lists");
+    task_graph_handle main_list = tasks->add_data("main list");
+    task_graph_handle descriptor_ring = tasks->add_data("descriptor ring");
+    task_graph_handle graphics_queue = tasks->add_data("graphics queue");
+    task_graph_handle compute_queue = tasks->add_data("compute queue");
+
+    // Culling and simulation, recorded on the compute list.
+    task_graph_handle task = tasks->add_task("Compute recording", [=]() {
+        for (int i = 0; i < G_NUM_COMPUTE_THREADS; i++)
+        {
+            command_recorder *recorder = recording->compute[i];
+            recorder->begin(to_handle(m_PSOs[particle_sim_PSO]));
+            m_jobs.run([this, recorder, i]() { compute_worker(recorder, i); }, &m_compute_jobs);
+        }
+        m_jobs.wait(&m_compute_jobs);
+        for (int i = 0; i < G_NUM_COMPUTE_THREADS; i++)
+        {
+            recording->compute[i]->end();
+        }
+    });
+    tasks->read(task, frame_resources);
+    tasks->read(task, settings);
+    tasks->read(task, camera_data);
+    tasks->read(task, attractors_data);
+    tasks->write(task, compute_list);
+
+    // Execute the simulation once the previous frame is done drawing the particles, it overlaps the graphics work
+    // of this frame until the post geometry list.
+    task = tasks->add_task("Compute submit", [=]() {
+        queue_submission submission = recording->timeline.schedule(gpu_queue_compute, "Particle simulation", &recording->particles_released, 1);
+        submit(recording, submission, recording->compute, G_NUM_COMPUTE_THREADS);
+        recording->particles_ready = {gpu_queue_compute, submission.signal_value};
+    });
+    tasks->read(task, compute_list);
+    tasks->write(task, compute_queue);
+
+    // Pass constants, recorded on the staging list.
+    task = tasks->add_task("Pass constants", [=]() {
+        command_recorder *recorder = recording->staging;
+        recorder->begin();
+        recorder->transition(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+                             D3D12_RESOURCE_STATE_DEPTH_WRITE,
+                             {to_handle(m_spotlight_shadowmaps.default_resource.Get())});
+        recorder->transition(D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
+                             D3D12_RESOURCE_STATE_COPY_DEST,
+                             {to_handle(m_pass_cb.default_resource.Get())});
+        staging_pass(recorder, &m_cameras[selected_cam]);
+        recorder->end();
+    });
+    tasks->read(task, frame_resources);
+    tasks->read(task, camera_data);
+    tasks->read(task, settings);
+    tasks->write(task, staging_list);
+
+    // Geometry pass setup: draw list, chunks and their slices of the descriptor ring.
+    task = tasks->add_task("Geometry setup", [=]() { begin_geometry_chunks(recording); });
+    tasks->read(task, frame_resources);
+    tasks->read(task, settings);
+    tasks->write(task, geometry_chunks);
+    tasks->write(task, descriptor_ring);
+
+    // Record the geometry pass on the job system, one job per chunk of draws.
+    task = tasks->add_task("Geometry recording", [=]() {
+        XMMATRIX cam_viewproj = XMLoadFloat4x4(&m_cameras[selected_cam].m_view_proj);
+        for (int chunk = 0; chunk < m_num_recorded_geometry_chunks; chunk++)
+        {
+            command_recorder *recorder = recording->geometry[chunk];
+            m_jobs.run([this, recorder, chunk, cam_viewproj]() { record_geometry_chunk(recorder, chunk, cam_viewproj); }, &m_geometry_jobs);
+        }
+        m_jobs.wait(&m_geometry_jobs);
+    });
+    tasks->read(task, camera_data);
+    tasks->read(task, geometry_chunks);
+    tasks->write(task, geometry_lists);
+
+    // Record the shadow pass on the job system, one job per group of spotlights.
+    task = tasks->add_task("Shadow recording", [=]() {
+        for (int i = 0; i < G_NUM_SHADOW_THREADS; i++)
+        {
+            command_recorder *recorder = recording->shadows[i];
+            recorder->begin(to_handle(m_PSOs[shadow_pass_PSO]));
+            m_jobs.run([this, recorder, i]() { shadowmap_worker(recorder, i, per_thread_sl[i], G_NUM_LIGHTS_PER_THREAD); }, &m_shadow_jobs);
+        }
+        m_jobs.wait(&m_shadow_jobs);
+    });
+    tasks->read(task, frame_resources);
+    tasks->read(task, settings);
+    tasks->write(task, shadow_lists);
+
+    // Main and post geometry lists: the scene passes of the render graph, with the point shadows at the start of the
+    // post geometry list because they draw the commands of the particle simulation.
+    task = tasks->add_task("Main list recording", [=]() {
+        command_recorder *recorder = recording->main;
+        recorder->begin();
+        recorder->set_root_signature(to_handle(m_graphics_rootsig.Get()), false);
+
+        // A command list starts without state, set what the passes after the geometry pass expect from the main list.
+        command_recorder *post_geometry_recorder = recording->post_geometry;
+        post_geometry_recorder->begin();
+        post_geometry_recorder->set_root_signature(to_handle(m_graphics_rootsig.Get()), false);
+        post_geometry_recorder->set_root_shader_resource(14, m_attractors_sb.default_resource->GetGPUVirtualAddress());
+        post_geometry_recorder->set_viewport(m_gpu.viewport.Width, m_gpu.viewport.Height);
+
+        recorder->transition(D3D12_RESOURCE_STATE_COPY_DEST,
+                             D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
+                             {to_handle(m_pass_cb.default_resource.Get())});
+
+        // Point shadows pass.
+        point_shadows_pass(post_geometry_recorder);
+
+        // Light buffers were updated by the staging and shadow lists.
+        post_geometry_recorder->transition(D3D12_RESOURCE_STATE_COPY_DEST,
+                                           D3D12_RESOURCE_STATE_COMMON,
+                                           {to_handle(m_particle_lights_sb.default_resource.Get()),
+                                            to_handle(m_spotlights_sb.default_resource.Get())});
+
+        // Scene passes, the render graph records the transitions between them.
+        build_render_graph(recorder, post_geometry_recorder, &m_cameras[selected_cam]);
+        std::string graph_error;
+        bool is_compiled = m_render_graph.compile(&graph_error);
+        ASSERT(is_compiled, graph_error.c_str());
+        command_recorder *graph_recorders[] = {recorder, post_geometry_recorder};
+        m_render_graph.execute([&](const std::vector<tracked_barrier> &barriers, uint32_t list_index) {
+            m_graph_barriers.clear();
+            for (const tracked_barrier &barrier : barriers)
+            {
+                m_graph_barriers.push_back(to_recorded_barrier(barrier));
+            }
+            graph_recorders[list_index]->barriers(m_graph_barriers.data(), (uint32_t)m_graph_barriers.size());
+        });
+
+        recorder->end();
+        post_geometry_recorder->end();
+    });
+    tasks->read(task, frame_resources);
+    tasks->read(task, camera_data);
+    tasks->read(task, settings);
+    tasks->read(task, attractors_data);
+    tasks->write(task, descriptor_ring);
+    tasks->write(task, main_list);
+
+    // Execute, the shadow lists go before the main list and the geometry chunks after it.
+    // None of them read the particle buffers, they don't wait for the simulation.
+    task = tasks->add_task("Graphics submit", [=]() {
+        command_recorder *recorders[1 + G_NUM_SHADOW_THREADS + 1 + max_geometry_chunks];
+        uint32_t num_recorders = 0;
+        recorders[num_recorders++] = recording->staging;
+        for (int i = 0; i < G_NUM_SHADOW_THREADS; i++)
+        {
+            recorders[num_recorders++] = recording->shadows[i];
+        }
+        recorders[num_recorders++] = recording->main;
+        for (int i = 0; i < m_num_recorded_geometry_chunks; i++)
+        {
+            recorders[num_recorders++] = recording->geometry[i];
+        }
+        submit(recording, recording->timeline.schedule(gpu_queue_graphics, "Shadows and geometry"), recorders, num_recorders);
+    });
+    tasks->read(task, staging_list);
+    tasks->read(task, shadow_lists);
+    tasks->read(task, main_list);
+    tasks->read(task, geometry_lists);
+    tasks->write(task, graphics_queue);
+
+    // Execute the passes that read the particle buffers once the simulation is done.
+    // The simulation of the next frame waits for them.
+    task = tasks->add_task("Post submit", [=]() {
+        queue_submission submission = recording->timeline.schedule(gpu_queue_graphics, "Lighting and particles", &recording->particles_ready, 1);
+        submit(recording, submission, &recording->post_geometry, 1);
+        recording->particles_released = {gpu_queue_graphics, submission.signal_value};
+    });
+    tasks->read(task, main_list);
+    tasks->read(task, compute_queue);
+    tasks->write(task, graphics_queue);
+}
+
+void particles_graphics::submit(frame_recording *recording, const queue_submission &submission, command_recorder *const *recorders, uint32_t count)
+{
+    recording_queue *queue = recording->queues[submission.queue];
+    for (const queue_sync_point &wait : submission.waits)
+    {
+        queue->wait_on_gpu(recording->queues[wait.queue], wait.value);
+    }
+
+    // The queue signals the value the timeline took, the pooled lists are reused once it is reached.
+    queue->execute(recorders, count, submission.name.c_str());
+    uint64_t signal_value = queue->signal();
+    ASSERT(signal_value == submission.signal_value, "The queue and its timeline signal different fence values.");
+}
+
+void particles_graphics::build_render_graph(command_recorder *recorder,
+                                            command_recorder *post_geometry_recorder,
+                                            camera *current_cam)
+{
+    render_graph &graph = m_render_graph;
+    graph.reset();
+
+    // Resources, in the state they are in when the main command list starts.
+    render_graph_handle gbuffer0 = graph.import_resource("gbuffer0", m_gbuffer0.rt_default_resource.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    render_graph_handle gbuffer1 = graph.import_resource("gbuffer1", m_gbuffer1.rt_default_resource.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    render_graph_handle gbuffer2 = graph.import_resource("gbuffer2", m_gbuffer2.rt_default_resource.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    render_graph_handle depth = graph.import_resource("depth", depthtarget_default.Get(), D3D12_RESOURCE_STATE_PRESENT);
+    render_graph_handle hdr = graph.import_resource("hdr render target", m_render_targets[m_gpu.back_buffer_index].rt_default_resource.Get(),
+                                                    D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    render_graph_handle back_buffer = graph.import_resource("back buffer", m_gpu.get_back_buffer(), D3D12_RESOURCE_STATE_PRESENT);
+
+    // The HDR render target shares its memory with the ones of the other frames, and on the first frame the
+    // gbuffers take over the memory of the IBL scratch texture. The geometry and lighting passes clear them.
+    if (m_transient_plan.is_aliased[transient_hdr0 + m_gpu.back_buffer_index])
+    {
+        graph.set_aliased(hdr);
+    }
+
+    if (!m_transient_targets_activated)
+    {
+        render_graph_handle gbuffers[] = {gbuffer0, gbuffer1, gbuffer2};
+        for (int i = 0; i < _countof(gbuffers); i++)
+        {
+            if (m_transient_plan.is_aliased[transient_gbuffer0 + i])
+            {
+                graph.set_aliased(gbuffers[i]);
+            }
+        }
+        m_transient_targets_activated = true;
+    }
+
+    // Shadow maps are written by the staging, shadow and point shadow passes before the graph runs.
+    // The next frame transitions them back to DEPTH_WRITE itself.
+    render_graph_handle spotlight_shadowmaps = graph.import_resource("spotlight shadowmaps", m_spotlight_shadowmaps.default_resource.Get(),
+                                                                     D3D12_RESOURCE_STATE_DEPTH_WRITE,
+                                                                     D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    render_graph_handle pointlight_shadowmaps = graph.import_resource("pointlight shadowmaps", m_pointlight_shadowmaps.default_resource.Get(),
+                                                                      D3D12_RESOURCE_STATE_DEPTH_WRITE,
+                                                                      D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+    // The simulation leaves the particles in UAV, the compute list transitions them back from VERTEX_AND_CONSTANT_BUFFER.
+    render_graph_handle particles = graph.import_resource("particle output", particle_output_default.Get(),
+                                                          D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+                                                          D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+    graph.set_output(back_buffer);
 
     // Geometry pass.
-    m_gpu.transition(D3D12_RESOURCE_STATE_COPY_DEST,
-                     D3D12_RESOURCE_STATE_COMMON,
-                     {m_particle_lights_sb.default_resource,
-                      m_spotlights_sb.default_resource},
-                     cmd_list);
-    m_gpu.transition(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
-                     D3D12_RESOURCE_STATE_RENDER_TARGET,
-                     {m_gbuffer0.rt_default_resource,
-                      m_gbuffer1.rt_default_resource,
-                      m_gbuffer2.rt_default_resource},
-                     cmd_list);
-    m_gpu.transition(D3D12_RESOURCE_STATE_PRESENT,
-                     D3D12_RESOURCE_STATE_DEPTH_WRITE,
-                     {depthtarget_default},
-                     cmd_list);
-    draw_geometry_pass(cmd_list, frame_resource, current_cam);
+    // Its draws are recorded by the geometry jobs, on lists submitted between the main and the post geometry list.
+    render_graph_handle pass = graph.add_pass("Geometry pass", [=]() {
+        draw_geometry_pass(recorder, post_geometry_recorder);
+    });
+    graph.write(pass, gbuffer0, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    graph.write(pass, gbuffer1, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    graph.write(pass, gbuffer2, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    graph.write(pass, depth, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+    graph.end_command_list(pass);
+
+    // The next passes are recorded on the post geometry list.
+    recorder = post_geometry_recorder;
 
     // Lighting pass.
-    m_gpu.transition(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
-                     D3D12_RESOURCE_STATE_RENDER_TARGET,
-                     {m_render_targets[m_gpu.frame_index].rt_default_resource},
-                     cmd_list);
-    m_gpu.transition(D3D12_RESOURCE_STATE_RENDER_TARGET,
-                     D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
-                     {m_gbuffer0.rt_default_resource,
-                      m_gbuffer1.rt_default_resource,
-                      m_gbuffer2.rt_default_resource},
-                     cmd_list);
-    m_gpu.transition(D3D12_RESOURCE_STATE_DEPTH_WRITE,
-                     D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
-                     {m_spotlight_shadowmaps.default_resource,
-                      depthtarget_default,
-                      m_pointlight_shadowmaps.default_resource},
-                     cmd_list);
-    draw_lighting_pass(cmd_list, frame_resource);
+    // The depth target stays bound as a read-only DSV until the particles are drawn.
+    pass = graph.add_pass("Lighting pass", [=]() { draw_lighting_pass(recorder); });
+    graph.read(pass, gbuffer0, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.read(pass, gbuffer1, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.read(pass, gbuffer2, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.read(pass, depth, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.read(pass, spotlight_shadowmaps, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.read(pass, pointlight_shadowmaps, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.write(pass, hdr, D3D12_RESOURCE_STATE_RENDER_TARGET);
 
     // Draw sky.
-    draw_sky(cmd_list, frame_resource);
+    pass = graph.add_pass("Draw sky", [=]() { draw_sky(recorder); });
+    graph.read(pass, depth, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.write(pass, hdr, D3D12_RESOURCE_STATE_RENDER_TARGET);
 
     // Draw volume lights.
-    draw_volume_lights(cmd_list, m_object_cb_vs, m_volume_light_cb_ps, volume_lights, _countof(volume_lights), current_cam);
+    pass = graph.add_pass("Draw volume lights", [=]() {
+        draw_volume_lights(recorder, volume_lights, _countof(volume_lights), current_cam);
+    });
+    graph.read(pass, depth, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.write(pass, hdr, D3D12_RESOURCE_STATE_RENDER_TARGET);
 
     // Draw particle systems.
-    m_gpu.transition(D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-                     D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
-                     {particle_output_default},
-                     cmd_list);
-    m_gpu.transition(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
-                     D3D12_RESOURCE_STATE_DEPTH_READ,
-                     {depthtarget_default},
-                     cmd_list);
-    draw_particle_systems(cmd_list, frame_resource);
+    pass = graph.add_pass("Draw particle systems", [=]() { draw_particle_systems(recorder); });
+    graph.read(pass, particles, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+    graph.read(pass, depth, D3D12_RESOURCE_STATE_DEPTH_READ);
+    graph.write(pass, hdr, D3D12_RESOURCE_STATE_RENDER_TARGET);
 
     // Draw the bounding boxes visualization.
     if (is_drawing_bounds)
     {
-        draw_bounding_boxes(cmd_list);
+        pass = graph.add_pass("Draw bounding boxes", [=]() { draw_bounding_boxes(recorder); });
+        graph.read(pass, depth, D3D12_RESOURCE_STATE_DEPTH_READ);
+        graph.write(pass, hdr, D3D12_RESOURCE_STATE_RENDER_TARGET);
     }
 
     // Debug color pass.
     if (show_debug_camera)
     {
-        draw_debug_objects(cmd_list);
+        pass = graph.add_pass("Debug color pass", [=]() { draw_debug_objects(recorder); });
+        graph.read(pass, depth, D3D12_RESOURCE_STATE_DEPTH_READ);
+        graph.write(pass, hdr, D3D12_RESOURCE_STATE_RENDER_TARGET);
     }
 
     // Post processing.
-    m_gpu.transition(D3D12_RESOURCE_STATE_PRESENT,
-                     D3D12_RESOURCE_STATE_RENDER_TARGET,
-                     {frame_resource->back_buffer},
-                     cmd_list);
-    m_gpu.transition(D3D12_RESOURCE_STATE_RENDER_TARGET,
-                     D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
-                     {m_render_targets[m_gpu.frame_index].rt_default_resource},
-                     cmd_list);
-    post_process(cmd_list, frame_resource);
+    pass = graph.add_pass("Postprocess", [=]() { post_process(recorder); });
+    graph.read(pass, hdr, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.write(pass, back_buffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
 
     // Render UI.
-    m_gpu.timer_start(cmd_list, "Render ImGui");
-    imgui_render(cmd_list.Get());
-    m_gpu.timer_stop(cmd_list, "Render ImGui");
-
-    // Wait for the shadow map workers to be done.
-    WaitForMultipleObjects(G_NUM_SHADOW_THREADS, end_shadowpass_events, true, INFINITE);
-
-    // Execute.
-    m_gpu.transition(D3D12_RESOURCE_STATE_RENDER_TARGET,
-                     D3D12_RESOURCE_STATE_PRESENT,
-                     {frame_resource->back_buffer},
-                     cmd_list);
-    m_gpu.transition(D3D12_RESOURCE_STATE_DEPTH_READ,
-                     D3D12_RESOURCE_STATE_PRESENT,
-                     {depthtarget_default},
-                     cmd_list);
-    check_hr(cmd_list->Close());
-    ID3D12CommandList *cmd_lists[] = {cmd_list.Get()};
-    PIXBeginEvent(m_gpu.graphics_cmd_queue.Get(), 0, "graphics_cmd_queue executing: %d", frame_fence_value);
-    m_gpu.graphics_cmd_queue->ExecuteCommandLists(_countof(cmd_lists), cmd_lists);
-    PIXEndEvent(m_gpu.graphics_cmd_queue.Get());
-
-    PIXEndEvent(); // cpu render.
-
-    // Move to next frame.
-    m_gpu.next_frame();
+    // ImGui records its draw lists on the D3D12 list itself, the null backend has no UI to draw.
+    pass = graph.add_pass("Render ImGui", [=]() {
+        recorder->timer_start(PROFILE_EVENT("Render ImGui"));
+        recorder->record_native([=](void *native_list) {
+            imgui_render((ID3D12GraphicsCommandList *)native_list, &m_ui_draws[m_recorded_state]);
+        });
+        recorder->timer_stop(PROFILE_EVENT("Render ImGui"));
+    }, true);
+    graph.write(pass, back_buffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
 }
 
-void particles_graphics::staging_pass(ComPtr<ID3D12GraphicsCommandList> cmd_list,
+void particles_graphics::staging_pass(command_recorder *recorder,
                                       camera *cam)
 {
     // Update pass data.
+    pass_data pass = {};
+    fill_pass_data(cam, &pass);
+    m_pass_cb.update(&pass, recorder);
+
+    // Clear all shadow maps.
+    recorder->clear_depth(m_spotlight_shadowmaps.dsv_handle.ptr, 1.f);
+}
+
+void particles_graphics::fill_pass_data(camera *cam, pass_data *pass_out)
+{
     XMVECTOR eye_pos = XMLoadFloat3(&cam->m_transform.m_translation);
     XMMATRIX inv_view = XMLoadFloat4x4(&cam->m_inv_view);
     XMMATRIX view = XMLoadFloat4x4(&cam->m_view);
@@ -501,16 +1149,12 @@ void particles_graphics::staging_pass(ComPtr<ID3D12GraphicsCommandList> cmd_list
     pass.direct_diffuse_brdf = (INT)m_direct_diffuse_brdf;
     pass.direct_specular_brdf = (INT)m_direct_specular_brdf;
     pass.clip_delta = clip_delta;
-    m_pass_cb.update(&pass, cmd_list);
-
-    // Clear all shadow maps.
-    cmd_list->ClearDepthStencilView(m_spotlight_shadowmaps.dsv_handle, D3D12_CLEAR_FLAG_DEPTH, 1.f, 0, 0, nullptr);
+    *pass_out = pass;
 }
 
-void particles_graphics::point_shadows_pass(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                                            gpu_interface::frame_resource *frame)
+void particles_graphics::point_shadows_pass(command_recorder *recorder)
 {
-    m_gpu.timer_start(cmd_list, "Draw attractor point lights shadows.");
+    recorder->timer_start(PROFILE_EVENT("Draw attractor point lights shadows."));
 
     // Update point shadow casters.
     int ro_id = 0;
@@ -526,401 +1170,388 @@ void particles_graphics::point_shadows_pass(ComPtr<ID3D12GraphicsCommandList> cm
         XMStoreFloat4x4(&shadow_casters_transforms[ro_id].world_view_proj, XMMatrixTranspose(world * view_proj));
         ro_id++;
     }
+    recorder->update_buffer(to_handle(m_shadowcasters_transforms.Get()), 0, shadow_casters_transforms, shadow_transforms_cbv_size);
 
-    UINT8 *dest = frame->m_resources_buffer.allocate(shadow_transforms_cbv_size, shadow_transforms_cbv_size);
-    memcpy(dest, shadow_casters_transforms, shadow_transforms_cbv_size);
-    size_t offset = dest - frame->m_resources_buffer.m_begin;
-    cmd_list->CopyBufferRegion(m_shadowcasters_transforms.Get(), 0,
-                               frame->m_resources_buffer.m_upload_resource.Get(), offset,
-                               shadow_transforms_cbv_size);
-
-    m_gpu.transition(D3D12_RESOURCE_STATE_COPY_DEST,
-                     D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
-                     {m_pass_cb.default_resource,
-                      m_shadowcasters_transforms},
-                     cmd_list);
-    m_gpu.transition(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
-                     D3D12_RESOURCE_STATE_DEPTH_WRITE,
-                     {m_pointlight_shadowmaps.default_resource},
-                     cmd_list);
+    recorder->transition(D3D12_RESOURCE_STATE_COPY_DEST,
+                         D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
+                         {to_handle(m_shadowcasters_transforms.Get())});
+    recorder->transition(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+                         D3D12_RESOURCE_STATE_DEPTH_WRITE,
+                         {to_handle(m_pointlight_shadowmaps.default_resource.Get())});
 
     // Set a square scissor rect and viewport.
-    D3D12_RECT shadow_rect;
-    shadow_rect.left = 0;
-    shadow_rect.top = 0;
-    shadow_rect.right = (LONG)shadowmap_width;
-    shadow_rect.bottom = (LONG)shadowmap_height;
-
-    D3D12_VIEWPORT shadow_vp;
-    shadow_vp.TopLeftY = 0;
-    shadow_vp.TopLeftX = 0;
-    shadow_vp.Width = (float)shadowmap_width;
-    shadow_vp.Height = (float)shadowmap_height;
-    shadow_vp.MaxDepth = 1.0f;
-    shadow_vp.MinDepth = 0.0f;
-
-    cmd_list->RSSetViewports(1, &shadow_vp);
-    cmd_list->RSSetScissorRects(1, &shadow_rect);
+    recorder->set_viewport((float)shadowmap_width, (float)shadowmap_height);
 
     // Draw point lights shadow casters.
-    cmd_list->SetPipelineState(m_PSOs[cube_shadow_pass_PSO]);
-    cmd_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    cmd_list->OMSetRenderTargets(0, nullptr, false, &m_pointlight_shadowmaps.dsv_handle);
-    cmd_list->ClearDepthStencilView(m_pointlight_shadowmaps.dsv_handle, D3D12_CLEAR_FLAG_DEPTH, 1.f, 0, 0, nullptr);
+    recorder->set_pipeline(to_handle(m_PSOs[cube_shadow_pass_PSO]));
+    recorder->set_primitive_topology(topology_triangle_list);
+    recorder->set_render_targets(0, nullptr, m_pointlight_shadowmaps.dsv_handle.ptr);
+    recorder->clear_depth(m_pointlight_shadowmaps.dsv_handle.ptr, 1.f);
 
-    cmd_list->SetGraphicsRootDescriptorTable(12, cbv_gpu_shadowcasters_transforms_base[m_gpu.frame_index]);
-    cmd_list->SetGraphicsRootShaderResourceView(14, m_attractors_sb.default_resource->GetGPUVirtualAddress());
+    recorder->set_root_table(12, cbv_gpu_shadowcasters_transforms_base[m_gpu.frame_index].ptr);
+    recorder->set_root_shader_resource(14, m_attractors_sb.default_resource->GetGPUVirtualAddress());
 
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, CBV, 0, m_pass_cb.cpu_handle);
-    m_gpu.set_descriptor_tables(cmd_list);
+    recorder->stage_descriptor(PS, CBV, 0, m_pass_cb.cpu_handle.ptr);
+    recorder->set_descriptor_tables();
 
-    cmd_list->ExecuteIndirect(render_point_shadows_cmdsig.Get(), (UINT)num_point_shadow_cmds,
-                              render_point_shadows_cmds_default.Get(), 0,
-                              nullptr, 0);
-    m_gpu.timer_stop(cmd_list, "Draw attractor point lights shadows.");
+    recorder->execute_indirect(to_handle(render_point_shadows_cmdsig.Get()), (uint32_t)num_point_shadow_cmds,
+                               to_handle(render_point_shadows_cmds_default.Get()), 0,
+                               0, 0);
+    recorder->timer_stop(PROFILE_EVENT("Draw attractor point lights shadows."));
 
     // Set back the original viewport and scissor rect.
-    cmd_list->RSSetViewports(1, &m_gpu.viewport);
-    cmd_list->RSSetScissorRects(1, &m_gpu.scissor_rect);
+    recorder->set_viewport(m_gpu.viewport.Width, m_gpu.viewport.Height);
 }
 
-void particles_graphics::draw_geometry_pass(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                                            gpu_interface::frame_resource *frame,
-                                            camera *cam)
+void particles_graphics::draw_geometry_pass(command_recorder *recorder,
+                                            command_recorder *post_geometry_recorder)
 {
-    m_gpu.timer_start(cmd_list, "Geometry pass");
+    recorder->timer_start(PROFILE_EVENT("Geometry pass"));
 
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, VS, CBV, 1, m_object_cb_vs.cpu_handle);
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, CBV, 0, m_pass_cb.cpu_handle);
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, CBV, 1, m_render_object_cb_ps.cpu_handle);
-    frame->sampler_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, sampler, 0, m_samplers[linear_wrap]);
-    m_gpu.set_descriptor_tables(cmd_list);
+    // The passes after this one still use these bindings, on a list that starts without descriptor tables.
+    recorder->stage_descriptor(VS, CBV, 1, m_object_cb_vs.cpu_handle.ptr);
+    recorder->stage_descriptor(PS, CBV, 0, m_pass_cb.cpu_handle.ptr);
+    recorder->stage_descriptor(PS, CBV, 1, m_render_object_cb_ps.cpu_handle.ptr);
+    recorder->stage_descriptor(PS, sampler, 0, m_samplers[linear_wrap].ptr);
+    recorder->invalidate_descriptor_tables();
 
-    cmd_list->SetPipelineState(m_PSOs[pbr_simple_PSO]);
-    cmd_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    // Clear gbuffer render targets.
+    set_gbuffer_render_targets(recorder);
+    const float gbuffer_clear_color[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    recorder->clear_render_target(m_gbuffer0.rtv_handle.ptr, gbuffer_clear_color);
+    recorder->clear_render_target(m_gbuffer1.rtv_handle.ptr, gbuffer_clear_color);
+    recorder->clear_render_target(m_gbuffer2.rtv_handle.ptr, gbuffer_clear_color);
+    recorder->clear_depth(depthtarget_dsv_handle.ptr, 1.f, true);
 
-    // Set the gbuffers as the render targets.
-    D3D12_CPU_DESCRIPTOR_HANDLE gbuffers_rt_handles[3];
-    gbuffers_rt_handles[0] = m_gbuffer0.rtv_handle;
-    gbuffers_rt_handles[1] = m_gbuffer1.rtv_handle;
-    gbuffers_rt_handles[2] = m_gbuffer2.rtv_handle;
-    cmd_list->OMSetRenderTargets(_countof(gbuffers_rt_handles), gbuffers_rt_handles, FALSE,
-                                 &depthtarget_dsv_handle);
+    // The geometry chunks run between the two lists.
+    post_geometry_recorder->timer_stop(PROFILE_EVENT("Geometry pass"));
+}
 
-    // Clear gbuffer render targets.
+void particles_graphics::set_gbuffer_render_targets(command_recorder *recorder)
+{
+    descriptor_handle gbuffers_rt_handles[3];
+    gbuffers_rt_handles[0] = m_gbuffer0.rtv_handle.ptr;
+    gbuffers_rt_handles[1] = m_gbuffer1.rtv_handle.ptr;
+    gbuffers_rt_handles[2] = m_gbuffer2.rtv_handle.ptr;
+    recorder->set_render_targets(_countof(gbuffers_rt_handles), gbuffers_rt_handles, depthtarget_dsv_handle.ptr);
+}
 
-    const float gbuffer_clear_color[] = {0.0f, 0.0f, 0.0f, 0.0f};
-    for (size_t i = 0; i < _countof(gbuffers_rt_handles); i++)
+void particles_graphics::begin_geometry_chunks(frame_recording *recording)
+{
+    // Draw list of the frame, every submesh of every render object.
+    m_geometry_draws.clear();
+    UINT64 total_index_count = 0;
+    for (auto &ro_pair : m_render_objects)
+    {
+        for (const mesh::submesh &submesh : ro_pair.second.m_mesh.m_submeshes)
+        {
+            geometry_draw draw = {&ro_pair.second, &submesh};
+            m_geometry_draws.push_back(draw);
+            total_index_count += submesh.index_count;
+        }
+    }
+
+    // Split the draws in chunks of about the same number of indices, each chunk gets at least one draw.
+    UINT num_draws = (UINT)m_geometry_draws.size();
+    int num_chunks = (m_num_geometry_chunks < max_geometry_chunks) ? (std::max)(m_num_geometry_chunks, 1) : max_geometry_chunks;
+    num_chunks = (std::min)(num_chunks, (int)num_draws);
+    UINT draw_index = 0;
+    UINT64 index_count = 0;
+    for (int chunk = 0; chunk < num_chunks; chunk++)
+    {
+        m_geometry_chunk_begin[chunk] = draw_index;
+        UINT64 chunk_end_index_count = total_index_count * (chunk + 1) / num_chunks;
+        UINT last_draw = num_draws - (num_chunks - chunk - 1);
+        while (draw_index < last_draw && (draw_index == m_geometry_chunk_begin[chunk] || index_count < chunk_end_index_count))
+        {
+            index_count += m_geometry_draws[draw_index].submesh->index_count;
+            draw_index++;
+        }
+    }
+    m_geometry_chunk_begin[num_chunks] = num_draws;
+    m_num_recorded_geometry_chunks = num_chunks;
+
+    for (int chunk = 0; chunk < num_chunks; chunk++)
     {
-        cmd_list->ClearRenderTargetView(gbuffers_rt_handles[i], gbuffer_clear_color, 0, nullptr);
+        // Each draw sets the descriptor tables once.
+        UINT num_chunk_draws = m_geometry_chunk_begin[chunk + 1] - m_geometry_chunk_begin[chunk];
+        command_recorder *recorder = recording->geometry[chunk];
+        recorder->reserve_descriptor_tables(num_chunk_draws);
+        recorder->begin(to_handle(m_PSOs[pbr_simple_PSO]));
     }
-    cmd_list->ClearDepthStencilView(depthtarget_dsv_handle,
-                                    D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL,
-                                    1.f,         // Depth.
-                                    0,           // Stencil.
-                                    0, nullptr); // Rects.
+}
+
+void particles_graphics::record_geometry_chunk(command_recorder *recorder, int chunk_index, XMMATRIX view_proj)
+{
+    // The chunks are part of the geometry pass, recorded on the job threads outside of its timer.
+    render_counter_pass pass(PROFILE_EVENT("Geometry pass"));
+    double start_time = g_cpu_timer.get_timestamp();
+
+    recorder->begin_pass("Geometry pass");
+
+    // Everything the draws use is set again, a command list doesn't inherit the state of the previous one.
+    recorder->set_root_signature(to_handle(m_geometry_rootsig.Get()), false);
+    recorder->set_viewport(m_gpu.viewport.Width, m_gpu.viewport.Height);
+    recorder->set_primitive_topology(topology_triangle_list);
+    set_gbuffer_render_targets(recorder);
+
+    recorder->stage_descriptor(PS, CBV, 0, m_pass_cb.cpu_handle.ptr);
+    recorder->stage_descriptor(PS, sampler, 0, m_samplers[linear_wrap].ptr);
 
     // Draw geometry to gbuffers.
-    XMMATRIX cam_viewproj = XMLoadFloat4x4(&cam->m_view_proj);
-    std::string timer_name;
-    for (auto &ro_pair : m_render_objects)
+    // The object constants of each render object are written to the upload ring and bound as root CBVs,
+    // the chunks don't copy into a shared constant buffer so they need no barrier between them.
+    const render_object *current_ro = nullptr;
+    for (UINT i = m_geometry_chunk_begin[chunk_index]; i < m_geometry_chunk_begin[chunk_index + 1]; i++)
     {
-        timer_name = "Render " + ro_pair.first;
-        m_gpu.timer_start(cmd_list, timer_name);
-        draw_render_objects(cmd_list, &m_object_cb_vs, &m_render_object_cb_ps, &ro_pair.second, 1, cam_viewproj, true);
-        m_gpu.timer_stop(cmd_list, timer_name);
+        const geometry_draw &draw = m_geometry_draws[i];
+        if (draw.ro != current_ro)
+        {
+            object_data_vs obj_data_vs = {};
+            render_object_data_ps obj_data_ps = {};
+            fill_object_constants(draw.ro, 0, view_proj, &obj_data_vs, &obj_data_ps);
+
+            recorder->set_root_constant_buffer(m_geometry_object_vs_param,
+                                               recorder->upload(&obj_data_vs, sizeof(obj_data_vs), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT));
+            recorder->set_root_constant_buffer(m_geometry_object_ps_param,
+                                               recorder->upload(&obj_data_ps, sizeof(obj_data_ps), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT));
+            set_mesh_buffers(recorder, &draw.ro->m_mesh);
+            current_ro = draw.ro;
+        }
+
+        recorder->stage_descriptor(PS, SRV, 0, draw.submesh->SRVs[diffuse].ptr);
+        recorder->stage_descriptor(PS, SRV, 1, draw.submesh->SRVs[normal].ptr);
+        recorder->stage_descriptor(PS, SRV, 2, draw.submesh->SRVs[metallic_roughness].ptr);
+        recorder->set_descriptor_tables();
+        recorder->draw_indexed(draw.submesh->index_count, 1,
+                               draw.submesh->start_index_location,
+                               draw.submesh->base_vertex_location, 0);
     }
 
-    m_gpu.timer_stop(cmd_list, "Geometry pass");
+    recorder->end_pass();
+    recorder->end();
+
+    m_geometry_chunk_ms[chunk_index] = (g_cpu_timer.get_timestamp() - start_time) / g_cpu_timer.cpu_frequency * cpu_timer::milliseconds;
 }
 
-void particles_graphics::draw_lighting_pass(ComPtr<ID3D12GraphicsCommandList> cmd_list, gpu_interface::frame_resource *frame)
+void particles_graphics::draw_lighting_pass(command_recorder *recorder)
 {
-    m_gpu.timer_start(cmd_list, "Lighting pass");
+    recorder->timer_start(PROFILE_EVENT("Lighting pass"));
 
-    cmd_list->SetPipelineState(m_PSOs[lighting_pass_PSO]);
-    cmd_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    recorder->set_pipeline(to_handle(m_PSOs[lighting_pass_PSO]));
+    recorder->set_primitive_topology(topology_triangle_list);
 
-    cmd_list->OMSetRenderTargets(1, &m_render_targets[m_gpu.frame_index].rtv_hdr, FALSE, &depthtarget_dsv_handle);
+    descriptor_handle hdr_target = m_render_targets[m_gpu.back_buffer_index].rtv_hdr.ptr;
+    recorder->set_render_targets(1, &hdr_target, depthtarget_dsv_handle.ptr);
 
     // Clear the back buffer RTV and DSV.
     const float clear_color[] = {0.0f, 0.0f, 0.0f, 1.0f};
-    cmd_list->ClearRenderTargetView(m_render_targets[m_gpu.frame_index].rtv_hdr, clear_color, 0, nullptr);
-    cmd_list->ClearDepthStencilView(m_gpu.dsv_heap->GetCPUDescriptorHandleForHeapStart(),
-                                    D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL,
-                                    1.0f,        // Depth
-                                    0,           // Stencil
-                                    0, nullptr); // Rects
+    recorder->clear_render_target(hdr_target, clear_color);
+    recorder->clear_depth(m_gpu.dsv_heap->GetCPUDescriptorHandleForHeapStart().ptr, 1.0f, true);
 
     // Bind pass data and samplers.
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, GS, CBV, 0, m_pass_cb.cpu_handle);
-    frame->sampler_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, sampler, 1, m_samplers[shadow_sampler]);
-    frame->sampler_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, sampler, 2, m_samplers[linear_clamp]);
+    recorder->stage_descriptor(GS, CBV, 0, m_pass_cb.cpu_handle.ptr);
+    recorder->stage_descriptor(PS, sampler, 1, m_samplers[shadow_sampler].ptr);
+    recorder->stage_descriptor(PS, sampler, 2, m_samplers[linear_clamp].ptr);
 
     // Bind the gbuffers.
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 0, m_gbuffer0.srv_handle);
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 1, m_gbuffer1.srv_handle);
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 2, m_gbuffer2.srv_handle);
+    recorder->stage_descriptor(PS, SRV, 0, m_gbuffer0.srv_handle.ptr);
+    recorder->stage_descriptor(PS, SRV, 1, m_gbuffer1.srv_handle.ptr);
+    recorder->stage_descriptor(PS, SRV, 2, m_gbuffer2.srv_handle.ptr);
 
     // Bind the geometry pass depth as an SRV to reconstruct world space positions from.
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 3, depthtarget_srv_handle);
+    recorder->stage_descriptor(PS, SRV, 3, depthtarget_srv_handle.ptr);
 
     // Bind light data.
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 4, m_particle_lights_sb.srv_cpu_handle);
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 5, m_spotlights_sb.srv_cpu_handle);
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 6, m_attractors_sb.srv_cpu_handle);
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 7, m_diffuse_irradiance_tex.srv_handle);
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 8, m_specular_irradiance_tex.srv_handle);
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 9, m_specular_brdf_lut.srv_handle);
+    recorder->stage_descriptor(PS, SRV, 4, m_particle_lights_sb.srv_cpu_handle.ptr);
+    recorder->stage_descriptor(PS, SRV, 5, m_spotlights_sb.srv_cpu_handle.ptr);
+    recorder->stage_descriptor(PS, SRV, 6, m_attractors_sb.srv_cpu_handle.ptr);
+    recorder->stage_descriptor(PS, SRV, 7, m_diffuse_irradiance_tex.srv_handle.ptr);
+    recorder->stage_descriptor(PS, SRV, 8, m_specular_irradiance_tex.srv_handle.ptr);
+    recorder->stage_descriptor(PS, SRV, 9, m_specular_brdf_lut.srv_handle.ptr);
 
     // Bind counters.
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, CBV, 1, m_particle_lights_counter.cpu_handle);
+    recorder->stage_descriptor(PS, CBV, 1, m_particle_lights_counter.cpu_handle.ptr);
 
     // Bind shadow maps.
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 10, m_spotlight_shadowmaps.srv_handle);
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 11, m_pointlight_shadowmaps.srv_handle);
-    m_gpu.set_descriptor_tables(cmd_list);
+    recorder->stage_descriptor(PS, SRV, 10, m_spotlight_shadowmaps.srv_handle.ptr);
+    recorder->stage_descriptor(PS, SRV, 11, m_pointlight_shadowmaps.srv_handle.ptr);
+    recorder->set_descriptor_tables();
 
     // Draw a triangle over the viewport.
-    cmd_list->DrawInstanced(3, 1, 0, 0);
-    m_gpu.timer_stop(cmd_list, "Lighting pass");
+    recorder->draw(3, 1, 0, 0);
+    recorder->timer_stop(PROFILE_EVENT("Lighting pass"));
 }
 
-void particles_graphics::draw_sky(ComPtr<ID3D12GraphicsCommandList> cmd_list, gpu_interface::frame_resource *frame)
+void particles_graphics::draw_sky(command_recorder *recorder)
 {
-    m_gpu.timer_start(cmd_list, "Draw sky");
-    cmd_list->SetPipelineState(m_PSOs[draw_sky_PSO]);
+    recorder->timer_start(PROFILE_EVENT("Draw sky"));
+    recorder->set_pipeline(to_handle(m_PSOs[draw_sky_PSO]));
 
     // Bind the sky environment map.
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 0, m_unfiltered_tex.srv_handle);
-    m_gpu.set_descriptor_tables(cmd_list);
+    recorder->stage_descriptor(PS, SRV, 0, m_unfiltered_tex.srv_handle.ptr);
+    recorder->set_descriptor_tables();
 
-    cmd_list->DrawInstanced(3, 1, 0, 0);
-    m_gpu.timer_stop(cmd_list, "Draw sky");
+    recorder->draw(3, 1, 0, 0);
+    recorder->timer_stop(PROFILE_EVENT("Draw sky"));
 }
 
-void particles_graphics::draw_particle_systems(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                                               gpu_interface::frame_resource *frame)
+void particles_graphics::draw_particle_systems(command_recorder *recorder)
 {
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, VS, CBV, 0, m_pass_cb.cpu_handle);
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 0, m_fire_sprite.srv_handle);
-    m_gpu.set_descriptor_tables(cmd_list);
-    cmd_list->RSSetViewports(1, &m_gpu.viewport);
-    cmd_list->RSSetScissorRects(1, &m_gpu.scissor_rect);
-    cmd_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
+    recorder->stage_descriptor(VS, CBV, 0, m_pass_cb.cpu_handle.ptr);
+    recorder->stage_descriptor(PS, SRV, 0, m_fire_sprite.srv_handle.ptr);
+    recorder->set_descriptor_tables();
+    recorder->set_viewport(m_gpu.viewport.Width, m_gpu.viewport.Height);
+    recorder->set_primitive_topology(topology_point_list);
 
     if (draw_billboards)
     {
         // Draw particle systems as billboards.
-        cmd_list->SetPipelineState(m_PSOs[billboards_PSO]);
+        recorder->set_pipeline(to_handle(m_PSOs[billboards_PSO]));
     }
     else
     {
         // Draw particle systems as points.
-        cmd_list->SetPipelineState(m_PSOs[particle_point_draw_PSO]);
+        recorder->set_pipeline(to_handle(m_PSOs[particle_point_draw_PSO]));
     }
 
-    m_gpu.timer_start(cmd_list, "Draw particle systems");
-    cmd_list->ExecuteIndirect(particle_draw_cmdsig.Get(), num_particle_systems,
-                              particle_drawcmds_filtered_default.Get(), 0,
-                              particle_drawcmds_counter_default[m_gpu.frame_index].Get(), 0);
-    m_gpu.timer_stop(cmd_list, "Draw particle systems");
+    recorder->timer_start(PROFILE_EVENT("Draw particle systems"));
+    recorder->execute_indirect(to_handle(particle_draw_cmdsig.Get()), num_particle_systems,
+                               to_handle(particle_drawcmds_filtered_default.Get()), 0,
+                               to_handle(particle_drawcmds_counter_default[m_gpu.frame_index].Get()), 0);
+    recorder->timer_stop(PROFILE_EVENT("Draw particle systems"));
 }
 
-void particles_graphics::draw_bounding_boxes(ComPtr<ID3D12GraphicsCommandList> cmd_list)
+void particles_graphics::draw_bounding_boxes(command_recorder *recorder)
 {
-    m_gpu.timer_start(cmd_list, "Draw bounding boxes");
-    cmd_list->SetPipelineState(m_PSOs[draw_bounds_PSO]);
-    cmd_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_LINELIST);
-    cmd_list->ExecuteIndirect(bounds_draw_cmdsig.Get(), num_particle_systems,
-                              bounds_drawcmds_default.Get(), 0,
-                              nullptr, 0);
-    m_gpu.timer_stop(cmd_list, "Draw bounding boxes");
+    recorder->timer_start(PROFILE_EVENT("Draw bounding boxes"));
+    recorder->set_pipeline(to_handle(m_PSOs[draw_bounds_PSO]));
+    recorder->set_primitive_topology(topology_line_list);
+    recorder->execute_indirect(to_handle(bounds_draw_cmdsig.Get()), num_particle_systems,
+                               to_handle(bounds_drawcmds_default.Get()), 0,
+                               0, 0);
+    recorder->timer_stop(PROFILE_EVENT("Draw bounding boxes"));
 }
 
-void particles_graphics::draw_debug_objects(ComPtr<ID3D12GraphicsCommandList> cmd_list)
+void particles_graphics::draw_debug_objects(command_recorder *recorder)
 {
-    m_gpu.timer_start(cmd_list, "Debug color pass");
+    recorder->timer_start(PROFILE_EVENT("Debug color pass"));
 
     // Update debug camera frustum vertices.
     std::vector<camera::vertex_debug> frustum_vertices = m_cameras[debug_camera].get_debug_frustum_vertices();
-    m_debugcam_frustum_vertices.update(frustum_vertices.data());
+    m_debugcam_frustum_vertices.update(frustum_vertices.data(), recorder);
 
     // Draw debug camera frustum lines.
-    cmd_list->SetPipelineState(m_PSOs[debug_line_PSO]);
-    cmd_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_LINELIST);
-
-    D3D12_VERTEX_BUFFER_VIEW debug_cam_vertices_vbv = {};
-    debug_cam_vertices_vbv.BufferLocation = m_debugcam_frustum_vertices.m_gpu_va;
-    debug_cam_vertices_vbv.SizeInBytes = (UINT)m_debugcam_frustum_vertices.m_aligned_size;
-    debug_cam_vertices_vbv.StrideInBytes = (UINT)m_debugcam_frustum_vertices.m_datum_size;
+    recorder->set_pipeline(to_handle(m_PSOs[debug_line_PSO]));
+    recorder->set_primitive_topology(topology_line_list);
 
-    cmd_list->IASetVertexBuffers(0, 1, &debug_cam_vertices_vbv);
-    cmd_list->IASetIndexBuffer(&m_debug_cam_frustum.m_mesh.m_ibv);
+    recorder->set_vertex_buffer(m_debugcam_frustum_vertices.m_gpu_va,
+                                (uint32_t)m_debugcam_frustum_vertices.m_aligned_size,
+                                (uint32_t)m_debugcam_frustum_vertices.m_datum_size);
+    set_index_buffer(recorder, m_debug_cam_frustum.m_mesh.m_ibv);
 
     mesh::submesh debug_cam_submesh = m_debug_cam_frustum.m_mesh.m_submeshes[0];
-    cmd_list->DrawIndexedInstanced(debug_cam_submesh.index_count, 1,
-                                   debug_cam_submesh.start_index_location,
-                                   debug_cam_submesh.base_vertex_location, 0);
+    recorder->draw_indexed(debug_cam_submesh.index_count, 1,
+                           debug_cam_submesh.start_index_location,
+                           debug_cam_submesh.base_vertex_location, 0);
 
     // Draw debug camera frustum planes.
-    cmd_list->SetPipelineState(m_PSOs[debug_plane_PSO]);
-    cmd_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    recorder->set_pipeline(to_handle(m_PSOs[debug_plane_PSO]));
+    recorder->set_primitive_topology(topology_triangle_list);
 
-    cmd_list->IASetIndexBuffer(&m_debug_cam_frustum_planes.m_mesh.m_ibv);
+    set_index_buffer(recorder, m_debug_cam_frustum_planes.m_mesh.m_ibv);
 
     mesh::submesh debug_cam_planes_submesh = m_debug_cam_frustum_planes.m_mesh.m_submeshes[0];
-    cmd_list->DrawIndexedInstanced(debug_cam_planes_submesh.index_count, 1,
-                                   debug_cam_planes_submesh.start_index_location,
-                                   debug_cam_planes_submesh.base_vertex_location, 0);
-    m_gpu.timer_stop(cmd_list, "Debug color pass");
+    recorder->draw_indexed(debug_cam_planes_submesh.index_count, 1,
+                           debug_cam_planes_submesh.start_index_location,
+                           debug_cam_planes_submesh.base_vertex_location, 0);
+    recorder->timer_stop(PROFILE_EVENT("Debug color pass"));
 }
 
-void particles_graphics::post_process(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                                      gpu_interface::frame_resource *frame)
+void particles_graphics::post_process(command_recorder *recorder)
 {
-    m_gpu.timer_start(cmd_list, "Postprocess");
-    cmd_list->SetPipelineState(m_PSOs[tonemapping_PSO]);
-    cmd_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    recorder->timer_start(PROFILE_EVENT("Postprocess"));
+    recorder->set_pipeline(to_handle(m_PSOs[tonemapping_PSO]));
+    recorder->set_primitive_topology(topology_triangle_list);
 
     // Set the back buffer as the render target.
-    cmd_list->OMSetRenderTargets(1, &m_render_targets[m_gpu.frame_index].rtv_backbuffer, FALSE, nullptr);
+    descriptor_handle back_buffer_target = m_render_targets[m_gpu.back_buffer_index].rtv_backbuffer.ptr;
+    recorder->set_render_targets(1, &back_buffer_target, 0);
 
-    frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 0, m_render_targets[m_gpu.frame_index].srv_handle);
-    m_gpu.set_descriptor_tables(cmd_list);
+    recorder->stage_descriptor(PS, SRV, 0, m_render_targets[m_gpu.back_buffer_index].srv_handle.ptr);
+    recorder->set_descriptor_tables();
 
     // Draw a triangle over the viewport.
-    cmd_list->DrawInstanced(3, 1, 0, 0);
-    m_gpu.timer_stop(cmd_list, "Postprocess");
+    recorder->draw(3, 1, 0, 0);
+    recorder->timer_stop(PROFILE_EVENT("Postprocess"));
 }
 
-void particles_graphics::draw_render_objects(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                                             gpu_interface::constant_buffer<object_data_vs> *vs_cb, gpu_interface::constant_buffer<render_object_data_ps> *ps_cb,
-                                             const render_object *render_objects, size_t count, XMMATRIX view_proj, bool is_scene_pass)
+void particles_graphics::draw_render_objects(command_recorder *recorder, UINT object_vs_param,
+                                             const render_object *render_objects, size_t count, XMMATRIX view_proj)
 {
     for (int i = 0; i < count; i++)
     {
-        {
-            std::vector<D3D12_RESOURCE_BARRIER> barriers_to_copydest;
-            D3D12_RESOURCE_BARRIER transition;
-            transition.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-            transition.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-            transition.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-            transition.Transition.StateBefore = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
-            transition.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;
-
-            transition.Transition.pResource = vs_cb->default_resource.Get();
-            barriers_to_copydest.push_back(transition);
-
-            if (is_scene_pass)
-            {
-                transition.Transition.pResource = ps_cb->default_resource.Get();
-                barriers_to_copydest.push_back(transition);
-            }
-
-            cmd_list->ResourceBarrier((UINT)barriers_to_copydest.size(), barriers_to_copydest.data());
-        }
-
-        // Update per-object vertex constant buffer.
         const render_object *ro = &render_objects[i];
-        XMMATRIX world;
-        object_data_vs obj_data_vs = {};
-        world = XMLoadFloat4x4(&ro->m_transform.m_world);
-        XMStoreFloat4x4(&obj_data_vs.world, XMMatrixTranspose(world));
-
-        XMMATRIX mvp = world * view_proj;
-        XMStoreFloat4x4(&obj_data_vs.world_view_proj, XMMatrixTranspose(mvp));
 
-        // Update per-object pixel constant buffer.
+        // Each draw reads its own copy of the constants in the upload ring, there is no copy or barrier between them.
+        object_data_vs obj_data_vs = {};
         render_object_data_ps obj_data_ps = {};
-        obj_data_ps.roughness_metalness = ro->m_roughness_metalness;
-        obj_data_ps.color = ro->m_color;
-        obj_data_ps.object_id = i;
-
-        mtx.lock();
-        vs_cb->update(&obj_data_vs, cmd_list);
-        if (is_scene_pass)
-        {
-            ps_cb->update(&obj_data_ps, cmd_list);
-        }
-        mtx.unlock();
-
-        {
-            // Transition to proper state for drawing.
-            std::vector<D3D12_RESOURCE_BARRIER> barriers_to_read;
-            D3D12_RESOURCE_BARRIER transition;
-            transition.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-            transition.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-            transition.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-            transition.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-            transition.Transition.StateAfter = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
-
-            transition.Transition.pResource = vs_cb->default_resource.Get();
-            barriers_to_read.push_back(transition);
-
-            if (is_scene_pass)
-            {
-                transition.Transition.pResource = ps_cb->default_resource.Get();
-                barriers_to_read.push_back(transition);
-            }
-            cmd_list->ResourceBarrier((UINT)barriers_to_read.size(), barriers_to_read.data());
-        }
+        fill_object_constants(ro, i, view_proj, &obj_data_vs, &obj_data_ps);
+        recorder->set_root_constant_buffer(object_vs_param,
+                                           recorder->upload(&obj_data_vs, sizeof(obj_data_vs), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT));
 
         // Set vertex and index buffers.
-        const mesh *current_mesh = &ro->m_mesh;
-        cmd_list->IASetVertexBuffers(0, 1, &current_mesh->m_vbv);
-        cmd_list->IASetIndexBuffer(&current_mesh->m_ibv);
+        set_mesh_buffers(recorder, &ro->m_mesh);
 
         // Draw each submesh.
         for (const mesh::submesh &submesh : ro->m_mesh.m_submeshes)
         {
-            gpu_interface::frame_resource *frame = m_gpu.get_frame_resource();
-
-            if (is_scene_pass)
-            {
-                frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 0, submesh.SRVs[diffuse]);
-                frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 1, submesh.SRVs[normal]);
-                frame->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, SRV, 2, submesh.SRVs[metallic_roughness]);
-                m_gpu.set_descriptor_tables(cmd_list);
-            }
-            cmd_list->DrawIndexedInstanced(submesh.index_count, 1,
-                                           submesh.start_index_location,
-                                           submesh.base_vertex_location, 0);
+            recorder->draw_indexed(submesh.index_count, 1,
+                                   submesh.start_index_location,
+                                   submesh.base_vertex_location, 0);
         }
     }
 }
 
-void particles_graphics::draw_volume_lights(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                                            gpu_interface::constant_buffer<object_data_vs> vs_cb, gpu_interface::constant_buffer<volume_light_data_ps> ps_cb,
+void particles_graphics::fill_object_constants(const render_object *ro, int object_id, XMMATRIX view_proj,
+                                               object_data_vs *obj_data_vs, render_object_data_ps *obj_data_ps)
+{
+    // Per-object vertex constants.
+    XMMATRIX world = XMLoadFloat4x4(&ro->m_transform.m_world);
+    XMStoreFloat4x4(&obj_data_vs->world, XMMatrixTranspose(world));
+
+    XMMATRIX mvp = world * view_proj;
+    XMStoreFloat4x4(&obj_data_vs->world_view_proj, XMMatrixTranspose(mvp));
+
+    // Per-object pixel constants.
+    obj_data_ps->roughness_metalness = ro->m_roughness_metalness;
+    obj_data_ps->color = ro->m_color;
+    obj_data_ps->object_id = object_id;
+}
+
+void particles_graphics::draw_volume_lights(command_recorder *recorder,
                                             const volume_light *volume_lights, size_t count,
                                             const camera *current_cam)
 {
-    m_gpu.timer_start(cmd_list, "Draw volume lights");
-    cmd_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    recorder->timer_start(PROFILE_EVENT("Draw volume lights"));
+    recorder->set_primitive_topology(topology_triangle_list);
 
-    m_gpu.get_frame_resource()->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, PS, CBV, 2, m_volume_light_cb_ps.cpu_handle);
-    m_gpu.set_descriptor_tables(cmd_list);
+    recorder->set_descriptor_tables();
 
     for (int i = 0; i < count; i++)
     {
-        m_gpu.transition(D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
-                         D3D12_RESOURCE_STATE_COPY_DEST,
-                         {vs_cb.default_resource,
-                          ps_cb.default_resource},
-                         cmd_list);
-
         const volume_light *vl = &volume_lights[i];
 
         switch (vl->m_blend_mode)
         {
         case alpha_transparency:
-            cmd_list->SetPipelineState(m_PSOs[volume_light_alpha_transparency_PSO]);
+            recorder->set_pipeline(to_handle(m_PSOs[volume_light_alpha_transparency_PSO]));
             break;
         case additive_transparency:
-            cmd_list->SetPipelineState(m_PSOs[volume_light_additive_transparency_PSO]);
+            recorder->set_pipeline(to_handle(m_PSOs[volume_light_additive_transparency_PSO]));
             break;
         default:
-            cmd_list->SetPipelineState(m_PSOs[volume_light_additive_transparency_PSO]);
+            recorder->set_pipeline(to_handle(m_PSOs[volume_light_additive_transparency_PSO]));
             break;
         }
 
@@ -946,32 +1577,22 @@ void particles_graphics::draw_volume_lights(ComPtr<ID3D12GraphicsCommandList> cm
         XMStoreFloat3(&volume_light_data.object_space_cam_pos, XMVector3TransformCoord(eye_pos, world_to_object));
         XMStoreFloat3(&volume_light_data.object_space_cam_forward, XMVector4Transform(eye_forward, world_to_object));
 
-        // Transfer updates to the GPU.
-        mtx.lock();
-        vs_cb.update(&obj_data_vs, cmd_list);
-        ps_cb.update(&volume_light_data, cmd_list);
-        mtx.unlock();
-
-        m_gpu.transition(D3D12_RESOURCE_STATE_COPY_DEST,
-                         D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
-                         {vs_cb.default_resource,
-                          ps_cb.default_resource},
-                         cmd_list);
+        // Each light reads its own copy of the constants in the upload ring, there is no copy or barrier between them.
+        recorder->set_root_constant_buffer(10, recorder->upload(&obj_data_vs, sizeof(obj_data_vs), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT));
+        recorder->set_root_constant_buffer(15, recorder->upload(&volume_light_data, sizeof(volume_light_data), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT));
 
         // Set vertex and index buffers.
-        const mesh *current_mesh = &vl->m_mesh;
-        cmd_list->IASetVertexBuffers(0, 1, &current_mesh->m_vbv);
-        cmd_list->IASetIndexBuffer(&current_mesh->m_ibv);
+        set_mesh_buffers(recorder, &vl->m_mesh);
 
         // Draw each submesh.
         for (const mesh::submesh &submesh : vl->m_mesh.m_submeshes)
         {
-            cmd_list->DrawIndexedInstanced(submesh.index_count, 1,
-                                           submesh.start_index_location,
-                                           submesh.base_vertex_location, 0);
+            recorder->draw_indexed(submesh.index_count, 1,
+                                   submesh.start_index_location,
+                                   submesh.base_vertex_location, 0);
         }
     }
-    m_gpu.timer_stop(cmd_list, "Draw volume lights");
+    recorder->timer_stop(PROFILE_EVENT("Draw volume lights"));
 }
 
 void particles_graphics::create_particle_systems_data(ComPtr<ID3D12GraphicsCommandList> cmd_list)
@@ -1002,7 +1623,8 @@ void particles_graphics::create_particle_systems_data(ComPtr<ID3D12GraphicsComma
     m_gpu.default_resource_from_uploader(cmd_list, particle_initial_default.GetAddressOf(),
                                          particles,
                                          total_particles_buffer_size,
-                                         D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+                                         D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT,
+                                         D3D12_RESOURCE_FLAG_NONE, gpu_memory_buffers, "particle_initial_default");
     NAME_D3D12_OBJECT(particle_initial_default);
 
     // Create input particles buffer filled with initial simulation data.
@@ -1010,7 +1632,8 @@ void particles_graphics::create_particle_systems_data(ComPtr<ID3D12GraphicsComma
                                          particles,
                                          num_particles_total * sizeof(particle::aligned_aos),
                                          sizeof(particle::aligned_aos),
-                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+                                         gpu_memory_buffers, "particle_input_default");
     NAME_D3D12_OBJECT(particle_input_default);
 
     // Create empty output particles buffer.
@@ -1022,6 +1645,7 @@ void particles_graphics::create_particle_systems_data(ComPtr<ID3D12GraphicsComma
         D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
         nullptr,
         IID_PPV_ARGS(particle_output_default.GetAddressOf())));
+    track_gpu_memory(m_gpu.device.Get(), particle_output_default.Get(), gpu_memory_buffers, "particle_output_default");
     NAME_D3D12_OBJECT(particle_output_default);
 
     // Create a SRV/UAV for each particle system inside each of the descriptor heaps.
@@ -1044,7 +1668,7 @@ void particles_graphics::create_particle_systems_data(ComPtr<ID3D12GraphicsComma
     D3D12_CPU_DESCRIPTOR_HANDLE handle;
     size_t offset_in_descriptors = 0;
     size_t offset_in_bytes = 0;
-    for (size_t i = 0; i < m_gpu.NUM_BACK_BUFFERS; i++)
+    for (size_t i = 0; i < m_gpu.MAX_FRAMES_IN_FLIGHT; i++)
     {
         auto csu_table_alloc = m_gpu.frames[i].csu_table_allocator;
         ComPtr<ID3D12DescriptorHeap> csu_heap_gpu = csu_table_alloc.m_heap_gpu;
@@ -1121,6 +1745,7 @@ void particles_graphics::create_particle_systems_data(ComPtr<ID3D12GraphicsComma
     sprite_textures_heap_desc.SizeInBytes = num_particle_systems * num_textures_per_particle_system * max_sprite_size;
 
     check_hr(m_gpu.device->CreateHeap(&sprite_textures_heap_desc, IID_PPV_ARGS(&m_sprite_textures_heap)));
+    track_gpu_memory(m_sprite_textures_heap.Get(), gpu_memory_textures, "m_sprite_textures_heap");
     NAME_D3D12_OBJECT(m_sprite_textures_heap);
 
     // Load the fire sprite texture.
@@ -1197,13 +1822,15 @@ void particles_graphics::create_particle_simulation_commands(ComPtr<ID3D12Graphi
     }
     m_gpu.default_resource_from_uploader(cmd_list, particle_simcmds_default.GetAddressOf(),
                                          particle_sim_cmds, simulation_commands_size, simulation_command_size,
-                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+                                         gpu_memory_buffers, "particle_simcmds_default");
     NAME_D3D12_OBJECT(particle_simcmds_default);
 
     // Create resource to hold the filtered particle simulation commands.
     m_gpu.default_resource_from_uploader(cmd_list, particle_simcmds_filtered_default.GetAddressOf(),
                                          nullptr, simulation_commands_size, simulation_command_size,
-                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+                                         gpu_memory_buffers, "particle_simcmds_filtered_default");
     NAME_D3D12_OBJECT(particle_simcmds_filtered_default);
 
     // Create indirect simulation commands that point to CBVs that contain swapped buffer indices.
@@ -1215,7 +1842,8 @@ void particles_graphics::create_particle_simulation_commands(ComPtr<ID3D12Graphi
     }
     m_gpu.default_resource_from_uploader(cmd_list, particle_simcmds_swap_default.GetAddressOf(),
                                          particle_sim_cmds, simulation_commands_size, simulation_command_size,
-                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+                                         gpu_memory_buffers, "particle_simcmds_swap_default");
     NAME_D3D12_OBJECT(particle_simcmds_swap_default);
 
     // Create filtered particle simulation descriptors.
@@ -1237,7 +1865,7 @@ void particles_graphics::create_particle_simulation_commands(ComPtr<ID3D12Graphi
     particle_simcmds_filtered_uav_desc.Buffer.StructureByteStride = (UINT)simulation_command_size;
     particle_simcmds_filtered_uav_desc.Buffer.CounterOffsetInBytes = 0;
 
-    for (UINT32 i = 0; i < gpu_interface::NUM_BACK_BUFFERS; i++)
+    for (UINT32 i = 0; i < gpu_interface::MAX_FRAMES_IN_FLIGHT; i++)
     {
         auto csu_table_alloc = m_gpu.frames[i].csu_table_allocator;
         ComPtr<ID3D12DescriptorHeap> csu_heap_gpu = csu_table_alloc.m_heap_gpu;
@@ -1249,6 +1877,7 @@ void particles_graphics::create_particle_simulation_commands(ComPtr<ID3D12Graphi
                                                        D3D12_RESOURCE_STATE_COMMON,
                                                        nullptr,
                                                        IID_PPV_ARGS(&particle_simcmds_counter_default[i])));
+        track_gpu_memory(m_gpu.device.Get(), particle_simcmds_counter_default[i].Get(), gpu_memory_buffers, "particle_simcmds_counter_default");
         NAME_D3D12_OBJECT_INDEXED(particle_simcmds_counter_default[i], i);
 
         size_t offset_to_simcmds = uav_simulation_commands_buffer * csu_table_alloc.m_descriptor_size;
@@ -1314,7 +1943,8 @@ void particles_graphics::create_particle_draw_commands(ComPtr<ID3D12GraphicsComm
     m_gpu.default_resource_from_uploader(cmd_list, particle_drawcmds_default.GetAddressOf(),
                                          particle_draw_cmds, draw_commands_size,
                                          draw_command_size,
-                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+                                         gpu_memory_buffers, "particle_drawcmds_default");
     NAME_D3D12_OBJECT(particle_drawcmds_default);
 
     // Create resource to hold the filtered particle draw commands.
@@ -1324,6 +1954,7 @@ void particles_graphics::create_particle_draw_commands(ComPtr<ID3D12GraphicsComm
                                                    D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
                                                    nullptr,
                                                    IID_PPV_ARGS(&particle_drawcmds_filtered_default)));
+    track_gpu_memory(m_gpu.device.Get(), particle_drawcmds_filtered_default.Get(), gpu_memory_buffers, "particle_drawcmds_filtered_default");
     NAME_D3D12_OBJECT(particle_drawcmds_filtered_default);
 
     // Create filtered particle drawing descriptors.
@@ -1345,7 +1976,7 @@ void particles_graphics::create_particle_draw_commands(ComPtr<ID3D12GraphicsComm
     particle_drawcmds_filtered_uav_desc.Buffer.StructureByteStride = (UINT)draw_command_size;
     particle_drawcmds_filtered_uav_desc.Buffer.CounterOffsetInBytes = 0;
 
-    for (UINT32 i = 0; i < gpu_interface::NUM_BACK_BUFFERS; i++)
+    for (UINT32 i = 0; i < gpu_interface::MAX_FRAMES_IN_FLIGHT; i++)
     {
         auto csu_table_alloc = m_gpu.frames[i].csu_table_allocator;
         ComPtr<ID3D12DescriptorHeap> csu_heap_gpu = csu_table_alloc.m_heap_gpu;
@@ -1363,6 +1994,7 @@ void particles_graphics::create_particle_draw_commands(ComPtr<ID3D12GraphicsComm
                                                        D3D12_RESOURCE_STATE_COMMON,
                                                        nullptr,
                                                        IID_PPV_ARGS(&particle_drawcmds_counter_default[i])));
+        track_gpu_memory(m_gpu.device.Get(), particle_drawcmds_counter_default[i].Get(), gpu_memory_buffers, "particle_drawcmds_counter_default");
         NAME_D3D12_OBJECT_INDEXED(particle_drawcmds_counter_default[i], i);
 
         offset_to_drawcmds = uav_draw_commands_buffer * csu_table_alloc.m_descriptor_size;
@@ -1375,9 +2007,9 @@ void particles_graphics::create_particle_draw_commands(ComPtr<ID3D12GraphicsComm
 void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> cmd_list)
 {
     // Load equirectangular environment texture data.
-    m_gpu.upload_dds(L"..\\particles\\textures\\dikholo.hdr",
+    m_gpu.upload_dds(equirect_texture_file,
                      cmd_list, m_equirect_tex.default_resource.GetAddressOf(),
-                     true, nullptr, 0);
+                     true, transient_heap(transient_equirect), transient_offset(transient_equirect));
     NAME_D3D12_OBJECT(m_equirect_tex.default_resource);
 
     D3D12_RESOURCE_DESC tex_desc = m_equirect_tex.default_resource->GetDesc();
@@ -1423,6 +2055,7 @@ void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> c
                                                    D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
                                                    &clear_value,
                                                    IID_PPV_ARGS(m_unfiltered_tex.default_resource.GetAddressOf())));
+    track_gpu_memory(m_gpu.device.Get(), m_unfiltered_tex.default_resource.Get(), gpu_memory_textures, "m_unfiltered_tex");
     NAME_D3D12_OBJECT(m_unfiltered_tex.default_resource);
 
     // Unfiltered environment map UAV.
@@ -1461,6 +2094,7 @@ void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> c
                                                    D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
                                                    &clear_value,
                                                    IID_PPV_ARGS(m_diffuse_irradiance_tex.default_resource.GetAddressOf())));
+    track_gpu_memory(m_gpu.device.Get(), m_diffuse_irradiance_tex.default_resource.Get(), gpu_memory_textures, "m_diffuse_irradiance_tex");
 
     // Diffuse irradiance map UAV.
     m_diffuse_irradiance_tex.uav_handle.ptr = m_gpu.csu_allocator.allocate();
@@ -1483,6 +2117,7 @@ void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> c
                                                    D3D12_RESOURCE_STATE_COPY_DEST,
                                                    &clear_value,
                                                    IID_PPV_ARGS(m_specular_irradiance_tex.default_resource.GetAddressOf())));
+    track_gpu_memory(m_gpu.device.Get(), m_specular_irradiance_tex.default_resource.Get(), gpu_memory_textures, "m_specular_irradiance_tex");
     NAME_D3D12_OBJECT(m_specular_irradiance_tex.default_resource);
 
     // Create a SRV for the full cube texture mipmap of the specualar irradiance map.
@@ -1560,6 +2195,7 @@ void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> c
                                                    D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
                                                    nullptr,
                                                    IID_PPV_ARGS(m_specular_brdf_lut.default_resource.GetAddressOf())));
+    track_gpu_memory(m_gpu.device.Get(), m_specular_brdf_lut.default_resource.Get(), gpu_memory_textures, "m_specular_brdf_lut");
     NAME_D3D12_OBJECT(m_specular_brdf_lut.default_resource);
 
     // Create UAV and SRV for specular brdf lut.
@@ -1589,6 +2225,7 @@ void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> c
                      {m_equirect_tex.default_resource},
                      cmd_list);
     cmd_list->SetPipelineState(m_PSOs[equirect_to_cube_PSO]);
+    g_render_counters.add(counter_pipeline_changes);
 
     gpu_interface::frame_resource *frame_resource = m_gpu.get_frame_resource();
     frame_resource->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, CS, UAV, 0, m_unfiltered_tex.uav_handle);
@@ -1600,6 +2237,7 @@ void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> c
     cmd_list->Dispatch((UINT)unfiltered_envmap_desc.Width / 32,
                        unfiltered_envmap_desc.Height / 32,
                        6);
+    g_render_counters.add(counter_dispatches);
 
     // Copy the unfiltered environment mip0 into mip0 of the specular irradiance map.
     // This is because mip0 will contain the highest frequency details, thus it doesn't get convolved at all.
@@ -1631,6 +2269,7 @@ void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> c
                      {m_specular_irradiance_tex.default_resource},
                      cmd_list);
     cmd_list->SetPipelineState(m_PSOs[generate_mipmap_PSO]);
+    g_render_counters.add(counter_pipeline_changes);
 
     std::vector<D3D12_RESOURCE_BARRIER> to_write_state(specular_irradiance_desc.DepthOrArraySize);
     std::vector<D3D12_RESOURCE_BARRIER> to_read_state(specular_irradiance_desc.DepthOrArraySize);
@@ -1661,6 +2300,7 @@ void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> c
         }
 
         cmd_list->ResourceBarrier((UINT)to_write_state.size(), to_write_state.data());
+        g_render_counters.add(counter_barriers, to_write_state.size());
 
         frame_resource->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, CS, SRV, 2,
                                                               m_specular_irradiance_tex.mips_srv_handles[mip_level]);
@@ -1672,7 +2312,9 @@ void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> c
         UINT tgroups_y = (std::max)(1, mip_height / 8);
         UINT tgroups_z = specular_irradiance_desc.DepthOrArraySize;
         cmd_list->Dispatch(tgroups_x, tgroups_y, tgroups_z);
+        g_render_counters.add(counter_dispatches);
         cmd_list->ResourceBarrier((UINT)to_read_state.size(), to_read_state.data());
+        g_render_counters.add(counter_barriers, to_read_state.size());
     }
 
     m_gpu.transition(D3D12_RESOURCE_STATE_COPY_SOURCE,
@@ -1699,9 +2341,11 @@ void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> c
         }
     }
     cmd_list->ResourceBarrier((UINT)mipchain_to_write_state.size(), mipchain_to_write_state.data());
+    g_render_counters.add(counter_barriers, mipchain_to_write_state.size());
 
     // Filter the mip chain of the unfiltered environment map to obtain a specular irradiance map.
     cmd_list->SetPipelineState(m_PSOs[filter_specular_irradiance_map_PSO]);
+    g_render_counters.add(counter_pipeline_changes);
 
     // Get the width of the Mip1 subresource.
     UINT mip1_subresource = D3D12CalcSubresource(1, 0, 0,
@@ -1732,10 +2376,12 @@ void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> c
         cmd_list->Dispatch(tgroups_x,
                            tgroups_y,
                            tgroups_z);
+        g_render_counters.add(counter_dispatches);
     }
 
     // Filter the environment map to obtain a diffuse irradiance map.
     cmd_list->SetPipelineState(m_PSOs[filter_diffuse_irradiance_map_PSO]);
+    g_render_counters.add(counter_pipeline_changes);
     frame_resource->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, CS, SRV, 1, m_unfiltered_tex.srv_handle);
     frame_resource->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, CS, UAV, 1, m_diffuse_irradiance_tex.uav_handle);
     m_gpu.set_descriptor_tables(cmd_list);
@@ -1743,9 +2389,11 @@ void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> c
     cmd_list->Dispatch((UINT)diffuse_irradiance_map_desc.Width / 32,
                        diffuse_irradiance_map_desc.Height / 32,
                        6);
+    g_render_counters.add(counter_dispatches);
 
     // Pre-integrate the Cook-Torrance specular BRDF for varying roughness and viewing directions inside of a look-up table.
     cmd_list->SetPipelineState(m_PSOs[pre_integrate_specular_brdf_PSO]);
+    g_render_counters.add(counter_pipeline_changes);
     frame_resource->sampler_table_allocator.stage_to_cpu_heap(m_gpu.device, CS, sampler, 1, m_samplers[linear_clamp]);
     frame_resource->csu_table_allocator.stage_to_cpu_heap(m_gpu.device, CS, UAV, 0, m_specular_brdf_lut.uav_handle);
     m_gpu.set_descriptor_tables(cmd_list);
@@ -1754,6 +2402,7 @@ void particles_graphics::create_ibl_textures(ComPtr<ID3D12GraphicsCommandList> c
     cmd_list->Dispatch((UINT)spec_brdf_lut_desc.Width / 32,
                        spec_brdf_lut_desc.Height / 32,
                        1);
+    g_render_counters.add(counter_dispatches);
 }
 
 void particles_graphics::create_point_shadows_draw_commands(ComPtr<ID3D12GraphicsCommandList> cmd_list)
@@ -1828,15 +2477,86 @@ void particles_graphics::create_point_shadows_draw_commands(ComPtr<ID3D12Graphic
     m_gpu.default_resource_from_uploader(cmd_list, render_point_shadows_cmds_default.GetAddressOf(),
                                          render_shadows_cmds.data(), num_point_shadow_cmds * sizeof(point_shadow_draw_command),
                                          sizeof(point_shadow_draw_command),
-                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+                                         gpu_memory_buffers, "render_point_shadows_cmds_default");
     NAME_D3D12_OBJECT(render_point_shadows_cmds_default);
 }
 
+void particles_graphics::plan_transient_memory()
+{
+    // Render targets can only share a heap with other textures on resource heap tier 2.
+    D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+    check_hr(m_gpu.device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)));
+    bool is_mixed_heap_supported = options.ResourceHeapTier >= D3D12_RESOURCE_HEAP_TIER_2;
+    const uint32_t rt_category = 0;
+    const uint32_t texture_category = is_mixed_heap_supported ? rt_category : 1;
+
+    D3D12_RESOURCE_DESC gbuffer_descs[] = {m_gpu.gbuffer_desc(gbuffer0_format),
+                                           m_gpu.gbuffer_desc(gbuffer1_format),
+                                           m_gpu.gbuffer_desc(gbuffer2_format)};
+    D3D12_RESOURCE_DESC hdr_desc = m_gpu.render_target_desc(hdr_buffer_format);
+    const uint32_t last_frame_pass = gpu_interface::NUM_BACK_BUFFERS * transient_passes_per_frame;
+
+    m_transient_requests.resize(transient_MAX);
+    D3D12_RESOURCE_ALLOCATION_INFO equirect_info = m_gpu.dds_allocation_info(equirect_texture_file, true);
+    m_transient_requests[transient_equirect] = {"equirect environment map", equirect_info.SizeInBytes, equirect_info.Alignment,
+                                                0, 0, texture_category};
+
+    // The gbuffers are shared by every frame in flight.
+    for (int i = 0; i < _countof(gbuffer_descs); i++)
+    {
+        D3D12_RESOURCE_ALLOCATION_INFO info = m_gpu.device->GetResourceAllocationInfo(0, 1, &gbuffer_descs[i]);
+        m_transient_requests[transient_gbuffer0 + i] = {"gbuffer" + std::to_string(i), info.SizeInBytes, info.Alignment,
+                                                        1, last_frame_pass, rt_category};
+    }
+
+    // Each HDR render target is written by the lighting pass and read by the post process pass of its frame.
+    // The frames execute one after the other on the graphics queue, so the render targets never live at the same time.
+    D3D12_RESOURCE_ALLOCATION_INFO hdr_info = m_gpu.device->GetResourceAllocationInfo(0, 1, &hdr_desc);
+    for (uint32_t i = 0; i < gpu_interface::NUM_BACK_BUFFERS; i++)
+    {
+        uint32_t lighting_pass = 1 + i * transient_passes_per_frame + 1;
+        m_transient_requests[transient_hdr0 + i] = {"hdr render target " + std::to_string(i), hdr_info.SizeInBytes, hdr_info.Alignment,
+                                                    lighting_pass, lighting_pass, rt_category};
+    }
+
+    m_transient_plan = plan_memory_aliasing(m_transient_requests);
+
+    m_transient_heaps.clear();
+    for (const aliasing_heap &heap : m_transient_plan.heaps)
+    {
+        D3D12_HEAP_DESC heap_desc = {};
+        heap_desc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+        heap_desc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+        heap_desc.SizeInBytes = align_up(heap.size, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+        if (is_mixed_heap_supported)
+        {
+            heap_desc.Flags = D3D12_HEAP_FLAG_DENY_BUFFERS;
+        }
+        else
+        {
+            heap_desc.Flags = (heap.category == rt_category) ? D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES
+                                                             : D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+        }
+
+        ComPtr<ID3D12Heap> transient_heap;
+        check_hr(m_gpu.device->CreateHeap(&heap_desc, IID_PPV_ARGS(&transient_heap)));
+        track_gpu_memory(transient_heap.Get(), gpu_memory_transient, "transient_heap");
+        NAME_D3D12_OBJECT_INDEXED(transient_heap, (UINT)m_transient_heaps.size());
+        m_transient_heaps.push_back(transient_heap);
+    }
+
+    m_transient_report = aliasing_report(m_transient_requests, m_transient_plan);
+    OutputDebugStringA(m_transient_report.c_str());
+}
+
 void particles_graphics::create_render_targets()
 {
     for (int i = 0; i < gpu_interface::NUM_BACK_BUFFERS; i++)
     {
-        m_render_targets[i] = m_gpu.create_render_target(i, hdr_buffer_format);
+        transient_resource resource = (transient_resource)(transient_hdr0 + i);
+        m_render_targets[i] = m_gpu.create_render_target(i, hdr_buffer_format, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+                                                         transient_heap(resource), transient_offset(resource));
         NAME_D3D12_OBJECT_INDEXED(m_render_targets[i].rt_default_resource, i);
     }
 }
@@ -1857,7 +2577,8 @@ void particles_graphics::create_bounds(ComPtr<ID3D12GraphicsCommandList> cmd_lis
 
     // Create the bounds indices resource.
     m_gpu.default_resource_from_uploader(cmd_list, bounds_indices_resource.GetAddressOf(),
-                                         bounds_indices, bounds_indices_size, bounds_indices_size);
+                                         bounds_indices, bounds_indices_size, bounds_indices_size,
+                                         D3D12_RESOURCE_FLAG_NONE, gpu_memory_meshes, "bounds_indices_resource");
     NAME_D3D12_OBJECT(bounds_indices_resource);
     bb_ibv.BufferLocation = bounds_indices_resource->GetGPUVirtualAddress();
     bb_ibv.Format = DXGI_FORMAT_R16_UINT;
@@ -1873,6 +2594,7 @@ void particles_graphics::create_bounds(ComPtr<ID3D12GraphicsCommandList> cmd_lis
                                                    D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
                                                    nullptr,
                                                    IID_PPV_ARGS(bounds_vertices_resource.GetAddressOf())));
+    track_gpu_memory(m_gpu.device.Get(), bounds_vertices_resource.Get(), gpu_memory_meshes, "bounds_vertices_resource");
     NAME_D3D12_OBJECT(bounds_vertices_resource);
 
     // Bounds vertices SRV description.
@@ -1896,7 +2618,7 @@ void particles_graphics::create_bounds(ComPtr<ID3D12GraphicsCommandList> cmd_lis
     uav_bounds_vertices_desc.Buffer.NumElements = num_particle_systems;
 
     // Create the bounds SRVs and UAVs for each frame.
-    for (size_t i = 0; i < m_gpu.NUM_BACK_BUFFERS; i++)
+    for (size_t i = 0; i < m_gpu.MAX_FRAMES_IN_FLIGHT; i++)
     {
 
         auto csu_table_alloc = m_gpu.frames[i].csu_table_allocator;
@@ -1917,13 +2639,19 @@ void particles_graphics::create_bounds(ComPtr<ID3D12GraphicsCommandList> cmd_lis
 
 void particles_graphics::create_gbuffers()
 {
-    m_gbuffer0 = m_gpu.create_gbuffer(gbuffer0_format);
+    m_gbuffer0 = m_gpu.create_gbuffer(gbuffer0_format, D3D12_RESOURCE_STATE_COMMON,
+                                      transient_heap(transient_gbuffer0), transient_offset(transient_gbuffer0),
+                                      "m_gbuffer0");
     NAME_D3D12_OBJECT(m_gbuffer0.rt_default_resource);
 
-    m_gbuffer1 = m_gpu.create_gbuffer(gbuffer1_format);
+    m_gbuffer1 = m_gpu.create_gbuffer(gbuffer1_format, D3D12_RESOURCE_STATE_COMMON,
+                                      transient_heap(transient_gbuffer1), transient_offset(transient_gbuffer1),
+                                      "m_gbuffer1");
     NAME_D3D12_OBJECT(m_gbuffer1.rt_default_resource);
 
-    m_gbuffer2 = m_gpu.create_gbuffer(gbuffer2_format);
+    m_gbuffer2 = m_gpu.create_gbuffer(gbuffer2_format, D3D12_RESOURCE_STATE_COMMON,
+                                      transient_heap(transient_gbuffer2), transient_offset(transient_gbuffer2),
+                                      "m_gbuffer2");
     NAME_D3D12_OBJECT(m_gbuffer2.rt_default_resource);
 }
 
@@ -1954,6 +2682,7 @@ void particles_graphics::create_depth_target()
                                                    D3D12_RESOURCE_STATE_COMMON,
                                                    &clear_value,
                                                    IID_PPV_ARGS(depthtarget_default.GetAddressOf())));
+    track_gpu_memory(m_gpu.device.Get(), depthtarget_default.Get(), gpu_memory_render_targets, "depthtarget_default");
     NAME_D3D12_OBJECT(depthtarget_default);
 
     // Create depth target DSV.
@@ -2019,6 +2748,7 @@ void particles_graphics::create_spotlight_shadowmaps()
                                                    &shadow_tex_desc,
                                                    D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, &clear_value,
                                                    IID_PPV_ARGS(m_spotlight_shadowmaps.default_resource.GetAddressOf())));
+    track_gpu_memory(m_gpu.device.Get(), m_spotlight_shadowmaps.default_resource.Get(), gpu_memory_shadow_maps, "m_spotlight_shadowmaps");
     NAME_D3D12_OBJECT(m_spotlight_shadowmaps.default_resource);
 
     // Create a view to the entire array of shadow maps.
@@ -2103,6 +2833,7 @@ void particles_graphics::create_pointlight_shadowmaps()
                                                    &shadow_tex_desc,
                                                    D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, &clear_value,
                                                    IID_PPV_ARGS(m_pointlight_shadowmaps.default_resource.GetAddressOf())));
+    track_gpu_memory(m_gpu.device.Get(), m_pointlight_shadowmaps.default_resource.Get(), gpu_memory_shadow_maps, "m_pointlight_shadowmaps");
     NAME_D3D12_OBJECT(m_pointlight_shadowmaps.default_resource);
 
     // Create a DSV that contains all of the shadow maps.
@@ -2133,318 +2864,227 @@ void particles_graphics::create_pointlight_shadowmaps()
                                            m_pointlight_shadowmaps.srv_handle);
 }
 
-void particles_graphics::shadowmap_worker(int thread_index, spot_light *spotlights, int num_spotlights)
+void particles_graphics::shadowmap_worker(command_recorder *recorder, int thread_index, spot_light *spotlights, int num_spotlights)
 {
     assert(thread_index >= 0);
     assert(thread_index < G_NUM_SHADOW_THREADS);
 
-    while (thread_index >= 0 && thread_index < G_NUM_SHADOW_THREADS)
-    {
-        // Wait for main thread to tell us to begin.
-        WaitForSingleObject(begin_shadowpass_events[thread_index], INFINITE);
+    recorder->timer_start(PROFILE_EVENT("Shadow pass"));
+    recorder->set_root_signature(to_handle(m_graphics_rootsig.Get()), false);
+    recorder->set_primitive_topology(topology_triangle_list);
 
-        ComPtr<ID3D12CommandAllocator> shadow_cmdalloc = shadow_cmdallocs[m_gpu.frame_index][thread_index];
-        ComPtr<ID3D12GraphicsCommandList> shadow_cmdlist = shadow_cmdlists[m_gpu.frame_index][thread_index];
+    // Set a square scissor rect and viewport.
+    recorder->set_viewport((float)shadowmap_width, (float)shadowmap_height);
 
-        m_gpu.timer_start(shadow_cmdlist, "Shadow pass");
-        m_gpu.set_staging_heaps(shadow_cmdlist);
-        shadow_cmdlist->SetGraphicsRootSignature(m_graphics_rootsig.Get());
-        shadow_cmdlist->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    // Draw to the shadow maps for each light.
+    for (size_t i = 0; i < num_spotlights; i++)
+    {
+        spot_light *light = &spotlights[i];
 
-        // Set a square scissor rect and viewport.
-        D3D12_RECT shadow_rect;
-        shadow_rect.left = 0;
-        shadow_rect.top = 0;
-        shadow_rect.right = (LONG)shadowmap_width;
-        shadow_rect.bottom = (LONG)shadowmap_height;
+        // Set the next shadow map for depth writes.
+        recorder->set_render_targets(0, nullptr, m_spotlight_shadowmaps.array_dsv_handles[light->id].ptr);
 
-        D3D12_VIEWPORT shadow_vp;
-        shadow_vp.TopLeftY = 0;
-        shadow_vp.TopLeftX = 0;
-        shadow_vp.Width = (float)shadowmap_width;
-        shadow_vp.Height = (float)shadowmap_height;
-        shadow_vp.MaxDepth = 1.0f;
-        shadow_vp.MinDepth = 0.0f;
+        // Calculate the current spotlight's view-projection matrix.
+        XMVECTOR light_up = XMVectorSet(0.f, 0.f, 1.f, 0.f); // All spotlights will just face downwards for now.
+        XMVECTOR light_pos = XMVectorSet(light->position_ws.x, light->position_ws.y, light->position_ws.z, 1.f);
+        XMVECTOR light_focus_pos = XMVectorAdd(light_pos, XMLoadFloat3(&light->direction));
 
-        shadow_cmdlist->RSSetViewports(1, &shadow_vp);
-        shadow_cmdlist->RSSetScissorRects(1, &shadow_rect);
+        XMMATRIX light_view = XMMatrixLookAtLH(light_pos, light_focus_pos, light_up);
+        XMMATRIX light_proj = XMMatrixPerspectiveFovLH(DirectX::XM_PI * 0.5f, 1.f, light->falloff_start, light->falloff_end);
+        XMMATRIX light_viewproj = light_view * light_proj;
 
-        shadow_cmdlist->SetGraphicsRootConstantBufferView(10, m_shadowmap_cb_vs.default_resource->GetGPUVirtualAddress());
+        XMStoreFloat4x4(&light->view_proj, XMMatrixTranspose(light_viewproj));
 
-        // Draw to the shadow maps for each light.
-        for (size_t i = 0; i < num_spotlights; i++)
+        // Draw shadow casters.
+        for (auto &ro_pair : m_render_objects)
         {
-            spot_light *light = &spotlights[i];
-
-            // Set the next shadow map for depth writes.
-            shadow_cmdlist->OMSetRenderTargets(0, nullptr, false, &m_spotlight_shadowmaps.array_dsv_handles[light->id]);
-
-            // Calculate the current spotlight's view-projection matrix.
-            XMVECTOR light_up = XMVectorSet(0.f, 0.f, 1.f, 0.f); // All spotlights will just face downwards for now.
-            XMVECTOR light_pos = XMVectorSet(light->position_ws.x, light->position_ws.y, light->position_ws.z, 1.f);
-            XMVECTOR light_focus_pos = XMVectorAdd(light_pos, XMLoadFloat3(&light->direction));
-
-            XMMATRIX light_view = XMMatrixLookAtLH(light_pos, light_focus_pos, light_up);
-            XMMATRIX light_proj = XMMatrixPerspectiveFovLH(DirectX::XM_PI * 0.5f, 1.f, light->falloff_start, light->falloff_end);
-            XMMATRIX light_viewproj = light_view * light_proj;
-
-            XMStoreFloat4x4(&light->view_proj, XMMatrixTranspose(light_viewproj));
-
-            // Draw shadow casters.
-            for (auto &ro_pair : m_render_objects)
-            {
-                draw_render_objects(shadow_cmdlist, &m_shadowmap_cb_vs, nullptr, &ro_pair.second, 1, light_viewproj, false);
-            }
+            draw_render_objects(recorder, 10, &ro_pair.second, 1, light_viewproj);
         }
-
-        // Update light data.
-        mtx.lock();
-        m_spotlights_sb.update(spotlights, num_spotlights, thread_index, shadow_cmdlist);
-        mtx.unlock();
-
-        // Execute shadow pass.
-        m_gpu.timer_stop(shadow_cmdlist, "Shadow pass");
-        check_hr(shadow_cmdlist->Close());
-        m_gpu.graphics_cmd_queue->ExecuteCommandLists(1, (ID3D12CommandList *const *)shadow_cmdlist.GetAddressOf());
-        SetEvent(end_shadowpass_events[thread_index]);
     }
-}
 
-DWORD __stdcall shadow_worker_thunk(void *param)
-{
-    particles_graphics::shadow_thunk_parameter *params = reinterpret_cast<particles_graphics::shadow_thunk_parameter *>(param);
-    params->graphics->shadowmap_worker(params->thread_index, params->spotlights, params->num_spotlights);
-    return 0;
+    // Update light data.
+    m_spotlights_sb.update(spotlights, num_spotlights, thread_index, recorder);
+
+    // The shadow lists are executed with the main list.
+    recorder->timer_stop(PROFILE_EVENT("Shadow pass"));
+    recorder->end();
 }
 
-void particles_graphics::create_shadowmap_thread_contexts()
+void particles_graphics::create_shadowmap_job_contexts()
 {
-    for (int thread_index = 0; thread_index < G_NUM_SHADOW_THREADS; thread_index++)
+    // Each shadow job records the shadow maps of a group of spotlights on its own command list.
+    for (int job_index = 0; job_index < G_NUM_SHADOW_THREADS; job_index++)
     {
-        per_thread_sl[thread_index] = &spotlights[thread_index * G_NUM_LIGHTS_PER_THREAD];
-
-        // Create events.
-        begin_shadowpass_events[thread_index] = CreateEvent(nullptr, false, false, nullptr);
-        end_shadowpass_events[thread_index] = CreateEvent(nullptr, false, false, nullptr);
-
-        // Create threads.
-        shadow_thunk_parameters[thread_index].graphics = this;
-        shadow_thunk_parameters[thread_index].thread_index = thread_index;
-        shadow_thunk_parameters[thread_index].spotlights = per_thread_sl[thread_index];
-        shadow_thunk_parameters[thread_index].num_spotlights = G_NUM_LIGHTS_PER_THREAD;
-        shadow_thread_handles[thread_index] = CreateThread(nullptr, 0,
-                                                           shadow_worker_thunk, reinterpret_cast<void *>(&shadow_thunk_parameters[thread_index]),
-                                                           0, nullptr);
-        std::wstring thread_desc = L"shadow worker #" + std::to_wstring(thread_index);
-        check_hr(SetThreadDescription(shadow_thread_handles[thread_index], thread_desc.c_str()));
+        per_thread_sl[job_index] = &spotlights[job_index * G_NUM_LIGHTS_PER_THREAD];
     }
 }
 
-DWORD __stdcall compute_worker_thunk(void *param)
-{
-    particles_graphics::compute_thunk_parameter *params = reinterpret_cast<particles_graphics::compute_thunk_parameter *>(param);
-    params->graphics->compute_worker(params->thread_index);
-    return 0;
-}
-
-void particles_graphics::create_compute_thread_contexts()
+void particles_graphics::update_attractors(frame_state *state)
 {
-    for (int thread_index = 0; thread_index < G_NUM_COMPUTE_THREADS; thread_index++)
+    // Update attractors data.
+    for (size_t i = 0; i < num_particle_systems; i++)
     {
-        // Create events.
-        begin_compute_events[thread_index] = CreateEvent(nullptr, false, false, nullptr);
-        end_compute_events[thread_index] = CreateEvent(nullptr, false, false, nullptr);
-
-        // Create threads.
-        compute_thunk_parameters[thread_index].graphics = this;
-        compute_thunk_parameters[thread_index].thread_index = thread_index;
-        compute_thread_handles[thread_index] = CreateThread(nullptr, 0,
-                                                            compute_worker_thunk, reinterpret_cast<void *>(&compute_thunk_parameters[thread_index]),
-                                                            0, nullptr);
-        std::wstring thread_desc = L"compute worker #" + std::to_wstring(thread_index);
-        check_hr(SetThreadDescription(compute_thread_handles[thread_index], thread_desc.c_str()));
+        attractor_point_light *attractor = &state->attractors[i];
+
+        // Update the light position.
+
+        float time = (float)g_cpu_timer.get_current_time();
+        transform t;
+        t.set_translation(attractor->light.position_ws.x,
+                          attractor->light.position_ws.y + (sinf(time) * 0.0003f),
+                          attractor->light.position_ws.z);
+        attractor->world = t.m_transposed_world;
+        attractor->light.position_ws = t.m_translation;
+
+        XMVECTOR light_pos = XMLoadFloat3(&attractor->light.position_ws);
+        XMMATRIX light_proj = XMMatrixPerspectiveFovLH(XMConvertToRadians(90.f),
+                                                       1.f,
+                                                       attractor->light.falloff_start,
+                                                       attractor->light.falloff_end);
+
+        // +X
+        XMVECTOR light_up = XMVectorSet(0.f, 1.f, 0.f, 0.f);
+        XMVECTOR face_dir = XMVectorSet(1.f, 0.f, 0.f, 0.f);
+        XMVECTOR target_pos = XMVectorAdd(face_dir, light_pos);
+        XMMATRIX light_view = XMMatrixLookAtLH(light_pos, target_pos, light_up);
+        XMStoreFloat4x4(&attractor->view_proj[0], XMMatrixTranspose(light_view * light_proj));
+
+        // -X
+        face_dir = XMVectorSet(-1.f, 0.f, 0.f, 0.f);
+        target_pos = XMVectorAdd(face_dir, light_pos);
+        light_view = XMMatrixLookAtLH(light_pos, target_pos, light_up);
+        XMStoreFloat4x4(&attractor->view_proj[1], XMMatrixTranspose(light_view * light_proj));
+
+        // +Y
+        light_up = XMVectorSet(0.f, 0.f, -1.f, 0.f);
+        face_dir = XMVectorSet(0.f, 1.f, 0.f, 0.f);
+        target_pos = XMVectorAdd(face_dir, light_pos);
+        light_view = XMMatrixLookAtLH(light_pos, target_pos, light_up);
+        XMStoreFloat4x4(&attractor->view_proj[2], XMMatrixTranspose(light_view * light_proj));
+
+        // -Y
+        light_up = XMVectorSet(0.f, 0.f, 1.f, 0.f);
+        face_dir = XMVectorSet(0.f, -1.f, 0.f, 0.f);
+        target_pos = XMVectorAdd(face_dir, light_pos);
+        light_view = XMMatrixLookAtLH(light_pos, target_pos, light_up);
+        XMStoreFloat4x4(&attractor->view_proj[3], XMMatrixTranspose(light_view * light_proj));
+
+        // +Z
+        light_up = XMVectorSet(0.f, 1.f, 0.f, 0.f);
+        face_dir = XMVectorSet(0.f, 0.f, 1.f, 0.f);
+        target_pos = XMVectorAdd(face_dir, light_pos);
+        light_view = XMMatrixLookAtLH(light_pos, target_pos, light_up);
+        XMStoreFloat4x4(&attractor->view_proj[4], XMMatrixTranspose(light_view * light_proj));
+
+        // -Z
+        face_dir = XMVectorSet(0.f, 0.f, -1.f, 0.f);
+        target_pos = XMVectorAdd(face_dir, light_pos);
+        light_view = XMMatrixLookAtLH(light_pos, target_pos, light_up);
+        XMStoreFloat4x4(&attractor->view_proj[5], XMMatrixTranspose(light_view * light_proj));
+
+        // Update volume lights.
+        state->volume_lights[i].m_transform = t;
     }
 }
 
-void particles_graphics::compute_worker(int thread_index)
+void particles_graphics::compute_worker(command_recorder *recorder, int thread_index)
 {
     assert(thread_index >= 0);
     assert(thread_index < G_NUM_COMPUTE_THREADS);
 
-    while (thread_index >= 0 && thread_index < G_NUM_COMPUTE_THREADS)
-    {
-        WaitForSingleObject(begin_compute_events[thread_index], INFINITE);
-        ComPtr<ID3D12GraphicsCommandList> compute_cmdlist = compute_cmdlists[m_gpu.frame_index][thread_index];
-        m_gpu.set_staging_heaps(compute_cmdlist);
-        compute_cmdlist->SetComputeRootSignature(m_compute_rootsig.Get());
-
-        particle_simcmds_default.Swap(particle_simcmds_swap_default);
-
-        compute_cmdlist->SetComputeRootShaderResourceView(5, particle_simcmds_default->GetGPUVirtualAddress());
-        compute_cmdlist->SetComputeRootConstantBufferView(3, m_pass_cb.default_resource->GetGPUVirtualAddress());
-        compute_cmdlist->SetComputeRootDescriptorTable(2, compute_descriptors_base_gpu_handle[m_gpu.frame_index]);
+    recorder->set_root_signature(to_handle(m_compute_rootsig.Get()), true);
+    recorder->set_root_shader_resource(5, particle_simcmds_default->GetGPUVirtualAddress());
 
-        m_gpu.transition(D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+    // The graphics queue updates m_pass_cb while the compute list runs, the compute list reads its own copy.
+    pass_data pass = {};
+    fill_pass_data(&m_cameras[selected_cam], &pass);
+    recorder->set_root_constant_buffer(3, recorder->upload(&pass, sizeof(pass_data), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT));
+    recorder->set_root_table(2, compute_descriptors_base_gpu_handle[m_gpu.frame_index].ptr);
+
+    gpu_handle simcmds_counter = to_handle(particle_simcmds_counter_default[m_gpu.frame_index].Get());
+    gpu_handle drawcmds_counter = to_handle(particle_drawcmds_counter_default[m_gpu.frame_index].Get());
+    gpu_handle system_infos = to_handle(m_particle_system_info.default_resource.Get());
+    gpu_handle attractors_buffer = to_handle(m_attractors_sb.default_resource.Get());
+    gpu_handle bounds_vertices = to_handle(bounds_vertices_resource.Get());
+    gpu_handle simcmds_filtered = to_handle(particle_simcmds_filtered_default.Get());
+    gpu_handle drawcmds_filtered = to_handle(particle_drawcmds_filtered_default.Get());
+
+    recorder->transition(D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
                          D3D12_RESOURCE_STATE_COPY_DEST,
-                         {particle_simcmds_counter_default[m_gpu.frame_index],
-                          particle_drawcmds_counter_default[m_gpu.frame_index],
-                          m_particle_system_info.default_resource},
-                         compute_cmdlist);
-        m_gpu.transition(D3D12_RESOURCE_STATE_COPY_SOURCE,
+                         {simcmds_counter, drawcmds_counter, system_infos});
+    recorder->transition(D3D12_RESOURCE_STATE_COPY_SOURCE,
                          D3D12_RESOURCE_STATE_COPY_DEST,
-                         {m_attractors_sb.default_resource},
-                         compute_cmdlist);
-
-        // Reset counters.
-        compute_cmdlist->CopyBufferRegion(m_particle_lights_counter.default_resource.Get(), 0,
-                                          reset_counter_default.Get(), 0,
-                                          sizeof(UINT));
-        compute_cmdlist->CopyResource(particle_simcmds_counter_default[m_gpu.frame_index].Get(), reset_counter_default.Get());
-        compute_cmdlist->CopyResource(particle_drawcmds_counter_default[m_gpu.frame_index].Get(), reset_counter_default.Get());
-
-        // Update attractors data.
-        for (size_t i = 0; i < num_particle_systems; i++)
-        {
-            attractor_point_light *attractor = &attractors[i];
-
-            // Update the light position.
-
-            float time = (float)g_cpu_timer.get_current_time();
-            transform t;
-            t.set_translation(attractor->light.position_ws.x,
-                              attractor->light.position_ws.y + (sinf(time) * 0.0003f),
-                              attractor->light.position_ws.z);
-            attractor->world = t.m_transposed_world;
-            attractor->light.position_ws = t.m_translation;
-
-            XMVECTOR light_pos = XMLoadFloat3(&attractor->light.position_ws);
-            XMMATRIX light_proj = XMMatrixPerspectiveFovLH(XMConvertToRadians(90.f),
-                                                           1.f,
-                                                           attractor->light.falloff_start,
-                                                           attractor->light.falloff_end);
-
-            // +X
-            XMVECTOR light_up = XMVectorSet(0.f, 1.f, 0.f, 0.f);
-            XMVECTOR face_dir = XMVectorSet(1.f, 0.f, 0.f, 0.f);
-            XMVECTOR target_pos = XMVectorAdd(face_dir, light_pos);
-            XMMATRIX light_view = XMMatrixLookAtLH(light_pos, target_pos, light_up);
-            XMStoreFloat4x4(&attractor->view_proj[0], XMMatrixTranspose(light_view * light_proj));
-
-            // -X
-            face_dir = XMVectorSet(-1.f, 0.f, 0.f, 0.f);
-            target_pos = XMVectorAdd(face_dir, light_pos);
-            light_view = XMMatrixLookAtLH(light_pos, target_pos, light_up);
-            XMStoreFloat4x4(&attractor->view_proj[1], XMMatrixTranspose(light_view * light_proj));
-
-            // +Y
-            light_up = XMVectorSet(0.f, 0.f, -1.f, 0.f);
-            face_dir = XMVectorSet(0.f, 1.f, 0.f, 0.f);
-            target_pos = XMVectorAdd(face_dir, light_pos);
-            light_view = XMMatrixLookAtLH(light_pos, target_pos, light_up);
-            XMStoreFloat4x4(&attractor->view_proj[2], XMMatrixTranspose(light_view * light_proj));
-
-            // -Y
-            light_up = XMVectorSet(0.f, 0.f, 1.f, 0.f);
-            face_dir = XMVectorSet(0.f, -1.f, 0.f, 0.f);
-            target_pos = XMVectorAdd(face_dir, light_pos);
-            light_view = XMMatrixLookAtLH(light_pos, target_pos, light_up);
-            XMStoreFloat4x4(&attractor->view_proj[3], XMMatrixTranspose(light_view * light_proj));
-
-            // +Z
-            light_up = XMVectorSet(0.f, 1.f, 0.f, 0.f);
-            face_dir = XMVectorSet(0.f, 0.f, 1.f, 0.f);
-            target_pos = XMVectorAdd(face_dir, light_pos);
-            light_view = XMMatrixLookAtLH(light_pos, target_pos, light_up);
-            XMStoreFloat4x4(&attractor->view_proj[4], XMMatrixTranspose(light_view * light_proj));
-
-            // -Z
-            face_dir = XMVectorSet(0.f, 0.f, -1.f, 0.f);
-            target_pos = XMVectorAdd(face_dir, light_pos);
-            light_view = XMMatrixLookAtLH(light_pos, target_pos, light_up);
-            XMStoreFloat4x4(&attractor->view_proj[5], XMMatrixTranspose(light_view * light_proj));
-
-            // Update volume lights.
-            volume_light *vl = &volume_lights[i];
-            vl->m_transform = t;
-        }
-        m_attractors_sb.update(attractors, compute_cmdlist);
+                         {attractors_buffer});
 
-        // Update particle systems data.
-        m_particle_system_info.update(particle_systems_infos, compute_cmdlist);
+    // Reset counters, they are all one UINT like the reset counter.
+    gpu_handle reset_counter = to_handle(reset_counter_default.Get());
+    recorder->copy_buffer(to_handle(m_particle_lights_counter.default_resource.Get()), 0, reset_counter, 0, sizeof(UINT));
+    recorder->copy_buffer(simcmds_counter, 0, reset_counter, 0, sizeof(UINT));
+    recorder->copy_buffer(drawcmds_counter, 0, reset_counter, 0, sizeof(UINT));
 
-        m_gpu.transition(D3D12_RESOURCE_STATE_COPY_DEST,
+    // Upload attractors and particle systems data.
+    m_attractors_sb.update(attractors, recorder);
+    m_particle_system_info.update(particle_systems_infos, recorder);
+
+    recorder->transition(D3D12_RESOURCE_STATE_COPY_DEST,
                          D3D12_RESOURCE_STATE_COPY_SOURCE,
-                         {m_attractors_sb.default_resource},
-                         compute_cmdlist);
+                         {attractors_buffer});
 
-        // Update attractor world matrix.
-        for (size_t i = 0; i < num_particle_systems; i++)
-        {
-            // Assign the world transform of each attractor to the world transform of each particle system.
-            size_t ps_offset = (i * sizeof(particle_system_info));
-            size_t dst_offset = ps_offset + offsetof(particle_system_info, world);
-            size_t pl_offset = (i * sizeof(attractor_point_light));
-            size_t src_offset = pl_offset + offsetof(attractor_point_light, world);
-            compute_cmdlist->CopyBufferRegion(m_particle_system_info.default_resource.Get(), dst_offset,
-                                              m_attractors_sb.default_resource.Get(), src_offset,
-                                              sizeof(particle_system_info::world));
-        }
+    // Update attractor world matrix.
+    for (size_t i = 0; i < num_particle_systems; i++)
+    {
+        // Assign the world transform of each attractor to the world transform of each particle system.
+        size_t ps_offset = (i * sizeof(particle_system_info));
+        size_t dst_offset = ps_offset + offsetof(particle_system_info, world);
+        size_t pl_offset = (i * sizeof(attractor_point_light));
+        size_t src_offset = pl_offset + offsetof(attractor_point_light, world);
+        recorder->copy_buffer(system_infos, dst_offset,
+                              attractors_buffer, src_offset,
+                              sizeof(particle_system_info::world));
+    }
 
-        m_gpu.transition(D3D12_RESOURCE_STATE_COPY_DEST,
+    recorder->transition(D3D12_RESOURCE_STATE_COPY_DEST,
                          D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
-                         {particle_simcmds_counter_default[m_gpu.frame_index],
-                          particle_drawcmds_counter_default[m_gpu.frame_index],
-                          m_particle_system_info.default_resource},
-                         compute_cmdlist);
-        m_gpu.transition(D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
+                         {simcmds_counter, drawcmds_counter, system_infos});
+    recorder->transition(D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
                          D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
-                         {bounds_vertices_resource},
-                         compute_cmdlist);
-        m_gpu.transition(D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+                         {bounds_vertices});
+    recorder->transition(D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
                          D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-                         {particle_simcmds_filtered_default,
-                          particle_drawcmds_filtered_default},
-                         compute_cmdlist);
+                         {simcmds_filtered, drawcmds_filtered});
 
-        // Frustum culling of commands.
-        m_gpu.timer_start(compute_cmdlist, "Frustum culling of commands");
-        compute_cmdlist->SetPipelineState(m_PSOs[commands_culling_PSO]);
-        compute_cmdlist->Dispatch(1, 1, 1);
-        m_gpu.timer_stop(compute_cmdlist, "Frustum culling of commands");
+    // Frustum culling of commands.
+    recorder->timer_start(PROFILE_EVENT("Frustum culling of commands"));
+    recorder->set_pipeline(to_handle(m_PSOs[commands_culling_PSO]));
+    recorder->dispatch(1, 1, 1);
+    recorder->timer_stop(PROFILE_EVENT("Frustum culling of commands"));
 
-        m_gpu.transition(D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+    recorder->transition(D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
                          D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
-                         {bounds_vertices_resource},
-                         compute_cmdlist);
-        m_gpu.transition(D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+                         {bounds_vertices});
+    recorder->transition(D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
                          D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
-                         {particle_simcmds_filtered_default,
-                          particle_drawcmds_filtered_default},
-                         compute_cmdlist);
-
-        // Particle simulation.
-        m_gpu.timer_start(compute_cmdlist, "Particle simulation");
-        compute_cmdlist->SetPipelineState(m_PSOs[particle_sim_PSO]);
-        compute_cmdlist->ExecuteIndirect(particle_sim_cmdsig.Get(), num_particle_systems,
-                                         particle_simcmds_filtered_default.Get(), 0,
-                                         particle_simcmds_counter_default[m_gpu.frame_index].Get(), 0);
-        m_gpu.timer_stop(compute_cmdlist, "Particle simulation");
-
-        m_gpu.transition(D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-                         D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
-                         {particle_output_default},
-                         compute_cmdlist);
+                         {simcmds_filtered, drawcmds_filtered});
 
-        // Update particle bounds.
-        m_gpu.timer_start(compute_cmdlist, "Update particle bounds");
-        compute_cmdlist->SetPipelineState(m_PSOs[calculate_bounds_PSO]);
-        compute_cmdlist->ExecuteIndirect(bounds_calc_cmdsig.Get(), num_particle_systems,
-                                         bounds_calc_cmds_default.Get(), 0,
-                                         nullptr, 0);
-        m_gpu.timer_stop(compute_cmdlist, "Update particle bounds");
+    // Particle simulation.
+    recorder->timer_start(PROFILE_EVENT("Particle simulation"));
+    recorder->set_pipeline(to_handle(m_PSOs[particle_sim_PSO]));
+    recorder->execute_indirect(to_handle(particle_sim_cmdsig.Get()), num_particle_systems,
+                               simcmds_filtered, 0,
+                               simcmds_counter, 0);
+    recorder->timer_stop(PROFILE_EVENT("Particle simulation"));
 
-        SetEvent(end_compute_events[thread_index]);
-    }
+    recorder->transition(D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+                         D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+                         {to_handle(particle_output_default.Get())});
+
+    // Update particle bounds.
+    recorder->timer_start(PROFILE_EVENT("Update particle bounds"));
+    recorder->set_pipeline(to_handle(m_PSOs[calculate_bounds_PSO]));
+    recorder->execute_indirect(to_handle(bounds_calc_cmdsig.Get()), num_particle_systems,
+                               to_handle(bounds_calc_cmds_default.Get()), 0,
+                               0, 0);
+    recorder->timer_stop(PROFILE_EVENT("Update particle bounds"));
 }
 
 void particles_graphics::create_bounds_calculations_commands(ComPtr<ID3D12GraphicsCommandList> cmd_list)
@@ -2487,7 +3127,8 @@ void particles_graphics::create_bounds_calculations_commands(ComPtr<ID3D12Graphi
     m_gpu.default_resource_from_uploader(cmd_list, bounds_calc_cmds_default.GetAddressOf(),
                                          calc_bounds_cmds, num_particle_systems * sizeof(calc_bounds_command),
                                          sizeof(calc_bounds_command),
-                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+                                         gpu_memory_buffers, "bounds_calc_cmds_default");
     NAME_D3D12_OBJECT(bounds_calc_cmds_default);
 }
 
@@ -2554,10 +3195,70 @@ void particles_graphics::create_bounds_draw_commands(ComPtr<ID3D12GraphicsComman
     m_gpu.default_resource_from_uploader(cmd_list, bounds_drawcmds_default.GetAddressOf(),
                                          draw_bounds_cmds, num_draw_bounds_cmds,
                                          draw_bounds_cmd_size,
-                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+                                         D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+                                         gpu_memory_buffers, "bounds_drawcmds_default");
     NAME_D3D12_OBJECT(bounds_drawcmds_default);
 }
 
+// Source of each shader, indexed by the shaders enum.
+struct shader_source
+{
+    const wchar_t *file;
+    shader_stages stage;
+};
+static const shader_source shader_sources[shaders_MAX] = {
+    {L"pbr_simple.hlsl", VS},
+    {L"pbr_simple.hlsl", PS},
+    {L"lighting_pass.hlsl", VS},
+    {L"lighting_pass.hlsl", PS},
+    {L"shadow_pass.hlsl", VS},
+    {L"pointlight_shadow.hlsl", VS},
+    {L"pointlight_shadow.hlsl", GS},
+    {L"pointlight_shadow.hlsl", PS},
+    {L"solid_color.hlsl", VS},
+    {L"solid_color.hlsl", PS},
+    {L"debug_line.hlsl", VS},
+    {L"debug_line.hlsl", PS},
+    {L"particle_sim.hlsl", CS},
+    {L"update_particles_bounds.hlsl", CS},
+    {L"particle_point.hlsl", VS},
+    {L"particle_point.hlsl", PS},
+    {L"bounds_draw.hlsl", VS},
+    {L"bounds_draw.hlsl", PS},
+    {L"reinhard_tonemapping.hlsl", VS},
+    {L"reinhard_tonemapping.hlsl", PS},
+    {L"filter_commands.hlsl", CS},
+    {L"billboards.hlsl", VS},
+    {L"billboards.hlsl", GS},
+    {L"billboards.hlsl", PS},
+    {L"volume_light.hlsl", VS},
+    {L"volume_light.hlsl", PS},
+    {L"equirect_to_cube.hlsl", CS},
+    {L"draw_sky.hlsl", VS},
+    {L"draw_sky.hlsl", PS},
+    {L"diffuse_irradiance_map.hlsl", CS},
+    {L"specular_irradiance_map.hlsl", CS},
+    {L"generate_cube_mip_linear.hlsl", CS},
+    {L"specular_brdf_lut.hlsl", CS},
+};
+
+void particles_graphics::compile_shaders()
+{
+    D3D_SHADER_MACRO vs_macros[2] = {"VERTEX_SHADER", "1"};
+    D3D_SHADER_MACRO gs_macros[2] = {"GEOMETRY_SHADER", "0"};
+    D3D_SHADER_MACRO ps_macros[2] = {"PIXEL_SHADER", "1"};
+    D3D_SHADER_MACRO cs_macros[2] = {"COMPUTE", "1"};
+    D3D_SHADER_MACRO *macros[SHADERSTAGE_MAX] = {vs_macros, nullptr, nullptr, gs_macros, ps_macros, cs_macros};
+    const wchar_t *entries[SHADERSTAGE_MAX] = {L"vs_main", L"hs_main", L"ds_main", L"gs_main", L"ps_main", L"cs_main"};
+
+    for (int i = 0; i < shaders_MAX; i++)
+    {
+        const shader_source &source = shader_sources[i];
+        std::wstring file = std::wstring(L"..\\particles\\shaders\\") + source.file;
+        m_gpu.compile_shader(file.c_str(), entries[source.stage], source.stage, &m_shaders[i], macros[source.stage], &m_shader_reflections[i]);
+    }
+}
+
 void particles_graphics::create_PSOs()
 {
     // Alpha transparency blending (blend)
@@ -2608,10 +3309,6 @@ void particles_graphics::create_PSOs()
     ID3D10Blob *shader_blob_ps = nullptr;
     ID3D10Blob *shader_blob_cs = nullptr;
 
-    D3D_SHADER_MACRO gs_macros[2] = {"GEOMETRY_SHADER", "0"};
-    D3D_SHADER_MACRO vs_macros[2] = {"VERTEX_SHADER", "1"};
-    D3D_SHADER_MACRO ps_macros[2] = {"PIXEL_SHADER", "1"};
-
     // Input layouts.
     D3D12_INPUT_ELEMENT_DESC particle_input_layout[4] = {
         {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
@@ -2631,8 +3328,8 @@ void particles_graphics::create_PSOs()
         {"COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}};
 
     // Simple pbr PSO.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\pbr_simple.hlsl", L"vs_main", VS, &shader_blob_vs, vs_macros);
-    m_gpu.compile_shader(L"..\\particles\\shaders\\pbr_simple.hlsl", L"ps_main", PS, &shader_blob_ps, ps_macros);
+    shader_blob_vs = m_shaders[pbr_simple_VS];
+    shader_blob_ps = m_shaders[pbr_simple_PS];
     simplepbr_pso_desc.VS = {shader_blob_vs->GetBufferPointer(), shader_blob_vs->GetBufferSize()};
     simplepbr_pso_desc.PS = {shader_blob_ps->GetBufferPointer(), shader_blob_ps->GetBufferSize()};
     simplepbr_pso_desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
@@ -2643,18 +3340,19 @@ void particles_graphics::create_PSOs()
     simplepbr_pso_desc.RTVFormats[2] = gbuffer2_format;
     simplepbr_pso_desc.DSVFormat = depthstencil_format;
     simplepbr_pso_desc.InputLayout = {standard_inputlayout, _countof(standard_inputlayout)};
-    simplepbr_pso_desc.pRootSignature = m_graphics_rootsig.Get();
+    simplepbr_pso_desc.pRootSignature = m_geometry_rootsig.Get();
     ID3D12PipelineState *pbr_simple_pso = nullptr;
     check_hr(m_gpu.device->CreateGraphicsPipelineState(&simplepbr_pso_desc, IID_PPV_ARGS(&pbr_simple_pso)));
     NAME_D3D12_OBJECT(pbr_simple_pso);
     m_PSOs[pbr_simple_PSO] = pbr_simple_pso;
 
     // Lighting pass PSO.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\lighting_pass.hlsl", L"vs_main", VS, &shader_blob_vs, vs_macros);
-    m_gpu.compile_shader(L"..\\particles\\shaders\\lighting_pass.hlsl", L"ps_main", PS, &shader_blob_ps, ps_macros);
+    shader_blob_vs = m_shaders[lighting_pass_VS];
+    shader_blob_ps = m_shaders[lighting_pass_PS];
     D3D12_GRAPHICS_PIPELINE_STATE_DESC lighting_pass_pso_desc = simplepbr_pso_desc;
     lighting_pass_pso_desc.VS = {shader_blob_vs->GetBufferPointer(), shader_blob_vs->GetBufferSize()};
     lighting_pass_pso_desc.PS = {shader_blob_ps->GetBufferPointer(), shader_blob_ps->GetBufferSize()};
+    lighting_pass_pso_desc.pRootSignature = m_graphics_rootsig.Get();
     lighting_pass_pso_desc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
     lighting_pass_pso_desc.RasterizerState.FrontCounterClockwise = true;
     lighting_pass_pso_desc.DepthStencilState.DepthEnable = false;
@@ -2670,7 +3368,7 @@ void particles_graphics::create_PSOs()
     m_PSOs[lighting_pass_PSO] = lighting_pass_pso;
 
     // Shadow pass PSO.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\shadow_pass.hlsl", L"vs_main", VS, &shader_blob_vs, vs_macros);
+    shader_blob_vs = m_shaders[shadow_pass_VS];
     D3D12_GRAPHICS_PIPELINE_STATE_DESC shadow_pass_pso_desc = default_pso_desc;
     shadow_pass_pso_desc.InputLayout = {standard_inputlayout, _countof(standard_inputlayout)};
     shadow_pass_pso_desc.pRootSignature = m_graphics_rootsig.Get();
@@ -2687,9 +3385,9 @@ void particles_graphics::create_PSOs()
     m_PSOs[shadow_pass_PSO] = shadow_pass_pso;
 
     // Cube shadow pass PSO.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\pointlight_shadow.hlsl", L"vs_main", VS, &shader_blob_vs, vs_macros);
-    m_gpu.compile_shader(L"..\\particles\\shaders\\pointlight_shadow.hlsl", L"gs_main", GS, &shader_blob_gs, gs_macros);
-    m_gpu.compile_shader(L"..\\particles\\shaders\\pointlight_shadow.hlsl", L"ps_main", PS, &shader_blob_ps, ps_macros);
+    shader_blob_vs = m_shaders[pointlight_shadow_VS];
+    shader_blob_gs = m_shaders[pointlight_shadow_GS];
+    shader_blob_ps = m_shaders[pointlight_shadow_PS];
     D3D12_GRAPHICS_PIPELINE_STATE_DESC indirect_shadow_pass_pso_desc = default_pso_desc;
     indirect_shadow_pass_pso_desc.VS = {shader_blob_vs->GetBufferPointer(), shader_blob_vs->GetBufferSize()};
     indirect_shadow_pass_pso_desc.GS = {shader_blob_gs->GetBufferPointer(), shader_blob_gs->GetBufferSize()};
@@ -2708,11 +3406,12 @@ void particles_graphics::create_PSOs()
     m_PSOs[cube_shadow_pass_PSO] = indirect_shadow_pass_pso;
 
     // Solid color PSO.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\solid_color.hlsl", L"vs_main", VS, &shader_blob_vs, vs_macros);
-    m_gpu.compile_shader(L"..\\particles\\shaders\\solid_color.hlsl", L"ps_main", PS, &shader_blob_ps, ps_macros);
+    shader_blob_vs = m_shaders[solid_color_VS];
+    shader_blob_ps = m_shaders[solid_color_PS];
     D3D12_GRAPHICS_PIPELINE_STATE_DESC solid_color_pso_desc = simplepbr_pso_desc;
     solid_color_pso_desc.VS = {shader_blob_vs->GetBufferPointer(), shader_blob_vs->GetBufferSize()};
     solid_color_pso_desc.PS = {shader_blob_ps->GetBufferPointer(), shader_blob_ps->GetBufferSize()};
+    solid_color_pso_desc.pRootSignature = m_graphics_rootsig.Get();
     solid_color_pso_desc.NumRenderTargets = 1;
     solid_color_pso_desc.RTVFormats[0] = hdr_buffer_format;
     solid_color_pso_desc.RTVFormats[1] = DXGI_FORMAT_UNKNOWN;
@@ -2723,8 +3422,8 @@ void particles_graphics::create_PSOs()
     m_PSOs[solid_color_PSO] = solid_color_pso;
 
     // Debug line PSO.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\debug_line.hlsl", L"vs_main", VS, &shader_blob_vs, vs_macros);
-    m_gpu.compile_shader(L"..\\particles\\shaders\\debug_line.hlsl", L"ps_main", PS, &shader_blob_ps, ps_macros);
+    shader_blob_vs = m_shaders[debug_line_VS];
+    shader_blob_ps = m_shaders[debug_line_PS];
     D3D12_GRAPHICS_PIPELINE_STATE_DESC debug_line_pso_desc = solid_color_pso_desc;
     debug_line_pso_desc.VS = {shader_blob_vs->GetBufferPointer(), shader_blob_vs->GetBufferSize()};
     debug_line_pso_desc.PS = {shader_blob_ps->GetBufferPointer(), shader_blob_ps->GetBufferSize()};
@@ -2747,8 +3446,7 @@ void particles_graphics::create_PSOs()
     m_PSOs[debug_plane_PSO] = debug_plane_pso;
 
     // Particle simulation PSO.
-    D3D_SHADER_MACRO cs_macros[2] = {"COMPUTE", "1"};
-    m_gpu.compile_shader(L"..\\particles\\shaders\\particle_sim.hlsl", L"cs_main", CS, &shader_blob_cs, cs_macros);
+    shader_blob_cs = m_shaders[particle_sim_CS];
     D3D12_COMPUTE_PIPELINE_STATE_DESC particle_sim_pso_desc = {};
     particle_sim_pso_desc.CS = {shader_blob_cs->GetBufferPointer(), shader_blob_cs->GetBufferSize()};
     particle_sim_pso_desc.pRootSignature = m_compute_rootsig.Get();
@@ -2760,7 +3458,7 @@ void particles_graphics::create_PSOs()
     m_PSOs[particle_sim_PSO] = particle_sim_pso;
 
     // Calculate particle/light bounds and update light matrices.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\update_particles_bounds.hlsl", L"cs_main", CS, &shader_blob_cs, cs_macros);
+    shader_blob_cs = m_shaders[update_particles_bounds_CS];
     D3D12_COMPUTE_PIPELINE_STATE_DESC calc_bounds_pso_desc = particle_sim_pso_desc;
     calc_bounds_pso_desc.CS = {shader_blob_cs->GetBufferPointer(), shader_blob_cs->GetBufferSize()};
     ID3D12PipelineState *calc_bounds_pso = nullptr;
@@ -2770,8 +3468,8 @@ void particles_graphics::create_PSOs()
 
     // Draw particles as points.
     D3D12_GRAPHICS_PIPELINE_STATE_DESC particle_point_draw_pso_desc = default_pso_desc;
-    m_gpu.compile_shader(L"..\\particles\\shaders\\particle_point.hlsl", L"vs_main", VS, &shader_blob_vs, vs_macros);
-    m_gpu.compile_shader(L"..\\particles\\shaders\\particle_point.hlsl", L"ps_main", PS, &shader_blob_ps, ps_macros);
+    shader_blob_vs = m_shaders[particle_point_VS];
+    shader_blob_ps = m_shaders[particle_point_PS];
     particle_point_draw_pso_desc.VS = {shader_blob_vs->GetBufferPointer(), shader_blob_vs->GetBufferSize()};
     particle_point_draw_pso_desc.PS = {shader_blob_ps->GetBufferPointer(), shader_blob_ps->GetBufferSize()};
     particle_point_draw_pso_desc.InputLayout = {particle_input_layout, _countof(particle_input_layout)};
@@ -2786,8 +3484,8 @@ void particles_graphics::create_PSOs()
     m_PSOs[particle_point_draw_PSO] = particle_point_draw_pso;
 
     // Draw bounding box bounds.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\bounds_draw.hlsl", L"vs_main", VS, &shader_blob_vs, vs_macros);
-    m_gpu.compile_shader(L"..\\particles\\shaders\\bounds_draw.hlsl", L"ps_main", PS, &shader_blob_ps, ps_macros);
+    shader_blob_vs = m_shaders[bounds_draw_VS];
+    shader_blob_ps = m_shaders[bounds_draw_PS];
     D3D12_GRAPHICS_PIPELINE_STATE_DESC bounds_draw_pso_desc = default_pso_desc;
     bounds_draw_pso_desc.VS = {shader_blob_vs->GetBufferPointer(), shader_blob_vs->GetBufferSize()};
     bounds_draw_pso_desc.PS = {shader_blob_ps->GetBufferPointer(), shader_blob_ps->GetBufferSize()};
@@ -2803,8 +3501,8 @@ void particles_graphics::create_PSOs()
     m_PSOs[draw_bounds_PSO] = bounds_draw_pso;
 
     // Reinhard tonemapping.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\reinhard_tonemapping.hlsl", L"vs_main", VS, &shader_blob_vs, vs_macros);
-    m_gpu.compile_shader(L"..\\particles\\shaders\\reinhard_tonemapping.hlsl", L"ps_main", PS, &shader_blob_ps, ps_macros);
+    shader_blob_vs = m_shaders[reinhard_tonemapping_VS];
+    shader_blob_ps = m_shaders[reinhard_tonemapping_PS];
     D3D12_GRAPHICS_PIPELINE_STATE_DESC tonemapping_pso_desc = default_pso_desc;
     tonemapping_pso_desc.VS = {shader_blob_vs->GetBufferPointer(), shader_blob_vs->GetBufferSize()};
     tonemapping_pso_desc.PS = {shader_blob_ps->GetBufferPointer(), shader_blob_ps->GetBufferSize()};
@@ -2821,7 +3519,7 @@ void particles_graphics::create_PSOs()
     m_PSOs[tonemapping_PSO] = tonemapping_pso;
 
     // Frustum culling of commands.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\filter_commands.hlsl", L"cs_main", CS, &shader_blob_cs, cs_macros);
+    shader_blob_cs = m_shaders[filter_commands_CS];
     D3D12_COMPUTE_PIPELINE_STATE_DESC commands_culling_pso_desc = {};
     commands_culling_pso_desc.CS = {shader_blob_cs->GetBufferPointer(), shader_blob_cs->GetBufferSize()};
     commands_culling_pso_desc.pRootSignature = m_compute_rootsig.Get();
@@ -2836,9 +3534,9 @@ void particles_graphics::create_PSOs()
     additive_blend_desc.IndependentBlendEnable = false;
     additive_blend_desc.RenderTarget[0] = additive_rtv_blend_desc;
 
-    m_gpu.compile_shader(L"..\\particles\\shaders\\billboards.hlsl", L"vs_main", VS, &shader_blob_vs, vs_macros);
-    m_gpu.compile_shader(L"..\\particles\\shaders\\billboards.hlsl", L"gs_main", GS, &shader_blob_gs, gs_macros);
-    m_gpu.compile_shader(L"..\\particles\\shaders\\billboards.hlsl", L"ps_main", PS, &shader_blob_ps, ps_macros);
+    shader_blob_vs = m_shaders[billboards_VS];
+    shader_blob_gs = m_shaders[billboards_GS];
+    shader_blob_ps = m_shaders[billboards_PS];
     D3D12_GRAPHICS_PIPELINE_STATE_DESC billboards_pso_desc = default_pso_desc;
     billboards_pso_desc.VS = {shader_blob_vs->GetBufferPointer(), shader_blob_vs->GetBufferSize()};
     billboards_pso_desc.GS = {shader_blob_gs->GetBufferPointer(), shader_blob_gs->GetBufferSize()};
@@ -2864,8 +3562,8 @@ void particles_graphics::create_PSOs()
     additive_transparency_blend_desc.IndependentBlendEnable = false;
     additive_transparency_blend_desc.RenderTarget[0] = additive_transparency_rtv_blend_desc;
 
-    m_gpu.compile_shader(L"..\\particles\\shaders\\volume_light.hlsl", L"vs_main", VS, &shader_blob_vs, vs_macros);
-    m_gpu.compile_shader(L"..\\particles\\shaders\\volume_light.hlsl", L"ps_main", PS, &shader_blob_ps, ps_macros);
+    shader_blob_vs = m_shaders[volume_light_VS];
+    shader_blob_ps = m_shaders[volume_light_PS];
     D3D12_GRAPHICS_PIPELINE_STATE_DESC volume_pl_desc = default_pso_desc;
     volume_pl_desc.VS = {shader_blob_vs->GetBufferPointer(), shader_blob_vs->GetBufferSize()};
     volume_pl_desc.PS = {shader_blob_ps->GetBufferPointer(), shader_blob_ps->GetBufferSize()};
@@ -2897,7 +3595,7 @@ void particles_graphics::create_PSOs()
     m_PSOs[volume_light_alpha_transparency_PSO] = volume_pl_pso3;
 
     // Conversion from equirectangular textures to cube maps.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\equirect_to_cube.hlsl", L"cs_main", CS, &shader_blob_cs, cs_macros);
+    shader_blob_cs = m_shaders[equirect_to_cube_CS];
     D3D12_COMPUTE_PIPELINE_STATE_DESC equirect_to_cube_desc = {};
     equirect_to_cube_desc.CS = {shader_blob_cs->GetBufferPointer(), shader_blob_cs->GetBufferSize()};
     equirect_to_cube_desc.pRootSignature = m_compute_rootsig.Get();
@@ -2909,8 +3607,8 @@ void particles_graphics::create_PSOs()
     m_PSOs[equirect_to_cube_PSO] = equirect_to_cube_pso;
 
     // Draw sky.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\draw_sky.hlsl", L"vs_main", VS, &shader_blob_vs, vs_macros);
-    m_gpu.compile_shader(L"..\\particles\\shaders\\draw_sky.hlsl", L"ps_main", PS, &shader_blob_ps, ps_macros);
+    shader_blob_vs = m_shaders[draw_sky_VS];
+    shader_blob_ps = m_shaders[draw_sky_PS];
     D3D12_GRAPHICS_PIPELINE_STATE_DESC draw_sky_desc = default_pso_desc;
     draw_sky_desc.VS = {shader_blob_vs->GetBufferPointer(), shader_blob_vs->GetBufferSize()};
     draw_sky_desc.PS = {shader_blob_ps->GetBufferPointer(), shader_blob_ps->GetBufferSize()};
@@ -2927,7 +3625,7 @@ void particles_graphics::create_PSOs()
     m_PSOs[draw_sky_PSO] = draw_sky_pso;
 
     // Precompute the diffuse irradiance map.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\diffuse_irradiance_map.hlsl", L"cs_main", CS, &shader_blob_cs, cs_macros);
+    shader_blob_cs = m_shaders[diffuse_irradiance_map_CS];
     D3D12_COMPUTE_PIPELINE_STATE_DESC diffuse_irrmap_pso_desc = {};
     diffuse_irrmap_pso_desc.CS = {shader_blob_cs->GetBufferPointer(), shader_blob_cs->GetBufferSize()};
     diffuse_irrmap_pso_desc.pRootSignature = m_compute_rootsig.Get();
@@ -2939,7 +3637,7 @@ void particles_graphics::create_PSOs()
     m_PSOs[filter_diffuse_irradiance_map_PSO] = diffuse_irrmap_pso;
 
     // Precompute the specular irradiance map.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\specular_irradiance_map.hlsl", L"cs_main", CS, &shader_blob_cs, cs_macros);
+    shader_blob_cs = m_shaders[specular_irradiance_map_CS];
     D3D12_COMPUTE_PIPELINE_STATE_DESC specular_irrmap_pso_desc = {};
     specular_irrmap_pso_desc.CS = {shader_blob_cs->GetBufferPointer(), shader_blob_cs->GetBufferSize()};
     specular_irrmap_pso_desc.pRootSignature = m_compute_rootsig.Get();
@@ -2951,7 +3649,7 @@ void particles_graphics::create_PSOs()
     m_PSOs[filter_specular_irradiance_map_PSO] = specular_irrmap_pso;
 
     // Generate mipmap.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\generate_cube_mip_linear.hlsl", L"cs_main", CS, &shader_blob_cs, cs_macros);
+    shader_blob_cs = m_shaders[generate_cube_mip_linear_CS];
     D3D12_COMPUTE_PIPELINE_STATE_DESC generate_mipmap_pso_desc = {};
     generate_mipmap_pso_desc.CS = {shader_blob_cs->GetBufferPointer(), shader_blob_cs->GetBufferSize()};
     generate_mipmap_pso_desc.pRootSignature = m_compute_rootsig.Get();
@@ -2963,7 +3661,7 @@ void particles_graphics::create_PSOs()
     m_PSOs[generate_mipmap_PSO] = generate_mipmap_pso;
 
     // Pre-compute the specular BRDF lut.
-    m_gpu.compile_shader(L"..\\particles\\shaders\\specular_brdf_lut.hlsl", L"cs_main", CS, &shader_blob_cs, cs_macros);
+    shader_blob_cs = m_shaders[specular_brdf_lut_CS];
     D3D12_COMPUTE_PIPELINE_STATE_DESC specular_brdf_lut_pso_desc = {};
     specular_brdf_lut_pso_desc.CS = {shader_blob_cs->GetBufferPointer(), shader_blob_cs->GetBufferSize()};
     specular_brdf_lut_pso_desc.pRootSignature = m_compute_rootsig.Get();
@@ -3124,19 +3822,11 @@ void particles_graphics::create_buffers(ComPtr<ID3D12GraphicsCommandList> cmd_li
     m_object_cb_vs = m_gpu.create_constant_buffer<object_data_vs>(&obj_data_vs);
     NAME_D3D12_OBJECT(m_object_cb_vs.default_resource);
 
-    m_shadowmap_cb_vs = m_gpu.create_constant_buffer<object_data_vs>(&obj_data_vs);
-    NAME_D3D12_OBJECT(m_shadowmap_cb_vs.default_resource);
-
     // Per render object pixel shader data.
     render_object_data_ps ro_data_ps = {};
     m_render_object_cb_ps = m_gpu.create_constant_buffer<render_object_data_ps>(&ro_data_ps);
     NAME_D3D12_OBJECT(m_render_object_cb_ps.default_resource);
 
-    // Per volume light pixel shader data.
-    volume_light_data_ps vl_data_ps = {};
-    m_volume_light_cb_ps = m_gpu.create_constant_buffer<volume_light_data_ps>(&vl_data_ps);
-    NAME_D3D12_OBJECT(m_volume_light_cb_ps.default_resource);
-
     UINT particle_lights_count = 0;
     m_particle_lights_counter = m_gpu.create_constant_buffer<UINT>(&particle_lights_count, 1, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
     NAME_D3D12_OBJECT(m_particle_lights_counter.default_resource);
@@ -3161,7 +3851,7 @@ void particles_graphics::create_buffers(ComPtr<ID3D12GraphicsCommandList> cmd_li
     srv_desc.Buffer.StructureByteStride = sizeof(point_light);
 
     D3D12_CPU_DESCRIPTOR_HANDLE pointlights_handle;
-    for (UINT i = 0; i < m_gpu.NUM_BACK_BUFFERS; i++)
+    for (UINT i = 0; i < m_gpu.MAX_FRAMES_IN_FLIGHT; i++)
     {
         auto csu_table_alloc = m_gpu.frames[i].csu_table_allocator;
         ComPtr<ID3D12DescriptorHeap> csu_heap_gpu = csu_table_alloc.m_heap_gpu;
@@ -3254,6 +3944,7 @@ void particles_graphics::create_buffers(ComPtr<ID3D12GraphicsCommandList> cmd_li
                                                    D3D12_RESOURCE_STATE_COPY_SOURCE,
                                                    nullptr,
                                                    IID_PPV_ARGS(&reset_counter_default)));
+    track_gpu_memory(m_gpu.device.Get(), reset_counter_default.Get(), gpu_memory_buffers, "reset_counter_default");
     NAME_D3D12_OBJECT(reset_counter_default);
 
     // Create the resource that holds the shadow casters transforms data.
@@ -3273,11 +3964,12 @@ void particles_graphics::create_buffers(ComPtr<ID3D12GraphicsCommandList> cmd_li
 
     shadow_transforms_cbv_size = num_shadow_casters * align_up(sizeof(object_data_vs), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
     m_gpu.default_resource_from_uploader(cmd_list, m_shadowcasters_transforms.GetAddressOf(),
-                                         shadow_casters_transforms, shadow_transforms_cbv_size, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+                                         shadow_casters_transforms, shadow_transforms_cbv_size, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT,
+                                         D3D12_RESOURCE_FLAG_NONE, gpu_memory_buffers, "m_shadowcasters_transforms");
     NAME_D3D12_OBJECT(m_shadowcasters_transforms);
 
     // Create the CBVs of the shadow casters transforms.
-    for (size_t i = 0; i < m_gpu.NUM_BACK_BUFFERS; i++)
+    for (size_t i = 0; i < m_gpu.MAX_FRAMES_IN_FLIGHT; i++)
     {
         auto csu_table_alloc = m_gpu.frames[i].csu_table_allocator;
         ComPtr<ID3D12DescriptorHeap> csu_heap_gpu = csu_table_alloc.m_heap_gpu;
@@ -3315,7 +4007,8 @@ void particles_graphics::create_camera_debug_indices(ComPtr<ID3D12GraphicsComman
     size_t num_indices = frustum_indices.size();
     size_t indices_size = index_stride * num_indices;
     m_gpu.default_resource_from_uploader(cmd_list, m_debug_cam_frustum.m_mesh.m_indices_gpu.GetAddressOf(),
-                                         frustum_indices.data(), indices_size, index_stride);
+                                         frustum_indices.data(), indices_size, index_stride,
+                                         D3D12_RESOURCE_FLAG_NONE, gpu_memory_meshes, "m_debug_cam_frustum indices");
     NAME_D3D12_OBJECT(m_debug_cam_frustum.m_mesh.m_indices_gpu);
 
     D3D12_INDEX_BUFFER_VIEW frustum_indices_ibv;
@@ -3338,7 +4031,8 @@ void particles_graphics::create_camera_debug_indices(ComPtr<ID3D12GraphicsComman
     num_indices = frustum_plane_indices.size();
     indices_size = index_stride * num_indices;
     m_gpu.default_resource_from_uploader(cmd_list, m_debug_cam_frustum_planes.m_mesh.m_indices_gpu.GetAddressOf(),
-                                         frustum_plane_indices.data(), indices_size, index_stride);
+                                         frustum_plane_indices.data(), indices_size, index_stride,
+                                         D3D12_RESOURCE_FLAG_NONE, gpu_memory_meshes, "m_debug_cam_frustum_planes indices");
     NAME_D3D12_OBJECT(m_debug_cam_frustum_planes.m_mesh.m_indices_gpu);
 
     frustum_indices_ibv.BufferLocation = m_debug_cam_frustum_planes.m_mesh.m_indices_gpu->GetGPUVirtualAddress();
@@ -3355,16 +4049,18 @@ void particles_graphics::create_camera_debug_indices(ComPtr<ID3D12GraphicsComman
     m_debug_cam_frustum_planes.m_mesh.m_submeshes.push_back(indices_submesh);
 }
 
-void particles_graphics::update_current_camera()
+void particles_graphics::update_current_camera(frame_state *state)
 {
-    m_cameras[selected_cam].update_position();
-    m_cameras[selected_cam].update_view_proj();
+    state->cameras[state->selected_cam].update_position();
+    state->cameras[state->selected_cam].update_view_proj();
 }
 
 void particles_graphics::update_camera_yaw_pitch(ImVec2 last_mouse_pos)
 {
-    m_cameras[selected_cam].update_yaw_pitch(XMFLOAT2(ImGui::GetMousePos().x, ImGui::GetMousePos().y),
-                                             XMFLOAT2(last_mouse_pos.x, last_mouse_pos.y));
+    // Called between frames, the next update starts from the last updated state.
+    frame_state *state = &m_frame_states[m_recorded_state];
+    state->cameras[state->selected_cam].update_yaw_pitch(XMFLOAT2(ImGui::GetMousePos().x, ImGui::GetMousePos().y),
+                                                         XMFLOAT2(last_mouse_pos.x, last_mouse_pos.y));
 }
 
 ComPtr<ID3D12RootSignature> particles_graphics::create_graphics_rootsig()
@@ -3376,7 +4072,7 @@ ComPtr<ID3D12RootSignature> particles_graphics::create_graphics_rootsig()
     // In the meantime we bind descriptor arrays to the root signature directly.
     // Some indirect execution commands make use of descriptor arrays.
 
-    // Spot light shadow caster transform.
+    // Per object vertex constants of the spot light shadow casters and of the volume lights.
     std::vector<D3D12_ROOT_PARAMETER1> params;
     D3D12_ROOT_PARAMETER1 sparam;
     sparam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
@@ -3429,9 +4125,36 @@ ComPtr<ID3D12RootSignature> particles_graphics::create_graphics_rootsig()
     sparam.Descriptor.ShaderRegister = 0;
     params.push_back(sparam);
 
+    // Volume light pixel constants.
+    sparam = {};
+    sparam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+    sparam.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+    sparam.Descriptor.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE;
+    sparam.Descriptor.RegisterSpace = 1;
+    sparam.Descriptor.ShaderRegister = 2;
+    params.push_back(sparam);
+
     return m_gpu.create_graphics_staging_rootsig(params);
 }
 
+ComPtr<ID3D12RootSignature> particles_graphics::create_geometry_rootsig()
+{
+    // The geometry pass changes its object constants with every render object.
+    // They are bound as root CBVs pointing in the upload ring, the other bindings use the staging tables.
+    std::vector<shader_reflection> shaders = {m_shader_reflections[pbr_simple_VS], m_shader_reflections[pbr_simple_PS]};
+    rootsig_layout_options options;
+    options.hot_constant_buffers = {"object_cb_vs", "object_cb_ps"};
+    m_geometry_layout = m_gpu.build_graphics_staging_layout(shaders, options);
+
+    m_geometry_object_vs_param = m_geometry_layout.find_parameter(CBV, 1, 0, VS);
+    m_geometry_object_ps_param = m_geometry_layout.find_parameter(CBV, 1, 0, PS);
+    ASSERT(m_geometry_object_vs_param >= 0 && m_geometry_layout.parameters[m_geometry_object_vs_param].type == rootsig_cbv &&
+               m_geometry_object_ps_param >= 0 && m_geometry_layout.parameters[m_geometry_object_ps_param].type == rootsig_cbv,
+           "The geometry pass shaders don't read their object constants from b1.");
+
+    return m_gpu.create_rootsig(m_geometry_layout);
+}
+
 ComPtr<ID3D12RootSignature> particles_graphics::create_compute_rootsig()
 {
     std::vector<D3D12_ROOT_PARAMETER1> params;
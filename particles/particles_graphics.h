@@ -3,13 +3,22 @@
 #include "directx12_include.h"
 #include <vector>
 #include "imgui.h"
+#include "imgui_helpers.h"
 #include "render_object.h"
 #include "volume_light.h"
 #include "camera.h"
 #include "shader_data.h"
 #include "shader_shared_constants.h"
-#include <mutex>
 #include "gpu_timer.h"
+#include "render_graph.h"
+#include "memory_aliasing.h"
+#include "job_system.h"
+#include "task_graph.h"
+#include "queue_timeline.h"
+#include "command_list_pool.h"
+#include "d3d12_recorder.h"
+#include "command_capture.h"
+#include <memory>
 
 namespace particle
 {
@@ -54,6 +63,44 @@ enum PSOs
     PSOs_MAX
 };
 
+enum shaders
+{
+    pbr_simple_VS,
+    pbr_simple_PS,
+    lighting_pass_VS,
+    lighting_pass_PS,
+    shadow_pass_VS,
+    pointlight_shadow_VS,
+    pointlight_shadow_GS,
+    pointlight_shadow_PS,
+    solid_color_VS,
+    solid_color_PS,
+    debug_line_VS,
+    debug_line_PS,
+    particle_sim_CS,
+    update_particles_bounds_CS,
+    particle_point_VS,
+    particle_point_PS,
+    bounds_draw_VS,
+    bounds_draw_PS,
+    reinhard_tonemapping_VS,
+    reinhard_tonemapping_PS,
+    filter_commands_CS,
+    billboards_VS,
+    billboards_GS,
+    billboards_PS,
+    volume_light_VS,
+    volume_light_PS,
+    equirect_to_cube_CS,
+    draw_sky_VS,
+    draw_sky_PS,
+    diffuse_irradiance_map_CS,
+    specular_irradiance_map_CS,
+    generate_cube_mip_linear_CS,
+    specular_brdf_lut_CS,
+    shaders_MAX
+};
+
 enum samplers
 {
     linear_wrap,
@@ -128,6 +175,67 @@ enum heap_descriptor_offsets
     descriptors_MAX = uav_draw_commands_buffer + 1
 };
 
+// Scene and settings written by the update of a frame: the camera, the UI and the attractors.
+// The update of frame N+1 writes one state while frame N is recorded from the other one, the recording only reads
+// the members of particles_graphics that publish_frame_state() copied from its state.
+struct frame_state
+{
+    // Parts of the volume lights and render objects that the UI and the attractor update change.
+    struct volume_light_state
+    {
+        transform m_transform;
+        DirectX::XMFLOAT4 m_color;
+        float m_radius;
+        blend_modes m_blend_mode;
+    };
+    struct render_object_state
+    {
+        const std::string *name;
+        transform m_transform;
+        DirectX::XMFLOAT2 m_roughness_metalness;
+    };
+
+    camera cameras[cameras_MAX];
+    camera_selection selected_cam;
+    bool show_debug_camera;
+
+    // Settings.
+    float clip_delta;
+    float exposure;
+    int specular_shading;
+    bool do_tonemapping;
+    bool use_pcf_point_shadows;
+    bool use_pcf_max_quality;
+    bool is_drawing_bounds;
+    bool draw_billboards;
+    int brdf_id;
+    indirect_diffuse_brdf m_indirect_diffuse_brdf;
+    indirect_specular_brdf m_indirect_specular_brdf;
+    direct_diffuse_brdf m_direct_diffuse_brdf;
+    direct_specular_brdf m_direct_specular_brdf;
+    int num_geometry_chunks;
+
+    // Lights and objects.
+    particle_system_info particle_systems_infos[num_particle_systems];
+    attractor_point_light attractors[num_particle_systems];
+    volume_light_state volume_lights[num_particle_systems];
+    spot_light spotlights[num_spotlights];
+    std::vector<render_object_state> render_objects; // In the iteration order of m_render_objects.
+
+    float deltatime;
+    double input_timestamp; // g_cpu_timer timestamp of the start of the update, when the input is read.
+};
+
+// CPU frame time and input to present latency, averaged over the frames rendered in one mode.
+struct frame_latency_stats
+{
+    UINT num_frames = 0;
+    double total_frame_ms = 0.0;
+    double total_work_ms = 0.0;
+    double total_wait_ms = 0.0;    // Blocked until the frame resource is available.
+    double total_latency_ms = 0.0; // From the input sampling to the present.
+};
+
 struct particles_graphics
 {
     particles_graphics() = default;
@@ -142,7 +250,84 @@ struct particles_graphics
     static const int draw_commands_buffer_descriptors = 2;                    // 2: [srv_draw_commands_buffer, uav_draw_commands_buffer].
 
     gpu_interface m_gpu;
-    std::mutex mtx;
+
+    // Shadow, geometry and compute recording runs on the job system, with one worker per hardware thread.
+    job_system m_jobs;
+
+    // CPU work of a frame, the tasks run on the job system as soon as the data they read is ready.
+    // The timings of the last frame are kept as text for the UI, which runs during the next one.
+    // The tasks that record the frame are added by add_recording_tasks(), the headless benchmark runs them too.
+    struct frame_recording;
+    task_graph m_frame_tasks;
+    void build_frame_tasks(int update_index);
+    std::string m_frame_tasks_report;
+    std::string m_frame_tasks_dot;
+    std::string m_frame_tasks_json;
+
+    // Benchmarks requested from the UI. They run after the frame tasks, so that they neither compete with the
+    // recording jobs for the upload buffer and the threads nor get slowed down by them.
+    bool m_run_upload_benchmark = false;
+    bool m_run_wakeup_benchmark = false;
+    bool m_run_profile_benchmark = false;
+    void run_requested_benchmarks();
+
+    // Report of the last upload contention benchmark.
+    std::string m_upload_benchmark_report;
+
+    // Report of the last thread wakeup latency benchmark.
+    std::string m_wakeup_benchmark_report;
+
+    // Call tree of the CPU scopes of the last frame, and the cost of a scope.
+    std::string m_cpu_profile_report;
+    std::string m_profile_benchmark_report;
+
+    // Trace of the CPU scopes, GPU timers and render counters of the next m_trace_frames frames, requested from the UI. It is saved
+    // to frame_trace.json or frame_trace.perfetto-trace once the GPU is done with the last captured frame.
+    bool m_start_trace = false;
+    bool m_is_tracing = false;
+    int m_trace_frames = 5;
+    int m_trace_format = trace_format_chrome_json;
+    trace_capture m_trace;
+    std::string m_trace_report;
+    void update_trace(const profile_frame &frame, const render_counter_frame &counters);
+
+    // Frame loop of this scene on the null recording backend, requested from the UI and run after the frame
+    // because it runs its own task graph on the job system. It also sweeps the number of geometry jobs.
+    // With m_capture_headless_frame, one frame is also captured to m_capture_path and replayed.
+    bool m_run_headless_benchmark = false;
+    bool m_capture_headless_frame = false;
+    std::string m_capture_path = "frame_capture.bin";
+    std::string m_headless_report;
+    task_graph m_headless_tasks;
+    void run_headless_benchmark();
+    double run_headless_frame(frame_recording *recording);
+
+    // Update and recording of consecutive frames.
+    // With m_overlap_update, the update of frame N+1 runs during the recording of frame N and during the wait for
+    // the frame resource, and writes the other state. Otherwise the frame records the state it just updated.
+    // The UI runs while the passes are recorded, it only reads what they write through the copies made after run().
+    frame_state m_frame_states[2];
+    imgui_draw_snapshot m_ui_draws[2];
+    int m_recorded_state = 0;
+    bool m_overlap_update = true;
+    void capture_frame_state(frame_state *state);
+    void publish_frame_state(const frame_state *state);
+    std::vector<gpu_interface::timer_result> m_timer_results;
+    std::vector<gpu_interface::timer_stats_summary> m_timer_stats; // Copied with m_timer_results.
+    gpu_interface::timer_readback_stats m_timer_readback = {}; // Copied with m_timer_results.
+    stall_totals m_stalls[stall_cause_count]; // Of the last presented frame, copied with m_timer_results.
+    frame_pacing_summary m_pacing = {};
+    render_counter_frame m_render_counters; // Of the last frame, copied with m_timer_results.
+    int m_timer_stats_window = rolling_stats::default_window; // Set from the UI, in frames.
+    std::string m_render_graph_report;
+    std::string m_geometry_report;
+    frame_latency_stats m_latency_stats[2]; // Sequential and overlapped.
+    int m_frames_in_flight = gpu_interface::NUM_BACK_BUFFERS; // Requested from the UI.
+    bool m_is_low_latency = false;                            // Requested from the UI, applied at the start of the next frame.
+    double m_cpu_wait_ms = 0.0;                               // Of the last frame, copied with m_timer_results.
+    double m_input_to_present_ms = 0.0;                       // Of the last presented frame, copied with m_timer_results.
+    frame_pacing_config m_pacing_config; // Simulated in the UI.
+
     float m_deltatime;
 
     // Buffer formats.
@@ -163,33 +348,56 @@ struct particles_graphics
     void initialize();
     void resize(int width, int height);
     void render();
-    void staging_pass(ComPtr<ID3D12GraphicsCommandList> cmd_list,
+    void staging_pass(command_recorder *recorder,
                       camera *cam);
-    void point_shadows_pass(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                            gpu_interface::frame_resource *frame);
-    void draw_geometry_pass(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                            gpu_interface::frame_resource *frame,
-                            camera *cam);
-    void draw_lighting_pass(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                            gpu_interface::frame_resource *frame);
-    void draw_sky(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                  gpu_interface::frame_resource *frame);
-    void draw_volume_lights(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                            gpu_interface::constant_buffer<object_data_vs> vs_cb,
-                            gpu_interface::constant_buffer<volume_light_data_ps> ps_cb,
+    void fill_pass_data(camera *cam, pass_data *pass);
+    void point_shadows_pass(command_recorder *recorder);
+    void draw_geometry_pass(command_recorder *recorder,
+                            command_recorder *post_geometry_recorder);
+    void draw_lighting_pass(command_recorder *recorder);
+    void draw_sky(command_recorder *recorder);
+    void draw_volume_lights(command_recorder *recorder,
                             const volume_light *volume_lights, size_t count,
                             const camera *current_cam);
-    void draw_particle_systems(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                               gpu_interface::frame_resource *frame);
-    void draw_bounding_boxes(ComPtr<ID3D12GraphicsCommandList> cmd_list);
-    void draw_debug_objects(ComPtr<ID3D12GraphicsCommandList> cmd_list);
-    void post_process(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                      gpu_interface::frame_resource *frame);
-
-    void draw_render_objects(ComPtr<ID3D12GraphicsCommandList> cmd_list,
-                             gpu_interface::constant_buffer<object_data_vs>* vs_cb,
-                             gpu_interface::constant_buffer<render_object_data_ps>* ps_cb,
-                             const render_object *render_objects, size_t count, DirectX::XMMATRIX view_proj, bool is_scene_pass);
+    void draw_particle_systems(command_recorder *recorder);
+    void draw_bounding_boxes(command_recorder *recorder);
+    void draw_debug_objects(command_recorder *recorder);
+    void post_process(command_recorder *recorder);
+
+    // Scene passes recorded on the main command list, the passes after the geometry pass go to the post geometry list.
+    render_graph m_render_graph;
+    std::vector<recorded_barrier> m_graph_barriers;
+    void build_render_graph(command_recorder *recorder,
+                            command_recorder *post_geometry_recorder,
+                            camera *current_cam);
+
+    // Geometry pass recorded on the job system.
+    // The draws are split in chunks of about the same number of indices, each chunk is recorded by a job on its
+    // own command list with its own staging, and the lists are submitted between the main and post geometry lists.
+    static const int max_geometry_chunks = 8;
+    struct geometry_draw
+    {
+        const render_object *ro;
+        const mesh::submesh *submesh;
+    };
+    std::vector<geometry_draw> m_geometry_draws;
+    UINT m_geometry_chunk_begin[max_geometry_chunks + 1]; // First draw of each chunk, the last one is the number of draws.
+    int m_num_geometry_chunks = max_geometry_chunks;      // Requested from the UI, to compare the recording times.
+    int m_num_recorded_geometry_chunks = 0;
+    double m_geometry_chunk_ms[max_geometry_chunks] = {}; // CPU time spent recording each chunk.
+    gpu_interface::recording_context m_geometry_contexts[max_geometry_chunks];
+    job_counter m_geometry_jobs;
+    void begin_geometry_chunks(frame_recording *recording);
+    void record_geometry_chunk(command_recorder *recorder, int chunk_index, DirectX::XMMATRIX view_proj);
+    void set_gbuffer_render_targets(command_recorder *recorder);
+
+    // Draws the render objects with their vertex constants only, bound to the root CBV object_vs_param.
+    void draw_render_objects(command_recorder *recorder, UINT object_vs_param,
+                             const render_object *render_objects, size_t count, DirectX::XMMATRIX view_proj);
+
+    // Copies the per-object constants, the upload buffer can be used by several jobs at the same time.
+    void fill_object_constants(const render_object *ro, int object_id, DirectX::XMMATRIX view_proj,
+                               object_data_vs *obj_data_vs, render_object_data_ps *obj_data_ps);
 
     void create_particle_systems_data(ComPtr<ID3D12GraphicsCommandList> cmd_list);
     void create_particle_simulation_commands(ComPtr<ID3D12GraphicsCommandList> cmd_list);
@@ -202,6 +410,7 @@ struct particles_graphics
 
     void create_point_shadows_draw_commands(ComPtr<ID3D12GraphicsCommandList> cmd_list);
 
+    void plan_transient_memory();
     void create_render_targets();
     void create_gbuffers();
     void create_depth_target();
@@ -213,7 +422,7 @@ struct particles_graphics
 
     camera *get_camera() { return &m_cameras[selected_cam]; };
     void create_camera_debug_indices(ComPtr<ID3D12GraphicsCommandList> cmd_list);
-    void update_current_camera();
+    void update_current_camera(frame_state *state);
     void update_camera_yaw_pitch(ImVec2 last_mouse_pos);
 
     ImGuiContext *m_ctx;
@@ -228,6 +437,18 @@ struct particles_graphics
     ComPtr<ID3D12RootSignature> m_compute_rootsig;
     ComPtr<ID3D12RootSignature> m_graphics_rootsig;
 
+    // Root signature of the geometry pass, generated from the reflection of its shaders.
+    ComPtr<ID3D12RootSignature> create_geometry_rootsig();
+    ComPtr<ID3D12RootSignature> m_geometry_rootsig;
+    rootsig_layout m_geometry_layout;
+    int m_geometry_object_vs_param;
+    int m_geometry_object_ps_param;
+
+    // Shaders, compiled before the root signatures that are sized from their reflection.
+    void compile_shaders();
+    ID3DBlob *m_shaders[shaders_MAX];
+    shader_reflection m_shader_reflections[shaders_MAX];
+
     ID3D12PipelineState *m_PSOs[PSOs_MAX];
     D3D12_CPU_DESCRIPTOR_HANDLE m_samplers[samplers_MAX];
 
@@ -249,7 +470,6 @@ struct particles_graphics
 
     // Per object constant data.
     gpu_interface::constant_buffer<object_data_vs> m_object_cb_vs;
-    gpu_interface::constant_buffer<object_data_vs> m_shadowmap_cb_vs;
     gpu_interface::constant_buffer<render_object_data_ps> m_render_object_cb_ps;
 
     // App state.
@@ -269,14 +489,13 @@ struct particles_graphics
 
     point_light total_particle_lights[num_particle_lights];
     gpu_interface::structured_buffer<point_light> m_particle_lights_sb;
-    ComPtr<ID3D12Resource> particle_lights_counter_default[gpu_interface::NUM_BACK_BUFFERS];
+    ComPtr<ID3D12Resource> particle_lights_counter_default[gpu_interface::MAX_FRAMES_IN_FLIGHT];
     gpu_interface::constant_buffer<UINT> m_particle_lights_counter;
 
     attractor_point_light attractors[num_particle_systems];
     gpu_interface::structured_buffer<attractor_point_light> m_attractors_sb;
 
     volume_light volume_lights[num_particle_systems];
-    gpu_interface::constant_buffer<volume_light_data_ps> m_volume_light_cb_ps;
 
     spot_light spotlights[num_spotlights];
     gpu_interface::structured_buffer<spot_light> m_spotlights_sb;
@@ -294,42 +513,50 @@ struct particles_graphics
     gpu_interface::gbuffer m_gbuffer1;
     gpu_interface::gbuffer m_gbuffer2;
 
-    // Staging command lists.
-    ComPtr<ID3D12GraphicsCommandList> staging_cmdlists[gpu_interface::NUM_BACK_BUFFERS];
-    ComPtr<ID3D12CommandAllocator> staging_cmdallocs[gpu_interface::NUM_BACK_BUFFERS];
+    // Transient memory.
+    // The gbuffers, the HDR render targets and the equirectangular environment map are placed in shared heaps.
+    // Pass 0 is the IBL generation at startup, each frame in flight then uses a geometry and a lighting pass.
+    enum transient_resource
+    {
+        transient_equirect,
+        transient_gbuffer0,
+        transient_gbuffer1,
+        transient_gbuffer2,
+        transient_hdr0,
+        transient_MAX = transient_hdr0 + gpu_interface::NUM_BACK_BUFFERS
+    };
+    static const uint32_t transient_passes_per_frame = 2;
+    std::vector<aliasing_request> m_transient_requests;
+    aliasing_plan m_transient_plan;
+    std::vector<ComPtr<ID3D12Heap>> m_transient_heaps;
+    std::string m_transient_report;
+    bool m_transient_targets_activated = false; // The first frame takes over the memory of the IBL scratch texture.
+    ComPtr<ID3D12Heap> transient_heap(transient_resource resource) { return m_transient_heaps[m_transient_plan.placements[resource].heap]; }
+    UINT64 transient_offset(transient_resource resource) { return m_transient_plan.placements[resource].offset; }
+
+    // Command lists of the frame, taken from a pool per list type and given back when their submission completes.
+    command_list_pool m_direct_list_pool;
+    command_list_pool m_compute_list_pool;
+    std::string m_list_pools_report;
 
     // Shadow maps related data.
-    void create_shadowmap_thread_contexts();
-    void shadowmap_worker(int thread_index, spot_light *spotlights, int num_spotlights);
+    void create_shadowmap_job_contexts();
+    void shadowmap_worker(command_recorder *recorder, int thread_index, spot_light *spotlights, int num_spotlights);
     void create_spotlight_shadowmaps();
     void create_pointlight_shadowmaps();
-    D3D12_GPU_DESCRIPTOR_HANDLE shadowmaps_base_gpu[gpu_interface::NUM_BACK_BUFFERS];
+    D3D12_GPU_DESCRIPTOR_HANDLE shadowmaps_base_gpu[gpu_interface::MAX_FRAMES_IN_FLIGHT];
 
     // Shadow casters transforms data.
     ComPtr<ID3D12Resource> m_shadowcasters_transforms;
     object_data_vs shadow_casters_transforms[num_shadow_casters];
     size_t shadow_transforms_cbv_size;
-    D3D12_GPU_DESCRIPTOR_HANDLE cbv_gpu_shadowcasters_transforms_base[gpu_interface::NUM_BACK_BUFFERS];
-    D3D12_CPU_DESCRIPTOR_HANDLE cbv_cpu_shadowcasters_transforms[gpu_interface::NUM_BACK_BUFFERS];
+    D3D12_GPU_DESCRIPTOR_HANDLE cbv_gpu_shadowcasters_transforms_base[gpu_interface::MAX_FRAMES_IN_FLIGHT];
+    D3D12_CPU_DESCRIPTOR_HANDLE cbv_cpu_shadowcasters_transforms[gpu_interface::MAX_FRAMES_IN_FLIGHT];
 
     spot_light per_thread_spotlights[G_NUM_SHADOW_THREADS][G_NUM_LIGHTS_PER_THREAD];
     spot_light *per_thread_sl[G_NUM_SHADOW_THREADS];
 
-    HANDLE shadow_thread_handles[G_NUM_SHADOW_THREADS];
-    HANDLE begin_shadowpass_events[G_NUM_SHADOW_THREADS];
-    HANDLE end_shadowpass_events[G_NUM_SHADOW_THREADS];
-
-    struct shadow_thunk_parameter
-    {
-        particles_graphics *graphics;
-        int thread_index;
-        spot_light *spotlights;
-        int num_spotlights;
-    };
-    shadow_thunk_parameter shadow_thunk_parameters[G_NUM_SHADOW_THREADS];
-
-    ComPtr<ID3D12GraphicsCommandList> shadow_cmdlists[gpu_interface::NUM_BACK_BUFFERS][G_NUM_SHADOW_THREADS];
-    ComPtr<ID3D12CommandAllocator> shadow_cmdallocs[gpu_interface::NUM_BACK_BUFFERS][G_NUM_SHADOW_THREADS];
+    job_counter m_shadow_jobs;
 
     // Particles related data.
     void create_indirect_commands(ComPtr<ID3D12GraphicsCommandList> cmd_list);
@@ -343,8 +570,8 @@ struct particles_graphics
     ComPtr<ID3D12Resource> particle_output_default;
     ComPtr<ID3D12Resource> particle_infos_default;
 
-    D3D12_GPU_DESCRIPTOR_HANDLE compute_descriptors_base_gpu_handle[gpu_interface::NUM_BACK_BUFFERS];
-    D3D12_CPU_DESCRIPTOR_HANDLE particles_base_cpu[gpu_interface::NUM_BACK_BUFFERS];
+    D3D12_GPU_DESCRIPTOR_HANDLE compute_descriptors_base_gpu_handle[gpu_interface::MAX_FRAMES_IN_FLIGHT];
+    D3D12_CPU_DESCRIPTOR_HANDLE particles_base_cpu[gpu_interface::MAX_FRAMES_IN_FLIGHT];
 
     // Texture processing data.
     struct texture
@@ -386,34 +613,56 @@ struct particles_graphics
     size_t num_bb_indices;
     ComPtr<ID3D12Resource> bounds_indices_resource;
     ComPtr<ID3D12Resource> bounds_vertices_resource;
-    D3D12_CPU_DESCRIPTOR_HANDLE cpu_srv_bounds_vertices_handle[gpu_interface::NUM_BACK_BUFFERS];
-    D3D12_CPU_DESCRIPTOR_HANDLE cpu_uav_bounds_vertices_handle[gpu_interface::NUM_BACK_BUFFERS];
-    D3D12_GPU_DESCRIPTOR_HANDLE gpu_uav_bounds_vertices_handle[gpu_interface::NUM_BACK_BUFFERS];
+    D3D12_CPU_DESCRIPTOR_HANDLE cpu_srv_bounds_vertices_handle[gpu_interface::MAX_FRAMES_IN_FLIGHT];
+    D3D12_CPU_DESCRIPTOR_HANDLE cpu_uav_bounds_vertices_handle[gpu_interface::MAX_FRAMES_IN_FLIGHT];
+    D3D12_GPU_DESCRIPTOR_HANDLE gpu_uav_bounds_vertices_handle[gpu_interface::MAX_FRAMES_IN_FLIGHT];
 
     // Compute queue related data.
-    void create_compute_thread_contexts();
-    void compute_worker(int thread_index);
+    void update_attractors(frame_state *state);
+    void compute_worker(command_recorder *recorder, int thread_index);
 
-    ComPtr<ID3D12Fence> compute_fence;
+    ComPtr<ID3D12Fence> compute_fence; // Of the IBL generation at startup.
+    job_counter m_compute_jobs;
 
-    ComPtr<ID3D12GraphicsCommandList> compute_cmdlists[gpu_interface::NUM_BACK_BUFFERS][G_NUM_COMPUTE_THREADS];
-    ComPtr<ID3D12CommandAllocator> compute_cmdallocs[gpu_interface::NUM_BACK_BUFFERS][G_NUM_COMPUTE_THREADS];
-
-    HANDLE compute_thread_handles[G_NUM_COMPUTE_THREADS];
-    HANDLE begin_compute_events[G_NUM_COMPUTE_THREADS];
-    HANDLE end_compute_events[G_NUM_COMPUTE_THREADS];
-
-    struct compute_thunk_parameter
+    // Recorders and queues that the recording tasks of a frame use.
+    // The frame records on D3D12, the headless benchmark records the same tasks on the null backend.
+    struct frame_recording
     {
-        particles_graphics *graphics;
-        int thread_index;
+        recording_device *device = nullptr;
+        recording_queue *queues[gpu_queue_MAX] = {};
+        command_recorder *compute[G_NUM_COMPUTE_THREADS] = {};
+        command_recorder *staging = nullptr;
+        command_recorder *shadows[G_NUM_SHADOW_THREADS] = {};
+        command_recorder *main = nullptr;
+        command_recorder *post_geometry = nullptr;
+        command_recorder *geometry[max_geometry_chunks] = {};
+
+        // Queue synchronization, with fence values taken from a timeline per queue.
+        // The particle simulation of frame N runs on the compute queue during the shadow and geometry lists of frame N.
+        // It only waits for the graphics submission of frame N - 1 that last read the particle buffers, and the
+        // lighting and particle passes of frame N wait for it.
+        // The simulation doesn't need the outputs of frame N - 1 to overlap the shadows and the gbuffer, which don't
+        // read the particles. Double buffering would also overlap it with the lighting and particle passes, but needs a
+        // second set of particle, light, bounds and draw command buffers, whose addresses are baked in the indirect commands.
+        queue_timeline timeline;
+        queue_sync_point particles_ready = {gpu_queue_compute, 0};
+        queue_sync_point particles_released = {gpu_queue_graphics, 0};
     };
-    compute_thunk_parameter compute_thunk_parameters[G_NUM_COMPUTE_THREADS];
+    void create_recorders(frame_recording *recording);
+    void add_recording_tasks(task_graph *tasks, frame_recording *recording,
+                             task_graph_handle frame_resources, task_graph_handle camera_data,
+                             task_graph_handle settings, task_graph_handle attractors_data);
+    void submit(frame_recording *recording, const queue_submission &submission, command_recorder *const *recorders, uint32_t count);
+
+    std::unique_ptr<d3d12_recording_device> m_d3d12_device;
+    std::unique_ptr<d3d12_recording_queue> m_d3d12_queues[2]; // Graphics and compute.
+    frame_recording m_recording;
+    std::string m_queue_report;
 
     // Indirect execution data.
     ComPtr<ID3D12Resource> reset_counter_default; // Zero'd counter used to reset other counters.
-    ComPtr<ID3D12Resource> particle_simcmds_counter_default[gpu_interface::NUM_BACK_BUFFERS];
-    ComPtr<ID3D12Resource> particle_drawcmds_counter_default[gpu_interface::NUM_BACK_BUFFERS];
+    ComPtr<ID3D12Resource> particle_simcmds_counter_default[gpu_interface::MAX_FRAMES_IN_FLIGHT];
+    ComPtr<ID3D12Resource> particle_drawcmds_counter_default[gpu_interface::MAX_FRAMES_IN_FLIGHT];
 
     ComPtr<ID3D12CommandSignature> render_point_shadows_cmdsig;
     ComPtr<ID3D12Resource> render_point_shadows_cmds_default;
@@ -423,14 +672,14 @@ struct particles_graphics
     ComPtr<ID3D12Resource> particle_simcmds_default;
     ComPtr<ID3D12Resource> particle_simcmds_swap_default;
     ComPtr<ID3D12Resource> particle_simcmds_filtered_default;
-    D3D12_CPU_DESCRIPTOR_HANDLE cpu_srv_particle_simcmds_handle[gpu_interface::NUM_BACK_BUFFERS];
-    D3D12_CPU_DESCRIPTOR_HANDLE cpu_uav_particle_simcmds_filtered_handle[gpu_interface::NUM_BACK_BUFFERS];
+    D3D12_CPU_DESCRIPTOR_HANDLE cpu_srv_particle_simcmds_handle[gpu_interface::MAX_FRAMES_IN_FLIGHT];
+    D3D12_CPU_DESCRIPTOR_HANDLE cpu_uav_particle_simcmds_filtered_handle[gpu_interface::MAX_FRAMES_IN_FLIGHT];
 
     ComPtr<ID3D12CommandSignature> particle_draw_cmdsig;
     ComPtr<ID3D12Resource> particle_drawcmds_default;
     ComPtr<ID3D12Resource> particle_drawcmds_filtered_default;
-    D3D12_CPU_DESCRIPTOR_HANDLE cpu_srv_particle_drawcmds_filtered_handle[gpu_interface::NUM_BACK_BUFFERS];
-    D3D12_CPU_DESCRIPTOR_HANDLE cpu_uav_particle_drawcmds_filtered_handle[gpu_interface::NUM_BACK_BUFFERS];
+    D3D12_CPU_DESCRIPTOR_HANDLE cpu_srv_particle_drawcmds_filtered_handle[gpu_interface::MAX_FRAMES_IN_FLIGHT];
+    D3D12_CPU_DESCRIPTOR_HANDLE cpu_uav_particle_drawcmds_filtered_handle[gpu_interface::MAX_FRAMES_IN_FLIGHT];
 
     ComPtr<ID3D12Resource> bounds_calc_cmds_default;
     ComPtr<ID3D12CommandSignature> bounds_calc_cmdsig;
@@ -23,7 +23,7 @@ struct volume_light_data_vs
     matrix world;
     matrix mvp;
 };
-ConstantBuffer<volume_light_data_vs> object_cb_vs : register(b1);
+ConstantBuffer<volume_light_data_vs> object_cb_vs : register(b1, space1);
 ConstantBuffer<pass_data> cb_pass : register(b0);
 
 vertex_out vs_main(vertex_in vin)
@@ -51,7 +51,7 @@ struct volume_light_data_ps
     float3 object_space_cam_forward;
     float _pad1;
 };
-ConstantBuffer<volume_light_data_ps> volume_light : register(b2);
+ConstantBuffer<volume_light_data_ps> volume_light : register(b2, space1);
 Texture2D<float> Depth : register(t3);
 SamplerState linear_wrap_sampler : register(s0);
 
@@ -3,12 +3,49 @@
 #include "imgui.h"
 #include "imgui_helpers.h"
 
-void ui_context::draw(particles_graphics *graphics)
+void ui_context::draw(particles_graphics *graphics, frame_state *state)
 {
     ImGui::Text("%f time", (float)g_cpu_timer.get_current_time());
     ImGui::Text("%d FPS", g_cpu_timer.fps);
 
-    if (ImGui::BeginTable("metrics", 3,
+    // A resolve per event before the timers were resolved per list.
+    const gpu_interface::timer_readback_stats &readback = graphics->m_timer_readback;
+    ImGui::Text("%u timers, %u resolves instead of %u, results read in %.3f ms",
+                readback.num_timers, readback.num_resolves, readback.num_timers, readback.readback_ms);
+
+    // Present-to-present intervals over the last frames, and the change from one interval to the next.
+    const frame_pacing_summary &pacing = graphics->m_pacing;
+    ImGui::Text("Present interval: p50 %.2f, p99 %.2f, max %.2f ms, jitter: mean %.2f, p99 %.2f ms",
+                pacing.interval.p50, pacing.interval.p99, pacing.interval.max, pacing.jitter.mean, pacing.jitter.p99);
+    if (ImGui::BeginTable("stalls", 4,
+                          ImGuiTableFlags_BordersInnerH |
+                              ImGuiTableFlags_BordersOuterH |
+                              ImGuiTableFlags_BordersOuterV |
+                              ImGuiTableFlags_BordersInnerV |
+                              ImGuiTableFlags_SizingStretchProp))
+    {
+        ImGui::TableSetupColumn("Blocking waits of the last frame");
+        ImGui::TableSetupColumn("Count");
+        ImGui::TableSetupColumn("Total (ms)");
+        ImGui::TableSetupColumn("Longest (ms)");
+        ImGui::TableHeadersRow();
+        for (int i = 0; i < stall_cause_count; i++)
+        {
+            const stall_totals &stall = graphics->m_stalls[i];
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextUnformatted(stall_cause_name((stall_cause)i));
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%u", stall.count);
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%f", stall.total_ms);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%f", stall.max_ms);
+        }
+        ImGui::EndTable();
+    }
+
+    if (ImGui::BeginTable("metrics", 4,
                           ImGuiTableFlags_BordersInnerH |
                               ImGuiTableFlags_BordersOuterH |
                               ImGuiTableFlags_BordersOuterV |
@@ -18,80 +55,335 @@ void ui_context::draw(particles_graphics *graphics)
         ImGui::TableSetupColumn("");
         ImGui::TableSetupColumn("CPU (ms)");
         ImGui::TableSetupColumn("GPU (ms)");
+        ImGui::TableSetupColumn("Queue latency (ms)");
         ImGui::TableHeadersRow();
         ImGui::TableNextRow();
 
-        for (auto &timer : graphics->m_gpu.timers)
+        for (gpu_interface::timer_result &timer : graphics->m_timer_results)
         {
-            std::string event_name = timer.first;
-            gpu_interface::timer_entry &entries = timer.second;
+            // Event name and the thread that recorded it.
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%s (%s)", timer.event_name.c_str(), timer.thread_name.c_str());
+
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%f", timer.cpu_ms);
 
-            // GPU result for the event.
             ImGui::TableSetColumnIndex(2);
-            ImGui::Text("%f", graphics->m_gpu.result_gpu(event_name));
+            ImGui::Text("%f", timer.gpu_ms);
 
-            // CPU results for the event.
-            for (std::string &cpu_event : entries.cpu_event_names)
+            // From the submission to the start on the GPU, on the calibrated GPU clock.
+            ImGui::TableSetColumnIndex(3);
+            if (timer.is_submitted)
             {
-                // Event name.
-                ImGui::TableSetColumnIndex(0);
-                ImGui::Text(cpu_event.c_str());
+                ImGui::Text("%f", timer.queue_latency_ms);
+            }
+            else
+            {
+                ImGui::TextUnformatted("-");
+            }
+            ImGui::TableNextRow();
+        }
 
-                ImGui::TableSetColumnIndex(1);
-                ImGui::Text("%f", graphics->m_gpu.result_cpu(cpu_event));
-                ImGui::TableNextRow();
+        ImGui::EndTable();
+    }
+
+    // What the passes of the last frame recorded, the work behind the timings above.
+    if (ImGui::BeginTable("render counters", render_counter_count + 1,
+                          ImGuiTableFlags_BordersInnerH |
+                              ImGuiTableFlags_BordersOuterH |
+                              ImGuiTableFlags_BordersOuterV |
+                              ImGuiTableFlags_BordersInnerV |
+                              ImGuiTableFlags_SizingStretchProp))
+    {
+        ImGui::TableSetupColumn("");
+        for (int i = 0; i < render_counter_count; i++)
+        {
+            ImGui::TableSetupColumn(render_counter_name((render_counter)i));
+        }
+        ImGui::TableHeadersRow();
+
+        const render_counter_frame &counters = graphics->m_render_counters;
+        auto counter_row = [](const char *name, const render_counter_values &values) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextUnformatted(name);
+            for (int i = 0; i < render_counter_count; i++)
+            {
+                ImGui::TableSetColumnIndex(i + 1);
+                ImGui::Text("%llu", (unsigned long long)values.values[i]);
             }
+        };
+        for (const pass_counter_values &pass : counters.passes)
+        {
+            counter_row(profile_event_name(pass.pass), pass.counters);
         }
+        counter_row("Outside of the passes", counters.outside_passes());
+        counter_row("Total", counters.totals);
 
         ImGui::EndTable();
     }
 
+    // Distribution of each event over the last frames, the spikes the last frame doesn't show.
+    if (ImGui::CollapsingHeader("Timer statistics", ImGuiTreeNodeFlags_None))
+    {
+        ImGui::SliderInt("Window (frames)", &graphics->m_timer_stats_window, 16, 4096);
+        if (ImGui::BeginTable("timer statistics", 9,
+                              ImGuiTableFlags_BordersInnerH |
+                                  ImGuiTableFlags_BordersOuterH |
+                                  ImGuiTableFlags_BordersOuterV |
+                                  ImGuiTableFlags_BordersInnerV |
+                                  ImGuiTableFlags_SizingStretchProp))
+        {
+            ImGui::TableSetupColumn("");
+            ImGui::TableSetupColumn("CPU p50");
+            ImGui::TableSetupColumn("CPU p95");
+            ImGui::TableSetupColumn("CPU p99");
+            ImGui::TableSetupColumn("CPU max");
+            ImGui::TableSetupColumn("GPU p50");
+            ImGui::TableSetupColumn("GPU p95");
+            ImGui::TableSetupColumn("GPU p99");
+            ImGui::TableSetupColumn("GPU max");
+            ImGui::TableHeadersRow();
+
+            for (const gpu_interface::timer_stats_summary &stats : graphics->m_timer_stats)
+            {
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::TextUnformatted(stats.event_name.c_str());
+                if (ImGui::IsItemHovered())
+                {
+                    ImGui::SetTooltip("%u frames\nCPU: min %.3f, mean %.3f, stddev %.3f ms\nGPU: min %.3f, mean %.3f, stddev %.3f ms",
+                                      stats.cpu.count, stats.cpu.min, stats.cpu.mean, stats.cpu.stddev,
+                                      stats.gpu.min, stats.gpu.mean, stats.gpu.stddev);
+                }
+
+                const double values[] = {stats.cpu.p50, stats.cpu.p95, stats.cpu.p99, stats.cpu.max,
+                                         stats.gpu.p50, stats.gpu.p95, stats.gpu.p99, stats.gpu.max};
+                for (int i = 0; i < 8; i++)
+                {
+                    ImGui::TableSetColumnIndex(i + 1);
+                    ImGui::Text("%.3f", values[i]);
+                }
+            }
+            ImGui::EndTable();
+        }
+    }
+
     imgui_mouse_pos();
     bool show_demo = true;
     ImGui::ShowDemoWindow(&show_demo);
 
-    ImGui::Combo("Camera", (int *)&graphics->selected_cam, "main camera\0debug camera\0\0");
-    ImGui::Checkbox("Show debug camera", &graphics->show_debug_camera);
+    ImGui::Combo("Camera", (int *)&state->selected_cam, "main camera\0debug camera\0\0");
+    ImGui::Checkbox("Show debug camera", &state->show_debug_camera);
 
     ImGui::Spacing();
-    ImGui::Checkbox("Soft point shadows", &graphics->use_pcf_point_shadows);
-    if (graphics->use_pcf_point_shadows)
+    ImGui::Checkbox("Soft point shadows", &state->use_pcf_point_shadows);
+    if (state->use_pcf_point_shadows)
     {
         ImGui::Indent(10.f);
-        ImGui::Checkbox("Max quality PCF", &graphics->use_pcf_max_quality);
+        ImGui::Checkbox("Max quality PCF", &state->use_pcf_max_quality);
         ImGui::Unindent(10.f);
     }
-    ImGui::Checkbox("Tonemapping", &graphics->do_tonemapping);
-    if (graphics->do_tonemapping)
+    ImGui::Checkbox("Tonemapping", &state->do_tonemapping);
+    if (state->do_tonemapping)
     {
-        ImGui::SliderFloat("Exposure", &graphics->exposure, 0.1f, 5.f);
+        ImGui::SliderFloat("Exposure", &state->exposure, 0.1f, 5.f);
     }
-        ImGui::SliderFloat("Pixel clip delta", &graphics->clip_delta, 0.0f, 1.f);
+        ImGui::SliderFloat("Pixel clip delta", &state->clip_delta, 0.0f, 1.f);
 
 
     if (ImGui::CollapsingHeader("Lighting", ImGuiTreeNodeFlags_None))
     {
         ImGui::Text("Indirect lighting");
-        ImGui::Combo("Indirect diffuse BRDF", (int *)&graphics->m_indirect_diffuse_brdf, "Lambertian PDF IBL\0Lambertian constant\0\0");
-        ImGui::Combo("Indirect specular BRDF", (int *)&graphics->m_indirect_specular_brdf, "GGX PDF IBL\0Simple reflection (not implemented yet)\0\0");
+        ImGui::Combo("Indirect diffuse BRDF", (int *)&state->m_indirect_diffuse_brdf, "Lambertian PDF IBL\0Lambertian constant\0\0");
+        ImGui::Combo("Indirect specular BRDF", (int *)&state->m_indirect_specular_brdf, "GGX PDF IBL\0Simple reflection (not implemented yet)\0\0");
 
         ImGui::Spacing();
 
         ImGui::Text("Direct lighting");
-        ImGui::Combo("Direct diffuse BRDF", (int *)&graphics->m_direct_diffuse_brdf, "Lambertian\0\0");
-        ImGui::Combo("Direct specular BRDF", (int *)&graphics->m_direct_specular_brdf, "Cook-Torrance\0Blinn-Phong\0\0");
+        ImGui::Combo("Direct diffuse BRDF", (int *)&state->m_direct_diffuse_brdf, "Lambertian\0\0");
+        ImGui::Combo("Direct specular BRDF", (int *)&state->m_direct_specular_brdf, "Cook-Torrance\0Blinn-Phong\0\0");
 
         // Cook-Torrance options.
-        if (graphics->m_direct_specular_brdf == direct_specular_brdf::cook_torrance)
+        if (state->m_direct_specular_brdf == direct_specular_brdf::cook_torrance)
         {
-            ImGui::Combo("Specular shading", (int *)&graphics->specular_shading,
+            ImGui::Combo("Specular shading", (int *)&state->specular_shading,
                          "All combined\0Distribution of normals\0Fresnel\0Geometric attenuation\0Distribution of visible normals\0\0");
         }
     }
 
     ImGui::Spacing();
-    ImGui::Checkbox("Draw as billboards", &graphics->draw_billboards);
-    ImGui::Checkbox("Draw bounds", &graphics->is_drawing_bounds);
+    ImGui::Checkbox("Draw as billboards", &state->draw_billboards);
+    ImGui::Checkbox("Draw bounds", &state->is_drawing_bounds);
+    ImGui::Spacing();
+
+    // Compiled schedule of the last frame.
+    if (ImGui::CollapsingHeader("Render graph", ImGuiTreeNodeFlags_None))
+    {
+        if (ImGui::Button("Copy schedule"))
+        {
+            ImGui::SetClipboardText(graphics->m_render_graph_report.c_str());
+        }
+        ImGui::TextUnformatted(graphics->m_render_graph_report.c_str());
+    }
+    if (ImGui::CollapsingHeader("Transient memory", ImGuiTreeNodeFlags_None))
+    {
+        ImGui::TextUnformatted(graphics->m_transient_report.c_str());
+    }
+
+    // Usage and budget of the adapter, and the resources and heaps of the renderer by category.
+    if (ImGui::CollapsingHeader("GPU memory", ImGuiTreeNodeFlags_None))
+    {
+        ComPtr<IDXGIAdapter4> adapter;
+        if (SUCCEEDED(graphics->m_gpu.m_adapter.As(&adapter)))
+        {
+            imgui_gpu_memory(adapter.Get());
+        }
+    }
+
+    // Submissions of the last frame with the fence values they signal and wait for, and the command list pools.
+    if (ImGui::CollapsingHeader("GPU queues", ImGuiTreeNodeFlags_None))
+    {
+        ImGui::TextUnformatted(graphics->m_queue_report.c_str());
+        ImGui::TextUnformatted(graphics->m_list_pools_report.c_str());
+    }
+
+    // CPU time spent recording the geometry pass, one chunk per job.
+    if (ImGui::CollapsingHeader("Geometry recording", ImGuiTreeNodeFlags_None))
+    {
+        ImGui::SliderInt("Geometry jobs", &state->num_geometry_chunks, 1, particles_graphics::max_geometry_chunks);
+        ImGui::TextUnformatted(graphics->m_geometry_report.c_str());
+    }
+
+    // CPU frame time and input latency, with and without the overlap of the update and the recording.
+    if (ImGui::CollapsingHeader("Frame latency", ImGuiTreeNodeFlags_None))
+    {
+        ImGui::Checkbox("Update the next frame during recording", &graphics->m_overlap_update);
+        ImGui::SliderInt("Frames in flight", &graphics->m_frames_in_flight, 1, gpu_interface::MAX_FRAMES_IN_FLIGHT);
+        ImGui::Checkbox("Low latency: wait for the GPU before sampling the input", &graphics->m_is_low_latency);
+        ImGui::Text("Last frame: CPU wait %f ms, input to present %f ms", graphics->m_cpu_wait_ms, graphics->m_input_to_present_ms);
+        const char *mode_names[] = {"Sequential", "Overlapped"};
+        for (int mode = 0; mode < _countof(graphics->m_latency_stats); mode++)
+        {
+            const frame_latency_stats &stats = graphics->m_latency_stats[mode];
+            double num_frames = (std::max)((double)stats.num_frames, 1.0);
+            ImGui::Text("%s: %u frames, CPU frame %f ms, task graph %f ms, CPU wait %f ms, input to present %f ms", mode_names[mode],
+                        stats.num_frames, stats.total_frame_ms / num_frames, stats.total_work_ms / num_frames,
+                        stats.total_wait_ms / num_frames, stats.total_latency_ms / num_frames);
+        }
+        if (ImGui::Button("Reset averages"))
+        {
+            graphics->m_latency_stats[0] = {};
+            graphics->m_latency_stats[1] = {};
+        }
+
+        // The same fence logic on a simulated GPU, for every setting.
+        if (ImGui::TreeNode("Simulation"))
+        {
+            frame_pacing_config *config = &graphics->m_pacing_config;
+            const double min_ms = 0.0;
+            const double max_ms = 33.0;
+            ImGui::SliderScalar("CPU update ms", ImGuiDataType_Double, &config->update_ms, &min_ms, &max_ms, "%.1f");
+            ImGui::SliderScalar("CPU recording ms", ImGuiDataType_Double, &config->record_ms, &min_ms, &max_ms, "%.1f");
+            ImGui::SliderScalar("GPU ms", ImGuiDataType_Double, &config->gpu_ms, &min_ms, &max_ms, "%.1f");
+            ImGui::SliderScalar("CPU recording jitter ms", ImGuiDataType_Double, &config->record_jitter_ms, &min_ms, &max_ms, "%.1f");
+            for (int is_low_latency = 0; is_low_latency < 2; is_low_latency++)
+            {
+                for (UINT frames_in_flight = 1; frames_in_flight <= gpu_interface::MAX_FRAMES_IN_FLIGHT; frames_in_flight++)
+                {
+                    frame_pacing_config simulated = *config;
+                    simulated.frames_in_flight = frames_in_flight;
+                    simulated.is_low_latency = is_low_latency != 0;
+                    frame_pacing_result result = simulate_frame_pacing(simulated);
+                    ImGui::Text("%u frames%s: frame %.1f ms, CPU wait %.1f ms, input to present %.1f ms, to GPU done %.1f ms, "
+                                "present interval p99 %.1f ms, jitter %.1f ms",
+                                frames_in_flight, is_low_latency ? ", low latency" : "", result.frame_ms, result.cpu_wait_ms,
+                                result.input_to_present_ms, result.input_to_gpu_done_ms, result.present_interval_p99_ms,
+                                result.present_jitter_ms);
+                }
+            }
+            ImGui::TreePop();
+        }
+    }
+
+    // CPU tasks of the last frame, with their dependencies and timings.
+    if (ImGui::CollapsingHeader("Frame tasks", ImGuiTreeNodeFlags_None))
+    {
+        if (ImGui::Button("Copy DOT"))
+        {
+            ImGui::SetClipboardText(graphics->m_frame_tasks_dot.c_str());
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Copy JSON"))
+        {
+            ImGui::SetClipboardText(graphics->m_frame_tasks_json.c_str());
+        }
+        ImGui::TextUnformatted(graphics->m_frame_tasks_report.c_str());
+    }
+
+    // Cost of the upload buffer allocations when several threads record at the same time.
+    if (ImGui::CollapsingHeader("Upload staging", ImGuiTreeNodeFlags_None))
+    {
+        if (ImGui::Button("Run contention benchmark"))
+        {
+            graphics->m_run_upload_benchmark = true;
+        }
+        ImGui::TextUnformatted(graphics->m_upload_benchmark_report.c_str());
+    }
+
+    // Time for a parked or spinning thread to wake up, with the events the job system and the frame loop use.
+    if (ImGui::CollapsingHeader("Thread wakeups", ImGuiTreeNodeFlags_None))
+    {
+        if (ImGui::Button("Run wakeup benchmark"))
+        {
+            graphics->m_run_wakeup_benchmark = true;
+        }
+        ImGui::TextUnformatted(graphics->m_wakeup_benchmark_report.c_str());
+    }
+
+    // Scopes of the frame tasks, the timed passes and the frame loop, per thread.
+    if (ImGui::CollapsingHeader("CPU profiler", ImGuiTreeNodeFlags_None))
+    {
+        if (ImGui::Button("Copy"))
+        {
+            ImGui::SetClipboardText(graphics->m_cpu_profile_report.c_str());
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Measure scope cost"))
+        {
+            graphics->m_run_profile_benchmark = true;
+        }
+        ImGui::TextUnformatted(graphics->m_profile_benchmark_report.c_str());
+        ImGui::TextUnformatted(graphics->m_cpu_profile_report.c_str());
+    }
+
+    // CPU scopes per thread and GPU timers per queue of a few frames, for chrome://tracing or ui.perfetto.dev.
+    if (ImGui::CollapsingHeader("Trace capture", ImGuiTreeNodeFlags_None))
+    {
+        ImGui::SliderInt("Frames", &graphics->m_trace_frames, 1, 60);
+        ImGui::Combo("Format", &graphics->m_trace_format, "Chrome JSON\0Perfetto protobuf\0\0");
+        if (ImGui::Button("Capture trace"))
+        {
+            graphics->m_start_trace = true;
+        }
+        ImGui::TextUnformatted(graphics->m_trace_report.c_str());
+    }
+
+    // CPU cost of the frame loop without the GPU, with the draws, barriers, descriptor copies and uploads per pass.
+    if (ImGui::CollapsingHeader("Headless recording", ImGuiTreeNodeFlags_None))
+    {
+        if (ImGui::Button("Run headless frames"))
+        {
+            graphics->m_run_headless_benchmark = true;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Capture and replay a frame"))
+        {
+            graphics->m_run_headless_benchmark = true;
+            graphics->m_capture_headless_frame = true;
+        }
+        ImGui::TextUnformatted(graphics->m_headless_report.c_str());
+    }
     ImGui::Spacing();
 
     // Particle systems and their lights.
@@ -99,7 +391,7 @@ void ui_context::draw(particles_graphics *graphics)
     for (int i = 0; i < num_particle_systems; i++)
     {
         ImGui::PushID(i);
-        particle_system_info *ps_info = &graphics->particle_systems_infos[i];
+        particle_system_info *ps_info = &state->particle_systems_infos[i];
         std::string header_title = "Particle system " + std::to_string(ps_info->particle_system_index);
         if (ImGui::CollapsingHeader(header_title.c_str(), ImGuiTreeNodeFlags_None))
         {
@@ -132,7 +424,7 @@ void ui_context::draw(particles_graphics *graphics)
             }
 
             // Volume light data.
-            volume_light *vl = &graphics->volume_lights[i];
+            frame_state::volume_light_state *vl = &state->volume_lights[i];
             ImGui::SliderFloat("Volume light radius", &vl->m_radius, 0.02f, 2.5f);
             ImGui::Combo("Blending mode", (int *)&vl->m_blend_mode, "Alpha transparency\0Additive transparency\0\0");
             float vlight_color[4] = {vl->m_color.x, vl->m_color.y, vl->m_color.z, vl->m_color.w};
@@ -147,7 +439,7 @@ void ui_context::draw(particles_graphics *graphics)
             ImGui::PopItemWidth();
 
             // Light data.
-            attractor_point_light *attractor = &graphics->attractors[i];
+            attractor_point_light *attractor = &state->attractors[i];
             point_light *light = &attractor->light;
 
             // Falloff start.
@@ -197,10 +489,10 @@ void ui_context::draw(particles_graphics *graphics)
 
     // Spot lights data.
     ImGui::Text("Spot lights");
-    for (int i = 0; i < _countof(graphics->spotlights); i++)
+    for (int i = 0; i < _countof(state->spotlights); i++)
     {
         ImGui::PushID(i);
-        spot_light *spot_light = &graphics->spotlights[i];
+        spot_light *spot_light = &state->spotlights[i];
 
         std::string header_title = "Spot light " + std::to_string(spot_light->id);
         if (ImGui::CollapsingHeader(header_title.c_str(), ImGuiTreeNodeFlags_None))
@@ -249,10 +541,9 @@ void ui_context::draw(particles_graphics *graphics)
     ImGui::Text("Render objects");
 
     int ro_id = 0;
-    for (auto &ro_pair : graphics->m_render_objects)
+    for (frame_state::render_object_state &ro : state->render_objects)
     {
-        std::string ro_name = ro_pair.first;
-        render_object &ro = ro_pair.second;
+        const std::string &ro_name = *ro.name;
         transform *ro_transform = &ro.m_transform;
 
         ImGui::PushID(ro_id);
@@ -295,7 +586,7 @@ void ui_context::draw(particles_graphics *graphics)
 
     ImGui::Spacing();
     ImGui::Text("Camera");
-    camera *cam = graphics->get_camera();
+    camera *cam = &state->cameras[state->selected_cam];
 
     float cam_pos[3] = {cam->m_transform.m_translation.x, cam->m_transform.m_translation.y, cam->m_transform.m_translation.z};
     if (ImGui::SliderFloat3("Position", cam_pos, -100.f, 100.f))
@@ -1,8 +1,10 @@
 #pragma once
 struct particles_graphics;
+struct frame_state;
 
 class ui_context
 {
 public:
-    static void draw(particles_graphics *app_graphics);
+    // Edits the state written by the update of the frame, see frame_state.
+    static void draw(particles_graphics *app_graphics, frame_state *state);
 };
@@ -0,0 +1,41 @@
+// Replays a command capture on the null backend and reports the CPU cost of each command type.
+//   replay <capture file> [frames]
+// Captures come from the "Headless recording" panel of the particles sample, which records its frame on the null backend.
+// Only the portable files of common are used, on other platforms build it with them:
+//   replay.cpp command_capture.cpp command_recorder.cpp resource_state_tracker.cpp cpu_profiler.cpp frame_stalls.cpp
+//   platform.cpp rolling_stats.cpp json.cpp
+#include "command_capture.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static int print_usage()
+{
+    printf("usage: replay <capture file> [frames]\n");
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        return print_usage();
+    }
+
+    std::string error;
+    command_capture capture;
+    const char *path = argv[1];
+    uint32_t num_frames = argc > 2 ? (uint32_t)atoi(argv[2]) : 100;
+    if (!capture.load(path, &error))
+    {
+        printf("%s\n", error.c_str());
+        return 1;
+    }
+
+    null_device device;
+    null_queue graphics_queue;
+    null_queue compute_queue;
+    recording_queue *queues[] = {&graphics_queue, &compute_queue};
+    replay_stats stats = replay_capture(capture, &device, queues, 2, num_frames);
+    printf("%s\n", dump_replay_stats(stats).c_str());
+    return stats.error.empty() ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+#include "unit_test.h"
+#include "clock_correlation.h"
+#include <math.h>
+#include <stdlib.h>
+
+// One sample every interval GPU ticks, with cpu - cpu_start = rate * (gpu - gpu_start), plus and minus the jitter
+// in turn.
+static void add_samples(clock_correlation *correlation, uint64_t gpu_start, uint64_t cpu_start, double rate, uint64_t interval,
+                        uint32_t count, double jitter = 0.0)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint64_t gpu = gpu_start + i * interval;
+        double noise = (i % 2 == 0) ? jitter : -jitter;
+        uint64_t cpu = cpu_start + (uint64_t)llround(rate * (double)(i * interval) + noise);
+        correlation->add_sample(gpu, cpu);
+    }
+}
+
+UNIT_TEST(clock_correlation_uses_the_nominal_rate_with_one_sample)
+{
+    clock_correlation correlation;
+    correlation.set_frequencies(25000000.0, 10000000.0);
+    CHECK(!correlation.is_calibrated());
+    CHECK_NEAR(correlation.rate(), 0.4, 1e-12);
+
+    correlation.add_sample(1000, 5000);
+    CHECK(correlation.is_calibrated());
+    CHECK_EQ(correlation.gpu_to_cpu(1000), 5000ull);
+    CHECK_EQ(correlation.gpu_to_cpu(1250), 5100ull);
+    CHECK_EQ(correlation.gpu_to_cpu(500), 4800ull);
+    CHECK_NEAR(correlation.drift_ppm(), 0.0, 1e-9);
+}
+
+UNIT_TEST(clock_correlation_measures_the_drift)
+{
+    // The CPU clock runs 50 ppm faster than the frequencies say.
+    clock_correlation correlation;
+    correlation.set_frequencies(25000000.0, 10000000.0);
+    double rate = 0.4 * (1.0 + 50e-6);
+    uint64_t interval = 25000000; // One second.
+    add_samples(&correlation, 1ull << 40, 1ull << 50, rate, interval, 8);
+
+    CHECK_NEAR(correlation.drift_ppm(), 50.0, 0.01);
+    CHECK(correlation.max_residual() <= 0.5 + 1e-6);
+
+    // Ten seconds after the last sample the nominal rate would be 200 ticks off.
+    uint64_t last_gpu = (1ull << 40) + 7 * interval;
+    uint64_t gpu = last_gpu + 10 * interval;
+    uint64_t expected = (1ull << 50) + (uint64_t)llround(rate * (double)(17 * interval));
+    CHECK(llabs((long long)(correlation.gpu_to_cpu(gpu) - expected)) <= 1);
+}
+
+UNIT_TEST(clock_correlation_averages_the_jitter_of_the_samples)
+{
+    clock_correlation correlation;
+    correlation.set_frequencies(1000000.0, 1000000.0);
+    add_samples(&correlation, 0, 0, 1.0 + 20e-6, 100000, 16, 3.0);
+
+    // The fit goes between the samples, a pair of samples alone would be off by 6 ticks over 100000.
+    CHECK_NEAR(correlation.drift_ppm(), 20.0, 10.0);
+    CHECK(correlation.max_residual() <= 3.0 + 1.0);
+
+    uint64_t gpu = 15 * 100000 + 50000;
+    double exact = (1.0 + 20e-6) * (double)gpu;
+    CHECK(fabs((double)correlation.gpu_to_cpu(gpu) - exact) <= 4.0);
+}
+
+UNIT_TEST(clock_correlation_handles_timestamps_that_wrap)
+{
+    clock_correlation correlation;
+    correlation.set_frequencies(1000.0, 2000.0);
+    uint64_t gpu_start = ~0ull - 2500;
+    uint64_t cpu_start = ~0ull - 100;
+    add_samples(&correlation, gpu_start, cpu_start, 2.0, 1000, 6);
+
+    CHECK_NEAR(correlation.rate(), 2.0, 1e-9);
+    CHECK_EQ(correlation.gpu_to_cpu(gpu_start + 1000), cpu_start + 2000);
+    CHECK_EQ(correlation.gpu_to_cpu(gpu_start + 7000), cpu_start + 14000);
+}
+
+UNIT_TEST(clock_correlation_rejects_rates_far_from_the_nominal_one)
+{
+    // The CPU clock jumped between the samples, the measured rate is off by 50%.
+    clock_correlation correlation(4);
+    correlation.set_frequencies(1000.0, 1000.0);
+    correlation.add_sample(0, 0);
+    correlation.add_sample(1000, 1500);
+    CHECK_NEAR(correlation.rate(), 1.0, 1e-12);
+
+    // Once the samples before the jump leave the window, the rate is measured again.
+    add_samples(&correlation, 2000, 2500, 1.0 + 100e-6, 1000000, 4);
+    CHECK_EQ(correlation.num_samples(), 4u);
+    CHECK_NEAR(correlation.drift_ppm(), 100.0, 1.0);
+
+    correlation.set_frequencies(1000.0, 1000.0);
+    CHECK_EQ(correlation.num_samples(), 0u);
+    CHECK_NEAR(correlation.rate(), 1.0, 1e-12);
+}
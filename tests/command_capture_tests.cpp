@@ -0,0 +1,153 @@
+#include "unit_test.h"
+#include "command_capture.h"
+#include <stdio.h>
+
+static const char *capture_path = "command_capture_tests.cmds";
+
+// A frame of two passes on the direct queue and a compute list on the other queue.
+static void record_frame(recording_device *device, recording_queue *direct_queue, recording_queue *compute_queue)
+{
+    command_recorder *recorder = device->create_recorder(false);
+    recorder->begin(0x1000);
+    recorder->begin_pass("Shadows");
+    recorder->set_primitive_topology(topology_triangle_list);
+    recorder->transition(0x80, 0x10, {0x2000}); // PIXEL_SHADER_RESOURCE to DEPTH_WRITE.
+    recorder->require_state(0x2000, 0x20);      // DEPTH_READ, from the state set by the transition.
+    recorder->flush_barriers();
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        float constants[16] = {(float)i};
+        recorder->set_root_constant_buffer(10, recorder->upload(constants, sizeof(constants), 256));
+        recorder->draw_indexed(36, 1, i * 36, 0, 0);
+    }
+    recorder->end_pass();
+    recorder->begin_pass("Lighting");
+    recorder->stage_descriptor(4, 1, 0, 0x3000);
+    recorder->set_descriptor_tables();
+    recorder->draw(3, 1, 0, 0);
+    recorder->record_native([](void *native_list) { (void)native_list; });
+    recorder->end_pass();
+    recorder->end();
+    direct_queue->execute(&recorder, 1);
+
+    command_recorder *compute = device->create_recorder(true);
+    compute->begin();
+    compute->begin_pass("Simulation");
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        compute->dispatch(64, 1, 1);
+    }
+    compute->end_pass();
+    compute->end();
+    compute_queue->execute(&compute, 1);
+}
+
+UNIT_TEST(command_capture_survives_a_save_and_load)
+{
+    null_device device;
+    null_queue queues[2];
+    command_capture capture;
+    capture_queue direct(&queues[0], &capture, 0);
+    capture_queue compute(&queues[1], &capture, 1);
+    record_frame(&device, &direct, &compute);
+
+    // The capture queues pass the lists on.
+    CHECK_EQ(queues[0].m_num_lists, 1ull);
+    CHECK_EQ(queues[1].m_num_lists, 1ull);
+    CHECK_EQ(capture.num_submissions(), 2u);
+    CHECK_EQ(capture.lists().size(), (size_t)2);
+    CHECK_EQ(capture.size_bytes(), queues[0].m_stream_bytes + queues[1].m_stream_bytes);
+
+    std::string error;
+    CHECK(capture.save(capture_path, &error));
+    command_capture loaded;
+    CHECK(loaded.load(capture_path, &error));
+    CHECK(error.empty());
+    CHECK_EQ(loaded.num_submissions(), capture.num_submissions());
+    CHECK_EQ(loaded.lists().size(), capture.lists().size());
+    for (size_t i = 0; i < loaded.lists().size() && i < capture.lists().size(); i++)
+    {
+        const captured_list &a = capture.lists()[i];
+        const captured_list &b = loaded.lists()[i];
+        CHECK_EQ(a.queue, b.queue);
+        CHECK_EQ(a.submission, b.submission);
+        CHECK_EQ(a.is_compute, b.is_compute);
+        CHECK(a.bytes == b.bytes);
+    }
+    CHECK(loaded.lists()[1].is_compute);
+
+    // A truncated file is rejected and leaves the capture empty.
+    std::vector<char> bytes(1 << 16);
+    FILE *file = fopen(capture_path, "rb");
+    CHECK(file != nullptr);
+    if (file)
+    {
+        bytes.resize(fread(bytes.data(), 1, bytes.size(), file));
+        fclose(file);
+        file = fopen(capture_path, "wb");
+        fwrite(bytes.data(), 1, bytes.size() - 8, file);
+        fclose(file);
+    }
+    CHECK(!loaded.load(capture_path, &error));
+    CHECK(error.find("truncated") != std::string::npos);
+    CHECK_EQ(loaded.lists().size(), (size_t)0);
+    remove(capture_path);
+}
+
+UNIT_TEST(command_capture_replay_reproduces_the_commands)
+{
+    null_device device;
+    null_queue queues[2];
+    command_capture capture;
+    capture_queue direct(&queues[0], &capture, 0);
+    capture_queue compute(&queues[1], &capture, 1);
+    record_frame(&device, &direct, &compute);
+
+    // Replaying a stream on a fresh null backend records the same bytes, upload addresses included.
+    null_device replay_device;
+    for (const captured_list &list : capture.lists())
+    {
+        null_command_recorder *recorder = static_cast<null_command_recorder *>(replay_device.create_recorder(list.is_compute));
+        recorder->begin();
+        CHECK(replay_stream(list.bytes.data(), list.bytes.size(), recorder));
+        recorder->end();
+        CHECK(recorder->stream().size() == list.bytes.size());
+        CHECK(std::vector<uint8_t>(recorder->stream().data(), recorder->stream().data() + recorder->stream().size()) == list.bytes);
+    }
+
+    // The replayed frames count the same commands per pass as the capture.
+    const uint32_t num_frames = 3;
+    null_queue replay_queues[2];
+    recording_queue *queue_pointers[] = {&replay_queues[0], &replay_queues[1]};
+    replay_stats stats = replay_capture(capture, &replay_device, queue_pointers, 2, num_frames);
+    CHECK(stats.error.empty());
+    CHECK_EQ(stats.num_frames, num_frames);
+    CHECK_EQ(stats.num_lists, 2u);
+    CHECK_EQ(stats.stream_bytes, capture.size_bytes());
+    CHECK_EQ(replay_queues[0].m_num_submissions, 2ull * num_frames);
+    CHECK_EQ(replay_queues[1].m_num_submissions, 2ull * num_frames);
+
+    // Timed frames only.
+    CHECK_EQ(stats.commands[recorded_draw_indexed].count, 3ull * num_frames);
+    CHECK_EQ(stats.commands[recorded_dispatch].count, 4ull * num_frames);
+    CHECK_EQ(stats.commands[recorded_native].count, 1ull * num_frames);
+    CHECK_EQ(stats.commands[recorded_upload].count, 3ull * num_frames);
+
+    CHECK_EQ(stats.passes.size(), (size_t)4);
+    const char *names[] = {"", "Shadows", "Lighting", "Simulation"};
+    for (size_t i = 0; i < stats.passes.size() && i < 4; i++)
+    {
+        CHECK(stats.passes[i].name == names[i]);
+    }
+    if (stats.passes.size() == 4)
+    {
+        // The pipeline of begin() is in the unnamed pass.
+        CHECK_EQ(stats.passes[0].num_commands, 1u);
+        CHECK_EQ(stats.passes[1].num_draws, 3u);
+        CHECK_EQ(stats.passes[1].num_barriers, 2u);
+        CHECK_EQ(stats.passes[1].upload_bytes, 3ull * 64);
+        CHECK_EQ(stats.passes[2].num_draws, 1u);
+        CHECK_EQ(stats.passes[2].num_descriptor_copies, 1u);
+        CHECK_EQ(stats.passes[3].num_dispatches, 4u);
+    }
+}
@@ -0,0 +1,121 @@
+#include "unit_test.h"
+#include "fenced_free_list.h"
+
+// Fences of the tests, the completed value of each is read from the array.
+struct test_fences
+{
+    uint64_t completed[2] = {};
+    uint32_t num_reads = 0;
+
+    uint64_t operator()(const void *fence)
+    {
+        num_reads++;
+        return completed[(const uint64_t *)fence - completed];
+    }
+};
+
+UNIT_TEST(fenced_free_list_waits_for_the_fence_value)
+{
+    fenced_free_list list;
+    test_fences fences;
+    list.add(0);
+    list.add(1);
+
+    size_t index = 0;
+    CHECK(list.acquire(&index));
+    CHECK_EQ(index, (size_t)1);
+    list.submitted(index, &fences.completed[0], 5);
+    CHECK(list.acquire(&index));
+    CHECK_EQ(index, (size_t)0);
+    list.submitted(index, &fences.completed[0], 6);
+
+    // Not handed out again before the fence reaches its value.
+    for (uint64_t value = 0; value < 5; value++)
+    {
+        fences.completed[0] = value;
+        list.recycle([&](const void *fence) { return fences(fence); });
+        CHECK(!list.acquire(&index));
+        CHECK_EQ(list.num_in_flight(), (size_t)2);
+    }
+
+    fences.completed[0] = 5;
+    list.recycle([&](const void *fence) { return fences(fence); });
+    CHECK(list.acquire(&index));
+    CHECK_EQ(index, (size_t)1);
+    CHECK(!list.acquire(&index));
+
+    // Past the value is free as well.
+    fences.completed[0] = 9;
+    list.recycle([&](const void *fence) { return fences(fence); });
+    CHECK(list.acquire(&index));
+    CHECK_EQ(index, (size_t)0);
+    CHECK_EQ(list.num_in_flight(), (size_t)0);
+}
+
+UNIT_TEST(fenced_free_list_hands_out_the_most_recently_freed_first)
+{
+    fenced_free_list list;
+    test_fences fences;
+    for (size_t i = 0; i < 3; i++)
+    {
+        list.add(i);
+    }
+    size_t index = 0;
+    for (size_t i = 0; i < 3; i++)
+    {
+        CHECK(list.acquire(&index));
+        list.submitted(index, &fences.completed[0], 1 + i);
+    }
+
+    // 2, 1 and 0 were submitted with the values 1, 2 and 3, the first one to complete is reused last.
+    fences.completed[0] = 1;
+    list.recycle([&](const void *fence) { return fences(fence); });
+    fences.completed[0] = 3;
+    list.recycle([&](const void *fence) { return fences(fence); });
+    CHECK_EQ(list.num_free(), (size_t)3);
+    CHECK(list.acquire(&index));
+    size_t first = index;
+    CHECK(list.acquire(&index));
+    size_t second = index;
+    CHECK(list.acquire(&index));
+    CHECK_EQ(index, (size_t)2);
+    CHECK(first != second && first != 2 && second != 2);
+}
+
+UNIT_TEST(fenced_free_list_reads_each_fence_once_per_run)
+{
+    fenced_free_list list;
+    test_fences fences;
+    for (size_t i = 0; i < 6; i++)
+    {
+        list.add(i);
+    }
+
+    // Two lists of the first queue, then three of the second, then one of the first.
+    const uint64_t *queue_fences[] = {&fences.completed[0], &fences.completed[0], &fences.completed[1],
+                                      &fences.completed[1], &fences.completed[1], &fences.completed[0]};
+    const uint64_t values[] = {1, 2, 1, 1, 3, 2};
+    size_t index = 0;
+    for (size_t i = 0; i < 6; i++)
+    {
+        CHECK(list.acquire(&index));
+        list.submitted(index, queue_fences[i], values[i]);
+    }
+    list.recycle([&](const void *fence) { return fences(fence); });
+    CHECK_EQ(fences.num_reads, 3u);
+    CHECK_EQ(list.num_free(), (size_t)0);
+
+    // Each fence frees its own lists only, the runs are the same.
+    fences.num_reads = 0;
+    fences.completed[0] = 2;
+    fences.completed[1] = 1;
+    list.recycle([&](const void *fence) { return fences(fence); });
+    CHECK_EQ(list.num_free(), (size_t)5);
+    CHECK_EQ(list.num_in_flight(), (size_t)1);
+    CHECK_EQ(fences.num_reads, 3u);
+
+    list.clear();
+    CHECK_EQ(list.num_free(), (size_t)0);
+    CHECK_EQ(list.num_in_flight(), (size_t)0);
+    CHECK(!list.acquire(&index));
+}
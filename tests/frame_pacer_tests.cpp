@@ -0,0 +1,116 @@
+#include "unit_test.h"
+#include "frame_pacer.h"
+
+UNIT_TEST(frame_pacer_waits_for_the_last_user_of_the_frame_resource)
+{
+    frame_pacer pacer;
+    pacer.set_frames_in_flight(3);
+    CHECK_EQ(pacer.frame_wait_value(), 0ull);
+
+    CHECK_EQ(pacer.end_frame(), 1ull);
+    CHECK_EQ(pacer.end_frame(), 2ull);
+    CHECK_EQ(pacer.end_frame(), 3ull);
+
+    // The fourth frame reuses the resource of the first one.
+    CHECK_EQ(pacer.frame_index(), 0u);
+    CHECK_EQ(pacer.frame_wait_value(), 1ull);
+    CHECK_EQ(pacer.end_frame(), 4ull);
+    CHECK_EQ(pacer.frame_wait_value(), 2ull);
+    CHECK_EQ(pacer.frame_number(), 4ull);
+
+    // The flush values are never waited for by a frame.
+    CHECK_EQ(pacer.flush_value(), 5ull);
+    CHECK_EQ(pacer.end_frame(), 6ull);
+    CHECK_EQ(pacer.frame_wait_value(), 3ull);
+}
+
+UNIT_TEST(frame_pacer_restarts_when_the_frames_in_flight_change)
+{
+    frame_pacer pacer;
+    pacer.end_frame();
+    pacer.end_frame();
+
+    // Every frame resource waits for the work submitted before the change.
+    pacer.set_frames_in_flight(2);
+    CHECK_EQ(pacer.frame_index(), 0u);
+    CHECK_EQ(pacer.frame_wait_value(), 2ull);
+    pacer.end_frame();
+    CHECK_EQ(pacer.frame_wait_value(), 2ull);
+    pacer.end_frame();
+    CHECK_EQ(pacer.frame_wait_value(), 3ull);
+
+    pacer.set_frames_in_flight(0);
+    CHECK_EQ(pacer.frames_in_flight(), 1u);
+    pacer.set_frames_in_flight(10);
+    CHECK_EQ(pacer.frames_in_flight(), frame_pacer::max_frames_in_flight);
+}
+
+UNIT_TEST(simulated_gpu_runs_the_submissions_in_order)
+{
+    simulated_gpu gpu;
+    gpu.submit(0.0, 5.0, 1);
+    gpu.submit(2.0, 3.0, 2); // Starts when the first one is done.
+    gpu.submit(20.0, 1.0, 3); // Starts when it is submitted.
+
+    CHECK_EQ(gpu.completed_value(4.0), 0ull);
+    CHECK_EQ(gpu.completed_value(5.0), 1ull);
+    CHECK_EQ(gpu.completed_value(8.0), 2ull);
+    CHECK_EQ(gpu.completed_value(20.5), 2ull);
+    CHECK_EQ(gpu.completed_value(21.0), 3ull);
+
+    CHECK_NEAR(gpu.completion_time(2, 0.0), 8.0, 1e-9);
+    CHECK_NEAR(gpu.completion_time(1, 6.0), 6.0, 1e-9);
+    CHECK_NEAR(gpu.completion_time(4, 7.0), 7.0, 1e-9);
+}
+
+UNIT_TEST(simulate_frame_pacing_follows_the_slowest_processor)
+{
+    // GPU bound: the CPU waits for the GPU, which is never idle.
+    frame_pacing_config config;
+    frame_pacing_result gpu_bound = simulate_frame_pacing(config);
+    CHECK_NEAR(gpu_bound.frame_ms, config.gpu_ms, 1e-6);
+    CHECK_NEAR(gpu_bound.cpu_wait_ms, config.gpu_ms - config.update_ms - config.record_ms, 1e-6);
+    CHECK_NEAR(gpu_bound.present_interval_p99_ms, config.gpu_ms, 1e-3);
+    CHECK_NEAR(gpu_bound.present_jitter_ms, 0.0, 1e-6);
+
+    // CPU bound: the CPU never waits.
+    config.gpu_ms = 3.0;
+    frame_pacing_result cpu_bound = simulate_frame_pacing(config);
+    CHECK_NEAR(cpu_bound.frame_ms, config.update_ms + config.record_ms, 1e-6);
+    CHECK_NEAR(cpu_bound.cpu_wait_ms, 0.0, 1e-6);
+    CHECK_NEAR(cpu_bound.input_to_present_ms, config.update_ms + config.record_ms, 1e-6);
+
+    // With one frame in flight the recording waits for the GPU to finish the previous frame.
+    config.gpu_ms = 8.0;
+    config.frames_in_flight = 1;
+    frame_pacing_result serialized = simulate_frame_pacing(config);
+    CHECK_NEAR(serialized.frame_ms, config.gpu_ms + config.record_ms, 1e-6);
+}
+
+UNIT_TEST(simulate_frame_pacing_low_latency_samples_the_input_after_the_wait)
+{
+    frame_pacing_config config;
+    frame_pacing_result queued = simulate_frame_pacing(config);
+    config.is_low_latency = true;
+    frame_pacing_result low_latency = simulate_frame_pacing(config);
+
+    // The same frame rate, but the input no longer waits in the queue of frames.
+    CHECK_NEAR(low_latency.frame_ms, queued.frame_ms, 1e-6);
+    CHECK_NEAR(low_latency.input_to_present_ms, config.update_ms + config.record_ms, 1e-6);
+    CHECK(queued.input_to_present_ms > low_latency.input_to_present_ms + 1.0);
+    CHECK(queued.input_to_gpu_done_ms > low_latency.input_to_gpu_done_ms + 1.0);
+}
+
+UNIT_TEST(simulate_frame_pacing_reports_the_recording_jitter)
+{
+    frame_pacing_config config;
+    config.gpu_ms = 3.0;
+    config.record_jitter_ms = 2.0;
+    frame_pacing_result result = simulate_frame_pacing(config);
+
+    // CPU bound, the present intervals vary with the recording time.
+    CHECK(result.present_jitter_ms > 0.1);
+    CHECK(result.present_interval_p99_ms > config.update_ms + config.record_ms);
+    CHECK(result.present_interval_p99_ms <= config.update_ms + config.record_ms + config.record_jitter_ms + 1e-6);
+    CHECK_NEAR(result.frame_ms, config.update_ms + config.record_ms, 0.5);
+}
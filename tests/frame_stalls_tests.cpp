@@ -0,0 +1,113 @@
+#include "unit_test.h"
+#include "frame_stalls.h"
+#include "platform.h"
+#include <string.h>
+#include <thread>
+
+UNIT_TEST(present_pacing_measures_the_intervals_and_their_jitter)
+{
+    // An even 20 ms has no jitter.
+    present_pacing even;
+    for (int i = 0; i < 10; i++)
+    {
+        even.add_present(100.0 + 20.0 * i);
+    }
+    frame_pacing_summary summary = even.summary();
+    CHECK_EQ(summary.interval.count, 9u);
+    CHECK_NEAR(summary.interval.mean, 20.0, 1e-9);
+    CHECK_EQ(summary.jitter.count, 8u);
+    CHECK_NEAR(summary.jitter.max, 0.0, 1e-9);
+
+    // Alternating 10 and 30 ms has the same mean interval and 20 ms of jitter.
+    present_pacing alternating;
+    double present_ms = 0.0;
+    for (int i = 0; i < 11; i++)
+    {
+        alternating.add_present(present_ms);
+        present_ms += (i % 2 == 0) ? 10.0 : 30.0;
+    }
+    summary = alternating.summary();
+    CHECK_NEAR(summary.interval.mean, 20.0, 1e-9);
+    CHECK_NEAR(summary.interval.min, 10.0, 1e-9);
+    CHECK_NEAR(summary.interval.max, 30.0, 1e-9);
+    CHECK_NEAR(summary.jitter.mean, 20.0, 1e-9);
+
+    // The first present after a reset has no interval.
+    alternating.set_window(16);
+    alternating.add_present(1000.0);
+    CHECK_EQ(alternating.summary().interval.count, 0u);
+    alternating.add_present(1016.0);
+    CHECK_NEAR(alternating.summary().interval.last, 16.0, 1e-9);
+    CHECK_EQ(alternating.summary().jitter.count, 0u);
+}
+
+UNIT_TEST(stall_tracker_totals_the_stalls_of_each_frame)
+{
+    stall_tracker tracker;
+    uint64_t start = tracker.begin_stall(stall_gpu_flush);
+    sleep_ms(5);
+    tracker.end_stall(stall_gpu_flush, start);
+    start = tracker.begin_stall(stall_gpu_flush);
+    tracker.end_stall(stall_gpu_flush, start);
+
+    tracker.end_frame(clock_ticks());
+    const stall_totals &flush = tracker.last_frame(stall_gpu_flush);
+    CHECK_EQ(flush.count, 2u);
+    CHECK(flush.total_ms >= 4.0);
+    CHECK(flush.max_ms >= 4.0);
+    CHECK(flush.max_ms <= flush.total_ms);
+    CHECK_EQ(tracker.last_frame(stall_present).count, 0u);
+
+    // The next frame starts from zero.
+    tracker.end_frame(clock_ticks());
+    CHECK_EQ(tracker.last_frame(stall_gpu_flush).count, 0u);
+    CHECK_NEAR(tracker.last_frame(stall_gpu_flush).total_ms, 0.0, 1e-12);
+
+    // The presents given to end_frame() are the pacing samples.
+    CHECK_EQ(tracker.pacing().interval.count, 1u);
+}
+
+UNIT_TEST(stall_tracker_counts_the_stalls_of_every_thread)
+{
+    stall_tracker tracker;
+    const int num_threads = 4;
+    const int num_stalls = 1000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++)
+    {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < num_stalls; i++)
+            {
+                tracker.end_stall(stall_job_wait, tracker.begin_stall(stall_job_wait));
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+
+    tracker.end_frame(clock_ticks());
+    const stall_totals &job_wait = tracker.last_frame(stall_job_wait);
+    CHECK_EQ(job_wait.count, (uint32_t)(num_threads * num_stalls));
+    CHECK(job_wait.max_ms <= job_wait.total_ms);
+}
+
+UNIT_TEST(stall_scope_is_a_profiler_scope_named_after_its_cause)
+{
+    g_cpu_profiler.end_frame();
+    {
+        stall_scope stall(stall_present);
+    }
+    const profile_frame &frame = g_cpu_profiler.end_frame();
+    bool is_found = false;
+    for (const profile_node &node : frame.nodes)
+    {
+        is_found |= strcmp(profile_event_name(node.event), "Stall: present") == 0 && node.calls == 1;
+    }
+    CHECK(is_found);
+
+    g_stall_tracker.end_frame(clock_ticks());
+    CHECK_EQ(g_stall_tracker.last_frame(stall_present).count, 1u);
+    CHECK(strcmp(stall_cause_name(stall_cause_count), "Stall: unknown") == 0);
+}
@@ -0,0 +1,89 @@
+#include "unit_test.h"
+#include "gpu_memory.h"
+
+static const uint64_t mb = 1024 * 1024;
+
+UNIT_TEST(gpu_memory_tracker_accounts_by_category)
+{
+    gpu_memory_tracker tracker;
+    CHECK(tracker.add(1, gpu_memory_textures, gpu_allocation_committed, "albedo", 4 * mb));
+    CHECK(tracker.add(2, gpu_memory_render_targets, gpu_allocation_committed, "gbuffer", 8 * mb));
+    CHECK(tracker.add(3, gpu_memory_transient, gpu_allocation_heap, "render graph heap", 16 * mb));
+
+    // The placed resources use the memory of their heap, only their placed bytes count.
+    CHECK(tracker.add(4, gpu_memory_render_targets, gpu_allocation_placed, "hdr", 6 * mb, 3));
+    CHECK(tracker.add(5, gpu_memory_render_targets, gpu_allocation_placed, "hdr aliased", 6 * mb, 3));
+
+    gpu_memory_usage render_targets = tracker.usage(gpu_memory_render_targets);
+    CHECK_EQ(render_targets.bytes, 8 * mb);
+    CHECK_EQ(render_targets.placed_bytes, 12 * mb);
+    CHECK_EQ(render_targets.count, 3u);
+    CHECK_EQ(tracker.usage(gpu_memory_transient).bytes, 16 * mb);
+    CHECK_EQ(tracker.usage(gpu_memory_meshes).count, 0u);
+
+    gpu_memory_usage total = tracker.total();
+    CHECK_EQ(total.bytes, 28 * mb);
+    CHECK_EQ(total.placed_bytes, 12 * mb);
+    CHECK_EQ(total.count, 5u);
+
+    // An id is only tracked once, with its first category.
+    CHECK(!tracker.add(1, gpu_memory_meshes, gpu_allocation_committed, "again", mb));
+    CHECK_EQ(tracker.usage(gpu_memory_textures).bytes, 4 * mb);
+    CHECK(!tracker.add(6, gpu_memory_category_count, gpu_allocation_committed, "invalid", mb));
+    CHECK_EQ(tracker.total().count, 5u);
+}
+
+UNIT_TEST(gpu_memory_tracker_keeps_the_peaks_until_reset)
+{
+    gpu_memory_tracker tracker;
+    tracker.add(1, gpu_memory_upload, gpu_allocation_committed, "ring", 32 * mb);
+    tracker.add(2, gpu_memory_upload, gpu_allocation_committed, "staging", 64 * mb);
+    CHECK(tracker.remove(2));
+    CHECK(!tracker.remove(2));
+
+    gpu_memory_usage upload = tracker.usage(gpu_memory_upload);
+    CHECK_EQ(upload.bytes, 32 * mb);
+    CHECK_EQ(upload.peak_bytes, 96 * mb);
+    CHECK_EQ(upload.count, 1u);
+    CHECK_EQ(upload.peak_count, 2u);
+    CHECK_EQ(tracker.total().peak_bytes, 96 * mb);
+
+    tracker.reset_peaks();
+    CHECK_EQ(tracker.usage(gpu_memory_upload).peak_bytes, 32 * mb);
+    CHECK_EQ(tracker.usage(gpu_memory_upload).peak_count, 1u);
+    CHECK_EQ(tracker.total().peak_bytes, 32 * mb);
+
+    // The placed bytes of a removed resource leave the category, the bytes of its heap stay.
+    tracker.add(3, gpu_memory_transient, gpu_allocation_heap, "heap", 8 * mb);
+    tracker.add(4, gpu_memory_transient, gpu_allocation_placed, "placed", 8 * mb, 3);
+    tracker.remove(4);
+    CHECK_EQ(tracker.usage(gpu_memory_transient).placed_bytes, 0ull);
+    CHECK_EQ(tracker.usage(gpu_memory_transient).bytes, 8 * mb);
+}
+
+UNIT_TEST(gpu_memory_tracker_lists_the_largest_allocations)
+{
+    gpu_memory_tracker tracker;
+    tracker.add(10, gpu_memory_meshes, gpu_allocation_committed, "sponza vertices", 2 * mb, 99);
+    tracker.add(11, gpu_memory_shadow_maps, gpu_allocation_committed, "spot shadows", 16 * mb);
+    tracker.add(12, gpu_memory_textures, gpu_allocation_committed, "b texture", 2 * mb);
+    tracker.add(13, gpu_memory_transient, gpu_allocation_heap, "heap", 32 * mb);
+    tracker.add(14, gpu_memory_transient, gpu_allocation_placed, "placed", 4 * mb, 13);
+
+    // Largest first, by name for equal sizes.
+    std::vector<gpu_allocation> allocations = tracker.allocations();
+    CHECK_EQ(allocations.size(), (size_t)5);
+    CHECK(allocations[0].name == "heap");
+    CHECK(allocations[1].name == "spot shadows");
+    CHECK(allocations[2].name == "placed");
+    CHECK_EQ(allocations[2].heap, 13ull);
+    CHECK(allocations[3].name == "b texture");
+    CHECK(allocations[4].name == "sponza vertices");
+    CHECK_EQ(allocations[4].heap, 0ull); // Only placed resources have a heap.
+
+    std::string dump = tracker.dump(2);
+    CHECK(dump.find("Shadow maps") != std::string::npos);
+    CHECK(dump.find("Largest 2 of 5 allocations") != std::string::npos);
+    CHECK(dump.find("spot shadows") != std::string::npos);
+    CHECK(dump.find("sponza vertices") == std::string::npos);
+}
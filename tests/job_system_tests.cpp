@@ -0,0 +1,128 @@
+#include "unit_test.h"
+#include "job_system.h"
+#include <thread>
+
+static void run_every_job_once(uint32_t num_workers)
+{
+    job_system jobs;
+    jobs.start(num_workers);
+    CHECK_EQ(jobs.num_threads(), num_workers + 1);
+
+    // More jobs than a pool block, so that the pools grow and recycle.
+    const uint32_t num_jobs = 3000;
+    std::vector<std::atomic<uint32_t>> runs(num_jobs);
+    for (int round = 0; round < 3; round++)
+    {
+        job_counter counter;
+        for (uint32_t i = 0; i < num_jobs; i++)
+        {
+            jobs.run([&runs, i]() { runs[i].fetch_add(1, std::memory_order_relaxed); }, &counter);
+        }
+        jobs.wait(&counter);
+        CHECK(counter.is_done());
+    }
+
+    for (uint32_t i = 0; i < num_jobs; i++)
+    {
+        CHECK_EQ(runs[i].load(), 3u);
+    }
+    CHECK_EQ(jobs.m_num_jobs.load(), (uint64_t)num_jobs * 3);
+    jobs.stop();
+}
+
+UNIT_TEST(job_system_runs_every_job_once_without_workers)
+{
+    run_every_job_once(0);
+}
+
+UNIT_TEST(job_system_runs_every_job_once_with_workers)
+{
+    run_every_job_once(3);
+}
+
+UNIT_TEST(job_system_parallel_for_covers_the_range)
+{
+    job_system jobs;
+    jobs.start(2);
+
+    const uint32_t count = 1000;
+    std::vector<std::atomic<uint32_t>> visits(count);
+    std::atomic<uint32_t> num_batches{0};
+    job_counter counter;
+    jobs.parallel_for(count, 64, [&](uint32_t begin, uint32_t end) {
+        num_batches.fetch_add(1);
+        for (uint32_t i = begin; i < end; i++)
+        {
+            visits[i].fetch_add(1, std::memory_order_relaxed);
+        }
+    }, &counter);
+    jobs.wait(&counter);
+
+    CHECK_EQ(num_batches.load(), 16u);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        CHECK_EQ(visits[i].load(), 1u);
+    }
+
+    // Nothing to split, nothing to run.
+    jobs.parallel_for(0, 64, [&](uint32_t, uint32_t) { num_batches.fetch_add(1); }, &counter);
+    CHECK(counter.is_done());
+    CHECK_EQ(num_batches.load(), 16u);
+    jobs.stop();
+}
+
+UNIT_TEST(job_system_waits_on_jobs_spawned_by_jobs)
+{
+    job_system jobs;
+    jobs.start(2);
+
+    std::atomic<uint32_t> num_leaves{0};
+    job_counter counter;
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        jobs.run([&]() {
+            // A job that waits runs the other jobs in the meantime instead of blocking its thread.
+            job_counter children;
+            for (uint32_t j = 0; j < 8; j++)
+            {
+                jobs.run([&]() { num_leaves.fetch_add(1); }, &children);
+            }
+            jobs.wait(&children);
+        }, &counter);
+    }
+    jobs.wait(&counter);
+    CHECK_EQ(num_leaves.load(), 64u);
+    jobs.stop();
+}
+
+UNIT_TEST(job_system_accepts_jobs_from_other_threads)
+{
+    job_system jobs;
+    jobs.start(2);
+
+    std::atomic<uint32_t> num_runs{0};
+    job_counter counter;
+    std::thread producer([&]() {
+        CHECK_EQ(job_system::thread_index(), 0u);
+        for (uint32_t i = 0; i < 500; i++)
+        {
+            jobs.run([&]() { num_runs.fetch_add(1); }, &counter);
+        }
+    });
+    producer.join();
+    jobs.wait(&counter);
+    CHECK_EQ(num_runs.load(), 500u);
+    jobs.stop();
+}
+
+UNIT_TEST(job_system_runs_inline_when_not_started)
+{
+    job_system jobs;
+    uint32_t num_runs = 0;
+    job_counter counter;
+    jobs.run([&]() { num_runs++; }, &counter);
+    jobs.parallel_for(10, 4, [&](uint32_t begin, uint32_t end) { num_runs += end - begin; }, &counter);
+    CHECK(counter.is_done());
+    CHECK_EQ(num_runs, 11u);
+    CHECK_EQ(jobs.m_num_inline.load(), 4ull);
+}
@@ -0,0 +1,166 @@
+#include "unit_test.h"
+#include "memory_aliasing.h"
+#include "render_graph.h"
+
+static const uint64_t kib = 1024;
+static const uint64_t mib = 1024 * 1024;
+
+static aliasing_request request(const char *name, uint64_t size, uint32_t first_pass, uint32_t last_pass,
+                                uint32_t category = 0, uint64_t alignment = 64 * kib)
+{
+    aliasing_request r = {name, size, alignment, first_pass, last_pass, category};
+    return r;
+}
+
+static bool placements_overlap(const std::vector<aliasing_request> &requests, const aliasing_plan &plan, uint32_t a, uint32_t b)
+{
+    return plan.placements[a].heap == plan.placements[b].heap &&
+           plan.placements[a].offset < plan.placements[b].offset + requests[b].size &&
+           plan.placements[b].offset < plan.placements[a].offset + requests[a].size;
+}
+
+UNIT_TEST(memory_aliasing_reuses_memory_of_dead_resources)
+{
+    std::vector<aliasing_request> requests = {request("gbuffer", 8 * mib, 0, 1),
+                                              request("bloom", 4 * mib, 2, 3)};
+    aliasing_plan plan = plan_memory_aliasing(requests);
+
+    CHECK_EQ(plan.heaps.size(), (size_t)1);
+    CHECK_EQ(plan.placements[0].offset, 0ull);
+    CHECK_EQ(plan.placements[1].offset, 0ull);
+    CHECK_EQ(plan.unaliased_size, 12 * mib);
+    CHECK_EQ(plan.aliased_size, 8 * mib);
+    CHECK(plan.is_aliased[0] && plan.is_aliased[1]);
+
+    // bloom takes over the memory of the gbuffer before its first pass.
+    CHECK_EQ(plan.barriers.size(), (size_t)1);
+    CHECK_EQ(plan.barriers[0].pass, 2u);
+    CHECK_EQ(plan.barriers[0].before, 0u);
+    CHECK_EQ(plan.barriers[0].after, 1u);
+}
+
+UNIT_TEST(memory_aliasing_keeps_live_resources_apart)
+{
+    std::vector<aliasing_request> requests = {request("a", 8 * mib, 0, 2),
+                                              request("b", 4 * mib + 1, 1, 3),
+                                              request("c", 2 * mib, 3, 4)};
+    aliasing_plan plan = plan_memory_aliasing(requests);
+
+    // b lives at the same time as a, it goes after a on the next aligned offset.
+    CHECK(!placements_overlap(requests, plan, 0, 1));
+    CHECK_EQ(plan.placements[1].offset, 8 * mib);
+    CHECK_EQ(plan.placements[1].offset % requests[1].alignment, 0ull);
+
+    // c only overlaps b in time and fits where a was.
+    CHECK_EQ(plan.placements[2].offset, 0ull);
+    CHECK(!plan.is_aliased[1]);
+    CHECK_EQ(plan.heaps[0].size, 8 * mib + 4 * mib + 1);
+    CHECK_EQ(plan.aliased_size, 8 * mib + 4 * mib + 64 * kib);
+}
+
+UNIT_TEST(memory_aliasing_separates_categories)
+{
+    std::vector<aliasing_request> requests = {request("render_target", 8 * mib, 0, 1, 1),
+                                              request("buffer", 8 * mib, 2, 3, 2)};
+    aliasing_plan plan = plan_memory_aliasing(requests);
+
+    CHECK_EQ(plan.heaps.size(), (size_t)2);
+    CHECK(plan.placements[0].heap != plan.placements[1].heap);
+    CHECK(plan.barriers.empty());
+    CHECK(!plan.is_aliased[0] && !plan.is_aliased[1]);
+    CHECK_EQ(plan.aliased_size, plan.unaliased_size);
+}
+
+UNIT_TEST(memory_aliasing_barrier_before_any_resource_when_several_preceded)
+{
+    std::vector<aliasing_request> requests = {request("a", 4 * mib, 0, 0),
+                                              request("b", 4 * mib, 1, 1),
+                                              request("c", 8 * mib, 2, 2)};
+    aliasing_plan plan = plan_memory_aliasing(requests);
+
+    // c is placed first and covers the memory of both a and b.
+    bool found = false;
+    for (const aliasing_barrier &barrier : plan.barriers)
+    {
+        if (barrier.after == 2)
+        {
+            CHECK_EQ(barrier.pass, 2u);
+            CHECK_EQ(barrier.before, aliasing_any_resource);
+            found = true;
+        }
+    }
+    CHECK(found);
+
+    for (size_t i = 1; i < plan.barriers.size(); i++)
+    {
+        CHECK(plan.barriers[i - 1].pass <= plan.barriers[i].pass);
+    }
+}
+
+UNIT_TEST(memory_aliasing_never_overlaps_live_resources)
+{
+    // Pseudo random lifetimes and sizes, the plan must never put two live resources on the same bytes.
+    uint32_t seed = 12345;
+    auto next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+
+    std::vector<aliasing_request> requests;
+    for (uint32_t i = 0; i < 40; i++)
+    {
+        uint32_t first_pass = next() % 16;
+        uint32_t last_pass = first_pass + next() % 6;
+        uint64_t size = (1 + next() % 64) * 64 * kib + next() % 1000;
+        requests.push_back(request("r", size, first_pass, last_pass, next() % 2));
+    }
+
+    aliasing_plan plan = plan_memory_aliasing(requests);
+    for (uint32_t i = 0; i < (uint32_t)requests.size(); i++)
+    {
+        CHECK_EQ(plan.placements[i].offset % requests[i].alignment, 0ull);
+        CHECK(plan.placements[i].offset + requests[i].size <= plan.heaps[plan.placements[i].heap].size);
+        CHECK_EQ(plan.heaps[plan.placements[i].heap].category, requests[i].category);
+        for (uint32_t j = i + 1; j < (uint32_t)requests.size(); j++)
+        {
+            bool live_together = requests[i].first_pass <= requests[j].last_pass && requests[j].first_pass <= requests[i].last_pass;
+            CHECK(!(live_together && placements_overlap(requests, plan, i, j)));
+        }
+    }
+    CHECK(plan.aliased_size <= plan.unaliased_size);
+}
+
+UNIT_TEST(render_graph_aliasing_barriers_come_first)
+{
+    static int resources[3] = {};
+    render_graph graph;
+    render_graph_handle back_buffer = graph.import_resource("back_buffer", &resources[0], 0x0);
+    render_graph_handle bloom = graph.import_resource("bloom", &resources[1], 0x4);
+    render_graph_handle unused = graph.import_resource("unused", &resources[2], 0x4);
+    graph.set_output(back_buffer);
+    graph.set_aliased(bloom, &resources[2]);
+    graph.set_aliased(unused);
+
+    render_graph_handle bloom_pass = graph.add_pass("bloom", nullptr);
+    graph.write(bloom_pass, bloom, 0x4);
+    render_graph_handle compose = graph.add_pass("compose", nullptr);
+    graph.read(compose, bloom, 0x80);
+    graph.write(compose, back_buffer, 0x4);
+    CHECK(graph.compile());
+
+    // Only the resource that is used gets a barrier, ahead of the begin half of the back buffer transition.
+    std::vector<tracked_barrier> initial;
+    bool is_first = true;
+    graph.execute([&](const std::vector<tracked_barrier> &barriers, uint32_t) {
+        if (is_first)
+        {
+            initial = barriers;
+            is_first = false;
+        }
+    });
+    CHECK_EQ(initial.size(), (size_t)2);
+    CHECK_EQ(initial[0].type, tracked_barrier_aliasing);
+    CHECK(initial[0].resource == &resources[1]);
+    CHECK(initial[0].resource_before == &resources[2]);
+    CHECK_EQ(initial[1].flags, tracked_barrier_begin_only);
+}
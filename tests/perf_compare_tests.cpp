@@ -0,0 +1,126 @@
+#include "unit_test.h"
+#include "perf_compare.h"
+#include <math.h>
+
+// Samples first, first + 1, ... count of them.
+static std::vector<double> sequence(double first, int count)
+{
+    std::vector<double> values;
+    for (int i = 0; i < count; i++)
+    {
+        values.push_back(first + (double)i);
+    }
+    return values;
+}
+
+UNIT_TEST(median_of_odd_and_even_sizes)
+{
+    CHECK_NEAR(median_of({3.0, 1.0, 2.0}), 2.0, 1e-12);
+    CHECK_NEAR(median_of({4.0, 1.0, 3.0, 2.0}), 2.5, 1e-12);
+    CHECK_NEAR(median_of({7.0}), 7.0, 1e-12);
+    CHECK_NEAR(median_of({5.0, 5.0, 1.0, 9.0}), 5.0, 1e-12);
+    CHECK_NEAR(median_of({}), 0.0, 1e-12);
+}
+
+UNIT_TEST(mann_whitney_exact_p_values_of_small_samples)
+{
+    // Complete separation has the smallest U, 1 of the C(n1 + n2, n1) orderings on each side.
+    CHECK_NEAR(mann_whitney_p(sequence(1.0, 3), sequence(4.0, 3)), 2.0 / 20.0, 1e-12);
+    CHECK_NEAR(mann_whitney_p(sequence(1.0, 4), sequence(5.0, 4)), 2.0 / 70.0, 1e-12);
+    CHECK_NEAR(mann_whitney_p(sequence(5.0, 4), sequence(1.0, 4)), 2.0 / 70.0, 1e-12);
+    CHECK_NEAR(mann_whitney_p(sequence(1.0, 10), sequence(11.0, 10)), 2.0 / 184756.0, 1e-15);
+
+    // U = 1: the orderings with U = 0 and U = 1, 2 of 70 on each side.
+    CHECK_NEAR(mann_whitney_p({1.0, 2.0, 3.0, 5.0}, {4.0, 6.0, 7.0, 8.0}), 4.0 / 70.0, 1e-12);
+
+    // Sizes that differ, P(U = 0) = 1 / C(7, 3) = 1 / 35.
+    CHECK_NEAR(mann_whitney_p(sequence(1.0, 3), sequence(4.0, 4)), 2.0 / 35.0, 1e-12);
+
+    // Interleaved samples are as likely as can be.
+    CHECK_NEAR(mann_whitney_p({1.0, 4.0, 5.0, 8.0}, {2.0, 3.0, 6.0, 7.0}), 1.0, 1e-12);
+    CHECK_NEAR(mann_whitney_p({}, {1.0, 2.0}), 1.0, 1e-12);
+}
+
+UNIT_TEST(mann_whitney_normal_approximation_corrects_for_the_ties)
+{
+    // Ranks 1.5, 1.5, 3.5 | 3.5, 5.5, 5.5: U = 0.5, three pairs of ties.
+    // mean = 4.5, variance = 9 / 12 * (7 - 18 / 30) = 4.8, z = (4.5 - 0.5 - 0.5) / sqrt(4.8).
+    CHECK_NEAR(mann_whitney_p({1.0, 1.0, 2.0}, {2.0, 3.0, 3.0}), 0.11014892418594698, 1e-12);
+
+    // All tied, there is no variance.
+    CHECK_NEAR(mann_whitney_p({2.0, 2.0}, {2.0, 2.0, 2.0}), 1.0, 1e-12);
+
+    // Over the exact sizes the approximation takes over, separated samples are still far from the null hypothesis.
+    CHECK(mann_whitney_p(sequence(1.0, 30), sequence(31.0, 30)) < 1e-9);
+    CHECK(mann_whitney_p(sequence(1.0, 30), sequence(1.5, 30)) > 0.5);
+}
+
+UNIT_TEST(compare_samples_verdicts)
+{
+    compare_options options;
+    std::vector<double> baseline = sequence(100.0, 10);
+
+    series_comparison slower = compare_samples(baseline, sequence(120.0, 10), options);
+    CHECK_EQ(slower.verdict, compare_slower);
+    CHECK_NEAR(slower.delta, 124.5 / 104.5 - 1.0, 1e-12);
+    CHECK_NEAR(slower.p_value, 2.0 / 184756.0, 1e-15);
+    CHECK_EQ(compare_samples(sequence(120.0, 10), baseline, options).verdict, compare_faster);
+
+    // A small difference within the threshold on both sides of the interval.
+    series_comparison same = compare_samples(baseline, sequence(100.5, 10), options);
+    CHECK_EQ(same.verdict, compare_same);
+    CHECK(same.delta_low > -options.threshold && same.delta_high < options.threshold);
+
+    // A single repetition can't tell, whatever the difference.
+    series_comparison single = compare_samples({100.0}, {200.0}, options);
+    CHECK_EQ(single.verdict, compare_unknown);
+    CHECK_NEAR(single.delta, 1.0, 1e-12);
+    CHECK_NEAR(single.p_value, 1.0, 1e-12);
+}
+
+UNIT_TEST(compare_samples_threshold_and_alpha_boundaries)
+{
+    std::vector<double> baseline = sequence(100.0, 10);
+    std::vector<double> candidate = sequence(120.0, 10);
+    compare_options options;
+    series_comparison reference = compare_samples(baseline, candidate, options);
+
+    // A difference equal to the threshold matters, a larger threshold leaves a significant difference unknown.
+    options.threshold = reference.delta;
+    CHECK_EQ(compare_samples(baseline, candidate, options).verdict, compare_slower);
+    options.threshold = nextafter(reference.delta, 1.0);
+    CHECK_EQ(compare_samples(baseline, candidate, options).verdict, compare_unknown);
+
+    // p must be under alpha to be significant.
+    options = compare_options();
+    options.alpha = reference.p_value;
+    CHECK_EQ(compare_samples(baseline, candidate, options).verdict, compare_unknown);
+    options.alpha = nextafter(reference.p_value, 1.0);
+    CHECK_EQ(compare_samples(baseline, candidate, options).verdict, compare_slower);
+
+    // The same interval with a threshold that covers it.
+    options = compare_options();
+    options.threshold = 1.0;
+    options.alpha = 0.0;
+    CHECK_EQ(compare_samples(baseline, candidate, options).verdict, compare_same);
+}
+
+UNIT_TEST(compare_samples_bootstrap_is_reproducible_for_a_seed)
+{
+    std::vector<double> baseline = {10.2, 9.8, 10.5, 10.1, 9.9, 10.4, 10.0, 10.3};
+    std::vector<double> candidate = {10.6, 10.1, 10.9, 10.4, 10.2, 11.0, 10.5, 10.3};
+    compare_options options;
+    options.seed = 42;
+    series_comparison first = compare_samples(baseline, candidate, options);
+    series_comparison second = compare_samples(baseline, candidate, options);
+    CHECK_EQ(first.delta_low, second.delta_low);
+    CHECK_EQ(first.delta_high, second.delta_high);
+    CHECK(first.delta_low <= first.delta && first.delta <= first.delta_high);
+    CHECK(first.delta_low < first.delta_high);
+
+    // A wider confidence can only widen the interval of the same resamples.
+    options.confidence = 0.99;
+    series_comparison wider = compare_samples(baseline, candidate, options);
+    CHECK(wider.delta_low <= first.delta_low);
+    CHECK(wider.delta_high >= first.delta_high);
+}
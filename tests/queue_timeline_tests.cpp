@@ -0,0 +1,140 @@
+#include "unit_test.h"
+#include "queue_timeline.h"
+
+// Every wait must start after the submission that signals the value it waits for.
+static void check_fence_ordering(const std::vector<queue_submission> &log, const simulated_schedule &schedule)
+{
+    for (size_t i = 0; i < log.size(); i++)
+    {
+        for (const queue_sync_point &wait : log[i].waits)
+        {
+            for (size_t j = 0; j < log.size(); j++)
+            {
+                if (log[j].queue == wait.queue && log[j].signal_value == wait.value)
+                {
+                    CHECK(schedule.submissions[i].start_ms >= schedule.submissions[j].end_ms);
+                }
+            }
+        }
+    }
+}
+
+UNIT_TEST(queue_timeline_signals_increasing_values_per_queue)
+{
+    queue_timeline timeline;
+    timeline.reset(gpu_queue_compute, 10);
+
+    CHECK_EQ(timeline.schedule(gpu_queue_graphics, "g1").signal_value, 1ull);
+    CHECK_EQ(timeline.schedule(gpu_queue_compute, "c1").signal_value, 11ull);
+    CHECK_EQ(timeline.schedule(gpu_queue_graphics, "g2").signal_value, 2ull);
+    CHECK_EQ(timeline.last(gpu_queue_graphics).value, 2ull);
+    CHECK_EQ(timeline.last(gpu_queue_compute).value, 11ull);
+    CHECK_EQ(timeline.log().size(), (size_t)3);
+
+    timeline.clear_log();
+    CHECK(timeline.log().empty());
+    CHECK_EQ(timeline.last(gpu_queue_graphics).value, 2ull);
+}
+
+UNIT_TEST(queue_timeline_drops_implied_waits)
+{
+    queue_timeline timeline;
+    queue_sync_point graphics = {gpu_queue_graphics, timeline.schedule(gpu_queue_graphics, "graphics").signal_value};
+    queue_sync_point compute = {gpu_queue_compute, timeline.schedule(gpu_queue_compute, "compute", &graphics, 1).signal_value};
+
+    // Waiting for the compute submission implies waiting for the graphics one it waited for.
+    queue_sync_point both[] = {compute, graphics};
+    queue_submission copy = timeline.schedule(gpu_queue_copy, "copy", both, 2);
+    CHECK_EQ(copy.waits.size(), (size_t)1);
+    CHECK_EQ(copy.waits[0].queue, (uint32_t)gpu_queue_compute);
+    CHECK_EQ(copy.num_dropped_waits, 1u);
+
+    // The copy queue already waited for these values, and a queue never waits for itself.
+    queue_sync_point again[] = {graphics, {gpu_queue_copy, copy.signal_value}};
+    queue_submission next = timeline.schedule(gpu_queue_copy, "next copy", again, 2);
+    CHECK(next.waits.empty());
+    CHECK_EQ(next.num_dropped_waits, 2u);
+}
+
+UNIT_TEST(simulate_queues_overlaps_the_particle_simulation_with_the_geometry)
+{
+    // The submissions of particles_graphics: the simulation waits for the previous frame's lighting and particles,
+    // which wait for the simulation of their frame. The shadows and geometry wait for nothing.
+    queue_timeline timeline;
+    queue_sync_point particles_released = {gpu_queue_graphics, 0};
+    std::vector<double> durations_ms;
+    const int num_frames = 3;
+    for (int frame = 0; frame < num_frames; frame++)
+    {
+        queue_submission simulation = timeline.schedule(gpu_queue_compute, "Particle simulation", &particles_released, 1);
+        queue_sync_point particles_ready = {gpu_queue_compute, simulation.signal_value};
+        timeline.schedule(gpu_queue_graphics, "Shadows and geometry");
+        queue_submission post = timeline.schedule(gpu_queue_graphics, "Lighting and particles", &particles_ready, 1);
+        particles_released = {gpu_queue_graphics, post.signal_value};
+        durations_ms.push_back(3.0);
+        durations_ms.push_back(5.0);
+        durations_ms.push_back(4.0);
+    }
+
+    // From the second frame on, the simulation waits for the lighting of the previous frame.
+    std::vector<queue_submission> log = timeline.log();
+    CHECK_EQ(log.size(), (size_t)(num_frames * 3));
+    CHECK(log[0].waits.empty());
+    CHECK_EQ(log[3].waits.size(), (size_t)1);
+    CHECK_EQ(log[3].waits[0].value, log[2].signal_value);
+
+    simulated_schedule schedule;
+    std::string error;
+    CHECK(simulate_queues(log, durations_ms, &schedule, &error));
+    CHECK(error.empty());
+    check_fence_ordering(log, schedule);
+
+    // Every simulation runs entirely during the shadows and geometry of its frame: 3 ms of overlap per frame,
+    // and the graphics queue is never idle.
+    for (int frame = 0; frame < num_frames; frame++)
+    {
+        const simulated_submission &simulation = schedule.submissions[frame * 3];
+        const simulated_submission &geometry = schedule.submissions[frame * 3 + 1];
+        const simulated_submission &post = schedule.submissions[frame * 3 + 2];
+        CHECK_NEAR(simulation.start_ms, geometry.start_ms, 1e-9);
+        CHECK(simulation.end_ms <= geometry.end_ms);
+        CHECK_NEAR(post.start_ms, geometry.end_ms, 1e-9);
+    }
+    CHECK_NEAR(schedule.overlap_ms, 3.0 * num_frames, 1e-9);
+    CHECK_NEAR(schedule.total_ms, 9.0 * num_frames, 1e-9);
+}
+
+UNIT_TEST(simulate_queues_serializes_a_simulation_longer_than_the_geometry)
+{
+    // The lighting waits for the end of the simulation, the graphics queue idles for the difference.
+    queue_timeline timeline;
+    queue_submission simulation = timeline.schedule(gpu_queue_compute, "Particle simulation");
+    queue_sync_point particles_ready = {gpu_queue_compute, simulation.signal_value};
+    timeline.schedule(gpu_queue_graphics, "Shadows and geometry");
+    timeline.schedule(gpu_queue_graphics, "Lighting and particles", &particles_ready, 1);
+
+    simulated_schedule schedule;
+    CHECK(simulate_queues(timeline.log(), {8.0, 5.0, 4.0}, &schedule));
+    check_fence_ordering(timeline.log(), schedule);
+    CHECK_NEAR(schedule.submissions[2].start_ms, 8.0, 1e-9);
+    CHECK_NEAR(schedule.overlap_ms, 5.0, 1e-9);
+    CHECK_NEAR(schedule.total_ms, 12.0, 1e-9);
+}
+
+UNIT_TEST(simulate_queues_reports_waits_that_are_never_signaled)
+{
+    // A compute value that no submission of the log signals.
+    queue_submission graphics = {"Lighting and particles", gpu_queue_graphics, 1, {{gpu_queue_compute, 2}}, 0};
+    queue_submission compute = {"Particle simulation", gpu_queue_compute, 1, {}, 0};
+
+    simulated_schedule schedule;
+    std::string error;
+    CHECK(!simulate_queues({graphics, compute}, {1.0, 1.0}, &schedule, &error));
+    CHECK(error.find("Lighting and particles") != std::string::npos);
+    CHECK(error.find("Particle simulation") == std::string::npos);
+
+    // Values signaled before the log are reached from the start.
+    graphics.waits[0].value = 0;
+    CHECK(simulate_queues({graphics, compute}, {1.0, 1.0}, &schedule, &error));
+    CHECK_NEAR(schedule.overlap_ms, 1.0, 1e-9);
+}
@@ -0,0 +1,106 @@
+#include "unit_test.h"
+#include "render_counters.h"
+#include <thread>
+
+static const pass_counter_values *find_pass(const render_counter_frame &frame, const char *name)
+{
+    for (const pass_counter_values &pass : frame.passes)
+    {
+        if (pass.pass == intern_profile_event(name))
+        {
+            return &pass;
+        }
+    }
+    return nullptr;
+}
+
+UNIT_TEST(render_counters_merge_the_passes_of_every_thread)
+{
+    render_counters counters;
+    profile_event_id shadows = intern_profile_event("Counters shadows");
+    profile_event_id lighting = intern_profile_event("Counters lighting");
+    counters.begin_pass(shadows);
+    counters.add(counter_draws, 3);
+    counters.end_pass(shadows);
+    counters.add(counter_barriers, 5); // Outside of the passes.
+
+    // The same pass on another thread adds to the same row of the frame, the inner pass counts its own work.
+    std::thread worker([&]() {
+        counters.begin_pass(shadows);
+        counters.add(counter_draws, 2);
+        counters.begin_pass(lighting);
+        counters.add(counter_dispatches);
+        counters.add(counter_upload_bytes, 256);
+        counters.end_pass(lighting);
+        counters.add(counter_draws);
+        counters.end_pass(shadows);
+    });
+    worker.join();
+
+    // The counts of the thread that exited are still collected.
+    const render_counter_frame &frame = counters.end_frame();
+    CHECK_EQ(frame.passes.size(), (size_t)2);
+    const pass_counter_values *shadows_pass = find_pass(frame, "Counters shadows");
+    const pass_counter_values *lighting_pass = find_pass(frame, "Counters lighting");
+    CHECK(shadows_pass && lighting_pass);
+    if (shadows_pass && lighting_pass)
+    {
+        CHECK_EQ(shadows_pass->counters[counter_draws], 6ull);
+        CHECK_EQ(shadows_pass->counters[counter_dispatches], 0ull);
+        CHECK_EQ(lighting_pass->counters[counter_dispatches], 1ull);
+        CHECK_EQ(lighting_pass->counters[counter_upload_bytes], 256ull);
+
+        // Sorted by name.
+        CHECK(lighting_pass < shadows_pass);
+    }
+    CHECK_EQ(frame.totals[counter_draws], 6ull);
+    CHECK_EQ(frame.totals[counter_barriers], 5ull);
+    CHECK_EQ(frame.outside_passes()[counter_barriers], 5ull);
+    CHECK_EQ(frame.outside_passes()[counter_draws], 0ull);
+}
+
+UNIT_TEST(render_counters_start_from_zero_every_frame)
+{
+    render_counters counters;
+    profile_event_id pass = intern_profile_event("Counters pass");
+    counters.begin_pass(pass);
+    counters.add(counter_draws, 4);
+    counters.end_pass(pass);
+    uint64_t first_frame = counters.end_frame().frame_number;
+
+    // Only what was counted since the last call, the passes without work are left out.
+    const render_counter_frame &empty = counters.end_frame();
+    CHECK_EQ(empty.frame_number, first_frame + 1);
+    CHECK_EQ(empty.totals[counter_draws], 0ull);
+    CHECK_EQ(empty.passes.size(), (size_t)0);
+
+    counters.begin_pass(pass);
+    counters.add(counter_draws);
+    counters.end_pass(pass);
+    const render_counter_frame &next = counters.end_frame();
+    CHECK_EQ(next.passes.size(), (size_t)1);
+    CHECK_EQ(next.totals[counter_draws], 1ull);
+    CHECK_EQ(counters.last_frame().passes[0].counters[counter_draws], 1ull);
+}
+
+UNIT_TEST(render_counters_close_the_passes_out_of_order)
+{
+    render_counters counters;
+    profile_event_id outer = intern_profile_event("Counters outer");
+    profile_event_id inner = intern_profile_event("Counters inner");
+
+    // Closing the outer pass first leaves the inner one counting, an unknown pass is ignored.
+    counters.begin_pass(outer);
+    counters.begin_pass(inner);
+    counters.end_pass(outer);
+    counters.add(counter_draws);
+    counters.end_pass(intern_profile_event("Counters never opened"));
+    counters.end_pass(inner);
+    counters.add(counter_draws);
+
+    const render_counter_frame &frame = counters.end_frame();
+    CHECK_EQ(frame.passes.size(), (size_t)1);
+    CHECK(find_pass(frame, "Counters inner") != nullptr);
+    CHECK_EQ(frame.outside_passes()[counter_draws], 1ull);
+    CHECK_EQ(frame.totals[counter_draws], 2ull);
+}
@@ -0,0 +1,208 @@
+#include "unit_test.h"
+#include "render_graph.h"
+
+// Values of D3D12_RESOURCE_STATES.
+static const uint32_t state_render_target = 0x4;
+static const uint32_t state_unordered_access = 0x8;
+static const uint32_t state_depth_write = 0x10;
+static const uint32_t state_pixel_shader_resource = 0x80;
+static const uint32_t state_copy_source = 0x800;
+static const uint32_t state_present = 0x0;
+
+static int g_resources[4] = {};
+
+UNIT_TEST(render_graph_culls_passes_that_reach_no_output)
+{
+    render_graph graph;
+    render_graph_handle back_buffer = graph.import_resource("back_buffer", &g_resources[0], state_present);
+    render_graph_handle hdr = graph.import_resource("hdr", &g_resources[1], state_render_target);
+    render_graph_handle debug = graph.import_resource("debug", &g_resources[2], state_render_target);
+    graph.set_output(back_buffer);
+
+    std::vector<std::string> executed;
+    render_graph_handle scene = graph.add_pass("scene", [&]() { executed.push_back("scene"); });
+    graph.write(scene, hdr, state_render_target);
+    render_graph_handle debug_view = graph.add_pass("debug_view", [&]() { executed.push_back("debug_view"); });
+    graph.read(debug_view, hdr, state_pixel_shader_resource);
+    graph.write(debug_view, debug, state_render_target);
+    render_graph_handle tonemap = graph.add_pass("tonemap", [&]() { executed.push_back("tonemap"); });
+    graph.read(tonemap, hdr, state_pixel_shader_resource);
+    graph.write(tonemap, back_buffer, state_render_target);
+    render_graph_handle capture = graph.add_pass("capture", [&]() { executed.push_back("capture"); }, true);
+    graph.read(capture, debug, state_copy_source);
+
+    CHECK(graph.compile());
+    CHECK(!graph.pass(scene).is_culled);
+    CHECK(!graph.pass(tonemap).is_culled);
+    CHECK(!graph.pass(capture).is_culled);
+    CHECK(!graph.pass(debug_view).is_culled); // Its output is read by a pass with side effects.
+    CHECK_EQ(graph.m_num_culled, 0u);
+
+    // Without the capture, nothing needs the debug view.
+    graph.reset();
+    back_buffer = graph.import_resource("back_buffer", &g_resources[0], state_present);
+    hdr = graph.import_resource("hdr", &g_resources[1], state_render_target);
+    debug = graph.import_resource("debug", &g_resources[2], state_render_target);
+    graph.set_output(back_buffer);
+    scene = graph.add_pass("scene", [&]() { executed.push_back("scene"); });
+    graph.write(scene, hdr, state_render_target);
+    debug_view = graph.add_pass("debug_view", [&]() { executed.push_back("debug_view"); });
+    graph.read(debug_view, hdr, state_pixel_shader_resource);
+    graph.write(debug_view, debug, state_render_target);
+    tonemap = graph.add_pass("tonemap", [&]() { executed.push_back("tonemap"); });
+    graph.read(tonemap, hdr, state_pixel_shader_resource);
+    graph.write(tonemap, back_buffer, state_render_target);
+
+    CHECK(graph.compile());
+    CHECK(graph.pass(debug_view).is_culled);
+    CHECK_EQ(graph.m_num_culled, 1u);
+
+    executed.clear();
+    graph.execute([](const std::vector<tracked_barrier> &, uint32_t) {});
+    CHECK_EQ(executed.size(), (size_t)2);
+    CHECK(executed[0] == "scene" && executed[1] == "tonemap");
+}
+
+UNIT_TEST(render_graph_transitions_between_passes_and_to_the_final_state)
+{
+    render_graph graph;
+    render_graph_handle back_buffer = graph.import_resource("back_buffer", &g_resources[0], state_present);
+    render_graph_handle hdr = graph.import_resource("hdr", &g_resources[1], state_render_target);
+    graph.set_output(back_buffer);
+
+    render_graph_handle scene = graph.add_pass("scene", nullptr);
+    graph.write(scene, hdr, state_render_target);
+    render_graph_handle tonemap = graph.add_pass("tonemap", nullptr);
+    graph.read(tonemap, hdr, state_pixel_shader_resource);
+    graph.write(tonemap, back_buffer, state_render_target);
+    CHECK(graph.compile());
+
+    // hdr starts in the state the scene needs and transitions right before the tone mapping.
+    // The back buffer isn't used before, its transition begins before the first pass and ends with hdr's.
+    CHECK(graph.pass(scene).barriers_before.empty());
+    const std::vector<tracked_barrier> &before = graph.pass(tonemap).barriers_before;
+    CHECK_EQ(before.size(), (size_t)2);
+    for (const tracked_barrier &barrier : before)
+    {
+        CHECK_EQ(barrier.type, tracked_barrier_transition);
+        uint32_t expected = barrier.resource == &g_resources[0] ? tracked_barrier_end_only : 0u;
+        CHECK_EQ(barrier.flags, expected);
+    }
+    CHECK_EQ(graph.m_num_split_barriers, 1u);
+
+    std::vector<std::vector<tracked_barrier>> emitted;
+    graph.execute([&](const std::vector<tracked_barrier> &barriers, uint32_t) { emitted.push_back(barriers); });
+    CHECK_EQ(emitted.size(), (size_t)3);
+    CHECK(emitted[0][0].resource == &g_resources[0]);
+    CHECK_EQ(emitted[0][0].flags, tracked_barrier_begin_only);
+
+    // Both go back to their initial state after the last pass so that the next frame starts from the same states.
+    const std::vector<tracked_barrier> &after = graph.pass(tonemap).barriers_after;
+    CHECK_EQ(after.size(), (size_t)2);
+    for (const tracked_barrier &barrier : after)
+    {
+        uint32_t expected = barrier.resource == &g_resources[0] ? state_present : state_render_target;
+        CHECK_EQ(barrier.after, expected);
+    }
+    CHECK_EQ(graph.m_num_barriers, 4u);
+}
+
+UNIT_TEST(render_graph_splits_barriers_over_unrelated_passes)
+{
+    render_graph graph;
+    render_graph_handle shadow = graph.import_resource("shadow", &g_resources[0], state_depth_write);
+    render_graph_handle color = graph.import_resource("color", &g_resources[1], state_render_target);
+    graph.set_output(color);
+
+    render_graph_handle shadow_pass = graph.add_pass("shadow", nullptr);
+    graph.write(shadow_pass, shadow, state_depth_write);
+    render_graph_handle sky = graph.add_pass("sky", nullptr);
+    graph.write(sky, color, state_render_target);
+    render_graph_handle lighting = graph.add_pass("lighting", nullptr);
+    graph.read(lighting, shadow, state_pixel_shader_resource);
+    graph.write(lighting, color, state_render_target);
+    CHECK(graph.compile());
+
+    // The shadow map transition begins after the shadow pass and ends before the lighting.
+    // The transition back to DEPTH_WRITE right after the lighting has nothing to overlap with and stays whole.
+    CHECK_EQ(graph.m_num_split_barriers, 1u);
+    const std::vector<tracked_barrier> &begin = graph.pass(shadow_pass).barriers_after;
+    CHECK_EQ(begin.size(), (size_t)1);
+    CHECK_EQ(begin[0].flags, tracked_barrier_begin_only);
+    CHECK_EQ(begin[0].after, state_pixel_shader_resource);
+    const std::vector<tracked_barrier> &end = graph.pass(lighting).barriers_before;
+    CHECK_EQ(end.size(), (size_t)1);
+    CHECK_EQ(end[0].flags, tracked_barrier_end_only);
+}
+
+UNIT_TEST(render_graph_split_barriers_stay_in_one_command_list)
+{
+    render_graph graph;
+    render_graph_handle shadow = graph.import_resource("shadow", &g_resources[0], state_depth_write);
+    render_graph_handle color = graph.import_resource("color", &g_resources[1], state_render_target);
+    graph.set_output(color);
+
+    render_graph_handle shadow_pass = graph.add_pass("shadow", nullptr);
+    graph.write(shadow_pass, shadow, state_depth_write);
+    render_graph_handle sky = graph.add_pass("sky", nullptr);
+    graph.write(sky, color, state_render_target);
+    graph.end_command_list(sky);
+    render_graph_handle lighting = graph.add_pass("lighting", nullptr);
+    graph.read(lighting, shadow, state_pixel_shader_resource);
+    graph.write(lighting, color, state_render_target);
+    CHECK(graph.compile());
+
+    // The sky pass would hide the shadow map transition, but the begin half would be on the first list.
+    CHECK_EQ(graph.pass(shadow_pass).command_list, 0u);
+    CHECK_EQ(graph.pass(lighting).command_list, 1u);
+    CHECK_EQ(graph.m_num_split_barriers, 0u);
+    CHECK(graph.pass(shadow_pass).barriers_after.empty());
+    CHECK_EQ(graph.pass(lighting).barriers_before.size(), (size_t)1);
+    CHECK_EQ(graph.pass(lighting).barriers_before[0].flags, 0u);
+
+    // The barriers are emitted on the list of the pass that follows them.
+    std::vector<uint32_t> lists;
+    graph.execute([&](const std::vector<tracked_barrier> &, uint32_t command_list) { lists.push_back(command_list); });
+    CHECK(!lists.empty());
+    CHECK_EQ(lists.front(), 1u);
+}
+
+UNIT_TEST(render_graph_orders_unordered_access_writes)
+{
+    render_graph graph;
+    render_graph_handle particles = graph.import_resource("particles", &g_resources[0], state_unordered_access);
+    graph.set_output(particles);
+
+    render_graph_handle emit = graph.add_pass("emit", nullptr);
+    graph.write(emit, particles, state_unordered_access);
+    render_graph_handle simulate = graph.add_pass("simulate", nullptr);
+    graph.read(simulate, particles, state_unordered_access);
+    graph.write(simulate, particles, state_unordered_access);
+    CHECK(graph.compile());
+
+    // Same state, but the second pass must see the first one's writes.
+    const std::vector<tracked_barrier> &before = graph.pass(simulate).barriers_before;
+    CHECK_EQ(before.size(), (size_t)1);
+    CHECK_EQ(before[0].type, tracked_barrier_uav);
+}
+
+UNIT_TEST(render_graph_combines_reads_and_rejects_conflicting_states)
+{
+    render_graph graph;
+    render_graph_handle texture = graph.import_resource("texture", &g_resources[0], state_render_target);
+    render_graph_handle output = graph.import_resource("output", &g_resources[1], state_render_target);
+    graph.set_output(output);
+
+    render_graph_handle pass = graph.add_pass("blit", nullptr);
+    graph.read(pass, texture, state_pixel_shader_resource);
+    graph.read(pass, texture, state_copy_source);
+    graph.write(pass, output, state_render_target);
+    CHECK(graph.compile());
+    CHECK_EQ(graph.pass(pass).barriers_before.size(), (size_t)1);
+    CHECK_EQ(graph.pass(pass).barriers_before[0].after, state_pixel_shader_resource | state_copy_source);
+
+    graph.write(pass, texture, state_unordered_access);
+    std::string error;
+    CHECK(!graph.compile(&error));
+    CHECK(error.find("texture") != std::string::npos);
+}
@@ -0,0 +1,233 @@
+#include "unit_test.h"
+#include "resource_state_tracker.h"
+
+// Values of D3D12_RESOURCE_STATES.
+static const uint32_t state_common = 0x0;
+static const uint32_t state_render_target = 0x4;
+static const uint32_t state_unordered_access = 0x8;
+static const uint32_t state_non_pixel_shader_resource = 0x40;
+static const uint32_t state_pixel_shader_resource = 0x80;
+static const uint32_t state_copy_dest = 0x400;
+static const uint32_t state_copy_source = 0x800;
+
+// The tracker only compares the resource pointers.
+static const int resource_a = 0;
+static const int resource_b = 0;
+static const void *const a = &resource_a;
+static const void *const b = &resource_b;
+
+UNIT_TEST(resource_state_tracker_read_states_are_compatible)
+{
+    CHECK(is_state_compatible(state_render_target, state_render_target));
+    CHECK(is_state_compatible(state_pixel_shader_resource | state_copy_source, state_copy_source));
+    CHECK(!is_state_compatible(state_pixel_shader_resource, state_pixel_shader_resource | state_copy_source));
+    CHECK(!is_state_compatible(state_render_target | state_unordered_access, state_render_target));
+    CHECK(!is_state_compatible(state_common, state_copy_source));
+    CHECK(!is_state_compatible(state_copy_source, state_common));
+}
+
+UNIT_TEST(resource_state_tracker_first_use_is_an_initial_requirement)
+{
+    resource_state_tracker tracker;
+    tracker.require(a, state_render_target);
+    tracker.require(a, state_render_target);
+
+    // Nothing to record in the list, the state is patched when the list is submitted.
+    CHECK(!tracker.has_pending());
+    CHECK_EQ(tracker.initial_requirements().size(), (size_t)1);
+    CHECK_EQ(tracker.initial_requirements()[0].before, resource_state_unknown);
+    CHECK_EQ(tracker.initial_requirements()[0].after, state_render_target);
+    CHECK_EQ(tracker.m_requested_count, 2u);
+    CHECK_EQ(tracker.m_removed_count, 1u);
+}
+
+UNIT_TEST(resource_state_tracker_batches_transitions_until_flush)
+{
+    resource_state_tracker tracker;
+    tracker.require(a, state_render_target);
+    tracker.require(b, state_copy_dest);
+    tracker.require(a, state_pixel_shader_resource);
+    tracker.require(b, state_copy_source);
+
+    std::vector<tracked_barrier> barriers;
+    tracker.flush(&barriers);
+    CHECK_EQ(barriers.size(), (size_t)2);
+    CHECK(barriers[0].resource == a);
+    CHECK_EQ(barriers[0].before, state_render_target);
+    CHECK_EQ(barriers[0].after, state_pixel_shader_resource);
+    CHECK(barriers[1].resource == b);
+    CHECK_EQ(barriers[1].after, state_copy_source);
+    CHECK_EQ(barriers[1].flags, 0u);
+    CHECK(barriers[1].resource_before == nullptr);
+    CHECK(!tracker.has_pending());
+    CHECK_EQ(tracker.m_flushed_count, 2u);
+}
+
+UNIT_TEST(resource_state_tracker_merges_and_removes_pending_transitions)
+{
+    resource_state_tracker tracker;
+    tracker.require(a, state_render_target);
+
+    // RT->UAV->COPY_DEST is merged into RT->COPY_DEST.
+    tracker.require(a, state_unordered_access);
+    tracker.require(a, state_copy_dest);
+    std::vector<tracked_barrier> barriers;
+    tracker.flush(&barriers);
+    CHECK_EQ(barriers.size(), (size_t)1);
+    CHECK_EQ(barriers[0].before, state_render_target);
+    CHECK_EQ(barriers[0].after, state_copy_dest);
+
+    // COPY_DEST->RT->COPY_DEST cancels out.
+    tracker.require(a, state_render_target);
+    tracker.require(a, state_copy_dest);
+    CHECK(!tracker.has_pending());
+}
+
+UNIT_TEST(resource_state_tracker_merges_after_a_removed_transition)
+{
+    resource_state_tracker tracker;
+    tracker.require(a, state_render_target);
+    tracker.require(b, state_render_target);
+    tracker.require(a, state_copy_dest);
+    tracker.require(b, state_copy_dest);
+
+    // The transition of a cancels out, the one of b is still pending.
+    tracker.require(a, state_render_target);
+    CHECK(tracker.has_pending());
+
+    // RT->UAV->COPY_DEST is merged again, after the transition of b.
+    tracker.require(a, state_unordered_access);
+    tracker.require(a, state_copy_dest);
+    std::vector<tracked_barrier> barriers;
+    tracker.flush(&barriers);
+    CHECK_EQ(barriers.size(), (size_t)2);
+    CHECK(barriers[0].resource == b);
+    CHECK(barriers[1].resource == a);
+    CHECK_EQ(barriers[1].before, state_render_target);
+    CHECK_EQ(barriers[1].after, state_copy_dest);
+    CHECK_EQ(tracker.m_flushed_count, 2u);
+
+    // Nothing is merged with the barriers of the last flush.
+    tracker.require(a, state_render_target);
+    barriers.clear();
+    tracker.flush(&barriers);
+    CHECK_EQ(barriers.size(), (size_t)1);
+    CHECK_EQ(barriers[0].before, state_copy_dest);
+}
+
+UNIT_TEST(resource_state_tracker_combines_read_states)
+{
+    resource_state_tracker tracker;
+    tracker.require(a, state_copy_dest);
+    tracker.require(a, state_pixel_shader_resource);
+    tracker.require(a, state_non_pixel_shader_resource);
+    tracker.require(a, state_pixel_shader_resource);
+
+    // One transition to both read states, the later reads need no barrier.
+    std::vector<tracked_barrier> barriers;
+    tracker.flush(&barriers);
+    CHECK_EQ(barriers.size(), (size_t)1);
+    CHECK_EQ(barriers[0].after, state_pixel_shader_resource | state_non_pixel_shader_resource);
+}
+
+UNIT_TEST(resource_state_tracker_keeps_uav_barrier_order)
+{
+    resource_state_tracker tracker;
+    tracker.require(a, state_unordered_access);
+    tracker.require_uav(a);
+    tracker.require_uav(a);
+    tracker.require(a, state_pixel_shader_resource);
+
+    // The transition after the UAV barrier is not merged across it.
+    std::vector<tracked_barrier> barriers;
+    tracker.flush(&barriers);
+    CHECK_EQ(barriers.size(), (size_t)2);
+    CHECK_EQ(barriers[0].type, tracked_barrier_uav);
+    CHECK_EQ(barriers[1].type, tracked_barrier_transition);
+    CHECK_EQ(barriers[1].before, state_unordered_access);
+}
+
+UNIT_TEST(resource_state_tracker_assume_follows_hand_coded_barriers)
+{
+    resource_state_tracker tracker;
+    tracker.assume(a, state_copy_dest, state_pixel_shader_resource);
+    tracker.require(a, state_pixel_shader_resource);
+    CHECK(!tracker.has_pending());
+    CHECK(tracker.initial_requirements().empty());
+
+    tracker.require(a, state_render_target);
+    std::vector<tracked_barrier> barriers;
+    tracker.flush(&barriers);
+    CHECK_EQ(barriers.size(), (size_t)1);
+    CHECK_EQ(barriers[0].before, state_pixel_shader_resource);
+}
+
+UNIT_TEST(resource_state_registry_patches_lists_in_submission_order)
+{
+    resource_state_registry registry;
+    registry.register_resource(a, state_copy_dest);
+
+    // The first list leaves the resource as a shader resource.
+    resource_state_tracker first;
+    first.require(a, state_render_target);
+    first.require(a, state_pixel_shader_resource);
+    std::vector<tracked_barrier> pending;
+    first.flush(&pending);
+
+    std::vector<tracked_barrier> fixups;
+    registry.resolve(first, &fixups);
+    CHECK_EQ(fixups.size(), (size_t)1);
+    CHECK_EQ(fixups[0].before, state_copy_dest);
+    CHECK_EQ(fixups[0].after, state_render_target);
+    CHECK_EQ(registry.state(a), state_pixel_shader_resource);
+
+    // The second list starts from the state the first one left.
+    resource_state_tracker second;
+    second.require(a, state_pixel_shader_resource);
+    fixups.clear();
+    registry.resolve(second, &fixups);
+    CHECK(fixups.empty());
+
+    // Unregistered resources are not tracked.
+    resource_state_tracker third;
+    third.require(b, state_copy_dest);
+    registry.resolve(third, &fixups);
+    CHECK(fixups.empty());
+    CHECK_EQ(registry.state(b), resource_state_unknown);
+}
+
+UNIT_TEST(resource_state_registry_resolves_subresources)
+{
+    resource_state_registry registry;
+    registry.register_resource(a, state_pixel_shader_resource, 3);
+
+    // Mip 1 is rendered to, the other mips keep their state.
+    resource_state_tracker first;
+    first.require(a, state_render_target, 1, 3);
+    std::vector<tracked_barrier> fixups;
+    registry.resolve(first, &fixups);
+    CHECK_EQ(fixups.size(), (size_t)1);
+    CHECK_EQ(fixups[0].subresource, 1u);
+    CHECK_EQ(registry.state(a, 0), state_pixel_shader_resource);
+    CHECK_EQ(registry.state(a, 1), state_render_target);
+
+    // A list using the whole resource gets one fixup per subresource in the wrong state.
+    resource_state_tracker second;
+    second.require(a, state_copy_source);
+    fixups.clear();
+    registry.resolve(second, &fixups);
+    CHECK_EQ(fixups.size(), (size_t)3);
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        CHECK_EQ(fixups[i].subresource, i);
+        CHECK_EQ(registry.state(a, i), state_copy_source);
+    }
+
+    // Once uniform again, a single barrier covers every subresource.
+    resource_state_tracker third;
+    third.require(a, state_copy_dest);
+    fixups.clear();
+    registry.resolve(third, &fixups);
+    CHECK_EQ(fixups.size(), (size_t)1);
+    CHECK_EQ(fixups[0].subresource, all_subresources);
+}
@@ -0,0 +1,116 @@
+#include "unit_test.h"
+#include "rolling_stats.h"
+#include <algorithm>
+#include <math.h>
+
+static const double max_relative_error = 0.0443; // 2^(1/16) - 1.
+
+UNIT_TEST(rolling_stats_summarizes_the_window)
+{
+    rolling_stats stats;
+    for (int i = 1; i <= 100; i++)
+    {
+        stats.add((double)i);
+    }
+
+    rolling_summary summary = stats.summary();
+    CHECK_EQ(summary.count, 100u);
+    CHECK_NEAR(summary.last, 100.0, 1e-12);
+    CHECK_NEAR(summary.min, 1.0, 1e-12);
+    CHECK_NEAR(summary.max, 100.0, 1e-12);
+    CHECK_NEAR(summary.mean, 50.5, 1e-9);
+    CHECK_NEAR(summary.stddev, sqrt((100.0 * 100.0 - 1.0) / 12.0), 1e-9);
+    CHECK_NEAR(summary.p50, 50.0, 50.0 * max_relative_error);
+    CHECK_NEAR(summary.p95, 95.0, 95.0 * max_relative_error);
+    CHECK_NEAR(summary.p99, 99.0, 99.0 * max_relative_error);
+}
+
+UNIT_TEST(rolling_stats_forgets_the_samples_out_of_the_window)
+{
+    rolling_stats stats(4);
+    double values[] = {10.0, 20.0, 30.0, 40.0, 1.0, 2.0};
+    for (double value : values)
+    {
+        stats.add(value);
+    }
+
+    rolling_summary summary = stats.summary();
+    CHECK_EQ(summary.count, 4u);
+    CHECK_NEAR(summary.last, 2.0, 1e-12);
+    CHECK_NEAR(summary.min, 1.0, 1e-12);
+    CHECK_NEAR(summary.max, 40.0, 1e-12);
+    CHECK_NEAR(summary.mean, 18.25, 1e-9);
+    CHECK(stats.percentile(0.25) <= 1.0 * (1.0 + max_relative_error));
+    CHECK_NEAR(stats.percentile(1.0), 40.0, 1e-12);
+
+    // A large sample that left the window doesn't stay in the sums.
+    rolling_stats drift(8);
+    drift.add(1e12);
+    for (int i = 0; i < 16; i++)
+    {
+        drift.add(1.0);
+    }
+    CHECK_NEAR(drift.summary().mean, 1.0, 1e-12);
+    CHECK_NEAR(drift.summary().stddev, 0.0, 1e-12);
+
+    stats.set_window(16);
+    CHECK_EQ(stats.count(), 0u);
+    CHECK_EQ(stats.window(), 16u);
+}
+
+UNIT_TEST(rolling_stats_percentiles_stay_within_a_bucket_of_the_exact_ones)
+{
+    // Values spread over six orders of magnitude.
+    rolling_stats stats(1000);
+    std::vector<double> values;
+    uint32_t random = 12345;
+    for (int i = 0; i < 3000; i++)
+    {
+        random = random * 1664525u + 1013904223u;
+        double value = 0.001 * pow(10.0, 6.0 * (double)(random >> 8) / (double)(1u << 24));
+        stats.add(value);
+        values.push_back(value);
+    }
+
+    std::vector<double> window(values.end() - 1000, values.end());
+    std::sort(window.begin(), window.end());
+    double fractions[] = {0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99, 0.999};
+    for (double p : fractions)
+    {
+        double exact = window[(size_t)ceil(p * window.size()) - 1];
+        double estimate = stats.percentile(p);
+        CHECK(fabs(estimate - exact) <= exact * max_relative_error);
+    }
+    CHECK_NEAR(stats.percentile(0.0), window.front(), window.front() * max_relative_error);
+    CHECK_NEAR(stats.percentile(1.0), window.back(), 1e-12);
+}
+
+UNIT_TEST(rolling_stats_handles_empty_and_tiny_windows)
+{
+    rolling_stats stats;
+    CHECK_EQ(stats.summary().count, 0u);
+    CHECK_NEAR(stats.percentile(0.5), 0.0, 1e-12);
+
+    // The percentiles are clamped to the exact extremes.
+    stats.add(5.0);
+    CHECK_NEAR(stats.percentile(0.01), 5.0, 1e-12);
+    CHECK_NEAR(stats.percentile(0.99), 5.0, 1e-12);
+
+    // Samples under min_value share the first bucket.
+    stats.clear();
+    for (int i = 0; i < 10; i++)
+    {
+        stats.add(0.0);
+    }
+    stats.add(rolling_stats::min_value / 2.0);
+    CHECK(stats.percentile(0.5) <= rolling_stats::min_value);
+    CHECK_NEAR(stats.percentile(1.0), rolling_stats::min_value / 2.0, 1e-12);
+
+    // A window of zero keeps one sample.
+    rolling_stats single(0);
+    CHECK_EQ(single.window(), 1u);
+    single.add(3.0);
+    single.add(4.0);
+    CHECK_EQ(single.summary().count, 1u);
+    CHECK_NEAR(single.summary().mean, 4.0, 1e-12);
+}
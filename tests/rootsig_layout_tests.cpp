@@ -0,0 +1,191 @@
+#include "unit_test.h"
+#include "rootsig_layout.h"
+
+static shader_binding binding(const char *name, shader_descriptor_type type, uint32_t bind_point,
+                              uint32_t size = 0, uint32_t bind_count = 1, uint32_t space = 0)
+{
+    shader_binding b = {};
+    b.name = name;
+    b.type = type;
+    b.bind_point = bind_point;
+    b.bind_count = bind_count;
+    b.space = space;
+    b.size = size;
+    return b;
+}
+
+// Bindings of pbr_simple.hlsl.
+static std::vector<shader_reflection> pbr_simple_shaders()
+{
+    shader_reflection vs = {VS, "vs_main", {binding("object_cb_vs", CBV, 1, 128)}};
+    shader_reflection ps = {PS, "ps_main", {binding("cb_pass", CBV, 0, 512),
+                                            binding("object_cb_ps", CBV, 1, 32),
+                                            binding("albedo", SRV, 0),
+                                            binding("normal", SRV, 1),
+                                            binding("roughness_metalness", SRV, 2),
+                                            binding("Sampler", sampler, 0)}};
+    return {vs, ps};
+}
+
+static const uint32_t staging_limits[DESCRIPTORTYPE_MAX] = {12, 64, 8, 16};
+
+UNIT_TEST(rootsig_layout_small_constants_go_to_the_root)
+{
+    shader_reflection vs = {VS, "vs_main", {binding("draw_id", CBV, 0, 8), binding("transforms", CBV, 1, 256)}};
+    rootsig_layout layout = build_rootsig_layout({vs});
+
+    int index = layout.find_parameter(CBV, 0, 0, VS);
+    CHECK(index >= 0);
+    CHECK_EQ(layout.parameters[index].type, rootsig_constants);
+    CHECK_EQ(layout.parameters[index].num_32bit_values, 2u);
+
+    // Too big and not hot, it stays in a table.
+    uint32_t table_offset = 99;
+    index = layout.find_parameter(CBV, 1, 0, VS, &table_offset);
+    CHECK(index >= 0);
+    CHECK_EQ(layout.parameters[index].type, rootsig_table);
+    CHECK_EQ(table_offset, 0u);
+    CHECK_EQ(layout.cost_dwords, 2u + 1u);
+}
+
+UNIT_TEST(rootsig_layout_hot_constant_buffers_are_root_cbvs)
+{
+    rootsig_layout_options options;
+    options.hot_constant_buffers = {"object_cb_vs", "object_cb_ps"};
+    rootsig_layout layout = build_rootsig_layout(pbr_simple_shaders(), options);
+
+    int vs_index = layout.find_parameter(CBV, 1, 0, VS);
+    int ps_index = layout.find_parameter(CBV, 1, 0, PS);
+    CHECK(vs_index >= 0 && ps_index >= 0 && vs_index != ps_index);
+    CHECK_EQ(layout.parameters[vs_index].type, rootsig_cbv);
+    CHECK_EQ(layout.parameters[vs_index].visibility, VS);
+    CHECK_EQ(layout.parameters[ps_index].type, rootsig_cbv);
+    CHECK_EQ(layout.parameters[ps_index].visibility, PS);
+
+    // The pass constants and the textures share the pixel shader table, the sampler has its own.
+    uint32_t cb_offset = 0;
+    uint32_t srv_offset = 0;
+    int cb_table = layout.find_parameter(CBV, 0, 0, PS, &cb_offset);
+    int srv_table = layout.find_parameter(SRV, 2, 0, PS, &srv_offset);
+    int sampler_table = layout.find_parameter(sampler, 0, 0, PS);
+    CHECK(cb_table >= 0);
+    CHECK_EQ(cb_table, srv_table);
+    CHECK_EQ(cb_offset, 0u);
+    CHECK_EQ(srv_offset, 3u);
+    CHECK(sampler_table >= 0 && sampler_table != cb_table);
+    CHECK_EQ(layout.table_descriptor_count, 4u);
+    CHECK_EQ(layout.sampler_descriptor_count, 1u);
+    CHECK_EQ(layout.cost_dwords, 2u + 2u + 1u + 1u);
+}
+
+UNIT_TEST(rootsig_layout_merges_registers_shared_by_stages)
+{
+    shader_reflection vs = {VS, "vs_main", {binding("lights", SRV, 0, 0, 4)}};
+    shader_reflection ps = {PS, "ps_main", {binding("lights", SRV, 0, 0, 4), binding("shadows", SRV, 4)}};
+    rootsig_layout layout = build_rootsig_layout({vs, ps});
+
+    int shared = layout.find_parameter(SRV, 3, 0, VS);
+    CHECK(shared >= 0);
+    CHECK_EQ(layout.parameters[shared].visibility, SHADERSTAGE_MAX);
+    CHECK_EQ(layout.parameters[shared].ranges.size(), (size_t)1);
+    CHECK_EQ(layout.parameters[shared].ranges[0].count, 4u);
+
+    int pixel_only = layout.find_parameter(SRV, 4, 0, PS);
+    CHECK(pixel_only >= 0 && pixel_only != shared);
+    CHECK_EQ(layout.find_parameter(SRV, 4, 0, VS), -1);
+}
+
+UNIT_TEST(rootsig_layout_demotes_root_parameters_over_budget)
+{
+    shader_reflection vs = {VS, "vs_main", {binding("a", CBV, 0, 16), binding("b", CBV, 1, 16), binding("c", CBV, 2, 16)}};
+    rootsig_layout_options options;
+    options.max_cost_dwords = 9;
+    rootsig_layout layout = build_rootsig_layout({vs}, options);
+
+    // Two sets of 4 constants fit, the third one goes to a table visible to every stage.
+    CHECK_EQ(layout.parameters[layout.find_parameter(CBV, 0, 0, VS)].type, rootsig_constants);
+    CHECK_EQ(layout.parameters[layout.find_parameter(CBV, 1, 0, VS)].type, rootsig_constants);
+    int demoted = layout.find_parameter(CBV, 2, 0, VS);
+    CHECK(demoted >= 0);
+    CHECK_EQ(layout.parameters[demoted].type, rootsig_table);
+    CHECK_EQ(layout.parameters[demoted].visibility, SHADERSTAGE_MAX);
+    CHECK(layout.cost_dwords <= options.max_cost_dwords);
+}
+
+UNIT_TEST(rootsig_layout_staging_usage_counts_each_stage_and_space)
+{
+    std::vector<shader_reflection> shaders = pbr_simple_shaders();
+    shaders.push_back({CS, "cs_main", {binding("particles", UAV, 2, 0, 1, 20), binding("ignored", UAV, 5, 0, 1, 1)}});
+
+    staging_usage usage = {};
+    CHECK(compute_staging_usage(shaders, 0, staging_limits, &usage));
+    CHECK_EQ(usage.count[VS][CBV], 2u);
+    CHECK_EQ(usage.count[PS][CBV], 2u);
+    CHECK_EQ(usage.count[PS][SRV], 3u);
+    CHECK_EQ(usage.count[PS][sampler], 1u);
+    CHECK_EQ(usage.count[CS][UAV], 0u);
+
+    CHECK(compute_staging_usage(shaders, 20, staging_limits, &usage));
+    CHECK_EQ(usage.count[CS][UAV], 3u);
+    CHECK_EQ(usage.count[PS][CBV], 0u);
+
+    // Registers past the staging tables are clamped and reported.
+    shaders.push_back({PS, "ps_main", {binding("too_far", SRV, 63, 0, 2)}});
+    CHECK(!compute_staging_usage(shaders, 0, staging_limits, &usage));
+    CHECK_EQ(usage.count[PS][SRV], 64u);
+}
+
+UNIT_TEST(rootsig_layout_staging_tables_keep_their_indices)
+{
+    std::vector<shader_reflection> shaders = pbr_simple_shaders();
+    rootsig_layout_options options;
+    options.hot_constant_buffers = {"object_cb_vs", "object_cb_ps"};
+    rootsig_layout layout = build_staging_rootsig_layout(shaders, build_rootsig_layout(shaders, options), 0, staging_limits);
+
+    // Resource and sampler tables of the 5 graphics stages, then the root CBVs.
+    CHECK_EQ(layout.parameters.size(), (size_t)12);
+    for (int stage = VS; stage < CS; stage++)
+    {
+        CHECK_EQ(layout.parameters[stage * 2 + 0].type, rootsig_table);
+        CHECK_EQ(layout.parameters[stage * 2 + 0].visibility, (shader_stages)stage);
+        CHECK_EQ(layout.parameters[stage * 2 + 1].ranges[0].type, sampler);
+    }
+    CHECK_EQ(layout.find_parameter(CBV, 1, 0, VS), 10);
+    CHECK_EQ(layout.find_parameter(CBV, 1, 0, PS), 11);
+    CHECK_EQ(layout.parameters[10].type, rootsig_cbv);
+    CHECK_EQ(layout.cost_dwords, 10u + 2u + 2u);
+
+    // Descriptors keep their offset in the staging table, the SRVs start after the CBVs.
+    uint32_t offset = 0;
+    CHECK_EQ(layout.find_parameter(CBV, 0, 0, PS, &offset), PS * 2);
+    CHECK_EQ(offset, 0u);
+    CHECK_EQ(layout.find_parameter(SRV, 1, 0, PS, &offset), PS * 2);
+    CHECK_EQ(offset, 13u);
+    CHECK_EQ(layout.find_parameter(sampler, 0, 0, PS, &offset), PS * 2 + 1);
+    CHECK_EQ(offset, 0u);
+
+    // The root CBV registers are left out of the tables.
+    const rootsig_parameter &ps_table = layout.parameters[PS * 2];
+    for (const rootsig_range &range : ps_table.ranges)
+    {
+        CHECK(!(range.type == CBV && range.base_register <= 1 && 1 < range.base_register + range.count));
+    }
+}
+
+UNIT_TEST(rootsig_layout_empty_staging_tables_avoid_root_registers)
+{
+    shader_reflection vs = {VS, "vs_main", {binding("object_cb_vs", CBV, 0, 128)}};
+    rootsig_layout_options options;
+    options.hot_constant_buffers = {"object_cb_vs"};
+    rootsig_layout layout = build_staging_rootsig_layout({vs}, build_rootsig_layout({vs}, options), 0, staging_limits);
+
+    // The vertex shader table only holds a placeholder, it can't declare b0 a second time.
+    const rootsig_parameter &vs_table = layout.parameters[VS * 2];
+    CHECK_EQ(vs_table.ranges.size(), (size_t)1);
+    CHECK_EQ(vs_table.ranges[0].base_register, 1u);
+    CHECK_EQ(vs_table.ranges[0].table_offset, 1u);
+    CHECK_EQ(layout.parameters[layout.find_parameter(CBV, 0, 0, VS)].type, rootsig_cbv);
+
+    // The other stages point at b0.
+    CHECK_EQ(layout.parameters[PS * 2].ranges[0].base_register, 0u);
+}
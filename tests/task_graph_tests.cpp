@@ -0,0 +1,124 @@
+#include "unit_test.h"
+#include "task_graph.h"
+#include <atomic>
+#include <thread>
+
+// Whether the task depends on the other one, because of the data or of depends_on() with task_graph_invalid.
+static bool has_dependency(const task_graph &graph, task_graph_handle task, task_graph_handle dependency, task_graph_handle data)
+{
+    for (const task_graph_dependency &d : graph.task(task).dependencies)
+    {
+        if (d.task == dependency && d.data == data)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+UNIT_TEST(task_graph_orders_the_accesses_to_the_data)
+{
+    job_system jobs;
+    jobs.start(3);
+
+    // Each task notes when it ran, the ones that depend on others check that they ran after them.
+    std::atomic<uint32_t> clock{0};
+    uint32_t order[6] = {};
+    task_graph graph;
+    task_graph_handle a = graph.add_data("a");
+    task_graph_handle b = graph.add_data("b");
+    task_graph_handle write_a = graph.add_task("write a", [&]() { order[0] = clock++; });
+    task_graph_handle read_a = graph.add_task("read a", [&]() { order[1] = clock++; });
+    task_graph_handle rewrite_a = graph.add_task("rewrite a", [&]() { order[2] = clock++; });
+    task_graph_handle write_b = graph.add_task("write b", [&]() { order[3] = clock++; });
+    task_graph_handle rewrite_b = graph.add_task("rewrite b", [&]() { order[4] = clock++; });
+    task_graph_handle read_b = graph.add_task("read b", [&]() { order[5] = clock++; });
+    graph.write(write_a, a);
+    graph.read(read_a, a);
+    graph.write(rewrite_a, a);
+    graph.write(write_b, b);
+    graph.write(rewrite_b, b);
+    graph.read(read_b, b);
+    CHECK(graph.compile());
+
+    // Read after write, write after read, write after write.
+    CHECK(has_dependency(graph, read_a, write_a, a));
+    CHECK(has_dependency(graph, rewrite_a, read_a, a));
+    CHECK(has_dependency(graph, rewrite_a, write_a, a));
+    CHECK(has_dependency(graph, rewrite_b, write_b, b));
+    CHECK(has_dependency(graph, read_b, rewrite_b, b));
+
+    // A reader only waits for the last write, the two chains are independent.
+    CHECK(!has_dependency(graph, read_b, write_b, b));
+    CHECK_EQ(graph.task(write_a).dependencies.size(), (size_t)0);
+    CHECK_EQ(graph.task(write_b).dependencies.size(), (size_t)0);
+    CHECK_EQ(graph.m_num_dependencies, 5u);
+
+    for (int run = 0; run < 20; run++)
+    {
+        graph.run(&jobs);
+        CHECK(order[0] < order[1] && order[1] < order[2]);
+        CHECK(order[3] < order[4] && order[4] < order[5]);
+        CHECK(graph.task(read_a).start_ms >= graph.task(write_a).end_ms);
+    }
+    jobs.stop();
+}
+
+UNIT_TEST(task_graph_runs_the_main_thread_tasks_on_the_caller)
+{
+    job_system jobs;
+    jobs.start(3);
+
+    const int num_tasks = 16;
+    std::thread::id threads[num_tasks];
+    task_graph graph;
+    task_graph_handle data = graph.add_data("data");
+    for (int i = 0; i < num_tasks; i++)
+    {
+        // Every other task is a main thread one, the ones that follow a worker task wait for it.
+        task_graph_handle task = graph.add_task("task", [&threads, i]() { threads[i] = std::this_thread::get_id(); }, i % 2 == 1);
+        if (i % 4 < 2)
+        {
+            graph.write(task, data);
+        }
+    }
+    CHECK(graph.compile());
+    graph.run(&jobs);
+
+    for (int i = 1; i < num_tasks; i += 2)
+    {
+        CHECK(threads[i] == std::this_thread::get_id());
+        CHECK(graph.task(i).on_main_thread);
+    }
+    jobs.stop();
+}
+
+UNIT_TEST(task_graph_reports_the_cycles_of_explicit_dependencies)
+{
+    task_graph graph;
+    task_graph_handle first = graph.add_task("first", []() {});
+    task_graph_handle second = graph.add_task("second", []() {});
+    task_graph_handle after = graph.add_task("after", []() {});
+    graph.add_task("independent", []() {});
+
+    // depends_on() can point forward, which is how a cycle can happen.
+    graph.depends_on(first, second);
+    graph.depends_on(second, first);
+    graph.depends_on(after, second);
+
+    // The tasks after the cycle can't run either.
+    std::string error;
+    CHECK(!graph.compile(&error));
+    CHECK(error == "Task graph has a cycle between: \"first\" \"second\" \"after\"");
+    CHECK(has_dependency(graph, first, second, task_graph_invalid));
+
+    // Without the backward edge the graph compiles.
+    graph.reset();
+    first = graph.add_task("first", []() {});
+    second = graph.add_task("second", []() {});
+    graph.depends_on(first, second);
+    error.clear();
+    CHECK(graph.compile(&error));
+    CHECK(error.empty());
+    CHECK(has_dependency(graph, first, second, task_graph_invalid));
+}
@@ -0,0 +1,59 @@
+// Unit tests of the portable files of common, see unit_test.h for the harness.
+//   tests [filter]
+// The tests only use the portable files of common, on other platforms build them with the files they cover, e.g.:
+//   g++ -std=c++17 -I../common tests.cpp *_tests.cpp ../common/render_graph.cpp ../common/resource_state_tracker.cpp ... -lpthread
+#include "unit_test.h"
+#include <stdio.h>
+#include <string.h>
+
+struct unit_test
+{
+    const char *name;
+    unit_test_function function;
+};
+
+static std::vector<unit_test> &unit_tests()
+{
+    static std::vector<unit_test> tests;
+    return tests;
+}
+
+static int g_num_failures = 0;
+
+int register_unit_test(const char *name, unit_test_function function)
+{
+    unit_tests().push_back({name, function});
+    return (int)unit_tests().size() - 1;
+}
+
+void unit_test_failure(const char *file, int line, const std::string &message)
+{
+    printf("    %s(%d): %s\n", file, line, message.c_str());
+    g_num_failures++;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = (argc > 1) ? argv[1] : "";
+
+    int num_run = 0;
+    int num_failed = 0;
+    for (const unit_test &test : unit_tests())
+    {
+        if (strstr(test.name, filter) == nullptr)
+        {
+            continue;
+        }
+
+        int failures_before = g_num_failures;
+        test.function();
+        bool has_failed = g_num_failures != failures_before;
+        printf("[%s] %s\n", has_failed ? "FAILED" : "    OK", test.name);
+
+        num_run++;
+        num_failed += has_failed ? 1 : 0;
+    }
+
+    printf("%d tests, %d failed.\n", num_run, num_failed);
+    return num_failed;
+}
@@ -0,0 +1,167 @@
+#include "unit_test.h"
+#include "trace_capture.h"
+#include "json.h"
+#include "perf_compare.h"
+#include "platform.h"
+#include <stdio.h>
+
+static const char *trace_path = "trace_capture_tests.json";
+
+// A frame with num_scopes scopes of 0.5 ms, every millisecond, alternating between two threads.
+static profile_frame make_frame(uint64_t start_tsc, uint32_t num_scopes)
+{
+    profile_frame frame;
+    frame.start_tsc = start_tsc;
+    frame.thread_names = {"Main thread", "Worker 1"};
+    for (uint32_t i = 0; i < num_scopes; i++)
+    {
+        frame.scopes.push_back({intern_profile_event("Trace scope"), i % 2, 0, (double)i, 0.5});
+    }
+    return frame;
+}
+
+UNIT_TEST(trace_capture_copies_into_the_buffers_of_begin)
+{
+    trace_capture trace;
+    trace.begin(2, 1, 4, 2, 64);
+    CHECK(trace.is_capturing());
+    const trace_event *cpu_events = trace.cpu_events().data();
+    const trace_event *gpu_events = trace.gpu_events().data();
+    CHECK(trace.cpu_events().capacity() >= 4);
+    CHECK(trace.gpu_events().capacity() >= 2);
+
+    // The events that don't fit are dropped and counted, the buffers are never reallocated.
+    uint64_t start_tsc = read_tsc();
+    trace.add_cpu_frame(make_frame(start_tsc, 3));
+    trace.add_cpu_frame(make_frame(start_tsc + 1000, 3));
+    CHECK_EQ(trace.cpu_events().size(), trace.cpu_events().capacity());
+    CHECK_EQ(trace.num_dropped(), (uint32_t)(6 - trace.cpu_events().capacity()));
+    CHECK(trace.cpu_events().data() == cpu_events);
+
+    uint32_t dropped = trace.num_dropped();
+    profile_event_id timer = intern_profile_event("Trace GPU timer");
+    trace.add_gpu_event(0, timer, 0, -20.0, -10.0); // Work of a frame before the capture, not an event.
+    for (uint32_t i = 0; i < trace.gpu_events().capacity() + 1; i++)
+    {
+        trace.add_gpu_event(0, timer, 0, 10.0 * i, 10.0 * i + 5.0);
+    }
+    CHECK_EQ(trace.num_dropped(), dropped + 1);
+    CHECK(trace.gpu_events().data() == gpu_events);
+
+    // The frames after the captured ones are ignored, the capture ends once the GPU caught up.
+    trace.add_cpu_frame(make_frame(start_tsc + 2000, 3));
+    CHECK_EQ(trace.num_dropped(), dropped + 1);
+    trace.end_gpu_frame();
+    CHECK(trace.is_capturing());
+    trace.end_gpu_frame();
+    CHECK(trace.is_complete());
+    size_t num_gpu_events = trace.gpu_events().size();
+    trace.add_gpu_event(0, timer, 0, 100.0, 110.0);
+    CHECK_EQ(trace.gpu_events().size(), num_gpu_events);
+}
+
+UNIT_TEST(trace_capture_chrome_json_is_what_perf_compare_reads)
+{
+    trace_capture trace;
+    trace.begin(2, 0);
+    trace.set_gpu_track_name(0, "Direct queue");
+    uint64_t start_tsc = read_tsc();
+    uint64_t start_ticks = clock_ticks();
+    trace.add_cpu_frame(make_frame(start_tsc, 4));
+    render_counter_frame counters;
+    counters.totals.values[counter_draws] = 12;
+    trace.add_render_counters(counters);
+    trace.add_present(start_ticks + clock_frequency() / 100);
+    trace.add_cpu_frame(make_frame(start_tsc + 1000000, 4));
+    trace.add_present(start_ticks + clock_frequency() / 50);
+    trace.add_present(start_ticks + clock_frequency() / 20);
+    profile_event_id timer = intern_profile_event("Trace GPU timer");
+    trace.add_gpu_event(0, timer, 1, 100.0, 350.0);
+    trace.add_gpu_event(0, timer, 1, 1100.0, 1350.0);
+    trace.end_gpu_frame();
+    CHECK(trace.is_complete());
+
+    // Complete events: the CPU is process 1 with the category cpu, the GPU process 2 with the category gpu.
+    json_value root;
+    std::string error;
+    CHECK(json_parse(trace.to_chrome_json(), &root, &error));
+    const json_value *events = root.find("traceEvents");
+    CHECK(events != nullptr && events->type == json_array);
+    if (!events)
+    {
+        return;
+    }
+    uint32_t num_cpu = 0;
+    uint32_t num_gpu = 0;
+    uint32_t num_frames = 0;
+    uint32_t num_presents = 0;
+    uint32_t num_counters = 0;
+    bool has_queue_name = false;
+    for (const json_value &event : events->array)
+    {
+        std::string phase = event.get_string("ph");
+        std::string name = event.get_string("name");
+        if (phase == "X")
+        {
+            bool is_gpu = event.get_string("cat") == "gpu";
+            CHECK(is_gpu || event.get_string("cat") == "cpu");
+            CHECK_EQ(event.get_number("pid"), is_gpu ? 2.0 : 1.0);
+            CHECK(event.find("ts") && event.find("dur") && event.find("tid"));
+            CHECK(name == (is_gpu ? "Trace GPU timer" : "Trace scope"));
+            CHECK_NEAR(event.get_number("dur"), is_gpu ? 250.0 : 500.0, 1e-3);
+            num_cpu += is_gpu ? 0 : 1;
+            num_gpu += is_gpu ? 1 : 0;
+        }
+        else if (phase == "i")
+        {
+            num_frames += name.compare(0, 6, "Frame ") == 0 ? 1 : 0;
+            num_presents += name == "Present" ? 1 : 0;
+        }
+        else if (phase == "C")
+        {
+            num_counters++;
+        }
+        else if (phase == "M" && name == "thread_name" && event.get_number("pid") == 2.0)
+        {
+            const json_value *args = event.find("args");
+            has_queue_name |= args && args->get_string("name") == "Direct queue";
+        }
+    }
+    CHECK_EQ(num_cpu, 8u);
+    CHECK_EQ(num_gpu, 2u);
+    CHECK_EQ(num_frames, 2u);
+    CHECK_EQ(num_presents, 3u);
+    CHECK_EQ(num_counters, (uint32_t)render_counter_count);
+    CHECK(has_queue_name);
+
+    // The series perf_compare makes of the saved trace, in ms.
+    CHECK(trace.save(trace_path, trace_format_chrome_json, &error));
+    std::vector<perf_series> series;
+    CHECK(load_perf_series(trace_path, &series, false, &error));
+    remove(trace_path);
+    bool has_cpu = false;
+    bool has_gpu = false;
+    bool has_presents = false;
+    for (const perf_series &s : series)
+    {
+        if (s.name == "CPU Trace scope")
+        {
+            has_cpu = s.samples.size() == 8 && s.unit == "ms";
+            CHECK_NEAR(s.samples[0], 0.5, 1e-6);
+        }
+        else if (s.name == "GPU Trace GPU timer")
+        {
+            has_gpu = s.samples.size() == 2;
+            CHECK_NEAR(s.samples[0], 0.25, 1e-6);
+        }
+        else if (s.name == "Present interval")
+        {
+            has_presents = s.samples.size() == 2;
+            CHECK_NEAR(s.samples[0], 10.0, 1e-2);
+            CHECK_NEAR(s.samples[1], 30.0, 1e-2);
+        }
+    }
+    CHECK(has_cpu);
+    CHECK(has_gpu);
+    CHECK(has_presents);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Small unit test harness for the portable files of common.
+// A test is a function registered with UNIT_TEST(), the checks record a failure and let the test continue:
+//   UNIT_TEST(render_graph_culls_unused_passes) { ... CHECK(graph.is_culled(pass)); CHECK_EQ(count, 2u); }
+// The runner executes every test whose name contains the filter given on the command line, prints one line per
+// test and the checks that failed, and returns the number of failed tests.
+//   tests [filter]
+
+typedef void (*unit_test_function)();
+
+int register_unit_test(const char *name, unit_test_function function);
+
+// Called by the checks, the file and line are printed with the failed expression.
+void unit_test_failure(const char *file, int line, const std::string &message);
+
+#define UNIT_TEST(name)                                                 \
+    static void name();                                                 \
+    static int unit_test_##name = register_unit_test(#name, name);      \
+    static void name()
+
+#define CHECK(expression)                                               \
+    do                                                                  \
+    {                                                                   \
+        if (!(expression))                                              \
+        {                                                               \
+            unit_test_failure(__FILE__, __LINE__, #expression);         \
+        }                                                               \
+    } while (0)
+
+// Prints both values when they differ, they need an std::to_string() overload.
+#define CHECK_EQ(a, b)                                                                                   \
+    do                                                                                                   \
+    {                                                                                                    \
+        auto unit_test_a = (a);                                                                          \
+        auto unit_test_b = (b);                                                                          \
+        if (!(unit_test_a == unit_test_b))                                                               \
+        {                                                                                                \
+            unit_test_failure(__FILE__, __LINE__, std::string(#a " == " #b ", ") +                       \
+                                                      std::to_string(unit_test_a) + " != " +             \
+                                                      std::to_string(unit_test_b));                      \
+        }                                                                                                \
+    } while (0)
+
+// Floating point comparison with an absolute tolerance.
+#define CHECK_NEAR(a, b, tolerance)                                                                      \
+    do                                                                                                   \
+    {                                                                                                    \
+        double unit_test_a = (double)(a);                                                                \
+        double unit_test_b = (double)(b);                                                                \
+        double unit_test_difference = unit_test_a > unit_test_b ? unit_test_a - unit_test_b             \
+                                                                : unit_test_b - unit_test_a;             \
+        if (!(unit_test_difference <= (tolerance)))                                                      \
+        {                                                                                                \
+            unit_test_failure(__FILE__, __LINE__, std::string(#a " ~= " #b ", ") +                       \
+                                                      std::to_string(unit_test_a) + " != " +             \
+                                                      std::to_string(unit_test_b));                      \
+        }                                                                                                \
+    } while (0)